@@ -0,0 +1,266 @@
+/**
+ * bench_arena.c - Snapshot allocations with and without the arena
+ *
+ * Counts malloc/calloc/realloc/free calls (by interposing them) and
+ * measures the time of loading and freeing a snapshot:
+ * - peers.json: peers_file_load()/peers_file_free(), against a copy of
+ *   the previous loader that strdup()ed every string
+ * - mgmt_config_t: building a snapshot of the same peers field by field
+ *   with strdup() and freeing it field by field, against the arena
+ * The cJSON tree is counted separately; it is the same in both cases.
+ *
+ * Usage: ./bench_arena [peers] [allowed_ips_per_peer]   (defaults: 50000, 2)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "peers_file.h"
+#include "mgmt_client.h"
+#include <cjson/cJSON.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Allocation counters; every allocation in the process goes through these */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void __libc_free(void *p);
+
+static uint64_t g_allocs, g_frees;
+
+void *malloc(size_t size) {
+    g_allocs++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    g_allocs++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+    g_allocs += p == NULL;
+    return __libc_realloc(p, size);
+}
+
+void free(void *p) {
+    g_frees += p != NULL;
+    __libc_free(p);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+    double load_s;
+    double free_s;
+} cost_t;
+
+static void print_cost(const char *label, const cost_t *c, const cost_t *base, int peers) {
+    uint64_t allocs = c->allocs - (base ? base->allocs : 0);
+    uint64_t frees = c->frees - (base ? base->frees : 0);
+    printf("  %-22s %9llu allocs %9llu frees  %6.2f per peer   load %7.2f ms   free %6.2f ms\n",
+           label, (unsigned long long)allocs, (unsigned long long)frees, (double)allocs / peers,
+           c->load_s * 1e3, c->free_s * 1e3);
+}
+
+/* The loader before the arena: one allocation per string and array */
+static peers_file_t* legacy_load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *json = malloc(size + 1);
+    size_t n = fread(json, 1, size, fp);
+    json[n] = '\0';
+    fclose(fp);
+    cJSON *root = cJSON_Parse(json);
+    free(json);
+
+    peers_file_t *pf = calloc(1, sizeof(peers_file_t));
+    cJSON *array = cJSON_GetObjectItem(root, "peers");
+    pf->peers = calloc(cJSON_GetArraySize(array), sizeof(peers_file_peer_t));
+    for (cJSON *pj = array->child; pj; pj = pj->next) {
+        peers_file_peer_t *p = &pf->peers[pf->peer_count++];
+        p->id = strdup(cJSON_GetObjectItem(pj, "id")->valuestring);
+        p->public_key = strdup(cJSON_GetObjectItem(pj, "publicKey")->valuestring);
+        p->endpoint = strdup(cJSON_GetObjectItem(pj, "endpoint")->valuestring);
+        p->keepalive = cJSON_GetObjectItem(pj, "keepalive")->valueint;
+        cJSON *ips = cJSON_GetObjectItem(pj, "allowedIPs");
+        p->allowed_ips_count = cJSON_GetArraySize(ips);
+        p->allowed_ips = calloc(p->allowed_ips_count, sizeof(char *));
+        int j = 0;
+        for (cJSON *ip = ips->child; ip; ip = ip->next) {
+            p->allowed_ips[j++] = strdup(ip->valuestring);
+        }
+    }
+    cJSON_Delete(root);
+    return pf;
+}
+
+static void legacy_free(peers_file_t *pf) {
+    for (int i = 0; i < pf->peer_count; i++) {
+        free(pf->peers[i].id);
+        free(pf->peers[i].public_key);
+        free(pf->peers[i].endpoint);
+        nb_free_string_array(pf->peers[i].allowed_ips, pf->peers[i].allowed_ips_count);
+    }
+    free(pf->peers);
+    free(pf);
+}
+
+/* Build a mgmt snapshot of the file's peers, each string copied */
+static mgmt_config_t* mgmt_build(const peers_file_t *pf, int arena) {
+    mgmt_config_t *c = calloc(1, sizeof(mgmt_config_t));
+    nb_arena_init(&c->arena, arena ? (size_t)pf->peer_count * 160 : 0);
+    c->peers = arena ? nb_arena_calloc(&c->arena, pf->peer_count, sizeof(mgmt_peer_t))
+                     : calloc(pf->peer_count, sizeof(mgmt_peer_t));
+    c->routes = arena ? nb_arena_calloc(&c->arena, pf->peer_count, sizeof(char *))
+                      : calloc(pf->peer_count, sizeof(char *));
+    for (int i = 0; i < pf->peer_count; i++) {
+        const peers_file_peer_t *p = &pf->peers[i];
+        mgmt_peer_t *m = &c->peers[c->peer_count++];
+        if (arena) {
+            m->id = nb_arena_strdup(&c->arena, p->id);
+            m->public_key = nb_arena_strdup(&c->arena, p->public_key);
+            m->endpoint = nb_arena_strdup(&c->arena, p->endpoint);
+            m->allowed_ips = nb_arena_strdup(&c->arena, p->allowed_ips[0]);
+            c->routes[c->route_count++] = nb_arena_strdup(&c->arena, p->allowed_ips[p->allowed_ips_count - 1]);
+        } else {
+            m->id = strdup(p->id);
+            m->public_key = strdup(p->public_key);
+            m->endpoint = strdup(p->endpoint);
+            m->allowed_ips = strdup(p->allowed_ips[0]);
+            c->routes[c->route_count++] = strdup(p->allowed_ips[p->allowed_ips_count - 1]);
+        }
+    }
+    return c;
+}
+
+static void mgmt_legacy_free(mgmt_config_t *c) {
+    for (int i = 0; i < c->peer_count; i++) {
+        free(c->peers[i].id);
+        free(c->peers[i].public_key);
+        free(c->peers[i].endpoint);
+        free(c->peers[i].allowed_ips);
+    }
+    free(c->peers);
+    nb_free_string_array(c->routes, c->route_count);
+    free(c);
+}
+
+/* Reset the counters and clock before a measured step */
+#define MEASURE_BEGIN(c)    do { g_allocs = g_frees = 0; t0 = now_sec(); } while (0)
+#define MEASURE_LOAD(c)     do { (c).load_s = now_sec() - t0; t0 = now_sec(); } while (0)
+#define MEASURE_END(c)      do { (c).free_s = now_sec() - t0; (c).allocs = g_allocs; (c).frees = g_frees; } while (0)
+
+int main(int argc, char *argv[]) {
+    int peers = argc > 1 ? atoi(argv[1]) : 50000;
+    int ips = argc > 2 ? atoi(argv[2]) : 2;
+    char path[64];
+    double t0;
+
+    if (peers <= 0) peers = 50000;
+    if (ips <= 0) ips = 2;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Snapshot Arena Benchmark (%d peers)\n", peers);
+    printf("================================================================================\n\n");
+
+    snprintf(path, sizeof(path), "/tmp/nb-bench-arena-%d.json", getpid());
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        printf("ERROR: cannot write %s\n", path);
+        return 1;
+    }
+    fprintf(f, "{\"updatedAt\": \"2026-10-16T00:00:00Z\", \"peers\": [\n");
+    for (int i = 0; i < peers; i++) {
+        fprintf(f, "  {\"id\": \"peer-%08d\", \"publicKey\": \"%043dA=\", \"endpoint\": \"198.51.%d.%d:51820\", "
+                "\"keepalive\": 25, \"allowedIPs\": [", i, i, (i >> 8) & 255, i & 255);
+        for (int j = 0; j < ips; j++) {
+            fprintf(f, "%s\"10.%d.%d.%d/32\"", j ? ", " : "", j, (i >> 8) & 255, i & 255);
+        }
+        fprintf(f, "]}%s\n", i + 1 < peers ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+
+    /* Warm up the page cache and the allocator */
+    peers_file_t *pf = legacy_load(path);
+    legacy_free(pf);
+
+    /* The JSON tree alone, common to both loaders */
+    cost_t tree, legacy, arena, mgmt_legacy, mgmt_arena;
+    FILE *fp = fopen(path, "r");
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *json = __libc_malloc(size + 1);
+    size_t n = fread(json, 1, size, fp);
+    json[n] = '\0';
+    fclose(fp);
+    MEASURE_BEGIN(tree);
+    cJSON *root = cJSON_Parse(json);
+    MEASURE_LOAD(tree);
+    cJSON_Delete(root);
+    MEASURE_END(tree);
+    __libc_free(json);
+
+    MEASURE_BEGIN(legacy);
+    pf = legacy_load(path);
+    MEASURE_LOAD(legacy);
+    legacy_free(pf);
+    MEASURE_END(legacy);
+
+    MEASURE_BEGIN(arena);
+    if (peers_file_load(path, &pf) != NB_SUCCESS) {
+        printf("ERROR: peers_file_load failed\n");
+        return 1;
+    }
+    MEASURE_LOAD(arena);
+    int blocks = pf->arena.blocks;
+    size_t used = pf->arena.used, reserved = pf->arena.reserved;
+    int loaded = pf->peer_count;
+    peers_file_free(pf);
+    MEASURE_END(arena);
+
+    printf("[peers.json] %d peers, %d allowed IPs each, %.1f MB\n", peers, ips, size / 1e6);
+    print_cost("cJSON tree (both)", &tree, NULL, peers);
+    print_cost("strdup per string", &legacy, &tree, peers);
+    print_cost("arena", &arena, &tree, peers);
+    printf("  (snapshot only; load/free times include the tree)\n");
+    printf("  arena: %d peers in %d block(s), %.1f of %.1f MB used\n\n",
+           loaded, blocks, used / 1e6, reserved / 1e6);
+
+    /* mgmt_config_t snapshots of the same peers */
+    pf = legacy_load(path);
+    MEASURE_BEGIN(mgmt_legacy);
+    mgmt_config_t *mc = mgmt_build(pf, 0);
+    MEASURE_LOAD(mgmt_legacy);
+    mgmt_legacy_free(mc);
+    MEASURE_END(mgmt_legacy);
+
+    MEASURE_BEGIN(mgmt_arena);
+    mc = mgmt_build(pf, 1);
+    MEASURE_LOAD(mgmt_arena);
+    mgmt_config_free(mc);
+    MEASURE_END(mgmt_arena);
+    legacy_free(pf);
+
+    printf("[mgmt_config_t] %d peers, 4 strings each plus one route\n", peers);
+    print_cost("strdup per string", &mgmt_legacy, NULL, peers);
+    print_cost("arena", &mgmt_arena, NULL, peers);
+    printf("\n");
+
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * bench_curve25519.c - Key generation and derivation throughput
+ *
+ * Measures X25519 public key derivation, the full cold-start key setup
+ * (wg_generate_private_key + wg_get_public_key) and, when the wg tool is
+ * installed, the old `wg genkey | wg pubkey` path for comparison.
+ *
+ * Usage: ./bench_curve25519 [iterations]   (default: 20000)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "wg_key.h"
+#include "wg_iface.h"
+#include "curve25519.h"
+#include <time.h>
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+    if (iterations <= 0) iterations = 20000;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Curve25519 Benchmark (%s)\n", curve25519_impl());
+    printf("================================================================================\n\n");
+
+    /* Derivation: chain outputs so the compiler cannot hoist the work */
+    uint8_t key[WG_KEY_LEN] = { 1 };
+    uint8_t pub[WG_KEY_LEN];
+    double t0 = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        wg_key_derive_public(pub, key);
+        memcpy(key, pub, sizeof(key));
+    }
+    double t1 = now_sec();
+    printf("  derive public: %8.3f s  %10.0f keys/s  %8.2f us/key\n",
+           t1 - t0, iterations / (t1 - t0), (t1 - t0) * 1e6 / iterations);
+
+    /* Cold start: what cmd_up does when no key is configured */
+    fflush(stdout);
+    FILE *saved = stdout;
+    stdout = fopen("/dev/null", "w");
+
+    int setup_iters = iterations / 10 > 0 ? iterations / 10 : 1;
+    int failures = 0;
+    t0 = now_sec();
+    for (int i = 0; i < setup_iters; i++) {
+        char *priv = NULL, *pubkey = NULL;
+        if (wg_generate_private_key(&priv) != NB_SUCCESS ||
+            wg_get_public_key(priv, &pubkey) != NB_SUCCESS) {
+            failures++;
+        }
+        free(priv);
+        free(pubkey);
+    }
+    t1 = now_sec();
+
+    fclose(stdout);
+    stdout = saved;
+
+    printf("  key setup:     %8.3f s  %10.0f keys/s  %8.2f us/key\n",
+           t1 - t0, setup_iters / (t1 - t0), (t1 - t0) * 1e6 / setup_iters);
+
+    /* Reference: the previous fork/exec based implementation */
+    if (system("command -v wg >/dev/null 2>&1") == 0) {
+        int shell_iters = 50;
+        t0 = now_sec();
+        for (int i = 0; i < shell_iters; i++) {
+            if (system("wg genkey | wg pubkey >/dev/null") != 0) {
+                failures++;
+            }
+        }
+        t1 = now_sec();
+        printf("  wg genkey|pubkey: %5.3f s  %10.0f keys/s  %8.2f us/key\n",
+               t1 - t0, shell_iters / (t1 - t0), (t1 - t0) * 1e6 / shell_iters);
+    } else {
+        printf("  (wg tool not installed, skipping shell comparison)\n");
+    }
+
+    if (failures) {
+        printf("  WARNING: %d operation(s) failed\n", failures);
+    }
+    printf("\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,360 @@
+/**
+ * bench_forward.c - Forwarding throughput of a routing peer, flowtable offload off vs on
+ *
+ * Three network namespaces connected by veth pairs:
+ *
+ *   client 10.201.0.2 --- fwd0 [router] fwd2 --- 10.202.0.2 server
+ *
+ * The router (this process) plays the routing peer: fwd0 stands in for
+ * the WireGuard device, fwd2 for the LAN, which is masqueraded (the
+ * server has no route back to the client). Measures, with the flowtable
+ * off and on:
+ * - a single TCP stream from client to server (Gbit/s)
+ * - TCP request/response with one-byte messages (transactions/s), where
+ *   the per-packet cost of the forward path dominates
+ *
+ * Usage: sudo ./bench_forward [seconds]
+ *        (default: 3 seconds per measurement)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#define _GNU_SOURCE
+#include "common.h"
+#include "route.h"
+#include <sched.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define FWD_DEV         "fwd0"      /* Router side towards the client ("WireGuard") */
+#define LAN_DEV         "fwd2"      /* Router side towards the server (LAN) */
+#define SERVER_ADDR     "10.202.0.2"
+#define STREAM_PORT     5201
+#define RR_PORT         5202
+#define STREAM_CHUNK    (128 * 1024)
+
+enum { MODE_STREAM = 1, MODE_RR = 2, MODE_QUIT = 3 };
+
+/* One measurement, reported by the client */
+typedef struct {
+    uint64_t bytes;
+    uint64_t transactions;
+    double seconds;
+} fwd_result_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* INFO logs go to stdout; hide them while timing */
+static int quiet_begin(void) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    return saved;
+}
+
+static void quiet_end(int saved) {
+    fflush(stdout);
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return NB_ERROR;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return NB_SUCCESS;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return NB_ERROR;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return NB_SUCCESS;
+}
+
+/*
+ * Fork a child in a network namespace of its own. The child waits on
+ * *ctl_out until the parent moved its veth end in, then configures it
+ * with setup (shell commands).
+ */
+static pid_t spawn_ns(int *ctl_out, int *res_out, const char *setup, void (*run)(int, int)) {
+    int ctl[2], res[2];
+    if (pipe(ctl) != 0 || pipe(res) != 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        close(ctl[1]);
+        close(res[0]);
+        char go = 0;
+        if (unshare(CLONE_NEWNET) != 0 || write_full(res[1], &go, 1) != NB_SUCCESS ||
+            read_full(ctl[0], &go, 1) != NB_SUCCESS || system(setup) != 0) {
+            _exit(1);
+        }
+        write_full(res[1], &go, 1);
+        run(ctl[0], res[1]);
+        _exit(0);
+    }
+    close(ctl[0]);
+    close(res[1]);
+    *ctl_out = ctl[1];
+    *res_out = res[0];
+    return pid;
+}
+
+static int listen_on(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons(port) };
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, 8) != 0) {
+        return -1;
+    }
+    return fd;
+}
+
+/* Server: drain streams, echo request/response bytes, until killed */
+static void server_run(int ctl, int res) {
+    (void)ctl;
+    (void)res;
+    int stream = listen_on(STREAM_PORT);
+    int rr = listen_on(RR_PORT);
+    static uint8_t buf[STREAM_CHUNK];
+
+    if (stream < 0 || rr < 0) {
+        _exit(1);
+    }
+    setpgid(0, 0);      /* The parent kills both processes at once */
+    if (fork() == 0) {
+        for (;;) {
+            int fd = accept(rr, NULL, NULL);
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            uint8_t b;
+            while (read(fd, &b, 1) == 1 && write(fd, &b, 1) == 1) {
+            }
+            close(fd);
+        }
+    }
+    for (;;) {
+        int fd = accept(stream, NULL, NULL);
+        while (read(fd, buf, sizeof(buf)) > 0) {
+        }
+        close(fd);
+    }
+}
+
+static int connect_to(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons(port) };
+    inet_pton(AF_INET, SERVER_ADDR, &sa.sin_addr);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Client: run the measurement the parent asks for and report it */
+static void client_run(int ctl, int res) {
+    static uint8_t buf[STREAM_CHUNK];
+    uint8_t mode;
+    double seconds;
+
+    while (read_full(ctl, &mode, 1) == NB_SUCCESS && mode != MODE_QUIT &&
+           read_full(ctl, &seconds, sizeof(seconds)) == NB_SUCCESS) {
+        fwd_result_t r = { 0 };
+        int fd = connect_to(mode == MODE_STREAM ? STREAM_PORT : RR_PORT);
+        if (fd >= 0) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            double t0 = now_sec();
+            double t = t0;
+            while (t - t0 < seconds) {
+                if (mode == MODE_STREAM) {
+                    ssize_t n = write(fd, buf, sizeof(buf));
+                    if (n <= 0) break;
+                    r.bytes += (uint64_t)n;
+                } else {
+                    /* Check the clock every 64 transactions */
+                    int i;
+                    for (i = 0; i < 64; i++) {
+                        uint8_t b = 'x';
+                        if (write(fd, &b, 1) != 1 || read(fd, &b, 1) != 1) break;
+                    }
+                    r.transactions += (uint64_t)i;
+                    if (i < 64) break;
+                }
+                t = now_sec();
+            }
+            r.seconds = t - t0;
+            close(fd);
+        }
+        write_full(res, &r, sizeof(r));
+    }
+}
+
+static int measure(int ctl, int res, uint8_t mode, double seconds, fwd_result_t *r) {
+    if (write_full(ctl, &mode, 1) != NB_SUCCESS || write_full(ctl, &seconds, sizeof(seconds)) != NB_SUCCESS ||
+        read_full(res, r, sizeof(*r)) != NB_SUCCESS || r->seconds <= 0) {
+        return NB_ERROR;
+    }
+    return NB_SUCCESS;
+}
+
+static void bench_mode(const char *label, int ctl, int res, double seconds) {
+    fwd_result_t stream, rr;
+
+    if (measure(ctl, res, MODE_STREAM, seconds, &stream) != NB_SUCCESS ||
+        measure(ctl, res, MODE_RR, seconds, &rr) != NB_SUCCESS) {
+        printf("  %-14s FAILED: no connection through the router\n", label);
+        return;
+    }
+    printf("  %-14s stream %7.2f Gbit/s   request/response %9.0f trans/s\n", label,
+           stream.bytes * 8 / stream.seconds / 1e9, rr.transactions / rr.seconds);
+}
+
+/* Move a veth end into the namespace of pid and let the child configure it */
+static int hand_over(const char *dev, pid_t pid, int ctl, int res) {
+    char cmd[128];
+    char b;
+
+    if (read_full(res, &b, 1) != NB_SUCCESS) {
+        return NB_ERROR;
+    }
+    snprintf(cmd, sizeof(cmd), "ip link set %s netns %d", dev, (int)pid);
+    if (system(cmd) != 0 || write_full(ctl, &b, 1) != NB_SUCCESS || read_full(res, &b, 1) != NB_SUCCESS) {
+        return NB_ERROR;
+    }
+    return NB_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+    int client_ctl = -1, client_res = -1, server_ctl = -1, server_res = -1;
+    pid_t client = -1, server = -1;
+    route_manager_t *mgr = NULL;
+    int saved;
+    int ret = 1;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Forwarding Benchmark (flowtable offload)\n");
+    printf("================================================================================\n\n");
+
+    if (geteuid() != 0) {
+        printf("  SKIPPED: must be run as root\n\n");
+        return 0;
+    }
+    if (seconds <= 0) {
+        seconds = 3.0;
+    }
+    if (unshare(CLONE_NEWNET) != 0) {
+        printf("  SKIPPED: cannot create a network namespace (%s)\n\n", strerror(errno));
+        return 0;
+    }
+    if (system("ip link set lo up && "
+               "ip link add " FWD_DEV " type veth peer name fwd1 && "
+               "ip link add " LAN_DEV " type veth peer name fwd3 && "
+               "ip addr add 10.201.0.1/24 dev " FWD_DEV " && ip link set " FWD_DEV " up && "
+               "ip addr add 10.202.0.1/24 dev " LAN_DEV " && ip link set " LAN_DEV " up") != 0) {
+        printf("  FAILED: could not create veth devices\n\n");
+        return 1;
+    }
+
+    client = spawn_ns(&client_ctl, &client_res,
+                      "ip link set lo up && ip addr add 10.201.0.2/24 dev fwd1 && ip link set fwd1 up && "
+                      "ip route add default via 10.201.0.1", client_run);
+    server = spawn_ns(&server_ctl, &server_res,
+                      "ip link set lo up && ip addr add " SERVER_ADDR "/24 dev fwd3 && ip link set fwd3 up",
+                      server_run);
+    if (client < 0 || server < 0 ||
+        hand_over("fwd1", client, client_ctl, client_res) != NB_SUCCESS ||
+        hand_over("fwd3", server, server_ctl, server_res) != NB_SUCCESS) {
+        printf("  FAILED: could not set up the client and server namespaces\n\n");
+        goto out;
+    }
+
+    /* The routing peer: forwarding and masquerade towards the LAN */
+    saved = quiet_begin();
+    mgr = route_manager_new_backend(FWD_DEV, ROUTE_BACKEND_NETLINK);
+    int masq = mgr ? route_enable_masquerade(mgr, LAN_DEV) : NB_ERROR;
+    quiet_end(saved);
+    if (masq != NB_SUCCESS) {
+        printf("  FAILED: could not masquerade " LAN_DEV "\n\n");
+        goto out;
+    }
+    usleep(200000);     /* Let the servers listen */
+
+    printf("[forward] client -> " FWD_DEV " -> " LAN_DEV " (masquerade) -> server, %.1f s each\n", seconds);
+    bench_mode("offload off", client_ctl, client_res, seconds);
+
+    const char *lan = LAN_DEV;
+    saved = quiet_begin();
+    int offload = route_enable_offload(mgr, &lan, 1);
+    quiet_end(saved);
+    if (offload != NB_SUCCESS) {
+        printf("  %-14s SKIPPED: flowtables not supported by this kernel (nf_flow_table)\n", "offload on");
+    } else {
+        bench_mode("offload on", client_ctl, client_res, seconds);
+    }
+    printf("\n");
+    ret = 0;
+
+out:
+    if (client_ctl >= 0) {
+        uint8_t quit = MODE_QUIT;
+        write_full(client_ctl, &quit, 1);
+    }
+    if (server > 0) {
+        kill(-server, SIGKILL);
+        kill(server, SIGKILL);
+    }
+    if (client > 0) {
+        waitpid(client, NULL, 0);
+    }
+    if (server > 0) {
+        waitpid(server, NULL, 0);
+    }
+    if (mgr) {
+        saved = quiet_begin();
+        route_remove_all(mgr);
+        route_manager_free(mgr);
+        quiet_end(saved);
+    }
+    return ret;
+}
@@ -0,0 +1,198 @@
+/**
+ * bench_journal.c - Catching up through the journal versus reloading the snapshot
+ *
+ * An engine that missed K single-peer updates to an N-peer map either
+ * reloads the whole map (peers_snap_open() and a walk over every peer, the
+ * input of the full diff) or reads the K journal records after the last
+ * one it applied and copies each peer out. Both are timed for growing K:
+ * - tail: the journal is open and K records were appended since
+ * - reopen: the journal is opened again (a compacted one or a restart) and
+ *   the records up to the last applied one are skipped first
+ * The reconcile with the device that follows is not included; for the
+ * reload it is proportional to N, for the journal to K.
+ *
+ * Usage: ./bench_journal [peers] [rounds]   (defaults: 100000, 5)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "journal.h"
+#include "peers_snap.h"
+#include "wg_key.h"
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <time.h>
+
+#define SKIPPED 10000
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A NB_DELTA_PEER_SET payload for peer i */
+typedef struct {
+    peers_snap_peer_t peer;
+    nb_prefix_t prefixes[2];
+} peer_set_t;
+
+static void make_peer(peer_set_t *set, int i, int port) {
+    memset(set, 0, sizeof(*set));
+    memcpy(set->peer.public_key, &i, sizeof(i));
+    set->peer.public_key[31] = 0x5a;
+    set->peer.endpoint_family = AF_INET;
+    set->peer.endpoint_addr[0] = 198;
+    set->peer.endpoint_addr[1] = 51;
+    set->peer.endpoint_addr[2] = (i >> 8) & 255;
+    set->peer.endpoint_addr[3] = i & 255;
+    set->peer.endpoint_port = htons((uint16_t)port);
+    set->peer.keepalive = 25;
+    set->peer.prefix_count = 2;
+    set->prefixes[0] = (nb_prefix_t){ .family = AF_INET, .len = 32,
+                                      .addr = { 100, 64 + (i >> 16), (i >> 8) & 255, i & 255 } };
+    set->prefixes[1] = (nb_prefix_t){ .family = AF_INET, .len = 24,
+                                      .addr = { 10, (i >> 8) & 255, i & 255, 0 } };
+}
+
+/* Read records after seq until the end; the engine copies each peer out */
+static int replay(nb_journal_t *j, uint64_t seq, volatile uint32_t *sink) {
+    const nb_journal_record_t *rec;
+    int n = 0, ret;
+    while ((ret = nb_journal_next(j, &rec)) == 1) {
+        if (rec->seq <= seq) continue;
+        peer_set_t set;
+        memcpy(&set, rec + 1, sizeof(set));
+        *sink += set.peer.public_key[0] + set.prefixes[0].addr[3];
+        n++;
+    }
+    return ret < 0 ? ret : n;
+}
+
+int main(int argc, char *argv[]) {
+    int peers = argc > 1 ? atoi(argv[1]) : 100000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    char snap_path[64], journal_path[64];
+    volatile uint32_t sink = 0;
+    if (peers <= 0) peers = 100000;
+    if (rounds <= 0) rounds = 5;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Journal Catch-up Benchmark (%d peers)\n", peers);
+    printf("================================================================================\n\n");
+
+    snprintf(snap_path, sizeof(snap_path), "/tmp/nb-bench-journal-%d.snap", getpid());
+    snprintf(journal_path, sizeof(journal_path), "/tmp/nb-bench-journal-%d.journal", getpid());
+
+    /* The snapshot, written through the JSON converter's input */
+    peers_file_peer_t *list = calloc(peers, sizeof(peers_file_peer_t));
+    char (*keys)[WG_KEY_B64_LEN] = calloc(peers, WG_KEY_B64_LEN);
+    char (*endpoints)[24] = calloc(peers, 24);
+    char (*ips)[2][24] = calloc(peers, sizeof(*ips));
+    char **ip_ptrs = calloc((size_t)peers * 2, sizeof(char *));
+    if (!list || !keys || !endpoints || !ips || !ip_ptrs) {
+        printf("ERROR: out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < peers; i++) {
+        uint8_t key[WG_KEY_LEN] = {0};
+        memcpy(key, &i, sizeof(i));
+        key[31] = 0x5a;
+        wg_key_to_base64(keys[i], key);
+        snprintf(endpoints[i], 24, "198.51.%d.%d:51820", (i >> 8) & 255, i & 255);
+        snprintf(ips[i][0], 24, "100.%d.%d.%d/32", 64 + (i >> 16), (i >> 8) & 255, i & 255);
+        snprintf(ips[i][1], 24, "10.%d.%d.0/24", (i >> 8) & 255, i & 255);
+        ip_ptrs[2 * i] = ips[i][0];
+        ip_ptrs[2 * i + 1] = ips[i][1];
+        list[i] = (peers_file_peer_t){ .public_key = keys[i], .endpoint = endpoints[i], .keepalive = 25,
+                                       .allowed_ips = &ip_ptrs[2 * i], .allowed_ips_count = 2 };
+    }
+    peers_file_t pf = { .peers = list, .peer_count = peers };
+    int written = peers_snap_write(snap_path, &pf);
+    free(list);
+    free(keys);
+    free(endpoints);
+    free(ips);
+    free(ip_ptrs);
+    if (written != peers) {
+        printf("ERROR: cannot write %s\n", snap_path);
+        return 1;
+    }
+
+    /* Full reload: map, verify and walk every peer */
+    double best_snap = 1e9;
+    for (int r = 0; r < rounds; r++) {
+        peers_snap_t *snap = NULL;
+        double t0 = now_sec();
+        if (peers_snap_open(snap_path, &snap) != NB_SUCCESS) {
+            printf("ERROR: peers_snap_open failed\n");
+            return 1;
+        }
+        for (int i = 0; i < snap->peer_count; i++) {
+            const peers_snap_peer_t *p = &snap->peers[i];
+            const nb_prefix_t *pfx = peers_snap_prefixes(snap, p);
+            nb_endpoint_t ep;
+            peers_snap_endpoint(p, &ep);
+            sink += p->public_key[0] + pfx[0].addr[3];
+        }
+        peers_snap_close(snap);
+        double t = now_sec() - t0;
+        if (t < best_snap) best_snap = t;
+    }
+    printf("  %-30s %10.3f ms\n\n", "snapshot reload (map+walk)", best_snap * 1e3);
+
+    printf("  %-10s %14s %14s %14s\n", "missed", "tail", "reopen+skip", "vs reload");
+    int missed[] = { 1, 10, 100, 1000, 10000 };
+    for (size_t m = 0; m < sizeof(missed) / sizeof(missed[0]); m++) {
+        int k = missed[m];
+        double best_tail = 1e9, best_reopen = 1e9;
+        for (int r = 0; r < rounds; r++) {
+            /* SKIPPED records already applied, then k missed ones */
+            nb_journal_t *w = NULL, *rd = NULL;
+            peer_set_t set;
+            if (nb_journal_create(journal_path, 0, &w) != NB_SUCCESS) {
+                printf("ERROR: cannot create %s\n", journal_path);
+                return 1;
+            }
+            for (int i = 0; i < SKIPPED; i++) {
+                make_peer(&set, i % peers, 1024 + r);
+                nb_journal_append(w, NB_DELTA_PEER_SET, &set, sizeof(set));
+            }
+            if (nb_journal_open(journal_path, &rd) != NB_SUCCESS || replay(rd, 0, &sink) != SKIPPED) {
+                printf("ERROR: cannot read %s\n", journal_path);
+                return 1;
+            }
+            for (int i = 0; i < k; i++) {
+                make_peer(&set, (i * 7919) % peers, 2048 + r);
+                nb_journal_append(w, NB_DELTA_PEER_SET, &set, sizeof(set));
+            }
+            nb_journal_close(w);
+
+            double t0 = now_sec();
+            int n = replay(rd, SKIPPED, &sink);
+            double t_tail = now_sec() - t0;
+            nb_journal_close(rd);
+
+            t0 = now_sec();
+            int n2 = nb_journal_open(journal_path, &rd) == NB_SUCCESS ? replay(rd, SKIPPED, &sink) : -1;
+            double t_reopen = now_sec() - t0;
+            nb_journal_close(rd);
+            if (n != k || n2 != k) {
+                printf("ERROR: replayed %d/%d records of %d\n", n, n2, k);
+                return 1;
+            }
+            if (t_tail < best_tail) best_tail = t_tail;
+            if (t_reopen < best_reopen) best_reopen = t_reopen;
+        }
+        printf("  %-10d %11.3f ms %11.3f ms %12.0fx\n", k, best_tail * 1e3, best_reopen * 1e3,
+               best_snap / best_tail);
+    }
+    printf("\n  Reopen skips %d applied records first (best of %d rounds)\n\n", SKIPPED, rounds);
+
+    unlink(snap_path);
+    unlink(journal_path);
+    return sink == 0xffffffff;
+}
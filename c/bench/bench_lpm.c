@@ -0,0 +1,131 @@
+/**
+ * bench_lpm.c - Allowed IP trie throughput
+ *
+ * Inserts random IPv4 prefixes one by one and in bulk (nb_lpm_build),
+ * then measures random address lookups, overlap checks and removals.
+ *
+ * Usage: ./bench_lpm [prefixes]   (default: 1000000)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "lpm.h"
+#include <time.h>
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)rng_state;
+}
+
+static void set_v4(nb_prefix_t *p, uint32_t a, int len) {
+    memset(p, 0, sizeof(*p));
+    p->family = AF_INET;
+    p->len = (uint8_t)len;
+    p->addr[0] = a >> 24;
+    p->addr[1] = a >> 16;
+    p->addr[2] = a >> 8;
+    p->addr[3] = a;
+    nb_prefix_normalize(p);
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (count <= 0) count = 1000000;
+    int lookups = 4 * count;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Allowed IP Trie Benchmark (%d prefixes)\n", count);
+    printf("================================================================================\n\n");
+
+    nb_prefix_t *prefixes = malloc((size_t)count * sizeof(nb_prefix_t));
+    uint32_t *values = malloc((size_t)count * sizeof(uint32_t));
+    nb_prefix_t *keys = malloc((size_t)lookups * sizeof(nb_prefix_t));
+    nb_lpm_t *lpm = nb_lpm_new();
+    if (!prefixes || !values || !keys || !lpm) {
+        printf("ERROR: Out of memory\n");
+        return 1;
+    }
+
+    /* Mostly host routes of peers plus some shorter routed networks */
+    for (int i = 0; i < count; i++) {
+        int len = (i % 16) ? 32 : 16 + rng() % 13;
+        set_v4(&prefixes[i], 0x64400000u + (rng() & 0x003FFFFFu) * 64, len);
+        values[i] = (uint32_t)i;
+    }
+    for (int i = 0; i < lookups; i++) {
+        set_v4(&keys[i], 0x64400000u + (rng() & 0x0FFFFFFFu), 32);
+    }
+
+    double t0 = now_sec();
+    for (int i = 0; i < count; i++) {
+        nb_lpm_insert(lpm, &prefixes[i], values[i]);
+    }
+    double t1 = now_sec();
+    int stored = nb_lpm_count(lpm);
+
+    long hits = 0;
+    uint32_t v;
+    for (int i = 0; i < lookups; i++) {
+        hits += nb_lpm_lookup(lpm, &keys[i], &v, NULL) == NB_SUCCESS;
+    }
+    double t2 = now_sec();
+
+    /* Lookups of stored host addresses always hit */
+    for (int i = 0; i < count; i++) {
+        hits += nb_lpm_lookup(lpm, &prefixes[i], &v, NULL) == NB_SUCCESS;
+    }
+    double t3 = now_sec();
+
+    long overlaps = 0;
+    nb_lpm_check_t c;
+    for (int i = 0; i < count; i++) {
+        nb_lpm_check(lpm, &prefixes[i], UINT32_MAX, &c);
+        overlaps += c.kind != NB_LPM_OK;
+    }
+    double t4 = now_sec();
+
+    for (int i = 0; i < count; i++) {
+        nb_lpm_remove(lpm, &prefixes[i]);
+    }
+    double t5 = now_sec();
+    int left = nb_lpm_count(lpm);
+
+    /* Bulk build inserts in sorted order, which also lays nodes out closer together */
+    nb_lpm_clear(lpm);
+    double t6 = now_sec();
+    nb_lpm_build(lpm, prefixes, values, count);
+    double t7 = now_sec();
+    for (int i = 0; i < lookups; i++) {
+        hits += nb_lpm_lookup(lpm, &keys[i], &v, NULL) == NB_SUCCESS;
+    }
+    double t8 = now_sec();
+
+    printf("  insert:            %10.1f ns/op  (%d distinct)\n", (t1 - t0) * 1e9 / count, stored);
+    printf("  lookup random:     %10.1f ns/op\n", (t2 - t1) * 1e9 / lookups);
+    printf("  lookup stored:     %10.1f ns/op\n", (t3 - t2) * 1e9 / count);
+    printf("  overlap check:     %10.1f ns/op\n", (t4 - t3) * 1e9 / count);
+    printf("  remove:            %10.1f ns/op  (%d left)\n", (t5 - t4) * 1e9 / count, left);
+    printf("  bulk build:        %10.1f ns/op  (%.1f ms total)\n",
+           (t7 - t6) * 1e9 / count, (t7 - t6) * 1e3);
+    printf("  lookup after build:%10.1f ns/op\n", (t8 - t7) * 1e9 / lookups);
+    printf("  (checksum %ld)\n\n", hits + overlaps);
+
+    nb_lpm_free(lpm);
+    free(prefixes);
+    free(values);
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,213 @@
+/**
+ * bench_notrack.c - WireGuard listen port with and without conntrack bypass
+ *
+ * A gateway namespace with conntrack in use (a masquerade table, as on a
+ * routing peer) receives UDP on the listen port from a sender namespace
+ * over a veth pair. The sender spreads its packets over many source
+ * ports, like the endpoints of many peers. Measures, with the NOTRACK
+ * rules (nb_nft_notrack_set) off and on:
+ * - packets per second delivered to the listen socket
+ * - conntrack entries created (nf_conntrack_count)
+ *
+ * Usage: sudo ./bench_notrack [seconds] [source_ports]
+ *        (defaults: 3 seconds per measurement, 4096 source ports)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#define _GNU_SOURCE
+#include "common.h"
+#include "nft.h"
+#include "wg_iface.h"
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define GW_DEV          "ntb0"
+#define GW_ADDR         "10.204.0.1"
+#define LISTEN_PORT     51820
+#define PAYLOAD         148     /* WireGuard handshake initiation size */
+#define CT_COUNT        "/proc/sys/net/netfilter/nf_conntrack_count"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long read_long(const char *path) {
+    FILE *f = fopen(path, "r");
+    long v = -1;
+    if (f) {
+        if (fscanf(f, "%ld", &v) != 1) {
+            v = -1;
+        }
+        fclose(f);
+    }
+    return v;
+}
+
+/* Sender: on each byte from ctl, blast packets for the given time from many source ports */
+static void sender_run(int ctl, int ports, double seconds) {
+    int *fds = calloc(ports, sizeof(int));
+    struct sockaddr_in gw = { .sin_family = AF_INET, .sin_port = htons(LISTEN_PORT) };
+    uint8_t payload[PAYLOAD] = { 1 };
+    char go;
+
+    inet_pton(AF_INET, GW_ADDR, &gw.sin_addr);
+    for (int i = 0; fds && i < ports; i++) {
+        fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    }
+    while (fds && read(ctl, &go, 1) == 1) {
+        double t0 = now_sec();
+        uint64_t sent = 0;
+        while (now_sec() - t0 < seconds) {
+            for (int i = 0; i < 256; i++, sent++) {
+                sendto(fds[sent % ports], payload, sizeof(payload), 0, (struct sockaddr *)&gw, sizeof(gw));
+            }
+        }
+    }
+    _exit(0);
+}
+
+/* Count packets on the listen socket for the given time */
+static uint64_t receive_for(int fd, double seconds) {
+    static uint8_t buf[2048];
+    uint64_t n = 0;
+    double t0 = now_sec();
+
+    while (now_sec() - t0 < seconds) {
+        if (recv(fd, buf, sizeof(buf), 0) > 0) {
+            n++;
+        }
+    }
+    /* Drain what the sender still had in flight */
+    while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+    }
+    return n;
+}
+
+static void bench_mode(const char *label, int ctl, int fd, double seconds) {
+    long ct0 = read_long(CT_COUNT);
+    if (write(ctl, "g", 1) != 1) {
+        printf("  %-14s FAILED: sender gone\n", label);
+        return;
+    }
+    uint64_t n = receive_for(fd, seconds);
+    long ct1 = read_long(CT_COUNT);
+
+    printf("  %-14s %10.0f packets/s   %7ld conntrack entries created\n", label, n / seconds,
+           ct0 >= 0 && ct1 >= 0 ? ct1 - ct0 : -1);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+    int ports = argc > 2 ? atoi(argv[2]) : 4096;
+    nb_nft_t masq, notrack;
+    int ctl[2];
+    int ret = 1;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Conntrack Bypass Benchmark\n");
+    printf("================================================================================\n\n");
+
+    if (geteuid() != 0) {
+        printf("  SKIPPED: must be run as root\n\n");
+        return 0;
+    }
+    if (seconds <= 0) {
+        seconds = 3.0;
+    }
+    if (ports <= 0) {
+        ports = 4096;
+    }
+    if (unshare(CLONE_NEWNET) != 0) {
+        printf("  SKIPPED: cannot create a network namespace (%s)\n\n", strerror(errno));
+        return 0;
+    }
+    if (system("ip link set lo up && ip link add " GW_DEV " type veth peer name ntb1 && "
+               "ip addr add " GW_ADDR "/24 dev " GW_DEV " && ip link set " GW_DEV " up") != 0 ||
+        pipe(ctl) != 0) {
+        printf("  FAILED: could not create veth devices\n\n");
+        return 1;
+    }
+
+    /* The sender gets a namespace of its own and the other veth end */
+    int ready[2];
+    if (pipe(ready) != 0) {
+        return 1;
+    }
+    pid_t sender = fork();
+    if (sender == 0) {
+        char b = 0;
+        close(ctl[1]);
+        close(ready[0]);
+        if (unshare(CLONE_NEWNET) != 0 || write(ready[1], &b, 1) != 1 || read(ctl[0], &b, 1) != 1 ||
+            system("ip link set lo up && ip addr add 10.204.0.2/24 dev ntb1 && ip link set ntb1 up") != 0) {
+            _exit(1);
+        }
+        sender_run(ctl[0], ports, seconds);
+    }
+    close(ctl[0]);
+    close(ready[1]);
+    char b;
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "ip link set ntb1 netns %d", (int)sender);
+    if (sender < 0 || read(ready[0], &b, 1) != 1 || system(cmd) != 0 || write(ctl[1], "s", 1) != 1) {
+        printf("  FAILED: could not set up the sender namespace\n\n");
+        goto out;
+    }
+
+    /* Conntrack in use, as on a routing peer that masquerades */
+    nb_nft_masq_t entry = { .device = GW_DEV, .prefix = { .family = AF_INET } };
+    if (nb_nft_open(&masq) != NB_SUCCESS || nb_nft_masq_set(&masq, &entry, 1) != NB_SUCCESS) {
+        printf("  SKIPPED: nftables NAT not available\n\n");
+        ret = 0;
+        goto out;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 8 << 20;
+    struct timeval tv = { .tv_usec = 100000 };
+    struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons(LISTEN_PORT) };
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (fd < 0 || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        printf("  FAILED: cannot bind UDP port %d\n\n", LISTEN_PORT);
+        goto out;
+    }
+    usleep(200000);     /* Let the sender configure its side */
+
+    printf("[notrack] UDP %d-byte packets to port %d from %d source ports, %.1f s each\n",
+           PAYLOAD, LISTEN_PORT, ports, seconds);
+    bench_mode("notrack off", ctl[1], fd, seconds);
+
+    if (nb_nft_open_table(&notrack, WG_NOTRACK_TABLE_PREFIX GW_DEV) != NB_SUCCESS ||
+        nb_nft_notrack_set(&notrack, LISTEN_PORT) != NB_SUCCESS) {
+        printf("  %-14s SKIPPED: notrack rules not available\n", "notrack on");
+    } else {
+        bench_mode("notrack on", ctl[1], fd, seconds);
+        nb_nft_table_delete(&notrack);
+        nb_nft_close(&notrack);
+    }
+    printf("  conntrack table: %ld / %ld entries\n\n", read_long(CT_COUNT),
+           read_long("/proc/sys/net/netfilter/nf_conntrack_max"));
+    close(fd);
+    nb_nft_table_delete(&masq);
+    nb_nft_close(&masq);
+    ret = 0;
+
+out:
+    close(ctl[1]);
+    if (sender > 0) {
+        kill(sender, SIGKILL);
+        waitpid(sender, NULL, 0);
+    }
+    return ret;
+}
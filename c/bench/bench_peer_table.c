@@ -0,0 +1,119 @@
+/**
+ * bench_peer_table.c - Peer table vs. naive array scan
+ *
+ * Compares nb_peer_table lookups with what the engine had to do before:
+ * scan an array of peers comparing base64 key strings (and, for
+ * reference, raw 32-byte keys).
+ *
+ * Usage: ./bench_peer_table [peers]   (default: 100000)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "peer_table.h"
+#include <sys/random.h>
+#include <time.h>
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int peers = argc > 1 ? atoi(argv[1]) : 100000;
+    if (peers <= 0) peers = 100000;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Peer Table Benchmark (%d peers)\n", peers);
+    printf("================================================================================\n\n");
+
+    uint8_t (*keys)[WG_KEY_LEN] = malloc((size_t)peers * WG_KEY_LEN);
+    char (*b64)[WG_KEY_B64_LEN] = malloc((size_t)peers * WG_KEY_B64_LEN);
+    nb_peer_table_t *t = nb_peer_table_new(0);
+    if (!keys || !b64 || !t) {
+        printf("ERROR: Out of memory\n");
+        return 1;
+    }
+    if (getrandom(keys, (size_t)peers * WG_KEY_LEN, 0) != (ssize_t)peers * WG_KEY_LEN) {
+        printf("ERROR: getrandom failed\n");
+        return 1;
+    }
+    for (int i = 0; i < peers; i++) {
+        wg_key_to_base64(b64[i], keys[i]);
+    }
+
+    nb_prefix_t ip;
+    nb_prefix_parse("100.64.0.1/32", &ip);
+
+    /* Table: insert, hit, miss, remove */
+    double t0 = now_sec();
+    for (int i = 0; i < peers; i++) {
+        nb_peer_table_upsert(t, keys[i], NULL, 25, &ip, 1);
+    }
+    double t1 = now_sec();
+
+    long found = 0;
+    for (int i = 0; i < peers; i++) {
+        found += nb_peer_table_find(t, keys[(i * 7919L) % peers]) != NULL;
+    }
+    double t2 = now_sec();
+
+    uint8_t miss[WG_KEY_LEN];
+    memcpy(miss, keys[0], WG_KEY_LEN);
+    for (int i = 0; i < peers; i++) {
+        miss[31] = (uint8_t)i;
+        miss[30] = (uint8_t)(i >> 8);
+        miss[0] ^= 0x80;
+        found += nb_peer_table_find(t, miss) != NULL;
+    }
+    double t3 = now_sec();
+
+    for (int i = 0; i < peers; i++) {
+        nb_peer_table_remove(t, keys[i]);
+    }
+    double t4 = now_sec();
+
+    printf("  peer table insert: %10.1f ns/op\n", (t1 - t0) * 1e9 / peers);
+    printf("  peer table hit:    %10.1f ns/op\n", (t2 - t1) * 1e9 / peers);
+    printf("  peer table miss:   %10.1f ns/op\n", (t3 - t2) * 1e9 / peers);
+    printf("  peer table remove: %10.1f ns/op\n", (t4 - t3) * 1e9 / peers);
+
+    /* Naive scans are O(n) per lookup; sample fewer lookups */
+    int samples = peers < 2000 ? peers : 2000;
+
+    t0 = now_sec();
+    for (int s = 0; s < samples; s++) {
+        const char *want = b64[(s * 7919L) % peers];
+        for (int i = 0; i < peers; i++) {
+            if (strcmp(b64[i], want) == 0) {
+                found++;
+                break;
+            }
+        }
+    }
+    t1 = now_sec();
+
+    for (int s = 0; s < samples; s++) {
+        const uint8_t *want = keys[(s * 7919L) % peers];
+        for (int i = 0; i < peers; i++) {
+            if (memcmp(keys[i], want, WG_KEY_LEN) == 0) {
+                found++;
+                break;
+            }
+        }
+    }
+    t2 = now_sec();
+
+    printf("  scan base64 hit:   %10.1f ns/op\n", (t1 - t0) * 1e9 / samples);
+    printf("  scan raw key hit:  %10.1f ns/op\n", (t2 - t1) * 1e9 / samples);
+    printf("  (checksum %ld)\n\n", found);
+
+    nb_peer_table_free(t);
+    free(keys);
+    free(b64);
+    return 0;
+}
@@ -0,0 +1,235 @@
+/**
+ * bench_peers_json.c - peers.json loaders: cJSON tree vs single-pass scan
+ *
+ * Loads the same generated peers.json with:
+ * - the previous loader: read the file, build the cJSON tree, copy the
+ *   strings into an arena, delete the tree
+ * - peers_file_load(): the mapped file scanned once, strings copied into
+ *   an arena as each peer is parsed
+ * - peers_file_stream(): the scan alone, peers handed to a callback (what
+ *   the engine does when it syncs peers.json)
+ * Reports the best time of several runs, the allocations and the peak heap
+ * (malloc/calloc/realloc/free are interposed). The mapped file itself is
+ * page cache, not heap.
+ *
+ * Usage: ./bench_peers_json [peers...]   (default: 1000 10000 100000)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "peers_file.h"
+#include <cjson/cJSON.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <time.h>
+
+#define RUNS 5
+
+/* Allocation counters; every allocation in the process goes through these */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void __libc_free(void *p);
+
+static uint64_t g_allocs;
+static size_t g_live, g_peak;
+
+static void *track(void *p) {
+    if (p) {
+        g_live += malloc_usable_size(p);
+        if (g_live > g_peak) g_peak = g_live;
+    }
+    return p;
+}
+
+void *malloc(size_t size) {
+    g_allocs++;
+    return track(__libc_malloc(size));
+}
+
+void *calloc(size_t count, size_t size) {
+    g_allocs++;
+    return track(__libc_calloc(count, size));
+}
+
+void *realloc(void *p, size_t size) {
+    g_allocs += p == NULL;
+    size_t old = p ? malloc_usable_size(p) : 0;
+    void *q = __libc_realloc(p, size);
+    if (q || size == 0) g_live -= old;
+    return track(q);
+}
+
+void free(void *p) {
+    if (p) g_live -= malloc_usable_size(p);
+    __libc_free(p);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The loader before the scanner: cJSON tree, strings copied into an arena */
+static peers_file_t* tree_load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *json = malloc(size + 1);
+    size_t n = fread(json, 1, size, fp);
+    json[n] = '\0';
+    fclose(fp);
+    cJSON *root = cJSON_Parse(json);
+    free(json);
+    if (!root) return NULL;
+
+    peers_file_t *pf = calloc(1, sizeof(peers_file_t));
+    cJSON *array = cJSON_GetObjectItem(root, "peers");
+    int count = cJSON_GetArraySize(array);
+    nb_arena_init(&pf->arena, (size_t)size + (size_t)count * sizeof(peers_file_peer_t));
+    nb_arena_t *arena = &pf->arena;
+    pf->updated_at = nb_arena_strdup(arena, cJSON_GetObjectItem(root, "updatedAt")->valuestring);
+    pf->peers = nb_arena_calloc(arena, count, sizeof(peers_file_peer_t));
+    for (cJSON *pj = array->child; pj; pj = pj->next) {
+        peers_file_peer_t *p = &pf->peers[pf->peer_count++];
+        p->id = nb_arena_strdup(arena, cJSON_GetObjectItem(pj, "id")->valuestring);
+        p->public_key = nb_arena_strdup(arena, cJSON_GetObjectItem(pj, "publicKey")->valuestring);
+        p->endpoint = nb_arena_strdup(arena, cJSON_GetObjectItem(pj, "endpoint")->valuestring);
+        p->keepalive = cJSON_GetObjectItem(pj, "keepalive")->valueint;
+        cJSON *ips = cJSON_GetObjectItem(pj, "allowedIPs");
+        p->allowed_ips_count = cJSON_GetArraySize(ips);
+        p->allowed_ips = nb_arena_calloc(arena, p->allowed_ips_count, sizeof(char *));
+        int j = 0;
+        for (cJSON *ip = ips->child; ip; ip = ip->next) {
+            p->allowed_ips[j++] = nb_arena_strdup(arena, ip->valuestring);
+        }
+    }
+    cJSON_Delete(root);
+    return pf;
+}
+
+static void tree_free(peers_file_t *pf) {
+    nb_arena_free(&pf->arena);
+    free(pf);
+}
+
+static int count_peer(const peers_file_peer_t *peer, void *ctx) {
+    int *ips = ctx;
+    *ips += peer->allowed_ips_count;
+    return NB_SUCCESS;
+}
+
+typedef enum { LOADER_TREE, LOADER_SCAN, LOADER_STREAM } loader_t;
+
+static const char *loader_names[] = {
+    "cJSON tree + arena",
+    "scan + arena (load)",
+    "scan to callback",
+};
+
+typedef struct {
+    double best_s;
+    uint64_t allocs;
+    size_t peak;
+    int peers;
+} cost_t;
+
+static cost_t run(loader_t loader, const char *path) {
+    cost_t c = { .best_s = 1e9 };
+    for (int r = 0; r < RUNS; r++) {
+        peers_file_t *pf = NULL;
+        int ips = 0;
+        size_t base = g_live;
+        g_allocs = 0;
+        g_peak = g_live;
+
+        double t0 = now_sec();
+        switch (loader) {
+        case LOADER_TREE:
+            pf = tree_load(path);
+            c.peers = pf ? pf->peer_count : -1;
+            break;
+        case LOADER_SCAN:
+            c.peers = peers_file_load(path, &pf) == NB_SUCCESS ? pf->peer_count : -1;
+            break;
+        case LOADER_STREAM:
+            c.peers = peers_file_stream(path, count_peer, &ips);
+            break;
+        }
+        double t = now_sec() - t0;
+
+        c.allocs = g_allocs;
+        c.peak = g_peak - base;
+        if (t < c.best_s) c.best_s = t;
+        if (loader == LOADER_TREE) {
+            if (pf) tree_free(pf);
+        } else {
+            peers_file_free(pf);
+        }
+    }
+    return c;
+}
+
+static int write_peers(const char *path, int peers) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "{\"updatedAt\": \"2026-10-16T00:00:00Z\", \"peers\": [\n");
+    for (int i = 0; i < peers; i++) {
+        fprintf(f, "  {\"id\": \"peer-%08d\", \"publicKey\": \"%043dA=\", \"endpoint\": \"198.51.%d.%d:51820\", "
+                "\"keepalive\": 25, \"allowedIPs\": [\"100.64.%d.%d/32\", \"10.%d.%d.0/24\"]}%s\n",
+                i, i, (i >> 8) & 255, i & 255, (i >> 8) & 255, i & 255, (i >> 8) & 255, i & 255,
+                i + 1 < peers ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    long size = ftell(f);
+    fclose(f);
+    return (int)size;
+}
+
+int main(int argc, char *argv[]) {
+    static const int defaults[] = { 1000, 10000, 100000 };
+    char path[64];
+
+    snprintf(path, sizeof(path), "/tmp/nb-bench-peers-json-%d.json", getpid());
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - peers.json Loader Benchmark\n");
+    printf("================================================================================\n\n");
+
+    int sizes = argc > 1 ? argc - 1 : (int)(sizeof(defaults) / sizeof(defaults[0]));
+    for (int s = 0; s < sizes; s++) {
+        int peers = argc > 1 ? atoi(argv[s + 1]) : defaults[s];
+        if (peers <= 0) continue;
+
+        int size = write_peers(path, peers);
+        if (size < 0) {
+            printf("ERROR: cannot write %s\n", path);
+            return 1;
+        }
+
+        printf("[%d peers] %.2f MB, best of %d runs\n", peers, size / 1e6, RUNS);
+        cost_t base = {0};
+        for (loader_t l = LOADER_TREE; l <= LOADER_STREAM; l++) {
+            cost_t c = run(l, path);
+            if (c.peers != peers) {
+                printf("ERROR: %s loaded %d peers\n", loader_names[l], c.peers);
+                unlink(path);
+                return 1;
+            }
+            if (l == LOADER_TREE) base = c;
+            printf("  %-20s %9.2f ms  %6.0f ns/peer  %9llu allocs  peak heap %9.1f KB  %5.1fx\n",
+                   loader_names[l], c.best_s * 1e3, c.best_s * 1e9 / peers,
+                   (unsigned long long)c.allocs, c.peak / 1e3, base.best_s / c.best_s);
+        }
+        printf("\n");
+    }
+
+    unlink(path);
+    return 0;
+}
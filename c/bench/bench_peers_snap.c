@@ -0,0 +1,168 @@
+/**
+ * bench_peers_snap.c - Loading peers.json versus mapping a snapshot
+ *
+ * Writes N peers as peers.json, converts it with peers_snap_write() and
+ * compares, per load: wall time, heap allocations and heap bytes
+ * (malloc/calloc/realloc are interposed to count them).
+ * - peers_file_load(): read, parse with cJSON, copy into the arena
+ * - peers_snap_open(): mmap, checksum and bounds check, read in place
+ * A walk over every peer's key and prefixes follows each load, so the
+ * snapshot's pages are actually touched.
+ *
+ * Usage: ./bench_peers_snap [peers] [rounds]   (defaults: 100000, 5)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "peers_file.h"
+#include "peers_snap.h"
+#include "wg_key.h"
+#include <stdint.h>
+#include <time.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static uint64_t g_allocs, g_bytes;
+
+void *malloc(size_t size) {
+    g_allocs++;
+    g_bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    g_allocs++;
+    g_bytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+    g_allocs++;
+    g_bytes += size;
+    return __libc_realloc(p, size);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int peers = argc > 1 ? atoi(argv[1]) : 100000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    char json_path[64], snap_path[64];
+    volatile uint32_t sink = 0;
+
+    if (peers <= 0) peers = 100000;
+    if (rounds <= 0) rounds = 5;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Peer Snapshot Benchmark (%d peers)\n", peers);
+    printf("================================================================================\n\n");
+
+    snprintf(json_path, sizeof(json_path), "/tmp/nb-bench-snap-%d.json", getpid());
+    snprintf(snap_path, sizeof(snap_path), "/tmp/nb-bench-snap-%d.snap", getpid());
+
+    FILE *f = fopen(json_path, "w");
+    if (!f) {
+        printf("ERROR: cannot write %s\n", json_path);
+        return 1;
+    }
+    fprintf(f, "{\"updatedAt\": \"2026-10-16T00:00:00Z\", \"peers\": [\n");
+    for (int i = 0; i < peers; i++) {
+        uint8_t key[WG_KEY_LEN] = {0};
+        char b64[WG_KEY_B64_LEN];
+        memcpy(key, &i, sizeof(i));
+        key[31] = 0x5a;
+        wg_key_to_base64(b64, key);
+        fprintf(f, "  {\"id\": \"peer-%d\", \"publicKey\": \"%s\", \"endpoint\": \"198.51.%d.%d:51820\", "
+                "\"keepalive\": 25, \"allowedIPs\": [\"100.%d.%d.%d/32\", \"10.%d.%d.0/24\"]}%s\n",
+                i, b64, (i >> 8) & 255, i & 255, 64 + (i >> 16), (i >> 8) & 255, i & 255,
+                (i >> 8) & 255, i & 255, i + 1 < peers ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+
+    peers_file_t *pf = NULL;
+    if (peers_file_load(json_path, &pf) != NB_SUCCESS || peers_snap_write(snap_path, pf) != peers) {
+        printf("ERROR: conversion failed\n");
+        return 1;
+    }
+    peers_file_free(pf);
+
+    /* JSON: the walk decodes what the engine would decode */
+    double best_json = 1e9;
+    uint64_t json_allocs = 0, json_bytes = 0;
+    for (int r = 0; r < rounds; r++) {
+        g_allocs = g_bytes = 0;
+        double t0 = now_sec();
+        if (peers_file_load(json_path, &pf) != NB_SUCCESS) {
+            printf("ERROR: peers_file_load failed\n");
+            return 1;
+        }
+        for (int i = 0; i < pf->peer_count; i++) {
+            uint8_t key[WG_KEY_LEN];
+            nb_prefix_t ip;
+            wg_key_from_base64(key, pf->peers[i].public_key);
+            for (int j = 0; j < pf->peers[i].allowed_ips_count; j++) {
+                nb_prefix_parse(pf->peers[i].allowed_ips[j], &ip);
+                sink += ip.addr[3];
+            }
+            sink += key[0];
+        }
+        peers_file_free(pf);
+        double t = now_sec() - t0;
+        json_allocs = g_allocs;
+        json_bytes = g_bytes;
+        if (t < best_json) best_json = t;
+    }
+
+    /* Snapshot: keys and prefixes are used as they are */
+    double best_snap = 1e9, best_open = 1e9;
+    uint64_t snap_allocs = 0, snap_bytes = 0;
+    size_t snap_size = 0;
+    for (int r = 0; r < rounds; r++) {
+        peers_snap_t *snap = NULL;
+        g_allocs = g_bytes = 0;
+        double t0 = now_sec();
+        if (peers_snap_open(snap_path, &snap) != NB_SUCCESS) {
+            printf("ERROR: peers_snap_open failed\n");
+            return 1;
+        }
+        double t_open = now_sec() - t0;
+        for (int i = 0; i < snap->peer_count; i++) {
+            const peers_snap_peer_t *p = &snap->peers[i];
+            const nb_prefix_t *ips = peers_snap_prefixes(snap, p);
+            for (int j = 0; j < p->prefix_count; j++) {
+                sink += ips[j].addr[3];
+            }
+            sink += p->public_key[0];
+        }
+        snap_size = snap->map_size;
+        peers_snap_close(snap);
+        double t = now_sec() - t0;
+        snap_allocs = g_allocs;
+        snap_bytes = g_bytes;
+        if (t < best_snap) best_snap = t;
+        if (t_open < best_open) best_open = t_open;
+    }
+
+    printf("  %-24s %10s %12s %14s\n", "", "time", "heap allocs", "heap bytes");
+    printf("  %-24s %8.1f ms %12llu %12.1f MB\n", "peers.json (load+walk)", best_json * 1e3,
+           (unsigned long long)json_allocs, json_bytes / 1e6);
+    printf("  %-24s %8.1f ms %12llu %12llu B\n", "peers.snap (map+walk)", best_snap * 1e3,
+           (unsigned long long)snap_allocs, (unsigned long long)snap_bytes);
+    printf("  %-24s %8.1f ms\n", "  of which map+verify", best_open * 1e3);
+    printf("\n  Snapshot %.1f MB; speedup %.0fx (best of %d rounds)\n\n",
+           snap_size / 1e6, best_json / best_snap, rounds);
+
+    unlink(json_path);
+    unlink(snap_path);
+    return sink == 0xffffffff;
+}
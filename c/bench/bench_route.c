@@ -0,0 +1,461 @@
+/**
+ * bench_route.c - Route programming throughput: shell vs netlink vs batch
+ *
+ * Runs in a private network namespace with a veth device, so the host
+ * routing table is never touched. Measures:
+ * - route_add() through the shell backend (one 'ip route' per route)
+ * - route_add() / route_remove() through netlink (one ACK wait per route)
+ * - route_batch_commit() for the same routes, adds then deletes
+ * - route_remove_all() after a batch install
+ * - route_sync() of a full list and of a 1% change, and route_check_drift()
+ * - route_aggregate() over the same list with every 8th route missing, and
+ *   the install of its result
+ * - failover of 10k routes to another device: rewriting every route with
+ *   route_sync() vs. one route_nexthop_set() under routes bound to a nexthop
+ *
+ * Usage: sudo ./bench_route [routes] [shell_routes]
+ *        (defaults: 50000 routes, 200 shell routes)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#define _GNU_SOURCE
+#include "common.h"
+#include "route.h"
+#include "route_agg.h"
+#include <sched.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <time.h>
+
+#define BENCH_DEV   "rtb0"
+#define BENCH_DEV2  "rtb2"
+#define BENCH_NHID  7001
+#define FAILOVER_ROUTES 10000
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* INFO logs go to stdout; hide them while timing */
+static int quiet_begin(void) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    return saved;
+}
+
+static void quiet_end(int saved) {
+    fflush(stdout);
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+}
+
+/* i-th /32 in 100.64.0.0/10 */
+static void route_network(int i, char *buf, size_t size) {
+    snprintf(buf, size, "100.%d.%d.%d/32", 64 + ((i >> 16) & 63), (i >> 8) & 255, i & 255);
+}
+
+static int count_routes_dev(const char *dev) {
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "ip route show dev %s | grep -vc 'proto kernel'", dev);
+    FILE *f = popen(cmd, "r");
+    int n = -1;
+    if (f) {
+        if (fscanf(f, "%d", &n) != 1) {
+            n = -1;
+        }
+        pclose(f);
+    }
+    return n;
+}
+
+static int count_routes(void) {
+    return count_routes_dev(BENCH_DEV);
+}
+
+static void report(const char *label, int count, double dt, int failed) {
+    printf("  %-28s %7d routes in %8.3f s = %9.0f routes/s", label, count, dt, count / dt);
+    if (failed) {
+        printf("  (%d failed)", failed);
+    }
+    printf("\n");
+}
+
+static void bench_shell(int count) {
+    route_manager_t *mgr = route_manager_new_backend(BENCH_DEV, ROUTE_BACKEND_SHELL);
+    char network[32];
+    int failed = 0;
+
+    if (!mgr || count <= 0) {
+        route_manager_free(mgr);
+        return;
+    }
+
+    int saved = quiet_begin();
+    double t0 = now_sec();
+    for (int i = 0; i < count; i++) {
+        route_network(i, network, sizeof(network));
+        route_config_t route = { .network = network, .metric = 100 };
+        failed += route_add(mgr, &route) != NB_SUCCESS;
+    }
+    double dt = now_sec() - t0;
+    route_remove_all(mgr);
+    quiet_end(saved);
+
+    report("shell route_add", count, dt, failed);
+    route_manager_free(mgr);
+}
+
+static void bench_netlink(int count) {
+    route_manager_t *mgr = route_manager_new_backend(BENCH_DEV, ROUTE_BACKEND_NETLINK);
+    char network[32];
+    int failed = 0;
+
+    if (!mgr) {
+        printf("  FAILED: netlink backend not available\n");
+        return;
+    }
+
+    int saved = quiet_begin();
+    double t0 = now_sec();
+    for (int i = 0; i < count; i++) {
+        route_network(i, network, sizeof(network));
+        route_config_t route = { .network = network, .metric = 100 };
+        failed += route_add(mgr, &route) != NB_SUCCESS;
+    }
+    double dt_add = now_sec() - t0;
+    int installed = count_routes();
+
+    int del_failed = 0;
+    t0 = now_sec();
+    for (int i = 0; i < count; i++) {
+        route_network(i, network, sizeof(network));
+        del_failed += route_remove(mgr, network) != NB_SUCCESS;
+    }
+    double dt_del = now_sec() - t0;
+    quiet_end(saved);
+
+    report("netlink route_add", count, dt_add, failed);
+    report("netlink route_remove", count, dt_del, del_failed);
+    printf("  (%d routes were installed)\n", installed);
+    route_manager_free(mgr);
+}
+
+static void bench_batch(int count) {
+    route_manager_t *mgr = route_manager_new_backend(BENCH_DEV, ROUTE_BACKEND_NETLINK);
+    route_batch_t *batch = route_batch_new();
+    char network[32];
+
+    if (!mgr || !batch) {
+        printf("  FAILED: netlink backend not available\n");
+        route_batch_free(batch);
+        route_manager_free(mgr);
+        return;
+    }
+
+    int saved = quiet_begin();
+    double t0 = now_sec();
+    for (int i = 0; i < count; i++) {
+        route_network(i, network, sizeof(network));
+        route_config_t route = { .network = network, .metric = 100 };
+        route_batch_add(batch, &route);
+    }
+    double dt_queue = now_sec() - t0;
+    t0 = now_sec();
+    int failed = route_batch_commit(mgr, batch);
+    double dt_add = now_sec() - t0;
+    int installed = count_routes();
+
+    /* Replace: same routes again */
+    t0 = now_sec();
+    int replace_failed = route_batch_commit(mgr, batch);
+    double dt_replace = now_sec() - t0;
+
+    route_batch_clear(batch);
+    for (int i = 0; i < count; i++) {
+        route_network(i, network, sizeof(network));
+        route_batch_del(batch, network);
+    }
+    t0 = now_sec();
+    int del_failed = route_batch_commit(mgr, batch);
+    double dt_del = now_sec() - t0;
+    int remaining = count_routes();
+
+    /* route_remove_all after a fresh install */
+    route_batch_clear(batch);
+    for (int i = 0; i < count; i++) {
+        route_network(i, network, sizeof(network));
+        route_config_t route = { .network = network, .metric = 100 };
+        route_batch_add(batch, &route);
+    }
+    route_batch_commit(mgr, batch);
+    t0 = now_sec();
+    int all_ret = route_remove_all(mgr);
+    double dt_all = now_sec() - t0;
+    int after_all = count_routes();
+    quiet_end(saved);
+
+    printf("  queueing                     %7d routes in %8.3f s\n", count, dt_queue);
+    report("batch add", count, dt_add, failed);
+    report("batch add (replace)", count, dt_replace, replace_failed);
+    report("batch delete", count, dt_del, del_failed);
+    report("route_remove_all", count, dt_all, all_ret != NB_SUCCESS);
+    printf("  (%d installed, %d left after batch delete, %d after remove_all)\n",
+           installed, remaining, after_all);
+    printf("  %d routes in under 1 s: %s\n", count, dt_add < 1.0 ? "yes" : "NO");
+
+    /* Error mapping: delete routes that do not exist, every other one */
+    route_batch_clear(batch);
+    for (int i = 0; i < 8; i++) {
+        route_network(i, network, sizeof(network));
+        if (i % 2 == 0) {
+            route_config_t route = { .network = network, .metric = 100 };
+            route_batch_add(batch, &route);
+        } else {
+            route_batch_del(batch, network);
+        }
+    }
+    saved = quiet_begin();
+    failed = route_batch_commit(mgr, batch);
+    route_remove_all(mgr);
+    quiet_end(saved);
+    printf("  error mapping: %d of 8 failed:", failed);
+    for (int i = 0; i < 8; i++) {
+        int err = 0;
+        int ret = route_batch_result(batch, i, &err);
+        printf(" %d:%s", i, ret == NB_SUCCESS ? "ok" : strerror(err));
+    }
+    printf("\n");
+
+    route_batch_free(batch);
+    route_manager_free(mgr);
+}
+
+static void bench_sync(int count) {
+    route_manager_t *mgr = route_manager_new_backend(BENCH_DEV, ROUTE_BACKEND_NETLINK);
+    route_config_t *routes = calloc(count, sizeof(route_config_t));
+    char (*networks)[32] = calloc(count, 32);
+
+    if (!mgr || !routes || !networks) {
+        printf("  FAILED: setup\n");
+        route_manager_free(mgr);
+        free(routes);
+        free(networks);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        route_network(i, networks[i], sizeof(networks[i]));
+        routes[i].network = networks[i];
+        routes[i].metric = 100;
+    }
+
+    int saved = quiet_begin();
+    double t0 = now_sec();
+    int failed = route_sync(mgr, routes, count);
+    double dt_full = now_sec() - t0;
+
+    t0 = now_sec();
+    int failed_same = route_sync(mgr, routes, count);
+    double dt_same = now_sec() - t0;
+
+    /* Replace 1% of the networks */
+    int changed = count / 100;
+    for (int i = 0; i < changed; i++) {
+        route_network(count + i, networks[i], sizeof(networks[i]));
+    }
+    t0 = now_sec();
+    int failed_delta = route_sync(mgr, routes, count);
+    double dt_delta = now_sec() - t0;
+
+    int repaired = -1;
+    t0 = now_sec();
+    route_check_drift(mgr, &repaired);
+    double dt_drift = now_sec() - t0;
+    int installed = count_routes();
+    int owned = route_owned_count(mgr);
+    route_remove_all(mgr);
+    quiet_end(saved);
+
+    report("sync (initial)", count, dt_full, failed);
+    report("sync (unchanged)", count, dt_same, failed_same);
+    printf("  %-28s %7d changes in %8.3f s\n", "sync (1% replaced)", changed * 2, dt_delta);
+    if (failed_delta) {
+        printf("  (%d failed)\n", failed_delta);
+    }
+    report("drift check (no drift)", count, dt_drift, repaired != 0);
+    printf("  (%d owned, %d installed)\n", owned, installed);
+
+    route_manager_free(mgr);
+    free(routes);
+    free(networks);
+}
+
+static void bench_aggregate(int count) {
+    route_manager_t *mgr = route_manager_new_backend(BENCH_DEV, ROUTE_BACKEND_NETLINK);
+    route_config_t *routes = calloc(count, sizeof(route_config_t));
+    char (*networks)[32] = calloc(count, 32);
+    route_agg_t *agg = NULL;
+    int n = 0;
+
+    if (!mgr || !routes || !networks) {
+        printf("  FAILED: setup\n");
+        route_manager_free(mgr);
+        free(routes);
+        free(networks);
+        return;
+    }
+    /* Holes keep the list from collapsing into a handful of prefixes */
+    for (int i = 0; i < count; i++) {
+        route_network(i + i / 7, networks[n], sizeof(networks[n]));
+        routes[n].network = networks[n];
+        routes[n].metric = 100;
+        n++;
+    }
+
+    int saved = quiet_begin();
+    double t0 = now_sec();
+    int ret = route_aggregate(routes, n, &agg);
+    double dt_agg = now_sec() - t0;
+    int out_count = 0;
+    const route_config_t *out = route_agg_routes(agg, &out_count);
+
+    t0 = now_sec();
+    int failed = route_sync(mgr, routes, n);
+    double dt_raw = now_sec() - t0;
+    route_remove_all(mgr);
+
+    t0 = now_sec();
+    int failed_agg = route_sync(mgr, out, out_count);
+    double dt_out = now_sec() - t0;
+    int installed = count_routes();
+    route_remove_all(mgr);
+    quiet_end(saved);
+
+    route_agg_stats_t st;
+    route_agg_get_stats(agg, &st);
+    report("aggregate", n, dt_agg, ret != NB_SUCCESS);
+    report("sync (raw list)", n, dt_raw, failed);
+    report("sync (aggregated)", out_count, dt_out, failed_agg);
+    printf("  (%d -> %d routes, saved %d: %d merged, %d covered; %d installed)\n",
+           st.input, st.output, st.saved, st.merged, st.covered, installed);
+
+    route_agg_free(agg);
+    route_manager_free(mgr);
+    free(routes);
+    free(networks);
+}
+
+static void bench_failover(int count) {
+    route_manager_t *mgr = route_manager_new_backend(BENCH_DEV, ROUTE_BACKEND_NETLINK);
+    route_config_t *routes = calloc(count, sizeof(route_config_t));
+    char (*networks)[32] = calloc(count, 32);
+
+    if (!mgr || !routes || !networks) {
+        printf("  FAILED: setup\n");
+        route_manager_free(mgr);
+        free(routes);
+        free(networks);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        route_network(i, networks[i], sizeof(networks[i]));
+        routes[i].network = networks[i];
+        routes[i].metric = 100;
+    }
+
+    /* Per route: every route is replaced with the new device */
+    int saved = quiet_begin();
+    int failed = route_sync(mgr, routes, count);
+    for (int i = 0; i < count; i++) {
+        routes[i].device = BENCH_DEV2;
+    }
+    double t0 = now_sec();
+    int failed_routes = route_sync(mgr, routes, count);
+    double dt_routes = now_sec() - t0;
+    int moved_routes = count_routes_dev(BENCH_DEV2);
+    route_remove_all(mgr);
+
+    /* Nexthop: the routes point at one object, which is updated */
+    for (int i = 0; i < count; i++) {
+        routes[i].device = NULL;
+        routes[i].nhid = BENCH_NHID;
+    }
+    failed += route_nexthop_set(mgr, BENCH_NHID, AF_INET, NULL) != NB_SUCCESS;
+    failed += route_sync(mgr, routes, count);
+    t0 = now_sec();
+    int failed_nh = route_nexthop_set(mgr, BENCH_NHID, AF_INET, BENCH_DEV2) != NB_SUCCESS;
+    double dt_nh = now_sec() - t0;
+    int moved_nh = count_routes_dev(BENCH_DEV2);
+    route_remove_all(mgr);
+    quiet_end(saved);
+
+    if (failed) {
+        printf("  (%d setup failures)\n", failed);
+    }
+    printf("  %-28s %7d routes in %8.3f s\n", "failover (per route)", moved_routes, dt_routes);
+    if (failed_routes) {
+        printf("  (%d failed)\n", failed_routes);
+    }
+    printf("  %-28s %7d routes in %8.3f s\n", "failover (nexthop)", moved_nh, dt_nh);
+    if (failed_nh) {
+        printf("  (nexthop update failed)\n");
+    }
+    if (dt_nh > 0) {
+        printf("  (%.0fx faster)\n", dt_routes / dt_nh);
+    }
+
+    route_manager_free(mgr);
+    free(routes);
+    free(networks);
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 50000;
+    int shell_count = argc > 2 ? atoi(argv[2]) : 200;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Route Programming Benchmark\n");
+    printf("================================================================================\n\n");
+
+    if (geteuid() != 0) {
+        printf("  SKIPPED: must be run as root\n\n");
+        return 0;
+    }
+    if (unshare(CLONE_NEWNET) != 0) {
+        printf("  SKIPPED: cannot create a network namespace (%s)\n\n", strerror(errno));
+        return 0;
+    }
+    if (system("ip link add " BENCH_DEV " type veth peer name rtb1 && "
+               "ip link set " BENCH_DEV " up && ip link set rtb1 up && "
+               "ip link add " BENCH_DEV2 " type veth peer name rtb3 && "
+               "ip link set " BENCH_DEV2 " up && ip link set rtb3 up") != 0) {
+        printf("  FAILED: could not create veth device\n\n");
+        return 1;
+    }
+
+    printf("[shell] %d routes\n", shell_count);
+    bench_shell(shell_count);
+    printf("\n[netlink] %d routes, one request at a time\n", count);
+    bench_netlink(count);
+    printf("\n[batch] %d routes, pipelined\n", count);
+    bench_batch(count);
+    printf("\n[sync] %d desired routes\n", count);
+    bench_sync(count);
+    printf("\n[aggregate] %d routes with holes\n", count);
+    bench_aggregate(count);
+    printf("\n[failover] %d routes moved to another device\n", FAILOVER_ROUTES);
+    bench_failover(FAILOVER_ROUTES);
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * bench_stats.c - Cost of a statistics sampling round
+ *
+ * Times nb_stats_sample() for a synthetic device dump (sort, EWMA merge
+ * and ring append) and reading the latest round back, as the status
+ * command does.
+ *
+ * Usage: ./bench_stats [peers]   (default: 100000)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "stats.h"
+#include <sys/random.h>
+#include <time.h>
+
+#define ROUNDS 10
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int peers = argc > 1 ? atoi(argv[1]) : 100000;
+    if (peers <= 0) peers = 100000;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Statistics Sampler Benchmark (%d peers)\n", peers);
+    printf("================================================================================\n\n");
+
+    char path[] = "/tmp/bench_stats_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("ERROR: mkstemp failed\n");
+        return 1;
+    }
+    close(fd);
+
+    wg_device_t dev;
+    memset(&dev, 0, sizeof(dev));
+    dev.peers = calloc(peers, sizeof(wg_device_peer_t));
+    dev.peer_count = peers;
+    nb_stats_t *stats = NULL;
+    if (!dev.peers || nb_stats_open(path, (uint32_t)peers * 4, 0, &stats) != NB_SUCCESS) {
+        printf("ERROR: Setup failed\n");
+        return 1;
+    }
+    for (int i = 0; i < peers; i++) {
+        if (getrandom(dev.peers[i].public_key, WG_KEY_LEN, 0) != WG_KEY_LEN) {
+            printf("ERROR: getrandom failed\n");
+            return 1;
+        }
+    }
+
+    double total = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < peers; i++) {
+            dev.peers[i].rx_bytes += 1000 + i;
+            dev.peers[i].tx_bytes += 500 + i;
+        }
+        double t0 = now_sec();
+        nb_stats_sample(stats, &dev, 1000000 + r * 10000);
+        total += now_sec() - t0;
+    }
+
+    nb_stats_reader_t *reader = NULL;
+    nb_stats_record_t *records = NULL;
+    double t0 = now_sec();
+    int got = 0;
+    if (nb_stats_reader_open(path, &reader) == NB_SUCCESS) {
+        got = nb_stats_reader_last_round(reader, &records);
+        nb_stats_reader_close(reader);
+    }
+    double t1 = now_sec();
+
+    printf("  sample round:      %10.2f ms  (%.1f ns/peer)\n",
+           total * 1e3 / ROUNDS, total * 1e9 / ROUNDS / peers);
+    printf("  read last round:   %10.2f ms  (%d records)\n\n", (t1 - t0) * 1e3, got);
+
+    free(records);
+    free(dev.peers);
+    nb_stats_close(stats);
+    unlink(path);
+    return 0;
+}
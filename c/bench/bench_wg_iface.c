@@ -0,0 +1,182 @@
+/**
+ * bench_wg_iface.c - Peer update throughput: netlink vs shell backend
+ *
+ * Creates a throwaway WireGuard interface per backend, then measures
+ * wg_iface_update_peer() and wg_iface_remove_peer() rates, followed by
+ * the same peers through wg_iface_apply_peers() in a single batch.
+ *
+ * Usage: sudo ./bench_wg_iface [netlink_peers] [shell_peers]
+ *        (defaults: 10000 netlink, 200 shell)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "config.h"
+#include "wg_iface.h"
+#include <sys/random.h>
+#include <time.h>
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Generate count random base64 public keys */
+static char (*random_keys(int count))[WG_KEY_B64_LEN] {
+    char (*keys)[WG_KEY_B64_LEN] = calloc(count, WG_KEY_B64_LEN);
+    if (!keys) return NULL;
+
+    for (int i = 0; i < count; i++) {
+        uint8_t raw[WG_KEY_LEN];
+        if (getrandom(raw, sizeof(raw), 0) != sizeof(raw)) {
+            free(keys);
+            return NULL;
+        }
+        wg_key_to_base64(keys[i], raw);
+    }
+    return keys;
+}
+
+static int run_backend(const char *backend, int peers) {
+    nb_config_t *cfg = NULL;
+    wg_iface_t *iface = NULL;
+    char ifname[32];
+    uint8_t raw[WG_KEY_LEN];
+    char privkey[WG_KEY_B64_LEN];
+    int ret;
+
+    if (peers <= 0) {
+        return 0;
+    }
+
+    printf("[%s] %d peers\n", backend, peers);
+
+    config_new_default(&cfg);
+    free(cfg->wg_iface_name);
+    snprintf(ifname, sizeof(ifname), "wtnb-bn-%d", getpid() % 10000);
+    cfg->wg_iface_name = strdup(ifname);
+    getrandom(raw, sizeof(raw), 0);
+    raw[0] &= 248;
+    raw[31] = (raw[31] & 127) | 64;
+    wg_key_to_base64(privkey, raw);
+    cfg->wg_private_key = strdup(privkey);
+    cfg->wg_address = strdup("203.0.113.249/32");
+    cfg->wg_listen_port = 53100 + (getpid() % 500);
+    cfg->wg_backend = strdup(backend);
+
+    ret = wg_iface_create(cfg, &iface);
+    if (ret != NB_SUCCESS) {
+        printf("  FAILED: Could not create interface\n");
+        config_free(cfg);
+        return 1;
+    }
+
+    char (*keys)[WG_KEY_B64_LEN] = random_keys(peers);
+    if (!keys) {
+        printf("  FAILED: Could not generate keys\n");
+        wg_iface_destroy(iface);
+        wg_iface_free(iface);
+        config_free(cfg);
+        return 1;
+    }
+
+    /* Silence per-peer INFO logging while measuring */
+    fflush(stdout);
+    FILE *saved = stdout;
+    stdout = fopen("/dev/null", "w");
+
+    double t0 = now_sec();
+    int failures = 0;
+    for (int i = 0; i < peers; i++) {
+        char ips[64];
+        snprintf(ips, sizeof(ips), "100.%d.%d.%d/32", 64 + (i >> 16), (i >> 8) & 0xff, i & 0xff);
+        if (wg_iface_update_peer(iface, keys[i], ips, 25, "203.0.113.10:51820", NULL) != NB_SUCCESS) {
+            failures++;
+        }
+    }
+    double t1 = now_sec();
+    for (int i = 0; i < peers; i++) {
+        if (wg_iface_remove_peer(iface, keys[i]) != NB_SUCCESS) {
+            failures++;
+        }
+    }
+    double t2 = now_sec();
+
+    /* Same peers again, as one batch */
+    wg_peer_spec_t *specs = calloc(peers, sizeof(wg_peer_spec_t));
+    nb_prefix_t *ips = calloc(peers, sizeof(nb_prefix_t));
+    double t3 = t2, t4 = t2;
+    if (specs && ips) {
+        for (int i = 0; i < peers; i++) {
+            char cidr[64];
+            snprintf(cidr, sizeof(cidr), "100.%d.%d.%d/32", 64 + (i >> 16), (i >> 8) & 0xff, i & 0xff);
+            nb_prefix_parse(cidr, &ips[i]);
+            wg_key_from_base64(specs[i].public_key, keys[i]);
+            specs[i].allowed_ips = &ips[i];
+            specs[i].allowed_ips_count = 1;
+            nb_endpoint_parse("203.0.113.10:51820", &specs[i].endpoint);
+            specs[i].keepalive = 25;
+        }
+
+        t3 = now_sec();
+        if (wg_iface_apply_peers(iface, specs, peers, NULL) != NB_SUCCESS) {
+            failures++;
+        }
+        t3 = now_sec() - t3;
+
+        for (int i = 0; i < peers; i++) {
+            specs[i].remove = 1;
+        }
+        t4 = now_sec();
+        if (wg_iface_apply_peers(iface, specs, peers, NULL) != NB_SUCCESS) {
+            failures++;
+        }
+        t4 = now_sec() - t4;
+    } else {
+        failures++;
+    }
+    free(specs);
+    free(ips);
+
+    fclose(stdout);
+    stdout = saved;
+
+    printf("  update:       %8.3f s  %10.0f peers/s\n", t1 - t0, peers / (t1 - t0));
+    printf("  remove:       %8.3f s  %10.0f peers/s\n", t2 - t1, peers / (t2 - t1));
+    printf("  batch update: %8.3f s  %10.0f peers/s\n", t3, peers / t3);
+    printf("  batch remove: %8.3f s  %10.0f peers/s\n", t4, peers / t4);
+    if (failures) {
+        printf("  WARNING: %d operation(s) failed\n", failures);
+    }
+    printf("\n");
+
+    free(keys);
+    wg_iface_destroy(iface);
+    wg_iface_free(iface);
+    config_free(cfg);
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    int netlink_peers = argc > 1 ? atoi(argv[1]) : 10000;
+    int shell_peers = argc > 2 ? atoi(argv[2]) : 200;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - WireGuard Backend Benchmark\n");
+    printf("================================================================================\n\n");
+
+    if (geteuid() != 0) {
+        printf("ERROR: This benchmark must be run as root (use sudo)\n");
+        return 1;
+    }
+
+    int ret = 0;
+    ret |= run_backend("netlink", netlink_peers);
+    ret |= run_backend("shell", shell_peers);
+
+    return ret;
+}
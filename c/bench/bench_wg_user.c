@@ -0,0 +1,312 @@
+/**
+ * bench_wg_user.c - Userspace WireGuard datapath throughput
+ *
+ * Part 1 measures the protocol primitives in-process (transport
+ * encryption and full handshakes). Part 2 builds two network namespaces
+ * joined by a veth pair, runs a userspace WireGuard interface in each
+ * (through wg_iface with WgBackend "userspace") and streams TCP across
+ * the tunnel, reporting throughput, handshake latency and how well the
+ * UDP batching (sendmmsg/GSO, recvmmsg/GRO) coalesced.
+ *
+ * Usage: sudo ./bench_wg_user [seconds]   (default 2)
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#define _GNU_SOURCE
+#include "common.h"
+#include "config.h"
+#include "wg_iface.h"
+#include "wg_user.h"
+#include "wg_noise.h"
+#include <sched.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define WG_PORT     51820
+#define TCP_PORT    5201
+#define CHUNK       (128 * 1024)
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Part 1: crypto */
+
+static void bench_crypto(void) {
+    uint8_t key[32], pkt[WG_USER_MTU], msg[WG_USER_MTU + 64];
+    memset(key, 7, sizeof(key));
+    memset(pkt, 1, sizeof(pkt));
+
+    int n = 200000;
+    double t0 = now_sec();
+    for (int i = 0; i < n; i++) {
+        wg_noise_data_seal(msg, pkt, sizeof(pkt), 1, (uint64_t)i, key);
+    }
+    double dt = now_sec() - t0;
+    printf("  Seal %d-byte packets:  %8.0f MB/s (%.0f packets/s)\n",
+           WG_USER_MTU, n * (double)sizeof(pkt) / dt / 1e6, n / dt);
+
+    wg_noise_static_t a, b;
+    wg_noise_handshake_t a_hs, b_hs;
+    wg_noise_keypair_t kp;
+    uint8_t ka[WG_KEY_LEN], kb[WG_KEY_LEN];
+    uint8_t init[WG_MSG_INITIATION_LEN], resp[WG_MSG_RESPONSE_LEN];
+    wg_key_generate_private(ka);
+    wg_key_generate_private(kb);
+    wg_noise_static_init(&a, ka);
+    wg_noise_static_init(&b, kb);
+    wg_noise_handshake_init(&a_hs, &a, b.public_key, NULL);
+    wg_noise_handshake_init(&b_hs, &b, a.public_key, NULL);
+
+    /* Both sides of each handshake; the rate limit is bypassed with a fake clock */
+    n = 500;
+    int done = 0;
+    t0 = now_sec();
+    for (int i = 0; i < n; i++) {
+        wg_noise_initiation_t in;
+        memset(b_hs.latest_timestamp, 0, sizeof(b_hs.latest_timestamp));
+        if (wg_noise_create_initiation(&a_hs, &a, 1, init) == NB_SUCCESS &&
+            wg_noise_consume_initiation(&b, init, &in) == NB_SUCCESS &&
+            wg_noise_accept_initiation(&b_hs, &in, init, (int64_t)i * 1000) == NB_SUCCESS &&
+            wg_noise_create_response(&b_hs, 2, resp) == NB_SUCCESS &&
+            wg_noise_derive_keypair(&b_hs, &kp, 0) == NB_SUCCESS &&
+            wg_noise_consume_response(&a_hs, &a, resp) == NB_SUCCESS &&
+            wg_noise_derive_keypair(&a_hs, &kp, 0) == NB_SUCCESS) {
+            done++;
+        }
+    }
+    dt = now_sec() - t0;
+    printf("  Handshakes (both sides): %6.0f /s (%d/%d completed)\n", done / dt, done, n);
+}
+
+/* Part 2: tunnel between two namespaces */
+
+static int wait_byte(int fd) {
+    char c;
+    return read(fd, &c, 1) == 1;
+}
+
+static void send_byte(int fd) {
+    char c = 'x';
+    if (write(fd, &c, 1) != 1) {
+        perror("write");
+    }
+}
+
+static wg_iface_t* make_iface(const char *name, const char *address, const uint8_t priv[WG_KEY_LEN],
+                              const uint8_t peer_pub[WG_KEY_LEN], const char *peer_ip,
+                              const char *peer_endpoint) {
+    nb_config_t *cfg = NULL;
+    wg_iface_t *iface = NULL;
+    char b64[WG_KEY_B64_LEN];
+
+    config_new_default(&cfg);
+    free(cfg->wg_iface_name);
+    cfg->wg_iface_name = strdup(name);
+    wg_key_to_base64(b64, priv);
+    cfg->wg_private_key = strdup(b64);
+    cfg->wg_address = strdup(address);
+    cfg->wg_listen_port = WG_PORT;
+    cfg->wg_backend = strdup("userspace");
+
+    int ok = wg_iface_create(cfg, &iface) == NB_SUCCESS;
+    config_free(cfg);
+    if (!ok) {
+        return NULL;
+    }
+
+    wg_peer_spec_t spec;
+    nb_prefix_t allowed;
+    memset(&spec, 0, sizeof(spec));
+    memcpy(spec.public_key, peer_pub, WG_KEY_LEN);
+    nb_prefix_parse(peer_ip, &allowed);
+    spec.allowed_ips = &allowed;
+    spec.allowed_ips_count = 1;
+    spec.keepalive = 0;
+    nb_endpoint_parse(peer_endpoint, &spec.endpoint);
+    if (wg_iface_apply_peers(iface, &spec, 1, NULL) != NB_SUCCESS || wg_iface_up(iface) != NB_SUCCESS) {
+        wg_iface_destroy(iface);
+        wg_iface_free(iface);
+        return NULL;
+    }
+    return iface;
+}
+
+static void print_stats(const char *side, wg_iface_t *iface) {
+    wg_user_stats_t st;
+    wg_user_get_stats(iface->user, &st);
+    printf("  [%s] tx %llu pkts in %llu datagrams, %llu GSO sends, %llu sendmmsg calls\n",
+           side, (unsigned long long)st.tx_packets, (unsigned long long)st.tx_datagrams,
+           (unsigned long long)st.tx_gso, (unsigned long long)st.tx_syscalls);
+    printf("  [%s] rx %llu pkts from %llu recvmmsg entries (%llu GRO), %llu calls, %llu dropped\n",
+           side, (unsigned long long)st.rx_packets, (unsigned long long)st.rx_datagrams,
+           (unsigned long long)st.rx_gro, (unsigned long long)st.rx_syscalls,
+           (unsigned long long)st.dropped);
+}
+
+/* Responder side: TCP sink in its own namespace */
+static int run_child(int rd, int wr, const uint8_t priv[WG_KEY_LEN], const uint8_t peer_pub[WG_KEY_LEN]) {
+    if (unshare(CLONE_NEWNET) != 0) {
+        perror("unshare");
+        return 1;
+    }
+    send_byte(wr);                      /* Namespace ready for the veth end */
+    if (!wait_byte(rd) ||
+        system("ip link set lo up && ip addr add 10.99.0.2/24 dev vb && ip link set vb up") != 0) {
+        return 1;
+    }
+
+    wg_iface_t *iface = make_iface("wgb", "10.100.0.2/24", priv, peer_pub, "10.100.0.1/32",
+                                   "10.99.0.1:51820");
+    if (!iface) {
+        return 1;
+    }
+
+    int one = 1;
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sin = { .sin_family = AF_INET, .sin_port = htons(TCP_PORT) };
+    inet_pton(AF_INET, "10.100.0.2", &sin.sin_addr);
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) < 0 || listen(lfd, 1) < 0) {
+        perror("listen");
+        return 1;
+    }
+    send_byte(wr);                      /* Listening */
+
+    int fd = accept(lfd, NULL, NULL);
+    static char buf[CHUNK];
+    uint64_t total = 0;
+    ssize_t n;
+    while (fd >= 0 && (n = read(fd, buf, sizeof(buf))) > 0) {
+        total += (uint64_t)n;
+    }
+    print_stats("receiver", iface);
+    if (write(wr, &total, sizeof(total)) != sizeof(total)) {
+        perror("write");
+    }
+
+    close(fd);
+    close(lfd);
+    wg_iface_destroy(iface);
+    wg_iface_free(iface);
+    return 0;
+}
+
+static int bench_tunnel(double seconds) {
+    uint8_t priv_a[WG_KEY_LEN], priv_b[WG_KEY_LEN], pub_a[WG_KEY_LEN], pub_b[WG_KEY_LEN];
+    int p2c[2], c2p[2];
+
+    wg_key_generate_private(priv_a);
+    wg_key_generate_private(priv_b);
+    wg_key_derive_public(pub_a, priv_a);
+    wg_key_derive_public(pub_b, priv_b);
+
+    if (unshare(CLONE_NEWNET) != 0) {
+        printf("  SKIPPED: cannot create a network namespace (%s)\n", strerror(errno));
+        return 0;
+    }
+    if (pipe(p2c) < 0 || pipe(c2p) < 0) {
+        return 1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(p2c[1]);
+        close(c2p[0]);
+        int ret = run_child(p2c[0], c2p[1], priv_b, pub_a);
+        fflush(stdout);
+        _exit(ret);
+    }
+    close(p2c[0]);
+    close(c2p[1]);
+
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd),
+             "ip link set lo up && ip link add va type veth peer name vb netns %d && "
+             "ip addr add 10.99.0.1/24 dev va && ip link set va up", (int)pid);
+    wg_iface_t *iface = NULL;
+    int ok = wait_byte(c2p[0]) && system(cmd) == 0;
+    send_byte(p2c[1]);
+    ok = ok && (iface = make_iface("wga", "10.100.0.1/24", priv_a, pub_b, "10.100.0.2/32",
+                                   "10.99.0.2:51820")) != NULL;
+    ok = ok && wait_byte(c2p[0]);
+    if (!ok) {
+        printf("  FAILED: tunnel setup\n");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        if (iface) {
+            wg_iface_destroy(iface);
+            wg_iface_free(iface);
+        }
+        return 1;
+    }
+
+    /* The first SYN is staged until the handshake completes */
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sin = { .sin_family = AF_INET, .sin_port = htons(TCP_PORT) };
+    inet_pton(AF_INET, "10.100.0.2", &sin.sin_addr);
+    double t0 = now_sec();
+    if (connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+        perror("connect");
+    }
+    double t_connect = now_sec() - t0;
+
+    static char buf[CHUNK];
+    memset(buf, 0xab, sizeof(buf));
+    t0 = now_sec();
+    while (now_sec() - t0 < seconds) {
+        if (write(fd, buf, sizeof(buf)) < 0) {
+            perror("write");
+            break;
+        }
+    }
+    shutdown(fd, SHUT_WR);
+    uint64_t received = 0;
+    if (read(c2p[0], &received, sizeof(received)) != sizeof(received)) {
+        received = 0;
+    }
+    double dt = now_sec() - t0;
+    close(fd);
+
+    print_stats("sender", iface);
+    printf("  Handshake + TCP connect: %.2f ms\n", t_connect * 1e3);
+    printf("  TCP over tunnel:         %.0f Mbit/s (%.1f MB in %.2f s)\n",
+           received * 8.0 / dt / 1e6, received / 1e6, dt);
+
+    waitpid(pid, NULL, 0);
+    wg_iface_destroy(iface);
+    wg_iface_free(iface);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Userspace WireGuard Benchmark\n");
+    printf("================================================================================\n\n");
+
+    printf("[crypto]\n");
+    bench_crypto();
+    printf("\n");
+
+    printf("[tunnel] veth between two namespaces, %.1f s TCP stream\n", seconds);
+    if (geteuid() != 0) {
+        printf("  SKIPPED: must be run as root\n\n");
+        return 0;
+    }
+    int ret = bench_tunnel(seconds);
+    printf("\n");
+    return ret;
+}
@@ -0,0 +1,72 @@
+/**
+ * arena.h - Bump allocator for parsed snapshots
+ *
+ * A snapshot (peers_file_t, mgmt_config_t) is built once and freed as a
+ * whole, so its strings and arrays do not need individual lifetimes.
+ * The arena hands them out from a few large blocks by bumping an offset;
+ * freeing the arena frees every block in one pass. Nothing is freed
+ * individually, and pointers stay valid until nb_arena_free().
+ *
+ * Blocks grow geometrically from the initial size hint up to
+ * NB_ARENA_BLOCK_MAX, so a snapshot of any size costs a handful of
+ * malloc() calls; a request larger than the next block gets its own.
+ *
+ * Not thread safe: one arena belongs to one snapshot being built.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_ARENA_H
+#define NB_ARENA_H
+
+#include <stddef.h>
+
+#define NB_ARENA_BLOCK_MIN  4096
+#define NB_ARENA_BLOCK_MAX  (4 * 1024 * 1024)
+
+typedef struct nb_arena_block nb_arena_block_t;
+
+typedef struct {
+    nb_arena_block_t *head;     /* Current block, older blocks follow */
+    size_t next_size;           /* Size of the next block */
+    size_t used;                /* Bytes handed out (including alignment) */
+    size_t reserved;            /* Bytes in all blocks */
+    int blocks;
+} nb_arena_t;
+
+/**
+ * Initialize an empty arena; no memory is allocated until the first request
+ *
+ * @param size_hint Expected total size, 0 for NB_ARENA_BLOCK_MIN (the first
+ *                  block is exactly this large when above the minimum)
+ */
+void nb_arena_init(nb_arena_t *arena, size_t size_hint);
+
+/**
+ * Allocate size bytes aligned for any type (uninitialized)
+ *
+ * @return Memory owned by the arena, NULL if out of memory
+ */
+void* nb_arena_alloc(nb_arena_t *arena, size_t size);
+
+/**
+ * Allocate a zeroed array of count elements
+ *
+ * @return Memory owned by the arena, NULL on overflow or out of memory
+ */
+void* nb_arena_calloc(nb_arena_t *arena, size_t count, size_t size);
+
+/**
+ * Copy a string into the arena
+ *
+ * @return Copy, NULL if s is NULL or out of memory
+ */
+char* nb_arena_strdup(nb_arena_t *arena, const char *s);
+
+/**
+ * Free every block; the arena is empty again and may be reused
+ */
+void nb_arena_free(nb_arena_t *arena);
+
+#endif /* NB_ARENA_H */
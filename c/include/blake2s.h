@@ -0,0 +1,60 @@
+/**
+ * blake2s.h - BLAKE2s hash (RFC 7693) and HMAC-BLAKE2s
+ *
+ * Reference: WireGuard whitepaper 5.4 (HASH, MAC, HMAC)
+ *
+ * WireGuard uses BLAKE2s-256 as HASH, keyed BLAKE2s-128 as MAC and
+ * HMAC-BLAKE2s-256 inside its KDF.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_BLAKE2S_H
+#define NB_BLAKE2S_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BLAKE2S_BLOCK_LEN   64
+#define BLAKE2S_HASH_LEN    32
+#define BLAKE2S_KEY_LEN     32
+
+typedef struct {
+    uint32_t h[8];
+    uint32_t t[2];
+    uint8_t buf[BLAKE2S_BLOCK_LEN];
+    size_t buflen;
+    size_t outlen;
+} blake2s_state_t;
+
+/**
+ * Start an unkeyed hash of outlen bytes (1..32)
+ */
+void blake2s_init(blake2s_state_t *s, size_t outlen);
+
+/**
+ * Start a keyed hash of outlen bytes (key_len 1..32)
+ */
+void blake2s_init_key(blake2s_state_t *s, size_t outlen, const uint8_t *key, size_t key_len);
+
+void blake2s_update(blake2s_state_t *s, const uint8_t *in, size_t len);
+
+/**
+ * Write outlen bytes and wipe the state
+ */
+void blake2s_final(blake2s_state_t *s, uint8_t *out);
+
+/**
+ * One-shot hash; key may be NULL for an unkeyed hash
+ */
+void blake2s(uint8_t *out, size_t outlen, const uint8_t *in, size_t len,
+             const uint8_t *key, size_t key_len);
+
+/**
+ * HMAC-BLAKE2s-256 (key of at most BLAKE2S_BLOCK_LEN bytes)
+ */
+void blake2s_hmac(uint8_t out[BLAKE2S_HASH_LEN], const uint8_t *in, size_t len,
+                  const uint8_t *key, size_t key_len);
+
+#endif /* NB_BLAKE2S_H */
@@ -0,0 +1,97 @@
+/**
+ * chacha20poly1305.h - ChaCha20-Poly1305 AEAD (RFC 8439) and XChaCha20-Poly1305
+ *
+ * Reference: wireguard-go (golang.org/x/crypto/chacha20poly1305), WireGuard whitepaper 5.4
+ *
+ * WireGuard uses the AEAD with a 64-bit little-endian counter as nonce
+ * (four zero bytes followed by the counter), and XChaCha20-Poly1305 with a
+ * 24-byte random nonce for cookie replies. The _ietf variants take the
+ * full 96-bit RFC 8439 nonce.
+ *
+ * ChaCha20 processes four blocks at a time with GCC vector extensions when
+ * available (SSE2/NEON), falling back to one block at a time. Poly1305 uses
+ * 44-bit limbs on compilers with 128-bit integers and 26-bit limbs
+ * elsewhere (or with -DNB_POLY1305_GENERIC). Tags are compared in constant
+ * time.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_CHACHA20POLY1305_H
+#define NB_CHACHA20POLY1305_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CHACHA20POLY1305_KEY_LEN    32
+#define CHACHA20POLY1305_TAG_LEN    16
+#define XCHACHA20POLY1305_NONCE_LEN 24
+
+/**
+ * Encrypt and authenticate
+ *
+ * dst may equal src (in place).
+ *
+ * @param dst Output of src_len + CHACHA20POLY1305_TAG_LEN bytes
+ * @param nonce WireGuard counter nonce
+ */
+void chacha20poly1305_encrypt(uint8_t *dst, const uint8_t *src, size_t src_len,
+                              const uint8_t *ad, size_t ad_len, uint64_t nonce,
+                              const uint8_t key[CHACHA20POLY1305_KEY_LEN]);
+
+/**
+ * Verify and decrypt
+ *
+ * Nothing is written to dst unless the tag is valid. dst may equal src.
+ *
+ * @param dst Output of src_len - CHACHA20POLY1305_TAG_LEN bytes
+ * @return NB_SUCCESS, or NB_ERROR_INVALID if the tag does not match
+ */
+int chacha20poly1305_decrypt(uint8_t *dst, const uint8_t *src, size_t src_len,
+                             const uint8_t *ad, size_t ad_len, uint64_t nonce,
+                             const uint8_t key[CHACHA20POLY1305_KEY_LEN]);
+
+/**
+ * chacha20poly1305_encrypt() with a 96-bit RFC 8439 nonce
+ */
+void chacha20poly1305_encrypt_ietf(uint8_t *dst, const uint8_t *src, size_t src_len,
+                                   const uint8_t *ad, size_t ad_len, const uint8_t nonce[12],
+                                   const uint8_t key[CHACHA20POLY1305_KEY_LEN]);
+
+/**
+ * chacha20poly1305_decrypt() with a 96-bit RFC 8439 nonce
+ */
+int chacha20poly1305_decrypt_ietf(uint8_t *dst, const uint8_t *src, size_t src_len,
+                                  const uint8_t *ad, size_t ad_len, const uint8_t nonce[12],
+                                  const uint8_t key[CHACHA20POLY1305_KEY_LEN]);
+
+/**
+ * XChaCha20-Poly1305 encryption (24-byte nonce)
+ */
+void xchacha20poly1305_encrypt(uint8_t *dst, const uint8_t *src, size_t src_len,
+                               const uint8_t *ad, size_t ad_len,
+                               const uint8_t nonce[XCHACHA20POLY1305_NONCE_LEN],
+                               const uint8_t key[CHACHA20POLY1305_KEY_LEN]);
+
+/**
+ * XChaCha20-Poly1305 decryption (24-byte nonce)
+ *
+ * @return NB_SUCCESS or NB_ERROR_INVALID
+ */
+int xchacha20poly1305_decrypt(uint8_t *dst, const uint8_t *src, size_t src_len,
+                              const uint8_t *ad, size_t ad_len,
+                              const uint8_t nonce[XCHACHA20POLY1305_NONCE_LEN],
+                              const uint8_t key[CHACHA20POLY1305_KEY_LEN]);
+
+/**
+ * HChaCha20 subkey derivation (used by XChaCha20)
+ */
+void hchacha20(uint8_t out[32], const uint8_t nonce[16], const uint8_t key[32]);
+
+/**
+ * Name of the implementation in use, e.g. "4-way/44-bit"
+ */
+const char* chacha20poly1305_impl(void);
+
+#endif /* NB_CHACHA20POLY1305_H */
@@ -22,6 +22,29 @@ typedef struct {
     char *wg_address;           /* WireGuard IP address, e.g., "100.64.0.5/16" */
     int wg_listen_port;         /* Listen port, default 51820 */
     char *preshared_key;        /* Optional pre-shared key */
+    char *wg_backend;           /* "auto" (default), "netlink", "userspace" or "shell" */
+    int wg_notrack;             /* 1 to skip conntrack for the listen port (default 0) */
+
+    /* Per-peer statistics */
+    char *stats_file;           /* Ring file, NULL for /var/lib/netbird/<iface>.stats */
+    int stats_interval;         /* Sampling interval in seconds, 0 disables (default 10) */
+
+    /* Peers published by the Go helper (see peers_file.h) */
+    char *peers_file;           /* peers.json, watched while running; NULL: manual peers only */
+    char *delta_socket;         /* Unix socket the helper attaches a delta ring to (delta_ring.h); NULL: off */
+    char *journal_file;         /* Change journal tailed after a peers_file snapshot (journal.h); NULL: off */
+
+    /* Lazy peers: install on first traffic, evict when idle */
+    int lazy_peers;             /* 1 to enable (default 0) */
+    int lazy_idle_timeout;      /* Seconds without a handshake before eviction (default 900) */
+
+    /* Policy routing: routes in a dedicated table (see route_use_table) */
+    int route_table;            /* Table number, 0 for the main table (default 0) */
+    int route_fwmark;           /* Packets with this mark bypass the table (default 0x1BD00) */
+
+    /* Flowtable offload of forwarded flows (see route_enable_offload) */
+    char **route_offload_devices;   /* Egress devices besides the WireGuard device, NULL: off */
+    int route_offload_devices_count;
 
     /* Server URLs */
     char *management_url;       /* Management server URL */
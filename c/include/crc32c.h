@@ -0,0 +1,25 @@
+/**
+ * crc32c.h - CRC-32C (Castagnoli) checksum
+ *
+ * Checksum of the files shared with the Go helper; matches Go's
+ * crc32.Checksum(data, crc32.MakeTable(crc32.Castagnoli)).
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_CRC32C_H
+#define NB_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Extend a CRC-32C over more data
+ *
+ * @param crc 0 to start, or the result over the preceding data
+ * @return Checksum of the preceding data followed by data
+ */
+uint32_t nb_crc32c(uint32_t crc, const void *data, size_t len);
+
+#endif /* NB_CRC32C_H */
@@ -0,0 +1,54 @@
+/**
+ * curve25519.h - X25519 scalar multiplication (RFC 7748)
+ *
+ * Reference: wireguard-tools curve25519.c, go/iface (wgtypes.GenerateKey)
+ *
+ * Used for WireGuard key generation and public key derivation without
+ * spawning `wg genkey` / `wg pubkey`. Every operation runs in constant time
+ * with respect to the scalar.
+ *
+ * On compilers with 128-bit integers the field arithmetic uses five 51-bit
+ * limbs; elsewhere (or with -DNB_CURVE25519_GENERIC) a portable sixteen
+ * 16-bit limb implementation is used instead.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_CURVE25519_H
+#define NB_CURVE25519_H
+
+#include <stdint.h>
+
+#define CURVE25519_KEY_LEN  32
+
+/**
+ * Clamp a secret scalar as required by X25519
+ */
+void curve25519_clamp_secret(uint8_t secret[CURVE25519_KEY_LEN]);
+
+/**
+ * Compute out = scalar * point
+ *
+ * The scalar is clamped internally; the caller's copy is not modified.
+ *
+ * @param out Resulting u-coordinate
+ * @param scalar Secret scalar
+ * @param point Peer u-coordinate
+ */
+void curve25519(uint8_t out[CURVE25519_KEY_LEN],
+                const uint8_t scalar[CURVE25519_KEY_LEN],
+                const uint8_t point[CURVE25519_KEY_LEN]);
+
+/**
+ * Derive the public key for a secret (scalar * base point 9)
+ */
+void curve25519_generate_public(uint8_t pub[CURVE25519_KEY_LEN],
+                                const uint8_t secret[CURVE25519_KEY_LEN]);
+
+/**
+ * Name of the field arithmetic in use ("64-bit" or "generic")
+ */
+const char* curve25519_impl(void);
+
+#endif /* NB_CURVE25519_H */
@@ -0,0 +1,197 @@
+/**
+ * delta_ring.h - Shared-memory delta channel from the Go helper
+ *
+ * A single-producer/single-consumer ring of typed records in a memfd
+ * shared by the helper (producer) and the engine (consumer), so peer and
+ * route changes reach the engine without rewriting and re-reading whole
+ * files:
+ *
+ *   [nb_delta_header_t][data: capacity bytes]
+ *
+ * The consumer creates the ring and an eventfd and hands both to the
+ * producer over a unix socket (SCM_RIGHTS, see nb_delta_ring_send); the
+ * connection stays open while the producer is attached, so either side
+ * notices when the other goes away.
+ *
+ * Records are 16-byte aligned and never wrap: a record that does not fit
+ * before the end of the data area is preceded by a padding record that
+ * fills it. head and tail count bytes since creation; the producer
+ * publishes head after writing one or more records (release), the
+ * consumer publishes tail after processing them. Each record carries a
+ * sequence number (1, 2, ...) so the consumer can tell that nothing was
+ * lost.
+ *
+ * Wakeups: before sleeping, the consumer sets waiting and checks head
+ * once more; the producer clears waiting after publishing and, if it was
+ * set, writes the eventfd. A burst of records costs one wakeup.
+ *
+ * When the ring is full the producer does not block: it writes its full
+ * state to the files as before and, once there is room, publishes a
+ * NB_DELTA_RESYNC record, so the file is applied in order with the
+ * deltas around it.
+ *
+ * A producer that also keeps a journal (journal.h) follows its changes
+ * with NB_DELTA_JOURNAL_SEQ, the journal record they bring the consumer
+ * to, so the consumer reading the journal after a detach starts there.
+ *
+ * Integers are little endian, addresses and ports in network byte order.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_DELTA_RING_H
+#define NB_DELTA_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ipaddr.h"
+#include "peers_snap.h"
+
+#define NB_DELTA_MAGIC          "NBDRING1"
+#define NB_DELTA_VERSION        1
+#define NB_DELTA_DEFAULT_SIZE   (1 << 20)
+#define NB_DELTA_ALIGN          16
+
+/* Record types */
+#define NB_DELTA_PAD            0   /* Skip to the start of the data area */
+#define NB_DELTA_PEER_SET       1   /* Add or update a peer: peers_snap_peer_t + nb_prefix_t[prefix_count] */
+#define NB_DELTA_PEER_REMOVE    2   /* Remove a peer: 32-byte public key */
+#define NB_DELTA_ROUTE_ADD      3   /* nb_delta_route_t */
+#define NB_DELTA_ROUTE_REMOVE   4   /* nb_delta_route_t (metric ignored) */
+#define NB_DELTA_ROUTE_SYNC     5   /* Complete route set: nb_delta_routes_t + nb_delta_route_t[count] */
+#define NB_DELTA_RESYNC         6   /* Reload the peers file, which holds the complete peer set */
+#define NB_DELTA_JOURNAL_SEQ    7   /* uint64_t: the records so far hold the journal up to this record */
+
+/* Shared header, 256 bytes; each side writes its own cache line */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;       /* sizeof(nb_delta_header_t) */
+    uint64_t capacity;          /* Data bytes, a power of two */
+    uint8_t reserved0[40];
+
+    /* Producer */
+    uint64_t head;              /* Bytes published */
+    uint64_t seq;               /* Sequence number of the last published record */
+    uint64_t resyncs;           /* Times the ring was full and the files were written */
+    uint8_t reserved1[40];
+
+    /* Consumer */
+    uint64_t tail;              /* Bytes consumed */
+    uint8_t reserved2[56];
+
+    /* Both */
+    uint32_t waiting;           /* 1 while the consumer sleeps on the eventfd */
+    uint8_t reserved3[60];
+} nb_delta_header_t;
+
+/* Record header, 16 bytes */
+typedef struct {
+    uint32_t size;              /* Bytes including this header, a multiple of NB_DELTA_ALIGN */
+    uint16_t type;              /* NB_DELTA_* */
+    uint16_t flags;             /* Reserved, 0 */
+    uint64_t seq;               /* 0 for padding */
+} nb_delta_record_t;
+
+/* A route, 24 bytes */
+typedef struct {
+    nb_prefix_t network;
+    uint16_t reserved;
+    uint32_t metric;
+} nb_delta_route_t;
+
+/* Head of a NB_DELTA_ROUTE_SYNC record */
+typedef struct {
+    uint32_t count;
+    uint32_t reserved;
+} nb_delta_routes_t;
+
+typedef struct nb_delta_ring nb_delta_ring_t;
+
+/**
+ * Create a ring (consumer side): a memfd of the given capacity and an eventfd
+ *
+ * @param capacity Data bytes, rounded up to a power of two (0 for NB_DELTA_DEFAULT_SIZE)
+ * @return NB_SUCCESS or NB_ERROR_*
+ */
+int nb_delta_ring_create(size_t capacity, nb_delta_ring_t **ring_out);
+
+/**
+ * Hand the ring to a producer connected to sock
+ *
+ * Sends the memfd and the eventfd in one SCM_RIGHTS message.
+ */
+int nb_delta_ring_send(const nb_delta_ring_t *ring, int sock);
+
+/**
+ * Receive a ring sent with nb_delta_ring_send (producer side)
+ *
+ * Maps the memfd and checks its header; publishing continues after the
+ * last published record.
+ *
+ * @return NB_SUCCESS, NB_ERROR_INVALID (not a ring) or NB_ERROR_*
+ */
+int nb_delta_ring_recv(int sock, nb_delta_ring_t **ring_out);
+
+/**
+ * Unmap a ring and close its descriptors
+ */
+void nb_delta_ring_close(nb_delta_ring_t *ring);
+
+/**
+ * The eventfd the consumer sleeps on
+ */
+int nb_delta_ring_eventfd(const nb_delta_ring_t *ring);
+
+/**
+ * Shared header (counters for status output)
+ */
+const nb_delta_header_t* nb_delta_ring_header(const nb_delta_ring_t *ring);
+
+/**
+ * Reserve a record (producer side)
+ *
+ * The record is not visible until nb_delta_ring_publish().
+ *
+ * @return Payload to fill in (len bytes, zeroed), NULL if the ring is full
+ */
+void* nb_delta_ring_reserve(nb_delta_ring_t *ring, uint16_t type, size_t len);
+
+/**
+ * Publish the reserved records and wake the consumer if it sleeps
+ *
+ * @return NB_SUCCESS or NB_ERROR_SYSTEM (eventfd write failed)
+ */
+int nb_delta_ring_publish(nb_delta_ring_t *ring);
+
+/**
+ * Next published record (consumer side)
+ *
+ * Padding is skipped. The header is copied to rec_out and checked there:
+ * its size lies within what was published. The payload (rec_out->size -
+ * sizeof(nb_delta_record_t) bytes) stays in shared memory until
+ * nb_delta_ring_release(); the producer can still change it, so the
+ * caller copies it out before validating it.
+ *
+ * @return 1 and the record, 0 if there is none, NB_ERROR_INVALID if the
+ *         ring is corrupt or a sequence number was skipped (the producer
+ *         must be dropped)
+ */
+int nb_delta_ring_next(nb_delta_ring_t *ring, nb_delta_record_t *rec_out, const void **payload_out);
+
+/**
+ * Give the space of the records returned so far back to the producer
+ */
+void nb_delta_ring_release(nb_delta_ring_t *ring);
+
+/**
+ * Prepare to sleep on the eventfd (consumer side)
+ *
+ * Clears the eventfd and announces the sleep to the producer.
+ *
+ * @return 1 if records arrived meanwhile (keep reading instead), 0 otherwise
+ */
+int nb_delta_ring_sleep(nb_delta_ring_t *ring);
+
+#endif /* NB_DELTA_RING_H */
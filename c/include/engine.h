@@ -20,6 +20,15 @@
 #include "wg_iface.h"
 #include "route.h"
 #include "mgmt_client.h"
+#include "peers_file.h"
+#include "peers_snap.h"
+#include "delta_ring.h"
+#include "journal.h"
+#include "peer_table.h"
+#include "lpm.h"
+#include "stats.h"
+#include "nflog.h"
+#include "event_loop.h"
 
 /**
  * Engine structure
@@ -35,10 +44,56 @@ typedef struct nb_engine {
 
     /* Route manager */
     route_manager_t *route_mgr;
+    int64_t routes_due_ms;   /* Monotonic time of the next route drift check */
 
     /* Management client (Phase 4) */
     mgmt_client_t *mgmt_client;
 
+    /* Known peers (applied to the interface unless lazy), keyed by raw public key */
+    nb_peer_table_t *peers;
+
+    /* Their allowed IPs, prefix -> peer record id */
+    nb_lpm_t *allowed_ips;
+
+    /* Per-peer statistics sampler (NULL if disabled) */
+    nb_stats_t *stats;
+    int64_t stats_due_ms;    /* Monotonic time of the next sample */
+
+    /* Lazy peers: only peers with recent traffic are in the kernel */
+    int lazy;                /* 1 if enabled and the NFLOG trap is in place */
+    nb_nflog_t nflog;        /* New flows leaving the interface */
+    int64_t lazy_due_ms;     /* Monotonic time of the next idle check */
+    uint64_t activations;
+    uint64_t evictions;
+    uint64_t traps;          /* Trapped packets */
+
+    /* Event loop driving the engine (nb_engine_attach), NULL with nb_engine_tick */
+    nb_loop_t *loop;
+    nb_loop_timer_t *routes_timer;  /* Drift check, periodic or right after a route event */
+    int routes_pending;      /* routes_timer armed for a route event */
+    int routes_fd;           /* Route notifications, -1 if not watched */
+    nb_loop_timer_t *stats_timer;
+    nb_loop_timer_t *lazy_timer;    /* Idle peer check */
+    nb_loop_timer_t *peers_timer;   /* Reload of PeersFile once writes settle */
+    int peers_fd;            /* inotify on the directory of PeersFile, -1 if none */
+    uint64_t peer_reloads;   /* PeersFile reloads */
+
+    /* Delta channel from the Go helper (DeltaSocket, see delta_ring.h) */
+    int delta_listen_fd;     /* -1 if not configured */
+    int delta_conn_fd;       /* Attached helper, -1 if none */
+    nb_delta_ring_t *delta;  /* Its ring, NULL if none */
+    uint64_t delta_records;  /* Records applied */
+    uint64_t delta_wakeups;  /* Eventfd wakeups */
+
+    /* Change journal of the Go helper (JournalFile, see journal.h) */
+    nb_journal_t *journal;   /* Journal being tailed, NULL if none yet */
+    int journal_synced;      /* journal_seq comes from a PeersFile snapshot */
+    int journal_broken;      /* The journal has a damaged record; wait for a new one */
+    uint64_t journal_seq;    /* Last record applied */
+    uint64_t journal_records; /* Records applied */
+    int peers_wd;            /* inotify watches of PeersFile's and JournalFile's directories */
+    int journal_wd;
+
     /* State */
     int running;
 
@@ -59,6 +114,17 @@ typedef struct {
     int keepalive;           /* Persistent keepalive interval */
 } nb_peer_info_t;
 
+/**
+ * Active versus known peers
+ */
+typedef struct {
+    int known;               /* Peers in the engine's table */
+    int active;              /* Peers configured in the kernel */
+    uint64_t activations;    /* Lazy peers installed on traffic */
+    uint64_t evictions;      /* Lazy peers removed when idle */
+    uint64_t traps;          /* Trapped packets */
+} nb_peer_metrics_t;
+
 /**
  * Create a new engine instance
  *
@@ -81,6 +147,12 @@ nb_engine_t* nb_engine_new(nb_config_t *config);
  * 4. (Future: Connects to Management/Signal servers)
  *
  * @param engine Engine instance
+ * With LazyPeers set, the NFLOG trap (see nflog.h) is installed as well.
+ * Peers are then recorded in the engine but only configured in the kernel
+ * once traffic to their allowed IPs is seen, and removed again after
+ * LazyIdleTimeout seconds without a handshake. If the trap cannot be set
+ * up the engine falls back to installing every peer.
+ *
  * @return NB_SUCCESS on success, NB_ERROR_* on failure
  */
 int nb_engine_start(nb_engine_t *engine);
@@ -125,10 +197,72 @@ int nb_engine_stop(nb_engine_t *engine);
  *
  * @param engine Engine instance
  * @param peer Peer information
- * @return NB_SUCCESS on success, NB_ERROR_* on failure
+ * @return NB_SUCCESS on success, NB_ERROR_INVALID if an allowed IP is
+ *         already owned by another peer, NB_ERROR_* on other failures
  */
 int nb_engine_add_peer(nb_engine_t *engine, const nb_peer_info_t *peer);
 
+/**
+ * Add many peers at once
+ *
+ * Converts the peers to wg_peer_spec_t and hands them to
+ * wg_iface_apply_peers(), so the netlink backend can pack them into a
+ * few WG_CMD_SET_DEVICE messages instead of one round trip per peer.
+ * Entries of allowed_ips may be comma separated lists.
+ *
+ * Allowed IPs are checked against the engine's trie first: a prefix
+ * another peer already owns is dropped from the new peer instead of being
+ * moved by the kernel, and counts as a failure. Prefixes that only
+ * contain or fall inside another peer's prefixes are logged.
+ *
+ * @param engine Engine instance
+ * @param peers Array of peers
+ * @param count Number of peers
+ * @return NB_SUCCESS if all peers were added, NB_ERROR if some failed
+ *         (each failure is logged), NB_ERROR_* on invalid arguments
+ */
+int nb_engine_add_peers(nb_engine_t *engine, const nb_peer_info_t *peers, int count);
+
+/**
+ * Make the interface's peers match exactly the given set
+ *
+ * Dumps the device once and applies only the difference (see
+ * wg_reconcile.h): new peers are added, changed peers updated and peers
+ * not in the set removed. When nothing changed no write is issued.
+ * Overlapping allowed IPs within the set are handled as in
+ * nb_engine_add_peers() (the earlier peer keeps a contested prefix).
+ *
+ * @param engine Engine instance
+ * @param peers Complete desired peer set
+ * @param count Number of peers
+ * @return NB_SUCCESS, NB_ERROR if some peers failed, NB_ERROR_* otherwise
+ */
+int nb_engine_sync_peers(nb_engine_t *engine, const nb_peer_info_t *peers, int count);
+
+/**
+ * nb_engine_sync_peers() for a peers.json written by the Go helper
+ */
+int nb_engine_sync_peers_file(nb_engine_t *engine, const peers_file_t *file);
+
+/**
+ * nb_engine_sync_peers() straight from a peers.json file
+ *
+ * The file is streamed (peers_file_stream()) and each peer converted as it
+ * is parsed, without loading a peers_file_t first.
+ *
+ * @param count_out Optional output: peers in the file, -1 if it could not
+ *        be read or parsed (nothing is synced then)
+ */
+int nb_engine_sync_peers_json(nb_engine_t *engine, const char *path, int *count_out);
+
+/**
+ * nb_engine_sync_peers() for a mapped binary snapshot (peers_snap.h)
+ *
+ * Keys, endpoints and prefixes are taken from the snapshot as they are;
+ * nothing is decoded or parsed.
+ */
+int nb_engine_sync_peers_snap(nb_engine_t *engine, const peers_snap_t *snap);
+
 /**
  * Remove a peer from the engine
  *
@@ -138,6 +272,88 @@ int nb_engine_add_peer(nb_engine_t *engine, const nb_peer_info_t *peer);
  */
 int nb_engine_remove_peer(nb_engine_t *engine, const char *public_key);
 
+/**
+ * Look up a peer the engine has applied
+ *
+ * @param engine Engine instance
+ * @param public_key Peer's public key (base64)
+ * @return Record (valid until the next peer change) or NULL if unknown
+ */
+const nb_peer_record_t* nb_engine_find_peer(const nb_engine_t *engine, const char *public_key);
+
+/**
+ * Drive the engine from an event loop
+ *
+ * Replaces polling nb_engine_tick(); use one or the other. The engine
+ * registers with the loop:
+ * - timers for statistics sampling (StatsInterval), the idle peer check
+ *   in lazy mode and the periodic route drift check (30 seconds)
+ * - the NFLOG socket in lazy mode, so trapped peers are installed as soon
+ *   as their first packet is seen
+ * - an rtnetlink notification socket (netlink route backend), so a drift
+ *   check runs within milliseconds of someone deleting or replacing an
+ *   owned route, nexthop or policy rule
+ * - with PeersFile set, an inotify watch on its directory: the file is
+ *   synced now and again whenever the helper rewrites it; a binary
+ *   snapshot (peers_snap.h) is mapped, any other file is read as JSON
+ * The notification socket and the inotify watch are optional and only
+ * warn on failure. Without armed timers the loop does not wake up while
+ * nothing happens. nb_engine_stop() and nb_engine_free() detach.
+ *
+ * @param engine Running engine
+ * @param loop Event loop (must outlive the attachment)
+ * @return NB_SUCCESS, NB_ERROR_INVALID if not running or already
+ *         attached, NB_ERROR_SYSTEM if the timers cannot be created
+ */
+int nb_engine_attach(nb_engine_t *engine, nb_loop_t *loop);
+
+/**
+ * Remove the engine's timers and watches from its event loop
+ */
+void nb_engine_detach(nb_engine_t *engine);
+
+/**
+ * Run periodic engine work; call about once a second while running
+ *
+ * Samples per-peer statistics (WG_CMD_GET_DEVICE) into the stats ring
+ * every StatsInterval seconds and checks the owned routes for drift
+ * every 30 seconds. In lazy mode it also installs peers whose
+ * traffic was trapped since the last call and evicts idle peers.
+ *
+ * @param engine Engine instance
+ * @return NB_SUCCESS or NB_ERROR_* from the last failed task
+ */
+int nb_engine_tick(nb_engine_t *engine);
+
+/**
+ * Throughput and counters of a peer from the latest statistics sample
+ *
+ * @param engine Engine instance
+ * @param public_key Peer's public key (base64)
+ * @param out Rate state (rx_rate/tx_rate are EWMA bytes per second)
+ * @return NB_SUCCESS, NB_ERROR_NOTFOUND if the peer was not sampled or
+ *         sampling is disabled, NB_ERROR_INVALID
+ */
+int nb_engine_peer_rate(const nb_engine_t *engine, const char *public_key, nb_peer_rate_t *out);
+
+/**
+ * Active versus known peers and lazy mode counters
+ *
+ * @param engine Engine instance
+ * @param out Metrics
+ * @return NB_SUCCESS or NB_ERROR_INVALID
+ */
+int nb_engine_peer_metrics(const nb_engine_t *engine, nb_peer_metrics_t *out);
+
+/**
+ * Find the peer whose allowed IPs route an address (longest prefix match)
+ *
+ * @param engine Engine instance
+ * @param ip Address or prefix, e.g. "100.64.0.7" or "10.1.2.0/24"
+ * @return Record (valid until the next peer change) or NULL if no peer owns it
+ */
+const nb_peer_record_t* nb_engine_peer_for_ip(const nb_engine_t *engine, const char *ip);
+
 /**
  * Free engine instance
  *
@@ -0,0 +1,144 @@
+/**
+ * event_loop.h - epoll based event loop
+ *
+ * One epoll descriptor multiplexes everything the client waits for:
+ * - File descriptors of other components (netlink listeners, inotify, ...)
+ * - Timers, one timerfd each (one-shot or periodic, CLOCK_MONOTONIC)
+ * - Signals, delivered through one signalfd instead of async handlers
+ *
+ * The loop sleeps in epoll_wait() without a timeout, so it wakes up only
+ * when a descriptor is ready or a timer expires; an idle client with no
+ * armed timers never wakes up. Callbacks run on the loop's thread and
+ * may add or remove watches, timers included, at any time.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_EVENT_LOOP_H
+#define NB_EVENT_LOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+typedef struct nb_loop nb_loop_t;
+typedef struct nb_loop_timer nb_loop_timer_t;
+
+/**
+ * Callback for a ready descriptor
+ *
+ * @param events EPOLLIN, EPOLLOUT, EPOLLERR, EPOLLHUP, ...
+ */
+typedef void (*nb_loop_fd_cb_t)(nb_loop_t *loop, int fd, uint32_t events, void *ctx);
+
+/**
+ * Callback for an expired timer (the timer may be re-armed or freed here)
+ */
+typedef void (*nb_loop_timer_cb_t)(nb_loop_t *loop, nb_loop_timer_t *timer, void *ctx);
+
+/**
+ * Callback for a received signal
+ */
+typedef void (*nb_loop_signal_cb_t)(nb_loop_t *loop, int sig, void *ctx);
+
+/**
+ * Create an event loop
+ *
+ * @return Loop, NULL on failure
+ */
+nb_loop_t* nb_loop_new(void);
+
+/**
+ * Free a loop with its timers and signal handling
+ *
+ * Descriptors added with nb_loop_add_fd() are not closed. Signals taken
+ * over by nb_loop_add_signal() are unblocked again.
+ */
+void nb_loop_free(nb_loop_t *loop);
+
+/**
+ * Watch a descriptor (level triggered)
+ *
+ * @param events EPOLLIN and/or EPOLLOUT (EPOLLERR/EPOLLHUP are implied)
+ * @return NB_SUCCESS, NB_ERROR_EXISTS if fd is already watched, NB_ERROR_*
+ */
+int nb_loop_add_fd(nb_loop_t *loop, int fd, uint32_t events, nb_loop_fd_cb_t cb, void *ctx);
+
+/**
+ * Stop watching a descriptor (it stays open)
+ *
+ * @return NB_SUCCESS or NB_ERROR_NOTFOUND
+ */
+int nb_loop_del_fd(nb_loop_t *loop, int fd);
+
+/**
+ * Create a timer; it does not fire until armed
+ *
+ * @return Timer (freed with nb_loop_timer_free() or nb_loop_free()), NULL on failure
+ */
+nb_loop_timer_t* nb_loop_timer_new(nb_loop_t *loop, nb_loop_timer_cb_t cb, void *ctx);
+
+/**
+ * Arm or re-arm a timer
+ *
+ * Replaces any pending expiry. Expiries missed while the loop was busy
+ * are merged into one callback.
+ *
+ * @param delay_ms First expiry from now (0: on the next loop iteration)
+ * @param interval_ms Period after that, 0 for a one-shot timer
+ * @return NB_SUCCESS, NB_ERROR_INVALID, NB_ERROR_SYSTEM
+ */
+int nb_loop_timer_arm(nb_loop_timer_t *timer, int64_t delay_ms, int64_t interval_ms);
+
+/**
+ * Cancel a pending expiry
+ */
+void nb_loop_timer_disarm(nb_loop_timer_t *timer);
+
+/**
+ * 1 if the timer will fire again, 0 if it is disarmed or a spent one-shot
+ */
+int nb_loop_timer_armed(const nb_loop_timer_t *timer);
+
+/**
+ * Free a timer (safe inside its own callback)
+ */
+void nb_loop_timer_free(nb_loop_timer_t *timer);
+
+/**
+ * Handle a signal in the loop
+ *
+ * The signal is blocked for the calling thread and read from a signalfd.
+ * Threads inherit the mask, so add signals before starting threads that
+ * should not receive them (e.g. the userspace WireGuard workers).
+ *
+ * @return NB_SUCCESS, NB_ERROR_EXISTS if the signal is already handled, NB_ERROR_*
+ */
+int nb_loop_add_signal(nb_loop_t *loop, int sig, nb_loop_signal_cb_t cb, void *ctx);
+
+/**
+ * Dispatch events until nb_loop_stop() is called
+ *
+ * @return NB_SUCCESS after nb_loop_stop(), NB_ERROR_SYSTEM if epoll fails
+ */
+int nb_loop_run(nb_loop_t *loop);
+
+/**
+ * Wait for events once and dispatch them
+ *
+ * @param timeout_ms Maximum wait, -1 to wait indefinitely, 0 to poll
+ * @return Number of events dispatched (0 on timeout), NB_ERROR_SYSTEM
+ */
+int nb_loop_run_once(nb_loop_t *loop, int timeout_ms);
+
+/**
+ * Make nb_loop_run() return after the current dispatch (callable from callbacks)
+ */
+void nb_loop_stop(nb_loop_t *loop);
+
+/**
+ * Number of times epoll_wait() returned with events, for idle checks
+ */
+uint64_t nb_loop_wakeups(const nb_loop_t *loop);
+
+#endif /* NB_EVENT_LOOP_H */
@@ -0,0 +1,133 @@
+/**
+ * ipaddr.h - IP prefix and endpoint helpers
+ *
+ * Binary representations of the CIDR / "IP:port" strings used throughout
+ * the configuration, so that the netlink backends never have to format
+ * command lines.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_IPADDR_H
+#define NB_IPADDR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+/* Longest textual prefix, e.g. "ffff:...:ffff/128" */
+#define NB_PREFIX_STRLEN    (INET6_ADDRSTRLEN + 4)
+
+/* Longest textual endpoint, e.g. "[ffff:...:ffff]:65535" */
+#define NB_ENDPOINT_STRLEN  (INET6_ADDRSTRLEN + 8)
+
+/**
+ * IPv4 or IPv6 prefix
+ *
+ * IPv4 addresses use the first 4 bytes of addr.
+ */
+typedef struct {
+    uint8_t family;         /* AF_INET or AF_INET6 */
+    uint8_t len;            /* Prefix length in bits */
+    uint8_t addr[16];       /* Network byte order */
+} nb_prefix_t;
+
+/**
+ * Peer endpoint (sockaddr_in or sockaddr_in6)
+ */
+typedef union {
+    struct sockaddr sa;
+    struct sockaddr_in in4;
+    struct sockaddr_in6 in6;
+} nb_endpoint_t;
+
+/**
+ * Parse a prefix, e.g. "10.0.0.0/8", "fd00::/64" or "100.64.0.5"
+ * (a bare address is treated as a host prefix)
+ *
+ * @return NB_SUCCESS or NB_ERROR_INVALID
+ */
+int nb_prefix_parse(const char *str, nb_prefix_t *out);
+
+/**
+ * Parse a comma separated prefix list, e.g. "100.64.0.6/32,10.0.0.0/24"
+ *
+ * @param str Prefix list (whitespace around entries is ignored)
+ * @param out Output array
+ * @param max Capacity of out
+ * @return Number of prefixes parsed, NB_ERROR_INVALID on bad input or overflow
+ */
+int nb_prefix_parse_list(const char *str, nb_prefix_t *out, int max);
+
+/**
+ * Format a prefix as "addr/len"
+ *
+ * @param buf Output buffer of at least NB_PREFIX_STRLEN bytes
+ */
+const char* nb_prefix_format(const nb_prefix_t *p, char *buf, size_t size);
+
+/**
+ * Clear host bits beyond the prefix length
+ */
+void nb_prefix_normalize(nb_prefix_t *p);
+
+/**
+ * Compare two prefixes (family, address, length)
+ *
+ * @return <0, 0, >0 like memcmp
+ */
+int nb_prefix_cmp(const nb_prefix_t *a, const nb_prefix_t *b);
+
+/**
+ * Check whether outer fully contains inner (same family, shorter or equal
+ * length, matching leading bits)
+ */
+int nb_prefix_contains(const nb_prefix_t *outer, const nb_prefix_t *inner);
+
+/**
+ * Address length in bytes for a family (4 or 16)
+ */
+static inline int nb_prefix_addr_len(const nb_prefix_t *p) {
+    return p->family == AF_INET ? 4 : 16;
+}
+
+/**
+ * Whether a prefix read from a binary source has a known family and a
+ * length that fits it
+ */
+static inline int nb_prefix_valid(const nb_prefix_t *p) {
+    return (p->family == AF_INET && p->len <= 32) || (p->family == AF_INET6 && p->len <= 128);
+}
+
+/**
+ * Parse an endpoint "1.2.3.4:51820" or "[2001:db8::1]:51820"
+ *
+ * @return NB_SUCCESS or NB_ERROR_INVALID
+ */
+int nb_endpoint_parse(const char *str, nb_endpoint_t *out);
+
+/**
+ * Format an endpoint (empty string for an unset endpoint)
+ *
+ * @param buf Output buffer of at least NB_ENDPOINT_STRLEN bytes
+ */
+const char* nb_endpoint_format(const nb_endpoint_t *ep, char *buf, size_t size);
+
+/**
+ * Length of the sockaddr inside the endpoint (0 if unset)
+ */
+static inline unsigned int nb_endpoint_len(const nb_endpoint_t *ep) {
+    if (ep->sa.sa_family == AF_INET) return sizeof(struct sockaddr_in);
+    if (ep->sa.sa_family == AF_INET6) return sizeof(struct sockaddr_in6);
+    return 0;
+}
+
+/**
+ * Compare two endpoints (family, address, port)
+ *
+ * @return 0 if equal
+ */
+int nb_endpoint_cmp(const nb_endpoint_t *a, const nb_endpoint_t *b);
+
+#endif /* NB_IPADDR_H */
@@ -0,0 +1,123 @@
+/**
+ * journal.h - Append-only journal of peer and route changes
+ *
+ * The helper appends one record per change to the journal and now and then
+ * compacts it: it writes a peer snapshot (peers_snap.h) whose journal_seq
+ * is the last record folded in, then renames a new journal starting after
+ * that sequence number over the old one. The engine tails the journal
+ * from the last sequence number it applied, so a missed write or a
+ * restart costs the missing records, not a reload of the whole map:
+ *
+ *   [nb_journal_header_t][record][record]...
+ *
+ * A record is a nb_journal_record_t followed by a payload in the delta
+ * ring's formats (NB_DELTA_PEER_SET, NB_DELTA_PEER_REMOVE,
+ * NB_DELTA_ROUTE_ADD, NB_DELTA_ROUTE_REMOVE, NB_DELTA_ROUTE_SYNC, see
+ * delta_ring.h), zero-padded to a multiple of NB_JOURNAL_ALIGN. Sequence
+ * numbers start at base_seq + 1 and have no gaps. Each record carries a
+ * CRC-32C. A new journal starts with the complete route set
+ * (NB_DELTA_ROUTE_SYNC) when the helper knows it.
+ *
+ * Records are appended with a single write each; a reader that sees only
+ * part of one waits for the rest. A last record whose checksum does not
+ * match counts as such a partial one (torn by a write in progress or a
+ * crash); a mismatch with more records after it is damage.
+ *
+ * Integers are little endian, addresses and ports in network byte order.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_JOURNAL_H
+#define NB_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "delta_ring.h"
+
+#define NB_JOURNAL_MAGIC        "NBJRNL01"
+#define NB_JOURNAL_VERSION      1
+#define NB_JOURNAL_ALIGN        8
+#define NB_JOURNAL_MAX_RECORD   (16 << 20)
+
+/* File header, 64 bytes */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;       /* sizeof(nb_journal_header_t) */
+    uint64_t base_seq;          /* The first record is base_seq + 1 */
+    uint8_t reserved[36];
+    uint32_t checksum;          /* CRC-32C of the header up to this field */
+} nb_journal_header_t;
+
+/* Record header, 24 bytes */
+typedef struct {
+    uint32_t size;              /* Bytes including this header, a multiple of NB_JOURNAL_ALIGN */
+    uint16_t type;              /* NB_DELTA_* */
+    uint16_t flags;             /* Reserved, 0 */
+    uint64_t seq;
+    uint32_t checksum;          /* CRC-32C of the fields above and the payload */
+    uint32_t reserved;
+} nb_journal_record_t;
+
+typedef struct nb_journal nb_journal_t;
+
+/**
+ * Open a journal for reading and check its header
+ *
+ * @return NB_SUCCESS, NB_ERROR_NOTFOUND, NB_ERROR_INVALID (not a journal)
+ *         or NB_ERROR_SYSTEM
+ */
+int nb_journal_open(const char *path, nb_journal_t **journal_out);
+
+/**
+ * Create an empty journal (writer side), replacing any file at path
+ *
+ * The helper creates the new journal under a temporary name and renames
+ * it; this is for tools and tests.
+ */
+int nb_journal_create(const char *path, uint64_t base_seq, nb_journal_t **journal_out);
+
+/**
+ * Close a journal
+ */
+void nb_journal_close(nb_journal_t *journal);
+
+/**
+ * Sequence number the journal starts after
+ */
+uint64_t nb_journal_base_seq(const nb_journal_t *journal);
+
+/**
+ * Sequence number of the last record read or appended (base_seq before any)
+ */
+uint64_t nb_journal_seq(const nb_journal_t *journal);
+
+/**
+ * Whether the path now names another file (the journal was compacted)
+ */
+int nb_journal_replaced(const nb_journal_t *journal);
+
+/**
+ * Next complete record (reader side)
+ *
+ * The record and its payload (rec + 1, rec->size - sizeof(*rec) bytes)
+ * stay valid until the next call.
+ *
+ * @return 1 and the record, 0 if there is no complete record yet (call
+ *         again once the file changed; this includes a torn last record),
+ *         NB_ERROR_INVALID if a record before the last is damaged, or one
+ *         is out of sequence, NB_ERROR_SYSTEM on read errors
+ */
+int nb_journal_next(nb_journal_t *journal, const nb_journal_record_t **rec_out);
+
+/**
+ * Append a record (writer side)
+ *
+ * @return NB_SUCCESS or NB_ERROR_*; the record's sequence number is
+ *         nb_journal_seq() afterwards
+ */
+int nb_journal_append(nb_journal_t *journal, uint16_t type, const void *payload, size_t len);
+
+#endif /* NB_JOURNAL_H */
@@ -0,0 +1,111 @@
+/**
+ * lpm.h - Longest prefix match trie for allowed IPs
+ *
+ * Reference: wireguard-linux allowedips.c (the kernel's own per-device trie)
+ *
+ * A path-compressed binary radix trie per address family, entered through
+ * a direct-indexed table on the first 16 address bits. Nodes live in a
+ * single pool addressed by 32-bit indices, so the trie stays compact at
+ * 1M prefixes and can be cleared without walking it.
+ *
+ * Each stored prefix carries an opaque 32-bit value (the engine uses the
+ * owning peer's id). Besides lookups, nb_lpm_check() classifies how a
+ * prefix would overlap with prefixes owned by other values, so conflicts
+ * can be caught before the kernel silently moves a prefix to the peer
+ * that was configured last.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_LPM_H
+#define NB_LPM_H
+
+#include <stdint.h>
+#include "ipaddr.h"
+
+typedef struct nb_lpm nb_lpm_t;
+
+/* How a candidate prefix overlaps with prefixes of other owners */
+typedef enum {
+    NB_LPM_OK = 0,           /* No overlap with another owner */
+    NB_LPM_DUPLICATE,        /* Same prefix already stored for the same owner */
+    NB_LPM_COVERS,           /* Contains a more specific prefix of another owner */
+    NB_LPM_COVERED,          /* Inside a shorter prefix of another owner (shadows part of it) */
+    NB_LPM_CONFLICT          /* Exact prefix already owned by another owner */
+} nb_lpm_overlap_t;
+
+typedef struct {
+    nb_lpm_overlap_t kind;
+    nb_prefix_t other;       /* Overlapping prefix (kinds COVERS and up) */
+    uint32_t other_value;    /* Its owner */
+} nb_lpm_check_t;
+
+/**
+ * Create an empty trie
+ *
+ * @return Trie or NULL on allocation failure
+ */
+nb_lpm_t* nb_lpm_new(void);
+
+/**
+ * Free a trie
+ */
+void nb_lpm_free(nb_lpm_t *lpm);
+
+/**
+ * Remove all prefixes, keeping the node pool
+ */
+void nb_lpm_clear(nb_lpm_t *lpm);
+
+/**
+ * Insert a prefix (host bits are ignored); replaces the value if present
+ *
+ * @return NB_SUCCESS, NB_ERROR_INVALID or NB_ERROR_SYSTEM
+ */
+int nb_lpm_insert(nb_lpm_t *lpm, const nb_prefix_t *prefix, uint32_t value);
+
+/**
+ * Insert many prefixes; sorts a copy first so the trie is built in order
+ *
+ * @return NB_SUCCESS or NB_ERROR_* (prefixes before the failure stay inserted)
+ */
+int nb_lpm_build(nb_lpm_t *lpm, const nb_prefix_t *prefixes, const uint32_t *values, int count);
+
+/**
+ * Remove an exact prefix
+ *
+ * @return NB_SUCCESS or NB_ERROR_NOTFOUND
+ */
+int nb_lpm_remove(nb_lpm_t *lpm, const nb_prefix_t *prefix);
+
+/**
+ * Longest stored prefix containing key (an address is a /32 or /128 key)
+ *
+ * @param value_out Owner of the match
+ * @param match_out Optional matching prefix
+ * @return NB_SUCCESS or NB_ERROR_NOTFOUND
+ */
+int nb_lpm_lookup(const nb_lpm_t *lpm, const nb_prefix_t *key,
+                  uint32_t *value_out, nb_prefix_t *match_out);
+
+/**
+ * Classify how prefix, owned by value, overlaps with stored prefixes
+ *
+ * Prefixes owned by value itself never count as overlaps. When several
+ * overlaps exist the most severe kind is reported.
+ */
+void nb_lpm_check(const nb_lpm_t *lpm, const nb_prefix_t *prefix, uint32_t value,
+                  nb_lpm_check_t *out);
+
+/**
+ * Number of stored prefixes
+ */
+int nb_lpm_count(const nb_lpm_t *lpm);
+
+/**
+ * Short name of an overlap kind for logging
+ */
+const char* nb_lpm_overlap_name(nb_lpm_overlap_t kind);
+
+#endif /* NB_LPM_H */
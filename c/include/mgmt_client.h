@@ -14,6 +14,7 @@
 #define MGMT_CLIENT_H
 
 #include "common.h"
+#include "arena.h"
 
 /* Management client structure */
 typedef struct mgmt_client mgmt_client_t;
@@ -36,6 +37,8 @@ typedef struct {
 
     char *wg_private_key;     /* Our WireGuard private key (if assigned) */
     char *wg_address;         /* Our WireGuard IP address */
+
+    nb_arena_t arena;         /* Owns the arrays and strings above */
 } mgmt_config_t;
 
 /**
@@ -74,7 +77,7 @@ int mgmt_register(mgmt_client_t *client, const char *setup_key, mgmt_config_t **
 int mgmt_sync(mgmt_client_t *client, mgmt_config_t **config_out);
 
 /**
- * Free management configuration
+ * Free management configuration (the whole snapshot at once)
  */
 void mgmt_config_free(mgmt_config_t *config);
 
@@ -0,0 +1,180 @@
+/**
+ * netlink.h - Minimal netlink socket and message helpers
+ *
+ * Small self-contained replacement for the parts of libmnl we need:
+ * - Persistent netlink sockets (rtnetlink, generic netlink, ...)
+ * - Message/attribute builder on a caller-owned buffer
+ * - Request/ACK and dump handling
+ * - Attribute parsing
+ *
+ * Errors are reported as NB_ERROR_* codes; the underlying kernel errno
+ * is left in errno (and returned by nb_nl_last_errno()) for logging.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_NETLINK_H
+#define NB_NETLINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/netlink.h>
+
+/* Default message buffer size (fits comfortably in a socket buffer) */
+#define NB_NL_BUFSIZE       (32 * 1024)
+
+/* Receive buffer size (large enough for big dump batches) */
+#define NB_NL_RECVSIZE      (64 * 1024)
+
+/**
+ * Netlink socket
+ */
+typedef struct {
+    int fd;                 /* Socket descriptor, -1 if closed */
+    int protocol;           /* NETLINK_ROUTE, NETLINK_GENERIC, ... */
+    uint32_t portid;        /* Our port id (assigned by kernel) */
+    uint32_t seq;           /* Last sequence number used */
+    int last_errno;         /* errno of the last failed request */
+} nb_nl_t;
+
+/**
+ * Message buffer
+ *
+ * A buffer may hold several messages back to back (batches); attributes
+ * are always appended to the most recently started message.
+ */
+typedef struct {
+    uint8_t *data;
+    size_t cap;
+    size_t len;             /* Total bytes used */
+    struct nlmsghdr *nlh;   /* Current message */
+} nb_nl_buf_t;
+
+/**
+ * Callback for each data message of a reply/dump
+ *
+ * @return NB_SUCCESS to continue, anything else aborts the receive loop
+ */
+typedef int (*nb_nl_cb_t)(const struct nlmsghdr *nlh, void *ctx);
+
+/* Socket handling */
+int nb_nl_open(nb_nl_t *nl, int protocol);
+void nb_nl_close(nb_nl_t *nl);
+uint32_t nb_nl_next_seq(nb_nl_t *nl);
+int nb_nl_last_errno(const nb_nl_t *nl);
+
+/* Buffer handling */
+int nb_nl_buf_init(nb_nl_buf_t *b, size_t cap);
+void nb_nl_buf_reset(nb_nl_buf_t *b);
+void nb_nl_buf_free(nb_nl_buf_t *b);
+
+/**
+ * Start a new message at the end of the buffer
+ *
+ * @return Message header, NULL if the buffer is full
+ */
+struct nlmsghdr* nb_nl_msg_begin(nb_nl_buf_t *b, uint16_t type, uint16_t flags, uint32_t seq);
+
+/**
+ * Reserve a zeroed family header (struct rtmsg, struct genlmsghdr, ...)
+ *
+ * @return Pointer to header, NULL if the buffer is full
+ */
+void* nb_nl_msg_put_header(nb_nl_buf_t *b, size_t len);
+
+/* Attribute builders: return NB_SUCCESS, or NB_ERROR if the buffer is full */
+int nb_nl_attr_put(nb_nl_buf_t *b, uint16_t type, const void *data, size_t len);
+int nb_nl_attr_put_u8(nb_nl_buf_t *b, uint16_t type, uint8_t v);
+int nb_nl_attr_put_u16(nb_nl_buf_t *b, uint16_t type, uint16_t v);
+int nb_nl_attr_put_u32(nb_nl_buf_t *b, uint16_t type, uint32_t v);
+int nb_nl_attr_put_u64(nb_nl_buf_t *b, uint16_t type, uint64_t v);
+int nb_nl_attr_put_str(nb_nl_buf_t *b, uint16_t type, const char *s);
+
+/* Nested attributes: begin returns NULL if the buffer is full */
+struct nlattr* nb_nl_nest_begin(nb_nl_buf_t *b, uint16_t type);
+void nb_nl_nest_end(nb_nl_buf_t *b, struct nlattr *nest);
+
+/**
+ * Truncate the current message back to a previous length
+ *
+ * Used to drop a partially written attribute when the buffer fills up.
+ */
+void nb_nl_msg_rollback(nb_nl_buf_t *b, size_t len);
+
+/**
+ * Send the buffer and wait for the ACK (or DONE for dumps)
+ *
+ * Data messages in the reply are passed to cb (may be NULL).
+ *
+ * @return NB_SUCCESS, or NB_ERROR_* mapped from the kernel errno
+ */
+int nb_nl_transact(nb_nl_t *nl, nb_nl_buf_t *b, nb_nl_cb_t cb, void *ctx);
+
+/* Low level send/receive (used for pipelined batches) */
+int nb_nl_send(nb_nl_t *nl, const nb_nl_buf_t *b);
+int nb_nl_recv(nb_nl_t *nl, uint32_t seq, nb_nl_cb_t cb, void *ctx);
+
+/**
+ * Collect ACKs for pipelined requests
+ *
+ * Reads one datagram (waiting for it when block is set, otherwise
+ * returning 0 if none is queued) and records every ACK whose sequence
+ * number is in [first_seq, first_seq + count): errs[seq - first_seq] is
+ * set to the request's errno, 0 on success. Other messages are skipped.
+ *
+ * @return Number of ACKs recorded, NB_ERROR_SYSTEM on socket errors
+ *         (ENOBUFS means ACKs overflowed the receive buffer and were lost)
+ */
+int nb_nl_recv_acks(nb_nl_t *nl, uint32_t first_seq, int count, int *errs, int block);
+
+/**
+ * Receive buffer size the kernel actually granted, in bytes
+ */
+int nb_nl_rcvbuf(const nb_nl_t *nl);
+
+/**
+ * Parse attributes into a table indexed by type (entries for absent
+ * attributes are NULL, types above maxtype are ignored)
+ */
+void nb_nl_attr_parse(const void *data, size_t len, const struct nlattr **tb, int maxtype);
+
+/* Parse the attributes following a family header of hdrlen bytes */
+void nb_nl_msg_parse(const struct nlmsghdr *nlh, size_t hdrlen,
+                     const struct nlattr **tb, int maxtype);
+
+/* Attribute accessors */
+static inline const void* nb_nl_attr_data(const struct nlattr *a) {
+    return (const uint8_t *)a + NLA_HDRLEN;
+}
+
+static inline size_t nb_nl_attr_len(const struct nlattr *a) {
+    return a->nla_len - NLA_HDRLEN;
+}
+
+uint8_t nb_nl_attr_get_u8(const struct nlattr *a);
+uint16_t nb_nl_attr_get_u16(const struct nlattr *a);
+uint32_t nb_nl_attr_get_u32(const struct nlattr *a);
+uint64_t nb_nl_attr_get_u64(const struct nlattr *a);
+
+/* Iterate over the attributes in [data, data + len) */
+#define nb_nl_attr_for_each(a, data, len) \
+    for ((a) = (const struct nlattr *)(data); \
+         (size_t)((const uint8_t *)(a) - (const uint8_t *)(data)) + NLA_HDRLEN <= (len) && \
+         (a)->nla_len >= NLA_HDRLEN && \
+         (size_t)((const uint8_t *)(a) - (const uint8_t *)(data)) + (a)->nla_len <= (len); \
+         (a) = (const struct nlattr *)((const uint8_t *)(a) + NLA_ALIGN((a)->nla_len)))
+
+/**
+ * Map a kernel errno to an NB_ERROR_* code
+ */
+int nb_nl_error(int err);
+
+/**
+ * Resolve a generic netlink family id by name
+ *
+ * @return NB_SUCCESS and *id_out, NB_ERROR_NOTFOUND if not registered
+ */
+int nb_genl_resolve(nb_nl_t *nl, const char *name, uint16_t *id_out);
+
+#endif /* NB_NETLINK_H */
@@ -0,0 +1,86 @@
+/**
+ * nflog.h - NFLOG listener used to trap traffic to inactive peers
+ *
+ * Reference: go/client/internal/lazyconn (activity detection for lazy peers)
+ *
+ * Lazy mode keeps most peers out of the kernel. To notice when one is
+ * needed, the first packet of every new flow leaving the WireGuard
+ * interface is copied to an NFLOG group:
+ *
+ *   iptables -I OUTPUT  -o <if> -m conntrack --ctstate NEW -j NFLOG --nflog-group <g>
+ *   iptables -I FORWARD -o <if> -m conntrack --ctstate NEW -j NFLOG --nflog-group <g>
+ *
+ * (and the same for ip6tables). Only the IP header is copied; the engine
+ * maps the destination to a peer through its allowed IP trie. Packets to
+ * a peer that is not installed yet are dropped by WireGuard, and the flow
+ * recovers on the sender's retransmit once the peer is in place.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_NFLOG_H
+#define NB_NFLOG_H
+
+#include "netlink.h"
+#include "ipaddr.h"
+
+#define NB_NFLOG_DEFAULT_GROUP  7311
+#define NB_NFLOG_COPY_RANGE     64      /* Enough for an IPv6 header */
+
+typedef struct {
+    nb_nl_t nl;
+    uint16_t group;
+    uint64_t packets;           /* Packets received */
+    uint64_t dropped;           /* Packets that did not fit into a read */
+} nb_nflog_t;
+
+/**
+ * Open a non-blocking listener bound to an NFLOG group
+ *
+ * @return NB_SUCCESS, NB_ERROR_EXISTS if another process holds the group, NB_ERROR_*
+ */
+int nb_nflog_open(uint16_t group, nb_nflog_t *nf);
+
+/**
+ * Close a listener
+ */
+void nb_nflog_close(nb_nflog_t *nf);
+
+/**
+ * File descriptor to poll for readability
+ */
+static inline int nb_nflog_fd(const nb_nflog_t *nf) {
+    return nf->nl.fd;
+}
+
+/**
+ * Drain pending packets and return their destination addresses
+ *
+ * Never blocks. Destinations beyond max are counted in nf->dropped.
+ *
+ * @param dst Output host prefixes (/32 or /128)
+ * @return Number of destinations, or NB_ERROR_SYSTEM
+ */
+int nb_nflog_read(nb_nflog_t *nf, nb_prefix_t *dst, int max);
+
+/**
+ * Destination address of an IPv4 or IPv6 packet
+ *
+ * @return NB_SUCCESS or NB_ERROR_INVALID (truncated or not IP; out is untouched)
+ */
+int nb_nflog_packet_dst(const uint8_t *pkt, size_t len, nb_prefix_t *out);
+
+/**
+ * Install the NFLOG rules for new flows leaving ifname (idempotent)
+ *
+ * @return NB_SUCCESS if the IPv4 rules are in place (IPv6 is best effort)
+ */
+int nb_nflog_rules_add(const char *ifname, uint16_t group);
+
+/**
+ * Remove the rules added by nb_nflog_rules_add()
+ */
+void nb_nflog_rules_del(const char *ifname, uint16_t group);
+
+#endif /* NB_NFLOG_H */
@@ -0,0 +1,164 @@
+/**
+ * nft.h - NetBird's nftables table over nfnetlink
+ *
+ * Reference: go/client/firewall/nftables (router: NAT for routed networks)
+ *
+ * NAT rules live in a table of their own, so they never mix with the
+ * host's rules and are removed by deleting the table:
+ *
+ *   table inet netbird {
+ *       set masq4 { type ifname . ipv4_addr; flags interval; }
+ *       set masq6 { type ifname . ipv6_addr; flags interval; }
+ *       chain postrouting {
+ *           type nat hook postrouting priority srcnat;
+ *           meta nfproto ipv4 oifname . ip daddr @masq4 masquerade
+ *           meta nfproto ipv6 oifname . ip6 daddr @masq6 masquerade
+ *       }
+ *       flowtable ft { hook ingress priority filter; devices = { ... }; }
+ *       chain forward {
+ *           type filter hook forward priority filter;
+ *           ct state established flow add @ft
+ *       }
+ *   }
+ *
+ * Each masqueraded route is one set element (output device and
+ * destination prefix), so evaluation is one set lookup per packet no
+ * matter how many routes there are. Every change is one nfnetlink batch,
+ * which the kernel applies atomically.
+ *
+ * Other tables of the inet family can be managed through the same calls
+ * (nb_nft_open_table), e.g. the conntrack bypass of a WireGuard
+ * interface, which lives and dies with the interface.
+ *
+ * The flowtable is optional (nb_nft_offload_set): once a forwarded
+ * connection is established, its packets are forwarded from the ingress
+ * hook of the listed devices, skipping routing, the forward and
+ * postrouting hooks (NAT is applied from the connection's state).
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_NFT_H
+#define NB_NFT_H
+
+#include <net/if.h>
+#include "netlink.h"
+#include "ipaddr.h"
+
+#define NB_NFT_TABLE            "netbird"
+#define NB_NFT_OFFLOAD_MAX      256     /* Devices of a flowtable (kernel limit) */
+
+typedef struct nb_nft {
+    nb_nl_t nl;
+    char table[64];             /* NB_NFT_TABLE unless opened with nb_nft_open_table() */
+    int masq_ready;             /* Chain, sets and rules were created through this handle */
+    int offload_ready;          /* The flowtable was created through this handle */
+} nb_nft_t;
+
+/**
+ * A masqueraded destination
+ */
+typedef struct {
+    char device[IFNAMSIZ];      /* Output device */
+    nb_prefix_t prefix;         /* Destination; length 0 for everything of that family */
+} nb_nft_masq_t;
+
+/**
+ * Open an nfnetlink socket for NetBird's table
+ *
+ * @return NB_SUCCESS or NB_ERROR_SYSTEM (nfnetlink unavailable)
+ */
+int nb_nft_open(nb_nft_t *nft);
+
+/**
+ * Open an nfnetlink socket for another table of the inet family
+ *
+ * @return NB_SUCCESS, NB_ERROR_INVALID (name too long) or NB_ERROR_SYSTEM
+ */
+int nb_nft_open_table(nb_nft_t *nft, const char *table);
+
+/**
+ * Close the socket (the table stays)
+ */
+void nb_nft_close(nb_nft_t *nft);
+
+/**
+ * Make the masquerade sets hold exactly these entries
+ *
+ * The first call on a handle creates the table, chain, sets and rules
+ * (dropping leftovers of an earlier run); every call replaces the set
+ * contents. Both happen in one batch. Overlapping prefixes of a device
+ * are merged into one element.
+ *
+ * @return NB_SUCCESS, NB_ERROR_INVALID or NB_ERROR_* mapped from the
+ *         kernel errno (e.g. nf_tables or NAT support missing)
+ */
+int nb_nft_masq_set(nb_nft_t *nft, const nb_nft_masq_t *entries, int count);
+
+/**
+ * Offload established forwarded flows between these devices
+ *
+ * Replaces the flowtable and its forward rule in one batch (dropping
+ * leftovers of an earlier run); count 0 removes both. The devices must
+ * exist; a device that is deleted drops out of the flowtable, so it has
+ * to be set again after recreating it.
+ *
+ * @return NB_SUCCESS, NB_ERROR_INVALID, NB_ERROR_NOTFOUND (a device does
+ *         not exist), NB_ERROR_SYSTEM (no flowtable support in the
+ *         kernel) or NB_ERROR_* mapped from the kernel errno
+ */
+int nb_nft_offload_set(nb_nft_t *nft, const char *const *devices, int count);
+
+/**
+ * Number of devices of the flowtable (for tests and status)
+ *
+ * @return Device count, or NB_ERROR_NOTFOUND if there is no flowtable
+ */
+int nb_nft_flowtable_devices(nb_nft_t *nft);
+
+/**
+ * Skip connection tracking for a UDP port (WireGuard's listen port)
+ *
+ *   chain raw_prerouting { type filter hook prerouting priority raw; udp dport <port> notrack }
+ *   chain raw_output { type filter hook output priority raw; udp sport <port> notrack }
+ *
+ * The tunnel's outer packets are never NATed, so tracking them only
+ * costs a conntrack lookup per packet and an entry per endpoint. Calling
+ * it again replaces the port.
+ *
+ * @return NB_SUCCESS, NB_ERROR_INVALID or NB_ERROR_* mapped from the kernel errno
+ */
+int nb_nft_notrack_set(nb_nft_t *nft, uint16_t port);
+
+/**
+ * Delete the whole table
+ *
+ * @return NB_SUCCESS (also if there was no table) or NB_ERROR_*
+ */
+int nb_nft_table_delete(nb_nft_t *nft);
+
+/**
+ * Number of elements in a set of the table (for tests and status)
+ *
+ * @return Element count, or NB_ERROR_NOTFOUND if the set does not exist
+ */
+int nb_nft_set_count(nb_nft_t *nft, const char *set);
+
+/**
+ * Whether the handle's table exists
+ *
+ * @return 1, 0 or NB_ERROR_*
+ */
+int nb_nft_table_exists(nb_nft_t *nft);
+
+/**
+ * Turn on IP forwarding by writing /proc/sys directly
+ *
+ * @param family AF_INET (net.ipv4.ip_forward) or AF_INET6
+ *               (net.ipv6.conf.all.forwarding)
+ * @return NB_SUCCESS or NB_ERROR_SYSTEM
+ */
+int nb_ip_forward_enable(int family);
+
+#endif /* NB_NFT_H */
@@ -0,0 +1,117 @@
+/**
+ * peer_table.h - Engine peer table keyed by raw public keys
+ *
+ * Reference: go/client/internal/peer (Status / peer store)
+ *
+ * Layout, chosen to stay cache friendly at 100k+ peers:
+ * - an open addressing index of 8-byte slots (hash tag + record index),
+ *   linear probing, at most half full, backward shift deletion
+ * - a dense array of fixed-size records holding the key, endpoint and
+ *   keepalive inline; removal moves the last record into the hole, so
+ *   iteration is a plain array walk
+ * - a separate slab of nb_prefix_t for the variable-length allowed IP
+ *   lists; records store an offset/count pair, and the slab is compacted
+ *   once more than half of it is garbage
+ *
+ * Record pointers are invalidated by insert and remove. Each record also
+ * gets a small integer id that stays fixed while the peer is present
+ * (ids of removed peers are reused), for structures that refer to peers
+ * without holding a key, such as the allowed IP trie.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_PEER_TABLE_H
+#define NB_PEER_TABLE_H
+
+#include "wg_key.h"
+#include "ipaddr.h"
+
+typedef struct nb_peer_table nb_peer_table_t;
+
+/* Record flags */
+#define NB_PEER_INSTALLED   0x1   /* Configured in the kernel (always set outside lazy mode) */
+
+/* One peer; fixed size, stored inline in the table */
+typedef struct {
+    uint8_t public_key[WG_KEY_LEN];
+    nb_endpoint_t endpoint;       /* sa_family 0 if none */
+    uint32_t ips_off;             /* Allowed IPs: slab offset ... */
+    uint16_t ips_count;           /* ... and count */
+    uint16_t keepalive;
+    uint32_t id;                  /* Stable while the peer is present */
+    uint32_t flags;               /* NB_PEER_*; kept by upsert */
+    int64_t last_active;          /* Unix time of install or last handshake (lazy mode) */
+} nb_peer_record_t;
+
+/**
+ * Create a table
+ *
+ * @param capacity_hint Expected number of peers (0 for a small default)
+ * @return Table or NULL on allocation failure
+ */
+nb_peer_table_t* nb_peer_table_new(int capacity_hint);
+
+/**
+ * Free a table
+ */
+void nb_peer_table_free(nb_peer_table_t *table);
+
+/**
+ * Remove all peers, keeping the allocated memory
+ */
+void nb_peer_table_clear(nb_peer_table_t *table);
+
+/**
+ * Insert a peer or replace an existing one
+ *
+ * A new record starts with zero flags and last_active; replacing keeps them.
+ *
+ * @param endpoint Endpoint (NULL for none)
+ * @param ips Allowed IPs (copied into the slab; must not point into the table)
+ * @param ips_count Number of allowed IPs, -1 to keep the current list
+ * @return NB_SUCCESS, NB_ERROR_INVALID or NB_ERROR_SYSTEM
+ */
+int nb_peer_table_upsert(nb_peer_table_t *table, const uint8_t key[WG_KEY_LEN],
+                         const nb_endpoint_t *endpoint, int keepalive,
+                         const nb_prefix_t *ips, int ips_count);
+
+/**
+ * Look up a peer
+ *
+ * @return Record or NULL if not present
+ */
+nb_peer_record_t* nb_peer_table_find(const nb_peer_table_t *table, const uint8_t key[WG_KEY_LEN]);
+
+/**
+ * Remove a peer
+ *
+ * @return NB_SUCCESS or NB_ERROR_NOTFOUND
+ */
+int nb_peer_table_remove(nb_peer_table_t *table, const uint8_t key[WG_KEY_LEN]);
+
+/**
+ * Allowed IPs of a record (valid until the next table modification)
+ */
+const nb_prefix_t* nb_peer_table_allowed_ips(const nb_peer_table_t *table,
+                                             const nb_peer_record_t *rec);
+
+/**
+ * Look up a peer by record id
+ *
+ * @return Record or NULL if no peer has this id
+ */
+nb_peer_record_t* nb_peer_table_by_id(const nb_peer_table_t *table, uint32_t id);
+
+/**
+ * Number of peers
+ */
+int nb_peer_table_count(const nb_peer_table_t *table);
+
+/**
+ * Record by dense index, 0 <= i < nb_peer_table_count() (for iteration)
+ */
+nb_peer_record_t* nb_peer_table_at(const nb_peer_table_t *table, int i);
+
+#endif /* NB_PEER_TABLE_H */
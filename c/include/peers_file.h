@@ -3,6 +3,16 @@
  *
  * Reads peers.json written by Go helper daemon.
  *
+ * The file is mapped and scanned once, without building a document tree
+ * (see peers_file.c); peers_file_stream() hands each peer to a callback
+ * as soon as its object ends, so a consumer can build its own structures
+ * directly. The helper replaces the file by renaming a new one over it,
+ * which keeps a mapped file intact while it is read.
+ *
+ * A loaded file is a snapshot: every string in it lives in the
+ * snapshot's arena (arena.h), so loading costs a few block allocations
+ * instead of several per peer, and peers_file_free() releases it at once.
+ *
  * Author: Claude
  * Date: 2025-12-01
  */
@@ -11,6 +21,7 @@
 #define PEERS_FILE_H
 
 #include "common.h"
+#include "arena.h"
 
 /* Peer information from JSON file */
 typedef struct {
@@ -27,8 +38,18 @@ typedef struct {
     peers_file_peer_t *peers;
     int peer_count;
     char *updated_at;
+    nb_arena_t arena;        /* Owns the peers' strings and updated_at */
 } peers_file_t;
 
+/**
+ * Callback of peers_file_stream()
+ *
+ * The peer and its strings are only valid during the call.
+ *
+ * @return NB_SUCCESS to continue, an error code to stop the stream
+ */
+typedef int (*peers_file_cb_t)(const peers_file_peer_t *peer, void *ctx);
+
 /**
  * Load peers from JSON file
  *
@@ -38,6 +59,18 @@ typedef struct {
  */
 int peers_file_load(const char *path, peers_file_t **peers_out);
 
+/**
+ * Parse peers.json in one pass, calling cb for each peer in file order
+ *
+ * Memory use is bounded by the largest peer object, not the file.
+ * Members other than the known ones are skipped, as are array elements
+ * that are not objects (peers) or strings (allowedIPs).
+ *
+ * @return Number of peers, NB_ERROR_INVALID on malformed JSON, the
+ *         callback's error code, or another NB_ERROR_*
+ */
+int peers_file_stream(const char *path, peers_file_cb_t cb, void *ctx);
+
 /**
  * Free peers file structure
  */
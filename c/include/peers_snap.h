@@ -0,0 +1,140 @@
+/**
+ * peers_snap.h - Memory-mapped binary peer snapshot
+ *
+ * Binary sibling of peers.json (peers_file.h), written by the Go helper
+ * (helper/snapshot.go) or converted from JSON with peers_snap_write().
+ * The reader maps the file and uses it in place: keys are raw, endpoints
+ * and prefixes are packed, and nothing is parsed or copied.
+ *
+ *   [peers_snap_header_t]
+ *   [peers_snap_peer_t   x peer_count]    64 bytes each
+ *   [nb_prefix_t         x prefix_count]  18 bytes each, family AF_INET/AF_INET6
+ *   [string table        strings_size]    NUL-terminated, starts with ""
+ *
+ * Integers are little endian; addresses and ports are in network byte
+ * order. A peer's allowed IPs are prefixes[prefix_first ..
+ * prefix_first + prefix_count); the ranges of consecutive peers follow
+ * each other. Strings are referenced by their offset in the string
+ * table, offset 0 being the empty string.
+ *
+ * The checksum is a CRC-32C of the header up to the checksum field
+ * followed by everything after the header. Writers create a new file and
+ * rename it over the old one, so a mapped snapshot never changes.
+ *
+ * A helper keeping a journal (journal.h) records in journal_seq which
+ * journal records the snapshot already contains.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef PEERS_SNAP_H
+#define PEERS_SNAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ipaddr.h"
+#include "peers_file.h"
+
+#define PEERS_SNAP_MAGIC    "NBPSNAP1"
+#define PEERS_SNAP_VERSION  1
+
+/* File header, 64 bytes */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;       /* sizeof(peers_snap_header_t) */
+    uint32_t peer_size;         /* sizeof(peers_snap_peer_t) */
+    uint32_t prefix_size;       /* sizeof(nb_prefix_t) */
+    uint32_t peer_count;
+    uint32_t prefix_count;
+    uint32_t strings_size;
+    uint32_t updated_at;        /* String offset (RFC 3339 time) */
+    uint64_t journal_seq;       /* Last journal record folded in (journal.h), 0 if none */
+    uint8_t reserved[12];
+    uint32_t checksum;
+} peers_snap_header_t;
+
+/* One peer, 64 bytes */
+typedef struct {
+    uint8_t public_key[32];
+    uint8_t endpoint_addr[16];  /* IPv4 in the first 4 bytes */
+    uint16_t endpoint_port;     /* Network byte order */
+    uint8_t endpoint_family;    /* 0 (no endpoint), AF_INET or AF_INET6 */
+    uint8_t flags;              /* Reserved, 0 */
+    uint16_t keepalive;         /* Seconds, 0 if off */
+    uint16_t prefix_count;
+    uint32_t prefix_first;
+    uint32_t id;                /* String offset */
+} peers_snap_peer_t;
+
+/* Mapped snapshot; everything points into the mapping */
+typedef struct {
+    const peers_snap_header_t *hdr;
+    const peers_snap_peer_t *peers;
+    int peer_count;
+    const nb_prefix_t *prefixes;
+    int prefix_count;
+    const char *strings;
+    void *map;
+    size_t map_size;
+} peers_snap_t;
+
+/**
+ * Map a snapshot read-only and validate it
+ *
+ * Checks the header, the section sizes, the checksum and that every
+ * string offset and prefix range is in bounds, so the accessors below
+ * never read outside the mapping.
+ *
+ * @param snap_out Output: snapshot (caller must free with peers_snap_close)
+ * @return NB_SUCCESS, NB_ERROR_NOTFOUND, NB_ERROR_INVALID (not a snapshot or
+ *         corrupt) or NB_ERROR_SYSTEM
+ */
+int peers_snap_open(const char *path, peers_snap_t **snap_out);
+
+/**
+ * Unmap a snapshot
+ */
+void peers_snap_close(peers_snap_t *snap);
+
+/**
+ * Whether a file starts with the snapshot magic (JSON files do not)
+ */
+int peers_snap_is_snapshot(const char *path);
+
+/**
+ * String at an offset of the string table
+ */
+static inline const char* peers_snap_string(const peers_snap_t *snap, uint32_t offset) {
+    return snap->strings + offset;
+}
+
+/**
+ * Allowed IPs of a peer (peer->prefix_count entries)
+ */
+static inline const nb_prefix_t* peers_snap_prefixes(const peers_snap_t *snap,
+                                                     const peers_snap_peer_t *peer) {
+    return snap->prefixes + peer->prefix_first;
+}
+
+/**
+ * Endpoint of a peer
+ *
+ * @return NB_SUCCESS, NB_ERROR_NOTFOUND if the peer has none
+ */
+int peers_snap_endpoint(const peers_snap_peer_t *peer, nb_endpoint_t *out);
+
+/**
+ * Write peers as a snapshot (the JSON to binary converter)
+ *
+ * Keys are decoded, endpoints and prefixes parsed (allowed IP entries may
+ * be comma separated lists). Peers with an invalid key, endpoint or prefix
+ * are skipped with a warning. The file is written next to path and
+ * renamed over it.
+ *
+ * @return Number of peers written, NB_ERROR_* on failure
+ */
+int peers_snap_write(const char *path, const peers_file_t *file);
+
+#endif /* PEERS_SNAP_H */
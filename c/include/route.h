@@ -3,9 +3,23 @@
  *
  * Reference: go/internal/routemanager/systemops/systemops_linux.go
  *
- * This module manages system routing table entries.
- * Quick prototype version uses 'ip route' commands.
- * Production version should use netlink API.
+ * This module manages system routing table entries. Routes are installed
+ * over one persistent rtnetlink socket (RTM_NEWROUTE with NLM_F_REPLACE,
+ * so re-adding an existing route succeeds); 'ip route' commands remain as
+ * a fallback when rtnetlink is unavailable.
+ *
+ * Routes go to the main table unless route_use_table() selects a
+ * dedicated policy routing table; full syncs are then built in a shadow
+ * table and switched in by moving the rule.
+ *
+ * Routes may point at a shared kernel nexthop object (or group) instead
+ * of a device; replacing the nexthop then moves every route using it in
+ * one request.
+ *
+ * Masqueraded routes become elements of the nftables sets in NetBird's
+ * own table (see nft.h): one atomic batch per change, one set lookup per
+ * packet. Without nf_tables, and with the shell backend, the device gets
+ * an iptables MASQUERADE rule as before.
  *
  * Author: Claude
  * Date: 2025-11-30
@@ -14,8 +28,11 @@
 #ifndef NB_ROUTE_H
 #define NB_ROUTE_H
 
-/* Forward declaration */
+#include <stdint.h>
+
+/* Forward declarations */
 typedef struct route_manager route_manager_t;
+typedef struct route_batch route_batch_t;
 
 /**
  * Route configuration
@@ -28,24 +45,71 @@ typedef struct {
     char *device;           /* Network device, e.g., "wtnb0" */
     int metric;             /* Route priority (lower = higher priority) */
     int masquerade;         /* 1 to enable NAT masquerading, 0 otherwise */
+    uint32_t nhid;          /* Nexthop object (route_nexthop_set), 0 to use device */
 } route_config_t;
 
+/* Policy routing defaults (same numbers as the Go client) */
+#define ROUTE_TABLE_DEFAULT     7120
+#define ROUTE_FWMARK_DEFAULT    0x1BD00
+#define ROUTE_RULE_PRIORITY     110
+
+/**
+ * Route backend
+ */
+typedef enum {
+    ROUTE_BACKEND_AUTO = 0,     /* rtnetlink, falling back to 'ip route' */
+    ROUTE_BACKEND_NETLINK,      /* rtnetlink only */
+    ROUTE_BACKEND_SHELL         /* 'ip route' commands */
+} route_backend_t;
+
 /**
  * Route manager structure
  */
 struct route_manager {
-    char *wg_device;        /* WireGuard device name */
-    /* Could add route tracking here for cleanup */
+    char *wg_device;            /* WireGuard device name */
+    route_backend_t backend;    /* Resolved backend (never AUTO) */
+    struct route_nl *nl;        /* rtnetlink state (netlink backend only) */
+    struct route_set *owned;    /* Routes installed through this manager, by destination */
+    int last_errno;             /* errno of the last failed request, 0 if unknown */
+
+    /* Policy routing (route_use_table); table 0 means the main table */
+    uint32_t table;             /* Table the rule points at (holds the owned routes) */
+    uint32_t shadow_table;      /* Table the next full sync is built in */
+    uint32_t fwmark;            /* Packets with this mark skip the table (0: none) */
+    uint32_t rule_priority;
+
+    /* Nexthop objects created through this manager, in creation order */
+    struct route_nh *nexthops;
+    int nexthop_count;
+    int nexthop_cap;
+
+    /* Masquerading: nftables set elements (nft.h), iptables with the shell backend */
+    struct nb_nft *nft;         /* NULL until something is masqueraded */
+    int nft_failed;             /* nf_tables unusable: iptables fallback */
+    int masq_dirty;             /* Masqueraded routes changed since the last update */
+    char **masq_devices;        /* Masqueraded as a whole (route_enable_masquerade) */
+    int masq_device_count;
+    int forwarding;             /* Families with forwarding enabled (1: IPv4, 2: IPv6) */
 };
 
 /**
- * Create a new route manager
+ * Create a new route manager (ROUTE_BACKEND_AUTO)
  *
  * @param wg_device WireGuard device name
  * @return Route manager instance, NULL on failure
  */
 route_manager_t* route_manager_new(const char *wg_device);
 
+/**
+ * Create a new route manager with an explicit backend
+ *
+ * @param wg_device WireGuard device name
+ * @param backend Backend to use
+ * @return Route manager instance, NULL on failure (or if the netlink
+ *         backend was requested and rtnetlink is unavailable)
+ */
+route_manager_t* route_manager_new_backend(const char *wg_device, route_backend_t backend);
+
 /**
  * Add a route to the routing table
  *
@@ -59,9 +123,12 @@ route_manager_t* route_manager_new(const char *wg_device);
  *     .masquerade = 0
  *   });
  *
+ * An existing route with the same destination and metric is replaced.
+ * The route is recorded in the manager's owned set.
+ *
  * @param mgr Route manager
  * @param route Route configuration
- * @return NB_SUCCESS on success, NB_ERROR_* on failure
+ * @return NB_SUCCESS on success, NB_ERROR_* on failure (see route_last_errno)
  */
 int route_add(route_manager_t *mgr, const route_config_t *route);
 
@@ -70,24 +137,299 @@ int route_add(route_manager_t *mgr, const route_config_t *route);
  *
  * Reference: Go RemoveRoute()
  *
+ * If the destination is owned, exactly the owned route (metric and
+ * device) is deleted; otherwise the first main-table route for it.
+ *
  * @param mgr Route manager
  * @param network Network to remove (CIDR notation)
- * @return NB_SUCCESS on success, NB_ERROR_* on failure
+ * @return NB_SUCCESS, NB_ERROR_NOTFOUND if no such route, NB_ERROR_*
  */
 int route_remove(route_manager_t *mgr, const char *network);
 
 /**
- * Remove all routes for the WireGuard device
+ * Offload forwarded flows to an nftables flowtable
+ *
+ * Established connections forwarded between the WireGuard device and
+ * the egress devices (e.g. the LAN a routing peer serves) are then
+ * forwarded from the devices' ingress hook, skipping routing, the
+ * forward path and the NAT rules; NAT still applies from the
+ * connection's state. Calling it again replaces the device list. The
+ * devices must exist: call it again after one was recreated.
+ *
+ * Needs the netlink backend and a kernel with nf_flow_table. The
+ * flowtable is removed by route_disable_offload() and route_remove_all().
  *
  * @param mgr Route manager
- * @return NB_SUCCESS on success, NB_ERROR_* on failure
+ * @param devices Egress devices (the WireGuard device is always included)
+ * @param count Number of devices
+ * @return NB_SUCCESS, NB_ERROR_NOTFOUND (a device does not exist) or NB_ERROR_*
+ */
+int route_enable_offload(route_manager_t *mgr, const char *const *devices, int count);
+
+/**
+ * Remove the flowtable
+ *
+ * @return NB_SUCCESS (also if offload was not enabled) or NB_ERROR_*
+ */
+int route_disable_offload(route_manager_t *mgr);
+
+/**
+ * Remove all routes owned by the manager
+ *
+ * The deletions are pipelined like a route batch; routes that are
+ * already gone count as removed. Nexthop objects created through the
+ * manager are deleted afterwards, and so is the nftables table
+ * (masquerade sets and flowtable).
+ *
+ * @param mgr Route manager
+ * @return NB_SUCCESS on success, NB_ERROR_* if any deletion failed
  */
 int route_remove_all(route_manager_t *mgr);
 
+/**
+ * Reconcile the owned routes with a desired list
+ *
+ * Routes that are wanted but missing or changed are installed, owned
+ * routes that are no longer wanted are deleted, and everything else is
+ * left alone; all changes go out as one pipelined batch, additions
+ * first. The manager owns one route per destination, so the list should
+ * not repeat a network.
+ *
+ * @param mgr Route manager
+ * @param routes Desired routes
+ * @param count Number of routes
+ * @return Number of routes that could not be applied (>= 0), or NB_ERROR_*
+ */
+int route_sync(route_manager_t *mgr, const route_config_t *routes, int count);
+
+/**
+ * Compare the owned routes with the kernel and repair the difference
+ *
+ * Dumps the main table filtered to our route protocol (RTM_GETROUTE
+ * with strict checking, so the kernel does the filtering), re-installs
+ * owned routes that are missing or changed and deletes routes of our
+ * protocol on the WireGuard device that are not owned. Nexthop objects
+ * of the manager that disappeared are re-created first.
+ *
+ * @param mgr Route manager (netlink backend)
+ * @param repaired_out Optional number of routes fixed
+ * @return NB_SUCCESS, NB_ERROR with the shell backend, NB_ERROR_*
+ */
+int route_check_drift(route_manager_t *mgr, int *repaired_out);
+
+/**
+ * Number of owned routes
+ */
+int route_owned_count(const route_manager_t *mgr);
+
+/**
+ * Subscribe to route, nexthop and rule notifications
+ *
+ * Opens a second, non-blocking rtnetlink socket joined to the IPv4/IPv6
+ * route, nexthop and rule multicast groups, so that an event loop can
+ * run route_check_drift() as soon as someone touches the owned routes
+ * instead of waiting for the next periodic check. Idempotent.
+ *
+ * @param mgr Route manager (netlink backend)
+ * @return Descriptor to poll for EPOLLIN, NB_ERROR with the shell backend, NB_ERROR_*
+ */
+int route_monitor_open(route_manager_t *mgr);
+
+/**
+ * Drain pending notifications
+ *
+ * Notifications matching the owned state (our own requests) are ignored.
+ * Never blocks.
+ *
+ * @return 1 if an owned route, nexthop or the policy rule may have been
+ *         changed or deleted by someone else (or notifications were lost),
+ *         0 if not, NB_ERROR_*
+ */
+int route_monitor_read(route_manager_t *mgr);
+
+/**
+ * Close the notification socket (also done by route_manager_free)
+ */
+void route_monitor_close(route_manager_t *mgr);
+
+/**
+ * Install routes into a dedicated policy routing table
+ *
+ * Routes go to table and table + 1 (the shadow) instead of the main
+ * table; one rule per address family ("not fwmark <fwmark> lookup
+ * <table>", or just "lookup <table>" with fwmark 0) at the given
+ * priority selects the active one. Leftovers of an earlier run (rules at
+ * that priority for either table, routes in them) are removed first.
+ *
+ * In this mode route_sync() rebuilds the whole desired list in the
+ * shadow table whenever anything changed, then switches the rule over:
+ * the new rule is added behind the old one at the same priority, so the
+ * deletion of the old rule switches every destination at once. The old
+ * table is flushed afterwards. route_add()/route_remove() change the
+ * active table in place, and route_remove_all() drops the rules and
+ * flushes both tables.
+ *
+ * The tunnel's own packets should carry fwmark (e.g. the WireGuard
+ * device's fwmark) so that they keep using the main table.
+ *
+ * @param mgr Route manager without owned routes
+ * @param table Table number; neither it nor table + 1 may be a reserved
+ *              table (0, 252..255)
+ * @param fwmark Mark of packets that bypass the table, 0 for none
+ * @param priority Rule priority
+ * @return NB_SUCCESS, NB_ERROR_INVALID or NB_ERROR_* if the rule could
+ *         not be added (the manager then keeps using the main table)
+ */
+int route_use_table(route_manager_t *mgr, uint32_t table, uint32_t fwmark, uint32_t priority);
+
+/**
+ * Table holding the owned routes (RT_TABLE_MAIN without route_use_table)
+ */
+uint32_t route_table(const route_manager_t *mgr);
+
+/**
+ * Create or replace a nexthop object for a device
+ *
+ * Routes with route_config_t.nhid = id go out through the nexthop, so
+ * calling this again with another device moves all of them at once (a
+ * single RTM_NEWNEXTHOP with NLM_F_REPLACE). Nexthops are per address
+ * family: IPv6 routes need an AF_INET6 nexthop.
+ *
+ * @param mgr Route manager
+ * @param id Nexthop id (> 0)
+ * @param family AF_INET or AF_INET6
+ * @param device Output device, NULL for the manager's WireGuard device
+ * @return NB_SUCCESS, NB_ERROR_INVALID, NB_ERROR_NOTFOUND (no such
+ *         device) or NB_ERROR_* (e.g. nexthops not supported)
+ */
+int route_nexthop_set(route_manager_t *mgr, uint32_t id, int family, const char *device);
+
+/**
+ * Create or replace a nexthop group
+ *
+ * Routes on the group are spread over the members by weight (multipath);
+ * replacing the group changes the members of every such route at once.
+ *
+ * @param mgr Route manager
+ * @param id Group id (> 0, not used by a single nexthop)
+ * @param members Ids of existing nexthops of one family
+ * @param weights Per-member weight 1..256, NULL for equal weights
+ * @param count Number of members (>= 1)
+ * @return NB_SUCCESS, NB_ERROR_INVALID or NB_ERROR_*
+ */
+int route_nexthop_group_set(route_manager_t *mgr, uint32_t id, const uint32_t *members,
+                            const uint16_t *weights, int count);
+
+/**
+ * Delete a nexthop object or group
+ *
+ * The kernel deletes the routes using it as well; they are dropped from
+ * the owned set.
+ *
+ * @return NB_SUCCESS, NB_ERROR_NOTFOUND or NB_ERROR_*
+ */
+int route_nexthop_del(route_manager_t *mgr, uint32_t id);
+
+/**
+ * Delete every route of a table, whoever installed it
+ *
+ * With rtnetlink the table is dumped (filtered by the kernel) and the
+ * deletions pipelined like a batch; the shell backend runs
+ * 'ip route flush table'. The owned set is not changed.
+ *
+ * @param mgr Route manager
+ * @param table Table number (not the main or local table)
+ * @return NB_SUCCESS, NB_ERROR_INVALID or NB_ERROR_*
+ */
+int route_flush_table(route_manager_t *mgr, uint32_t table);
+
+/**
+ * Create an empty route batch
+ *
+ * A batch queues route additions and deletions and applies them with
+ * route_batch_commit(). With the netlink backend the requests are packed
+ * back to back into one buffer per sendmsg() and the ACKs are collected
+ * afterwards, so the kernel is never idle waiting for us; each ACK is
+ * mapped back to the operation that caused it.
+ *
+ * @return Batch, NULL on allocation failure
+ */
+route_batch_t* route_batch_new(void);
+
+/**
+ * Queue a route addition (same semantics as route_add)
+ *
+ * The network is parsed and route->device copied immediately, so the
+ * route config need not outlive the call.
+ *
+ * @return Operation index (>= 0) used by route_batch_result, or
+ *         NB_ERROR_INVALID for an unparsable network / device name
+ */
+int route_batch_add(route_batch_t *batch, const route_config_t *route);
+
+/**
+ * Queue a route deletion (same semantics as route_remove)
+ *
+ * @return Operation index (>= 0), or NB_ERROR_INVALID
+ */
+int route_batch_del(route_batch_t *batch, const char *network);
+
+/**
+ * Number of queued operations
+ */
+int route_batch_count(const route_batch_t *batch);
+
+/**
+ * Apply every queued operation
+ *
+ * The batch keeps its operations and their results until it is cleared.
+ *
+ * @param mgr Route manager
+ * @param batch Batch to apply
+ * @return Number of failed operations (>= 0), or NB_ERROR_* if the
+ *         netlink socket itself failed
+ */
+int route_batch_commit(route_manager_t *mgr, route_batch_t *batch);
+
+/**
+ * Result of one operation after route_batch_commit
+ *
+ * @param batch Committed batch
+ * @param index Operation index returned when it was queued
+ * @param errno_out Optional kernel errno (0 on success or if unknown)
+ * @return NB_SUCCESS or NB_ERROR_*
+ */
+int route_batch_result(const route_batch_t *batch, int index, int *errno_out);
+
+/**
+ * Drop all queued operations and results (keeps the allocation)
+ */
+void route_batch_clear(route_batch_t *batch);
+
+/**
+ * Free a batch
+ */
+void route_batch_free(route_batch_t *batch);
+
+/**
+ * errno reported by the kernel for the last failed request
+ *
+ * @return errno value, 0 if the last failure carried none (shell backend)
+ */
+int route_last_errno(const route_manager_t *mgr);
+
+/**
+ * Backend name ("netlink" or "shell")
+ */
+const char* route_backend_name(route_backend_t backend);
+
 /**
  * Enable IP masquerading for a device
  *
- * This adds iptables rule for NAT.
+ * Masquerades everything leaving the device (routes with masquerade set
+ * only cover their own destination) and turns on IP forwarding through
+ * /proc/sys. Uses the nftables sets, or an iptables rule with the shell
+ * backend or without nf_tables.
  *
  * @param mgr Route manager
  * @param device Device to masquerade (usually WireGuard device)
@@ -98,6 +440,9 @@ int route_enable_masquerade(route_manager_t *mgr, const char *device);
 /**
  * Disable IP masquerading for a device
  *
+ * Undoes route_enable_masquerade(); masqueraded routes through the
+ * device keep their entries until they are removed.
+ *
  * @param mgr Route manager
  * @param device Device to un-masquerade
  * @return NB_SUCCESS on success, NB_ERROR_* on failure
@@ -0,0 +1,89 @@
+/**
+ * route_agg.h - CIDR aggregation of route lists
+ *
+ * Shrinks a route list before it is installed:
+ * - duplicates and prefixes inside a broader route with the same device,
+ *   metric, masquerade setting and nexthop are dropped
+ * - sibling prefixes (the two halves of a parent) are merged into the
+ *   parent, repeatedly, so 256 adjacent /32s become one /24
+ *
+ * Forwarding is unchanged for every address. A prefix that lies inside a
+ * route of another group (different device, metric, masquerade or
+ * nexthop) is passed through untouched, because dropping or merging it
+ * could move traffic between the two groups.
+ *
+ * The result keeps a mapping in both directions between the original
+ * routes and the aggregated ones.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_ROUTE_AGG_H
+#define NB_ROUTE_AGG_H
+
+#include "route.h"
+
+typedef struct route_agg route_agg_t;
+
+/**
+ * What the aggregation saved
+ */
+typedef struct {
+    int input;              /* Routes given */
+    int invalid;            /* ... with an unparsable network (dropped) */
+    int duplicates;         /* Same prefix twice in a group */
+    int covered;            /* Inside a broader prefix of the same group */
+    int merged;             /* Sibling pairs merged into their parent */
+    int isolated;           /* Passed through: inside another group's route */
+    int output;             /* Routes after aggregation */
+    int saved;              /* input - invalid - output */
+} route_agg_stats_t;
+
+/**
+ * Aggregate a route list
+ *
+ * @param routes Routes (networks in CIDR notation; host bits are ignored)
+ * @param count Number of routes
+ * @param agg_out Result (free with route_agg_free)
+ * @return NB_SUCCESS, NB_ERROR_INVALID or NB_ERROR_SYSTEM
+ */
+int route_aggregate(const route_config_t *routes, int count, route_agg_t **agg_out);
+
+/**
+ * Aggregated routes, grouped by device, metric, masquerade and nexthop
+ *
+ * Networks and devices are owned by the result.
+ *
+ * @param count_out Number of routes
+ */
+const route_config_t* route_agg_routes(const route_agg_t *agg, int *count_out);
+
+/**
+ * Aggregated route that carries an original route
+ *
+ * @param index Index into the original list
+ * @return Index into route_agg_routes(), -1 for an invalid original
+ */
+int route_agg_target(const route_agg_t *agg, int index);
+
+/**
+ * Original routes folded into an aggregated route
+ *
+ * @param index Index into route_agg_routes()
+ * @param sources_out Indices into the original list (owned by the result)
+ * @return Number of original routes
+ */
+int route_agg_sources(const route_agg_t *agg, int index, const int **sources_out);
+
+/**
+ * Savings report
+ */
+void route_agg_get_stats(const route_agg_t *agg, route_agg_stats_t *out);
+
+/**
+ * Free a result
+ */
+void route_agg_free(route_agg_t *agg);
+
+#endif /* NB_ROUTE_AGG_H */
@@ -0,0 +1,152 @@
+/**
+ * route_ha.h - HA selection among routing peers that serve the same network
+ *
+ * Reference: go/internal/routemanager/manager.go (HAMap, TriggerSelection)
+ *
+ * Routes carry a network ID; routes with the same ID are alternatives for
+ * one network, each through a different routing peer. For every ID the
+ * selector keeps one active route:
+ * - a peer is healthy while its last handshake is younger than stale_after
+ * - among healthy peers the lowest metric wins (the management server's
+ *   preference), then the best score
+ * - the score (0..1) weighs handshake freshness, RTT (relative to the best
+ *   RTT of the group) and throughput (relative to the best of the group)
+ *
+ * To avoid flapping, a healthy active route only gives way to a route
+ * with the same metric whose score is higher by at least margin, and not
+ * before hold_ms has passed since the last switch. An active route whose
+ * peer turned unhealthy is replaced at once; when no peer is healthy the
+ * active route is kept.
+ *
+ * The selector only decides; moving the network's allowed IP and route to
+ * the new peer is up to the caller.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_ROUTE_HA_H
+#define NB_ROUTE_HA_H
+
+#include <stdint.h>
+#include "wg_key.h"
+#include "stats.h"
+
+#define ROUTE_HA_STALE_AFTER_S  180     /* WireGuard's REJECT_AFTER_TIME */
+#define ROUTE_HA_MARGIN         0.10
+#define ROUTE_HA_HOLD_MS        30000
+
+typedef struct route_ha route_ha_t;
+
+/**
+ * A route through one routing peer
+ */
+typedef struct {
+    const char *net_id;             /* Routes with the same ID serve the same network */
+    const char *network;            /* CIDR */
+    uint8_t peer[WG_KEY_LEN];       /* Routing peer */
+    int metric;                     /* Lower is preferred */
+} route_ha_route_t;
+
+/**
+ * Measured state of a routing peer
+ */
+typedef struct {
+    int64_t last_handshake;         /* Unix time, 0 if never */
+    uint32_t rtt_ms;                /* Round trip time, 0 if unknown */
+    uint64_t rate;                  /* Throughput, bytes per second (rx + tx) */
+} route_ha_health_t;
+
+/**
+ * Tuning; zero fields take the defaults above
+ */
+typedef struct {
+    int stale_after_s;
+    double margin;                  /* Score lead a challenger needs */
+    int hold_ms;                    /* Minimum time between switches of a network */
+} route_ha_params_t;
+
+/**
+ * Active route of one network ID
+ */
+typedef struct {
+    const char *net_id;
+    const route_ha_route_t *active; /* NULL if the ID has no routes */
+    int healthy;                    /* 1 if the active peer is healthy */
+    double score;                   /* Score of the active route */
+    int candidates;                 /* Routes with this ID */
+    int switched;                   /* 1 if the last route_ha_select() changed it */
+    uint64_t switches;              /* Moves from one route to another (not the first choice) */
+} route_ha_selection_t;
+
+/**
+ * Create a selector
+ *
+ * @param params Tuning (NULL for the defaults)
+ * @return Selector or NULL on allocation failure
+ */
+route_ha_t* route_ha_new(const route_ha_params_t *params);
+
+/**
+ * Free a selector
+ */
+void route_ha_free(route_ha_t *ha);
+
+/**
+ * Replace the route set
+ *
+ * Routes are copied and grouped by network ID. An ID whose active route
+ * (same network and peer) is still in the set keeps it and its hold
+ * timer; new IDs get their first choice on the next route_ha_select().
+ *
+ * @return NB_SUCCESS, NB_ERROR_INVALID or NB_ERROR_SYSTEM
+ */
+int route_ha_set_routes(route_ha_t *ha, const route_ha_route_t *routes, int count);
+
+/**
+ * Record the measured state of a peer
+ *
+ * @return NB_SUCCESS, NB_ERROR_INVALID or NB_ERROR_SYSTEM
+ */
+int route_ha_set_health(route_ha_t *ha, const uint8_t peer[WG_KEY_LEN],
+                        const route_ha_health_t *health);
+
+/**
+ * Take handshake times and throughput from a statistics sampler
+ *
+ * Peers without routes are skipped; RTTs are kept.
+ *
+ * @return Number of peers updated, or NB_ERROR_*
+ */
+int route_ha_update_from_stats(route_ha_t *ha, const nb_stats_t *stats);
+
+/**
+ * Score the candidates and update the active route of every network ID
+ *
+ * @param now_ms Wall clock time (ms since epoch)
+ * @return Number of network IDs whose active route changed, or NB_ERROR_INVALID
+ */
+int route_ha_select(route_ha_t *ha, int64_t now_ms);
+
+/**
+ * Number of network IDs
+ */
+int route_ha_count(const route_ha_t *ha);
+
+/**
+ * Active route of the i-th network ID (IDs are sorted)
+ *
+ * Pointers stay valid until the next route_ha_set_routes().
+ *
+ * @return NB_SUCCESS or NB_ERROR_NOTFOUND
+ */
+int route_ha_get(const route_ha_t *ha, int index, route_ha_selection_t *out);
+
+/**
+ * Active route of a network ID
+ *
+ * @return NB_SUCCESS or NB_ERROR_NOTFOUND
+ */
+int route_ha_find(const route_ha_t *ha, const char *net_id, route_ha_selection_t *out);
+
+#endif /* NB_ROUTE_HA_H */
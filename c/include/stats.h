@@ -0,0 +1,191 @@
+/**
+ * stats.h - Per-peer statistics sampler with a memory-mapped ring
+ *
+ * Reference: go/client/internal/peer (Status: BytesRx/BytesTx/LastWireguardHandshake)
+ *
+ * The engine feeds nb_stats_sample() with WG_CMD_GET_DEVICE dumps. Every
+ * round appends one fixed-size record per peer to a ring file shared with
+ * other processes through mmap, so history survives restarts and readers
+ * (e.g. "netbird-client status") never take a lock:
+ *
+ *   [nb_stats_header_t][nb_stats_record_t x slots]
+ *
+ * There is a single writer (enforced with flock). Each record is guarded
+ * by its own sequence number, written last: a reader copies a record and
+ * keeps it only if the sequence number was the expected one before and
+ * after the copy. The header's head counter is published once per round,
+ * so readers only see complete rounds.
+ *
+ * Per-peer throughput is an exponentially weighted moving average of the
+ * byte counter deltas, stored in each record and kept in memory for
+ * in-process consumers.
+ *
+ * The header also carries a few engine-wide gauges (active versus known
+ * peers in lazy mode), guarded by their own sequence number.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_STATS_H
+#define NB_STATS_H
+
+#include <stdint.h>
+#include "wg_iface.h"
+
+#define NB_STATS_MAGIC          "NBSTATS1"
+#define NB_STATS_VERSION        1
+#define NB_STATS_DEFAULT_SLOTS  65536
+#define NB_STATS_DEFAULT_TAU_MS 30000
+#define NB_STATS_DIR            "/var/lib/netbird"
+
+/* Engine-wide gauges published with each round */
+typedef struct {
+    uint32_t peers_known;       /* Peers in the engine's peer table */
+    uint32_t peers_active;      /* Peers configured in the kernel */
+    uint64_t activations;       /* Lazy peers installed on traffic */
+    uint64_t evictions;         /* Lazy peers removed when idle */
+} nb_stats_gauges_t;
+
+/* File header, 64 bytes */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t slots;
+    uint32_t gauges_seq;        /* Odd while the gauges are being written */
+    uint64_t head;              /* Records written since the file was created */
+    nb_stats_gauges_t gauges;
+    uint8_t pad[8];
+} nb_stats_header_t;
+
+/* One peer in one sampling round */
+typedef struct {
+    uint64_t seq;               /* Record number + 1; 0 while being written */
+    int64_t time_ms;            /* Wall clock time of the round (ms since epoch) */
+    int64_t last_handshake;     /* Unix time, 0 if never */
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_rate;           /* EWMA, bytes per second */
+    uint64_t tx_rate;
+    uint8_t public_key[WG_KEY_LEN];
+} nb_stats_record_t;
+
+/* In-memory rate state of a peer */
+typedef struct {
+    uint8_t public_key[WG_KEY_LEN];
+    int64_t time_ms;            /* Time of the last sample */
+    int64_t last_handshake;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    double rx_rate;             /* EWMA, bytes per second */
+    double tx_rate;
+} nb_peer_rate_t;
+
+typedef struct nb_stats nb_stats_t;
+typedef struct nb_stats_reader nb_stats_reader_t;
+
+/**
+ * Default ring file for an interface: NB_STATS_DIR/<ifname>.stats
+ */
+const char* nb_stats_default_path(const char *ifname, char *buf, size_t size);
+
+/**
+ * Open (or create) a ring file for writing
+ *
+ * An existing file with the same layout is reused: its history is kept
+ * and the last sample of each peer seeds the rate state. A file with a
+ * different layout is reinitialized.
+ *
+ * @param path Ring file (the parent directory is created if missing)
+ * @param slots Ring capacity in records (0 for NB_STATS_DEFAULT_SLOTS)
+ * @param tau_ms EWMA time constant (0 for NB_STATS_DEFAULT_TAU_MS)
+ * @param stats_out Sampler
+ * @return NB_SUCCESS, NB_ERROR_EXISTS if another writer holds the file, NB_ERROR_*
+ */
+int nb_stats_open(const char *path, uint32_t slots, int tau_ms, nb_stats_t **stats_out);
+
+/**
+ * Close a sampler (the file stays)
+ */
+void nb_stats_close(nb_stats_t *stats);
+
+/**
+ * Record one sampling round
+ *
+ * Updates the rates of every peer in dev, forgets peers no longer present
+ * and appends a record per peer to the ring.
+ *
+ * @param now_ms Wall clock time of the round (ms since epoch)
+ * @return NB_SUCCESS or NB_ERROR_*
+ */
+int nb_stats_sample(nb_stats_t *stats, const wg_device_t *dev, int64_t now_ms);
+
+/**
+ * Rate state of a peer
+ *
+ * @return NB_SUCCESS or NB_ERROR_NOTFOUND
+ */
+int nb_stats_rate(const nb_stats_t *stats, const uint8_t key[WG_KEY_LEN], nb_peer_rate_t *out);
+
+/**
+ * All rate states, sorted by public key (valid until the next sample)
+ *
+ * @return Number of peers
+ */
+int nb_stats_rates(const nb_stats_t *stats, const nb_peer_rate_t **rates_out);
+
+/**
+ * Publish the engine-wide gauges
+ */
+void nb_stats_set_gauges(nb_stats_t *stats, const nb_stats_gauges_t *gauges);
+
+/**
+ * Open a ring file read-only
+ *
+ * @return NB_SUCCESS, NB_ERROR_NOTFOUND, NB_ERROR_INVALID (not a ring file) or NB_ERROR_SYSTEM
+ */
+int nb_stats_reader_open(const char *path, nb_stats_reader_t **reader_out);
+
+/**
+ * Close a reader
+ */
+void nb_stats_reader_close(nb_stats_reader_t *reader);
+
+/**
+ * Number of records written so far; records head - slots .. head - 1 may
+ * still be in the ring
+ */
+uint64_t nb_stats_reader_head(const nb_stats_reader_t *reader);
+
+/**
+ * Ring capacity in records
+ */
+uint32_t nb_stats_reader_slots(const nb_stats_reader_t *reader);
+
+/**
+ * Copy record number n (0-based)
+ *
+ * @return NB_SUCCESS, or NB_ERROR_NOTFOUND if it was not written yet or
+ *         has been overwritten
+ */
+int nb_stats_reader_get(const nb_stats_reader_t *reader, uint64_t n, nb_stats_record_t *out);
+
+/**
+ * Copy the latest engine-wide gauges (all zero if never published)
+ *
+ * @return NB_SUCCESS, NB_ERROR_TIMEOUT (all zero) if they stay half
+ *         written, i.e. the writer died while publishing them, or
+ *         NB_ERROR_INVALID
+ */
+int nb_stats_reader_gauges(const nb_stats_reader_t *reader, nb_stats_gauges_t *out);
+
+/**
+ * Copy the records of the latest complete round
+ *
+ * @param records_out Allocated array (free with free())
+ * @return Number of records, or NB_ERROR_* (0 if nothing was sampled yet)
+ */
+int nb_stats_reader_last_round(const nb_stats_reader_t *reader, nb_stats_record_t **records_out);
+
+#endif /* NB_STATS_H */
@@ -4,8 +4,10 @@
  * Reference: go/iface/iface.go, go/iface/iface_new_linux.go
  *
  * This module manages WireGuard network interfaces on Linux.
- * Quick prototype version uses shell commands (wg, ip).
- * Production version should use netlink API.
+ * Three backends implement the same API:
+ * - netlink:   rtnetlink + WireGuard generic netlink (wg_netlink.c)
+ * - userspace: WireGuard in this process over a TUN device (wg_user.c)
+ * - shell:     original prototype using the wg/ip commands
  *
  * Author: Claude
  * Date: 2025-11-30
@@ -14,10 +16,29 @@
 #ifndef NB_WG_IFACE_H
 #define NB_WG_IFACE_H
 
+/* nftables table of an interface's conntrack bypass: prefix + interface name */
+#define WG_NOTRACK_TABLE_PREFIX "netbird-notrack-"
+
 #include "config.h"
+#include "wg_key.h"
+#include "ipaddr.h"
+#include <net/if.h>
 
-/* Forward declaration */
+/* Forward declarations */
 typedef struct wg_iface wg_iface_t;
+struct wg_nl;
+struct wg_user;
+struct nb_nft;
+
+/**
+ * Configuration backend
+ */
+typedef enum {
+    WG_BACKEND_AUTO = 0,     /* Netlink if the wireguard family exists, else userspace */
+    WG_BACKEND_SHELL,        /* wg/ip commands */
+    WG_BACKEND_NETLINK,      /* rtnetlink + WireGuard generic netlink */
+    WG_BACKEND_USERSPACE     /* TUN device + in-process WireGuard */
+} wg_backend_t;
 
 /**
  * WireGuard interface structure
@@ -33,8 +54,62 @@ struct wg_iface {
     /* State */
     int created;             /* 1 if interface created */
     int up;                  /* 1 if interface is up */
+
+    /* Backend */
+    wg_backend_t backend;    /* Resolved on first use when WG_BACKEND_AUTO */
+    struct wg_nl *nl;        /* Netlink handle (netlink; rtnetlink only for userspace) */
+    struct wg_user *user;    /* Userspace device (userspace backend only) */
+    struct nb_nft *notrack;  /* Conntrack bypass for listen_port, NULL if off */
 };
 
+/**
+ * Peer change for wg_iface_apply_peers()
+ *
+ * Binary form of the wg_iface_update_peer() arguments so that large batches
+ * need no string parsing on the hot path.
+ */
+typedef struct {
+    uint8_t public_key[WG_KEY_LEN];
+    int remove;                     /* 1 to remove the peer (other fields ignored) */
+    const nb_prefix_t *allowed_ips; /* Replaces current allowed IPs; NULL leaves them unchanged */
+    int allowed_ips_count;
+    nb_endpoint_t endpoint;         /* sa_family 0 leaves the endpoint unchanged */
+    int keepalive;                  /* Seconds, 0 to disable, -1 to leave unchanged */
+    int has_preshared_key;          /* 1 to set preshared_key */
+    uint8_t preshared_key[WG_KEY_LEN];
+} wg_peer_spec_t;
+
+/**
+ * Peer as reported by the kernel
+ */
+typedef struct {
+    uint8_t public_key[WG_KEY_LEN];
+    uint8_t preshared_key[WG_KEY_LEN];
+    nb_endpoint_t endpoint;  /* sa_family 0 if unknown */
+    int keepalive;           /* Persistent keepalive interval, 0 if off */
+    int64_t last_handshake;  /* Unix time of last handshake, 0 if never */
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    nb_prefix_t *allowed_ips;
+    int allowed_ips_count;
+} wg_device_peer_t;
+
+/**
+ * Device state as reported by the kernel
+ *
+ * Reference: Go wgtypes.Device
+ */
+typedef struct {
+    char name[IFNAMSIZ];
+    uint32_t ifindex;
+    uint8_t private_key[WG_KEY_LEN];
+    uint8_t public_key[WG_KEY_LEN];
+    int listen_port;
+    uint32_t fwmark;
+    wg_device_peer_t *peers;
+    int peer_count;
+} wg_device_t;
+
 /**
  * Create a new WireGuard interface
  *
@@ -44,7 +119,9 @@ struct wg_iface {
  * 1. Creates a WireGuard network interface
  * 2. Assigns IP address
  * 3. Sets private key and listen port
- * 4. Does NOT bring the interface up (call wg_iface_up() for that)
+ * 4. With cfg->wg_notrack, exempts the listen port from connection
+ *    tracking (nftables raw rules; failure only logs a warning)
+ * 5. Does NOT bring the interface up (call wg_iface_up() for that)
  *
  * @param cfg Configuration containing WG parameters
  * @param iface_out Output interface structure (allocated by this function)
@@ -94,6 +171,28 @@ int wg_iface_update_peer(
     const char *preshared_key
 );
 
+/**
+ * Apply a batch of peer additions, updates and removals
+ *
+ * With the netlink backend the whole batch is packed into as few
+ * WG_CMD_SET_DEVICE messages as fit the netlink buffer; the shell backend
+ * falls back to one command per peer.
+ *
+ * @param iface WireGuard interface
+ * @param specs Peer changes, applied in order
+ * @param count Number of specs
+ * @param errors Optional output array (count entries) with NB_SUCCESS or
+ *               NB_ERROR_* for each spec
+ * @return NB_SUCCESS if every peer was applied, NB_ERROR if some failed
+ *         (see errors), NB_ERROR_* on invalid arguments
+ */
+int wg_iface_apply_peers(
+    wg_iface_t *iface,
+    const wg_peer_spec_t *specs,
+    int count,
+    int *errors
+);
+
 /**
  * Remove a peer from the WireGuard interface
  *
@@ -114,6 +213,7 @@ int wg_iface_remove_peer(wg_iface_t *iface, const char *peer_pubkey);
  * 1. Brings interface down
  * 2. Removes all peers
  * 3. Deletes the network interface
+ * 4. Removes the conntrack bypass rules, if any
  *
  * @param iface WireGuard interface to destroy
  * @return NB_SUCCESS on success, NB_ERROR_* on failure
@@ -130,9 +230,42 @@ int wg_iface_destroy(wg_iface_t *iface);
  */
 void wg_iface_free(wg_iface_t *iface);
 
+/**
+ * Read the current device state from the kernel
+ *
+ * Reference: Go wgctrl Client.Device()
+ *
+ * Uses WG_CMD_GET_DEVICE with the netlink backend and "wg show dump"
+ * with the shell backend.
+ *
+ * @param iface WireGuard interface
+ * @param dev_out Output device (free with wg_device_free)
+ * @return NB_SUCCESS on success, NB_ERROR_* on failure
+ */
+int wg_iface_get_device(wg_iface_t *iface, wg_device_t **dev_out);
+
+/**
+ * Free a device structure returned by wg_iface_get_device()
+ */
+void wg_device_free(wg_device_t *dev);
+
+/**
+ * Parse a backend name ("auto", "netlink", "userspace", "shell")
+ *
+ * @return NB_SUCCESS or NB_ERROR_INVALID
+ */
+int wg_backend_parse(const char *name, wg_backend_t *backend_out);
+
+/**
+ * Backend name for logging
+ */
+const char* wg_backend_name(wg_backend_t backend);
+
 /**
  * Get WireGuard public key from private key
  *
+ * Derived in-process with X25519; does not need the wg tool.
+ *
  * @param private_key Private key (base64)
  * @param public_key_out Output public key (allocated by this function)
  * @return NB_SUCCESS on success, NB_ERROR_* on failure
@@ -142,6 +275,8 @@ int wg_get_public_key(const char *private_key, char **public_key_out);
 /**
  * Generate a new WireGuard private key
  *
+ * Uses getrandom(); the key never touches the filesystem.
+ *
  * @param private_key_out Output private key (allocated by this function)
  * @return NB_SUCCESS on success, NB_ERROR_* on failure
  */
@@ -0,0 +1,69 @@
+/**
+ * wg_key.h - WireGuard key encoding
+ *
+ * Reference: go/iface/configurer (wgtypes.ParseKey / Key.String)
+ *
+ * Keys travel as base64 strings in the configuration and management data,
+ * but the kernel (and any lookup table) wants the raw 32 bytes. Key
+ * generation and derivation use the in-process X25519 in curve25519.c.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_WG_KEY_H
+#define NB_WG_KEY_H
+
+#include <stdint.h>
+
+#ifndef WG_KEY_LEN
+#define WG_KEY_LEN          32
+#endif
+
+/* Base64 key length including the terminating NUL ("...=" is 44 chars) */
+#define WG_KEY_B64_LEN      45
+
+/**
+ * Decode a base64 key
+ *
+ * Runs in constant time with respect to the key contents.
+ *
+ * @param key Output raw key
+ * @param b64 Base64 string (exactly 44 characters ending in '=')
+ * @return NB_SUCCESS or NB_ERROR_INVALID
+ */
+int wg_key_from_base64(uint8_t key[WG_KEY_LEN], const char *b64);
+
+/**
+ * Encode a raw key as base64
+ *
+ * @param b64 Output buffer of WG_KEY_B64_LEN bytes
+ * @param key Raw key
+ */
+void wg_key_to_base64(char b64[WG_KEY_B64_LEN], const uint8_t key[WG_KEY_LEN]);
+
+/**
+ * Check whether a key is all zeros (constant time)
+ */
+int wg_key_is_zero(const uint8_t key[WG_KEY_LEN]);
+
+/**
+ * Compare two keys in constant time
+ *
+ * @return 1 if equal, 0 otherwise
+ */
+int wg_key_equal(const uint8_t a[WG_KEY_LEN], const uint8_t b[WG_KEY_LEN]);
+
+/**
+ * Generate a new private key (getrandom + X25519 clamping)
+ *
+ * @return NB_SUCCESS or NB_ERROR_SYSTEM if no randomness is available
+ */
+int wg_key_generate_private(uint8_t key[WG_KEY_LEN]);
+
+/**
+ * Derive the public key of a private key (X25519 with the base point)
+ */
+void wg_key_derive_public(uint8_t pub[WG_KEY_LEN], const uint8_t priv[WG_KEY_LEN]);
+
+#endif /* NB_WG_KEY_H */
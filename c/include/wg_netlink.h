@@ -0,0 +1,90 @@
+/**
+ * wg_netlink.h - WireGuard netlink backend
+ *
+ * Reference: go/iface/configurer/kernel_unix.go (wgctrl), wireguard-tools ipc-linux.h
+ *
+ * Talks to the kernel directly:
+ * - rtnetlink for link create/delete/up/down and addresses
+ * - generic netlink family "wireguard" for WG_CMD_SET_DEVICE / WG_CMD_GET_DEVICE
+ *
+ * Used by wg_iface.c when the netlink backend is selected; not meant to be
+ * called directly by the engine.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_WG_NETLINK_H
+#define NB_WG_NETLINK_H
+
+#include "wg_key.h"
+#include "ipaddr.h"
+#include "wg_iface.h"
+
+/* Forward declaration */
+typedef struct wg_nl wg_nl_t;
+
+/**
+ * Open the netlink backend
+ *
+ * @param nl_out Output handle
+ * @return NB_SUCCESS, NB_ERROR_NOTFOUND if the wireguard family is not
+ *         registered (module not loaded), NB_ERROR_SYSTEM otherwise
+ */
+int wg_nl_open(wg_nl_t **nl_out);
+
+/**
+ * Open rtnetlink only, for the link and address helpers
+ *
+ * Used by the userspace backend, which has no wireguard family; the
+ * wg_nl_set_* / wg_nl_get_device calls must not be used on this handle.
+ */
+int wg_nl_open_route(wg_nl_t **nl_out);
+
+/**
+ * Close the netlink backend
+ */
+void wg_nl_close(wg_nl_t *nl);
+
+/* Link management (rtnetlink) */
+int wg_nl_link_add(wg_nl_t *nl, const char *ifname);
+int wg_nl_link_del(wg_nl_t *nl, const char *ifname);
+int wg_nl_link_set_up(wg_nl_t *nl, const char *ifname, int up);
+int wg_nl_addr_add(wg_nl_t *nl, const char *ifname, const nb_prefix_t *addr);
+
+/**
+ * Set device private key and listen port
+ *
+ * @param private_key Raw private key (NULL to leave unchanged)
+ * @param listen_port Listen port (-1 to leave unchanged)
+ */
+int wg_nl_set_device(wg_nl_t *nl, const char *ifname,
+                     const uint8_t *private_key, int listen_port);
+
+/**
+ * Add, update or remove a single peer
+ */
+int wg_nl_set_peer(wg_nl_t *nl, const char *ifname, const wg_peer_spec_t *peer);
+
+/**
+ * Apply many peer changes with as few WG_CMD_SET_DEVICE messages as possible
+ *
+ * Peers are packed back to back; a message is sent whenever the buffer
+ * fills up, and a peer whose allowed IPs do not fit continues in the next
+ * message. If the kernel rejects a message, its peers are replayed one by
+ * one so that the error can be attributed.
+ *
+ * @param errors Optional per-peer NB_SUCCESS / NB_ERROR_* (count entries)
+ * @return Number of peers that failed (0 on full success)
+ */
+int wg_nl_apply_peers(wg_nl_t *nl, const char *ifname,
+                      const wg_peer_spec_t *specs, int count, int *errors);
+
+/**
+ * Dump device state (WG_CMD_GET_DEVICE)
+ *
+ * @param dev_out Output device (free with wg_device_free)
+ */
+int wg_nl_get_device(wg_nl_t *nl, const char *ifname, wg_device_t **dev_out);
+
+#endif /* NB_WG_NETLINK_H */
@@ -0,0 +1,313 @@
+/**
+ * wg_noise.h - WireGuard handshake (Noise_IKpsk2), cookies and transport framing
+ *
+ * Reference: WireGuard whitepaper sections 5 and 6, wireguard-go device/noise-protocol.go
+ *
+ * Pure protocol state with no I/O and no locking; wg_user.c owns the
+ * sockets, peers and timers and serialises access per peer.
+ *
+ * Handshake, from the initiator's view:
+ *
+ *   wg_noise_create_initiation()  ->  [148 bytes]  ->  wg_noise_consume_initiation()
+ *                                                      wg_noise_accept_initiation()
+ *   wg_noise_consume_response()   <-  [92 bytes]   <-  wg_noise_create_response()
+ *   wg_noise_derive_keypair()                          wg_noise_derive_keypair()
+ *
+ * Consuming an initiation is split in two so that the responder can find
+ * the peer (by the decrypted static key) before touching any peer state.
+ * mac1/mac2 are added and checked separately with the wg_cookie_* helpers.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_WG_NOISE_H
+#define NB_WG_NOISE_H
+
+#include "wg_key.h"
+#include "ipaddr.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/* Message types (first byte, followed by three zero bytes) */
+#define WG_MSG_INITIATION       1
+#define WG_MSG_RESPONSE         2
+#define WG_MSG_COOKIE           3
+#define WG_MSG_DATA             4
+
+#define WG_MSG_INITIATION_LEN   148
+#define WG_MSG_RESPONSE_LEN     92
+#define WG_MSG_COOKIE_LEN       64
+#define WG_DATA_HEADER_LEN      16      /* type, receiver index, counter */
+#define WG_DATA_TAG_LEN         16
+#define WG_DATA_MIN_LEN         (WG_DATA_HEADER_LEN + WG_DATA_TAG_LEN)  /* Keepalive */
+
+#define WG_COOKIE_LEN           16
+#define WG_TIMESTAMP_LEN        12
+
+/* Protocol constants (whitepaper 6.1) */
+#define WG_REKEY_AFTER_MESSAGES     (1ULL << 60)
+#define WG_REJECT_AFTER_MESSAGES    (UINT64_MAX - (1ULL << 13))
+#define WG_REKEY_AFTER_TIME_MS      120000
+#define WG_REJECT_AFTER_TIME_MS     180000
+#define WG_REKEY_ATTEMPT_TIME_MS    90000
+#define WG_REKEY_TIMEOUT_MS         5000
+#define WG_KEEPALIVE_TIMEOUT_MS     10000
+#define WG_COOKIE_LIFETIME_MS       120000
+#define WG_INITIATION_MIN_GAP_MS    20      /* At most 50 initiations per second per peer */
+
+/* Replay window: 2048 bits, of which one word is the moving edge */
+#define WG_REPLAY_WORDS         32
+#define WG_REPLAY_WINDOW        ((WG_REPLAY_WORDS - 1) * 64)
+
+/**
+ * Device identity
+ */
+typedef struct {
+    uint8_t private_key[WG_KEY_LEN];
+    uint8_t public_key[WG_KEY_LEN];
+    uint8_t mac1_key[32];       /* HASH("mac1----" || public_key): mac1 of messages to us */
+    uint8_t cookie_key[32];     /* HASH("cookie--" || public_key): our cookie replies */
+} wg_noise_static_t;
+
+/* Handshake states */
+typedef enum {
+    WG_HS_NONE = 0,
+    WG_HS_CREATED_INITIATION,
+    WG_HS_CONSUMED_INITIATION,
+    WG_HS_CREATED_RESPONSE,
+    WG_HS_CONSUMED_RESPONSE
+} wg_hs_state_t;
+
+/**
+ * Per-peer handshake state
+ */
+typedef struct {
+    uint8_t remote_static[WG_KEY_LEN];
+    uint8_t preshared_key[WG_KEY_LEN];
+    uint8_t precomputed_ss[32];         /* DH(local private, remote static) */
+    uint8_t remote_mac1_key[32];        /* For mac1 of messages we send */
+    uint8_t remote_cookie_key[32];      /* For cookie replies we receive */
+
+    wg_hs_state_t state;
+    uint8_t hash[32];
+    uint8_t chaining_key[32];
+    uint8_t ephemeral_private[32];
+    uint8_t remote_ephemeral[32];
+    uint32_t local_index;
+    uint32_t remote_index;
+
+    uint8_t latest_timestamp[WG_TIMESTAMP_LEN]; /* Greatest accepted TAI64N */
+    int64_t last_initiation_ms;                 /* When we last accepted an initiation */
+} wg_noise_handshake_t;
+
+/**
+ * Initiation decrypted up to the static key, before the peer is known
+ */
+typedef struct {
+    uint8_t remote_static[WG_KEY_LEN];
+    uint8_t remote_ephemeral[32];
+    uint8_t hash[32];
+    uint8_t chaining_key[32];
+    uint32_t sender_index;
+} wg_noise_initiation_t;
+
+/**
+ * Anti-replay window (RFC 6479 style bitmap)
+ */
+typedef struct {
+    uint64_t greatest;                  /* Greatest counter seen, plus one */
+    uint64_t bitmap[WG_REPLAY_WORDS];
+} wg_replay_t;
+
+/**
+ * Transport keys of one session
+ */
+typedef struct {
+    uint8_t send_key[32];
+    uint8_t recv_key[32];
+    uint32_t local_index;
+    uint32_t remote_index;
+    uint64_t send_counter;              /* Next counter to use */
+    wg_replay_t replay;
+    int64_t birth_ms;
+    int initiator;                      /* 1 if we sent the initiation */
+    int valid;
+} wg_noise_keypair_t;
+
+/**
+ * Cookie received from a peer that is under load
+ */
+typedef struct {
+    uint8_t cookie[WG_COOKIE_LEN];
+    int64_t cookie_birth_ms;            /* 0 if no cookie */
+    uint8_t last_mac1[16];              /* mac1 of our last handshake message */
+    int have_last_mac1;
+} wg_cookie_t;
+
+/**
+ * Secret for the cookies we hand out (rotated every two minutes)
+ */
+typedef struct {
+    uint8_t secret[32];
+    int64_t secret_birth_ms;            /* 0 before first use */
+} wg_cookie_checker_t;
+
+/**
+ * Derive the device identity from a private key
+ */
+void wg_noise_static_init(wg_noise_static_t *local, const uint8_t private_key[WG_KEY_LEN]);
+
+/**
+ * Prepare the handshake state for a peer
+ *
+ * @param psk Preshared key, NULL for none (all zeros)
+ * @return NB_SUCCESS, or NB_ERROR_INVALID if the remote key is a low-order
+ *         point; hs is still initialised, but every handshake with it fails
+ */
+int wg_noise_handshake_init(wg_noise_handshake_t *hs, const wg_noise_static_t *local,
+                            const uint8_t remote_static[WG_KEY_LEN], const uint8_t *psk);
+
+/**
+ * Wipe the ephemeral part of a handshake and return it to WG_HS_NONE
+ */
+void wg_noise_handshake_clear(wg_noise_handshake_t *hs);
+
+/**
+ * Build a handshake initiation (mac1/mac2 left zero)
+ *
+ * @return NB_SUCCESS, NB_ERROR_INVALID (low-order remote key) or
+ *         NB_ERROR_SYSTEM if no randomness is available
+ */
+int wg_noise_create_initiation(wg_noise_handshake_t *hs, const wg_noise_static_t *local,
+                               uint32_t local_index, uint8_t msg[WG_MSG_INITIATION_LEN]);
+
+/**
+ * Decrypt the initiator's static key
+ *
+ * @return NB_SUCCESS or NB_ERROR_INVALID
+ */
+int wg_noise_consume_initiation(const wg_noise_static_t *local,
+                                const uint8_t msg[WG_MSG_INITIATION_LEN],
+                                wg_noise_initiation_t *out);
+
+/**
+ * Finish consuming an initiation for the peer owning in->remote_static
+ *
+ * Rejects stale timestamps (replays) and initiations arriving faster than
+ * WG_INITIATION_MIN_GAP_MS. hs is only modified on success.
+ *
+ * @return NB_SUCCESS or NB_ERROR_INVALID
+ */
+int wg_noise_accept_initiation(wg_noise_handshake_t *hs, const wg_noise_initiation_t *in,
+                               const uint8_t msg[WG_MSG_INITIATION_LEN], int64_t now_ms);
+
+/**
+ * Build the response to an accepted initiation (mac1/mac2 left zero)
+ *
+ * @return NB_SUCCESS, NB_ERROR_INVALID (wrong state) or NB_ERROR_SYSTEM
+ */
+int wg_noise_create_response(wg_noise_handshake_t *hs, uint32_t local_index,
+                             uint8_t msg[WG_MSG_RESPONSE_LEN]);
+
+/**
+ * Consume a response to our initiation
+ *
+ * hs is only modified on success.
+ *
+ * @return NB_SUCCESS or NB_ERROR_INVALID
+ */
+int wg_noise_consume_response(wg_noise_handshake_t *hs, const wg_noise_static_t *local,
+                              const uint8_t msg[WG_MSG_RESPONSE_LEN]);
+
+/**
+ * Derive transport keys after wg_noise_create_response() or
+ * wg_noise_consume_response(); clears the handshake
+ *
+ * @return NB_SUCCESS or NB_ERROR_INVALID (no completed handshake)
+ */
+int wg_noise_derive_keypair(wg_noise_handshake_t *hs, wg_noise_keypair_t *kp, int64_t now_ms);
+
+/**
+ * Length of a data message carrying plain_len bytes (padded to 16)
+ */
+static inline size_t wg_noise_data_len(size_t plain_len) {
+    return WG_DATA_HEADER_LEN + ((plain_len + 15) & ~(size_t)15) + WG_DATA_TAG_LEN;
+}
+
+/**
+ * Build a data message; out holds wg_noise_data_len(len) bytes and may not overlap plain
+ */
+void wg_noise_data_seal(uint8_t *out, const uint8_t *plain, size_t len,
+                        uint32_t remote_index, uint64_t counter, const uint8_t key[32]);
+
+/**
+ * Receiver index and counter of a data message (len >= WG_DATA_MIN_LEN)
+ */
+uint32_t wg_noise_data_index(const uint8_t *msg);
+uint64_t wg_noise_data_counter(const uint8_t *msg);
+
+/**
+ * Verify and decrypt a data message; out holds len - WG_DATA_MIN_LEN bytes
+ *
+ * The counter is not checked against the replay window here.
+ *
+ * @param plain_len Output decrypted length (including padding)
+ * @return NB_SUCCESS or NB_ERROR_INVALID
+ */
+int wg_noise_data_open(uint8_t *out, const uint8_t *msg, size_t len,
+                       const uint8_t key[32], size_t *plain_len);
+
+/**
+ * Check a received counter and mark it as seen
+ *
+ * @return 1 if the counter is new and inside the window, 0 otherwise
+ */
+int wg_replay_check(wg_replay_t *r, uint64_t counter);
+
+/**
+ * Write mac1 (and mac2 if a fresh cookie is known) into the last 32 bytes
+ * of a handshake message and remember mac1 for a cookie reply
+ */
+void wg_cookie_add_macs(wg_cookie_t *c, const uint8_t remote_mac1_key[32],
+                        uint8_t *msg, size_t len, int64_t now_ms);
+
+/**
+ * Check mac1 of a handshake message sent to us
+ *
+ * @return 1 if valid
+ */
+int wg_cookie_check_mac1(const wg_noise_static_t *local, const uint8_t *msg, size_t len);
+
+/**
+ * Check mac2 against the cookie we would give to src
+ *
+ * @return 1 if valid
+ */
+int wg_cookie_check_mac2(wg_cookie_checker_t *ck, const uint8_t *msg, size_t len,
+                         const nb_endpoint_t *src, int64_t now_ms);
+
+/**
+ * Build a cookie reply to a handshake message from src
+ *
+ * @return NB_SUCCESS or NB_ERROR_SYSTEM if no randomness is available
+ */
+int wg_cookie_create_reply(wg_cookie_checker_t *ck, const wg_noise_static_t *local,
+                           const uint8_t *msg, size_t len, uint32_t receiver_index,
+                           const nb_endpoint_t *src, int64_t now_ms,
+                           uint8_t out[WG_MSG_COOKIE_LEN]);
+
+/**
+ * Consume a cookie reply to our last handshake message
+ *
+ * @return NB_SUCCESS or NB_ERROR_INVALID
+ */
+int wg_cookie_consume_reply(wg_cookie_t *c, const uint8_t remote_cookie_key[32],
+                            const uint8_t reply[WG_MSG_COOKIE_LEN], int64_t now_ms);
+
+/**
+ * Current time as TAI64N, rounded down to limit timing information
+ */
+void wg_noise_tai64n(uint8_t out[WG_TIMESTAMP_LEN]);
+
+#endif /* NB_WG_NOISE_H */
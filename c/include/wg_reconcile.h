@@ -0,0 +1,68 @@
+/**
+ * wg_reconcile.h - Peer reconciliation against live device state
+ *
+ * Reference: go/iface/configurer (ConfigureDevice with ReplacePeers semantics)
+ *
+ * Instead of re-setting every peer, the reconciler dumps the device once
+ * (WG_CMD_GET_DEVICE or `wg show dump`), indexes the live peers by public
+ * key and computes the minimal add / update / remove plan against the
+ * desired peer set. Only that plan is written, so a sync where nothing
+ * changed costs one dump and no writes.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_WG_RECONCILE_H
+#define NB_WG_RECONCILE_H
+
+#include "wg_iface.h"
+
+/* Outcome of a reconcile pass */
+typedef struct {
+    int added;
+    int updated;
+    int removed;
+    int unchanged;
+    int failed;              /* Plan entries the kernel rejected */
+} wg_reconcile_stats_t;
+
+/**
+ * Compute the changes needed to turn dev into the desired peer set
+ *
+ * Desired peers not on the device are added, peers whose allowed IPs,
+ * endpoint, keepalive or pre-shared key differ are updated, and device
+ * peers missing from desired are removed. Fields a spec leaves unchanged
+ * (NULL allowed_ips, endpoint family 0, keepalive -1) are not compared.
+ * Specs with remove set only produce a removal if the peer exists.
+ *
+ * Plan entries borrow the allowed_ips arrays of desired; keep desired
+ * alive while the plan is in use.
+ *
+ * @param dev Live device state (from wg_iface_get_device)
+ * @param desired Desired peers
+ * @param count Number of desired peers
+ * @param plan_out Output plan (free with free(); NULL if empty)
+ * @param plan_count_out Number of plan entries
+ * @param stats Optional counters (failed is left 0)
+ * @return NB_SUCCESS or NB_ERROR_*
+ */
+int wg_reconcile_plan(const wg_device_t *dev,
+                      const wg_peer_spec_t *desired, int count,
+                      wg_peer_spec_t **plan_out, int *plan_count_out,
+                      wg_reconcile_stats_t *stats);
+
+/**
+ * Dump the device, compute the plan and apply it
+ *
+ * @param iface Interface
+ * @param desired Desired peers (the complete set; others are removed)
+ * @param count Number of desired peers
+ * @param stats_out Optional counters
+ * @return NB_SUCCESS, NB_ERROR if some plan entries failed, NB_ERROR_* otherwise
+ */
+int wg_iface_reconcile(wg_iface_t *iface,
+                       const wg_peer_spec_t *desired, int count,
+                       wg_reconcile_stats_t *stats_out);
+
+#endif /* NB_WG_RECONCILE_H */
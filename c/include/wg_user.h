@@ -0,0 +1,112 @@
+/**
+ * wg_user.h - Userspace WireGuard datapath over TUN
+ *
+ * Reference: wireguard-go (device/, conn/bind_std.go, tun/tun_linux.go)
+ *
+ * Used by wg_iface.c when the kernel module is missing (or WgBackend is
+ * "userspace"). The device speaks the WireGuard protocol (wg_noise.c), so
+ * it interoperates with kernel WireGuard and wireguard-go peers.
+ *
+ * Threads:
+ * - N workers, each owning one queue of a multiqueue TUN device and one
+ *   UDP socket bound with SO_REUSEPORT to the shared listen port. The
+ *   kernel spreads flows across TUN queues and sockets, so each worker
+ *   encrypts (TUN -> UDP) and decrypts (UDP -> TUN) its own share.
+ * - one timer thread for retransmits, rekeying and keepalives.
+ *
+ * Batching:
+ * - TX reads up to WG_USER_BATCH packets from the TUN queue, encrypts
+ *   them and sends them with one sendmmsg(); runs of equal-sized packets
+ *   to the same endpoint go out as one UDP_SEGMENT (GSO) datagram.
+ * - RX receives with recvmmsg() and UDP_GRO, so one read can return many
+ *   coalesced datagrams of a flow.
+ * The TUN side is still one read()/write() per packet (no vnet header
+ * offloads).
+ *
+ * Peers are configured with the same wg_peer_spec_t batches as the
+ * kernel backends. The private key, MTU (WG_USER_MTU) and workers are
+ * fixed for the lifetime of the device.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#ifndef NB_WG_USER_H
+#define NB_WG_USER_H
+
+#include "wg_iface.h"
+
+#define WG_USER_MTU             1420
+#define WG_USER_MAX_WORKERS     16
+#define WG_USER_BATCH           64      /* TUN packets per TX round */
+#define WG_USER_RX_BATCH        16      /* recvmmsg() entries, up to 64 KB each with GRO */
+#define WG_USER_STAGED_MAX      128     /* Packets queued per peer while handshaking */
+
+typedef struct wg_user wg_user_t;
+
+/**
+ * Datapath counters (sum over workers)
+ */
+typedef struct {
+    uint64_t tx_packets;        /* Data packets encrypted (keepalives included) */
+    uint64_t tx_bytes;          /* Plaintext bytes */
+    uint64_t tx_datagrams;      /* UDP datagrams passed to the kernel */
+    uint64_t tx_gso;            /* ... of which carried several segments */
+    uint64_t tx_syscalls;       /* sendmmsg() calls */
+    uint64_t rx_packets;        /* Data packets decrypted */
+    uint64_t rx_bytes;
+    uint64_t rx_datagrams;      /* recvmmsg() entries */
+    uint64_t rx_gro;            /* ... of which carried several segments */
+    uint64_t rx_syscalls;       /* recvmmsg() calls */
+    uint64_t handshakes;        /* Completed handshakes */
+    uint64_t cookies_sent;      /* Cookie replies sent while under load */
+    uint64_t dropped;           /* Invalid, replayed or unroutable packets */
+} wg_user_stats_t;
+
+/**
+ * Create the TUN device and start the workers
+ *
+ * The interface is created down and without addresses; use rtnetlink
+ * (wg_nl_addr_add / wg_nl_link_set_up) to configure it.
+ *
+ * @param ifname Interface name
+ * @param private_key Raw private key
+ * @param listen_port UDP port, 0 for an ephemeral port
+ * @param workers Worker threads, 0 for one per online CPU
+ * @param dev_out Output device
+ * @return NB_SUCCESS, NB_ERROR_EXISTS if ifname is taken, NB_ERROR_SYSTEM
+ */
+int wg_user_open(const char *ifname, const uint8_t private_key[WG_KEY_LEN],
+                 int listen_port, int workers, wg_user_t **dev_out);
+
+/**
+ * Stop the threads and delete the TUN device
+ */
+void wg_user_close(wg_user_t *dev);
+
+/**
+ * Actual UDP listen port
+ */
+int wg_user_listen_port(const wg_user_t *dev);
+
+/**
+ * Apply peer additions, updates and removals (same semantics as the kernel)
+ *
+ * @param errors Optional per-spec NB_SUCCESS / NB_ERROR_* (count entries)
+ * @return Number of specs that failed
+ */
+int wg_user_apply_peers(wg_user_t *dev, const wg_peer_spec_t *specs, int count, int *errors);
+
+/**
+ * Device state in the same form as the kernel dump
+ *
+ * @param dev_out Output device (free with wg_device_free)
+ */
+int wg_user_get_device(wg_user_t *dev, wg_device_t **dev_out);
+
+/**
+ * Datapath counters
+ */
+void wg_user_get_stats(wg_user_t *dev, wg_user_stats_t *out);
+
+#endif /* NB_WG_USER_H */
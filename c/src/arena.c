@@ -0,0 +1,127 @@
+/**
+ * arena.c - Bump allocator for parsed snapshots
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "arena.h"
+#include "common.h"
+#include <stdint.h>
+#include <stdalign.h>
+
+#define ARENA_ALIGN     alignof(max_align_t)
+#define ALIGN_UP(n)     (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+struct nb_arena_block {
+    nb_arena_block_t *next;
+    size_t size;                /* Usable bytes after the header */
+    size_t used;
+};
+
+/* Start of a block's data, aligned like malloc() memory */
+#define BLOCK_HEADER    ALIGN_UP(sizeof(nb_arena_block_t))
+#define BLOCK_DATA(b)   ((uint8_t *)(b) + BLOCK_HEADER)
+
+void nb_arena_init(nb_arena_t *arena, size_t size_hint) {
+    memset(arena, 0, sizeof(*arena));
+    arena->next_size = size_hint > NB_ARENA_BLOCK_MIN ? ALIGN_UP(size_hint) : NB_ARENA_BLOCK_MIN;
+}
+
+/* Helper: put a new block in front that fits size */
+static nb_arena_block_t* block_new(nb_arena_t *arena, size_t size) {
+    size_t block_size = arena->next_size > size ? arena->next_size : size;
+    if (block_size > SIZE_MAX - BLOCK_HEADER) {
+        return NULL;
+    }
+
+    nb_arena_block_t *b = malloc(BLOCK_HEADER + block_size);
+    if (!b) {
+        NB_LOG_ERROR("malloc failed");
+        return NULL;
+    }
+    b->size = block_size;
+    b->used = 0;
+
+    /* A block for one oversized request leaves the current one in front */
+    if (block_size > arena->next_size && arena->head &&
+        arena->head->size - arena->head->used >= ARENA_ALIGN) {
+        b->next = arena->head->next;
+        arena->head->next = b;
+    } else {
+        b->next = arena->head;
+        arena->head = b;
+        if (arena->next_size < NB_ARENA_BLOCK_MAX) {
+            arena->next_size *= 2;
+        }
+    }
+    arena->reserved += block_size;
+    arena->blocks++;
+    return b;
+}
+
+/* Helper: bump-allocate size bytes at the given alignment (a power of two <= ARENA_ALIGN) */
+static void* arena_take(nb_arena_t *arena, size_t size, size_t align) {
+    nb_arena_block_t *b = arena->head;
+    size_t off = b ? (b->used + align - 1) & ~(align - 1) : 0;
+
+    if (!b || off > b->size || b->size - off < size) {
+        b = block_new(arena, size);
+        if (!b) {
+            return NULL;
+        }
+        off = 0;
+    }
+
+    arena->used += off + size - b->used;
+    b->used = off + size;
+    return BLOCK_DATA(b) + off;
+}
+
+void* nb_arena_alloc(nb_arena_t *arena, size_t size) {
+    if (!arena || size > SIZE_MAX - ARENA_ALIGN) {
+        return NULL;
+    }
+    return arena_take(arena, size ? size : 1, ARENA_ALIGN);
+}
+
+void* nb_arena_calloc(nb_arena_t *arena, size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) {
+        return NULL;
+    }
+
+    void *p = nb_arena_alloc(arena, count * size);
+    if (p) {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+char* nb_arena_strdup(nb_arena_t *arena, const char *s) {
+    if (!s) {
+        return NULL;
+    }
+
+    /* Strings need no alignment and are packed back to back */
+    size_t len = strlen(s) + 1;
+    char *copy = arena ? arena_take(arena, len, 1) : NULL;
+    if (copy) {
+        memcpy(copy, s, len);
+    }
+    return copy;
+}
+
+void nb_arena_free(nb_arena_t *arena) {
+    if (!arena) return;
+
+    nb_arena_block_t *b = arena->head;
+    while (b) {
+        nb_arena_block_t *next = b->next;
+        free(b);
+        b = next;
+    }
+    arena->head = NULL;
+    arena->used = 0;
+    arena->reserved = 0;
+    arena->blocks = 0;
+}
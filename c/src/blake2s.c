@@ -0,0 +1,172 @@
+/**
+ * blake2s.c - BLAKE2s hash (RFC 7693) and HMAC-BLAKE2s
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "blake2s.h"
+#include <string.h>
+
+static const uint32_t blake2s_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint8_t blake2s_sigma[10][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+};
+
+static uint32_t load32_le(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+#define ROTR32(v, n)    (((v) >> (n)) | ((v) << (32 - (n))))
+
+#define G(a, b, c, d, x, y)                     \
+    a = a + b + x; d = ROTR32(d ^ a, 16);       \
+    c = c + d;     b = ROTR32(b ^ c, 12);       \
+    a = a + b + y; d = ROTR32(d ^ a, 8);        \
+    c = c + d;     b = ROTR32(b ^ c, 7)
+
+static void blake2s_compress(blake2s_state_t *s, const uint8_t block[BLAKE2S_BLOCK_LEN],
+                             uint32_t inc, int last) {
+    uint32_t m[16], v[16];
+
+    s->t[0] += inc;
+    s->t[1] += s->t[0] < inc;
+
+    for (int i = 0; i < 16; i++) {
+        m[i] = load32_le(block + 4 * i);
+    }
+    for (int i = 0; i < 8; i++) {
+        v[i] = s->h[i];
+        v[8 + i] = blake2s_iv[i];
+    }
+    v[12] ^= s->t[0];
+    v[13] ^= s->t[1];
+    if (last) {
+        v[14] = ~v[14];
+    }
+
+    for (int r = 0; r < 10; r++) {
+        const uint8_t *sg = blake2s_sigma[r];
+        G(v[0], v[4], v[8],  v[12], m[sg[0]],  m[sg[1]]);
+        G(v[1], v[5], v[9],  v[13], m[sg[2]],  m[sg[3]]);
+        G(v[2], v[6], v[10], v[14], m[sg[4]],  m[sg[5]]);
+        G(v[3], v[7], v[11], v[15], m[sg[6]],  m[sg[7]]);
+        G(v[0], v[5], v[10], v[15], m[sg[8]],  m[sg[9]]);
+        G(v[1], v[6], v[11], v[12], m[sg[10]], m[sg[11]]);
+        G(v[2], v[7], v[8],  v[13], m[sg[12]], m[sg[13]]);
+        G(v[3], v[4], v[9],  v[14], m[sg[14]], m[sg[15]]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        s->h[i] ^= v[i] ^ v[8 + i];
+    }
+}
+
+void blake2s_init(blake2s_state_t *s, size_t outlen) {
+    memset(s, 0, sizeof(*s));
+    memcpy(s->h, blake2s_iv, sizeof(s->h));
+    s->h[0] ^= 0x01010000 | (uint32_t)outlen;
+    s->outlen = outlen;
+}
+
+void blake2s_init_key(blake2s_state_t *s, size_t outlen, const uint8_t *key, size_t key_len) {
+    uint8_t block[BLAKE2S_BLOCK_LEN] = {0};
+
+    blake2s_init(s, outlen);
+    s->h[0] ^= (uint32_t)key_len << 8;
+    memcpy(block, key, key_len);
+    blake2s_update(s, block, sizeof(block));
+    memset(block, 0, sizeof(block));
+}
+
+void blake2s_update(blake2s_state_t *s, const uint8_t *in, size_t len) {
+    if (len == 0) {
+        return;
+    }
+
+    /* The last block is kept back for blake2s_final() */
+    size_t fill = BLAKE2S_BLOCK_LEN - s->buflen;
+    if (len > fill) {
+        memcpy(s->buf + s->buflen, in, fill);
+        blake2s_compress(s, s->buf, BLAKE2S_BLOCK_LEN, 0);
+        s->buflen = 0;
+        in += fill;
+        len -= fill;
+        while (len > BLAKE2S_BLOCK_LEN) {
+            blake2s_compress(s, in, BLAKE2S_BLOCK_LEN, 0);
+            in += BLAKE2S_BLOCK_LEN;
+            len -= BLAKE2S_BLOCK_LEN;
+        }
+    }
+    memcpy(s->buf + s->buflen, in, len);
+    s->buflen += len;
+}
+
+void blake2s_final(blake2s_state_t *s, uint8_t *out) {
+    uint8_t full[BLAKE2S_HASH_LEN];
+
+    memset(s->buf + s->buflen, 0, BLAKE2S_BLOCK_LEN - s->buflen);
+    blake2s_compress(s, s->buf, (uint32_t)s->buflen, 1);
+    for (int i = 0; i < 8; i++) {
+        full[4 * i] = (uint8_t)s->h[i];
+        full[4 * i + 1] = (uint8_t)(s->h[i] >> 8);
+        full[4 * i + 2] = (uint8_t)(s->h[i] >> 16);
+        full[4 * i + 3] = (uint8_t)(s->h[i] >> 24);
+    }
+    memcpy(out, full, s->outlen);
+    memset(full, 0, sizeof(full));
+    memset(s, 0, sizeof(*s));
+}
+
+void blake2s(uint8_t *out, size_t outlen, const uint8_t *in, size_t len,
+             const uint8_t *key, size_t key_len) {
+    blake2s_state_t s;
+
+    if (key && key_len > 0) {
+        blake2s_init_key(&s, outlen, key, key_len);
+    } else {
+        blake2s_init(&s, outlen);
+    }
+    blake2s_update(&s, in, len);
+    blake2s_final(&s, out);
+}
+
+void blake2s_hmac(uint8_t out[BLAKE2S_HASH_LEN], const uint8_t *in, size_t len,
+                  const uint8_t *key, size_t key_len) {
+    uint8_t pad[BLAKE2S_BLOCK_LEN] = {0};
+    uint8_t inner[BLAKE2S_HASH_LEN];
+    blake2s_state_t s;
+
+    memcpy(pad, key, key_len);
+    for (int i = 0; i < BLAKE2S_BLOCK_LEN; i++) {
+        pad[i] ^= 0x36;
+    }
+    blake2s_init(&s, BLAKE2S_HASH_LEN);
+    blake2s_update(&s, pad, sizeof(pad));
+    blake2s_update(&s, in, len);
+    blake2s_final(&s, inner);
+
+    for (int i = 0; i < BLAKE2S_BLOCK_LEN; i++) {
+        pad[i] ^= 0x36 ^ 0x5c;
+    }
+    blake2s_init(&s, BLAKE2S_HASH_LEN);
+    blake2s_update(&s, pad, sizeof(pad));
+    blake2s_update(&s, inner, sizeof(inner));
+    blake2s_final(&s, out);
+
+    memset(pad, 0, sizeof(pad));
+    memset(inner, 0, sizeof(inner));
+}
@@ -0,0 +1,532 @@
+/**
+ * chacha20poly1305.c - ChaCha20-Poly1305 AEAD (RFC 8439) and XChaCha20-Poly1305
+ *
+ * In the AEAD construction Poly1305 only ever sees whole 16-byte blocks
+ * (the associated data and ciphertext are zero padded), so the final
+ * partial-block rule of plain Poly1305 is not needed here.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "chacha20poly1305.h"
+#include "common.h"
+#include <string.h>
+
+static uint32_t load32_le(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void store32_le(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static void store64_le(uint8_t *p, uint64_t v) {
+    store32_le(p, (uint32_t)v);
+    store32_le(p + 4, (uint32_t)(v >> 32));
+}
+
+/* ---- ChaCha20 ---- */
+
+#define ROTL32(v, n)    (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTERROUND(a, b, c, d)                     \
+    a += b; d ^= a; d = ROTL32(d, 16);               \
+    c += d; b ^= c; b = ROTL32(b, 12);               \
+    a += b; d ^= a; d = ROTL32(d, 8);                \
+    c += d; b ^= c; b = ROTL32(b, 7)
+
+#define DOUBLEROUND(x)                                        \
+    QUARTERROUND(x[0], x[4], x[8],  x[12]);                   \
+    QUARTERROUND(x[1], x[5], x[9],  x[13]);                   \
+    QUARTERROUND(x[2], x[6], x[10], x[14]);                   \
+    QUARTERROUND(x[3], x[7], x[11], x[15]);                   \
+    QUARTERROUND(x[0], x[5], x[10], x[15]);                   \
+    QUARTERROUND(x[1], x[6], x[11], x[12]);                   \
+    QUARTERROUND(x[2], x[7], x[8],  x[13]);                   \
+    QUARTERROUND(x[3], x[4], x[9],  x[14])
+
+static void chacha20_init(uint32_t s[16], const uint8_t key[32], const uint8_t nonce[12],
+                          uint32_t counter) {
+    s[0] = 0x61707865;
+    s[1] = 0x3320646e;
+    s[2] = 0x79622d32;
+    s[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) {
+        s[4 + i] = load32_le(key + 4 * i);
+    }
+    s[12] = counter;
+    s[13] = load32_le(nonce);
+    s[14] = load32_le(nonce + 4);
+    s[15] = load32_le(nonce + 8);
+}
+
+static void chacha20_block(const uint32_t s[16], uint8_t out[64]) {
+    uint32_t x[16];
+
+    memcpy(x, s, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        DOUBLEROUND(x);
+    }
+    for (int i = 0; i < 16; i++) {
+        store32_le(out + 4 * i, x[i] + s[i]);
+    }
+}
+
+static void xor_bytes(uint8_t *dst, const uint8_t *src, const uint8_t *ks, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, src + i, 8);
+        memcpy(&b, ks + i, 8);
+        a ^= b;
+        memcpy(dst + i, &a, 8);
+    }
+    for (; i < len; i++) {
+        dst[i] = src[i] ^ ks[i];
+    }
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && !defined(NB_CHACHA20_GENERIC)
+
+/* Four blocks side by side: lane i of every word belongs to block i */
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+
+#define CHACHA20_IMPL   "4-way"
+
+/* XOR 256 bytes with blocks s[12] .. s[12] + 3 */
+static void chacha20_xor4(uint8_t *dst, const uint8_t *src, const uint32_t s[16]) {
+    v4u32 x[16], in[16];
+
+    for (int i = 0; i < 16; i++) {
+        in[i] = (v4u32){ s[i], s[i], s[i], s[i] };
+    }
+    in[12] += (v4u32){ 0, 1, 2, 3 };
+    memcpy(x, in, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        DOUBLEROUND(x);
+    }
+
+    /* Transpose each group of four words so a vector holds 16 bytes of one block */
+    for (int i = 0; i < 16; i += 4) {
+        v4u32 a = x[i] + in[i], b = x[i + 1] + in[i + 1];
+        v4u32 c = x[i + 2] + in[i + 2], d = x[i + 3] + in[i + 3];
+        v4u32 t0 = __builtin_shuffle(a, b, (v4u32){ 0, 4, 1, 5 });
+        v4u32 t1 = __builtin_shuffle(a, b, (v4u32){ 2, 6, 3, 7 });
+        v4u32 t2 = __builtin_shuffle(c, d, (v4u32){ 0, 4, 1, 5 });
+        v4u32 t3 = __builtin_shuffle(c, d, (v4u32){ 2, 6, 3, 7 });
+        v4u32 lanes[4] = {
+            __builtin_shuffle(t0, t2, (v4u32){ 0, 1, 4, 5 }),
+            __builtin_shuffle(t0, t2, (v4u32){ 2, 3, 6, 7 }),
+            __builtin_shuffle(t1, t3, (v4u32){ 0, 1, 4, 5 }),
+            __builtin_shuffle(t1, t3, (v4u32){ 2, 3, 6, 7 }),
+        };
+        for (int lane = 0; lane < 4; lane++) {
+            v4u32 m;
+            size_t off = 64 * lane + 4 * i;
+            memcpy(&m, src + off, 16);
+            m ^= lanes[lane];
+            memcpy(dst + off, &m, 16);
+        }
+    }
+}
+
+#else
+
+#define CHACHA20_IMPL   "1-way"
+
+static void chacha20_xor4(uint8_t *dst, const uint8_t *src, const uint32_t s[16]) {
+    uint32_t t[16];
+    uint8_t ks[64];
+
+    memcpy(t, s, sizeof(t));
+    for (int lane = 0; lane < 4; lane++) {
+        chacha20_block(t, ks);
+        xor_bytes(dst + 64 * lane, src + 64 * lane, ks, 64);
+        t[12]++;
+    }
+    memset(ks, 0, sizeof(ks));
+}
+
+#endif
+
+/* XOR len bytes with the key stream starting at block s[12] */
+static void chacha20_xor(uint8_t *dst, const uint8_t *src, size_t len, uint32_t s[16]) {
+    uint8_t ks[64];
+
+    while (len >= 256) {
+        chacha20_xor4(dst, src, s);
+        s[12] += 4;
+        dst += 256;
+        src += 256;
+        len -= 256;
+    }
+    while (len > 0) {
+        size_t n = len < 64 ? len : 64;
+        chacha20_block(s, ks);
+        xor_bytes(dst, src, ks, n);
+        s[12]++;
+        dst += n;
+        src += n;
+        len -= n;
+    }
+    memset(ks, 0, sizeof(ks));
+}
+
+void hchacha20(uint8_t out[32], const uint8_t nonce[16], const uint8_t key[32]) {
+    uint32_t x[16];
+
+    chacha20_init(x, key, nonce + 4, load32_le(nonce));
+    for (int i = 0; i < 10; i++) {
+        DOUBLEROUND(x);
+    }
+    for (int i = 0; i < 4; i++) {
+        store32_le(out + 4 * i, x[i]);
+        store32_le(out + 16 + 4 * i, x[12 + i]);
+    }
+    memset(x, 0, sizeof(x));
+}
+
+/* ---- Poly1305 ---- */
+
+#if defined(__SIZEOF_INT128__) && !defined(NB_POLY1305_GENERIC)
+
+/* 64-bit path: three 44/44/42-bit limbs */
+
+typedef unsigned __int128 u128;
+
+#define POLY1305_IMPL   "44-bit"
+
+static uint64_t load64_le(const uint8_t *p) {
+    return (uint64_t)load32_le(p) | (uint64_t)load32_le(p + 4) << 32;
+}
+
+#define MASK44  0xfffffffffffULL
+#define MASK42  0x3ffffffffffULL
+
+typedef struct {
+    uint64_t r[3], s[2];
+    uint64_t h[3];
+    uint64_t pad[2];
+} poly1305_t;
+
+static void poly1305_init(poly1305_t *p, const uint8_t key[32]) {
+    uint64_t t0 = load64_le(key), t1 = load64_le(key + 8);
+
+    p->r[0] = t0 & 0xffc0fffffffULL;
+    p->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+    p->r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+    p->s[0] = p->r[1] * (5 << 2);
+    p->s[1] = p->r[2] * (5 << 2);
+    p->h[0] = p->h[1] = p->h[2] = 0;
+    p->pad[0] = load64_le(key + 16);
+    p->pad[1] = load64_le(key + 24);
+}
+
+static void poly1305_blocks(poly1305_t *p, const uint8_t *m, size_t nblocks) {
+    const uint64_t r0 = p->r[0], r1 = p->r[1], r2 = p->r[2];
+    const uint64_t s1 = p->s[0], s2 = p->s[1];
+    uint64_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2];
+
+    while (nblocks--) {
+        uint64_t t0 = load64_le(m), t1 = load64_le(m + 8);
+        uint64_t c;
+
+        h0 += t0 & MASK44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & MASK44;
+        h2 += ((t1 >> 24) & MASK42) | (1ULL << 40);
+
+        u128 d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+        u128 d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+        u128 d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
+
+        c = (uint64_t)(d0 >> 44); h0 = (uint64_t)d0 & MASK44;
+        d1 += c;
+        c = (uint64_t)(d1 >> 44); h1 = (uint64_t)d1 & MASK44;
+        d2 += c;
+        c = (uint64_t)(d2 >> 42); h2 = (uint64_t)d2 & MASK42;
+        h0 += c * 5;
+        c = h0 >> 44; h0 &= MASK44;
+        h1 += c;
+        m += 16;
+    }
+
+    p->h[0] = h0;
+    p->h[1] = h1;
+    p->h[2] = h2;
+}
+
+static void poly1305_finish(poly1305_t *p, uint8_t tag[16]) {
+    uint64_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2];
+    uint64_t c, g0, g1, g2;
+
+    c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c; c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c;
+
+    /* g = h + 5 - 2^130; keep it if it did not go negative (h >= p) */
+    g0 = h0 + 5; c = g0 >> 44; g0 &= MASK44;
+    g1 = h1 + c; c = g1 >> 44; g1 &= MASK44;
+    g2 = h2 + c - (1ULL << 42);
+    c = (g2 >> 63) - 1;
+    h0 = (h0 & ~c) | (g0 & c);
+    h1 = (h1 & ~c) | (g1 & c);
+    h2 = (h2 & ~c) | (g2 & c);
+
+    /* h + pad mod 2^128 */
+    uint64_t t0 = p->pad[0], t1 = p->pad[1];
+    h0 += t0 & MASK44; c = h0 >> 44; h0 &= MASK44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c; c = h1 >> 44; h1 &= MASK44;
+    h2 += ((t1 >> 24) & MASK42) + c; h2 &= MASK42;
+
+    store64_le(tag, h0 | (h1 << 44));
+    store64_le(tag + 8, (h1 >> 20) | (h2 << 24));
+    memset(p, 0, sizeof(*p));
+}
+
+#else
+
+/* Generic path: five 26-bit limbs */
+
+#define POLY1305_IMPL   "26-bit"
+#define MASK26  0x3ffffff
+
+typedef struct {
+    uint32_t r[5], s[4];
+    uint32_t h[5];
+    uint32_t pad[4];
+} poly1305_t;
+
+static void poly1305_init(poly1305_t *p, const uint8_t key[32]) {
+    p->r[0] = load32_le(key) & 0x3ffffff;
+    p->r[1] = (load32_le(key + 3) >> 2) & 0x3ffff03;
+    p->r[2] = (load32_le(key + 6) >> 4) & 0x3ffc0ff;
+    p->r[3] = (load32_le(key + 9) >> 6) & 0x3f03fff;
+    p->r[4] = (load32_le(key + 12) >> 8) & 0x00fffff;
+    for (int i = 0; i < 4; i++) {
+        p->s[i] = p->r[i + 1] * 5;
+        p->pad[i] = load32_le(key + 16 + 4 * i);
+    }
+    memset(p->h, 0, sizeof(p->h));
+}
+
+static void poly1305_blocks(poly1305_t *p, const uint8_t *m, size_t nblocks) {
+    const uint32_t r0 = p->r[0], r1 = p->r[1], r2 = p->r[2], r3 = p->r[3], r4 = p->r[4];
+    const uint32_t s1 = p->s[0], s2 = p->s[1], s3 = p->s[2], s4 = p->s[3];
+    uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3], h4 = p->h[4];
+
+    while (nblocks--) {
+        uint64_t d0, d1, d2, d3, d4;
+        uint32_t c;
+
+        h0 += load32_le(m) & MASK26;
+        h1 += (load32_le(m + 3) >> 2) & MASK26;
+        h2 += (load32_le(m + 6) >> 4) & MASK26;
+        h3 += (load32_le(m + 9) >> 6) & MASK26;
+        h4 += (load32_le(m + 12) >> 8) | (1 << 24);
+
+        d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 +
+             (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+        d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 +
+             (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+        d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 +
+             (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+        d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 +
+             (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+        d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 +
+             (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+        c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & MASK26;
+        d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & MASK26;
+        d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & MASK26;
+        d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & MASK26;
+        d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & MASK26;
+        h0 += c * 5; c = h0 >> 26; h0 &= MASK26;
+        h1 += c;
+        m += 16;
+    }
+
+    p->h[0] = h0; p->h[1] = h1; p->h[2] = h2; p->h[3] = h3; p->h[4] = h4;
+}
+
+static void poly1305_finish(poly1305_t *p, uint8_t tag[16]) {
+    uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3], h4 = p->h[4];
+    uint32_t c, g0, g1, g2, g3, g4, mask;
+    uint64_t f;
+
+    c = h1 >> 26; h1 &= MASK26;
+    h2 += c; c = h2 >> 26; h2 &= MASK26;
+    h3 += c; c = h3 >> 26; h3 &= MASK26;
+    h4 += c; c = h4 >> 26; h4 &= MASK26;
+    h0 += c * 5; c = h0 >> 26; h0 &= MASK26;
+    h1 += c;
+
+    g0 = h0 + 5; c = g0 >> 26; g0 &= MASK26;
+    g1 = h1 + c; c = g1 >> 26; g1 &= MASK26;
+    g2 = h2 + c; c = g2 >> 26; g2 &= MASK26;
+    g3 = h3 + c; c = g3 >> 26; g3 &= MASK26;
+    g4 = h4 + c - (1 << 26);
+
+    mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    h0 = h0 | (h1 << 26);
+    h1 = (h1 >> 6) | (h2 << 20);
+    h2 = (h2 >> 12) | (h3 << 14);
+    h3 = (h3 >> 18) | (h4 << 8);
+
+    f = (uint64_t)h0 + p->pad[0];             h0 = (uint32_t)f;
+    f = (uint64_t)h1 + p->pad[1] + (f >> 32); h1 = (uint32_t)f;
+    f = (uint64_t)h2 + p->pad[2] + (f >> 32); h2 = (uint32_t)f;
+    f = (uint64_t)h3 + p->pad[3] + (f >> 32); h3 = (uint32_t)f;
+
+    store32_le(tag, h0);
+    store32_le(tag + 4, h1);
+    store32_le(tag + 8, h2);
+    store32_le(tag + 12, h3);
+    memset(p, 0, sizeof(*p));
+}
+
+#endif
+
+/* Feed data zero padded to a multiple of 16 bytes */
+static void poly1305_padded(poly1305_t *p, const uint8_t *data, size_t len) {
+    poly1305_blocks(p, data, len / 16);
+    if (len % 16) {
+        uint8_t block[16] = {0};
+        memcpy(block, data + len - len % 16, len % 16);
+        poly1305_blocks(p, block, 1);
+    }
+}
+
+/* Tag over ad || pad || ct || pad || le64(ad_len) || le64(ct_len) */
+static void aead_tag(uint8_t tag[16], const uint32_t s[16], const uint8_t *ad, size_t ad_len,
+                     const uint8_t *ct, size_t ct_len) {
+    uint8_t otk[64], lens[16];
+    poly1305_t p;
+
+    chacha20_block(s, otk);        /* Block counter 0 */
+    poly1305_init(&p, otk);
+    poly1305_padded(&p, ad, ad_len);
+    poly1305_padded(&p, ct, ct_len);
+    store64_le(lens, ad_len);
+    store64_le(lens + 8, ct_len);
+    poly1305_blocks(&p, lens, 1);
+    poly1305_finish(&p, tag);
+    memset(otk, 0, sizeof(otk));
+}
+
+static int tag_equal(const uint8_t a[16], const uint8_t b[16]) {
+    uint8_t d = 0;
+    for (int i = 0; i < 16; i++) {
+        d |= a[i] ^ b[i];
+    }
+    return d == 0;
+}
+
+static void seal(uint8_t *dst, const uint8_t *src, size_t src_len, const uint8_t *ad,
+                 size_t ad_len, const uint8_t nonce[12], const uint8_t key[32]) {
+    uint32_t s[16];
+
+    chacha20_init(s, key, nonce, 1);
+    chacha20_xor(dst, src, src_len, s);
+    s[12] = 0;
+    aead_tag(dst + src_len, s, ad, ad_len, dst, src_len);
+    memset(s, 0, sizeof(s));
+}
+
+static int open_(uint8_t *dst, const uint8_t *src, size_t src_len, const uint8_t *ad,
+                 size_t ad_len, const uint8_t nonce[12], const uint8_t key[32]) {
+    uint32_t s[16];
+    uint8_t tag[16];
+
+    if (src_len < CHACHA20POLY1305_TAG_LEN) {
+        return NB_ERROR_INVALID;
+    }
+    size_t len = src_len - CHACHA20POLY1305_TAG_LEN;
+
+    chacha20_init(s, key, nonce, 0);
+    aead_tag(tag, s, ad, ad_len, src, len);
+    if (!tag_equal(tag, src + len)) {
+        memset(s, 0, sizeof(s));
+        return NB_ERROR_INVALID;
+    }
+    s[12] = 1;
+    chacha20_xor(dst, src, len, s);
+    memset(s, 0, sizeof(s));
+    return NB_SUCCESS;
+}
+
+static void counter_nonce(uint8_t out[12], uint64_t nonce) {
+    memset(out, 0, 4);
+    store64_le(out + 4, nonce);
+}
+
+void chacha20poly1305_encrypt(uint8_t *dst, const uint8_t *src, size_t src_len,
+                              const uint8_t *ad, size_t ad_len, uint64_t nonce,
+                              const uint8_t key[CHACHA20POLY1305_KEY_LEN]) {
+    uint8_t n[12];
+    counter_nonce(n, nonce);
+    seal(dst, src, src_len, ad, ad_len, n, key);
+}
+
+int chacha20poly1305_decrypt(uint8_t *dst, const uint8_t *src, size_t src_len,
+                             const uint8_t *ad, size_t ad_len, uint64_t nonce,
+                             const uint8_t key[CHACHA20POLY1305_KEY_LEN]) {
+    uint8_t n[12];
+    counter_nonce(n, nonce);
+    return open_(dst, src, src_len, ad, ad_len, n, key);
+}
+
+void chacha20poly1305_encrypt_ietf(uint8_t *dst, const uint8_t *src, size_t src_len,
+                                   const uint8_t *ad, size_t ad_len, const uint8_t nonce[12],
+                                   const uint8_t key[CHACHA20POLY1305_KEY_LEN]) {
+    seal(dst, src, src_len, ad, ad_len, nonce, key);
+}
+
+int chacha20poly1305_decrypt_ietf(uint8_t *dst, const uint8_t *src, size_t src_len,
+                                  const uint8_t *ad, size_t ad_len, const uint8_t nonce[12],
+                                  const uint8_t key[CHACHA20POLY1305_KEY_LEN]) {
+    return open_(dst, src, src_len, ad, ad_len, nonce, key);
+}
+
+void xchacha20poly1305_encrypt(uint8_t *dst, const uint8_t *src, size_t src_len,
+                               const uint8_t *ad, size_t ad_len,
+                               const uint8_t nonce[XCHACHA20POLY1305_NONCE_LEN],
+                               const uint8_t key[CHACHA20POLY1305_KEY_LEN]) {
+    uint8_t subkey[32], n[12] = {0};
+
+    hchacha20(subkey, nonce, key);
+    memcpy(n + 4, nonce + 16, 8);
+    seal(dst, src, src_len, ad, ad_len, n, subkey);
+    memset(subkey, 0, sizeof(subkey));
+}
+
+int xchacha20poly1305_decrypt(uint8_t *dst, const uint8_t *src, size_t src_len,
+                              const uint8_t *ad, size_t ad_len,
+                              const uint8_t nonce[XCHACHA20POLY1305_NONCE_LEN],
+                              const uint8_t key[CHACHA20POLY1305_KEY_LEN]) {
+    uint8_t subkey[32], n[12] = {0};
+
+    hchacha20(subkey, nonce, key);
+    memcpy(n + 4, nonce + 16, 8);
+    int ret = open_(dst, src, src_len, ad, ad_len, n, subkey);
+    memset(subkey, 0, sizeof(subkey));
+    return ret;
+}
+
+const char* chacha20poly1305_impl(void) {
+    return CHACHA20_IMPL "/" POLY1305_IMPL;
+}
@@ -53,6 +53,9 @@ int config_new_default(nb_config_t **cfg_out) {
     /* Set defaults */
     cfg->wg_iface_name = nb_strdup("wtnb0");
     cfg->wg_listen_port = 51820;
+    cfg->stats_interval = 10;
+    cfg->lazy_idle_timeout = 900;
+    cfg->route_fwmark = 0x1BD00;
     cfg->config_path = nb_strdup(config_get_default_path());
 
     *cfg_out = cfg;
@@ -96,6 +99,21 @@ static int json_get_int_any(cJSON *obj, const char *key1, const char *key2, int
     return val;
 }
 
+/* Helper: Get bool from JSON object (numbers are accepted as well) */
+static int json_get_bool_any(cJSON *obj, const char *key1, const char *key2, int default_val) {
+    cJSON *item = cJSON_GetObjectItem(obj, key1);
+    if (!item && key2) {
+        item = cJSON_GetObjectItem(obj, key2);
+    }
+    if (item && cJSON_IsBool(item)) {
+        return cJSON_IsTrue(item);
+    }
+    if (item && cJSON_IsNumber(item)) {
+        return item->valueint != 0;
+    }
+    return default_val;
+}
+
 /* Helper: Get string array from JSON object */
 static int json_get_string_array(cJSON *obj, const char *key, char ***arr_out, int *count_out) {
     cJSON *item = cJSON_GetObjectItem(obj, key);
@@ -199,6 +217,33 @@ int config_load(const char *path, nb_config_t **cfg_out) {
     cfg->signal_url = json_get_string_any(root, "SignalURL", "signal_url");
     cfg->admin_url = json_get_string_any(root, "AdminURL", "admin_url");
 
+    /* Load WireGuard backend */
+    cfg->wg_backend = json_get_string_any(root, "WgBackend", "wg_backend");
+    cfg->wg_notrack = json_get_bool_any(root, "WgNoTrack", "wg_notrack", 0);
+
+    /* Load statistics sampler settings */
+    cfg->stats_file = json_get_string_any(root, "StatsFile", "stats_file");
+    cfg->stats_interval = json_get_int_any(root, "StatsInterval", "stats_interval", 10);
+
+    /* Load the helper's peer file */
+    cfg->peers_file = json_get_string_any(root, "PeersFile", "peers_file");
+    cfg->delta_socket = json_get_string_any(root, "DeltaSocket", "delta_socket");
+    cfg->journal_file = json_get_string_any(root, "JournalFile", "journal_file");
+
+    /* Load lazy peer settings */
+    cfg->lazy_peers = json_get_bool_any(root, "LazyPeers", "lazy_peers", 0);
+    cfg->lazy_idle_timeout = json_get_int_any(root, "LazyIdleTimeout", "lazy_idle_timeout", 900);
+
+    /* Load policy routing settings */
+    cfg->route_table = json_get_int_any(root, "RouteTable", "route_table", 0);
+    cfg->route_fwmark = json_get_int_any(root, "RouteFwmark", "route_fwmark", 0x1BD00);
+    if (json_get_string_array(root, "RouteOffloadDevices",
+                              &cfg->route_offload_devices,
+                              &cfg->route_offload_devices_count) != NB_SUCCESS) {
+        cfg->route_offload_devices = NULL;
+        cfg->route_offload_devices_count = 0;
+    }
+
     /* Load interface name */
     cfg->wg_iface_name = json_get_string_any(root, "WgIfaceName", "wg_iface_name");
     if (!cfg->wg_iface_name) {
@@ -276,6 +321,46 @@ int config_save(const char *path, const nb_config_t *cfg) {
         cJSON_AddStringToObject(root, "WgIfaceName", cfg->wg_iface_name);
     }
 
+    /* WireGuard backend */
+    if (cfg->wg_backend) {
+        cJSON_AddStringToObject(root, "WgBackend", cfg->wg_backend);
+    }
+    cJSON_AddBoolToObject(root, "WgNoTrack", cfg->wg_notrack);
+
+    /* Statistics sampler */
+    if (cfg->stats_file) {
+        cJSON_AddStringToObject(root, "StatsFile", cfg->stats_file);
+    }
+    cJSON_AddNumberToObject(root, "StatsInterval", cfg->stats_interval);
+
+    /* Helper's peer file */
+    if (cfg->peers_file) {
+        cJSON_AddStringToObject(root, "PeersFile", cfg->peers_file);
+    }
+    if (cfg->delta_socket) {
+        cJSON_AddStringToObject(root, "DeltaSocket", cfg->delta_socket);
+    }
+    if (cfg->journal_file) {
+        cJSON_AddStringToObject(root, "JournalFile", cfg->journal_file);
+    }
+
+    /* Lazy peers */
+    cJSON_AddBoolToObject(root, "LazyPeers", cfg->lazy_peers);
+    cJSON_AddNumberToObject(root, "LazyIdleTimeout", cfg->lazy_idle_timeout);
+
+    /* Policy routing */
+    cJSON_AddNumberToObject(root, "RouteTable", cfg->route_table);
+    cJSON_AddNumberToObject(root, "RouteFwmark", cfg->route_fwmark);
+    if (cfg->route_offload_devices && cfg->route_offload_devices_count > 0) {
+        cJSON *devices = cJSON_CreateArray();
+        for (int i = 0; i < cfg->route_offload_devices_count; i++) {
+            if (cfg->route_offload_devices[i]) {
+                cJSON_AddItemToArray(devices, cJSON_CreateString(cfg->route_offload_devices[i]));
+            }
+        }
+        cJSON_AddItemToObject(root, "RouteOffloadDevices", devices);
+    }
+
     /* Peer ID */
     if (cfg->peer_id) {
         cJSON_AddStringToObject(root, "PeerID", cfg->peer_id);
@@ -339,6 +424,11 @@ void config_free(nb_config_t *cfg) {
     free(cfg->wg_iface_name);
     free(cfg->wg_address);
     free(cfg->preshared_key);
+    free(cfg->wg_backend);
+    free(cfg->stats_file);
+    free(cfg->peers_file);
+    free(cfg->delta_socket);
+    free(cfg->journal_file);
     free(cfg->management_url);
     free(cfg->signal_url);
     free(cfg->admin_url);
@@ -347,6 +437,7 @@ void config_free(nb_config_t *cfg) {
     free(cfg->config_path);
 
     nb_free_string_array(cfg->nat_external_ips, cfg->nat_external_ips_count);
+    nb_free_string_array(cfg->route_offload_devices, cfg->route_offload_devices_count);
 
     free(cfg);
 }
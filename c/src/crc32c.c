@@ -0,0 +1,65 @@
+/**
+ * crc32c.c - CRC-32C (Castagnoli) checksum
+ *
+ * Table driven, eight bytes per step (slicing-by-8).
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "crc32c.h"
+#include <pthread.h>
+#include <string.h>
+
+#define CRC32C_POLY     0x82F63B78u     /* Reversed 0x1EDC6F41 */
+
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void table_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c >> 1) ^ (CRC32C_POLY & -(c & 1));
+        }
+        crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            crc_table[t][i] = (crc_table[t - 1][i] >> 8) ^ crc_table[0][crc_table[t - 1][i] & 0xff];
+        }
+    }
+}
+
+uint32_t nb_crc32c(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+
+    pthread_once(&crc_once, table_init);
+    crc = ~crc;
+
+    while (len && ((uintptr_t)p & 7)) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xff];
+        len--;
+    }
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+              crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+              crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xff];
+    }
+
+    return ~crc;
+}
@@ -0,0 +1,402 @@
+/**
+ * curve25519.c - X25519 scalar multiplication (RFC 7748)
+ *
+ * Montgomery ladder over GF(2^255 - 19). Both field implementations avoid
+ * secret dependent branches and memory accesses; conditional swaps are
+ * done with masks.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "curve25519.h"
+#include <string.h>
+
+#if defined(__SIZEOF_INT128__) && !defined(NB_CURVE25519_GENERIC)
+
+/* ---- 64-bit path: five 51-bit limbs ---- */
+
+typedef unsigned __int128 u128;
+typedef uint64_t fe[5];
+
+#define MASK51 ((UINT64_C(1) << 51) - 1)
+
+static uint64_t load64_le(const uint8_t *p) {
+    return (uint64_t)p[0]         | (uint64_t)p[1] << 8  |
+           (uint64_t)p[2] << 16   | (uint64_t)p[3] << 24 |
+           (uint64_t)p[4] << 32   | (uint64_t)p[5] << 40 |
+           (uint64_t)p[6] << 48   | (uint64_t)p[7] << 56;
+}
+
+static void store64_le(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static void fe_frombytes(fe h, const uint8_t s[32]) {
+    h[0] = load64_le(s) & MASK51;
+    h[1] = (load64_le(s + 6) >> 3) & MASK51;
+    h[2] = (load64_le(s + 12) >> 6) & MASK51;
+    h[3] = (load64_le(s + 19) >> 1) & MASK51;
+    h[4] = (load64_le(s + 24) >> 12) & MASK51;   /* Top bit ignored */
+}
+
+static void fe_tobytes(uint8_t s[32], const fe f) {
+    uint64_t t[5] = { f[0], f[1], f[2], f[3], f[4] };
+    uint64_t q;
+
+    /* Two carry passes bring every limb below 2^51 (value < 2^255 + small) */
+    for (int pass = 0; pass < 2; pass++) {
+        t[1] += t[0] >> 51; t[0] &= MASK51;
+        t[2] += t[1] >> 51; t[1] &= MASK51;
+        t[3] += t[2] >> 51; t[2] &= MASK51;
+        t[4] += t[3] >> 51; t[3] &= MASK51;
+        t[0] += 19 * (t[4] >> 51); t[4] &= MASK51;
+    }
+
+    /* q = 1 iff t >= p; then t + 19q drops 2^255 */
+    q = (t[0] + 19) >> 51;
+    q = (t[1] + q) >> 51;
+    q = (t[2] + q) >> 51;
+    q = (t[3] + q) >> 51;
+    q = (t[4] + q) >> 51;
+
+    t[0] += 19 * q;
+    t[1] += t[0] >> 51; t[0] &= MASK51;
+    t[2] += t[1] >> 51; t[1] &= MASK51;
+    t[3] += t[2] >> 51; t[2] &= MASK51;
+    t[4] += t[3] >> 51; t[3] &= MASK51;
+    t[4] &= MASK51;
+
+    store64_le(s,      t[0]       | t[1] << 51);
+    store64_le(s + 8,  t[1] >> 13 | t[2] << 38);
+    store64_le(s + 16, t[2] >> 26 | t[3] << 25);
+    store64_le(s + 24, t[3] >> 39 | t[4] << 12);
+}
+
+static void fe_0(fe h) { h[0] = h[1] = h[2] = h[3] = h[4] = 0; }
+static void fe_1(fe h) { fe_0(h); h[0] = 1; }
+static void fe_copy(fe h, const fe f) { memcpy(h, f, sizeof(fe)); }
+
+static void fe_add(fe h, const fe f, const fe g) {
+    for (int i = 0; i < 5; i++) h[i] = f[i] + g[i];
+}
+
+/* h = f - g; adds 4p so limbs stay positive for g limbs below 2^53 */
+static void fe_sub(fe h, const fe f, const fe g) {
+    h[0] = f[0] + UINT64_C(0x1FFFFFFFFFFFB4) - g[0];
+    h[1] = f[1] + UINT64_C(0x1FFFFFFFFFFFFC) - g[1];
+    h[2] = f[2] + UINT64_C(0x1FFFFFFFFFFFFC) - g[2];
+    h[3] = f[3] + UINT64_C(0x1FFFFFFFFFFFFC) - g[3];
+    h[4] = f[4] + UINT64_C(0x1FFFFFFFFFFFFC) - g[4];
+}
+
+/* Carry 128-bit limb products back into 51-bit limbs */
+static void fe_carry_wide(fe h, u128 r0, u128 r1, u128 r2, u128 r3, u128 r4) {
+    uint64_t c;
+
+    r1 += (uint64_t)(r0 >> 51); h[0] = (uint64_t)r0 & MASK51;
+    r2 += (uint64_t)(r1 >> 51); h[1] = (uint64_t)r1 & MASK51;
+    r3 += (uint64_t)(r2 >> 51); h[2] = (uint64_t)r2 & MASK51;
+    r4 += (uint64_t)(r3 >> 51); h[3] = (uint64_t)r3 & MASK51;
+    c = (uint64_t)(r4 >> 51);   h[4] = (uint64_t)r4 & MASK51;
+
+    h[0] += c * 19;
+    h[1] += h[0] >> 51;
+    h[0] &= MASK51;
+}
+
+static void fe_mul(fe h, const fe f, const fe g) {
+    uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+    uint64_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+    uint64_t g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3, g4_19 = 19 * g4;
+
+    u128 r0 = (u128)f0 * g0 + (u128)f1 * g4_19 + (u128)f2 * g3_19 + (u128)f3 * g2_19 + (u128)f4 * g1_19;
+    u128 r1 = (u128)f0 * g1 + (u128)f1 * g0    + (u128)f2 * g4_19 + (u128)f3 * g3_19 + (u128)f4 * g2_19;
+    u128 r2 = (u128)f0 * g2 + (u128)f1 * g1    + (u128)f2 * g0    + (u128)f3 * g4_19 + (u128)f4 * g3_19;
+    u128 r3 = (u128)f0 * g3 + (u128)f1 * g2    + (u128)f2 * g1    + (u128)f3 * g0    + (u128)f4 * g4_19;
+    u128 r4 = (u128)f0 * g4 + (u128)f1 * g3    + (u128)f2 * g2    + (u128)f3 * g1    + (u128)f4 * g0;
+
+    fe_carry_wide(h, r0, r1, r2, r3, r4);
+}
+
+static void fe_sq(fe h, const fe f) {
+    uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+    uint64_t f0_2 = 2 * f0, f1_2 = 2 * f1;
+    uint64_t f3_19 = 19 * f3, f4_19 = 19 * f4;
+
+    u128 r0 = (u128)f0 * f0   + (u128)(2 * f1) * f4_19 + (u128)(2 * f2) * f3_19;
+    u128 r1 = (u128)f0_2 * f1 + (u128)(2 * f2) * f4_19 + (u128)f3 * f3_19;
+    u128 r2 = (u128)f0_2 * f2 + (u128)f1 * f1          + (u128)(2 * f3) * f4_19;
+    u128 r3 = (u128)f0_2 * f3 + (u128)f1_2 * f2        + (u128)f4 * f4_19;
+    u128 r4 = (u128)f0_2 * f4 + (u128)f1_2 * f3        + (u128)f2 * f2;
+
+    fe_carry_wide(h, r0, r1, r2, r3, r4);
+}
+
+/* h = f * 121665 (a24 for the ladder) */
+static void fe_mul_a24(fe h, const fe f) {
+    fe_carry_wide(h, (u128)f[0] * 121665, (u128)f[1] * 121665, (u128)f[2] * 121665,
+                  (u128)f[3] * 121665, (u128)f[4] * 121665);
+}
+
+static void fe_cswap(fe f, fe g, uint64_t b) {
+    uint64_t mask = 0 - b;
+    for (int i = 0; i < 5; i++) {
+        uint64_t x = mask & (f[i] ^ g[i]);
+        f[i] ^= x;
+        g[i] ^= x;
+    }
+}
+
+static void fe_sqn(fe h, const fe f, int n) {
+    fe_sq(h, f);
+    while (--n > 0) fe_sq(h, h);
+}
+
+/* h = z^(p-2) */
+static void fe_invert(fe h, const fe z) {
+    fe z2, z9, z11, z2_5_0, z2_10_0, z2_20_0, z2_50_0, z2_100_0, t;
+
+    fe_sq(z2, z);
+    fe_sqn(t, z2, 2);
+    fe_mul(z9, t, z);
+    fe_mul(z11, z9, z2);
+    fe_sq(t, z11);
+    fe_mul(z2_5_0, t, z9);
+    fe_sqn(t, z2_5_0, 5);
+    fe_mul(z2_10_0, t, z2_5_0);
+    fe_sqn(t, z2_10_0, 10);
+    fe_mul(z2_20_0, t, z2_10_0);
+    fe_sqn(t, z2_20_0, 20);
+    fe_mul(t, t, z2_20_0);
+    fe_sqn(t, t, 10);
+    fe_mul(z2_50_0, t, z2_10_0);
+    fe_sqn(t, z2_50_0, 50);
+    fe_mul(z2_100_0, t, z2_50_0);
+    fe_sqn(t, z2_100_0, 100);
+    fe_mul(t, t, z2_100_0);
+    fe_sqn(t, t, 50);
+    fe_mul(t, t, z2_50_0);
+    fe_sqn(t, t, 5);
+    fe_mul(h, t, z11);
+}
+
+static void scalarmult(uint8_t out[32], const uint8_t e[32], const uint8_t point[32]) {
+    fe x1, x2, z2, x3, z3, a, b, aa, bb, ee, c, d, da, cb;
+    uint64_t swap = 0;
+
+    fe_frombytes(x1, point);
+    fe_1(x2);
+    fe_0(z2);
+    fe_copy(x3, x1);
+    fe_1(z3);
+
+    for (int pos = 254; pos >= 0; pos--) {
+        uint64_t bit = (e[pos >> 3] >> (pos & 7)) & 1;
+        swap ^= bit;
+        fe_cswap(x2, x3, swap);
+        fe_cswap(z2, z3, swap);
+        swap = bit;
+
+        fe_add(a, x2, z2);
+        fe_sq(aa, a);
+        fe_sub(b, x2, z2);
+        fe_sq(bb, b);
+        fe_sub(ee, aa, bb);
+        fe_add(c, x3, z3);
+        fe_sub(d, x3, z3);
+        fe_mul(da, d, a);
+        fe_mul(cb, c, b);
+
+        fe_add(x3, da, cb);
+        fe_sq(x3, x3);
+        fe_sub(z3, da, cb);
+        fe_sq(z3, z3);
+        fe_mul(z3, z3, x1);
+
+        fe_mul(x2, aa, bb);
+        fe_mul_a24(z2, ee);
+        fe_add(z2, z2, aa);
+        fe_mul(z2, z2, ee);
+    }
+    fe_cswap(x2, x3, swap);
+    fe_cswap(z2, z3, swap);
+
+    fe_invert(z2, z2);
+    fe_mul(x2, x2, z2);
+    fe_tobytes(out, x2);
+}
+
+const char* curve25519_impl(void) {
+    return "64-bit";
+}
+
+#else
+
+/* ---- Generic path: sixteen 16-bit limbs in int64_t ---- */
+
+typedef int64_t gf[16];
+
+static const gf gf_121665 = { 0xDB41, 1 };
+
+static void car25519(gf o) {
+    for (int i = 0; i < 16; i++) {
+        o[i] += (int64_t)1 << 16;
+        int64_t c = o[i] >> 16;
+        o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+        o[i] -= c * ((int64_t)1 << 16);
+    }
+}
+
+static void sel25519(gf p, gf q, int b) {
+    int64_t mask = ~((int64_t)b - 1);
+    for (int i = 0; i < 16; i++) {
+        int64_t t = mask & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void pack25519(uint8_t o[32], const gf n) {
+    gf m, t;
+    memcpy(t, n, sizeof(gf));
+    car25519(t);
+    car25519(t);
+    car25519(t);
+
+    for (int j = 0; j < 2; j++) {
+        m[0] = t[0] - 0xffed;
+        for (int i = 1; i < 15; i++) {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        int b = (int)((m[15] >> 16) & 1);
+        m[14] &= 0xffff;
+        sel25519(t, m, 1 - b);
+    }
+    for (int i = 0; i < 16; i++) {
+        o[2 * i] = (uint8_t)(t[i] & 0xff);
+        o[2 * i + 1] = (uint8_t)(t[i] >> 8);
+    }
+}
+
+static void unpack25519(gf o, const uint8_t n[32]) {
+    for (int i = 0; i < 16; i++) {
+        o[i] = n[2 * i] + ((int64_t)n[2 * i + 1] << 8);
+    }
+    o[15] &= 0x7fff;
+}
+
+static void gf_add(gf o, const gf a, const gf b) {
+    for (int i = 0; i < 16; i++) o[i] = a[i] + b[i];
+}
+
+static void gf_sub(gf o, const gf a, const gf b) {
+    for (int i = 0; i < 16; i++) o[i] = a[i] - b[i];
+}
+
+static void gf_mul(gf o, const gf a, const gf b) {
+    int64_t t[31] = {0};
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 16; j++) {
+            t[i + j] += a[i] * b[j];
+        }
+    }
+    for (int i = 0; i < 15; i++) {
+        t[i] += 38 * t[i + 16];
+    }
+    memcpy(o, t, sizeof(gf));
+    car25519(o);
+    car25519(o);
+}
+
+static void gf_sq(gf o, const gf a) {
+    gf_mul(o, a, a);
+}
+
+static void inv25519(gf o, const gf in) {
+    gf c;
+    memcpy(c, in, sizeof(gf));
+    for (int a = 253; a >= 0; a--) {
+        gf_sq(c, c);
+        if (a != 2 && a != 4) {
+            gf_mul(c, c, in);
+        }
+    }
+    memcpy(o, c, sizeof(gf));
+}
+
+static void scalarmult(uint8_t out[32], const uint8_t z[32], const uint8_t point[32]) {
+    gf x, a, b, c, d, e, f;
+
+    unpack25519(x, point);
+    memcpy(b, x, sizeof(gf));
+    memset(a, 0, sizeof(gf));
+    memset(c, 0, sizeof(gf));
+    memset(d, 0, sizeof(gf));
+    a[0] = d[0] = 1;
+
+    for (int i = 254; i >= 0; i--) {
+        int r = (z[i >> 3] >> (i & 7)) & 1;
+        sel25519(a, b, r);
+        sel25519(c, d, r);
+        gf_add(e, a, c);
+        gf_sub(a, a, c);
+        gf_add(c, b, d);
+        gf_sub(b, b, d);
+        gf_sq(d, e);
+        gf_sq(f, a);
+        gf_mul(a, c, a);
+        gf_mul(c, b, e);
+        gf_add(e, a, c);
+        gf_sub(a, a, c);
+        gf_sq(b, a);
+        gf_sub(c, d, f);
+        gf_mul(a, c, gf_121665);
+        gf_add(a, a, d);
+        gf_mul(c, c, a);
+        gf_mul(a, d, f);
+        gf_mul(d, b, x);
+        gf_sq(b, e);
+        sel25519(a, b, r);
+        sel25519(c, d, r);
+    }
+
+    inv25519(c, c);
+    gf_mul(a, a, c);
+    pack25519(out, a);
+}
+
+const char* curve25519_impl(void) {
+    return "generic";
+}
+
+#endif
+
+void curve25519_clamp_secret(uint8_t secret[CURVE25519_KEY_LEN]) {
+    secret[0] &= 248;
+    secret[31] = (secret[31] & 127) | 64;
+}
+
+void curve25519(uint8_t out[CURVE25519_KEY_LEN],
+                const uint8_t scalar[CURVE25519_KEY_LEN],
+                const uint8_t point[CURVE25519_KEY_LEN]) {
+    uint8_t e[CURVE25519_KEY_LEN];
+
+    memcpy(e, scalar, sizeof(e));
+    curve25519_clamp_secret(e);
+    scalarmult(out, e, point);
+
+    /* Do not leave the scalar on the stack */
+    memset(e, 0, sizeof(e));
+    __asm__ __volatile__("" : : "r"(e) : "memory");
+}
+
+void curve25519_generate_public(uint8_t pub[CURVE25519_KEY_LEN],
+                                const uint8_t secret[CURVE25519_KEY_LEN]) {
+    static const uint8_t basepoint[CURVE25519_KEY_LEN] = { 9 };
+    curve25519(pub, secret, basepoint);
+}
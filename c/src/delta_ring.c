@@ -0,0 +1,346 @@
+/**
+ * delta_ring.c - Shared-memory delta channel implementation
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#define _GNU_SOURCE
+#include "delta_ring.h"
+#include "common.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "delta rings are little endian");
+_Static_assert(sizeof(nb_delta_header_t) == 256, "delta ring header layout");
+_Static_assert(sizeof(nb_delta_record_t) == 16, "delta record layout");
+_Static_assert(sizeof(nb_delta_route_t) == 24, "delta route layout");
+
+#define DELTA_MAX_SIZE  ((size_t)1 << 30)
+
+struct nb_delta_ring {
+    nb_delta_header_t *hdr;
+    uint8_t *data;
+    uint64_t capacity;
+    uint64_t mask;
+    void *map;
+    size_t map_size;
+    int memfd;
+    int efd;
+
+    /* Producer: end of the reserved records and their last sequence number */
+    uint64_t wpos;
+    uint64_t wseq;
+
+    /* Consumer: end of the records returned by next() and the last sequence number */
+    uint64_t rpos;
+    uint64_t rseq;
+};
+
+/* Hello sent with the descriptors */
+typedef struct {
+    char magic[8];
+    uint64_t map_size;
+} delta_hello_t;
+
+static int ring_map(nb_delta_ring_t *ring, size_t map_size) {
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->memfd, 0);
+    if (map == MAP_FAILED) {
+        NB_LOG_ERROR("mmap delta ring failed: %s", strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+    ring->map = map;
+    ring->map_size = map_size;
+    ring->hdr = map;
+    ring->data = (uint8_t *)map + sizeof(nb_delta_header_t);
+    return NB_SUCCESS;
+}
+
+int nb_delta_ring_create(size_t capacity, nb_delta_ring_t **ring_out) {
+    if (!ring_out || capacity > DELTA_MAX_SIZE) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+    *ring_out = NULL;
+
+    size_t cap = 4096;
+    while (cap < (capacity ? capacity : NB_DELTA_DEFAULT_SIZE)) {
+        cap <<= 1;
+    }
+
+    nb_delta_ring_t *ring = calloc(1, sizeof(nb_delta_ring_t));
+    if (!ring) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    ring->efd = -1;
+    ring->memfd = memfd_create("netbird-delta", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    size_t map_size = sizeof(nb_delta_header_t) + cap;
+    if (ring->memfd < 0 || ftruncate(ring->memfd, (off_t)map_size) < 0) {
+        NB_LOG_ERROR("Cannot create delta ring: %s", strerror(errno));
+        nb_delta_ring_close(ring);
+        return NB_ERROR_SYSTEM;
+    }
+
+    /* The producer must not be able to shrink the mapping under us */
+    fcntl(ring->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    ring->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ring->efd < 0) {
+        NB_LOG_ERROR("eventfd failed: %s", strerror(errno));
+        nb_delta_ring_close(ring);
+        return NB_ERROR_SYSTEM;
+    }
+    if (ring_map(ring, map_size) != NB_SUCCESS) {
+        nb_delta_ring_close(ring);
+        return NB_ERROR_SYSTEM;
+    }
+
+    memcpy(ring->hdr->magic, NB_DELTA_MAGIC, sizeof(ring->hdr->magic));
+    ring->hdr->version = NB_DELTA_VERSION;
+    ring->hdr->header_size = sizeof(nb_delta_header_t);
+    ring->hdr->capacity = cap;
+    ring->capacity = cap;
+    ring->mask = cap - 1;
+
+    *ring_out = ring;
+    return NB_SUCCESS;
+}
+
+int nb_delta_ring_send(const nb_delta_ring_t *ring, int sock) {
+    if (!ring || sock < 0) {
+        return NB_ERROR_INVALID;
+    }
+
+    delta_hello_t hello = { .map_size = ring->map_size };
+    memcpy(hello.magic, NB_DELTA_MAGIC, sizeof(hello.magic));
+    int fds[2] = { ring->memfd, ring->efd };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = ctrl.buf,
+        .msg_controllen = sizeof(ctrl.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(hello)) {
+        NB_LOG_ERROR("Cannot send delta ring: %s", strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+    return NB_SUCCESS;
+}
+
+int nb_delta_ring_recv(int sock, nb_delta_ring_t **ring_out) {
+    if (sock < 0 || !ring_out) {
+        return NB_ERROR_INVALID;
+    }
+    *ring_out = NULL;
+
+    delta_hello_t hello;
+    int fds[2] = { -1, -1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } ctrl;
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = ctrl.buf,
+        .msg_controllen = sizeof(ctrl.buf),
+    };
+
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    struct cmsghdr *cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    }
+    if (n < 0) {
+        NB_LOG_ERROR("Cannot receive delta ring: %s", strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+
+    nb_delta_ring_t *ring = calloc(1, sizeof(nb_delta_ring_t));
+    if (!ring) {
+        close(fds[0]);
+        close(fds[1]);
+        return NB_ERROR_SYSTEM;
+    }
+    ring->memfd = fds[0];
+    ring->efd = fds[1];
+
+    struct stat st;
+    if (n != (ssize_t)sizeof(hello) || fds[0] < 0 || fds[1] < 0 ||
+        memcmp(hello.magic, NB_DELTA_MAGIC, sizeof(hello.magic)) != 0 ||
+        fstat(ring->memfd, &st) < 0 || (uint64_t)st.st_size != hello.map_size ||
+        hello.map_size <= sizeof(nb_delta_header_t)) {
+        NB_LOG_ERROR("Not a delta ring");
+        nb_delta_ring_close(ring);
+        return NB_ERROR_INVALID;
+    }
+    if (ring_map(ring, hello.map_size) != NB_SUCCESS) {
+        nb_delta_ring_close(ring);
+        return NB_ERROR_SYSTEM;
+    }
+
+    const nb_delta_header_t *hdr = ring->hdr;
+    uint64_t cap = hdr->capacity;
+    if (memcmp(hdr->magic, NB_DELTA_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != NB_DELTA_VERSION ||
+        hdr->header_size != sizeof(nb_delta_header_t) || cap == 0 || (cap & (cap - 1)) != 0 ||
+        cap != hello.map_size - sizeof(nb_delta_header_t)) {
+        NB_LOG_ERROR("Unsupported delta ring (version %u)", hdr->version);
+        nb_delta_ring_close(ring);
+        return NB_ERROR_INVALID;
+    }
+    ring->capacity = cap;
+    ring->mask = cap - 1;
+    ring->wpos = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+    ring->wseq = hdr->seq;
+
+    *ring_out = ring;
+    return NB_SUCCESS;
+}
+
+void nb_delta_ring_close(nb_delta_ring_t *ring) {
+    if (!ring) return;
+
+    if (ring->map) {
+        munmap(ring->map, ring->map_size);
+    }
+    if (ring->memfd >= 0) {
+        close(ring->memfd);
+    }
+    if (ring->efd >= 0) {
+        close(ring->efd);
+    }
+    free(ring);
+}
+
+int nb_delta_ring_eventfd(const nb_delta_ring_t *ring) {
+    return ring ? ring->efd : -1;
+}
+
+const nb_delta_header_t* nb_delta_ring_header(const nb_delta_ring_t *ring) {
+    return ring ? ring->hdr : NULL;
+}
+
+void* nb_delta_ring_reserve(nb_delta_ring_t *ring, uint16_t type, size_t len) {
+    if (!ring || len > ring->capacity) {
+        return NULL;
+    }
+
+    uint64_t size = (sizeof(nb_delta_record_t) + len + NB_DELTA_ALIGN - 1) & ~(uint64_t)(NB_DELTA_ALIGN - 1);
+    uint64_t off = ring->wpos & ring->mask;
+    uint64_t pad = off + size > ring->capacity ? ring->capacity - off : 0;
+    uint64_t tail = __atomic_load_n(&ring->hdr->tail, __ATOMIC_ACQUIRE);
+    if (pad + size > ring->capacity - (ring->wpos - tail)) {
+        return NULL;
+    }
+
+    if (pad) {
+        nb_delta_record_t *p = (nb_delta_record_t *)(ring->data + off);
+        p->size = (uint32_t)pad;
+        p->type = NB_DELTA_PAD;
+        p->flags = 0;
+        p->seq = 0;
+        ring->wpos += pad;
+        off = 0;
+    }
+
+    nb_delta_record_t *rec = (nb_delta_record_t *)(ring->data + off);
+    rec->size = (uint32_t)size;
+    rec->type = type;
+    rec->flags = 0;
+    rec->seq = ++ring->wseq;
+    memset(rec + 1, 0, size - sizeof(*rec));
+    ring->wpos += size;
+    return rec + 1;
+}
+
+int nb_delta_ring_publish(nb_delta_ring_t *ring) {
+    if (!ring) {
+        return NB_ERROR_INVALID;
+    }
+
+    nb_delta_header_t *hdr = ring->hdr;
+    __atomic_store_n(&hdr->seq, ring->wseq, __ATOMIC_RELAXED);
+    __atomic_store_n(&hdr->head, ring->wpos, __ATOMIC_SEQ_CST);
+
+    /* Pairs with the consumer's store of waiting and load of head */
+    if (__atomic_exchange_n(&hdr->waiting, 0, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        if (write(ring->efd, &one, sizeof(one)) != sizeof(one)) {
+            return NB_ERROR_SYSTEM;
+        }
+    }
+    return NB_SUCCESS;
+}
+
+int nb_delta_ring_next(nb_delta_ring_t *ring, nb_delta_record_t *rec_out, const void **payload_out) {
+    uint64_t head = __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE);
+
+    while (ring->rpos != head) {
+        uint64_t avail = head - ring->rpos;
+        uint64_t off = ring->rpos & ring->mask;
+        const nb_delta_record_t *rec = (const nb_delta_record_t *)(ring->data + off);
+
+        /* The producer is not trusted: read the header once, then check only the copy */
+        nb_delta_record_t h = {
+            .size = __atomic_load_n(&rec->size, __ATOMIC_RELAXED),
+            .type = __atomic_load_n(&rec->type, __ATOMIC_RELAXED),
+            .seq = __atomic_load_n(&rec->seq, __ATOMIC_RELAXED),
+        };
+        if (avail > ring->capacity || avail < sizeof(h) ||
+            h.size < sizeof(h) || h.size % NB_DELTA_ALIGN != 0 ||
+            h.size > avail || off + h.size > ring->capacity) {
+            NB_LOG_ERROR("Corrupt delta ring at %llu", (unsigned long long)ring->rpos);
+            return NB_ERROR_INVALID;
+        }
+        ring->rpos += h.size;
+        if (h.type == NB_DELTA_PAD) {
+            continue;
+        }
+        if (h.seq != ring->rseq + 1) {
+            NB_LOG_ERROR("Delta record %llu follows %llu", (unsigned long long)h.seq,
+                         (unsigned long long)ring->rseq);
+            return NB_ERROR_INVALID;
+        }
+        ring->rseq = h.seq;
+        *rec_out = h;
+        *payload_out = rec + 1;
+        return 1;
+    }
+    return 0;
+}
+
+void nb_delta_ring_release(nb_delta_ring_t *ring) {
+    __atomic_store_n(&ring->hdr->tail, ring->rpos, __ATOMIC_RELEASE);
+}
+
+int nb_delta_ring_sleep(nb_delta_ring_t *ring) {
+    uint64_t count;
+    while (read(ring->efd, &count, sizeof(count)) == sizeof(count)) {
+    }
+
+    __atomic_store_n(&ring->hdr->waiting, 1, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&ring->hdr->head, __ATOMIC_SEQ_CST) != ring->rpos;
+}
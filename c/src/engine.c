@@ -7,8 +7,93 @@
  * Date: 2025-11-30
  */
 
+#define _GNU_SOURCE
 #include "engine.h"
 #include "common.h"
+#include "wg_key.h"
+#include "ipaddr.h"
+#include "wg_reconcile.h"
+#include "route_agg.h"
+#include <time.h>
+#include <libgen.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+static int64_t clock_ms(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Open the statistics ring; sampling is optional, so failures only warn */
+static void stats_start(nb_engine_t *engine) {
+    char path[512];
+
+    if (engine->config->stats_interval <= 0) {
+        return;
+    }
+    if (!engine->config->stats_file) {
+        nb_stats_default_path(engine->config->wg_iface_name, path, sizeof(path));
+    }
+    const char *file = engine->config->stats_file ? engine->config->stats_file : path;
+
+    if (nb_stats_open(file, 0, 0, &engine->stats) != NB_SUCCESS) {
+        NB_LOG_WARN("Peer statistics disabled");
+        engine->stats = NULL;
+        return;
+    }
+    engine->stats_due_ms = clock_ms(CLOCK_MONOTONIC);
+}
+
+/* Interval of the idle peer check in lazy mode */
+#define LAZY_CHECK_MS       10000
+
+/* Interval of the route drift check */
+#define ROUTE_CHECK_MS      30000
+
+/* Trapped packets handled per read */
+#define LAZY_TRAP_BATCH     256
+
+/* Delay of the drift check after a route event, so that bursts are checked once */
+#define ROUTE_EVENT_DELAY_MS    100
+
+/* Delay of the PeersFile reload after a write, so that bursts are loaded once */
+#define PEERS_SETTLE_MS     50
+
+/* Records applied per delta ring wakeup before yielding to other events */
+#define DELTA_BATCH         4096
+
+/* Set up the NFLOG trap for lazy peers; without it every peer is installed */
+static void lazy_start(nb_engine_t *engine) {
+    if (!engine->config->lazy_peers) {
+        return;
+    }
+
+    if (nb_nflog_open(NB_NFLOG_DEFAULT_GROUP, &engine->nflog) != NB_SUCCESS) {
+        NB_LOG_WARN("Lazy peers disabled, installing all peers");
+        return;
+    }
+    if (nb_nflog_rules_add(engine->wg_iface->name, NB_NFLOG_DEFAULT_GROUP) != NB_SUCCESS) {
+        NB_LOG_WARN("Lazy peers disabled, installing all peers");
+        nb_nflog_close(&engine->nflog);
+        return;
+    }
+
+    engine->lazy = 1;
+    engine->lazy_due_ms = clock_ms(CLOCK_MONOTONIC) + LAZY_CHECK_MS;
+    NB_LOG_INFO("Lazy peers enabled (idle timeout %ds)", engine->config->lazy_idle_timeout);
+}
+
+static void lazy_stop(nb_engine_t *engine) {
+    if (!engine->lazy) {
+        return;
+    }
+    nb_nflog_rules_del(engine->wg_iface->name, NB_NFLOG_DEFAULT_GROUP);
+    nb_nflog_close(&engine->nflog);
+    engine->lazy = 0;
+}
 
 nb_engine_t* nb_engine_new(nb_config_t *config) {
     if (!config) {
@@ -24,6 +109,21 @@ nb_engine_t* nb_engine_new(nb_config_t *config) {
 
     engine->config = config;
     engine->running = 0;
+    engine->nflog.nl.fd = -1;
+    engine->routes_fd = -1;
+    engine->peers_fd = -1;
+    engine->peers_wd = engine->journal_wd = -1;
+    engine->delta_listen_fd = -1;
+    engine->delta_conn_fd = -1;
+
+    engine->peers = nb_peer_table_new(0);
+    engine->allowed_ips = nb_lpm_new();
+    if (!engine->peers || !engine->allowed_ips) {
+        nb_peer_table_free(engine->peers);
+        nb_lpm_free(engine->allowed_ips);
+        free(engine);
+        return NULL;
+    }
 
     NB_LOG_INFO("Engine created");
     return engine;
@@ -82,7 +182,21 @@ int nb_engine_start(nb_engine_t *engine) {
         nb_engine_stop(engine);
         return NB_ERROR_SYSTEM;
     }
+    if (engine->config->route_table > 0 &&
+        route_use_table(engine->route_mgr, (uint32_t)engine->config->route_table,
+                        (uint32_t)engine->config->route_fwmark, ROUTE_RULE_PRIORITY) != NB_SUCCESS) {
+        NB_LOG_WARN("Routing table %d not available, using the main table",
+                    engine->config->route_table);
+    }
+    if (engine->config->route_offload_devices_count > 0 &&
+        route_enable_offload(engine->route_mgr, (const char *const *)engine->config->route_offload_devices,
+                             engine->config->route_offload_devices_count) != NB_SUCCESS) {
+        NB_LOG_WARN("Flowtable offload not available, forwarding through the full path");
+    }
+    engine->routes_due_ms = clock_ms(CLOCK_MONOTONIC) + ROUTE_CHECK_MS;
 
+    stats_start(engine);
+    lazy_start(engine);
     engine->running = 1;
 
     NB_LOG_INFO("========================================");
@@ -136,42 +250,67 @@ int nb_engine_start_with_mgmt(nb_engine_t *engine, const char *setup_key) {
         return ret;
     }
 
-    /* Step 3: Add peers from management */
-    NB_LOG_INFO("Step 3: Adding %d peer(s) from management...", mgmt_config->peer_count);
+    /* Step 3: Sync peers with management (only the delta is written) */
+    NB_LOG_INFO("Step 3: Syncing %d peer(s) from management...", mgmt_config->peer_count);
+    nb_peer_info_t *peers = calloc(mgmt_config->peer_count > 0 ? mgmt_config->peer_count : 1,
+                                   sizeof(nb_peer_info_t));
+    if (!peers) {
+        NB_LOG_ERROR("calloc failed");
+        mgmt_config_free(mgmt_config);
+        return NB_ERROR_SYSTEM;
+    }
+
+    /* Convert mgmt peers to nb_peer_info (allowed_ips may be a comma list) */
     for (int i = 0; i < mgmt_config->peer_count; i++) {
         mgmt_peer_t *mp = &mgmt_config->peers[i];
+        peers[i].public_key = mp->public_key;
+        peers[i].endpoint = mp->endpoint;
+        peers[i].keepalive = 25;  /* Default keepalive */
+        peers[i].allowed_ips = mp->allowed_ips ? &mp->allowed_ips : NULL;
+        peers[i].allowed_ips_count = mp->allowed_ips ? 1 : 0;
+    }
 
-        /* Convert mgmt peer to nb_peer_info */
-        nb_peer_info_t peer = {0};
-        peer.public_key = mp->public_key;
-        peer.endpoint = mp->endpoint;
-        peer.keepalive = 25;  /* Default keepalive */
-
-        /* Parse allowed_ips (single CIDR for stub) */
-        peer.allowed_ips_count = 1;
-        peer.allowed_ips = &mp->allowed_ips;
-
-        ret = nb_engine_add_peer(engine, &peer);
-        if (ret != NB_SUCCESS) {
-            NB_LOG_WARN("Failed to add peer %s", mp->id);
-        }
+    ret = nb_engine_sync_peers(engine, peers, mgmt_config->peer_count);
+    if (ret != NB_SUCCESS) {
+        NB_LOG_WARN("Some peers could not be applied");
     }
+    free(peers);
 
-    /* Step 4: Add routes from management */
-    NB_LOG_INFO("Step 4: Adding %d route(s) from management...", mgmt_config->route_count);
+    /* Step 4: Sync routes from management (only the difference is applied) */
+    NB_LOG_INFO("Step 4: Syncing %d route(s) from management...", mgmt_config->route_count);
+    route_config_t *routes = calloc(mgmt_config->route_count > 0 ? mgmt_config->route_count : 1,
+                                    sizeof(route_config_t));
+    if (!routes) {
+        NB_LOG_ERROR("calloc failed");
+        mgmt_config_free(mgmt_config);
+        return NB_ERROR_SYSTEM;
+    }
     for (int i = 0; i < mgmt_config->route_count; i++) {
-        route_config_t route = {
-            .network = mgmt_config->routes[i],
-            .device = engine->wg_iface->name,
-            .metric = 100,
-            .masquerade = 0
-        };
+        routes[i].network = mgmt_config->routes[i];
+        routes[i].device = engine->wg_iface->name;
+        routes[i].metric = 100;
+        routes[i].masquerade = 0;
+    }
 
-        ret = route_add(engine->route_mgr, &route);
-        if (ret != NB_SUCCESS) {
-            NB_LOG_WARN("Failed to add route %s", mgmt_config->routes[i]);
-        }
+    /* Install the smallest equivalent list; fall back to the raw one */
+    route_agg_t *agg = NULL;
+    const route_config_t *install = routes;
+    int install_count = mgmt_config->route_count;
+    if (route_aggregate(routes, mgmt_config->route_count, &agg) == NB_SUCCESS) {
+        route_agg_stats_t st;
+        route_agg_get_stats(agg, &st);
+        install = route_agg_routes(agg, &install_count);
+        NB_LOG_INFO("Aggregated %d route(s) into %d (saved %d: %d duplicate, %d covered, %d merged)",
+                    st.input, st.output, st.saved, st.duplicates, st.covered, st.merged);
+    }
+
+    ret = route_sync(engine->route_mgr, install, install_count);
+    if (ret != 0) {
+        NB_LOG_WARN("Some routes could not be applied");
     }
+    route_agg_free(agg);
+    free(routes);
+    engine->routes_due_ms = clock_ms(CLOCK_MONOTONIC) + ROUTE_CHECK_MS;
 
     mgmt_config_free(mgmt_config);
 
@@ -194,6 +333,7 @@ int nb_engine_stop(nb_engine_t *engine) {
     }
 
     NB_LOG_INFO("Stopping NetBird engine...");
+    nb_engine_detach(engine);
 
     /* Step 1: Remove all routes */
     if (engine->route_mgr) {
@@ -205,11 +345,16 @@ int nb_engine_stop(nb_engine_t *engine) {
 
     /* Step 2: Destroy WireGuard interface */
     if (engine->wg_iface) {
+        lazy_stop(engine);
         NB_LOG_INFO("Step 2: Destroying WireGuard interface...");
         wg_iface_destroy(engine->wg_iface);
         wg_iface_free(engine->wg_iface);
         engine->wg_iface = NULL;
     }
+    nb_peer_table_clear(engine->peers);
+    nb_lpm_clear(engine->allowed_ips);
+    nb_stats_close(engine->stats);
+    engine->stats = NULL;
 
     /* Step 3: Close management client */
     if (engine->mgmt_client) {
@@ -224,6 +369,553 @@ int nb_engine_stop(nb_engine_t *engine) {
     return NB_SUCCESS;
 }
 
+/* Peers converted to wg_peer_spec_t; all specs share one prefix array */
+typedef struct {
+    wg_peer_spec_t *specs;
+    nb_prefix_t *ips;
+    int *source;             /* specs[k] was built from peers[source[k]] */
+    int *first;              /* Offset of specs[k]'s prefixes in ips, -1 for none */
+    int count;
+    int invalid;             /* Peers that could not be converted */
+    int cap;
+    int ips_used;
+    int ips_cap;
+} peer_specs_t;
+
+static void peer_specs_free(peer_specs_t *ps) {
+    free(ps->specs);
+    free(ps->ips);
+    free(ps->source);
+    free(ps->first);
+    memset(ps, 0, sizeof(*ps));
+}
+
+/* Helper: make room for more specs and prefixes (arrays grow geometrically) */
+static int peer_specs_reserve(peer_specs_t *ps, int specs, int ips) {
+    if (ps->count + specs > ps->cap || !ps->specs) {
+        int cap = ps->cap ? ps->cap : 16;
+        while (cap < ps->count + specs) {
+            cap *= 2;
+        }
+        wg_peer_spec_t *sp = realloc(ps->specs, cap * sizeof(wg_peer_spec_t));
+        if (sp) ps->specs = sp;
+        int *src = realloc(ps->source, cap * sizeof(int));
+        if (src) ps->source = src;
+        int *first = realloc(ps->first, cap * sizeof(int));
+        if (first) ps->first = first;
+        if (!sp || !src || !first) {
+            NB_LOG_ERROR("realloc failed");
+            return NB_ERROR_SYSTEM;
+        }
+        ps->cap = cap;
+    }
+    if (ps->ips_used + ips > ps->ips_cap || !ps->ips) {
+        int cap = ps->ips_cap ? ps->ips_cap : 16;
+        while (cap < ps->ips_used + ips) {
+            cap *= 2;
+        }
+        nb_prefix_t *p = realloc(ps->ips, cap * sizeof(nb_prefix_t));
+        if (!p) {
+            NB_LOG_ERROR("realloc failed");
+            return NB_ERROR_SYSTEM;
+        }
+        ps->ips = p;
+        ps->ips_cap = cap;
+    }
+    return NB_SUCCESS;
+}
+
+/*
+ * Convert one peer (peers[index] of the source) and append its spec.
+ * Invalid peers are skipped; with keep_invalid a peer whose key is valid
+ * still gets a spec that changes nothing, so a reconcile does not remove
+ * it over a bad endpoint or prefix.
+ */
+static int peer_specs_add(peer_specs_t *ps, const nb_peer_info_t *peer, int index, int keep_invalid) {
+    /* Count prefixes first (entries may be comma separated lists) */
+    int n = 0;
+    for (int j = 0; j < peer->allowed_ips_count; j++) {
+        const char *p = peer->allowed_ips[j];
+        n++;
+        while (p && (p = strchr(p, ','))) {
+            n++;
+            p++;
+        }
+    }
+    int ret = peer_specs_reserve(ps, 1, n);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+
+    wg_peer_spec_t *spec = &ps->specs[ps->count];
+    nb_prefix_t *ips = &ps->ips[ps->ips_used];
+    memset(spec, 0, sizeof(*spec));
+    int key_ok = peer->public_key &&
+                 wg_key_from_base64(spec->public_key, peer->public_key) == NB_SUCCESS;
+    int ok = key_ok;
+
+    for (int j = 0; ok && j < peer->allowed_ips_count; j++) {
+        int c = nb_prefix_parse_list(peer->allowed_ips[j], &ips[spec->allowed_ips_count],
+                                     n - spec->allowed_ips_count);
+        if (c < 0) {
+            ok = 0;
+            break;
+        }
+        spec->allowed_ips_count += c;
+    }
+
+    if (ok && peer->endpoint && nb_endpoint_parse(peer->endpoint, &spec->endpoint) != NB_SUCCESS) {
+        ok = 0;
+    }
+    spec->keepalive = peer->keepalive > 0 ? peer->keepalive : -1;
+    ps->first[ps->count] = ps->ips_used;
+
+    if (!ok) {
+        NB_LOG_WARN("Skipping invalid peer %s", peer->public_key ? peer->public_key : "(null)");
+        ps->invalid++;
+        memset(spec, 0, sizeof(*spec));
+        if (!key_ok || !keep_invalid) {
+            return NB_SUCCESS;
+        }
+        wg_key_from_base64(spec->public_key, peer->public_key);
+        spec->keepalive = -1;
+        ps->first[ps->count] = -1;
+    }
+
+    ps->ips_used += spec->allowed_ips_count;
+    ps->source[ps->count++] = index;
+    return NB_SUCCESS;
+}
+
+/* Point the specs at their prefixes once the prefix array no longer moves */
+static void peer_specs_finish(peer_specs_t *ps) {
+    for (int k = 0; k < ps->count; k++) {
+        ps->specs[k].allowed_ips = ps->first[k] >= 0 ? &ps->ips[ps->first[k]] : NULL;
+    }
+}
+
+static int peer_specs_build(const nb_peer_info_t *peers, int count, int keep_invalid,
+                            peer_specs_t *ps) {
+    memset(ps, 0, sizeof(*ps));
+
+    int ret = peer_specs_reserve(ps, count, count);
+    for (int i = 0; ret == NB_SUCCESS && i < count; i++) {
+        ret = peer_specs_add(ps, &peers[i], i, keep_invalid);
+    }
+    if (ret != NB_SUCCESS) {
+        peer_specs_free(ps);
+        return ret;
+    }
+
+    peer_specs_finish(ps);
+    return NB_SUCCESS;
+}
+
+/* Owner values for peers of a batch that have no record id yet */
+#define BATCH_OWNER     0x80000000u
+
+/* A spec's key and index, for ordering a batch by peer */
+typedef struct {
+    const uint8_t *key;
+    int index;
+} batch_key_t;
+
+static int batch_key_cmp(const void *a, const void *b) {
+    const batch_key_t *x = a, *y = b;
+    int c = memcmp(x->key, y->key, WG_KEY_LEN);
+    return c ? c : (x->index > y->index) - (x->index < y->index);
+}
+
+static int batch_key_find(const void *key, const void *entry) {
+    return memcmp(key, ((const batch_key_t *)entry)->key, WG_KEY_LEN);
+}
+
+/*
+ * A batch by peer. owners[k] is the batch owner of spec k: BATCH_OWNER
+ * with the index of the first spec of the same peer, so a peer listed
+ * twice does not conflict with itself. final[k] is the spec that decides
+ * the peer's allowed IPs: its last one removing the peer or replacing
+ * them, -1 if there is none.
+ */
+typedef struct {
+    batch_key_t *order;      /* Specs by key, then index */
+    uint32_t *owners;
+    int *final;
+    int count;
+} batch_index_t;
+
+static void batch_index_free(batch_index_t *bi) {
+    free(bi->order);
+    free(bi->owners);
+    free(bi->final);
+}
+
+static int batch_index_build(const peer_specs_t *ps, batch_index_t *bi) {
+    int n = ps->count > 0 ? ps->count : 1;
+    bi->count = ps->count;
+    bi->order = calloc(n, sizeof(batch_key_t));
+    bi->owners = calloc(n, sizeof(uint32_t));
+    bi->final = calloc(n, sizeof(int));
+    if (!bi->order || !bi->owners || !bi->final) {
+        NB_LOG_ERROR("calloc failed");
+        batch_index_free(bi);
+        return NB_ERROR_SYSTEM;
+    }
+
+    for (int k = 0; k < ps->count; k++) {
+        bi->order[k].key = ps->specs[k].public_key;
+        bi->order[k].index = k;
+    }
+    qsort(bi->order, ps->count, sizeof(batch_key_t), batch_key_cmp);
+
+    /* One run of equal keys per peer, in batch order */
+    for (int i = 0, end; i < ps->count; i = end) {
+        int first = bi->order[i].index, last = -1;
+        for (end = i; end < ps->count && memcmp(bi->order[end].key, bi->order[i].key, WG_KEY_LEN) == 0; end++) {
+            const wg_peer_spec_t *spec = &ps->specs[bi->order[end].index];
+            if (spec->remove || spec->allowed_ips) {
+                last = bi->order[end].index;
+            }
+        }
+        for (int j = i; j < end; j++) {
+            bi->owners[bi->order[j].index] = BATCH_OWNER | (uint32_t)first;
+            bi->final[bi->order[j].index] = last;
+        }
+    }
+    return NB_SUCCESS;
+}
+
+/*
+ * Whether the batch takes prefix away from the applied peer owning it:
+ * the peer is removed, or its allowed IPs are replaced by a list without
+ * the prefix. Such a prefix can move to another peer of the batch.
+ */
+static int batch_releases(const nb_engine_t *engine, const peer_specs_t *ps, const batch_index_t *bi,
+                          uint32_t owner, const nb_prefix_t *prefix) {
+    const nb_peer_record_t *rec = nb_peer_table_by_id(engine->peers, owner);
+    const batch_key_t *entry = rec ? bsearch(rec->public_key, bi->order, bi->count, sizeof(batch_key_t),
+                                             batch_key_find) : NULL;
+    int k = entry ? bi->final[entry->index] : -1;
+    if (k < 0) {
+        return 0;
+    }
+
+    const wg_peer_spec_t *spec = &ps->specs[k];
+    if (spec->remove) {
+        return 1;
+    }
+    nb_prefix_t want = *prefix;
+    nb_prefix_normalize(&want);
+    for (int i = 0; i < spec->allowed_ips_count; i++) {
+        nb_prefix_t have = spec->allowed_ips[i];
+        nb_prefix_normalize(&have);
+        if (nb_prefix_cmp(&have, &want) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Check the specs' allowed IPs against the applied peers (with
+ * against_table) and against the specs before them. A prefix owned by
+ * another peer is dropped from the spec, so the kernel never moves it,
+ * unless the batch takes it from that peer; prefixes that merely nest
+ * with another peer's are logged.
+ *
+ * Returns the number of specs that lost a prefix, or NB_ERROR_SYSTEM.
+ */
+static int resolve_overlaps(nb_engine_t *engine, peer_specs_t *ps,
+                            const nb_peer_info_t *peers, int against_table) {
+    batch_index_t bi;
+    if (batch_index_build(ps, &bi) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+    nb_lpm_t *batch = nb_lpm_new();
+    if (!batch) {
+        batch_index_free(&bi);
+        return NB_ERROR_SYSTEM;
+    }
+
+    int lost = 0;
+    for (int k = 0; k < ps->count; k++) {
+        wg_peer_spec_t *spec = &ps->specs[k];
+        if (spec->remove || !spec->allowed_ips) {
+            continue;
+        }
+
+        const nb_peer_record_t *rec = against_table ?
+            nb_peer_table_find(engine->peers, spec->public_key) : NULL;
+        uint32_t owner = rec ? rec->id : bi.owners[k];
+        nb_prefix_t *ips = &ps->ips[spec->allowed_ips - ps->ips];
+        char b64[WG_KEY_B64_LEN];
+        const char *name = peers ? peers[ps->source[k]].public_key : b64;
+        if (!peers) {
+            wg_key_to_base64(b64, spec->public_key);
+        }
+        int kept = 0;
+
+        for (int i = 0; i < spec->allowed_ips_count; i++) {
+            nb_lpm_check_t seen, applied;
+            char buf[NB_PREFIX_STRLEN], other[NB_PREFIX_STRLEN];
+
+            nb_lpm_check(batch, &ips[i], owner, &seen);
+            if (against_table) {
+                nb_lpm_check(engine->allowed_ips, &ips[i], owner, &applied);
+                if (applied.kind == NB_LPM_CONFLICT &&
+                    batch_releases(engine, ps, &bi, applied.other_value, &ips[i])) {
+                    applied.kind = NB_LPM_OK;
+                }
+                if (applied.kind > seen.kind) {
+                    seen = applied;
+                }
+            }
+
+            nb_prefix_format(&ips[i], buf, sizeof(buf));
+            if (seen.kind == NB_LPM_CONFLICT) {
+                NB_LOG_ERROR("Allowed IP %s of peer %s is owned by another peer, dropping it",
+                             buf, name);
+                continue;
+            }
+            if (seen.kind == NB_LPM_COVERS || seen.kind == NB_LPM_COVERED) {
+                NB_LOG_DEBUG("Allowed IP %s of peer %s %s %s of another peer", buf, name,
+                             seen.kind == NB_LPM_COVERS ? "covers" : "is inside",
+                             nb_prefix_format(&seen.other, other, sizeof(other)));
+            }
+
+            if (nb_lpm_insert(batch, &ips[i], owner) != NB_SUCCESS) {
+                nb_lpm_free(batch);
+                batch_index_free(&bi);
+                return NB_ERROR_SYSTEM;
+            }
+            ips[kept++] = ips[i];
+        }
+
+        if (kept != spec->allowed_ips_count) {
+            spec->allowed_ips_count = kept;
+            lost++;
+        }
+    }
+
+    nb_lpm_free(batch);
+    batch_index_free(&bi);
+    return lost;
+}
+
+/* Add or drop a record's allowed IPs in the engine trie */
+static void trie_link(nb_engine_t *engine, const nb_peer_record_t *rec, int link) {
+    const nb_prefix_t *ips = nb_peer_table_allowed_ips(engine->peers, rec);
+
+    for (int i = 0; i < rec->ips_count; i++) {
+        if (link) {
+            if (nb_lpm_insert(engine->allowed_ips, &ips[i], rec->id) != NB_SUCCESS) {
+                NB_LOG_WARN("Failed to record allowed IP in trie");
+            }
+            continue;
+        }
+
+        /* Only drop entries the record still owns */
+        uint32_t owner;
+        nb_prefix_t match;
+        if (nb_lpm_lookup(engine->allowed_ips, &ips[i], &owner, &match) == NB_SUCCESS &&
+            owner == rec->id && match.len == ips[i].len) {
+            nb_lpm_remove(engine->allowed_ips, &ips[i]);
+        }
+    }
+}
+
+static void table_clear(nb_engine_t *engine) {
+    nb_peer_table_clear(engine->peers);
+    nb_lpm_clear(engine->allowed_ips);
+}
+
+/*
+ * Mirror a spec in the engine peer table. installed marks the peer as
+ * configured in the kernel; otherwise its install state is kept.
+ */
+static nb_peer_record_t* table_record(nb_engine_t *engine, const wg_peer_spec_t *spec,
+                                      int installed) {
+    nb_peer_record_t *rec = nb_peer_table_find(engine->peers, spec->public_key);
+
+    if (rec && (spec->remove || spec->allowed_ips)) {
+        trie_link(engine, rec, 0);
+    }
+    if (spec->remove) {
+        nb_peer_table_remove(engine->peers, spec->public_key);
+        return NULL;
+    }
+
+    const nb_endpoint_t *ep = spec->endpoint.sa.sa_family ? &spec->endpoint :
+                              rec ? &rec->endpoint : NULL;
+    nb_endpoint_t ep_copy;
+    if (ep) {
+        ep_copy = *ep;
+        ep = &ep_copy;
+    }
+    int keepalive = spec->keepalive >= 0 ? spec->keepalive : rec ? rec->keepalive : 0;
+
+    if (nb_peer_table_upsert(engine->peers, spec->public_key, ep, keepalive, spec->allowed_ips,
+                             spec->allowed_ips ? spec->allowed_ips_count : -1) != NB_SUCCESS) {
+        NB_LOG_WARN("Failed to record peer in peer table");
+    }
+
+    rec = nb_peer_table_find(engine->peers, spec->public_key);
+    if (rec) {
+        trie_link(engine, rec, 1);
+        if (installed) {
+            rec->flags |= NB_PEER_INSTALLED;
+            rec->last_active = time(NULL);
+        }
+    }
+    return rec;
+}
+
+/* Rebuild the peer table from the device after a partially failed sync */
+static void table_reload(nb_engine_t *engine) {
+    wg_device_t *dev = NULL;
+
+    table_clear(engine);
+    if (wg_iface_get_device(engine->wg_iface, &dev) != NB_SUCCESS) {
+        return;
+    }
+    for (int i = 0; i < dev->peer_count; i++) {
+        wg_device_peer_t *p = &dev->peers[i];
+        nb_peer_table_upsert(engine->peers, p->public_key, &p->endpoint, p->keepalive,
+                             p->allowed_ips, p->allowed_ips_count);
+        nb_peer_record_t *rec = nb_peer_table_find(engine->peers, p->public_key);
+        if (rec) {
+            trie_link(engine, rec, 1);
+            rec->flags |= NB_PEER_INSTALLED;
+            rec->last_active = time(NULL);
+        }
+    }
+    wg_device_free(dev);
+}
+
+/* Outside lazy mode every known peer is in the kernel */
+static int is_installed(const nb_engine_t *engine, const uint8_t key[WG_KEY_LEN]) {
+    const nb_peer_record_t *rec;
+
+    if (!engine->lazy) {
+        return 1;
+    }
+    rec = nb_peer_table_find(engine->peers, key);
+    return rec && (rec->flags & NB_PEER_INSTALLED);
+}
+
+/*
+ * Select the specs to write to the kernel in lazy mode: those of peers
+ * already installed. The others only update the peer table until traffic
+ * activates them. map[j] is the index in ps of push[j] (increasing).
+ *
+ * Returns the number of specs to push, or NB_ERROR_SYSTEM.
+ */
+static int lazy_split(const nb_engine_t *engine, const peer_specs_t *ps,
+                      wg_peer_spec_t **push_out, int **map_out) {
+    wg_peer_spec_t *push = calloc(ps->count > 0 ? ps->count : 1, sizeof(wg_peer_spec_t));
+    int *map = calloc(ps->count > 0 ? ps->count : 1, sizeof(int));
+    if (!push || !map) {
+        NB_LOG_ERROR("calloc failed");
+        free(push);
+        free(map);
+        return NB_ERROR_SYSTEM;
+    }
+
+    int n = 0;
+    for (int k = 0; k < ps->count; k++) {
+        if (is_installed(engine, ps->specs[k].public_key)) {
+            push[n] = ps->specs[k];
+            map[n++] = k;
+        }
+    }
+    *push_out = push;
+    *map_out = map;
+    return n;
+}
+
+/*
+ * Apply specs (additions, updates and removals) to the device and the
+ * peer table, checking their prefixes against the table. Frees the specs.
+ * peers names the specs' sources in log messages; without it keys are
+ * logged.
+ */
+static int apply_specs(nb_engine_t *engine, peer_specs_t *ps, const nb_peer_info_t *peers) {
+    int count = ps->count + ps->invalid;
+    int lost = resolve_overlaps(engine, ps, peers, 1);
+    if (lost < 0) {
+        peer_specs_free(ps);
+        return lost;
+    }
+
+    /* In lazy mode only installed peers go to the kernel */
+    wg_peer_spec_t *push = ps->specs;
+    int *map = NULL;
+    int npush = ps->count;
+    if (engine->lazy) {
+        npush = lazy_split(engine, ps, &push, &map);
+        if (npush < 0) {
+            peer_specs_free(ps);
+            return npush;
+        }
+        for (int k = 0, j = 0; k < ps->count; k++) {
+            if (j < npush && map[j] == k) {
+                j++;
+            } else {
+                table_record(engine, &ps->specs[k], 0);
+            }
+        }
+    }
+
+    int *errors = calloc(npush > 0 ? npush : 1, sizeof(int));
+    if (!errors) {
+        NB_LOG_ERROR("calloc failed");
+        if (map) {
+            free(push);
+            free(map);
+        }
+        peer_specs_free(ps);
+        return NB_ERROR_SYSTEM;
+    }
+
+    NB_LOG_INFO("Applying %d peer change(s) in batch...", npush);
+
+    int failed = ps->invalid + lost;
+    int ret = npush > 0 ? wg_iface_apply_peers(engine->wg_iface, push, npush, errors) : NB_SUCCESS;
+    if (ret != NB_SUCCESS && ret != NB_ERROR) {
+        failed += npush;
+    } else {
+        for (int j = 0; j < npush; j++) {
+            int k = map ? map[j] : j;
+            if (errors[j] != NB_SUCCESS) {
+                char b64[WG_KEY_B64_LEN];
+                if (!peers) {
+                    wg_key_to_base64(b64, ps->specs[k].public_key);
+                }
+                NB_LOG_WARN("Failed to apply peer %s (error %d)",
+                            peers ? peers[ps->source[k]].public_key : b64, errors[j]);
+                failed++;
+            } else {
+                table_record(engine, &ps->specs[k], 1);
+            }
+        }
+    }
+
+    free(errors);
+    if (map) {
+        free(push);
+        free(map);
+    }
+    peer_specs_free(ps);
+
+    if (failed) {
+        NB_LOG_ERROR("%d of %d peer(s) failed", failed, count);
+        return NB_ERROR;
+    }
+
+    NB_LOG_INFO("Applied %d peer(s) successfully", count);
+    return NB_SUCCESS;
+}
+
 int nb_engine_add_peer(nb_engine_t *engine, const nb_peer_info_t *peer) {
     if (!engine || !peer || !peer->public_key) {
         NB_LOG_ERROR("Invalid arguments");
@@ -235,40 +927,53 @@ int nb_engine_add_peer(nb_engine_t *engine, const nb_peer_info_t *peer) {
         return NB_ERROR_INVALID;
     }
 
-    /* Build allowed IPs string */
-    char allowed_ips[1024] = {0};
-    if (peer->allowed_ips && peer->allowed_ips_count > 0) {
-        for (int i = 0; i < peer->allowed_ips_count; i++) {
-            if (i > 0) strcat(allowed_ips, ",");
-            strcat(allowed_ips, peer->allowed_ips[i]);
-        }
+    /* Refuse prefixes another peer owns before the kernel moves them */
+    peer_specs_t ps;
+    int ret = peer_specs_build(peer, 1, 0, &ps);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+    if (ps.count == 0) {
+        peer_specs_free(&ps);
+        return NB_ERROR_INVALID;
+    }
+    int lost = resolve_overlaps(engine, &ps, peer, 1);
+    if (lost != 0) {
+        peer_specs_free(&ps);
+        return lost < 0 ? lost : NB_ERROR_INVALID;
+    }
+
+    /* Lazy peers are installed on first traffic */
+    if (!is_installed(engine, ps.specs[0].public_key)) {
+        table_record(engine, &ps.specs[0], 0);
+        peer_specs_free(&ps);
+        NB_LOG_INFO("Recorded lazy peer: %s", peer->public_key);
+        return NB_SUCCESS;
     }
 
     NB_LOG_INFO("Adding peer: %s", peer->public_key);
-    NB_LOG_INFO("  Allowed IPs: %s", allowed_ips[0] ? allowed_ips : "(none)");
+    NB_LOG_INFO("  Allowed IPs: %d prefix(es)", ps.specs[0].allowed_ips_count);
     NB_LOG_INFO("  Endpoint:    %s", peer->endpoint ? peer->endpoint : "(none)");
     NB_LOG_INFO("  Keepalive:   %d", peer->keepalive);
 
-    int ret = wg_iface_update_peer(
-        engine->wg_iface,
-        peer->public_key,
-        allowed_ips[0] ? allowed_ips : NULL,
-        peer->keepalive,
-        peer->endpoint,
-        NULL  /* no pre-shared key for now */
-    );
-
+    /* The parsed spec, so the prefix list needs no string of its own */
+    int error = NB_SUCCESS;
+    ret = wg_iface_apply_peers(engine->wg_iface, ps.specs, 1, &error);
     if (ret != NB_SUCCESS) {
         NB_LOG_ERROR("Failed to add peer");
-        return ret;
+        peer_specs_free(&ps);
+        return ret == NB_ERROR && error != NB_SUCCESS ? error : ret;
     }
 
+    table_record(engine, &ps.specs[0], 1);
+    peer_specs_free(&ps);
+
     NB_LOG_INFO("Peer added successfully");
     return NB_SUCCESS;
 }
 
-int nb_engine_remove_peer(nb_engine_t *engine, const char *public_key) {
-    if (!engine || !public_key) {
+int nb_engine_add_peers(nb_engine_t *engine, const nb_peer_info_t *peers, int count) {
+    if (!engine || (!peers && count > 0) || count < 0) {
         NB_LOG_ERROR("Invalid arguments");
         return NB_ERROR_INVALID;
     }
@@ -278,23 +983,1238 @@ int nb_engine_remove_peer(nb_engine_t *engine, const char *public_key) {
         return NB_ERROR_INVALID;
     }
 
-    NB_LOG_INFO("Removing peer: %s", public_key);
+    if (count == 0) {
+        return NB_SUCCESS;
+    }
 
-    int ret = wg_iface_remove_peer(engine->wg_iface, public_key);
+    peer_specs_t ps;
+    int ret = peer_specs_build(peers, count, 0, &ps);
     if (ret != NB_SUCCESS) {
-        NB_LOG_ERROR("Failed to remove peer");
         return ret;
     }
 
-    NB_LOG_INFO("Peer removed successfully");
-    return NB_SUCCESS;
+    return apply_specs(engine, &ps, peers);
 }
 
-void nb_engine_free(nb_engine_t *engine) {
-    if (!engine) return;
+/*
+ * Reconcile the device with the specs (the desired set) and rebuild the
+ * peer table from them. Frees the specs. peers names the specs' sources
+ * in log messages; without it keys are logged.
+ */
+static int sync_specs(nb_engine_t *engine, peer_specs_t *ps, const nb_peer_info_t *peers) {
+    int lost = resolve_overlaps(engine, ps, peers, 0);
+    if (lost < 0) {
+        peer_specs_free(ps);
+        return lost;
+    }
 
-    /* Note: Config is freed separately by caller if needed */
-    free(engine);
+    /* In lazy mode the device holds only the installed subset */
+    wg_peer_spec_t *push = ps->specs;
+    int *map = NULL;
+    int64_t *active = NULL;
+    int npush = ps->count;
+    if (engine->lazy) {
+        npush = lazy_split(engine, ps, &push, &map);
+        active = npush >= 0 ? calloc(npush > 0 ? npush : 1, sizeof(int64_t)) : NULL;
+        if (!active) {
+            if (npush >= 0) {
+                free(push);
+                free(map);
+            }
+            peer_specs_free(ps);
+            return NB_ERROR_SYSTEM;
+        }
+        for (int j = 0; j < npush; j++) {
+            active[j] = nb_peer_table_find(engine->peers, push[j].public_key)->last_active;
+        }
+    }
+
+    wg_reconcile_stats_t stats;
+    int ret = wg_iface_reconcile(engine->wg_iface, push, npush, &stats);
+    if (ret == NB_SUCCESS) {
+        /* The device now holds exactly the desired (installed) set */
+        table_clear(engine);
+        for (int k = 0, j = 0; k < ps->count; k++) {
+            int pushed = !map || (j < npush && map[j] == k);
+            nb_peer_record_t *rec = table_record(engine, &ps->specs[k], pushed);
+            if (pushed && active) {
+                /* Keep the idle clock of peers that stay installed */
+                if (rec) {
+                    rec->last_active = active[j];
+                }
+                j++;
+            }
+        }
+    } else {
+        table_reload(engine);
+        for (int k = 0; map && k < ps->count; k++) {
+            if (!nb_peer_table_find(engine->peers, ps->specs[k].public_key)) {
+                table_record(engine, &ps->specs[k], 0);
+            }
+        }
+    }
+    int invalid = ps->invalid + lost;
+    if (map) {
+        free(push);
+        free(map);
+        free(active);
+    }
+    peer_specs_free(ps);
+
+    if (ret == NB_SUCCESS && invalid) {
+        return NB_ERROR;
+    }
+    return ret;
+}
+
+int nb_engine_sync_peers(nb_engine_t *engine, const nb_peer_info_t *peers, int count) {
+    if (!engine || (!peers && count > 0) || count < 0) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    if (!engine->running || !engine->wg_iface) {
+        NB_LOG_ERROR("Engine not running");
+        return NB_ERROR_INVALID;
+    }
+
+    peer_specs_t ps;
+    int ret = peer_specs_build(peers, count, 1, &ps);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+    return sync_specs(engine, &ps, peers);
+}
+
+int nb_engine_sync_peers_snap(nb_engine_t *engine, const peers_snap_t *snap) {
+    if (!engine || !snap) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    if (!engine->running || !engine->wg_iface) {
+        NB_LOG_ERROR("Engine not running");
+        return NB_ERROR_INVALID;
+    }
+
+    /* Keys and prefixes are binary already; only the prefixes are copied,
+     * since overlap resolution edits them */
+    int count = snap->peer_count;
+    peer_specs_t ps;
+    memset(&ps, 0, sizeof(ps));
+    ps.specs = calloc(count > 0 ? count : 1, sizeof(wg_peer_spec_t));
+    ps.ips = malloc((snap->prefix_count > 0 ? snap->prefix_count : 1) * sizeof(nb_prefix_t));
+    ps.source = calloc(count > 0 ? count : 1, sizeof(int));
+    if (!ps.specs || !ps.ips || !ps.source) {
+        NB_LOG_ERROR("calloc failed");
+        peer_specs_free(&ps);
+        return NB_ERROR_SYSTEM;
+    }
+    memcpy(ps.ips, snap->prefixes, (size_t)snap->prefix_count * sizeof(nb_prefix_t));
+
+    for (int i = 0; i < count; i++) {
+        const peers_snap_peer_t *p = &snap->peers[i];
+        wg_peer_spec_t *spec = &ps.specs[i];
+        memcpy(spec->public_key, p->public_key, WG_KEY_LEN);
+        spec->allowed_ips = &ps.ips[p->prefix_first];
+        spec->allowed_ips_count = p->prefix_count;
+        peers_snap_endpoint(p, &spec->endpoint);
+        spec->keepalive = p->keepalive > 0 ? p->keepalive : -1;
+        ps.source[i] = i;
+    }
+    ps.count = count;
+
+    return sync_specs(engine, &ps, NULL);
+}
+
+/* peers.json being streamed into specs */
+typedef struct {
+    peer_specs_t *ps;
+    int index;
+} stream_ctx_t;
+
+static int stream_peer(const peers_file_peer_t *fp, void *arg) {
+    stream_ctx_t *sc = arg;
+    nb_peer_info_t peer = {
+        .public_key = fp->public_key,
+        .endpoint = fp->endpoint,
+        .keepalive = fp->keepalive,
+        .allowed_ips = fp->allowed_ips,
+        .allowed_ips_count = fp->allowed_ips_count,
+    };
+    return peer_specs_add(sc->ps, &peer, sc->index++, 1);
+}
+
+int nb_engine_sync_peers_json(nb_engine_t *engine, const char *path, int *count_out) {
+    if (count_out) *count_out = -1;
+
+    if (!engine || !path) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    if (!engine->running || !engine->wg_iface) {
+        NB_LOG_ERROR("Engine not running");
+        return NB_ERROR_INVALID;
+    }
+
+    /* Each peer is converted while its strings are still in the scanner's
+     * buffer; no document or intermediate peer array is built */
+    peer_specs_t ps;
+    memset(&ps, 0, sizeof(ps));
+    stream_ctx_t sc = { .ps = &ps };
+    int ret = peer_specs_reserve(&ps, 0, 0);
+    if (ret == NB_SUCCESS) {
+        ret = peers_file_stream(path, stream_peer, &sc);
+    }
+    if (ret < 0) {
+        peer_specs_free(&ps);
+        return ret;
+    }
+    if (count_out) *count_out = ret;
+
+    peer_specs_finish(&ps);
+    return sync_specs(engine, &ps, NULL);
+}
+
+int nb_engine_sync_peers_file(nb_engine_t *engine, const peers_file_t *file) {
+    if (!engine || !file) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    nb_peer_info_t *peers = calloc(file->peer_count > 0 ? file->peer_count : 1, sizeof(nb_peer_info_t));
+    if (!peers) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+
+    for (int i = 0; i < file->peer_count; i++) {
+        const peers_file_peer_t *fp = &file->peers[i];
+        peers[i].public_key = fp->public_key;
+        peers[i].endpoint = fp->endpoint;
+        peers[i].keepalive = fp->keepalive;
+        peers[i].allowed_ips = fp->allowed_ips;
+        peers[i].allowed_ips_count = fp->allowed_ips_count;
+    }
+
+    int ret = nb_engine_sync_peers(engine, peers, file->peer_count);
+    free(peers);
+    return ret;
+}
+
+int nb_engine_remove_peer(nb_engine_t *engine, const char *public_key) {
+    if (!engine || !public_key) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    if (!engine->running || !engine->wg_iface) {
+        NB_LOG_ERROR("Engine not running");
+        return NB_ERROR_INVALID;
+    }
+
+    NB_LOG_INFO("Removing peer: %s", public_key);
+
+    uint8_t key[WG_KEY_LEN];
+    int key_ok = wg_key_from_base64(key, public_key) == NB_SUCCESS;
+
+    /* A lazy peer that is not installed only lives in the table */
+    if (!key_ok || !engine->lazy || is_installed(engine, key) ||
+        !nb_peer_table_find(engine->peers, key)) {
+        int ret = wg_iface_remove_peer(engine->wg_iface, public_key);
+        if (ret != NB_SUCCESS) {
+            NB_LOG_ERROR("Failed to remove peer");
+            return ret;
+        }
+    }
+
+    if (key_ok) {
+        wg_peer_spec_t spec = { .remove = 1 };
+        memcpy(spec.public_key, key, WG_KEY_LEN);
+        table_record(engine, &spec, 0);
+    }
+
+    NB_LOG_INFO("Peer removed successfully");
+    return NB_SUCCESS;
+}
+
+void nb_engine_free(nb_engine_t *engine) {
+    if (!engine) return;
+
+    /* Note: Config is freed separately by caller if needed */
+    nb_engine_detach(engine);
+    nb_peer_table_free(engine->peers);
+    nb_lpm_free(engine->allowed_ips);
+    nb_stats_close(engine->stats);
+    nb_nflog_close(&engine->nflog);
+    free(engine);
+}
+
+const nb_peer_record_t* nb_engine_find_peer(const nb_engine_t *engine, const char *public_key) {
+    uint8_t key[WG_KEY_LEN];
+
+    if (!engine || !public_key || wg_key_from_base64(key, public_key) != NB_SUCCESS) {
+        return NULL;
+    }
+    return nb_peer_table_find(engine->peers, key);
+}
+
+/*
+ * Install the peers whose traffic was trapped since the last call. Each
+ * trapped destination is mapped to its peer through the allowed IP trie;
+ * peers found more than once are installed once.
+ */
+static int lazy_activate(nb_engine_t *engine) {
+    nb_prefix_t dst[LAZY_TRAP_BATCH];
+    wg_peer_spec_t specs[LAZY_TRAP_BATCH];
+    uint32_t ids[LAZY_TRAP_BATCH];
+    int errors[LAZY_TRAP_BATCH];
+    int n;
+
+    do {
+        n = nb_nflog_read(&engine->nflog, dst, LAZY_TRAP_BATCH);
+        if (n < 0) {
+            return n;
+        }
+        engine->traps += n;
+
+        int count = 0;
+        for (int i = 0; i < n; i++) {
+            uint32_t id;
+            nb_peer_record_t *rec;
+
+            if (nb_lpm_lookup(engine->allowed_ips, &dst[i], &id, NULL) != NB_SUCCESS ||
+                !(rec = nb_peer_table_by_id(engine->peers, id)) ||
+                (rec->flags & NB_PEER_INSTALLED)) {
+                continue;
+            }
+
+            /* Flag it now so later packets of this read skip it */
+            rec->flags |= NB_PEER_INSTALLED;
+            wg_peer_spec_t *spec = &specs[count];
+            memset(spec, 0, sizeof(*spec));
+            memcpy(spec->public_key, rec->public_key, WG_KEY_LEN);
+            spec->endpoint = rec->endpoint;
+            spec->keepalive = rec->keepalive;
+            spec->allowed_ips = nb_peer_table_allowed_ips(engine->peers, rec);
+            spec->allowed_ips_count = rec->ips_count;
+            ids[count++] = rec->id;
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        int ret = wg_iface_apply_peers(engine->wg_iface, specs, count, errors);
+        time_t now = time(NULL);
+        for (int i = 0; i < count; i++) {
+            nb_peer_record_t *rec = nb_peer_table_by_id(engine->peers, ids[i]);
+            char key[WG_KEY_B64_LEN];
+
+            wg_key_to_base64(key, rec->public_key);
+            if ((ret != NB_SUCCESS && ret != NB_ERROR) || errors[i] != NB_SUCCESS) {
+                NB_LOG_WARN("Failed to activate peer %s", key);
+                rec->flags &= ~NB_PEER_INSTALLED;
+                continue;
+            }
+            rec->last_active = now;
+            engine->activations++;
+            NB_LOG_INFO("Activated peer %s on traffic", key);
+        }
+    } while (n == LAZY_TRAP_BATCH);
+
+    return NB_SUCCESS;
+}
+
+/*
+ * Remove installed peers without a handshake for LazyIdleTimeout seconds.
+ * A peer counts as active from its install time or its latest handshake,
+ * whichever is later. They stay in the table and the trie, so new traffic
+ * installs them again.
+ */
+static int lazy_evict(nb_engine_t *engine, const wg_device_t *dev) {
+    int64_t now = time(NULL);
+    int idle = engine->config->lazy_idle_timeout;
+
+    if (idle <= 0 || dev->peer_count == 0) {
+        return NB_SUCCESS;
+    }
+
+    wg_peer_spec_t *specs = calloc(dev->peer_count, sizeof(wg_peer_spec_t));
+    uint32_t *ids = calloc(dev->peer_count, sizeof(uint32_t));
+    int *errors = calloc(dev->peer_count, sizeof(int));
+    if (!specs || !ids || !errors) {
+        NB_LOG_ERROR("calloc failed");
+        free(specs);
+        free(ids);
+        free(errors);
+        return NB_ERROR_SYSTEM;
+    }
+
+    int count = 0;
+    for (int i = 0; i < dev->peer_count; i++) {
+        const wg_device_peer_t *p = &dev->peers[i];
+        nb_peer_record_t *rec = nb_peer_table_find(engine->peers, p->public_key);
+
+        if (!rec || !(rec->flags & NB_PEER_INSTALLED)) {
+            continue;
+        }
+        if (p->last_handshake > rec->last_active) {
+            rec->last_active = p->last_handshake;
+        }
+        if (now - rec->last_active < idle) {
+            continue;
+        }
+        specs[count].remove = 1;
+        memcpy(specs[count].public_key, p->public_key, WG_KEY_LEN);
+        ids[count++] = rec->id;
+    }
+
+    int ret = NB_SUCCESS;
+    if (count > 0) {
+        ret = wg_iface_apply_peers(engine->wg_iface, specs, count, errors);
+        if (ret == NB_SUCCESS || ret == NB_ERROR) {
+            int evicted = 0;
+            for (int i = 0; i < count; i++) {
+                if (errors[i] == NB_SUCCESS) {
+                    nb_peer_table_by_id(engine->peers, ids[i])->flags &= ~NB_PEER_INSTALLED;
+                    evicted++;
+                }
+            }
+            engine->evictions += evicted;
+            NB_LOG_INFO("Evicted %d idle peer(s)", evicted);
+        }
+    }
+
+    free(specs);
+    free(ids);
+    free(errors);
+    return ret;
+}
+
+/* Install the peers trapped since the last read */
+static void lazy_trap(nb_engine_t *engine) {
+    int ret = lazy_activate(engine);
+    if (ret != NB_SUCCESS) {
+        NB_LOG_WARN("Failed to read trapped traffic (error %d)", ret);
+    }
+}
+
+/* Repair routes someone else deleted or changed */
+static int routes_check(nb_engine_t *engine) {
+    int repaired = 0;
+    int ret = route_check_drift(engine->route_mgr, &repaired);
+    if (ret != NB_SUCCESS) {
+        NB_LOG_WARN("Route drift check failed (error %d)", ret);
+    } else if (repaired > 0) {
+        NB_LOG_INFO("Repaired %d drifted route(s)", repaired);
+    }
+    return ret;
+}
+
+/* One dump serves both the sampler and the idle check */
+static int device_poll(nb_engine_t *engine, int sample, int evict) {
+    int ret = NB_SUCCESS;
+    wg_device_t *dev = NULL;
+    int err = wg_iface_get_device(engine->wg_iface, &dev);
+    if (err != NB_SUCCESS) {
+        NB_LOG_WARN("Failed to read device (error %d)", err);
+        ret = err;
+    } else {
+        if (sample) {
+            err = nb_stats_sample(engine->stats, dev, clock_ms(CLOCK_REALTIME));
+            if (err != NB_SUCCESS) {
+                NB_LOG_WARN("Failed to sample peer statistics (error %d)", err);
+                ret = err;
+            }
+        }
+        if (evict) {
+            err = lazy_evict(engine, dev);
+            if (err != NB_SUCCESS) {
+                NB_LOG_WARN("Failed to evict idle peers (error %d)", err);
+                ret = err;
+            }
+        }
+        wg_device_free(dev);
+    }
+
+    if (engine->stats) {
+        nb_peer_metrics_t m;
+        nb_engine_peer_metrics(engine, &m);
+        nb_stats_gauges_t g = {
+            .peers_known = (uint32_t)m.known,
+            .peers_active = (uint32_t)m.active,
+            .activations = m.activations,
+            .evictions = m.evictions,
+        };
+        nb_stats_set_gauges(engine->stats, &g);
+    }
+
+    return ret;
+}
+
+int nb_engine_tick(nb_engine_t *engine) {
+    if (!engine) {
+        return NB_ERROR_INVALID;
+    }
+    if (!engine->running || !engine->wg_iface) {
+        return NB_SUCCESS;
+    }
+
+    int ret = NB_SUCCESS;
+    int64_t now = clock_ms(CLOCK_MONOTONIC);
+
+    if (engine->lazy) {
+        lazy_trap(engine);
+    }
+
+    if (engine->route_mgr && engine->route_mgr->backend == ROUTE_BACKEND_NETLINK &&
+        now >= engine->routes_due_ms) {
+        engine->routes_due_ms = now + ROUTE_CHECK_MS;
+        int err = routes_check(engine);
+        if (err != NB_SUCCESS) {
+            ret = err;
+        }
+    }
+
+    int sample = engine->stats && now >= engine->stats_due_ms;
+    int evict = engine->lazy && now >= engine->lazy_due_ms;
+    if (!sample && !evict) {
+        return ret;
+    }
+
+    /* Skip missed rounds instead of running them in a burst */
+    while (sample && engine->stats_due_ms <= now) {
+        engine->stats_due_ms += (int64_t)engine->config->stats_interval * 1000;
+    }
+    while (evict && engine->lazy_due_ms <= now) {
+        engine->lazy_due_ms += LAZY_CHECK_MS;
+    }
+
+    int err = device_poll(engine, sample, evict);
+    return err != NB_SUCCESS ? err : ret;
+}
+
+int nb_engine_peer_metrics(const nb_engine_t *engine, nb_peer_metrics_t *out) {
+    if (!engine || !out) {
+        return NB_ERROR_INVALID;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->known = nb_peer_table_count(engine->peers);
+    for (int i = 0; i < out->known; i++) {
+        if (!engine->lazy || (nb_peer_table_at(engine->peers, i)->flags & NB_PEER_INSTALLED)) {
+            out->active++;
+        }
+    }
+    out->activations = engine->activations;
+    out->evictions = engine->evictions;
+    out->traps = engine->traps;
+    return NB_SUCCESS;
+}
+
+static void on_routes_timer(nb_loop_t *loop, nb_loop_timer_t *timer, void *ctx) {
+    nb_engine_t *engine = ctx;
+
+    (void)loop;
+    routes_check(engine);
+    /* After an event-driven check the period starts over */
+    if (engine->routes_pending) {
+        engine->routes_pending = 0;
+        nb_loop_timer_arm(timer, ROUTE_CHECK_MS, ROUTE_CHECK_MS);
+    }
+}
+
+static void on_route_event(nb_loop_t *loop, int fd, uint32_t events, void *ctx) {
+    nb_engine_t *engine = ctx;
+
+    (void)loop;
+    (void)fd;
+    (void)events;
+    int changed = route_monitor_read(engine->route_mgr);
+    if (changed < 0) {
+        NB_LOG_WARN("Failed to read route notifications (error %d)", changed);
+    }
+    if (changed != 0 && !engine->routes_pending) {
+        engine->routes_pending = 1;
+        nb_loop_timer_arm(engine->routes_timer, ROUTE_EVENT_DELAY_MS, ROUTE_CHECK_MS);
+    }
+}
+
+static void on_stats_timer(nb_loop_t *loop, nb_loop_timer_t *timer, void *ctx) {
+    (void)loop;
+    (void)timer;
+    device_poll(ctx, 1, 0);
+}
+
+static void on_lazy_timer(nb_loop_t *loop, nb_loop_timer_t *timer, void *ctx) {
+    (void)loop;
+    (void)timer;
+    device_poll(ctx, 0, 1);
+}
+
+static void on_nflog(nb_loop_t *loop, int fd, uint32_t events, void *ctx) {
+    (void)loop;
+    (void)fd;
+    (void)events;
+    lazy_trap(ctx);
+}
+
+/* Drop the attached helper; later changes come through PeersFile again */
+static void delta_detach(nb_engine_t *engine) {
+    if (engine->delta) {
+        nb_loop_del_fd(engine->loop, nb_delta_ring_eventfd(engine->delta));
+        nb_delta_ring_close(engine->delta);
+        engine->delta = NULL;
+    }
+    if (engine->delta_conn_fd >= 0) {
+        nb_loop_del_fd(engine->loop, engine->delta_conn_fd);
+        close(engine->delta_conn_fd);
+        engine->delta_conn_fd = -1;
+    }
+}
+
+/* Append a NB_DELTA_PEER_SET record; the payload is copied out of shared memory first */
+static int delta_peer_set(peer_specs_t *ps, const uint8_t *payload, size_t len) {
+    peers_snap_peer_t p;
+    if (len < sizeof(p)) {
+        return NB_ERROR_INVALID;
+    }
+    memcpy(&p, payload, sizeof(p));
+    if (len < sizeof(p) + (size_t)p.prefix_count * sizeof(nb_prefix_t)) {
+        return NB_ERROR_INVALID;
+    }
+
+    int ret = peer_specs_reserve(ps, 1, p.prefix_count);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+    nb_prefix_t *ips = &ps->ips[ps->ips_used];
+    memcpy(ips, payload + sizeof(p), (size_t)p.prefix_count * sizeof(nb_prefix_t));
+    for (int i = 0; i < p.prefix_count; i++) {
+        if (!nb_prefix_valid(&ips[i])) {
+            return NB_ERROR_INVALID;
+        }
+    }
+
+    /* A full description of the peer: allowed IPs are replaced, keepalive 0 disables */
+    wg_peer_spec_t *spec = &ps->specs[ps->count];
+    memset(spec, 0, sizeof(*spec));
+    memcpy(spec->public_key, p.public_key, WG_KEY_LEN);
+    spec->allowed_ips_count = p.prefix_count;
+    peers_snap_endpoint(&p, &spec->endpoint);
+    spec->keepalive = p.keepalive;
+    ps->first[ps->count] = ps->ips_used;
+    ps->source[ps->count] = ps->count;
+    ps->ips_used += p.prefix_count;
+    ps->count++;
+    return NB_SUCCESS;
+}
+
+static int delta_peer_remove(peer_specs_t *ps, const uint8_t *payload, size_t len) {
+    if (len < WG_KEY_LEN) {
+        return NB_ERROR_INVALID;
+    }
+    int ret = peer_specs_reserve(ps, 1, 0);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+    wg_peer_spec_t *spec = &ps->specs[ps->count];
+    memset(spec, 0, sizeof(*spec));
+    memcpy(spec->public_key, payload, WG_KEY_LEN);
+    spec->remove = 1;
+    ps->first[ps->count] = -1;
+    ps->source[ps->count] = ps->count;
+    ps->count++;
+    return NB_SUCCESS;
+}
+
+/* Apply the peer records gathered so far as one batch */
+static void delta_flush_peers(nb_engine_t *engine, peer_specs_t *ps) {
+    if (ps->count == 0) {
+        return;
+    }
+    peer_specs_finish(ps);
+    if (apply_specs(engine, ps, NULL) != NB_SUCCESS) {
+        NB_LOG_WARN("Some peer deltas could not be applied");
+    }
+    memset(ps, 0, sizeof(*ps));
+}
+
+/* Route records: ROUTE_ADD, ROUTE_REMOVE and ROUTE_SYNC (a list) */
+static int delta_routes(nb_engine_t *engine, uint16_t type, const uint8_t *payload, size_t len) {
+    nb_delta_routes_t head = { .count = 1 };
+    if (type == NB_DELTA_ROUTE_SYNC) {
+        if (len < sizeof(head)) {
+            return NB_ERROR_INVALID;
+        }
+        memcpy(&head, payload, sizeof(head));
+        payload += sizeof(head);
+        len -= sizeof(head);
+    }
+    if (len / sizeof(nb_delta_route_t) < head.count) {
+        return NB_ERROR_INVALID;
+    }
+    if (!engine->route_mgr) {
+        return NB_SUCCESS;
+    }
+
+    int count = (int)head.count;
+    route_config_t *routes = calloc(count > 0 ? count : 1, sizeof(route_config_t));
+    char (*nets)[NB_PREFIX_STRLEN] = calloc(count > 0 ? count : 1, NB_PREFIX_STRLEN);
+    if (!routes || !nets) {
+        free(routes);
+        free(nets);
+        return NB_ERROR_SYSTEM;
+    }
+    for (int i = 0; i < count; i++) {
+        nb_delta_route_t r;
+        memcpy(&r, payload + (size_t)i * sizeof(r), sizeof(r));
+        if (!nb_prefix_valid(&r.network)) {
+            free(routes);
+            free(nets);
+            return NB_ERROR_INVALID;
+        }
+        routes[i].network = (char *)nb_prefix_format(&r.network, nets[i], NB_PREFIX_STRLEN);
+        routes[i].device = engine->wg_iface->name;
+        routes[i].metric = (int)r.metric;
+    }
+
+    int ret = NB_SUCCESS;
+    if (type == NB_DELTA_ROUTE_SYNC) {
+        ret = route_sync(engine->route_mgr, routes, count) == 0 ? NB_SUCCESS : NB_ERROR;
+    } else if (type == NB_DELTA_ROUTE_ADD) {
+        ret = route_add(engine->route_mgr, &routes[0]);
+    } else if (route_remove(engine->route_mgr, routes[0].network) == NB_ERROR_NOTFOUND) {
+        ret = NB_SUCCESS;
+    }
+    if (ret != NB_SUCCESS) {
+        NB_LOG_WARN("Route delta %s could not be applied", count == 1 ? routes[0].network : "(sync)");
+    }
+    free(routes);
+    free(nets);
+    return NB_SUCCESS;
+}
+
+/* Apply a peer or route record; peer records gather in ps until another type comes */
+static int delta_apply(nb_engine_t *engine, peer_specs_t *ps, uint16_t type, const uint8_t *payload, size_t len) {
+    if (type == NB_DELTA_PEER_SET) {
+        return delta_peer_set(ps, payload, len);
+    }
+    if (type == NB_DELTA_PEER_REMOVE) {
+        return delta_peer_remove(ps, payload, len);
+    }
+    delta_flush_peers(engine, ps);
+    if (type == NB_DELTA_ROUTE_ADD || type == NB_DELTA_ROUTE_REMOVE || type == NB_DELTA_ROUTE_SYNC) {
+        return delta_routes(engine, type, payload, len);
+    }
+    NB_LOG_DEBUG("Skipping delta record type %u", type);
+    return NB_SUCCESS;
+}
+
+/*
+ * Apply the JournalFile records after journal_seq, the last one applied.
+ * Runs after a snapshot sync and whenever the journal grows; a journal
+ * the helper compacted is opened again.
+ */
+static void journal_tail(nb_engine_t *engine) {
+    const char *path = engine->config->journal_file;
+    const nb_journal_record_t *rec;
+    peer_specs_t ps;
+    uint64_t n = 0;
+    int ret;
+
+    if (!path || !engine->journal_synced) {
+        return;
+    }
+    if (engine->journal && nb_journal_replaced(engine->journal)) {
+        nb_journal_close(engine->journal);
+        engine->journal = NULL;
+        engine->journal_broken = 0;
+    }
+    if (!engine->journal) {
+        ret = nb_journal_open(path, &engine->journal);
+        if (ret != NB_SUCCESS) {
+            if (ret != NB_ERROR_NOTFOUND) {
+                NB_LOG_WARN("Cannot open journal %s (error %d)", path, ret);
+            }
+            return;
+        }
+    }
+    if (engine->journal_broken) {
+        return;
+    }
+    if (nb_journal_base_seq(engine->journal) > engine->journal_seq) {
+        /* Compacted past us: the snapshot holding the missing records is due first */
+        NB_LOG_DEBUG("Journal %s starts after %llu, waiting for the snapshot at %llu", path,
+                     (unsigned long long)nb_journal_base_seq(engine->journal),
+                     (unsigned long long)engine->journal_seq);
+        return;
+    }
+
+    memset(&ps, 0, sizeof(ps));
+    while ((ret = nb_journal_next(engine->journal, &rec)) > 0) {
+        if (rec->seq <= engine->journal_seq) {
+            continue;
+        }
+        /* The journal itself is what a resync would reload */
+        if (rec->type != NB_DELTA_RESYNC &&
+            delta_apply(engine, &ps, rec->type, (const uint8_t *)(rec + 1), rec->size - sizeof(*rec)) != NB_SUCCESS) {
+            NB_LOG_ERROR("Invalid journal record %llu (type %u)", (unsigned long long)rec->seq, rec->type);
+            ret = NB_ERROR_INVALID;
+            break;
+        }
+        engine->journal_seq = rec->seq;
+        n++;
+    }
+    delta_flush_peers(engine, &ps);
+    peer_specs_free(&ps);
+    engine->journal_records += n;
+
+    if (ret < 0) {
+        engine->journal_broken = 1;
+        NB_LOG_WARN("Stopped reading %s after record %llu, waiting for the helper to compact it",
+                    path, (unsigned long long)engine->journal_seq);
+    } else if (n > 0) {
+        NB_LOG_DEBUG("Applied %llu journal record(s) up to %llu", (unsigned long long)n,
+                     (unsigned long long)engine->journal_seq);
+    }
+}
+
+/*
+ * Sync the peers to PeersFile (a binary snapshot or JSON). With JournalFile
+ * a snapshot only holding journal records already applied is skipped.
+ */
+static void peers_reload(nb_engine_t *engine) {
+    const char *path = engine->config->peers_file;
+    peers_snap_t *snap = NULL;
+    int ret, count;
+
+    if (peers_snap_is_snapshot(path)) {
+        if (peers_snap_open(path, &snap) != NB_SUCCESS) {
+            NB_LOG_WARN("Failed to map peers from %s", path);
+            return;
+        }
+        uint64_t seq = snap->hdr->journal_seq;
+        if (engine->config->journal_file && engine->journal_synced && seq != 0 && seq <= engine->journal_seq) {
+            NB_LOG_DEBUG("%s holds journal records up to %llu, already applied", path, (unsigned long long)seq);
+            peers_snap_close(snap);
+            journal_tail(engine);
+            return;
+        }
+        ret = nb_engine_sync_peers_snap(engine, snap);
+        count = snap->peer_count;
+        peers_snap_close(snap);
+
+        /* Read the journal again if we went past the snapshot (a new helper) */
+        if (engine->journal && nb_journal_seq(engine->journal) > seq) {
+            nb_journal_close(engine->journal);
+            engine->journal = NULL;
+            engine->journal_broken = 0;
+        }
+        engine->journal_seq = seq;
+        engine->journal_synced = 1;
+    } else {
+        if (engine->config->journal_file) {
+            NB_LOG_WARN("JournalFile needs a peer snapshot as PeersFile, not tailing %s",
+                        engine->config->journal_file);
+        }
+        ret = nb_engine_sync_peers_json(engine, path, &count);
+        if (count < 0) {
+            NB_LOG_WARN("Failed to load peers from %s", path);
+            return;
+        }
+    }
+
+    engine->peer_reloads++;
+    if (ret != NB_SUCCESS) {
+        NB_LOG_WARN("Some peers from %s could not be applied (error %d)", path, ret);
+    } else {
+        NB_LOG_INFO("Synced %d peer(s) from %s", count, path);
+    }
+    journal_tail(engine);
+}
+
+static void on_peers_timer(nb_loop_t *loop, nb_loop_timer_t *timer, void *ctx) {
+    (void)loop;
+    (void)timer;
+    peers_reload(ctx);
+}
+
+/* Name of the file in path */
+static const char *base_name(const char *path) {
+    return strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+}
+
+/*
+ * The helper writes PeersFile in place or renames a new one over it; the
+ * journal grows by appends and is renamed over when compacted.
+ */
+static void on_peers_event(nb_loop_t *loop, int fd, uint32_t events, void *ctx) {
+    nb_engine_t *engine = ctx;
+    const char *name = base_name(engine->config->peers_file);
+    const char *journal = engine->config->journal_file ? base_name(engine->config->journal_file) : NULL;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int hit = 0, grew = 0;
+    ssize_t n;
+
+    (void)loop;
+    (void)events;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (ev->len == 0) {
+                continue;
+            }
+            if (ev->wd == engine->peers_wd && (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) &&
+                strcmp(ev->name, name) == 0) {
+                hit = 1;
+            }
+            if (journal && ev->wd == engine->journal_wd && strcmp(ev->name, journal) == 0) {
+                grew = 1;
+            }
+        }
+    }
+    /* An attached helper announces its file writes in the ring (NB_DELTA_RESYNC) */
+    if (engine->delta) {
+        return;
+    }
+    if (hit) {
+        nb_loop_timer_arm(engine->peers_timer, PEERS_SETTLE_MS, 0);
+    }
+    /* Appends are complete records or get finished later; no need to settle */
+    if (grew) {
+        journal_tail(engine);
+    }
+}
+
+/* Watch the directories of PeersFile and JournalFile; the files may be replaced */
+static int peers_watch(nb_engine_t *engine) {
+    char *copy = nb_strdup(engine->config->peers_file);
+    char *jcopy = engine->config->journal_file ? nb_strdup(engine->config->journal_file) : NULL;
+    if (!copy || (engine->config->journal_file && !jcopy)) {
+        free(copy);
+        return NB_ERROR_SYSTEM;
+    }
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || (engine->peers_wd = inotify_add_watch(fd, dirname(copy), IN_CLOSE_WRITE | IN_MOVED_TO)) < 0 ||
+        (jcopy && (engine->journal_wd = inotify_add_watch(fd, dirname(jcopy),
+                                                          IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO |
+                                                          IN_MASK_ADD)) < 0) ||
+        nb_loop_add_fd(engine->loop, fd, EPOLLIN, on_peers_event, engine) != NB_SUCCESS) {
+        NB_LOG_WARN("Cannot watch %s: %s", engine->config->peers_file, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        engine->peers_wd = engine->journal_wd = -1;
+        free(copy);
+        free(jcopy);
+        return NB_ERROR_SYSTEM;
+    }
+    free(copy);
+    free(jcopy);
+    engine->peers_fd = fd;
+    return NB_SUCCESS;
+}
+
+/*
+ * Apply published records in order. Consecutive peer records go to the
+ * device as one batch; a route or resync record first flushes them. The
+ * last journal position the helper sent becomes journal_seq once they are
+ * applied. Returns 1 if records are left (the batch limit was hit), 0 if the ring
+ * is empty, NB_ERROR_INVALID if the helper must be dropped.
+ */
+static int delta_drain(nb_engine_t *engine) {
+    nb_delta_ring_t *ring = engine->delta;
+    nb_delta_record_t rec;
+    const void *payload;
+    peer_specs_t ps;
+    uint64_t journal_seq = 0;
+    int n = 0, ret = 0;
+
+    memset(&ps, 0, sizeof(ps));
+    while (n < DELTA_BATCH && (ret = nb_delta_ring_next(ring, &rec, &payload)) > 0) {
+        size_t len = rec.size - sizeof(rec);
+        uint16_t type = rec.type;
+        n++;
+
+        if (type == NB_DELTA_RESYNC) {
+            delta_flush_peers(engine, &ps);
+            if (engine->config->peers_file) {
+                peers_reload(engine);
+            } else {
+                NB_LOG_WARN("Delta resync without PeersFile, peers may be stale");
+            }
+            ret = NB_SUCCESS;
+        } else if (type == NB_DELTA_JOURNAL_SEQ) {
+            /* Takes effect once the peers before it are flushed */
+            ret = len >= sizeof(journal_seq) ? NB_SUCCESS : NB_ERROR_INVALID;
+            if (ret == NB_SUCCESS) {
+                memcpy(&journal_seq, payload, sizeof(journal_seq));
+            }
+        } else {
+            ret = delta_apply(engine, &ps, type, payload, len);
+        }
+        if (ret != NB_SUCCESS) {
+            NB_LOG_ERROR("Invalid delta record %llu (type %u)", (unsigned long long)rec.seq, type);
+            ret = NB_ERROR_INVALID;
+            break;
+        }
+    }
+    delta_flush_peers(engine, &ps);
+    peer_specs_free(&ps);
+    engine->delta_records += n;
+    nb_delta_ring_release(ring);
+
+    /* The journal records the helper published need not be read after a detach */
+    if (engine->journal_synced && journal_seq > engine->journal_seq) {
+        engine->journal_seq = journal_seq;
+    }
+
+    if (ret < 0) {
+        return ret;
+    }
+    return n == DELTA_BATCH ? 1 : 0;
+}
+
+static void on_delta_wakeup(nb_loop_t *loop, int fd, uint32_t events, void *ctx) {
+    nb_engine_t *engine = ctx;
+    int ret;
+
+    (void)loop;
+    (void)fd;
+    (void)events;
+    engine->delta_wakeups++;
+    do {
+        ret = delta_drain(engine);
+    } while (ret == 0 && nb_delta_ring_sleep(engine->delta));
+
+    if (ret < 0) {
+        NB_LOG_WARN("Dropping the delta channel, reloading %s",
+                    engine->config->peers_file ? engine->config->peers_file : "(none)");
+        delta_detach(engine);
+        if (engine->config->peers_file) {
+            peers_reload(engine);
+        }
+    } else if (ret > 0) {
+        /* More records are waiting: come back after the other events */
+        uint64_t one = 1;
+        if (write(nb_delta_ring_eventfd(engine->delta), &one, sizeof(one)) < 0) {
+            NB_LOG_WARN("Cannot requeue delta wakeup: %s", strerror(errno));
+        }
+    }
+}
+
+/* The helper sends nothing after attaching; readable means it went away */
+static void on_delta_conn(nb_loop_t *loop, int fd, uint32_t events, void *ctx) {
+    nb_engine_t *engine = ctx;
+    char buf[64];
+
+    (void)loop;
+    (void)events;
+    ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n > 0 || (n < 0 && (errno == EAGAIN || errno == EINTR))) {
+        return;
+    }
+
+    /* Apply what it published before leaving */
+    while (delta_drain(engine) > 0) {
+    }
+    NB_LOG_INFO("Helper detached from the delta channel (%llu record(s) applied in %llu wakeup(s))",
+                (unsigned long long)engine->delta_records, (unsigned long long)engine->delta_wakeups);
+    delta_detach(engine);
+    /* Records it journaled after the last publish */
+    journal_tail(engine);
+}
+
+static void on_delta_accept(nb_loop_t *loop, int fd, uint32_t events, void *ctx) {
+    nb_engine_t *engine = ctx;
+    nb_delta_ring_t *ring = NULL;
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+
+    (void)events;
+    int conn = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (conn < 0) {
+        return;
+    }
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0 || cred.uid != geteuid()) {
+        NB_LOG_WARN("Rejecting delta channel peer (uid %d)", cred_len == sizeof(cred) ? (int)cred.uid : -1);
+        close(conn);
+        return;
+    }
+
+    /* One producer at a time: a new helper replaces the old one */
+    if (engine->delta) {
+        while (delta_drain(engine) > 0) {
+        }
+        delta_detach(engine);
+    }
+
+    if (nb_delta_ring_create(0, &ring) != NB_SUCCESS || nb_delta_ring_send(ring, conn) != NB_SUCCESS ||
+        nb_loop_add_fd(loop, nb_delta_ring_eventfd(ring), EPOLLIN, on_delta_wakeup, engine) != NB_SUCCESS) {
+        NB_LOG_WARN("Cannot attach the helper to a delta ring");
+        nb_delta_ring_close(ring);
+        close(conn);
+        return;
+    }
+    if (nb_loop_add_fd(loop, conn, EPOLLIN | EPOLLRDHUP, on_delta_conn, engine) != NB_SUCCESS) {
+        nb_loop_del_fd(loop, nb_delta_ring_eventfd(ring));
+        nb_delta_ring_close(ring);
+        close(conn);
+        return;
+    }
+    engine->delta = ring;
+    engine->delta_conn_fd = conn;
+    nb_delta_ring_sleep(ring);
+    NB_LOG_INFO("Helper attached to the delta channel (pid %d)", (int)cred.pid);
+}
+
+/* Listen on DeltaSocket for the helper */
+static int delta_listen(nb_engine_t *engine) {
+    const char *path = engine->config->delta_socket;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        NB_LOG_WARN("DeltaSocket path too long: %s", path);
+        return NB_ERROR_INVALID;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd >= 0) {
+        unlink(path);
+    }
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        chmod(path, 0600) < 0 || listen(fd, 4) < 0 ||
+        nb_loop_add_fd(engine->loop, fd, EPOLLIN, on_delta_accept, engine) != NB_SUCCESS) {
+        NB_LOG_WARN("Cannot listen on %s: %s", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NB_ERROR_SYSTEM;
+    }
+    engine->delta_listen_fd = fd;
+    NB_LOG_INFO("Delta channel listening on %s", path);
+    return NB_SUCCESS;
+}
+
+int nb_engine_attach(nb_engine_t *engine, nb_loop_t *loop) {
+    if (!engine || !loop) {
+        return NB_ERROR_INVALID;
+    }
+    if (!engine->running || !engine->wg_iface || engine->loop) {
+        NB_LOG_ERROR("Engine not running or already attached");
+        return NB_ERROR_INVALID;
+    }
+
+    engine->loop = loop;
+    route_manager_t *mgr = engine->route_mgr;
+    int drift = mgr && mgr->backend == ROUTE_BACKEND_NETLINK;
+
+    if ((drift && !(engine->routes_timer = nb_loop_timer_new(loop, on_routes_timer, engine))) ||
+        (engine->stats && !(engine->stats_timer = nb_loop_timer_new(loop, on_stats_timer, engine))) ||
+        (engine->lazy && !(engine->lazy_timer = nb_loop_timer_new(loop, on_lazy_timer, engine))) ||
+        (engine->config->peers_file &&
+         !(engine->peers_timer = nb_loop_timer_new(loop, on_peers_timer, engine)))) {
+        nb_engine_detach(engine);
+        return NB_ERROR_SYSTEM;
+    }
+
+    if (drift) {
+        nb_loop_timer_arm(engine->routes_timer, ROUTE_CHECK_MS, ROUTE_CHECK_MS);
+        int fd = route_monitor_open(mgr);
+        if (fd >= 0 && nb_loop_add_fd(loop, fd, EPOLLIN, on_route_event, engine) == NB_SUCCESS) {
+            engine->routes_fd = fd;
+        } else {
+            NB_LOG_WARN("Route notifications not available, checking every %ds", ROUTE_CHECK_MS / 1000);
+            route_monitor_close(mgr);
+        }
+    }
+    if (engine->stats) {
+        nb_loop_timer_arm(engine->stats_timer, 0, (int64_t)engine->config->stats_interval * 1000);
+    }
+    if (engine->lazy) {
+        nb_loop_timer_arm(engine->lazy_timer, LAZY_CHECK_MS, LAZY_CHECK_MS);
+        if (nb_loop_add_fd(loop, nb_nflog_fd(&engine->nflog), EPOLLIN, on_nflog, engine) != NB_SUCCESS) {
+            NB_LOG_WARN("Cannot watch the NFLOG socket, lazy peers will not be activated");
+        }
+    }
+    if (engine->config->peers_file) {
+        peers_watch(engine);
+        if (access(engine->config->peers_file, F_OK) == 0) {
+            peers_reload(engine);
+        } else {
+            NB_LOG_INFO("Waiting for %s", engine->config->peers_file);
+        }
+    }
+    if (engine->config->delta_socket) {
+        delta_listen(engine);
+    }
+    return NB_SUCCESS;
+}
+
+void nb_engine_detach(nb_engine_t *engine) {
+    if (!engine || !engine->loop) {
+        return;
+    }
+
+    nb_loop_timer_free(engine->routes_timer);
+    nb_loop_timer_free(engine->stats_timer);
+    nb_loop_timer_free(engine->lazy_timer);
+    nb_loop_timer_free(engine->peers_timer);
+    engine->routes_timer = engine->stats_timer = engine->lazy_timer = engine->peers_timer = NULL;
+    engine->routes_pending = 0;
+
+    if (engine->routes_fd >= 0) {
+        nb_loop_del_fd(engine->loop, engine->routes_fd);
+        route_monitor_close(engine->route_mgr);
+        engine->routes_fd = -1;
+    }
+    if (engine->nflog.nl.fd >= 0) {
+        nb_loop_del_fd(engine->loop, engine->nflog.nl.fd);
+    }
+    if (engine->peers_fd >= 0) {
+        nb_loop_del_fd(engine->loop, engine->peers_fd);
+        close(engine->peers_fd);
+        engine->peers_fd = -1;
+        engine->peers_wd = engine->journal_wd = -1;
+    }
+    nb_journal_close(engine->journal);
+    engine->journal = NULL;
+    engine->journal_synced = engine->journal_broken = 0;
+    delta_detach(engine);
+    if (engine->delta_listen_fd >= 0) {
+        nb_loop_del_fd(engine->loop, engine->delta_listen_fd);
+        close(engine->delta_listen_fd);
+        unlink(engine->config->delta_socket);
+        engine->delta_listen_fd = -1;
+    }
+    engine->loop = NULL;
+}
+
+int nb_engine_peer_rate(const nb_engine_t *engine, const char *public_key, nb_peer_rate_t *out) {
+    uint8_t key[WG_KEY_LEN];
+
+    if (!engine || !public_key || !out || wg_key_from_base64(key, public_key) != NB_SUCCESS) {
+        return NB_ERROR_INVALID;
+    }
+    if (!engine->stats) {
+        return NB_ERROR_NOTFOUND;
+    }
+    return nb_stats_rate(engine->stats, key, out);
+}
+
+const nb_peer_record_t* nb_engine_peer_for_ip(const nb_engine_t *engine, const char *ip) {
+    nb_prefix_t key;
+    uint32_t id;
+
+    if (!engine || !ip || nb_prefix_parse(ip, &key) != NB_SUCCESS ||
+        nb_lpm_lookup(engine->allowed_ips, &key, &id, NULL) != NB_SUCCESS) {
+        return NULL;
+    }
+    return nb_peer_table_by_id(engine->peers, id);
 }
 
 void nb_peer_info_free(nb_peer_info_t *peer) {
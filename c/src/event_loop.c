@@ -0,0 +1,404 @@
+/**
+ * event_loop.c - epoll based event loop
+ *
+ * Every watch (descriptor, timer or the signalfd) is a small heap object
+ * whose address is the epoll cookie. Removing a watch while events are
+ * being dispatched only unlinks it; it is freed once the current batch
+ * is done, so events still queued for it in that batch are skipped
+ * instead of touching freed memory.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#define _GNU_SOURCE
+#include "event_loop.h"
+#include "common.h"
+#include <signal.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+/* Events handled per epoll_wait() */
+#define LOOP_BATCH      32
+
+typedef enum {
+    WATCH_FD = 0,
+    WATCH_TIMER,
+    WATCH_SIGNAL
+} watch_kind_t;
+
+typedef struct watch {
+    int fd;
+    watch_kind_t kind;
+    int dead;                   /* Removed during dispatch, freed afterwards */
+    nb_loop_fd_cb_t cb;         /* WATCH_FD */
+    void *ctx;
+    nb_loop_timer_t *timer;     /* WATCH_TIMER */
+    struct watch *next;
+} watch_t;
+
+struct nb_loop_timer {
+    nb_loop_t *loop;
+    watch_t *watch;             /* Its timerfd */
+    nb_loop_timer_cb_t cb;
+    void *ctx;
+    int armed;
+    int periodic;
+};
+
+struct nb_loop {
+    int epfd;
+    watch_t *watches;           /* Live watches */
+    watch_t *dead;              /* Removed during the current dispatch */
+    int dispatching;            /* Nesting depth of dispatch */
+    int stop;
+    uint64_t wakeups;
+
+    /* Signals read from one signalfd */
+    watch_t *signal_watch;
+    sigset_t signals;           /* Taken over by the loop */
+    sigset_t blocked;           /* Of those, already blocked before */
+    struct {
+        nb_loop_signal_cb_t cb;
+        void *ctx;
+    } handlers[NSIG];
+};
+
+nb_loop_t* nb_loop_new(void) {
+    nb_loop_t *loop = calloc(1, sizeof(nb_loop_t));
+    if (!loop) {
+        NB_LOG_ERROR("calloc failed");
+        return NULL;
+    }
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        NB_LOG_ERROR("epoll_create1 failed: %s", strerror(errno));
+        free(loop);
+        return NULL;
+    }
+    sigemptyset(&loop->signals);
+    sigemptyset(&loop->blocked);
+    return loop;
+}
+
+/* Helper: register a new watch for fd */
+static watch_t* watch_add(nb_loop_t *loop, int fd, watch_kind_t kind, uint32_t events) {
+    watch_t *w = calloc(1, sizeof(watch_t));
+    if (!w) {
+        NB_LOG_ERROR("calloc failed");
+        return NULL;
+    }
+    w->fd = fd;
+    w->kind = kind;
+
+    struct epoll_event ev = { .events = events, .data.ptr = w };
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        NB_LOG_ERROR("epoll_ctl(ADD, %d) failed: %s", fd, strerror(errno));
+        free(w);
+        return NULL;
+    }
+    w->next = loop->watches;
+    loop->watches = w;
+    return w;
+}
+
+/* Helper: unregister a watch; freed now or after the current dispatch */
+static void watch_remove(nb_loop_t *loop, watch_t *w) {
+    for (watch_t **p = &loop->watches; *p; p = &(*p)->next) {
+        if (*p == w) {
+            *p = w->next;
+            break;
+        }
+    }
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, w->fd, NULL);
+    if (w->kind != WATCH_FD) {
+        close(w->fd);
+    }
+    free(w->timer);
+    w->timer = NULL;
+
+    if (loop->dispatching) {
+        w->dead = 1;
+        w->next = loop->dead;
+        loop->dead = w;
+    } else {
+        free(w);
+    }
+}
+
+static watch_t* watch_find_fd(const nb_loop_t *loop, int fd) {
+    for (watch_t *w = loop->watches; w; w = w->next) {
+        if (w->kind == WATCH_FD && w->fd == fd) {
+            return w;
+        }
+    }
+    return NULL;
+}
+
+void nb_loop_free(nb_loop_t *loop) {
+    if (!loop) return;
+
+    while (loop->watches) {
+        watch_remove(loop, loop->watches);
+    }
+    while (loop->dead) {
+        watch_t *w = loop->dead;
+        loop->dead = w->next;
+        free(w);
+    }
+
+    /* Give the signals back, except those that were blocked before */
+    sigset_t unblock;
+    sigemptyset(&unblock);
+    for (int sig = 1; sig < NSIG; sig++) {
+        if (sigismember(&loop->signals, sig) == 1 && sigismember(&loop->blocked, sig) != 1) {
+            sigaddset(&unblock, sig);
+        }
+    }
+    sigprocmask(SIG_UNBLOCK, &unblock, NULL);
+
+    close(loop->epfd);
+    free(loop);
+}
+
+int nb_loop_add_fd(nb_loop_t *loop, int fd, uint32_t events, nb_loop_fd_cb_t cb, void *ctx) {
+    if (!loop || fd < 0 || !cb) {
+        return NB_ERROR_INVALID;
+    }
+    if (watch_find_fd(loop, fd)) {
+        return NB_ERROR_EXISTS;
+    }
+
+    watch_t *w = watch_add(loop, fd, WATCH_FD, events);
+    if (!w) {
+        return NB_ERROR_SYSTEM;
+    }
+    w->cb = cb;
+    w->ctx = ctx;
+    return NB_SUCCESS;
+}
+
+int nb_loop_del_fd(nb_loop_t *loop, int fd) {
+    if (!loop) {
+        return NB_ERROR_INVALID;
+    }
+
+    watch_t *w = watch_find_fd(loop, fd);
+    if (!w) {
+        return NB_ERROR_NOTFOUND;
+    }
+    watch_remove(loop, w);
+    return NB_SUCCESS;
+}
+
+nb_loop_timer_t* nb_loop_timer_new(nb_loop_t *loop, nb_loop_timer_cb_t cb, void *ctx) {
+    if (!loop || !cb) {
+        return NULL;
+    }
+
+    nb_loop_timer_t *timer = calloc(1, sizeof(nb_loop_timer_t));
+    if (!timer) {
+        NB_LOG_ERROR("calloc failed");
+        return NULL;
+    }
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        NB_LOG_ERROR("timerfd_create failed: %s", strerror(errno));
+        free(timer);
+        return NULL;
+    }
+    timer->watch = watch_add(loop, fd, WATCH_TIMER, EPOLLIN);
+    if (!timer->watch) {
+        close(fd);
+        free(timer);
+        return NULL;
+    }
+    timer->watch->timer = timer;
+    timer->loop = loop;
+    timer->cb = cb;
+    timer->ctx = ctx;
+    return timer;
+}
+
+static void ms_to_timespec(int64_t ms, struct timespec *ts) {
+    ts->tv_sec = ms / 1000;
+    ts->tv_nsec = (ms % 1000) * 1000000;
+}
+
+int nb_loop_timer_arm(nb_loop_timer_t *timer, int64_t delay_ms, int64_t interval_ms) {
+    if (!timer || delay_ms < 0 || interval_ms < 0) {
+        return NB_ERROR_INVALID;
+    }
+
+    struct itimerspec its;
+    ms_to_timespec(delay_ms, &its.it_value);
+    ms_to_timespec(interval_ms, &its.it_interval);
+    if (delay_ms == 0) {
+        its.it_value.tv_nsec = 1;       /* Zero would disarm */
+    }
+    if (timerfd_settime(timer->watch->fd, 0, &its, NULL) < 0) {
+        NB_LOG_ERROR("timerfd_settime failed: %s", strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+    timer->armed = 1;
+    timer->periodic = interval_ms > 0;
+    return NB_SUCCESS;
+}
+
+void nb_loop_timer_disarm(nb_loop_timer_t *timer) {
+    if (!timer) return;
+
+    struct itimerspec its = { 0 };
+    timerfd_settime(timer->watch->fd, 0, &its, NULL);
+    timer->armed = 0;
+}
+
+int nb_loop_timer_armed(const nb_loop_timer_t *timer) {
+    return timer ? timer->armed : 0;
+}
+
+void nb_loop_timer_free(nb_loop_timer_t *timer) {
+    if (!timer) return;
+    watch_remove(timer->loop, timer->watch);
+}
+
+int nb_loop_add_signal(nb_loop_t *loop, int sig, nb_loop_signal_cb_t cb, void *ctx) {
+    if (!loop || sig <= 0 || sig >= NSIG || !cb) {
+        return NB_ERROR_INVALID;
+    }
+    if (sigismember(&loop->signals, sig) == 1) {
+        return NB_ERROR_EXISTS;
+    }
+
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, sig);
+    if (sigprocmask(SIG_BLOCK, &set, &old) < 0) {
+        NB_LOG_ERROR("Failed to block signal %d: %s", sig, strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+
+    sigset_t mask = loop->signals;
+    sigaddset(&mask, sig);
+    int fd = signalfd(loop->signal_watch ? loop->signal_watch->fd : -1, &mask,
+                      SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0 || (!loop->signal_watch && !(loop->signal_watch = watch_add(loop, fd, WATCH_SIGNAL, EPOLLIN)))) {
+        NB_LOG_ERROR("Failed to handle signal %d: %s", sig, strerror(errno));
+        if (fd >= 0 && !loop->signal_watch) {
+            close(fd);
+        }
+        if (sigismember(&old, sig) != 1) {
+            sigprocmask(SIG_UNBLOCK, &set, NULL);
+        }
+        return NB_ERROR_SYSTEM;
+    }
+
+    loop->signals = mask;
+    if (sigismember(&old, sig) == 1) {
+        sigaddset(&loop->blocked, sig);
+    }
+    loop->handlers[sig].cb = cb;
+    loop->handlers[sig].ctx = ctx;
+    return NB_SUCCESS;
+}
+
+/* Helper: run the callback of an expired timer */
+static void timer_dispatch(nb_loop_t *loop, nb_loop_timer_t *timer) {
+    uint64_t expirations;
+
+    /* Re-armed or disarmed since epoll_wait(): nothing to report */
+    if (read(timer->watch->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+    if (!timer->periodic) {
+        timer->armed = 0;
+    }
+    timer->cb(loop, timer, timer->ctx);
+}
+
+/* Helper: run the callbacks of the pending signals */
+static void signal_dispatch(nb_loop_t *loop, int fd) {
+    struct signalfd_siginfo si;
+
+    while (read(fd, &si, sizeof(si)) == sizeof(si)) {
+        int sig = (int)si.ssi_signo;
+        if (sig > 0 && sig < NSIG && loop->handlers[sig].cb) {
+            loop->handlers[sig].cb(loop, sig, loop->handlers[sig].ctx);
+        }
+    }
+}
+
+int nb_loop_run_once(nb_loop_t *loop, int timeout_ms) {
+    struct epoll_event events[LOOP_BATCH];
+
+    if (!loop) {
+        return NB_ERROR_INVALID;
+    }
+
+    int n = epoll_wait(loop->epfd, events, LOOP_BATCH, timeout_ms);
+    if (n < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        NB_LOG_ERROR("epoll_wait failed: %s", strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+    if (n > 0) {
+        loop->wakeups++;
+    }
+
+    loop->dispatching++;
+    for (int i = 0; i < n; i++) {
+        watch_t *w = events[i].data.ptr;
+        if (w->dead) {
+            continue;
+        }
+        switch (w->kind) {
+        case WATCH_FD:
+            w->cb(loop, w->fd, events[i].events, w->ctx);
+            break;
+        case WATCH_TIMER:
+            timer_dispatch(loop, w->timer);
+            break;
+        case WATCH_SIGNAL:
+            signal_dispatch(loop, w->fd);
+            break;
+        }
+    }
+    if (--loop->dispatching == 0) {
+        while (loop->dead) {
+            watch_t *w = loop->dead;
+            loop->dead = w->next;
+            free(w);
+        }
+    }
+    return n;
+}
+
+int nb_loop_run(nb_loop_t *loop) {
+    if (!loop) {
+        return NB_ERROR_INVALID;
+    }
+
+    loop->stop = 0;
+    while (!loop->stop) {
+        int n = nb_loop_run_once(loop, -1);
+        if (n < 0) {
+            return n;
+        }
+    }
+    return NB_SUCCESS;
+}
+
+void nb_loop_stop(nb_loop_t *loop) {
+    if (loop) {
+        loop->stop = 1;
+    }
+}
+
+uint64_t nb_loop_wakeups(const nb_loop_t *loop) {
+    return loop ? loop->wakeups : 0;
+}
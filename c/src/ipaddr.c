@@ -0,0 +1,221 @@
+/**
+ * ipaddr.c - IP prefix and endpoint helpers
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "ipaddr.h"
+#include "common.h"
+#include <arpa/inet.h>
+#include <ctype.h>
+
+int nb_prefix_parse(const char *str, nb_prefix_t *out) {
+    if (!str || !out) {
+        return NB_ERROR_INVALID;
+    }
+
+    char buf[NB_PREFIX_STRLEN];
+    size_t n = strlen(str);
+    if (n == 0 || n >= sizeof(buf)) {
+        return NB_ERROR_INVALID;
+    }
+    memcpy(buf, str, n + 1);
+
+    int len = -1;
+    char *slash = strchr(buf, '/');
+    if (slash) {
+        *slash = '\0';
+        char *end = NULL;
+        long v = strtol(slash + 1, &end, 10);
+        if (end == slash + 1 || *end != '\0' || v < 0) {
+            return NB_ERROR_INVALID;
+        }
+        len = (int)v;
+    }
+
+    memset(out, 0, sizeof(*out));
+    if (inet_pton(AF_INET, buf, out->addr) == 1) {
+        out->family = AF_INET;
+        if (len < 0) len = 32;
+        if (len > 32) return NB_ERROR_INVALID;
+    } else if (inet_pton(AF_INET6, buf, out->addr) == 1) {
+        out->family = AF_INET6;
+        if (len < 0) len = 128;
+        if (len > 128) return NB_ERROR_INVALID;
+    } else {
+        return NB_ERROR_INVALID;
+    }
+
+    out->len = (uint8_t)len;
+    return NB_SUCCESS;
+}
+
+int nb_prefix_parse_list(const char *str, nb_prefix_t *out, int max) {
+    if (!str || !out) {
+        return NB_ERROR_INVALID;
+    }
+
+    int count = 0;
+    const char *p = str;
+
+    while (*p) {
+        while (*p == ',' || isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+
+        const char *start = p;
+        while (*p && *p != ',' && !isspace((unsigned char)*p)) p++;
+
+        char item[NB_PREFIX_STRLEN];
+        size_t n = (size_t)(p - start);
+        if (n >= sizeof(item) || count >= max) {
+            return NB_ERROR_INVALID;
+        }
+        memcpy(item, start, n);
+        item[n] = '\0';
+
+        if (nb_prefix_parse(item, &out[count]) != NB_SUCCESS) {
+            return NB_ERROR_INVALID;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+const char* nb_prefix_format(const nb_prefix_t *p, char *buf, size_t size) {
+    char addr[INET6_ADDRSTRLEN];
+    if (!inet_ntop(p->family, p->addr, addr, sizeof(addr))) {
+        snprintf(buf, size, "(invalid)");
+        return buf;
+    }
+    snprintf(buf, size, "%s/%u", addr, p->len);
+    return buf;
+}
+
+void nb_prefix_normalize(nb_prefix_t *p) {
+    int bytes = nb_prefix_addr_len(p);
+    int full = p->len / 8;
+    int rem = p->len % 8;
+
+    if (full < bytes && rem) {
+        p->addr[full] &= (uint8_t)(0xff << (8 - rem));
+        full++;
+    }
+    if (full < 16) {
+        memset(p->addr + full, 0, 16 - full);
+    }
+}
+
+int nb_prefix_cmp(const nb_prefix_t *a, const nb_prefix_t *b) {
+    if (a->family != b->family) {
+        return (int)a->family - (int)b->family;
+    }
+    int c = memcmp(a->addr, b->addr, nb_prefix_addr_len(a));
+    if (c != 0) {
+        return c;
+    }
+    return (int)a->len - (int)b->len;
+}
+
+int nb_prefix_contains(const nb_prefix_t *outer, const nb_prefix_t *inner) {
+    if (outer->family != inner->family || outer->len > inner->len) {
+        return 0;
+    }
+
+    int full = outer->len / 8;
+    int rem = outer->len % 8;
+
+    if (memcmp(outer->addr, inner->addr, full) != 0) {
+        return 0;
+    }
+    if (rem) {
+        uint8_t mask = (uint8_t)(0xff << (8 - rem));
+        if ((outer->addr[full] & mask) != (inner->addr[full] & mask)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int nb_endpoint_parse(const char *str, nb_endpoint_t *out) {
+    if (!str || !out) {
+        return NB_ERROR_INVALID;
+    }
+
+    char host[INET6_ADDRSTRLEN];
+    const char *port_str;
+
+    memset(out, 0, sizeof(*out));
+
+    if (str[0] == '[') {
+        const char *close = strchr(str, ']');
+        if (!close || close[1] != ':') {
+            return NB_ERROR_INVALID;
+        }
+        size_t n = (size_t)(close - str - 1);
+        if (n >= sizeof(host)) return NB_ERROR_INVALID;
+        memcpy(host, str + 1, n);
+        host[n] = '\0';
+        port_str = close + 2;
+    } else {
+        const char *colon = strrchr(str, ':');
+        if (!colon) {
+            return NB_ERROR_INVALID;
+        }
+        size_t n = (size_t)(colon - str);
+        if (n >= sizeof(host)) return NB_ERROR_INVALID;
+        memcpy(host, str, n);
+        host[n] = '\0';
+        port_str = colon + 1;
+    }
+
+    char *end = NULL;
+    long port = strtol(port_str, &end, 10);
+    if (end == port_str || *end != '\0' || port <= 0 || port > 65535) {
+        return NB_ERROR_INVALID;
+    }
+
+    if (inet_pton(AF_INET, host, &out->in4.sin_addr) == 1) {
+        out->in4.sin_family = AF_INET;
+        out->in4.sin_port = htons((uint16_t)port);
+        return NB_SUCCESS;
+    }
+    if (inet_pton(AF_INET6, host, &out->in6.sin6_addr) == 1) {
+        out->in6.sin6_family = AF_INET6;
+        out->in6.sin6_port = htons((uint16_t)port);
+        return NB_SUCCESS;
+    }
+
+    return NB_ERROR_INVALID;
+}
+
+const char* nb_endpoint_format(const nb_endpoint_t *ep, char *buf, size_t size) {
+    char addr[INET6_ADDRSTRLEN];
+
+    if (ep->sa.sa_family == AF_INET) {
+        inet_ntop(AF_INET, &ep->in4.sin_addr, addr, sizeof(addr));
+        snprintf(buf, size, "%s:%u", addr, ntohs(ep->in4.sin_port));
+    } else if (ep->sa.sa_family == AF_INET6) {
+        inet_ntop(AF_INET6, &ep->in6.sin6_addr, addr, sizeof(addr));
+        snprintf(buf, size, "[%s]:%u", addr, ntohs(ep->in6.sin6_port));
+    } else if (size > 0) {
+        buf[0] = '\0';
+    }
+    return buf;
+}
+
+int nb_endpoint_cmp(const nb_endpoint_t *a, const nb_endpoint_t *b) {
+    if (a->sa.sa_family != b->sa.sa_family) {
+        return 1;
+    }
+    if (a->sa.sa_family == AF_INET) {
+        return a->in4.sin_port != b->in4.sin_port ||
+               a->in4.sin_addr.s_addr != b->in4.sin_addr.s_addr;
+    }
+    if (a->sa.sa_family == AF_INET6) {
+        return a->in6.sin6_port != b->in6.sin6_port ||
+               memcmp(&a->in6.sin6_addr, &b->in6.sin6_addr, 16) != 0;
+    }
+    return 0;
+}
@@ -0,0 +1,286 @@
+/**
+ * journal.c - Append-only journal of peer and route changes
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "journal.h"
+#include "common.h"
+#include "crc32c.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(nb_journal_header_t) == 64, "journal header layout");
+_Static_assert(sizeof(nb_journal_record_t) == 24, "journal record layout");
+
+struct nb_journal {
+    int fd;
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    uint64_t base_seq;
+    uint64_t seq;
+
+    /* Reader: file bytes from offset off; the next record starts at buf + pos */
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    size_t pos;
+    uint64_t off;
+};
+
+static uint32_t header_checksum(const nb_journal_header_t *hdr) {
+    return nb_crc32c(0, hdr, offsetof(nb_journal_header_t, checksum));
+}
+
+static uint32_t record_checksum(const nb_journal_record_t *rec) {
+    uint32_t crc = nb_crc32c(0, rec, offsetof(nb_journal_record_t, checksum));
+    return nb_crc32c(crc, rec + 1, rec->size - sizeof(*rec));
+}
+
+static nb_journal_t* journal_new(const char *path, int fd) {
+    nb_journal_t *j = calloc(1, sizeof(nb_journal_t));
+    struct stat st;
+    if (!j || !(j->path = nb_strdup(path)) || fstat(fd, &st) < 0) {
+        NB_LOG_ERROR("Cannot set up journal %s", path);
+        if (j) free(j->path);
+        free(j);
+        close(fd);
+        return NULL;
+    }
+    j->fd = fd;
+    j->dev = st.st_dev;
+    j->ino = st.st_ino;
+    return j;
+}
+
+int nb_journal_open(const char *path, nb_journal_t **journal_out) {
+    if (!path || !journal_out) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+    *journal_out = NULL;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? NB_ERROR_NOTFOUND : NB_ERROR_SYSTEM;
+    }
+
+    nb_journal_header_t hdr;
+    if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+        memcmp(hdr.magic, NB_JOURNAL_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != NB_JOURNAL_VERSION || hdr.header_size != sizeof(hdr) ||
+        hdr.checksum != header_checksum(&hdr)) {
+        NB_LOG_WARN("Not a journal: %s", path);
+        close(fd);
+        return NB_ERROR_INVALID;
+    }
+
+    nb_journal_t *j = journal_new(path, fd);
+    if (!j) {
+        return NB_ERROR_SYSTEM;
+    }
+    j->base_seq = j->seq = hdr.base_seq;
+    j->off = sizeof(hdr);
+    *journal_out = j;
+    return NB_SUCCESS;
+}
+
+int nb_journal_create(const char *path, uint64_t base_seq, nb_journal_t **journal_out) {
+    if (!path || !journal_out) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+    *journal_out = NULL;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        NB_LOG_ERROR("Cannot create journal %s: %s", path, strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+
+    nb_journal_header_t hdr = {
+        .version = NB_JOURNAL_VERSION,
+        .header_size = sizeof(hdr),
+        .base_seq = base_seq,
+    };
+    memcpy(hdr.magic, NB_JOURNAL_MAGIC, sizeof(hdr.magic));
+    hdr.checksum = header_checksum(&hdr);
+    if (write(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr)) {
+        NB_LOG_ERROR("Cannot write journal %s: %s", path, strerror(errno));
+        close(fd);
+        return NB_ERROR_SYSTEM;
+    }
+
+    nb_journal_t *j = journal_new(path, fd);
+    if (!j) {
+        return NB_ERROR_SYSTEM;
+    }
+    j->base_seq = j->seq = base_seq;
+    *journal_out = j;
+    return NB_SUCCESS;
+}
+
+void nb_journal_close(nb_journal_t *journal) {
+    if (!journal) return;
+
+    close(journal->fd);
+    free(journal->path);
+    free(journal->buf);
+    free(journal);
+}
+
+uint64_t nb_journal_base_seq(const nb_journal_t *journal) {
+    return journal ? journal->base_seq : 0;
+}
+
+uint64_t nb_journal_seq(const nb_journal_t *journal) {
+    return journal ? journal->seq : 0;
+}
+
+int nb_journal_replaced(const nb_journal_t *journal) {
+    struct stat st;
+    if (!journal || stat(journal->path, &st) < 0) {
+        return 1;
+    }
+    return st.st_dev != journal->dev || st.st_ino != journal->ino;
+}
+
+/* Buffer at least need bytes from the next record on; 1 if there are, 0 at end of file */
+static int fill(nb_journal_t *j, size_t need) {
+    if (j->len - j->pos >= need) {
+        return 1;
+    }
+    if (j->pos > 0) {
+        memmove(j->buf, j->buf + j->pos, j->len - j->pos);
+        j->off += j->pos;
+        j->len -= j->pos;
+        j->pos = 0;
+    }
+    if (j->cap < need || j->cap - j->len < 4096) {
+        size_t cap = j->cap ? j->cap * 2 : 64 * 1024;
+        while (cap < need) {
+            cap *= 2;
+        }
+        uint8_t *buf = realloc(j->buf, cap);
+        if (!buf) {
+            NB_LOG_ERROR("realloc failed");
+            return NB_ERROR_SYSTEM;
+        }
+        j->buf = buf;
+        j->cap = cap;
+    }
+
+    while (j->len < need) {
+        ssize_t n = pread(j->fd, j->buf + j->len, j->cap - j->len, (off_t)(j->off + j->len));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            NB_LOG_ERROR("Cannot read journal %s: %s", j->path, strerror(errno));
+            return NB_ERROR_SYSTEM;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        j->len += (size_t)n;
+    }
+    return 1;
+}
+
+/* Whether the file ends with the next record, which is size bytes long */
+static int last_record(const nb_journal_t *j, size_t size) {
+    uint8_t byte;
+    if (j->len - j->pos > size) {
+        return 0;
+    }
+    return pread(j->fd, &byte, 1, (off_t)(j->off + j->pos + size)) == 0;
+}
+
+int nb_journal_next(nb_journal_t *journal, const nb_journal_record_t **rec_out) {
+    if (!journal || !rec_out) {
+        return NB_ERROR_INVALID;
+    }
+    nb_journal_t *j = journal;
+
+    int ret = fill(j, sizeof(nb_journal_record_t));
+    const nb_journal_record_t *rec = (const nb_journal_record_t *)(j->buf + j->pos);
+    if (ret == 1) {
+        uint32_t size = rec->size;
+        if (size < sizeof(*rec) || size % NB_JOURNAL_ALIGN != 0 || size > NB_JOURNAL_MAX_RECORD) {
+            NB_LOG_ERROR("Damaged journal record at %llu in %s",
+                         (unsigned long long)(j->off + j->pos), j->path);
+            return NB_ERROR_INVALID;
+        }
+        ret = fill(j, size);
+        rec = (const nb_journal_record_t *)(j->buf + j->pos);
+    }
+    if (ret == 0) {
+        /* Not all written yet: read it again from the start next time */
+        j->len = j->pos;
+        return 0;
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (rec->checksum != record_checksum(rec)) {
+        if (last_record(j, rec->size)) {
+            /* Torn at the end of the file: still being written, or cut short by a crash */
+            NB_LOG_DEBUG("Journal record at %llu in %s is not complete yet",
+                         (unsigned long long)(j->off + j->pos), j->path);
+            j->len = j->pos;
+            return 0;
+        }
+        NB_LOG_ERROR("Journal record checksum mismatch at %llu in %s",
+                     (unsigned long long)(j->off + j->pos), j->path);
+        return NB_ERROR_INVALID;
+    }
+    if (rec->seq != j->seq + 1) {
+        NB_LOG_ERROR("Journal record %llu follows %llu in %s", (unsigned long long)rec->seq,
+                     (unsigned long long)j->seq, j->path);
+        return NB_ERROR_INVALID;
+    }
+
+    j->seq = rec->seq;
+    j->pos += rec->size;
+    *rec_out = rec;
+    return 1;
+}
+
+int nb_journal_append(nb_journal_t *journal, uint16_t type, const void *payload, size_t len) {
+    if (!journal || (!payload && len > 0)) {
+        return NB_ERROR_INVALID;
+    }
+
+    size_t size = (sizeof(nb_journal_record_t) + len + NB_JOURNAL_ALIGN - 1) & ~(size_t)(NB_JOURNAL_ALIGN - 1);
+    if (size > NB_JOURNAL_MAX_RECORD) {
+        NB_LOG_ERROR("Journal record too large (%zu bytes)", len);
+        return NB_ERROR_INVALID;
+    }
+    nb_journal_record_t *rec = calloc(1, size);
+    if (!rec) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    rec->size = (uint32_t)size;
+    rec->type = type;
+    rec->seq = journal->seq + 1;
+    if (len > 0) {
+        memcpy(rec + 1, payload, len);
+    }
+    rec->checksum = record_checksum(rec);
+
+    /* One write, so readers never see records interleaved */
+    ssize_t n = write(journal->fd, rec, size);
+    free(rec);
+    if (n != (ssize_t)size) {
+        NB_LOG_ERROR("Cannot append to journal %s: %s", journal->path, n < 0 ? strerror(errno) : "short write");
+        return NB_ERROR_SYSTEM;
+    }
+    journal->seq++;
+    return NB_SUCCESS;
+}
@@ -0,0 +1,497 @@
+/**
+ * lpm.c - Longest prefix match trie for allowed IPs
+ *
+ * Every node stores its full (normalized) prefix; a node is either a
+ * stored prefix or an internal branch point with exactly two children.
+ *
+ * The first STRIDE_BITS bits are resolved by a direct-indexed array of
+ * subtrie roots (one per family), so a lookup skips the top of the trie
+ * and walks only the prefixes sharing its first 16 bits. Prefixes shorter
+ * than the stride live in a small separate trie per family that is
+ * consulted when the subtrie has no match.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "lpm.h"
+#include "common.h"
+#include <endian.h>
+
+#define NIL             0
+#define MAX_DEPTH       130     /* One node per prefix length at most, plus root */
+#define STRIDE_BITS     16
+#define STRIDE_SIZE     (1u << STRIDE_BITS)
+
+typedef struct {
+    nb_prefix_t prefix;
+    uint8_t has_value;
+    uint32_t value;
+    uint32_t child[2];
+} node_t;
+
+struct nb_lpm {
+    node_t *nodes;          /* nodes[0] is unused so that 0 can mean "none" */
+    uint32_t cap;
+    uint32_t used;
+    uint32_t free_list;     /* Chained through child[0] */
+    uint32_t root[2];       /* Prefixes shorter than the stride: IPv4, IPv6 */
+    uint32_t *stride[2];    /* Subtrie roots by leading 16 bits: IPv4, IPv6 */
+    int count;
+};
+
+static int family_index(uint8_t family) {
+    return family == AF_INET ? 0 : family == AF_INET6 ? 1 : -1;
+}
+
+static int bit_at(const uint8_t *addr, int i) {
+    return (addr[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+static uint32_t stride_index(const uint8_t *addr) {
+    return ((uint32_t)addr[0] << 8) | addr[1];
+}
+
+/* Link holding the (sub)trie a prefix belongs to */
+static uint32_t* root_link(nb_lpm_t *lpm, const nb_prefix_t *p) {
+    int fi = family_index(p->family);
+    return p->len >= STRIDE_BITS ? &lpm->stride[fi][stride_index(p->addr)] : &lpm->root[fi];
+}
+
+/* Number of leading bits a and b share, at most max (compared as 64-bit words) */
+static inline int common_bits(const uint8_t *a, const uint8_t *b, int max) {
+    uint64_t x, y;
+
+    memcpy(&x, a, 8);
+    memcpy(&y, b, 8);
+    uint64_t d = be64toh(x ^ y);
+    int n;
+    if (d) {
+        n = __builtin_clzll(d);
+    } else if (max <= 64) {
+        return max;
+    } else {
+        memcpy(&x, a + 8, 8);
+        memcpy(&y, b + 8, 8);
+        d = be64toh(x ^ y);
+        n = d ? 64 + __builtin_clzll(d) : 128;
+    }
+    return n < max ? n : max;
+}
+
+/* Make sure two nodes can be allocated without moving the pool */
+static int reserve(nb_lpm_t *lpm) {
+    if (lpm->used + 2 <= lpm->cap) {
+        return NB_SUCCESS;
+    }
+
+    uint32_t cap = lpm->cap ? lpm->cap * 2 : 64;
+    node_t *nodes = realloc(lpm->nodes, cap * sizeof(node_t));
+    if (!nodes) {
+        NB_LOG_ERROR("realloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    lpm->nodes = nodes;
+    lpm->cap = cap;
+    return NB_SUCCESS;
+}
+
+static uint32_t node_new(nb_lpm_t *lpm, const nb_prefix_t *p, int has_value, uint32_t value) {
+    uint32_t n;
+
+    if (lpm->free_list != NIL) {
+        n = lpm->free_list;
+        lpm->free_list = lpm->nodes[n].child[0];
+    } else {
+        n = lpm->used++;
+    }
+
+    node_t *node = &lpm->nodes[n];
+    node->prefix = *p;
+    node->has_value = (uint8_t)has_value;
+    node->value = value;
+    node->child[0] = node->child[1] = NIL;
+    return n;
+}
+
+static void node_release(nb_lpm_t *lpm, uint32_t n) {
+    lpm->nodes[n].child[0] = lpm->free_list;
+    lpm->free_list = n;
+}
+
+static int prefix_valid(const nb_prefix_t *p) {
+    int fi = family_index(p->family);
+    return fi >= 0 && p->len <= (fi == 0 ? 32 : 128);
+}
+
+nb_lpm_t* nb_lpm_new(void) {
+    nb_lpm_t *lpm = calloc(1, sizeof(nb_lpm_t));
+    if (!lpm) {
+        NB_LOG_ERROR("calloc failed");
+        return NULL;
+    }
+    lpm->used = 1;
+    lpm->stride[0] = calloc(STRIDE_SIZE, sizeof(uint32_t));
+    lpm->stride[1] = calloc(STRIDE_SIZE, sizeof(uint32_t));
+    if (!lpm->stride[0] || !lpm->stride[1] || reserve(lpm) != NB_SUCCESS) {
+        NB_LOG_ERROR("calloc failed");
+        nb_lpm_free(lpm);
+        return NULL;
+    }
+    return lpm;
+}
+
+void nb_lpm_free(nb_lpm_t *lpm) {
+    if (!lpm) return;
+    free(lpm->nodes);
+    free(lpm->stride[0]);
+    free(lpm->stride[1]);
+    free(lpm);
+}
+
+void nb_lpm_clear(nb_lpm_t *lpm) {
+    if (!lpm) return;
+    lpm->used = 1;
+    lpm->free_list = NIL;
+    lpm->root[0] = lpm->root[1] = NIL;
+    memset(lpm->stride[0], 0, STRIDE_SIZE * sizeof(uint32_t));
+    memset(lpm->stride[1], 0, STRIDE_SIZE * sizeof(uint32_t));
+    lpm->count = 0;
+}
+
+int nb_lpm_insert(nb_lpm_t *lpm, const nb_prefix_t *prefix, uint32_t value) {
+    if (!lpm || !prefix || !prefix_valid(prefix)) {
+        return NB_ERROR_INVALID;
+    }
+    if (reserve(lpm) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    nb_prefix_t p = *prefix;
+    nb_prefix_normalize(&p);
+
+    uint32_t *link = root_link(lpm, &p);
+    for (;;) {
+        uint32_t n = *link;
+        if (n == NIL) {
+            *link = node_new(lpm, &p, 1, value);
+            lpm->count++;
+            return NB_SUCCESS;
+        }
+
+        node_t *node = &lpm->nodes[n];
+        int max = node->prefix.len < p.len ? node->prefix.len : p.len;
+        int cpl = common_bits(node->prefix.addr, p.addr, max);
+
+        if (cpl == node->prefix.len) {
+            if (node->prefix.len == p.len) {
+                if (!node->has_value) {
+                    lpm->count++;
+                }
+                node->has_value = 1;
+                node->value = value;
+                return NB_SUCCESS;
+            }
+            link = &node->child[bit_at(p.addr, node->prefix.len)];
+            continue;
+        }
+
+        if (cpl == p.len) {
+            /* New prefix sits above this node */
+            uint32_t m = node_new(lpm, &p, 1, value);
+            lpm->nodes[m].child[bit_at(node->prefix.addr, p.len)] = n;
+            *link = m;
+        } else {
+            /* Diverge at bit cpl: add a branch point */
+            nb_prefix_t branch = p;
+            branch.len = (uint8_t)cpl;
+            nb_prefix_normalize(&branch);
+
+            uint32_t b = node_new(lpm, &branch, 0, 0);
+            uint32_t leaf = node_new(lpm, &p, 1, value);
+            lpm->nodes[b].child[bit_at(p.addr, cpl)] = leaf;
+            lpm->nodes[b].child[bit_at(lpm->nodes[n].prefix.addr, cpl)] = n;
+            *link = b;
+        }
+        lpm->count++;
+        return NB_SUCCESS;
+    }
+}
+
+typedef struct {
+    nb_prefix_t prefix;
+    uint32_t value;
+} build_entry_t;
+
+static int build_cmp(const void *a, const void *b) {
+    return nb_prefix_cmp(&((const build_entry_t *)a)->prefix, &((const build_entry_t *)b)->prefix);
+}
+
+int nb_lpm_build(nb_lpm_t *lpm, const nb_prefix_t *prefixes, const uint32_t *values, int count) {
+    if (!lpm || count < 0 || (count > 0 && (!prefixes || !values))) {
+        return NB_ERROR_INVALID;
+    }
+    if (count == 0) {
+        return NB_SUCCESS;
+    }
+
+    build_entry_t *entries = malloc(count * sizeof(build_entry_t));
+    if (!entries) {
+        NB_LOG_ERROR("malloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    for (int i = 0; i < count; i++) {
+        entries[i].prefix = prefixes[i];
+        nb_prefix_normalize(&entries[i].prefix);
+        entries[i].value = values[i];
+    }
+    qsort(entries, count, sizeof(build_entry_t), build_cmp);
+
+    /* Grow the pool once: at most two nodes per prefix */
+    uint64_t want = (uint64_t)lpm->used + 2 * (uint64_t)count;
+    if (want > lpm->cap && want < UINT32_MAX) {
+        node_t *nodes = realloc(lpm->nodes, want * sizeof(node_t));
+        if (nodes) {
+            lpm->nodes = nodes;
+            lpm->cap = (uint32_t)want;
+        }
+    }
+
+    int ret = NB_SUCCESS;
+    for (int i = 0; i < count && ret == NB_SUCCESS; i++) {
+        ret = nb_lpm_insert(lpm, &entries[i].prefix, entries[i].value);
+    }
+    free(entries);
+    return ret;
+}
+
+int nb_lpm_remove(nb_lpm_t *lpm, const nb_prefix_t *prefix) {
+    if (!lpm || !prefix || !prefix_valid(prefix)) {
+        return NB_ERROR_INVALID;
+    }
+
+    nb_prefix_t p = *prefix;
+    nb_prefix_normalize(&p);
+
+    uint32_t *links[MAX_DEPTH];
+    int depth = 0;
+    uint32_t *link = root_link(lpm, &p);
+    uint32_t n;
+
+    while ((n = *link) != NIL) {
+        node_t *node = &lpm->nodes[n];
+        if (node->prefix.len > p.len ||
+            common_bits(node->prefix.addr, p.addr, node->prefix.len) < node->prefix.len) {
+            return NB_ERROR_NOTFOUND;
+        }
+        if (node->prefix.len == p.len) {
+            break;
+        }
+        links[depth++] = link;
+        link = &node->child[bit_at(p.addr, node->prefix.len)];
+    }
+
+    if (n == NIL || !lpm->nodes[n].has_value) {
+        return NB_ERROR_NOTFOUND;
+    }
+
+    node_t *node = &lpm->nodes[n];
+    node->has_value = 0;
+    lpm->count--;
+
+    /* Still a branch point: keep it */
+    if (node->child[0] != NIL && node->child[1] != NIL) {
+        return NB_SUCCESS;
+    }
+
+    uint32_t child = node->child[0] != NIL ? node->child[0] : node->child[1];
+    *link = child;
+    node_release(lpm, n);
+
+    /* A valueless parent left with one child is no longer needed */
+    if (child == NIL && depth > 0) {
+        uint32_t *plink = links[depth - 1];
+        uint32_t pn = *plink;
+        node_t *parent = &lpm->nodes[pn];
+        if (!parent->has_value) {
+            *plink = parent->child[0] != NIL ? parent->child[0] : parent->child[1];
+            node_release(lpm, pn);
+        }
+    }
+    return NB_SUCCESS;
+}
+
+/* Deepest node with a value on key's path from n */
+static uint32_t descend(const nb_lpm_t *lpm, uint32_t n, const nb_prefix_t *key) {
+    uint32_t best = NIL;
+
+    while (n != NIL) {
+        const node_t *node = &lpm->nodes[n];
+        int len = node->prefix.len;
+
+        if (len > key->len || common_bits(node->prefix.addr, key->addr, len) < len) {
+            break;
+        }
+        best = node->has_value ? n : best;
+        if (len == key->len) {
+            break;
+        }
+        n = node->child[bit_at(key->addr, len)];
+    }
+    return best;
+}
+
+int nb_lpm_lookup(const nb_lpm_t *lpm, const nb_prefix_t *key,
+                  uint32_t *value_out, nb_prefix_t *match_out) {
+    if (!lpm || !key || !prefix_valid(key)) {
+        return NB_ERROR_INVALID;
+    }
+
+    int fi = family_index(key->family);
+    uint32_t best = NIL;
+
+    /* Anything found below the stride is longer than every short prefix */
+    if (key->len >= STRIDE_BITS) {
+        best = descend(lpm, lpm->stride[fi][stride_index(key->addr)], key);
+    }
+    if (best == NIL) {
+        best = descend(lpm, lpm->root[fi], key);
+    }
+
+    if (best == NIL) {
+        return NB_ERROR_NOTFOUND;
+    }
+    if (value_out) {
+        *value_out = lpm->nodes[best].value;
+    }
+    if (match_out) {
+        *match_out = lpm->nodes[best].prefix;
+    }
+    return NB_SUCCESS;
+}
+
+/* First stored prefix in the subtree at n owned by someone other than value */
+static uint32_t find_foreign(const nb_lpm_t *lpm, uint32_t n, uint32_t value) {
+    uint32_t stack[2 * MAX_DEPTH];
+    int top = 0;
+
+    if (n != NIL) {
+        stack[top++] = n;
+    }
+    while (top > 0) {
+        const node_t *node = &lpm->nodes[stack[--top]];
+        if (node->has_value && node->value != value) {
+            return (uint32_t)(node - lpm->nodes);
+        }
+        for (int i = 0; i < 2; i++) {
+            if (node->child[i] != NIL) {
+                stack[top++] = node->child[i];
+            }
+        }
+    }
+    return NIL;
+}
+
+typedef struct {
+    uint32_t covered;       /* Deepest shorter foreign prefix containing p */
+    uint32_t exact;         /* p itself */
+    uint32_t covers;        /* Some foreign prefix inside p */
+} check_state_t;
+
+/* Walk one (sub)trie from n along p, filling in what overlaps */
+static void check_walk(const nb_lpm_t *lpm, uint32_t n, const nb_prefix_t *p, uint32_t value,
+                       check_state_t *st) {
+    while (n != NIL) {
+        const node_t *node = &lpm->nodes[n];
+        int len = node->prefix.len;
+
+        if (len >= p->len) {
+            /* At or below the candidate: everything here is inside p if it matches */
+            if (common_bits(node->prefix.addr, p->addr, p->len) == p->len) {
+                if (len == p->len && node->has_value) {
+                    st->exact = n;
+                    n = find_foreign(lpm, node->child[0], value);
+                    if (n == NIL) {
+                        n = find_foreign(lpm, node->child[1], value);
+                    }
+                } else {
+                    n = find_foreign(lpm, n, value);
+                }
+                if (st->covers == NIL) {
+                    st->covers = n;
+                }
+            }
+            return;
+        }
+        if (common_bits(node->prefix.addr, p->addr, len) < len) {
+            return;
+        }
+        if (node->has_value && node->value != value) {
+            st->covered = n;
+        }
+        n = node->child[bit_at(p->addr, len)];
+    }
+}
+
+void nb_lpm_check(const nb_lpm_t *lpm, const nb_prefix_t *prefix, uint32_t value,
+                  nb_lpm_check_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (!lpm || !prefix || !prefix_valid(prefix)) {
+        return;
+    }
+
+    nb_prefix_t p = *prefix;
+    nb_prefix_normalize(&p);
+
+    int fi = family_index(p.family);
+    check_state_t st = { NIL, NIL, NIL };
+
+    /* Short prefixes can cover anything; walk them first so that a
+     * covering prefix found in a subtrie (always longer) wins */
+    check_walk(lpm, lpm->root[fi], &p, value, &st);
+    if (p.len >= STRIDE_BITS) {
+        check_walk(lpm, lpm->stride[fi][stride_index(p.addr)], &p, value, &st);
+    } else {
+        /* A short prefix spans a range of subtries */
+        uint32_t first = stride_index(p.addr);
+        uint32_t span = 1u << (STRIDE_BITS - p.len);
+        for (uint32_t i = first; i < first + span && st.covers == NIL; i++) {
+            st.covers = find_foreign(lpm, lpm->stride[fi][i], value);
+        }
+    }
+
+    uint32_t other = NIL;
+    if (st.exact != NIL && lpm->nodes[st.exact].value != value) {
+        out->kind = NB_LPM_CONFLICT;
+        other = st.exact;
+    } else if (st.covered != NIL) {
+        out->kind = NB_LPM_COVERED;
+        other = st.covered;
+    } else if (st.covers != NIL) {
+        out->kind = NB_LPM_COVERS;
+        other = st.covers;
+    } else if (st.exact != NIL) {
+        out->kind = NB_LPM_DUPLICATE;
+        other = st.exact;
+    }
+
+    if (other != NIL) {
+        out->other = lpm->nodes[other].prefix;
+        out->other_value = lpm->nodes[other].value;
+    }
+}
+
+int nb_lpm_count(const nb_lpm_t *lpm) {
+    return lpm ? lpm->count : 0;
+}
+
+const char* nb_lpm_overlap_name(nb_lpm_overlap_t kind) {
+    switch (kind) {
+    case NB_LPM_OK:        return "ok";
+    case NB_LPM_DUPLICATE: return "duplicate";
+    case NB_LPM_COVERS:    return "covers";
+    case NB_LPM_COVERED:   return "covered";
+    case NB_LPM_CONFLICT:  return "conflict";
+    }
+    return "unknown";
+}
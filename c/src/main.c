@@ -8,6 +8,8 @@
  *   netbird-client down            - Stop NetBird
  *   netbird-client status          - Show status
  *   netbird-client add-peer <key>  - Add peer manually
+ *   netbird-client convert-peers <peers.json> <peers.snap>
+ *                                  - Convert peers.json to a binary snapshot
  *
  * Author: Claude
  * Date: 2025-11-30
@@ -18,24 +20,22 @@
 #include "wg_iface.h"
 #include "route.h"
 #include "engine.h"
+#include "event_loop.h"
+#include "stats.h"
+#include "wg_key.h"
+#include "peers_file.h"
+#include "peers_snap.h"
+#include <time.h>
 #include <signal.h>
 
 #define DEFAULT_CONFIG_PATH "/etc/netbird/config.json"
 
-/* Global engine pointer for signal handling */
-static nb_engine_t *g_engine = NULL;
-
-void signal_handler(int sig) {
-    if (sig == SIGINT || sig == SIGTERM) {
-        printf("\n");
-        NB_LOG_INFO("Received signal %d, shutting down...", sig);
-        if (g_engine) {
-            nb_engine_stop(g_engine);
-            nb_engine_free(g_engine);
-            g_engine = NULL;
-        }
-        exit(0);
-    }
+/* SIGINT/SIGTERM arrive through the event loop's signalfd */
+static void on_shutdown(nb_loop_t *loop, int sig, void *ctx) {
+    (void)ctx;
+    printf("\n");
+    NB_LOG_INFO("Received signal %d, shutting down...", sig);
+    nb_loop_stop(loop);
 }
 
 void print_usage(const char *prog) {
@@ -48,6 +48,8 @@ void print_usage(const char *prog) {
     printf("  %s [-c CONFIG] status          - Show WireGuard status\n", prog);
     printf("  %s [-c CONFIG] add-peer <key> <endpoint> <allowed-ips>\n", prog);
     printf("                                     - Add peer manually\n");
+    printf("  %s convert-peers <peers.json> <peers.snap>\n", prog);
+    printf("                                     - Convert peers.json to a binary snapshot\n");
     printf("  %s --help                      - Show this help\n\n", prog);
     printf("Options:\n");
     printf("  -c CONFIG   - Use custom config file (default: %s)\n\n", DEFAULT_CONFIG_PATH);
@@ -85,36 +87,58 @@ int cmd_up(const char *config_path) {
         return NB_ERROR_INVALID;
     }
 
+    /*
+     * Take over the signals before any thread exists (the userspace
+     * backend starts its workers in nb_engine_start), so that every
+     * thread keeps them blocked and only the loop sees them
+     */
+    nb_loop_t *loop = nb_loop_new();
+    if (!loop ||
+        nb_loop_add_signal(loop, SIGINT, on_shutdown, NULL) != NB_SUCCESS ||
+        nb_loop_add_signal(loop, SIGTERM, on_shutdown, NULL) != NB_SUCCESS) {
+        NB_LOG_ERROR("Failed to create event loop");
+        nb_loop_free(loop);
+        config_free(cfg);
+        return NB_ERROR_SYSTEM;
+    }
+
     /* Create engine */
-    g_engine = nb_engine_new(cfg);
-    if (!g_engine) {
+    nb_engine_t *engine = nb_engine_new(cfg);
+    if (!engine) {
         NB_LOG_ERROR("Failed to create engine");
+        nb_loop_free(loop);
         config_free(cfg);
         return NB_ERROR_SYSTEM;
     }
 
     /* Start engine */
-    ret = nb_engine_start(g_engine);
-    if (ret != NB_SUCCESS) {
+    ret = nb_engine_start(engine);
+    if (ret == NB_SUCCESS) {
+        ret = nb_engine_attach(engine, loop);
+        if (ret != NB_SUCCESS) {
+            NB_LOG_ERROR("Failed to attach engine to the event loop");
+            nb_engine_stop(engine);
+        }
+    } else {
         NB_LOG_ERROR("Failed to start engine");
-        nb_engine_free(g_engine);
+    }
+    if (ret != NB_SUCCESS) {
+        nb_engine_free(engine);
+        nb_loop_free(loop);
         config_free(cfg);
-        g_engine = NULL;
         return ret;
     }
 
     NB_LOG_INFO("NetBird client is running. Press Ctrl+C to stop.");
 
-    /* Setup signal handlers */
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
-
-    /* Keep running */
-    while (1) {
-        sleep(1);
-    }
+    /* Peer updates, route events, timers and shutdown all arrive here */
+    ret = nb_loop_run(loop);
 
-    return NB_SUCCESS;
+    nb_engine_stop(engine);
+    nb_engine_free(engine);
+    nb_loop_free(loop);
+    config_free(cfg);
+    return ret;
 }
 
 int cmd_down(const char *config_path) {
@@ -153,6 +177,70 @@ int cmd_down(const char *config_path) {
     return NB_SUCCESS;
 }
 
+static const char* format_bytes(uint64_t n, char *buf, size_t size) {
+    static const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    double v = (double)n;
+    int u = 0;
+    while (v >= 1024 && u < 4) {
+        v /= 1024;
+        u++;
+    }
+    snprintf(buf, size, u ? "%.1f %s" : "%.0f %s", v, units[u]);
+    return buf;
+}
+
+/* Print the latest sampling round of the stats ring (no locks, no shelling out) */
+static int print_peer_stats(const nb_config_t *cfg) {
+    char path[512];
+    const char *file = cfg->stats_file ? cfg->stats_file :
+                       nb_stats_default_path(cfg->wg_iface_name, path, sizeof(path));
+
+    nb_stats_reader_t *reader = NULL;
+    if (nb_stats_reader_open(file, &reader) != NB_SUCCESS) {
+        return NB_ERROR_NOTFOUND;
+    }
+
+    nb_stats_record_t *records = NULL;
+    nb_stats_gauges_t gauges;
+    int count = nb_stats_reader_last_round(reader, &records);
+    if (nb_stats_reader_gauges(reader, &gauges) != NB_SUCCESS) {
+        NB_LOG_WARN("Engine gauges in %s are half written, not shown", file);
+    }
+    nb_stats_reader_close(reader);
+    if (count <= 0) {
+        free(records);
+        return NB_ERROR_NOTFOUND;
+    }
+
+    time_t now = time(NULL);
+    printf("Sampled %llds ago, %d peer(s)\n\n",
+           (long long)(now - records[0].time_ms / 1000), count);
+    if (gauges.peers_known > gauges.peers_active) {
+        printf("Lazy peers: %u active / %u known (%llu activated, %llu evicted)\n\n",
+               gauges.peers_active, gauges.peers_known,
+               (unsigned long long)gauges.activations, (unsigned long long)gauges.evictions);
+    }
+    for (int i = 0; i < count; i++) {
+        const nb_stats_record_t *r = &records[i];
+        char key[WG_KEY_B64_LEN], rx[32], tx[32], rxr[32], txr[32];
+
+        wg_key_to_base64(key, r->public_key);
+        printf("peer: %s\n", key);
+        if (r->last_handshake > 0) {
+            printf("  latest handshake: %llds ago\n", (long long)(now - r->last_handshake));
+        } else {
+            printf("  latest handshake: never\n");
+        }
+        printf("  transfer: %s received, %s sent\n",
+               format_bytes(r->rx_bytes, rx, sizeof(rx)), format_bytes(r->tx_bytes, tx, sizeof(tx)));
+        printf("  rate:     %s/s received, %s/s sent\n",
+               format_bytes(r->rx_rate, rxr, sizeof(rxr)), format_bytes(r->tx_rate, txr, sizeof(txr)));
+    }
+
+    free(records);
+    return NB_SUCCESS;
+}
+
 int cmd_status(const char *config_path) {
     nb_config_t *cfg = NULL;
     int ret;
@@ -186,11 +274,13 @@ int cmd_status(const char *config_path) {
     printf("Status: RUNNING\n");
     printf("Interface: %s\n\n", cfg->wg_iface_name);
 
-    /* Show WireGuard status */
-    printf("WireGuard Status:\n");
+    /* Show peers from the engine's statistics ring, or ask wg if there is none */
+    printf("Peers:\n");
     printf("--------------------------------------------------------------------------------\n");
-    snprintf(cmd, sizeof(cmd), "wg show %s", cfg->wg_iface_name);
-    system(cmd);
+    if (print_peer_stats(cfg) != NB_SUCCESS) {
+        snprintf(cmd, sizeof(cmd), "wg show %s", cfg->wg_iface_name);
+        system(cmd);
+    }
     printf("\n");
 
     /* Show routes */
@@ -248,6 +338,28 @@ int cmd_add_peer(const char *config_path, const char *pubkey,
     return NB_SUCCESS;
 }
 
+int cmd_convert_peers(const char *json_path, const char *snap_path) {
+    peers_file_t *file = NULL;
+
+    int ret = peers_file_load(json_path, &file);
+    if (ret != NB_SUCCESS) {
+        NB_LOG_ERROR("Failed to load %s", json_path);
+        return ret;
+    }
+
+    ret = peers_snap_write(snap_path, file);
+    int skipped = file->peer_count - ret;
+    peers_file_free(file);
+    if (ret < 0) {
+        NB_LOG_ERROR("Failed to write %s", snap_path);
+        return ret;
+    }
+    if (skipped > 0) {
+        NB_LOG_WARN("%d invalid peer(s) left out", skipped);
+    }
+    return NB_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
     const char *config_path = DEFAULT_CONFIG_PATH;
     int arg_idx = 1;
@@ -281,6 +393,16 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    /* File conversion needs no privileges either */
+    if (strcmp(cmd, "convert-peers") == 0) {
+        if (argc < arg_idx + 3) {
+            fprintf(stderr, "ERROR: convert-peers requires <peers.json> <peers.snap>\n");
+            print_usage(argv[0]);
+            return 1;
+        }
+        return cmd_convert_peers(argv[arg_idx + 1], argv[arg_idx + 2]) == NB_SUCCESS ? 0 : 1;
+    }
+
     /* Check root privileges for other commands */
     if (geteuid() != 0) {
         fprintf(stderr, "ERROR: This program must be run as root (use sudo)\n");
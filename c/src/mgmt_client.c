@@ -26,6 +26,17 @@ struct mgmt_client {
     int connected;
 };
 
+/* Helper: empty snapshot; everything in it is allocated from its arena */
+static mgmt_config_t* config_new(void) {
+    mgmt_config_t *config = calloc(1, sizeof(mgmt_config_t));
+    if (!config) {
+        NB_LOG_ERROR("calloc failed");
+        return NULL;
+    }
+    nb_arena_init(&config->arena, 0);
+    return config;
+}
+
 mgmt_client_t* mgmt_client_new(const char *url) {
     if (!url) {
         NB_LOG_ERROR("Invalid management URL");
@@ -62,11 +73,11 @@ int mgmt_register(mgmt_client_t *client, const char *setup_key, mgmt_config_t **
     }
 
     /* Allocate config */
-    mgmt_config_t *config = calloc(1, sizeof(mgmt_config_t));
+    mgmt_config_t *config = config_new();
     if (!config) {
-        NB_LOG_ERROR("calloc failed");
         return NB_ERROR_SYSTEM;
     }
+    nb_arena_t *arena = &config->arena;
 
     /*
      * STUB: Return demo peer and route
@@ -79,16 +90,22 @@ int mgmt_register(mgmt_client_t *client, const char *setup_key, mgmt_config_t **
      */
 
     /* Demo peer - represents another machine in the network */
+    config->peers = nb_arena_calloc(arena, 1, sizeof(mgmt_peer_t));
+    config->routes = nb_arena_calloc(arena, 1, sizeof(char*));
+    if (!config->peers || !config->routes) {
+        mgmt_config_free(config);
+        return NB_ERROR_SYSTEM;
+    }
     config->peer_count = 1;
-    config->peers = calloc(1, sizeof(mgmt_peer_t));
 
     char peer_id[64];
     snprintf(peer_id, sizeof(peer_id), "peer-stub-%ld", time(NULL));
 
-    config->peers[0].id = strdup(peer_id);
-    config->peers[0].public_key = strdup("DEMO_PEER_PUBKEY_PLACEHOLDER_1234567890ABCDEF=");
-    config->peers[0].endpoint = strdup("203.0.113.50:51820");  /* TEST-NET-3 IP */
-    config->peers[0].allowed_ips = strdup("100.64.1.0/24");
+    /* Out of memory is only possible for the first block, checked above */
+    config->peers[0].id = nb_arena_strdup(arena, peer_id);
+    config->peers[0].public_key = nb_arena_strdup(arena, "DEMO_PEER_PUBKEY_PLACEHOLDER_1234567890ABCDEF=");
+    config->peers[0].endpoint = nb_arena_strdup(arena, "203.0.113.50:51820");  /* TEST-NET-3 IP */
+    config->peers[0].allowed_ips = nb_arena_strdup(arena, "100.64.1.0/24");
 
     NB_LOG_INFO("  Peer:      %s", config->peers[0].id);
     NB_LOG_INFO("    PubKey:  %s", config->peers[0].public_key);
@@ -97,8 +114,7 @@ int mgmt_register(mgmt_client_t *client, const char *setup_key, mgmt_config_t **
 
     /* Demo route */
     config->route_count = 1;
-    config->routes = calloc(1, sizeof(char*));
-    config->routes[0] = strdup("10.20.0.0/16");
+    config->routes[0] = nb_arena_strdup(arena, "10.20.0.0/16");
 
     NB_LOG_INFO("  Routes:    %s", config->routes[0]);
 
@@ -126,16 +142,11 @@ int mgmt_sync(mgmt_client_t *client, mgmt_config_t **config_out) {
     NB_LOG_INFO("Management sync (stub - no changes)");
 
     /* STUB: Return empty config (no updates) */
-    mgmt_config_t *config = calloc(1, sizeof(mgmt_config_t));
+    mgmt_config_t *config = config_new();
     if (!config) {
         return NB_ERROR_SYSTEM;
     }
 
-    config->peer_count = 0;
-    config->peers = NULL;
-    config->route_count = 0;
-    config->routes = NULL;
-
     *config_out = config;
     return NB_SUCCESS;
 }
@@ -143,22 +154,7 @@ int mgmt_sync(mgmt_client_t *client, mgmt_config_t **config_out) {
 void mgmt_config_free(mgmt_config_t *config) {
     if (!config) return;
 
-    /* Free peers */
-    for (int i = 0; i < config->peer_count; i++) {
-        free(config->peers[i].id);
-        free(config->peers[i].public_key);
-        free(config->peers[i].endpoint);
-        free(config->peers[i].allowed_ips);
-    }
-    free(config->peers);
-
-    /* Free routes */
-    nb_free_string_array(config->routes, config->route_count);
-
-    /* Free WG config */
-    free(config->wg_private_key);
-    free(config->wg_address);
-
+    nb_arena_free(&config->arena);
     free(config);
 }
 
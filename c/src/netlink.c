@@ -0,0 +1,447 @@
+/**
+ * netlink.c - Minimal netlink socket and message helpers
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "netlink.h"
+#include "common.h"
+#include <sys/socket.h>
+#include <time.h>
+#include <linux/genetlink.h>
+
+#ifndef NETLINK_CAP_ACK
+#define NETLINK_CAP_ACK 10
+#endif
+
+int nb_nl_open(nb_nl_t *nl, int protocol) {
+    if (!nl) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    memset(nl, 0, sizeof(*nl));
+    nl->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+    if (nl->fd < 0) {
+        nl->last_errno = errno;
+        NB_LOG_ERROR("netlink socket (protocol %d) failed: %s", protocol, strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+    nl->protocol = protocol;
+
+    /* Bigger buffers for large batches and dumps (FORCE lifts rmem_max as root) */
+    int bufsize = 1024 * 1024;
+    setsockopt(nl->fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+    if (setsockopt(nl->fd, SOL_SOCKET, SO_RCVBUFFORCE, &bufsize, sizeof(bufsize)) < 0) {
+        setsockopt(nl->fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    }
+
+    /* Do not echo the whole request back in ACKs */
+    int one = 1;
+    setsockopt(nl->fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK };
+    if (bind(nl->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        nl->last_errno = errno;
+        NB_LOG_ERROR("netlink bind failed: %s", strerror(errno));
+        close(nl->fd);
+        nl->fd = -1;
+        return NB_ERROR_SYSTEM;
+    }
+
+    socklen_t addrlen = sizeof(addr);
+    if (getsockname(nl->fd, (struct sockaddr *)&addr, &addrlen) == 0) {
+        nl->portid = addr.nl_pid;
+    }
+
+    nl->seq = (uint32_t)time(NULL);
+    return NB_SUCCESS;
+}
+
+void nb_nl_close(nb_nl_t *nl) {
+    if (!nl || nl->fd < 0) return;
+
+    close(nl->fd);
+    nl->fd = -1;
+}
+
+uint32_t nb_nl_next_seq(nb_nl_t *nl) {
+    return ++nl->seq;
+}
+
+int nb_nl_last_errno(const nb_nl_t *nl) {
+    return nl ? nl->last_errno : 0;
+}
+
+int nb_nl_buf_init(nb_nl_buf_t *b, size_t cap) {
+    if (!b) {
+        return NB_ERROR_INVALID;
+    }
+
+    memset(b, 0, sizeof(*b));
+    b->data = calloc(1, cap > 0 ? cap : NB_NL_BUFSIZE);
+    if (!b->data) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    b->cap = cap > 0 ? cap : NB_NL_BUFSIZE;
+    return NB_SUCCESS;
+}
+
+void nb_nl_buf_reset(nb_nl_buf_t *b) {
+    b->len = 0;
+    b->nlh = NULL;
+}
+
+void nb_nl_buf_free(nb_nl_buf_t *b) {
+    if (!b) return;
+
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+struct nlmsghdr* nb_nl_msg_begin(nb_nl_buf_t *b, uint16_t type, uint16_t flags, uint32_t seq) {
+    size_t off = NLMSG_ALIGN(b->len);
+    if (off + NLMSG_HDRLEN > b->cap) {
+        return NULL;
+    }
+
+    struct nlmsghdr *nlh = (struct nlmsghdr *)(b->data + off);
+    memset(nlh, 0, NLMSG_HDRLEN);
+    nlh->nlmsg_len = NLMSG_HDRLEN;
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_flags = flags;
+    nlh->nlmsg_seq = seq;
+
+    b->nlh = nlh;
+    b->len = off + NLMSG_HDRLEN;
+    return nlh;
+}
+
+void* nb_nl_msg_put_header(nb_nl_buf_t *b, size_t len) {
+    size_t alen = NLMSG_ALIGN(len);
+    if (!b->nlh || b->len + alen > b->cap) {
+        return NULL;
+    }
+
+    void *hdr = b->data + b->len;
+    memset(hdr, 0, alen);
+    b->len += alen;
+    b->nlh->nlmsg_len += alen;
+    return hdr;
+}
+
+int nb_nl_attr_put(nb_nl_buf_t *b, uint16_t type, const void *data, size_t len) {
+    size_t total = NLA_ALIGN(NLA_HDRLEN + len);
+    if (!b->nlh || b->len + total > b->cap) {
+        return NB_ERROR;
+    }
+
+    struct nlattr *a = (struct nlattr *)(b->data + b->len);
+    a->nla_type = type;
+    a->nla_len = NLA_HDRLEN + len;
+    if (len > 0) {
+        memcpy((uint8_t *)a + NLA_HDRLEN, data, len);
+    }
+    memset((uint8_t *)a + NLA_HDRLEN + len, 0, total - NLA_HDRLEN - len);
+
+    b->len += total;
+    b->nlh->nlmsg_len += total;
+    return NB_SUCCESS;
+}
+
+int nb_nl_attr_put_u8(nb_nl_buf_t *b, uint16_t type, uint8_t v) {
+    return nb_nl_attr_put(b, type, &v, sizeof(v));
+}
+
+int nb_nl_attr_put_u16(nb_nl_buf_t *b, uint16_t type, uint16_t v) {
+    return nb_nl_attr_put(b, type, &v, sizeof(v));
+}
+
+int nb_nl_attr_put_u32(nb_nl_buf_t *b, uint16_t type, uint32_t v) {
+    return nb_nl_attr_put(b, type, &v, sizeof(v));
+}
+
+int nb_nl_attr_put_u64(nb_nl_buf_t *b, uint16_t type, uint64_t v) {
+    return nb_nl_attr_put(b, type, &v, sizeof(v));
+}
+
+int nb_nl_attr_put_str(nb_nl_buf_t *b, uint16_t type, const char *s) {
+    return nb_nl_attr_put(b, type, s, strlen(s) + 1);
+}
+
+struct nlattr* nb_nl_nest_begin(nb_nl_buf_t *b, uint16_t type) {
+    struct nlattr *nest = (struct nlattr *)(b->data + b->len);
+    if (nb_nl_attr_put(b, type | NLA_F_NESTED, NULL, 0) != NB_SUCCESS) {
+        return NULL;
+    }
+    return nest;
+}
+
+void nb_nl_nest_end(nb_nl_buf_t *b, struct nlattr *nest) {
+    nest->nla_len = (uint16_t)((b->data + b->len) - (uint8_t *)nest);
+}
+
+void nb_nl_msg_rollback(nb_nl_buf_t *b, size_t len) {
+    if (!b->nlh || len >= b->len) return;
+
+    size_t start = (uint8_t *)b->nlh - b->data;
+    if (len < start + NLMSG_HDRLEN) return;
+
+    b->nlh->nlmsg_len -= (uint32_t)(b->len - len);
+    b->len = len;
+}
+
+int nb_nl_error(int err) {
+    switch (err) {
+    case 0:
+        return NB_SUCCESS;
+    case EEXIST:
+        return NB_ERROR_EXISTS;
+    case ENOENT:
+    case ENODEV:
+    case ESRCH:
+        return NB_ERROR_NOTFOUND;
+    case EINVAL:
+    case ERANGE:
+        return NB_ERROR_INVALID;
+    case ETIMEDOUT:
+        return NB_ERROR_TIMEOUT;
+    default:
+        return NB_ERROR_SYSTEM;
+    }
+}
+
+int nb_nl_send(nb_nl_t *nl, const nb_nl_buf_t *b) {
+    struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+    ssize_t n;
+
+    do {
+        n = sendto(nl->fd, b->data, b->len, 0, (struct sockaddr *)&kernel, sizeof(kernel));
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0 || (size_t)n != b->len) {
+        nl->last_errno = n < 0 ? errno : EMSGSIZE;
+        errno = nl->last_errno;
+        return NB_ERROR_SYSTEM;
+    }
+    return NB_SUCCESS;
+}
+
+int nb_nl_recv(nb_nl_t *nl, uint32_t seq, nb_nl_cb_t cb, void *ctx) {
+    uint8_t *buf = malloc(NB_NL_RECVSIZE);
+    if (!buf) {
+        NB_LOG_ERROR("malloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+
+    int ret = NB_SUCCESS;
+    int done = 0;
+    int cb_failed = 0;
+
+    while (!done) {
+        ssize_t n = recv(nl->fd, buf, NB_NL_RECVSIZE, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            nl->last_errno = errno;
+            ret = NB_ERROR_SYSTEM;
+            break;
+        }
+
+        size_t len = (size_t)n;
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+             NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_pid != nl->portid || nlh->nlmsg_seq != seq) {
+                continue;   /* Stale reply to an earlier request */
+            }
+
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr *e = NLMSG_DATA(nlh);
+                if (e->error != 0) {
+                    nl->last_errno = -e->error;
+                    ret = nb_nl_error(-e->error);
+                }
+                done = 1;
+                break;
+            }
+
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                if (nlh->nlmsg_len >= NLMSG_LENGTH(sizeof(int))) {
+                    int err = *(const int *)NLMSG_DATA(nlh);
+                    if (err < 0) {
+                        nl->last_errno = -err;
+                        ret = nb_nl_error(-err);
+                    }
+                }
+                done = 1;
+                break;
+            }
+
+            if (cb && !cb_failed) {
+                int cb_ret = cb(nlh, ctx);
+                if (cb_ret != NB_SUCCESS) {
+                    /* Keep draining so the socket stays in sync */
+                    cb_failed = 1;
+                    ret = cb_ret;
+                }
+            }
+        }
+    }
+
+    free(buf);
+    if (ret != NB_SUCCESS) {
+        errno = nl->last_errno;
+    }
+    return ret;
+}
+
+int nb_nl_recv_acks(nb_nl_t *nl, uint32_t first_seq, int count, int *errs, int block) {
+    uint8_t *buf = malloc(NB_NL_RECVSIZE);
+    if (!buf) {
+        NB_LOG_ERROR("malloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+
+    ssize_t n;
+    do {
+        n = recv(nl->fd, buf, NB_NL_RECVSIZE, block ? 0 : MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        int err = errno;
+        free(buf);
+        if (err == EAGAIN || err == EWOULDBLOCK) {
+            return 0;
+        }
+        nl->last_errno = err;
+        errno = err;
+        return NB_ERROR_SYSTEM;
+    }
+
+    int acked = 0;
+    size_t len = (size_t)n;
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+         NLMSG_OK(nlh, len);
+         nlh = NLMSG_NEXT(nlh, len)) {
+        uint32_t idx = nlh->nlmsg_seq - first_seq;      /* Wraps safely */
+        if (nlh->nlmsg_type != NLMSG_ERROR || nlh->nlmsg_pid != nl->portid ||
+            idx >= (uint32_t)count) {
+            continue;
+        }
+        const struct nlmsgerr *e = NLMSG_DATA(nlh);
+        errs[idx] = -e->error;
+        if (e->error != 0) {
+            nl->last_errno = -e->error;
+        }
+        acked++;
+    }
+
+    free(buf);
+    return acked;
+}
+
+int nb_nl_rcvbuf(const nb_nl_t *nl) {
+    int size = 0;
+    socklen_t len = sizeof(size);
+    if (!nl || nl->fd < 0 || getsockopt(nl->fd, SOL_SOCKET, SO_RCVBUF, &size, &len) < 0) {
+        return 0;
+    }
+    return size;
+}
+
+int nb_nl_transact(nb_nl_t *nl, nb_nl_buf_t *b, nb_nl_cb_t cb, void *ctx) {
+    if (!nl || nl->fd < 0 || !b || !b->nlh) {
+        return NB_ERROR_INVALID;
+    }
+
+    b->nlh->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+
+    int ret = nb_nl_send(nl, b);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+    return nb_nl_recv(nl, b->nlh->nlmsg_seq, cb, ctx);
+}
+
+void nb_nl_attr_parse(const void *data, size_t len, const struct nlattr **tb, int maxtype) {
+    const struct nlattr *a;
+
+    memset(tb, 0, sizeof(*tb) * (maxtype + 1));
+    nb_nl_attr_for_each(a, data, len) {
+        int type = a->nla_type & NLA_TYPE_MASK;
+        if (type <= maxtype) {
+            tb[type] = a;
+        }
+    }
+}
+
+void nb_nl_msg_parse(const struct nlmsghdr *nlh, size_t hdrlen,
+                     const struct nlattr **tb, int maxtype) {
+    size_t off = NLMSG_HDRLEN + NLMSG_ALIGN(hdrlen);
+    if (nlh->nlmsg_len < off) {
+        memset(tb, 0, sizeof(*tb) * (maxtype + 1));
+        return;
+    }
+    nb_nl_attr_parse((const uint8_t *)nlh + off, nlh->nlmsg_len - off, tb, maxtype);
+}
+
+uint8_t nb_nl_attr_get_u8(const struct nlattr *a) {
+    return *(const uint8_t *)nb_nl_attr_data(a);
+}
+
+uint16_t nb_nl_attr_get_u16(const struct nlattr *a) {
+    uint16_t v;
+    memcpy(&v, nb_nl_attr_data(a), sizeof(v));
+    return v;
+}
+
+uint32_t nb_nl_attr_get_u32(const struct nlattr *a) {
+    uint32_t v;
+    memcpy(&v, nb_nl_attr_data(a), sizeof(v));
+    return v;
+}
+
+uint64_t nb_nl_attr_get_u64(const struct nlattr *a) {
+    uint64_t v;
+    memcpy(&v, nb_nl_attr_data(a), sizeof(v));
+    return v;
+}
+
+/* Callback: extract CTRL_ATTR_FAMILY_ID */
+static int genl_family_cb(const struct nlmsghdr *nlh, void *ctx) {
+    const struct nlattr *tb[CTRL_ATTR_MAX + 1];
+    nb_nl_msg_parse(nlh, GENL_HDRLEN, tb, CTRL_ATTR_MAX);
+    if (tb[CTRL_ATTR_FAMILY_ID]) {
+        *(uint16_t *)ctx = nb_nl_attr_get_u16(tb[CTRL_ATTR_FAMILY_ID]);
+    }
+    return NB_SUCCESS;
+}
+
+int nb_genl_resolve(nb_nl_t *nl, const char *name, uint16_t *id_out) {
+    if (!nl || !name || !id_out) {
+        return NB_ERROR_INVALID;
+    }
+
+    uint8_t storage[256];
+    nb_nl_buf_t b = { .data = storage, .cap = sizeof(storage) };
+
+    nb_nl_msg_begin(&b, GENL_ID_CTRL, NLM_F_REQUEST | NLM_F_ACK, nb_nl_next_seq(nl));
+    struct genlmsghdr *genl = nb_nl_msg_put_header(&b, GENL_HDRLEN);
+    genl->cmd = CTRL_CMD_GETFAMILY;
+    genl->version = 1;
+    nb_nl_attr_put_str(&b, CTRL_ATTR_FAMILY_NAME, name);
+
+    uint16_t id = 0;
+    int ret = nb_nl_transact(nl, &b, genl_family_cb, &id);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+    if (id == 0) {
+        return NB_ERROR_NOTFOUND;
+    }
+
+    *id_out = id;
+    return NB_SUCCESS;
+}
@@ -0,0 +1,214 @@
+/**
+ * nflog.c - NFLOG listener used to trap traffic to inactive peers
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "nflog.h"
+#include "common.h"
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_log.h>
+
+#define NFLOG_MSG(type)     ((NFNL_SUBSYS_ULOG << 8) | (type))
+
+/* Send one NFULNL_MSG_CONFIG request; attributes are added by the caller */
+static struct nlmsghdr* config_begin(nb_nflog_t *nf, nb_nl_buf_t *b, uint8_t family) {
+    struct nlmsghdr *nlh = nb_nl_msg_begin(b, NFLOG_MSG(NFULNL_MSG_CONFIG),
+                                           NLM_F_REQUEST | NLM_F_ACK, nb_nl_next_seq(&nf->nl));
+    struct nfgenmsg *g = nlh ? nb_nl_msg_put_header(b, sizeof(*g)) : NULL;
+    if (!g) {
+        return NULL;
+    }
+    g->nfgen_family = family;
+    g->version = NFNETLINK_V0;
+    g->res_id = htons(nf->group);
+    return nlh;
+}
+
+static int config_cmd(nb_nflog_t *nf, nb_nl_buf_t *b, uint8_t family, uint8_t cmd) {
+    struct nfulnl_msg_config_cmd c = { .command = cmd };
+
+    nb_nl_buf_reset(b);
+    if (!config_begin(nf, b, family) ||
+        nb_nl_attr_put(b, NFULA_CFG_CMD, &c, sizeof(c)) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+    return nb_nl_transact(&nf->nl, b, NULL, NULL);
+}
+
+int nb_nflog_open(uint16_t group, nb_nflog_t *nf) {
+    if (!nf) {
+        return NB_ERROR_INVALID;
+    }
+
+    memset(nf, 0, sizeof(*nf));
+    nf->group = group;
+    int ret = nb_nl_open(&nf->nl, NETLINK_NETFILTER);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+
+    nb_nl_buf_t b;
+    if (nb_nl_buf_init(&b, 256) != NB_SUCCESS) {
+        nb_nl_close(&nf->nl);
+        return NB_ERROR_SYSTEM;
+    }
+
+    /* Kernels before 3.17 need the families bound explicitly; newer ones ignore this */
+    config_cmd(nf, &b, AF_INET, NFULNL_CFG_CMD_PF_BIND);
+    config_cmd(nf, &b, AF_INET6, NFULNL_CFG_CMD_PF_BIND);
+
+    ret = config_cmd(nf, &b, AF_UNSPEC, NFULNL_CFG_CMD_BIND);
+    if (ret == NB_SUCCESS) {
+        /* Copy only the start of each packet, deliver without batching delay */
+        struct nfulnl_msg_config_mode mode = {
+            .copy_range = htonl(NB_NFLOG_COPY_RANGE),
+            .copy_mode = NFULNL_COPY_PACKET,
+        };
+        nb_nl_buf_reset(&b);
+        if (!config_begin(nf, &b, AF_UNSPEC) ||
+            nb_nl_attr_put(&b, NFULA_CFG_MODE, &mode, sizeof(mode)) != NB_SUCCESS ||
+            nb_nl_attr_put_u32(&b, NFULA_CFG_QTHRESH, htonl(1)) != NB_SUCCESS) {
+            ret = NB_ERROR_SYSTEM;
+        } else {
+            ret = nb_nl_transact(&nf->nl, &b, NULL, NULL);
+        }
+    }
+    nb_nl_buf_free(&b);
+
+    if (ret != NB_SUCCESS) {
+        int err = nb_nl_last_errno(&nf->nl);
+        NB_LOG_ERROR("Failed to bind NFLOG group %u: %s", group, strerror(err));
+        nb_nl_close(&nf->nl);
+        return err == EBUSY ? NB_ERROR_EXISTS : ret;
+    }
+
+    int flags = fcntl(nf->nl.fd, F_GETFL);
+    fcntl(nf->nl.fd, F_SETFL, flags | O_NONBLOCK);
+    return NB_SUCCESS;
+}
+
+void nb_nflog_close(nb_nflog_t *nf) {
+    if (!nf || nf->nl.fd < 0) return;
+    nb_nl_close(&nf->nl);
+}
+
+int nb_nflog_packet_dst(const uint8_t *pkt, size_t len, nb_prefix_t *out) {
+    if (!pkt || !out || len < 1) {
+        return NB_ERROR_INVALID;
+    }
+
+    switch (pkt[0] >> 4) {
+    case 4:
+        if (len < 20) return NB_ERROR_INVALID;
+        memset(out, 0, sizeof(*out));
+        out->family = AF_INET;
+        out->len = 32;
+        memcpy(out->addr, pkt + 16, 4);
+        return NB_SUCCESS;
+    case 6:
+        if (len < 40) return NB_ERROR_INVALID;
+        memset(out, 0, sizeof(*out));
+        out->family = AF_INET6;
+        out->len = 128;
+        memcpy(out->addr, pkt + 24, 16);
+        return NB_SUCCESS;
+    }
+    return NB_ERROR_INVALID;
+}
+
+int nb_nflog_read(nb_nflog_t *nf, nb_prefix_t *dst, int max) {
+    if (!nf || nf->nl.fd < 0 || (!dst && max > 0)) {
+        return NB_ERROR_INVALID;
+    }
+
+    uint8_t buf[8192];
+    int count = 0;
+
+    for (;;) {
+        ssize_t n = recv(nf->nl.fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == ENOBUFS) {
+                /* The kernel dropped packets; later flows will trigger again */
+                nf->dropped++;
+                continue;
+            }
+            nf->nl.last_errno = errno;
+            return NB_ERROR_SYSTEM;
+        }
+
+        size_t len = (size_t)n;
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type != NFLOG_MSG(NFULNL_MSG_PACKET)) {
+                continue;
+            }
+            nf->packets++;
+
+            const struct nlattr *tb[NFULA_MAX + 1];
+            nb_nl_msg_parse(nlh, sizeof(struct nfgenmsg), tb, NFULA_MAX);
+            if (!tb[NFULA_PAYLOAD]) {
+                continue;
+            }
+            if (count >= max) {
+                nf->dropped++;
+                continue;
+            }
+            if (nb_nflog_packet_dst(nb_nl_attr_data(tb[NFULA_PAYLOAD]),
+                                    nb_nl_attr_len(tb[NFULA_PAYLOAD]), &dst[count]) == NB_SUCCESS) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/* Add or delete the rules in one chain of one table program */
+static int rule_cmd(const char *prog, const char *chain, const char *ifname,
+                    uint16_t group, int add) {
+    char rule[256], cmd[640];
+
+    snprintf(rule, sizeof(rule), "%s -o %s -m conntrack --ctstate NEW -j NFLOG --nflog-group %u",
+             chain, ifname, group);
+    if (add) {
+        snprintf(cmd, sizeof(cmd), "%s -w -C %s 2>/dev/null || %s -w -I %s 2>/dev/null",
+                 prog, rule, prog, rule);
+    } else {
+        snprintf(cmd, sizeof(cmd), "%s -w -D %s 2>/dev/null", prog, rule);
+    }
+    return system(cmd) == 0 ? NB_SUCCESS : NB_ERROR_SYSTEM;
+}
+
+int nb_nflog_rules_add(const char *ifname, uint16_t group) {
+    if (!ifname) {
+        return NB_ERROR_INVALID;
+    }
+
+    NB_LOG_INFO("Trapping new flows on %s to NFLOG group %u", ifname, group);
+    if (rule_cmd("iptables", "OUTPUT", ifname, group, 1) != NB_SUCCESS ||
+        rule_cmd("iptables", "FORWARD", ifname, group, 1) != NB_SUCCESS) {
+        NB_LOG_ERROR("Failed to install NFLOG rules for %s", ifname);
+        nb_nflog_rules_del(ifname, group);
+        return NB_ERROR_SYSTEM;
+    }
+    if (rule_cmd("ip6tables", "OUTPUT", ifname, group, 1) != NB_SUCCESS ||
+        rule_cmd("ip6tables", "FORWARD", ifname, group, 1) != NB_SUCCESS) {
+        NB_LOG_WARN("IPv6 NFLOG rules not installed; IPv6 traffic will not activate peers");
+    }
+    return NB_SUCCESS;
+}
+
+void nb_nflog_rules_del(const char *ifname, uint16_t group) {
+    if (!ifname) return;
+
+    rule_cmd("iptables", "OUTPUT", ifname, group, 0);
+    rule_cmd("iptables", "FORWARD", ifname, group, 0);
+    rule_cmd("ip6tables", "OUTPUT", ifname, group, 0);
+    rule_cmd("ip6tables", "FORWARD", ifname, group, 0);
+}
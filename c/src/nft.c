@@ -0,0 +1,912 @@
+/**
+ * nft.c - NetBird's nftables table over nfnetlink
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "nft.h"
+#include "common.h"
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
+#include <linux/netfilter/nf_conntrack_common.h>
+
+#define NFT_MSG(type)       ((NFNL_SUBSYS_NFTABLES << 8) | (type))
+
+#define NFT_CHAIN_POSTROUTING   "postrouting"
+#define NFT_CHAIN_FORWARD       "forward"
+#define NFT_CHAIN_RAW_PRE       "raw_prerouting"
+#define NFT_CHAIN_RAW_OUT       "raw_output"
+#define NFT_FLOWTABLE           "ft"
+#define NFT_SET_MASQ4           "masq4"
+#define NFT_SET_MASQ6           "masq6"
+#define NFT_PRIO_SRCNAT         100
+#define NFT_PRIO_FILTER         0
+#define NFT_PRIO_RAW            ((uint32_t)-300)
+
+/* nft's datatype ids, so that 'nft list table' can print the sets */
+#define NFT_TYPE_IPADDR     7
+#define NFT_TYPE_IP6ADDR    8
+#define NFT_TYPE_IFNAME     41
+#define NFT_TYPE_BITS       6
+
+/* Elements per NEWSETELEM message (the element list is a 64 KiB attribute) */
+#define NFT_ELEMS_PER_MSG   256
+#define NFT_ELEM_MAX        112     /* Upper bound of one encoded element */
+#define NFT_BATCH_OVERHEAD  4096    /* Table, chain, sets, rules and batch markers */
+
+/* A masquerade element: device and an address range of one family */
+typedef struct {
+    char device[IFNAMSIZ];
+    uint8_t family;
+    uint8_t start[16];
+    uint8_t end[16];
+} masq_range_t;
+
+/* Message headers of the batch being built */
+typedef struct {
+    nb_nl_buf_t buf;
+    uint32_t first_seq;
+    int count;              /* Messages that will be acknowledged */
+    int failed;             /* Set when the buffer ran out */
+} nft_batch_t;
+
+int nb_nft_open(nb_nft_t *nft) {
+    return nb_nft_open_table(nft, NB_NFT_TABLE);
+}
+
+int nb_nft_open_table(nb_nft_t *nft, const char *table) {
+    if (!nft || !table || !table[0] || strlen(table) >= sizeof(nft->table)) {
+        return NB_ERROR_INVALID;
+    }
+    memset(nft, 0, sizeof(*nft));
+    memcpy(nft->table, table, strlen(table) + 1);
+    return nb_nl_open(&nft->nl, NETLINK_NETFILTER);
+}
+
+void nb_nft_close(nb_nft_t *nft) {
+    if (nft) {
+        nb_nl_close(&nft->nl);
+    }
+}
+
+static int batch_init(nft_batch_t *bt, size_t size) {
+    memset(bt, 0, sizeof(*bt));
+    return nb_nl_buf_init(&bt->buf, size);
+}
+
+/* Batch begin/end markers (not acknowledged) */
+static void batch_marker(nft_batch_t *bt, nb_nft_t *nft, uint16_t type) {
+    if (!nb_nl_msg_begin(&bt->buf, type, NLM_F_REQUEST, nb_nl_next_seq(&nft->nl))) {
+        bt->failed = 1;
+        return;
+    }
+    struct nfgenmsg *g = nb_nl_msg_put_header(&bt->buf, sizeof(*g));
+    if (!g) {
+        bt->failed = 1;
+        return;
+    }
+    g->nfgen_family = AF_UNSPEC;
+    g->version = NFNETLINK_V0;
+    g->res_id = htons(NFNL_SUBSYS_NFTABLES);
+}
+
+/* Start an acknowledged nf_tables message in the inet family */
+static int msg_begin(nft_batch_t *bt, nb_nft_t *nft, uint16_t type, uint16_t flags) {
+    uint32_t seq = nb_nl_next_seq(&nft->nl);
+    if (bt->count == 0) {
+        bt->first_seq = seq;
+    }
+    if (!nb_nl_msg_begin(&bt->buf, NFT_MSG(type), NLM_F_REQUEST | NLM_F_ACK | flags, seq)) {
+        bt->failed = 1;
+        return NB_ERROR;
+    }
+    struct nfgenmsg *g = nb_nl_msg_put_header(&bt->buf, sizeof(*g));
+    if (!g) {
+        bt->failed = 1;
+        return NB_ERROR;
+    }
+    g->nfgen_family = NFPROTO_INET;
+    g->version = NFNETLINK_V0;
+    bt->count++;
+    return nb_nl_attr_put_str(&bt->buf, NFTA_TABLE_NAME, nft->table);
+}
+
+static void put_be32(nft_batch_t *bt, uint16_t type, uint32_t v) {
+    if (nb_nl_attr_put_u32(&bt->buf, type, htonl(v)) != NB_SUCCESS) {
+        bt->failed = 1;
+    }
+}
+
+static void put_str(nft_batch_t *bt, uint16_t type, const char *s) {
+    if (nb_nl_attr_put_str(&bt->buf, type, s) != NB_SUCCESS) {
+        bt->failed = 1;
+    }
+}
+
+/* Value wrapped in NFTA_DATA_VALUE (cmp data, element keys) */
+static void put_data(nft_batch_t *bt, uint16_t type, const void *data, size_t len) {
+    struct nlattr *nest = nb_nl_nest_begin(&bt->buf, type);
+    if (!nest || nb_nl_attr_put(&bt->buf, NFTA_DATA_VALUE, data, len) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    nb_nl_nest_end(&bt->buf, nest);
+}
+
+/*
+ * Send the batch and collect one ACK per message
+ *
+ * The kernel applies all messages or none; the first error is returned
+ * (ENOENT without a log message if missing_ok is set).
+ */
+static int batch_commit(nft_batch_t *bt, nb_nft_t *nft, const char *what, int missing_ok) {
+    if (bt->failed) {
+        NB_LOG_ERROR("nftables %s: batch buffer too small", what);
+        return NB_ERROR_SYSTEM;
+    }
+
+    /* The whole batch must fit into one datagram */
+    int sndbuf = (int)bt->buf.len + 4096;
+    if (setsockopt(nft->nl.fd, SOL_SOCKET, SO_SNDBUFFORCE, &sndbuf, sizeof(sndbuf)) < 0) {
+        setsockopt(nft->nl.fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    }
+
+    int ret = nb_nl_send(&nft->nl, &bt->buf);
+    if (ret != NB_SUCCESS) {
+        NB_LOG_ERROR("nftables %s: send failed: %s", what, strerror(nft->nl.last_errno));
+        return ret;
+    }
+
+    int *errs = calloc(bt->count > 0 ? bt->count : 1, sizeof(int));
+    if (!errs) {
+        return NB_ERROR_SYSTEM;
+    }
+    int acked = 0;
+    while (acked < bt->count) {
+        int n = nb_nl_recv_acks(&nft->nl, bt->first_seq, bt->count, errs, 1);
+        if (n < 0) {
+            free(errs);
+            NB_LOG_ERROR("nftables %s: %s", what, strerror(nft->nl.last_errno));
+            return n;
+        }
+        acked += n;
+    }
+
+    ret = NB_SUCCESS;
+    for (int i = 0; i < bt->count; i++) {
+        if (errs[i] != 0) {
+            nft->nl.last_errno = errs[i];
+            ret = nb_nl_error(errs[i]);
+            if (!missing_ok || errs[i] != ENOENT) {
+                NB_LOG_ERROR("nftables %s: message %d failed: %s", what, i, strerror(errs[i]));
+            }
+            break;
+        }
+    }
+    free(errs);
+    return ret;
+}
+
+/* Helper: one expression of a rule */
+static struct nlattr* expr_begin(nft_batch_t *bt, const char *name, struct nlattr **data) {
+    struct nlattr *elem = nb_nl_nest_begin(&bt->buf, NFTA_LIST_ELEM);
+    if (!elem) {
+        bt->failed = 1;
+        return NULL;
+    }
+    put_str(bt, NFTA_EXPR_NAME, name);
+    *data = nb_nl_nest_begin(&bt->buf, NFTA_EXPR_DATA);
+    if (!*data) {
+        bt->failed = 1;
+        return NULL;
+    }
+    return elem;
+}
+
+static void expr_end(nft_batch_t *bt, struct nlattr *elem, struct nlattr *data) {
+    nb_nl_nest_end(&bt->buf, data);
+    nb_nl_nest_end(&bt->buf, elem);
+}
+
+static void expr_meta(nft_batch_t *bt, uint32_t key, uint32_t dreg) {
+    struct nlattr *data;
+    struct nlattr *elem = expr_begin(bt, "meta", &data);
+    if (!elem) return;
+    put_be32(bt, NFTA_META_KEY, key);
+    put_be32(bt, NFTA_META_DREG, dreg);
+    expr_end(bt, elem, data);
+}
+
+static void expr_cmp(nft_batch_t *bt, uint32_t sreg, uint32_t op, const void *value, size_t len) {
+    struct nlattr *data;
+    struct nlattr *elem = expr_begin(bt, "cmp", &data);
+    if (!elem) return;
+    put_be32(bt, NFTA_CMP_SREG, sreg);
+    put_be32(bt, NFTA_CMP_OP, op);
+    put_data(bt, NFTA_CMP_DATA, value, len);
+    expr_end(bt, elem, data);
+}
+
+static void expr_payload(nft_batch_t *bt, uint32_t dreg, uint32_t base, uint32_t offset, uint32_t len) {
+    struct nlattr *data;
+    struct nlattr *elem = expr_begin(bt, "payload", &data);
+    if (!elem) return;
+    put_be32(bt, NFTA_PAYLOAD_DREG, dreg);
+    put_be32(bt, NFTA_PAYLOAD_BASE, base);
+    put_be32(bt, NFTA_PAYLOAD_OFFSET, offset);
+    put_be32(bt, NFTA_PAYLOAD_LEN, len);
+    expr_end(bt, elem, data);
+}
+
+static void expr_lookup(nft_batch_t *bt, const char *set, uint32_t sreg) {
+    struct nlattr *data;
+    struct nlattr *elem = expr_begin(bt, "lookup", &data);
+    if (!elem) return;
+    put_str(bt, NFTA_LOOKUP_SET, set);
+    put_be32(bt, NFTA_LOOKUP_SREG, sreg);
+    expr_end(bt, elem, data);
+}
+
+static void expr_ct(nft_batch_t *bt, uint32_t key, uint32_t dreg) {
+    struct nlattr *data;
+    struct nlattr *elem = expr_begin(bt, "ct", &data);
+    if (!elem) return;
+    put_be32(bt, NFTA_CT_KEY, key);
+    put_be32(bt, NFTA_CT_DREG, dreg);
+    expr_end(bt, elem, data);
+}
+
+/* reg = (reg & mask) ^ 0 */
+static void expr_and(nft_batch_t *bt, uint32_t reg, const void *mask, size_t len) {
+    static const uint8_t zero[16];
+    struct nlattr *data;
+    struct nlattr *elem = expr_begin(bt, "bitwise", &data);
+    if (!elem) return;
+    put_be32(bt, NFTA_BITWISE_SREG, reg);
+    put_be32(bt, NFTA_BITWISE_DREG, reg);
+    put_be32(bt, NFTA_BITWISE_LEN, len);
+    put_data(bt, NFTA_BITWISE_MASK, mask, len);
+    put_data(bt, NFTA_BITWISE_XOR, zero, len);
+    expr_end(bt, elem, data);
+}
+
+static void expr_flow_offload(nft_batch_t *bt, const char *flowtable) {
+    struct nlattr *data;
+    struct nlattr *elem = expr_begin(bt, "flow_offload", &data);
+    if (!elem) return;
+    put_str(bt, NFTA_FLOW_TABLE_NAME, flowtable);
+    expr_end(bt, elem, data);
+}
+
+static void expr_notrack(nft_batch_t *bt) {
+    struct nlattr *elem = nb_nl_nest_begin(&bt->buf, NFTA_LIST_ELEM);
+    if (!elem) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_EXPR_NAME, "notrack");
+    nb_nl_nest_end(&bt->buf, elem);
+}
+
+static void expr_masq(nft_batch_t *bt) {
+    struct nlattr *elem = nb_nl_nest_begin(&bt->buf, NFTA_LIST_ELEM);
+    if (!elem) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_EXPR_NAME, "masq");
+    nb_nl_nest_end(&bt->buf, elem);
+}
+
+/* Address length of a family's sets */
+static size_t family_addr_len(uint8_t family) {
+    return family == AF_INET ? 4 : 16;
+}
+
+/* Set of ifname . address with intervals */
+static void msg_new_set(nft_batch_t *bt, nb_nft_t *nft, const char *name, uint8_t family, uint32_t id) {
+    uint32_t addr_len = family_addr_len(family);
+    uint32_t addr_type = family == AF_INET ? NFT_TYPE_IPADDR : NFT_TYPE_IP6ADDR;
+
+    if (msg_begin(bt, nft, NFT_MSG_NEWSET, NLM_F_CREATE) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_SET_NAME, name);
+    put_be32(bt, NFTA_SET_FLAGS, NFT_SET_INTERVAL | NFT_SET_CONCAT);
+    put_be32(bt, NFTA_SET_KEY_TYPE, (NFT_TYPE_IFNAME << NFT_TYPE_BITS) | addr_type);
+    put_be32(bt, NFTA_SET_KEY_LEN, IFNAMSIZ + addr_len);
+    put_be32(bt, NFTA_SET_ID, id);
+
+    struct nlattr *desc = nb_nl_nest_begin(&bt->buf, NFTA_SET_DESC);
+    struct nlattr *concat = desc ? nb_nl_nest_begin(&bt->buf, NFTA_SET_DESC_CONCAT) : NULL;
+    if (!concat) {
+        bt->failed = 1;
+        return;
+    }
+    uint32_t fields[2] = { IFNAMSIZ, addr_len };
+    for (int i = 0; i < 2; i++) {
+        struct nlattr *field = nb_nl_nest_begin(&bt->buf, NFTA_LIST_ELEM);
+        if (!field) {
+            bt->failed = 1;
+            return;
+        }
+        put_be32(bt, NFTA_SET_FIELD_LEN, fields[i]);
+        nb_nl_nest_end(&bt->buf, field);
+    }
+    nb_nl_nest_end(&bt->buf, concat);
+    nb_nl_nest_end(&bt->buf, desc);
+}
+
+/* meta nfproto <family> oifname . <family> daddr @set masquerade */
+static void msg_masq_rule(nft_batch_t *bt, nb_nft_t *nft, const char *set, uint8_t family) {
+    uint8_t nfproto = family == AF_INET ? NFPROTO_IPV4 : NFPROTO_IPV6;
+
+    if (msg_begin(bt, nft, NFT_MSG_NEWRULE, NLM_F_CREATE | NLM_F_APPEND) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_RULE_CHAIN, NFT_CHAIN_POSTROUTING);
+    struct nlattr *exprs = nb_nl_nest_begin(&bt->buf, NFTA_RULE_EXPRESSIONS);
+    if (!exprs) {
+        bt->failed = 1;
+        return;
+    }
+    expr_meta(bt, NFT_META_NFPROTO, NFT_REG_1);
+    expr_cmp(bt, NFT_REG_1, NFT_CMP_EQ, &nfproto, sizeof(nfproto));
+    /* The concatenation: ifname in registers 1, address right after it */
+    expr_meta(bt, NFT_META_OIFNAME, NFT_REG_1);
+    if (family == AF_INET) {
+        expr_payload(bt, NFT_REG_2, NFT_PAYLOAD_NETWORK_HEADER, 16, 4);
+    } else {
+        expr_payload(bt, NFT_REG_2, NFT_PAYLOAD_NETWORK_HEADER, 24, 16);
+    }
+    expr_lookup(bt, set, NFT_REG_1);
+    expr_masq(bt);
+    nb_nl_nest_end(&bt->buf, exprs);
+}
+
+/* Base chain of the inet family (created if missing) */
+static void msg_new_chain(nft_batch_t *bt, nb_nft_t *nft, const char *name, const char *type,
+                          uint32_t hooknum, uint32_t priority) {
+    if (msg_begin(bt, nft, NFT_MSG_NEWCHAIN, NLM_F_CREATE) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_CHAIN_NAME, name);
+    put_str(bt, NFTA_CHAIN_TYPE, type);
+    struct nlattr *hook = nb_nl_nest_begin(&bt->buf, NFTA_CHAIN_HOOK);
+    if (!hook) {
+        bt->failed = 1;
+        return;
+    }
+    put_be32(bt, NFTA_HOOK_HOOKNUM, hooknum);
+    put_be32(bt, NFTA_HOOK_PRIORITY, priority);
+    nb_nl_nest_end(&bt->buf, hook);
+    put_be32(bt, NFTA_CHAIN_POLICY, NF_ACCEPT);
+}
+
+/* Flowtable on the ingress hook of the devices (none: only declares it) */
+static void msg_new_flowtable(nft_batch_t *bt, nb_nft_t *nft, const char *const *devices, int count) {
+    if (msg_begin(bt, nft, NFT_MSG_NEWFLOWTABLE, NLM_F_CREATE) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_FLOWTABLE_NAME, NFT_FLOWTABLE);
+    struct nlattr *hook = nb_nl_nest_begin(&bt->buf, NFTA_FLOWTABLE_HOOK);
+    if (!hook) {
+        bt->failed = 1;
+        return;
+    }
+    put_be32(bt, NFTA_FLOWTABLE_HOOK_NUM, NF_NETDEV_INGRESS);
+    put_be32(bt, NFTA_FLOWTABLE_HOOK_PRIORITY, NFT_PRIO_FILTER);
+    if (count > 0) {
+        struct nlattr *devs = nb_nl_nest_begin(&bt->buf, NFTA_FLOWTABLE_HOOK_DEVS);
+        if (!devs) {
+            bt->failed = 1;
+            return;
+        }
+        for (int i = 0; i < count; i++) {
+            put_str(bt, NFTA_DEVICE_NAME, devices[i]);
+        }
+        nb_nl_nest_end(&bt->buf, devs);
+    }
+    nb_nl_nest_end(&bt->buf, hook);
+}
+
+/*
+ * Drop the forward chain and the flowtable, whether they exist or not:
+ * declaring an object first makes its deletion succeed either way, and
+ * the rule goes first because it holds the flowtable.
+ */
+static void batch_offload_drop(nft_batch_t *bt, nb_nft_t *nft) {
+    msg_new_chain(bt, nft, NFT_CHAIN_FORWARD, "filter", NF_INET_FORWARD, NFT_PRIO_FILTER);
+    if (msg_begin(bt, nft, NFT_MSG_DELRULE, 0) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_RULE_CHAIN, NFT_CHAIN_FORWARD);
+    if (msg_begin(bt, nft, NFT_MSG_DELCHAIN, 0) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_CHAIN_NAME, NFT_CHAIN_FORWARD);
+
+    msg_new_flowtable(bt, nft, NULL, 0);
+    if (msg_begin(bt, nft, NFT_MSG_DELFLOWTABLE, 0) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_FLOWTABLE_NAME, NFT_FLOWTABLE);
+}
+
+/* ct state established flow add @ft */
+static void msg_offload_rule(nft_batch_t *bt, nb_nft_t *nft) {
+    uint32_t established = NF_CT_STATE_BIT(IP_CT_ESTABLISHED);
+    uint32_t zero = 0;
+
+    if (msg_begin(bt, nft, NFT_MSG_NEWRULE, NLM_F_CREATE | NLM_F_APPEND) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_RULE_CHAIN, NFT_CHAIN_FORWARD);
+    struct nlattr *exprs = nb_nl_nest_begin(&bt->buf, NFTA_RULE_EXPRESSIONS);
+    if (!exprs) {
+        bt->failed = 1;
+        return;
+    }
+    expr_ct(bt, NFT_CT_STATE, NFT_REG_1);
+    expr_and(bt, NFT_REG_1, &established, sizeof(established));
+    expr_cmp(bt, NFT_REG_1, NFT_CMP_NEQ, &zero, sizeof(zero));
+    expr_flow_offload(bt, NFT_FLOWTABLE);
+    nb_nl_nest_end(&bt->buf, exprs);
+}
+
+/* Table, chain, sets and rules; leftovers of an earlier run are dropped */
+static void batch_masq_setup(nft_batch_t *bt, nb_nft_t *nft) {
+    if (msg_begin(bt, nft, NFT_MSG_NEWTABLE, NLM_F_CREATE) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+
+    msg_new_chain(bt, nft, NFT_CHAIN_POSTROUTING, "nat", NF_INET_POST_ROUTING, NFT_PRIO_SRCNAT);
+
+    /* Flush the chain's rules (a DELRULE without handle) */
+    if (msg_begin(bt, nft, NFT_MSG_DELRULE, 0) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_RULE_CHAIN, NFT_CHAIN_POSTROUTING);
+
+    msg_new_set(bt, nft, NFT_SET_MASQ4, AF_INET, 1);
+    msg_new_set(bt, nft, NFT_SET_MASQ6, AF_INET6, 2);
+    msg_masq_rule(bt, nft, NFT_SET_MASQ4, AF_INET);
+    msg_masq_rule(bt, nft, NFT_SET_MASQ6, AF_INET6);
+}
+
+/* Flush a set (a DELSETELEM without elements) */
+static void msg_set_flush(nft_batch_t *bt, nb_nft_t *nft, const char *set) {
+    if (msg_begin(bt, nft, NFT_MSG_DELSETELEM, 0) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_SET_ELEM_LIST_SET, set);
+}
+
+static int range_cmp(const void *pa, const void *pb) {
+    const masq_range_t *a = pa;
+    const masq_range_t *b = pb;
+    if (a->family != b->family) {
+        return a->family - b->family;
+    }
+    int c = strcmp(a->device, b->device);
+    if (c != 0) {
+        return c;
+    }
+    return memcmp(a->start, b->start, sizeof(a->start));
+}
+
+/* Sorted, non-overlapping ranges for the entries; returns the count */
+static int masq_ranges(const nb_nft_masq_t *entries, int count, masq_range_t *out) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        const nb_prefix_t *p = &entries[i].prefix;
+        masq_range_t *r = &out[n];
+        memset(r, 0, sizeof(*r));
+        memcpy(r->device, entries[i].device, sizeof(r->device));
+        r->device[IFNAMSIZ - 1] = '\0';
+        r->family = p->family;
+
+        int bits = (int)family_addr_len(p->family) * 8;
+        for (int bit = 0; bit < bits; bit++) {
+            uint8_t mask = 0x80 >> (bit % 8);
+            if (bit < p->len) {
+                r->start[bit / 8] |= p->addr[bit / 8] & mask;
+                r->end[bit / 8] |= p->addr[bit / 8] & mask;
+            } else {
+                r->end[bit / 8] |= mask;
+            }
+        }
+        n++;
+    }
+    qsort(out, n, sizeof(masq_range_t), range_cmp);
+
+    /* Merge ranges of a device that overlap */
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        masq_range_t *prev = m > 0 ? &out[m - 1] : NULL;
+        if (prev && prev->family == out[i].family &&
+            strcmp(prev->device, out[i].device) == 0 &&
+            memcmp(out[i].start, prev->end, sizeof(prev->end)) <= 0) {
+            if (memcmp(out[i].end, prev->end, sizeof(prev->end)) > 0) {
+                memcpy(prev->end, out[i].end, sizeof(prev->end));
+            }
+            continue;
+        }
+        out[m++] = out[i];
+    }
+    return m;
+}
+
+/* NEWSETELEM messages for the ranges of one family */
+static void batch_masq_elems(nft_batch_t *bt, nb_nft_t *nft, const masq_range_t *ranges, int count,
+                             uint8_t family) {
+    const char *set = family == AF_INET ? NFT_SET_MASQ4 : NFT_SET_MASQ6;
+    size_t addr_len = family_addr_len(family);
+    struct nlattr *list = NULL;
+    int in_msg = 0;
+
+    for (int i = 0; i < count && !bt->failed; i++) {
+        const masq_range_t *r = &ranges[i];
+        if (r->family != family) {
+            continue;
+        }
+        if (!list || in_msg == NFT_ELEMS_PER_MSG) {
+            if (list) {
+                nb_nl_nest_end(&bt->buf, list);
+            }
+            if (msg_begin(bt, nft, NFT_MSG_NEWSETELEM, NLM_F_CREATE) != NB_SUCCESS) {
+                bt->failed = 1;
+                return;
+            }
+            put_str(bt, NFTA_SET_ELEM_LIST_SET, set);
+            list = nb_nl_nest_begin(&bt->buf, NFTA_SET_ELEM_LIST_ELEMENTS);
+            if (!list) {
+                bt->failed = 1;
+                return;
+            }
+            in_msg = 0;
+        }
+
+        uint8_t key[IFNAMSIZ + 16];
+        uint8_t key_end[IFNAMSIZ + 16];
+        memcpy(key, r->device, IFNAMSIZ);
+        memcpy(key + IFNAMSIZ, r->start, addr_len);
+        memcpy(key_end, r->device, IFNAMSIZ);
+        memcpy(key_end + IFNAMSIZ, r->end, addr_len);
+
+        struct nlattr *elem = nb_nl_nest_begin(&bt->buf, NFTA_LIST_ELEM);
+        if (!elem) {
+            bt->failed = 1;
+            return;
+        }
+        put_data(bt, NFTA_SET_ELEM_KEY, key, IFNAMSIZ + addr_len);
+        put_data(bt, NFTA_SET_ELEM_KEY_END, key_end, IFNAMSIZ + addr_len);
+        nb_nl_nest_end(&bt->buf, elem);
+        in_msg++;
+    }
+    if (list) {
+        nb_nl_nest_end(&bt->buf, list);
+    }
+}
+
+int nb_nft_masq_set(nb_nft_t *nft, const nb_nft_masq_t *entries, int count) {
+    if (!nft || nft->nl.fd < 0 || count < 0 || (count > 0 && !entries)) {
+        return NB_ERROR_INVALID;
+    }
+    for (int i = 0; i < count; i++) {
+        uint8_t family = entries[i].prefix.family;
+        if (!entries[i].device[0] || (family != AF_INET && family != AF_INET6) ||
+            entries[i].prefix.len > family_addr_len(family) * 8) {
+            NB_LOG_ERROR("Invalid masquerade entry %d", i);
+            return NB_ERROR_INVALID;
+        }
+    }
+
+    masq_range_t *ranges = calloc(count > 0 ? count : 1, sizeof(masq_range_t));
+    if (!ranges) {
+        return NB_ERROR_SYSTEM;
+    }
+    int n = masq_ranges(entries, count, ranges);
+
+    nft_batch_t bt;
+    if (batch_init(&bt, NFT_BATCH_OVERHEAD + (size_t)n * NFT_ELEM_MAX) != NB_SUCCESS) {
+        free(ranges);
+        return NB_ERROR_SYSTEM;
+    }
+    batch_marker(&bt, nft, NFNL_MSG_BATCH_BEGIN);
+    if (!nft->masq_ready) {
+        batch_masq_setup(&bt, nft);
+    }
+    msg_set_flush(&bt, nft, NFT_SET_MASQ4);
+    msg_set_flush(&bt, nft, NFT_SET_MASQ6);
+    batch_masq_elems(&bt, nft, ranges, n, AF_INET);
+    batch_masq_elems(&bt, nft, ranges, n, AF_INET6);
+    batch_marker(&bt, nft, NFNL_MSG_BATCH_END);
+    free(ranges);
+
+    int ret = batch_commit(&bt, nft, "masquerade", 0);
+    nb_nl_buf_free(&bt.buf);
+    if (ret == NB_SUCCESS) {
+        nft->masq_ready = 1;
+        NB_LOG_DEBUG("nftables: %d masquerade element(s) from %d entr%s", n, count,
+                     count == 1 ? "y" : "ies");
+    }
+    return ret;
+}
+
+int nb_nft_offload_set(nb_nft_t *nft, const char *const *devices, int count) {
+    if (!nft || nft->nl.fd < 0 || count < 0 || count > NB_NFT_OFFLOAD_MAX || (count > 0 && !devices)) {
+        return NB_ERROR_INVALID;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!devices[i] || !devices[i][0] || strlen(devices[i]) >= IFNAMSIZ) {
+            NB_LOG_ERROR("Invalid offload device %d", i);
+            return NB_ERROR_INVALID;
+        }
+        if (if_nametoindex(devices[i]) == 0) {
+            NB_LOG_ERROR("Offload device %s does not exist", devices[i]);
+            return NB_ERROR_NOTFOUND;
+        }
+    }
+    if (count == 0 && !nft->offload_ready) {
+        return NB_SUCCESS;
+    }
+
+    nft_batch_t bt;
+    if (batch_init(&bt, NFT_BATCH_OVERHEAD + (size_t)count * NLA_ALIGN(NLA_HDRLEN + IFNAMSIZ)) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+    batch_marker(&bt, nft, NFNL_MSG_BATCH_BEGIN);
+    if (msg_begin(&bt, nft, NFT_MSG_NEWTABLE, NLM_F_CREATE) != NB_SUCCESS) {
+        bt.failed = 1;
+    }
+    batch_offload_drop(&bt, nft);
+    if (count > 0) {
+        msg_new_flowtable(&bt, nft, devices, count);
+        msg_new_chain(&bt, nft, NFT_CHAIN_FORWARD, "filter", NF_INET_FORWARD, NFT_PRIO_FILTER);
+        msg_offload_rule(&bt, nft);
+    }
+    batch_marker(&bt, nft, NFNL_MSG_BATCH_END);
+
+    int ret = batch_commit(&bt, nft, "flowtable", 0);
+    nb_nl_buf_free(&bt.buf);
+    if (ret == NB_SUCCESS) {
+        nft->offload_ready = count > 0;
+        NB_LOG_DEBUG("nftables: flowtable %s on %d device(s)", count ? "set" : "removed", count);
+    } else if (ret == NB_ERROR_NOTFOUND) {
+        /* The devices exist: it is the flowtable type that is missing */
+        NB_LOG_WARN("nftables: flowtables not supported by the kernel (nf_flow_table)");
+        ret = NB_ERROR_SYSTEM;
+    }
+    return ret;
+}
+
+/* Chain with one rule: udp <sport|dport> <port> notrack (the chain is flushed first) */
+static void batch_notrack_chain(nft_batch_t *bt, nb_nft_t *nft, const char *chain, uint32_t hooknum,
+                                uint32_t port_offset, uint16_t port) {
+    uint8_t udp = IPPROTO_UDP;
+    uint16_t be_port = htons(port);
+
+    msg_new_chain(bt, nft, chain, "filter", hooknum, NFT_PRIO_RAW);
+    if (msg_begin(bt, nft, NFT_MSG_DELRULE, 0) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_RULE_CHAIN, chain);
+
+    if (msg_begin(bt, nft, NFT_MSG_NEWRULE, NLM_F_CREATE | NLM_F_APPEND) != NB_SUCCESS) {
+        bt->failed = 1;
+        return;
+    }
+    put_str(bt, NFTA_RULE_CHAIN, chain);
+    struct nlattr *exprs = nb_nl_nest_begin(&bt->buf, NFTA_RULE_EXPRESSIONS);
+    if (!exprs) {
+        bt->failed = 1;
+        return;
+    }
+    expr_meta(bt, NFT_META_L4PROTO, NFT_REG_1);
+    expr_cmp(bt, NFT_REG_1, NFT_CMP_EQ, &udp, sizeof(udp));
+    expr_payload(bt, NFT_REG_1, NFT_PAYLOAD_TRANSPORT_HEADER, port_offset, sizeof(be_port));
+    expr_cmp(bt, NFT_REG_1, NFT_CMP_EQ, &be_port, sizeof(be_port));
+    expr_notrack(bt);
+    nb_nl_nest_end(&bt->buf, exprs);
+}
+
+int nb_nft_notrack_set(nb_nft_t *nft, uint16_t port) {
+    if (!nft || nft->nl.fd < 0 || port == 0) {
+        return NB_ERROR_INVALID;
+    }
+
+    nft_batch_t bt;
+    if (batch_init(&bt, NFT_BATCH_OVERHEAD) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+    batch_marker(&bt, nft, NFNL_MSG_BATCH_BEGIN);
+    if (msg_begin(&bt, nft, NFT_MSG_NEWTABLE, NLM_F_CREATE) != NB_SUCCESS) {
+        bt.failed = 1;
+    }
+    /* Incoming tunnel packets by destination port, outgoing ones by source port */
+    batch_notrack_chain(&bt, nft, NFT_CHAIN_RAW_PRE, NF_INET_PRE_ROUTING, 2, port);
+    batch_notrack_chain(&bt, nft, NFT_CHAIN_RAW_OUT, NF_INET_LOCAL_OUT, 0, port);
+    batch_marker(&bt, nft, NFNL_MSG_BATCH_END);
+
+    int ret = batch_commit(&bt, nft, "notrack", 0);
+    nb_nl_buf_free(&bt.buf);
+    if (ret == NB_SUCCESS) {
+        NB_LOG_DEBUG("nftables: conntrack bypass for UDP port %u in table %s", port, nft->table);
+    }
+    return ret;
+}
+
+int nb_nft_table_delete(nb_nft_t *nft) {
+    if (!nft || nft->nl.fd < 0) {
+        return NB_ERROR_INVALID;
+    }
+
+    nft_batch_t bt;
+    if (batch_init(&bt, 256) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+    batch_marker(&bt, nft, NFNL_MSG_BATCH_BEGIN);
+    msg_begin(&bt, nft, NFT_MSG_DELTABLE, 0);
+    batch_marker(&bt, nft, NFNL_MSG_BATCH_END);
+
+    int ret = batch_commit(&bt, nft, "table delete", 1);
+    nb_nl_buf_free(&bt.buf);
+    nft->masq_ready = 0;
+    nft->offload_ready = 0;
+    return ret == NB_ERROR_NOTFOUND ? NB_SUCCESS : ret;
+}
+
+/* Callback: count the elements of GETSETELEM replies */
+static int set_count_cb(const struct nlmsghdr *nlh, void *ctx) {
+    const struct nlattr *tb[NFTA_SET_ELEM_LIST_MAX + 1];
+    const struct nlattr *a;
+
+    nb_nl_msg_parse(nlh, sizeof(struct nfgenmsg), tb, NFTA_SET_ELEM_LIST_MAX);
+    if (tb[NFTA_SET_ELEM_LIST_ELEMENTS]) {
+        nb_nl_attr_for_each(a, nb_nl_attr_data(tb[NFTA_SET_ELEM_LIST_ELEMENTS]),
+                            nb_nl_attr_len(tb[NFTA_SET_ELEM_LIST_ELEMENTS])) {
+            (*(int *)ctx)++;
+        }
+    }
+    return NB_SUCCESS;
+}
+
+int nb_nft_set_count(nb_nft_t *nft, const char *set) {
+    if (!nft || nft->nl.fd < 0 || !set) {
+        return NB_ERROR_INVALID;
+    }
+
+    nb_nl_buf_t b;
+    if (nb_nl_buf_init(&b, 256) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+    int count = 0;
+    int ret = NB_ERROR_SYSTEM;
+    struct nfgenmsg *g = NULL;
+    if (nb_nl_msg_begin(&b, NFT_MSG(NFT_MSG_GETSETELEM), NLM_F_REQUEST | NLM_F_DUMP,
+                        nb_nl_next_seq(&nft->nl))) {
+        g = nb_nl_msg_put_header(&b, sizeof(*g));
+    }
+    if (g) {
+        g->nfgen_family = NFPROTO_INET;
+        g->version = NFNETLINK_V0;
+        if (nb_nl_attr_put_str(&b, NFTA_SET_ELEM_LIST_TABLE, nft->table) == NB_SUCCESS &&
+            nb_nl_attr_put_str(&b, NFTA_SET_ELEM_LIST_SET, set) == NB_SUCCESS) {
+            ret = nb_nl_transact(&nft->nl, &b, set_count_cb, &count);
+        }
+    }
+    nb_nl_buf_free(&b);
+    return ret == NB_SUCCESS ? count : ret;
+}
+
+/* Callback: count the hook devices of a GETFLOWTABLE reply */
+static int flowtable_devices_cb(const struct nlmsghdr *nlh, void *ctx) {
+    const struct nlattr *tb[NFTA_FLOWTABLE_MAX + 1];
+    const struct nlattr *hook[NFTA_FLOWTABLE_HOOK_MAX + 1];
+    const struct nlattr *a;
+
+    nb_nl_msg_parse(nlh, sizeof(struct nfgenmsg), tb, NFTA_FLOWTABLE_MAX);
+    if (!tb[NFTA_FLOWTABLE_HOOK]) {
+        return NB_SUCCESS;
+    }
+    nb_nl_attr_parse(nb_nl_attr_data(tb[NFTA_FLOWTABLE_HOOK]), nb_nl_attr_len(tb[NFTA_FLOWTABLE_HOOK]),
+                     hook, NFTA_FLOWTABLE_HOOK_MAX);
+    if (hook[NFTA_FLOWTABLE_HOOK_DEVS]) {
+        nb_nl_attr_for_each(a, nb_nl_attr_data(hook[NFTA_FLOWTABLE_HOOK_DEVS]),
+                            nb_nl_attr_len(hook[NFTA_FLOWTABLE_HOOK_DEVS])) {
+            (*(int *)ctx)++;
+        }
+    }
+    return NB_SUCCESS;
+}
+
+int nb_nft_flowtable_devices(nb_nft_t *nft) {
+    if (!nft || nft->nl.fd < 0) {
+        return NB_ERROR_INVALID;
+    }
+
+    nb_nl_buf_t b;
+    if (nb_nl_buf_init(&b, 256) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+    int count = 0;
+    int ret = NB_ERROR_SYSTEM;
+    struct nfgenmsg *g = NULL;
+    if (nb_nl_msg_begin(&b, NFT_MSG(NFT_MSG_GETFLOWTABLE), NLM_F_REQUEST, nb_nl_next_seq(&nft->nl))) {
+        g = nb_nl_msg_put_header(&b, sizeof(*g));
+    }
+    if (g) {
+        g->nfgen_family = NFPROTO_INET;
+        g->version = NFNETLINK_V0;
+        if (nb_nl_attr_put_str(&b, NFTA_FLOWTABLE_TABLE, nft->table) == NB_SUCCESS &&
+            nb_nl_attr_put_str(&b, NFTA_FLOWTABLE_NAME, NFT_FLOWTABLE) == NB_SUCCESS) {
+            ret = nb_nl_transact(&nft->nl, &b, flowtable_devices_cb, &count);
+        }
+    }
+    nb_nl_buf_free(&b);
+    return ret == NB_SUCCESS ? count : ret;
+}
+
+int nb_nft_table_exists(nb_nft_t *nft) {
+    if (!nft || nft->nl.fd < 0) {
+        return NB_ERROR_INVALID;
+    }
+
+    nb_nl_buf_t b;
+    if (nb_nl_buf_init(&b, 256) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+    int ret = NB_ERROR_SYSTEM;
+    struct nfgenmsg *g = NULL;
+    if (nb_nl_msg_begin(&b, NFT_MSG(NFT_MSG_GETTABLE), NLM_F_REQUEST, nb_nl_next_seq(&nft->nl))) {
+        g = nb_nl_msg_put_header(&b, sizeof(*g));
+    }
+    if (g) {
+        g->nfgen_family = NFPROTO_INET;
+        g->version = NFNETLINK_V0;
+        if (nb_nl_attr_put_str(&b, NFTA_TABLE_NAME, nft->table) == NB_SUCCESS) {
+            ret = nb_nl_transact(&nft->nl, &b, NULL, NULL);
+        }
+    }
+    nb_nl_buf_free(&b);
+    if (ret == NB_ERROR_NOTFOUND) {
+        return 0;
+    }
+    return ret == NB_SUCCESS ? 1 : ret;
+}
+
+int nb_ip_forward_enable(int family) {
+    const char *path = family == AF_INET6 ? "/proc/sys/net/ipv6/conf/all/forwarding"
+                                          : "/proc/sys/net/ipv4/ip_forward";
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        NB_LOG_WARN("Cannot open %s: %s", path, strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+    ssize_t n = write(fd, "1\n", 2);
+    int err = errno;
+    close(fd);
+    if (n != 2) {
+        NB_LOG_WARN("Cannot enable forwarding in %s: %s", path, strerror(err));
+        return NB_ERROR_SYSTEM;
+    }
+    return NB_SUCCESS;
+}
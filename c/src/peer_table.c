@@ -0,0 +1,367 @@
+/**
+ * peer_table.c - Engine peer table keyed by raw public keys
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "peer_table.h"
+#include "common.h"
+#include <sys/random.h>
+
+#define SLOT_EMPTY      UINT32_MAX
+#define MIN_SLOTS       16
+
+typedef struct {
+    uint32_t hash;
+    uint32_t idx;                 /* Record index, SLOT_EMPTY if free */
+} slot_t;
+
+struct nb_peer_table {
+    slot_t *slots;
+    uint32_t mask;                /* Slot count - 1 (power of two) */
+
+    nb_peer_record_t *records;
+    uint32_t count;
+    uint32_t capacity;
+
+    nb_prefix_t *slab;
+    uint32_t slab_len;
+    uint32_t slab_cap;
+    uint32_t slab_garbage;        /* Entries no record refers to */
+
+    uint32_t *id_to_idx;          /* Record index by id, SLOT_EMPTY if unused */
+    uint32_t *free_ids;           /* Stack of released ids */
+    uint32_t free_count;
+    uint32_t next_id;             /* Ids below this have been handed out */
+
+    uint64_t seed;
+};
+
+/*
+ * Public keys are curve points and already look random, so mixing two
+ * words with a per-table seed is enough to spread them.
+ */
+static uint32_t key_hash(const nb_peer_table_t *t, const uint8_t key[WG_KEY_LEN]) {
+    uint64_t a, b;
+    memcpy(&a, key, sizeof(a));
+    memcpy(&b, key + 8, sizeof(b));
+
+    uint64_t h = (a ^ t->seed) * UINT64_C(0x9E3779B97F4A7C15);
+    h ^= b + (h >> 29);
+    h *= UINT64_C(0xBF58476D1CE4E5B9);
+    return (uint32_t)(h >> 32);
+}
+
+static int slots_alloc(nb_peer_table_t *t, uint32_t nslots) {
+    slot_t *slots = malloc(nslots * sizeof(slot_t));
+    if (!slots) {
+        NB_LOG_ERROR("malloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    for (uint32_t i = 0; i < nslots; i++) {
+        slots[i].idx = SLOT_EMPTY;
+    }
+
+    free(t->slots);
+    t->slots = slots;
+    t->mask = nslots - 1;
+
+    /* Reindex the dense records */
+    for (uint32_t r = 0; r < t->count; r++) {
+        uint32_t h = key_hash(t, t->records[r].public_key);
+        uint32_t i = h & t->mask;
+        while (t->slots[i].idx != SLOT_EMPTY) {
+            i = (i + 1) & t->mask;
+        }
+        t->slots[i].hash = h;
+        t->slots[i].idx = r;
+    }
+    return NB_SUCCESS;
+}
+
+/* Slot holding key, or SLOT_EMPTY */
+static uint32_t slot_find(const nb_peer_table_t *t, const uint8_t key[WG_KEY_LEN], uint32_t h) {
+    uint32_t i = h & t->mask;
+
+    while (t->slots[i].idx != SLOT_EMPTY) {
+        if (t->slots[i].hash == h &&
+            memcmp(t->records[t->slots[i].idx].public_key, key, WG_KEY_LEN) == 0) {
+            return i;
+        }
+        i = (i + 1) & t->mask;
+    }
+    return SLOT_EMPTY;
+}
+
+static int records_reserve(nb_peer_table_t *t, uint32_t need) {
+    if (need <= t->capacity) {
+        return NB_SUCCESS;
+    }
+
+    uint32_t cap = t->capacity ? t->capacity : MIN_SLOTS / 2;
+    while (cap < need) cap *= 2;
+
+    nb_peer_record_t *r = realloc(t->records, cap * sizeof(nb_peer_record_t));
+    if (!r) {
+        NB_LOG_ERROR("realloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    t->records = r;
+
+    /* Never more live ids than records, so both id arrays share the capacity */
+    uint32_t *map = realloc(t->id_to_idx, cap * sizeof(uint32_t));
+    if (!map) {
+        NB_LOG_ERROR("realloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    t->id_to_idx = map;
+    uint32_t *ids = realloc(t->free_ids, cap * sizeof(uint32_t));
+    if (!ids) {
+        NB_LOG_ERROR("realloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    t->free_ids = ids;
+    t->capacity = cap;
+
+    /* Keep the index at most half full */
+    if ((uint64_t)cap * 2 > (uint64_t)t->mask + 1) {
+        uint32_t nslots = t->mask + 1;
+        while (nslots < cap * 2) nslots *= 2;
+        return slots_alloc(t, nslots);
+    }
+    return NB_SUCCESS;
+}
+
+/* Rewrite the slab with only live lists */
+static int slab_compact(nb_peer_table_t *t, uint32_t extra) {
+    uint32_t live = t->slab_len - t->slab_garbage;
+    uint32_t cap = MIN_SLOTS;
+    while (cap < live + extra) cap *= 2;
+
+    nb_prefix_t *slab = malloc(cap * sizeof(nb_prefix_t));
+    if (!slab) {
+        NB_LOG_ERROR("malloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+
+    uint32_t len = 0;
+    for (uint32_t r = 0; r < t->count; r++) {
+        nb_peer_record_t *rec = &t->records[r];
+        memcpy(&slab[len], &t->slab[rec->ips_off], rec->ips_count * sizeof(nb_prefix_t));
+        rec->ips_off = len;
+        len += rec->ips_count;
+    }
+
+    free(t->slab);
+    t->slab = slab;
+    t->slab_len = len;
+    t->slab_cap = cap;
+    t->slab_garbage = 0;
+    return NB_SUCCESS;
+}
+
+/* Make room for n more slab entries at the end */
+static int slab_reserve(nb_peer_table_t *t, uint32_t n) {
+    if (t->slab_len + n <= t->slab_cap) {
+        return NB_SUCCESS;
+    }
+    if (t->slab_garbage > t->slab_len / 2) {
+        return slab_compact(t, n);
+    }
+
+    uint32_t cap = t->slab_cap ? t->slab_cap : MIN_SLOTS;
+    while (cap < t->slab_len + n) cap *= 2;
+
+    nb_prefix_t *slab = realloc(t->slab, cap * sizeof(nb_prefix_t));
+    if (!slab) {
+        NB_LOG_ERROR("realloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    t->slab = slab;
+    t->slab_cap = cap;
+    return NB_SUCCESS;
+}
+
+nb_peer_table_t* nb_peer_table_new(int capacity_hint) {
+    nb_peer_table_t *t = calloc(1, sizeof(nb_peer_table_t));
+    if (!t) {
+        NB_LOG_ERROR("calloc failed");
+        return NULL;
+    }
+
+    if (getrandom(&t->seed, sizeof(t->seed), GRND_NONBLOCK) != sizeof(t->seed)) {
+        t->seed = (uint64_t)(uintptr_t)t ^ UINT64_C(0x2545F4914F6CDD1D);
+    }
+
+    if (slots_alloc(t, MIN_SLOTS) != NB_SUCCESS ||
+        records_reserve(t, capacity_hint > 0 ? (uint32_t)capacity_hint : 1) != NB_SUCCESS) {
+        nb_peer_table_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void nb_peer_table_free(nb_peer_table_t *table) {
+    if (!table) return;
+
+    free(table->slots);
+    free(table->records);
+    free(table->slab);
+    free(table->id_to_idx);
+    free(table->free_ids);
+    free(table);
+}
+
+void nb_peer_table_clear(nb_peer_table_t *table) {
+    if (!table) return;
+
+    for (uint32_t i = 0; i <= table->mask; i++) {
+        table->slots[i].idx = SLOT_EMPTY;
+    }
+    table->count = 0;
+    table->slab_len = 0;
+    table->slab_garbage = 0;
+    table->free_count = 0;
+    table->next_id = 0;
+}
+
+int nb_peer_table_upsert(nb_peer_table_t *table, const uint8_t key[WG_KEY_LEN],
+                         const nb_endpoint_t *endpoint, int keepalive,
+                         const nb_prefix_t *ips, int ips_count) {
+    if (!table || !key || ips_count < -1 || ips_count > UINT16_MAX || (!ips && ips_count > 0)) {
+        return NB_ERROR_INVALID;
+    }
+
+    /* Reserve first so a failure leaves the table untouched */
+    if (ips_count > 0 && slab_reserve(table, ips_count) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    uint32_t h = key_hash(table, key);
+    uint32_t s = slot_find(table, key, h);
+    nb_peer_record_t *rec;
+
+    if (s == SLOT_EMPTY) {
+        if (records_reserve(table, table->count + 1) != NB_SUCCESS) {
+            return NB_ERROR_SYSTEM;
+        }
+
+        uint32_t i = h & table->mask;
+        while (table->slots[i].idx != SLOT_EMPTY) {
+            i = (i + 1) & table->mask;
+        }
+        table->slots[i].hash = h;
+        table->slots[i].idx = table->count;
+
+        rec = &table->records[table->count];
+        memset(rec, 0, sizeof(*rec));
+        memcpy(rec->public_key, key, WG_KEY_LEN);
+        rec->id = table->free_count ? table->free_ids[--table->free_count] : table->next_id++;
+        table->id_to_idx[rec->id] = table->count++;
+    } else {
+        rec = &table->records[table->slots[s].idx];
+    }
+
+    /* Reuse the old list if the new one fits, otherwise append */
+    if (ips_count < 0) {
+        /* Keep the current list */
+    } else if ((uint32_t)ips_count > rec->ips_count) {
+        table->slab_garbage += rec->ips_count;
+        rec->ips_off = table->slab_len;
+        table->slab_len += ips_count;
+    } else {
+        table->slab_garbage += rec->ips_count - ips_count;
+    }
+    if (ips_count >= 0) {
+        if (ips_count > 0) {
+            memcpy(&table->slab[rec->ips_off], ips, ips_count * sizeof(nb_prefix_t));
+        }
+        rec->ips_count = (uint16_t)ips_count;
+    }
+
+    if (endpoint) {
+        rec->endpoint = *endpoint;
+    } else {
+        memset(&rec->endpoint, 0, sizeof(rec->endpoint));
+    }
+    rec->keepalive = keepalive > 0 && keepalive <= UINT16_MAX ? (uint16_t)keepalive : 0;
+    return NB_SUCCESS;
+}
+
+nb_peer_record_t* nb_peer_table_find(const nb_peer_table_t *table, const uint8_t key[WG_KEY_LEN]) {
+    if (!table || !key) return NULL;
+
+    uint32_t s = slot_find(table, key, key_hash(table, key));
+    return s == SLOT_EMPTY ? NULL : &table->records[table->slots[s].idx];
+}
+
+int nb_peer_table_remove(nb_peer_table_t *table, const uint8_t key[WG_KEY_LEN]) {
+    if (!table || !key) return NB_ERROR_INVALID;
+
+    uint32_t s = slot_find(table, key, key_hash(table, key));
+    if (s == SLOT_EMPTY) {
+        return NB_ERROR_NOTFOUND;
+    }
+
+    uint32_t idx = table->slots[s].idx;
+    table->slab_garbage += table->records[idx].ips_count;
+    table->id_to_idx[table->records[idx].id] = SLOT_EMPTY;
+    table->free_ids[table->free_count++] = table->records[idx].id;
+
+    /* Backward shift deletion keeps probe sequences intact */
+    uint32_t i = s;
+    uint32_t j = s;
+    for (;;) {
+        j = (j + 1) & table->mask;
+        if (table->slots[j].idx == SLOT_EMPTY) {
+            break;
+        }
+        uint32_t home = table->slots[j].hash & table->mask;
+        /* Move j into i unless its home lies cyclically in (i, j] */
+        int in_range = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+        if (!in_range) {
+            table->slots[i] = table->slots[j];
+            i = j;
+        }
+    }
+    table->slots[i].idx = SLOT_EMPTY;
+
+    /* Keep records dense: move the last record into the hole */
+    uint32_t last = table->count - 1;
+    if (idx != last) {
+        table->records[idx] = table->records[last];
+        /* records[last] still holds the key, so this finds the slot pointing at it */
+        uint32_t ls = slot_find(table, table->records[idx].public_key,
+                                key_hash(table, table->records[idx].public_key));
+        table->slots[ls].idx = idx;
+        table->id_to_idx[table->records[idx].id] = idx;
+    }
+    table->count--;
+
+    if (table->count == 0) {
+        table->slab_len = 0;
+        table->slab_garbage = 0;
+    }
+    return NB_SUCCESS;
+}
+
+const nb_prefix_t* nb_peer_table_allowed_ips(const nb_peer_table_t *table,
+                                             const nb_peer_record_t *rec) {
+    if (!table || !rec || rec->ips_count == 0) return NULL;
+    return &table->slab[rec->ips_off];
+}
+
+nb_peer_record_t* nb_peer_table_by_id(const nb_peer_table_t *table, uint32_t id) {
+    if (!table || id >= table->next_id || table->id_to_idx[id] == SLOT_EMPTY) return NULL;
+    return &table->records[table->id_to_idx[id]];
+}
+
+int nb_peer_table_count(const nb_peer_table_t *table) {
+    return table ? (int)table->count : 0;
+}
+
+nb_peer_record_t* nb_peer_table_at(const nb_peer_table_t *table, int i) {
+    if (!table || i < 0 || (uint32_t)i >= table->count) return NULL;
+    return &table->records[i];
+}
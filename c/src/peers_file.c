@@ -1,146 +1,558 @@
 /**
  * peers_file.c - Peers JSON file reader implementation
  *
+ * A single-pass scanner over the mapped file: no document tree is built.
+ * Only the members the reader knows are decoded, anything else is skipped
+ * in place. Strings of the current peer are decoded into a scratch buffer
+ * that is reused for the next peer, so memory is bounded by the largest
+ * peer object rather than the file.
+ *
  * Author: Claude
  * Date: 2025-12-01
  */
 
 #include "peers_file.h"
 #include "common.h"
-#include <cjson/cJSON.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-int peers_file_load(const char *path, peers_file_t **peers_out) {
-    if (!path || !peers_out) {
-        NB_LOG_ERROR("Invalid arguments");
-        return NB_ERROR_INVALID;
+#define JSON_MAX_DEPTH  64
+#define NO_STRING       ((size_t)-1)
+
+/* Scanner state */
+typedef struct {
+    const char *p;
+    const char *end;
+    const char *start;
+    const char *error;          /* Position of the first syntax error */
+
+    /* Decoded strings of the current peer */
+    char *scratch;
+    size_t used;
+    size_t cap;
+    size_t *ips;                /* Offsets of the allowed IPs in scratch */
+    int ips_count;
+    int ips_cap;
+    char **ip_ptrs;             /* Resolved for the callback */
+} scan_t;
+
+static int fail(scan_t *s) {
+    if (!s->error) {
+        s->error = s->p;
     }
+    return NB_ERROR_INVALID;
+}
 
-    /* Read file */
-    FILE *fp = fopen(path, "r");
-    if (!fp) {
-        NB_LOG_ERROR("Failed to open %s", path);
-        return NB_ERROR_NOTFOUND;
+static void skip_ws(scan_t *s) {
+    while (s->p < s->end && (*s->p == ' ' || *s->p == '\n' || *s->p == '\r' || *s->p == '\t')) {
+        s->p++;
+    }
+}
+
+/* Helper: consume c after optional whitespace */
+static int eat(scan_t *s, char c) {
+    skip_ws(s);
+    if (s->p < s->end && *s->p == c) {
+        s->p++;
+        return 1;
     }
+    return 0;
+}
 
-    fseek(fp, 0, SEEK_END);
-    long size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+static int peek(scan_t *s) {
+    skip_ws(s);
+    return s->p < s->end ? (unsigned char)*s->p : -1;
+}
 
-    char *json_str = malloc(size + 1);
-    if (!json_str) {
-        fclose(fp);
-        return NB_ERROR_SYSTEM;
+static int hex4(const char *p, uint32_t *out) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= (uint32_t)(c - '0');
+        else if (c >= 'a' && c <= 'f') v |= (uint32_t)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v |= (uint32_t)(c - 'A' + 10);
+        else return 0;
     }
+    *out = v;
+    return 1;
+}
 
-    fread(json_str, 1, size, fp);
-    json_str[size] = '\0';
-    fclose(fp);
+static size_t utf8_put(char *dst, uint32_t cp) {
+    if (cp < 0x80) {
+        dst[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        dst[0] = (char)(0xc0 | (cp >> 6));
+        dst[1] = (char)(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        dst[0] = (char)(0xe0 | (cp >> 12));
+        dst[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        dst[2] = (char)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    dst[0] = (char)(0xf0 | (cp >> 18));
+    dst[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+    dst[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    dst[3] = (char)(0x80 | (cp & 0x3f));
+    return 4;
+}
 
-    /* Parse JSON */
-    cJSON *root = cJSON_Parse(json_str);
-    free(json_str);
+/*
+ * Scan a string at s->p (the opening quote). With off_out the decoded
+ * string is appended to the scratch buffer and its offset returned;
+ * without it the string is only skipped.
+ */
+static int scan_string(scan_t *s, size_t *off_out) {
+    if (s->p >= s->end || *s->p != '"') {
+        return fail(s);
+    }
+    const char *q = ++s->p;
+    int escaped = 0;
 
-    if (!root) {
-        NB_LOG_ERROR("Failed to parse JSON from %s", path);
-        return NB_ERROR_INVALID;
+    /* Find the closing quote; the decoded string is never longer */
+    while (q < s->end && *q != '"') {
+        if ((unsigned char)*q < 0x20) {
+            s->p = q;
+            return fail(s);
+        }
+        if (*q == '\\') {
+            escaped = 1;
+            q++;
+        }
+        q++;
+    }
+    if (q >= s->end) {
+        return fail(s);
+    }
+    if (!off_out) {
+        s->p = q + 1;
+        return NB_SUCCESS;
     }
 
-    /* Allocate peers structure */
-    peers_file_t *peers = calloc(1, sizeof(peers_file_t));
-    if (!peers) {
-        cJSON_Delete(root);
-        return NB_ERROR_SYSTEM;
+    size_t raw = (size_t)(q - s->p);
+    if (s->used + raw + 1 > s->cap) {
+        size_t cap = s->cap ? s->cap : 256;
+        while (cap < s->used + raw + 1) {
+            cap *= 2;
+        }
+        char *buf = realloc(s->scratch, cap);
+        if (!buf) {
+            NB_LOG_ERROR("realloc failed");
+            return NB_ERROR_SYSTEM;
+        }
+        s->scratch = buf;
+        s->cap = cap;
     }
 
-    /* Get updatedAt */
-    cJSON *updated_at = cJSON_GetObjectItem(root, "updatedAt");
-    if (updated_at && cJSON_IsString(updated_at)) {
-        peers->updated_at = strdup(updated_at->valuestring);
+    char *dst = s->scratch + s->used;
+    *off_out = s->used;
+    if (!escaped) {
+        memcpy(dst, s->p, raw);
+        dst += raw;
+    } else {
+        for (const char *r = s->p; r < q; r++) {
+            if (*r != '\\') {
+                *dst++ = *r;
+                continue;
+            }
+            switch (*++r) {
+            case '"': *dst++ = '"'; break;
+            case '\\': *dst++ = '\\'; break;
+            case '/': *dst++ = '/'; break;
+            case 'b': *dst++ = '\b'; break;
+            case 'f': *dst++ = '\f'; break;
+            case 'n': *dst++ = '\n'; break;
+            case 'r': *dst++ = '\r'; break;
+            case 't': *dst++ = '\t'; break;
+            case 'u': {
+                /* \uXXXX is 6 bytes and at most 4 when decoded (3 unless paired) */
+                uint32_t cp, lo;
+                if (q - r < 5 || !hex4(r + 1, &cp)) {
+                    s->p = r;
+                    return fail(s);
+                }
+                r += 4;
+                if (cp >= 0xd800 && cp < 0xdc00 && q - r >= 7 && r[1] == '\\' && r[2] == 'u' &&
+                    hex4(r + 3, &lo) && lo >= 0xdc00 && lo < 0xe000) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    r += 6;
+                } else if (cp >= 0xd800 && cp < 0xe000) {
+                    cp = 0xfffd;    /* Unpaired surrogate */
+                }
+                dst += utf8_put(dst, cp);
+                break;
+            }
+            default:
+                s->p = r;
+                return fail(s);
+            }
+        }
     }
+    *dst++ = '\0';
+    s->used = (size_t)(dst - s->scratch);
+    s->p = q + 1;
+    return NB_SUCCESS;
+}
 
-    /* Get peers array */
-    cJSON *peers_array = cJSON_GetObjectItem(root, "peers");
-    if (!peers_array || !cJSON_IsArray(peers_array)) {
-        NB_LOG_WARN("No peers array in %s", path);
-        peers->peer_count = 0;
-        peers->peers = NULL;
-        *peers_out = peers;
-        cJSON_Delete(root);
-        return NB_SUCCESS;
+/* Scan a number; the value is truncated to an int like cJSON's valueint */
+static int scan_number(scan_t *s, int *out) {
+    const char *q = s->p;
+    char buf[64];
+
+    if (q < s->end && *q == '-') q++;
+    if (q >= s->end || *q < '0' || *q > '9') {
+        return fail(s);
+    }
+    while (q < s->end && ((*q >= '0' && *q <= '9') || *q == '.' || *q == 'e' || *q == 'E' ||
+                          *q == '+' || *q == '-')) {
+        q++;
     }
 
-    int count = cJSON_GetArraySize(peers_array);
-    if (count == 0) {
-        peers->peer_count = 0;
-        peers->peers = NULL;
-        *peers_out = peers;
-        cJSON_Delete(root);
-        return NB_SUCCESS;
+    size_t n = (size_t)(q - s->p);
+    if (n >= sizeof(buf)) {
+        return fail(s);
     }
+    memcpy(buf, s->p, n);
+    buf[n] = '\0';
 
-    /* Allocate peers array */
-    peers->peers = calloc(count, sizeof(peers_file_peer_t));
-    if (!peers->peers) {
-        free(peers);
-        cJSON_Delete(root);
-        return NB_ERROR_SYSTEM;
+    char *end;
+    double v = strtod(buf, &end);
+    if (end != buf + n) {
+        return fail(s);
+    }
+    if (out) {
+        *out = v >= 2147483647.0 ? 2147483647 : v <= -2147483648.0 ? (-2147483647 - 1) : (int)v;
     }
+    s->p = q;
+    return NB_SUCCESS;
+}
 
-    /* Parse each peer */
-    for (int i = 0; i < count; i++) {
-        cJSON *peer_json = cJSON_GetArrayItem(peers_array, i);
-        if (!peer_json) continue;
+/* Scan an object key and the colon after it into the scratch buffer (rolled back by the caller) */
+static int scan_key(scan_t *s, size_t *off_out) {
+    skip_ws(s);
+    int ret = scan_string(s, off_out);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+    return eat(s, ':') ? NB_SUCCESS : fail(s);
+}
 
-        peers_file_peer_t *peer = &peers->peers[i];
+/* Helper: after a member or element, consume ',' (returns 1) or the closing bracket (returns 0) */
+static int next_member(scan_t *s, char close) {
+    if (eat(s, ',')) {
+        return 1;
+    }
+    if (eat(s, close)) {
+        return 0;
+    }
+    return fail(s);
+}
 
-        /* id */
-        cJSON *id = cJSON_GetObjectItem(peer_json, "id");
-        if (id && cJSON_IsString(id)) {
-            peer->id = strdup(id->valuestring);
-        }
+static int skip_value(scan_t *s, int depth) {
+    int c = peek(s);
+    int ret;
 
-        /* publicKey */
-        cJSON *pubkey = cJSON_GetObjectItem(peer_json, "publicKey");
-        if (pubkey && cJSON_IsString(pubkey)) {
-            peer->public_key = strdup(pubkey->valuestring);
-        }
+    if (depth > JSON_MAX_DEPTH) {
+        return fail(s);
+    }
 
-        /* endpoint */
-        cJSON *endpoint = cJSON_GetObjectItem(peer_json, "endpoint");
-        if (endpoint && cJSON_IsString(endpoint)) {
-            peer->endpoint = strdup(endpoint->valuestring);
+    switch (c) {
+    case '"':
+        return scan_string(s, NULL);
+    case '{':
+    case '[':
+        s->p++;
+        if (eat(s, c == '{' ? '}' : ']')) {
+            return NB_SUCCESS;
+        }
+        do {
+            if (c == '{') {
+                skip_ws(s);
+                if ((ret = scan_string(s, NULL)) != NB_SUCCESS) return ret;
+                if (!eat(s, ':')) return fail(s);
+            }
+            if ((ret = skip_value(s, depth + 1)) != NB_SUCCESS) return ret;
+        } while ((ret = next_member(s, c == '{' ? '}' : ']')) == 1);
+        return ret;
+    case 't':
+    case 'f':
+    case 'n': {
+        const char *word = c == 't' ? "true" : c == 'f' ? "false" : "null";
+        size_t n = strlen(word);
+        if ((size_t)(s->end - s->p) < n || memcmp(s->p, word, n) != 0) {
+            return fail(s);
         }
+        s->p += n;
+        return NB_SUCCESS;
+    }
+    default:
+        return scan_number(s, NULL);
+    }
+}
 
-        /* keepalive */
-        cJSON *keepalive = cJSON_GetObjectItem(peer_json, "keepalive");
-        if (keepalive && cJSON_IsNumber(keepalive)) {
-            peer->keepalive = keepalive->valueint;
+/* Helper: remember an allowed IP of the current peer */
+static int push_ip(scan_t *s, size_t off) {
+    if (s->ips_count == s->ips_cap) {
+        int cap = s->ips_cap ? s->ips_cap * 2 : 8;
+        size_t *ips = realloc(s->ips, cap * sizeof(size_t));
+        char **ptrs = ips ? realloc(s->ip_ptrs, cap * sizeof(char *)) : NULL;
+        if (ips) s->ips = ips;
+        if (!ptrs) {
+            NB_LOG_ERROR("realloc failed");
+            return NB_ERROR_SYSTEM;
         }
+        s->ip_ptrs = ptrs;
+        s->ips_cap = cap;
+    }
+    s->ips[s->ips_count++] = off;
+    return NB_SUCCESS;
+}
+
+/* Parse one peer object at s->p and hand it to cb */
+static int scan_peer(scan_t *s, peers_file_cb_t cb, void *ctx) {
+    size_t id = NO_STRING, key = NO_STRING, endpoint = NO_STRING;
+    int keepalive = 0, has_ips = 0;
+    int ret;
+
+    s->used = 0;
+    s->ips_count = 0;
+    s->p++;
+    if (!eat(s, '}')) {
+        do {
+            size_t name;
+            size_t mark = s->used;
+            if ((ret = scan_key(s, &name)) != NB_SUCCESS) return ret;
+            const char *k = s->scratch + name;
+            int c = peek(s);
 
-        /* allowedIPs */
-        cJSON *allowed_ips = cJSON_GetObjectItem(peer_json, "allowedIPs");
-        if (allowed_ips && cJSON_IsArray(allowed_ips)) {
-            int ip_count = cJSON_GetArraySize(allowed_ips);
-            peer->allowed_ips_count = ip_count;
-            peer->allowed_ips = calloc(ip_count, sizeof(char*));
-
-            for (int j = 0; j < ip_count; j++) {
-                cJSON *ip = cJSON_GetArrayItem(allowed_ips, j);
-                if (ip && cJSON_IsString(ip)) {
-                    peer->allowed_ips[j] = strdup(ip->valuestring);
+            if (c == '"' && (strcasecmp(k, "id") == 0 || strcasecmp(k, "publicKey") == 0 ||
+                             strcasecmp(k, "endpoint") == 0)) {
+                size_t *field = k[0] == 'i' || k[0] == 'I' ? &id : k[0] == 'p' || k[0] == 'P' ? &key : &endpoint;
+                s->used = mark;
+                ret = scan_string(s, field);
+            } else if (c == '[' && strcasecmp(k, "allowedIPs") == 0) {
+                s->used = mark;
+                s->ips_count = 0;
+                has_ips = 1;
+                s->p++;
+                if (!eat(s, ']')) {
+                    do {
+                        size_t off;
+                        if (peek(s) != '"') {
+                            ret = skip_value(s, 2);
+                        } else if ((ret = scan_string(s, &off)) == NB_SUCCESS) {
+                            ret = push_ip(s, off);
+                        }
+                        if (ret != NB_SUCCESS) return ret;
+                    } while ((ret = next_member(s, ']')) == 1);
                 }
+            } else if ((c == '-' || (c >= '0' && c <= '9')) && strcasecmp(k, "keepalive") == 0) {
+                s->used = mark;
+                ret = scan_number(s, &keepalive);
+            } else {
+                s->used = mark;
+                ret = skip_value(s, 2);
             }
+            if (ret != NB_SUCCESS) return ret;
+        } while ((ret = next_member(s, '}')) == 1);
+        if (ret != NB_SUCCESS) return ret;
+    }
+
+    /* Offsets are final now that the scratch buffer no longer moves */
+    for (int i = 0; i < s->ips_count; i++) {
+        s->ip_ptrs[i] = s->scratch + s->ips[i];
+    }
+    peers_file_peer_t peer = {
+        .id = id != NO_STRING ? s->scratch + id : NULL,
+        .public_key = key != NO_STRING ? s->scratch + key : NULL,
+        .endpoint = endpoint != NO_STRING ? s->scratch + endpoint : NULL,
+        .allowed_ips = has_ips && s->ips_count > 0 ? s->ip_ptrs : NULL,
+        .allowed_ips_count = s->ips_count,
+        .keepalive = keepalive,
+    };
+    return cb(&peer, ctx);
+}
+
+/*
+ * Scan the root object. Peers go to cb as soon as their object ends;
+ * updatedAt is copied into arena when one is given.
+ * Returns the number of peers or an error.
+ */
+static int scan_root(scan_t *s, peers_file_cb_t cb, void *ctx, nb_arena_t *arena,
+                     char **updated_at, int *has_peers) {
+    int count = 0;
+    int ret;
+
+    if (!eat(s, '{')) {
+        return fail(s);
+    }
+    if (!eat(s, '}')) {
+        do {
+            size_t name;
+            s->used = 0;
+            if ((ret = scan_key(s, &name)) != NB_SUCCESS) return ret;
+            int c = peek(s);
+
+            if (c == '[' && strcasecmp(s->scratch + name, "peers") == 0) {
+                *has_peers = 1;
+                s->p++;
+                if (!eat(s, ']')) {
+                    do {
+                        if (peek(s) == '{') {
+                            ret = scan_peer(s, cb, ctx);
+                            count += ret == NB_SUCCESS;
+                        } else {
+                            ret = skip_value(s, 2);
+                        }
+                        if (ret != NB_SUCCESS) return ret;
+                    } while ((ret = next_member(s, ']')) == 1);
+                    if (ret != NB_SUCCESS) return ret;
+                }
+            } else if (c == '"' && arena && strcasecmp(s->scratch + name, "updatedAt") == 0) {
+                size_t off;
+                if ((ret = scan_string(s, &off)) != NB_SUCCESS) return ret;
+                *updated_at = nb_arena_strdup(arena, s->scratch + off);
+                if (!*updated_at) return NB_ERROR_SYSTEM;
+            } else if ((ret = skip_value(s, 1)) != NB_SUCCESS) {
+                return ret;
+            }
+        } while ((ret = next_member(s, '}')) == 1);
+        if (ret != NB_SUCCESS) return ret;
+    }
+
+    skip_ws(s);
+    return s->p == s->end ? count : fail(s);
+}
+
+/* Map path and scan it */
+static int scan_file(const char *path, peers_file_cb_t cb, void *ctx, nb_arena_t *arena,
+                     char **updated_at) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        NB_LOG_ERROR("Failed to open %s", path);
+        return errno == ENOENT ? NB_ERROR_NOTFOUND : NB_ERROR_SYSTEM;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        NB_LOG_ERROR("Failed to parse JSON from %s (empty)", path);
+        return NB_ERROR_INVALID;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        NB_LOG_ERROR("mmap %s failed: %s", path, strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    scan_t s = { .p = map, .end = (const char *)map + size, .start = map };
+    int has_peers = 0;
+    int ret = scan_root(&s, cb, ctx, arena, updated_at, &has_peers);
+    if (ret == NB_ERROR_INVALID && s.error) {
+        NB_LOG_ERROR("Failed to parse JSON from %s at byte %zu", path, (size_t)(s.error - s.start));
+    } else if (ret >= 0 && !has_peers) {
+        NB_LOG_WARN("No peers array in %s", path);
+    }
+
+    munmap(map, size);
+    free(s.scratch);
+    free(s.ips);
+    free(s.ip_ptrs);
+    return ret;
+}
+
+int peers_file_stream(const char *path, peers_file_cb_t cb, void *ctx) {
+    if (!path || !cb) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+    return scan_file(path, cb, ctx, NULL, NULL);
+}
+
+/* Snapshot being loaded: peers are copied into the arena as they arrive */
+typedef struct {
+    peers_file_t *file;
+    int cap;
+} load_ctx_t;
+
+static int load_peer(const peers_file_peer_t *peer, void *arg) {
+    load_ctx_t *lc = arg;
+    peers_file_t *file = lc->file;
+    nb_arena_t *arena = &file->arena;
+
+    if (file->peer_count == lc->cap) {
+        int cap = lc->cap ? lc->cap * 2 : 64;
+        peers_file_peer_t *peers = realloc(file->peers, cap * sizeof(peers_file_peer_t));
+        if (!peers) {
+            NB_LOG_ERROR("realloc failed");
+            return NB_ERROR_SYSTEM;
         }
+        file->peers = peers;
+        lc->cap = cap;
+    }
 
-        peers->peer_count++;
+    peers_file_peer_t *p = &file->peers[file->peer_count];
+    int oom = 0;
+    *p = *peer;
+    p->id = nb_arena_strdup(arena, peer->id);
+    p->public_key = nb_arena_strdup(arena, peer->public_key);
+    p->endpoint = nb_arena_strdup(arena, peer->endpoint);
+    oom = (peer->id && !p->id) || (peer->public_key && !p->public_key) ||
+          (peer->endpoint && !p->endpoint);
+    if (peer->allowed_ips) {
+        p->allowed_ips = nb_arena_alloc(arena, peer->allowed_ips_count * sizeof(char *));
+        oom |= !p->allowed_ips;
+        for (int j = 0; !oom && j < peer->allowed_ips_count; j++) {
+            p->allowed_ips[j] = nb_arena_strdup(arena, peer->allowed_ips[j]);
+            oom |= !p->allowed_ips[j];
+        }
+    }
+    if (oom) {
+        NB_LOG_ERROR("Out of memory");
+        return NB_ERROR_SYSTEM;
     }
 
-    cJSON_Delete(root);
-    *peers_out = peers;
+    file->peer_count++;
+    return NB_SUCCESS;
+}
+
+int peers_file_load(const char *path, peers_file_t **peers_out) {
+    if (!path || !peers_out) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    peers_file_t *peers = calloc(1, sizeof(peers_file_t));
+    if (!peers) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    /* The strings are shorter than the file; one block usually holds them all */
+    struct stat st;
+    nb_arena_init(&peers->arena, stat(path, &st) == 0 ? (size_t)st.st_size : 0);
+
+    load_ctx_t lc = { .file = peers };
+    int ret = scan_file(path, load_peer, &lc, &peers->arena, &peers->updated_at);
+    if (ret < 0) {
+        peers_file_free(peers);
+        return ret;
+    }
 
+    *peers_out = peers;
     NB_LOG_INFO("Loaded %d peer(s) from %s", peers->peer_count, path);
     return NB_SUCCESS;
 }
@@ -148,14 +560,7 @@ int peers_file_load(const char *path, peers_file_t **peers_out) {
 void peers_file_free(peers_file_t *peers) {
     if (!peers) return;
 
-    for (int i = 0; i < peers->peer_count; i++) {
-        free(peers->peers[i].id);
-        free(peers->peers[i].public_key);
-        free(peers->peers[i].endpoint);
-        nb_free_string_array(peers->peers[i].allowed_ips, peers->peers[i].allowed_ips_count);
-    }
-
     free(peers->peers);
-    free(peers->updated_at);
+    nb_arena_free(&peers->arena);
     free(peers);
 }
@@ -0,0 +1,382 @@
+/**
+ * peers_snap.c - Memory-mapped binary peer snapshot
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "peers_snap.h"
+#include "common.h"
+#include "crc32c.h"
+#include "wg_key.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+/* Records are read in place */
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "peer snapshots are little endian");
+_Static_assert(sizeof(peers_snap_header_t) == 64, "snapshot header layout");
+_Static_assert(sizeof(peers_snap_peer_t) == 64, "snapshot peer layout");
+_Static_assert(sizeof(nb_prefix_t) == 18, "snapshot prefix layout");
+
+/* Checksum of a snapshot, skipping the checksum field itself */
+static uint32_t snap_checksum(const uint8_t *data, size_t size) {
+    uint32_t crc = nb_crc32c(0, data, offsetof(peers_snap_header_t, checksum));
+    return nb_crc32c(crc, data + sizeof(peers_snap_header_t), size - sizeof(peers_snap_header_t));
+}
+
+/* Helper: validate the mapping of a snapshot and fill in the section pointers */
+static int snap_validate(peers_snap_t *snap) {
+    const peers_snap_header_t *hdr = snap->map;
+    size_t size = snap->map_size;
+
+    if (size < sizeof(*hdr) || memcmp(hdr->magic, PEERS_SNAP_MAGIC, sizeof(hdr->magic)) != 0) {
+        return NB_ERROR_INVALID;
+    }
+    if (hdr->version != PEERS_SNAP_VERSION || hdr->header_size != sizeof(peers_snap_header_t) ||
+        hdr->peer_size != sizeof(peers_snap_peer_t) || hdr->prefix_size != sizeof(nb_prefix_t) ||
+        hdr->peer_count > INT32_MAX || hdr->prefix_count > INT32_MAX) {
+        NB_LOG_WARN("Unsupported peer snapshot (version %u)", hdr->version);
+        return NB_ERROR_INVALID;
+    }
+
+    /* Sections are contiguous and fill the file exactly (sums fit in 64 bits) */
+    uint64_t peers_bytes = (uint64_t)hdr->peer_count * sizeof(peers_snap_peer_t);
+    uint64_t prefix_bytes = (uint64_t)hdr->prefix_count * sizeof(nb_prefix_t);
+    if (sizeof(*hdr) + peers_bytes + prefix_bytes + hdr->strings_size != size ||
+        hdr->strings_size == 0) {
+        NB_LOG_WARN("Peer snapshot size mismatch");
+        return NB_ERROR_INVALID;
+    }
+    if (snap_checksum(snap->map, size) != hdr->checksum) {
+        NB_LOG_WARN("Peer snapshot checksum mismatch");
+        return NB_ERROR_INVALID;
+    }
+
+    const uint8_t *base = snap->map;
+    snap->hdr = hdr;
+    snap->peers = (const peers_snap_peer_t *)(base + sizeof(*hdr));
+    snap->peer_count = (int)hdr->peer_count;
+    snap->prefixes = (const nb_prefix_t *)(base + sizeof(*hdr) + peers_bytes);
+    snap->prefix_count = (int)hdr->prefix_count;
+    snap->strings = (const char *)(base + sizeof(*hdr) + peers_bytes + prefix_bytes);
+
+    /* Every string ends inside the table once the table ends with a NUL */
+    if (snap->strings[hdr->strings_size - 1] != '\0' || hdr->updated_at >= hdr->strings_size) {
+        return NB_ERROR_INVALID;
+    }
+    /* Prefix ranges follow each other, so no two peers share a prefix */
+    uint64_t next = 0;
+    for (int i = 0; i < snap->peer_count; i++) {
+        const peers_snap_peer_t *p = &snap->peers[i];
+        if (p->id >= hdr->strings_size || p->prefix_first != next ||
+            next + p->prefix_count > hdr->prefix_count ||
+            (p->endpoint_family != 0 && p->endpoint_family != AF_INET &&
+             p->endpoint_family != AF_INET6)) {
+            NB_LOG_WARN("Peer snapshot record %d is out of bounds", i);
+            return NB_ERROR_INVALID;
+        }
+        next += p->prefix_count;
+    }
+    if (next != hdr->prefix_count) {
+        return NB_ERROR_INVALID;
+    }
+    for (int i = 0; i < snap->prefix_count; i++) {
+        if (!nb_prefix_valid(&snap->prefixes[i])) {
+            NB_LOG_WARN("Peer snapshot prefix %d is invalid", i);
+            return NB_ERROR_INVALID;
+        }
+    }
+
+    return NB_SUCCESS;
+}
+
+int peers_snap_open(const char *path, peers_snap_t **snap_out) {
+    if (!path || !snap_out) {
+        return NB_ERROR_INVALID;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? NB_ERROR_NOTFOUND : NB_ERROR_SYSTEM;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(peers_snap_header_t)) {
+        close(fd);
+        return NB_ERROR_INVALID;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        NB_LOG_ERROR("mmap %s failed: %s", path, strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+
+    peers_snap_t *snap = calloc(1, sizeof(peers_snap_t));
+    if (!snap) {
+        munmap(map, size);
+        return NB_ERROR_SYSTEM;
+    }
+    snap->map = map;
+    snap->map_size = size;
+
+    int ret = snap_validate(snap);
+    if (ret != NB_SUCCESS) {
+        peers_snap_close(snap);
+        return ret;
+    }
+
+    NB_LOG_INFO("Mapped %d peer(s) from %s", snap->peer_count, path);
+    *snap_out = snap;
+    return NB_SUCCESS;
+}
+
+void peers_snap_close(peers_snap_t *snap) {
+    if (!snap) return;
+
+    munmap(snap->map, snap->map_size);
+    free(snap);
+}
+
+int peers_snap_is_snapshot(const char *path) {
+    char magic[sizeof(((peers_snap_header_t *)0)->magic)];
+    int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    if (fd < 0) {
+        return 0;
+    }
+
+    ssize_t n = read(fd, magic, sizeof(magic));
+    close(fd);
+    return n == (ssize_t)sizeof(magic) && memcmp(magic, PEERS_SNAP_MAGIC, sizeof(magic)) == 0;
+}
+
+int peers_snap_endpoint(const peers_snap_peer_t *peer, nb_endpoint_t *out) {
+    memset(out, 0, sizeof(*out));
+
+    if (peer->endpoint_family == AF_INET) {
+        out->in4.sin_family = AF_INET;
+        out->in4.sin_port = peer->endpoint_port;
+        memcpy(&out->in4.sin_addr, peer->endpoint_addr, 4);
+    } else if (peer->endpoint_family == AF_INET6) {
+        out->in6.sin6_family = AF_INET6;
+        out->in6.sin6_port = peer->endpoint_port;
+        memcpy(&out->in6.sin6_addr, peer->endpoint_addr, 16);
+    } else {
+        return NB_ERROR_NOTFOUND;
+    }
+    return NB_SUCCESS;
+}
+
+/* Snapshot being built in memory */
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t cap;
+} snap_buf_t;
+
+/* Helper: append bytes, growing the buffer geometrically */
+static void* buf_append(snap_buf_t *b, const void *data, size_t len) {
+    if (b->size + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->size + len) {
+            cap *= 2;
+        }
+        uint8_t *p = realloc(b->buf, cap);
+        if (!p) {
+            NB_LOG_ERROR("realloc failed");
+            return NULL;
+        }
+        b->buf = p;
+        b->cap = cap;
+    }
+
+    void *dst = b->buf + b->size;
+    if (data) {
+        memcpy(dst, data, len);
+    } else {
+        memset(dst, 0, len);
+    }
+    b->size += len;
+    return dst;
+}
+
+/* Helper: convert one peer; prefixes are appended to ips */
+static int snap_peer(const peers_file_peer_t *fp, peers_snap_peer_t *out,
+                     nb_prefix_t *ips, int max_ips) {
+    nb_endpoint_t ep;
+    int count = 0;
+
+    memset(out, 0, sizeof(*out));
+    if (!fp->public_key || wg_key_from_base64(out->public_key, fp->public_key) != NB_SUCCESS) {
+        return NB_ERROR_INVALID;
+    }
+
+    if (fp->endpoint && fp->endpoint[0]) {
+        if (nb_endpoint_parse(fp->endpoint, &ep) != NB_SUCCESS) {
+            return NB_ERROR_INVALID;
+        }
+        out->endpoint_family = (uint8_t)ep.sa.sa_family;
+        if (ep.sa.sa_family == AF_INET) {
+            out->endpoint_port = ep.in4.sin_port;
+            memcpy(out->endpoint_addr, &ep.in4.sin_addr, 4);
+        } else {
+            out->endpoint_port = ep.in6.sin6_port;
+            memcpy(out->endpoint_addr, &ep.in6.sin6_addr, 16);
+        }
+    }
+
+    for (int j = 0; j < fp->allowed_ips_count; j++) {
+        int c = nb_prefix_parse_list(fp->allowed_ips[j], &ips[count], max_ips - count);
+        if (c < 0) {
+            return NB_ERROR_INVALID;
+        }
+        count += c;
+    }
+    if (count > UINT16_MAX) {
+        return NB_ERROR_INVALID;
+    }
+
+    out->keepalive = fp->keepalive > 0 && fp->keepalive <= UINT16_MAX ? (uint16_t)fp->keepalive : 0;
+    out->prefix_count = (uint16_t)count;
+    return count;
+}
+
+/* Helper: write a buffer to a new file and rename it over path */
+static int write_atomic(const char *path, const void *data, size_t size) {
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        return NB_ERROR_INVALID;
+    }
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        NB_LOG_ERROR("Cannot create %s: %s", tmp, strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+
+    const uint8_t *p = data;
+    size_t left = size;
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            NB_LOG_ERROR("Write %s failed: %s", tmp, strerror(errno));
+            close(fd);
+            unlink(tmp);
+            return NB_ERROR_SYSTEM;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+    if (close(fd) < 0 || rename(tmp, path) < 0) {
+        NB_LOG_ERROR("Cannot replace %s: %s", path, strerror(errno));
+        unlink(tmp);
+        return NB_ERROR_SYSTEM;
+    }
+    return NB_SUCCESS;
+}
+
+int peers_snap_write(const char *path, const peers_file_t *file) {
+    if (!path || !file || file->peer_count < 0) {
+        return NB_ERROR_INVALID;
+    }
+
+    /* Prefix upper bound: entries may be comma separated lists */
+    int max_ips = 0;
+    for (int i = 0; i < file->peer_count; i++) {
+        for (int j = 0; j < file->peers[i].allowed_ips_count; j++) {
+            const char *p = file->peers[i].allowed_ips[j];
+            max_ips++;
+            while (p && (p = strchr(p, ','))) {
+                max_ips++;
+                p++;
+            }
+        }
+    }
+
+    int count = file->peer_count;
+    peers_snap_peer_t *recs = calloc(count > 0 ? count : 1, sizeof(peers_snap_peer_t));
+    nb_prefix_t *ips = calloc(max_ips > 0 ? max_ips : 1, sizeof(nb_prefix_t));
+    snap_buf_t strings = {0};
+    int ret = NB_SUCCESS;
+
+    if (!recs || !ips || !buf_append(&strings, "", 1)) {
+        NB_LOG_ERROR("calloc failed");
+        ret = NB_ERROR_SYSTEM;
+        goto out;
+    }
+
+    peers_snap_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, PEERS_SNAP_MAGIC, sizeof(hdr.magic));
+    hdr.version = PEERS_SNAP_VERSION;
+    hdr.header_size = sizeof(peers_snap_header_t);
+    hdr.peer_size = sizeof(peers_snap_peer_t);
+    hdr.prefix_size = sizeof(nb_prefix_t);
+
+    if (file->updated_at && file->updated_at[0]) {
+        hdr.updated_at = (uint32_t)strings.size;
+        if (!buf_append(&strings, file->updated_at, strlen(file->updated_at) + 1)) {
+            ret = NB_ERROR_SYSTEM;
+            goto out;
+        }
+    }
+
+    int used = 0, written = 0;
+    for (int i = 0; i < count; i++) {
+        const peers_file_peer_t *fp = &file->peers[i];
+        peers_snap_peer_t *rec = &recs[written];
+        int c = snap_peer(fp, rec, &ips[used], max_ips - used);
+        if (c < 0) {
+            NB_LOG_WARN("Skipping invalid peer %s", fp->public_key ? fp->public_key : "(null)");
+            continue;
+        }
+        rec->prefix_first = (uint32_t)used;
+        used += c;
+        if (fp->id && fp->id[0]) {
+            rec->id = (uint32_t)strings.size;
+            if (!buf_append(&strings, fp->id, strlen(fp->id) + 1)) {
+                ret = NB_ERROR_SYSTEM;
+                goto out;
+            }
+        }
+        written++;
+    }
+    if (strings.size > UINT32_MAX) {
+        ret = NB_ERROR_INVALID;
+        goto out;
+    }
+    hdr.peer_count = (uint32_t)written;
+    hdr.prefix_count = (uint32_t)used;
+    hdr.strings_size = (uint32_t)strings.size;
+
+    snap_buf_t image = {0};
+    if (!buf_append(&image, &hdr, sizeof(hdr)) ||
+        !buf_append(&image, recs, (size_t)written * sizeof(peers_snap_peer_t)) ||
+        !buf_append(&image, ips, (size_t)used * sizeof(nb_prefix_t)) ||
+        !buf_append(&image, strings.buf, strings.size)) {
+        free(image.buf);
+        ret = NB_ERROR_SYSTEM;
+        goto out;
+    }
+    ((peers_snap_header_t *)image.buf)->checksum = snap_checksum(image.buf, image.size);
+
+    ret = write_atomic(path, image.buf, image.size);
+    free(image.buf);
+    if (ret == NB_SUCCESS) {
+        NB_LOG_INFO("Wrote %d peer(s) to %s", written, path);
+        ret = written;
+    }
+
+out:
+    free(recs);
+    free(ips);
+    free(strings.buf);
+    return ret;
+}
@@ -1,154 +1,2082 @@
 /**
- * route.c - Route management (Quick prototype version)
+ * route.c - Route management
  *
  * Reference: go/internal/routemanager/systemops/systemops_linux.go
  *
- * This is the QUICK PROTOTYPE version that uses 'ip route' commands.
- * Production version should use netlink API (libmnl).
+ * Routes are installed and deleted over one persistent rtnetlink socket;
+ * the 'ip route' commands of the original prototype are kept as the
+ * fallback backend. Masqueraded routes are elements of nftables sets
+ * (nft.c), updated in one batch per change; iptables rules per device
+ * remain for the shell backend and kernels without nf_tables. The same
+ * nftables table optionally holds a flowtable for forwarded flows.
+ *
+ * With a policy routing table (route_use_table) every request names the
+ * table; the rules selecting it are FIB rules on the same socket. Routes
+ * with a nexthop id carry RTA_NH_ID instead of an output interface.
  *
  * Author: Claude
  * Date: 2025-11-30
  */
 
-#include "route.h"
-#include "common.h"
+#include "route.h"
+#include "common.h"
+#include "netlink.h"
+#include "ipaddr.h"
+#include "nft.h"
+#include <fcntl.h>
+#include <net/if.h>
+#include <linux/rtnetlink.h>
+#include <linux/fib_rules.h>
+#include <linux/nexthop.h>
+
+#define ROUTE_DEFAULT_METRIC    100
+#define ROUTE_PROTO             RTPROT_STATIC
+
+/* Pipelining: requests per sendmsg() are bounded by the ACKs the receive
+ * buffer can hold (one small skb each) and by the batch buffer */
+#define ROUTE_ACK_TRUESIZE      1024
+#define ROUTE_WINDOW_MIN        64
+#define ROUTE_WINDOW_MAX        4096
+#define ROUTE_MSG_MAX           128     /* Upper bound of one route message */
+#define ROUTE_BATCH_BUFSIZE     (ROUTE_WINDOW_MAX * ROUTE_MSG_MAX)
+
+struct route_nl {
+    nb_nl_t rtnl;           /* Persistent rtnetlink socket */
+    nb_nl_buf_t buf;        /* Request buffer for single requests */
+    nb_nl_buf_t batch;      /* Request buffer for pipelined batches */
+    int window;             /* Max requests in flight */
+    nb_nl_t monitor;        /* Notification socket (route_monitor_open), fd -1 if closed */
+};
+
+/* One queued route request */
+typedef struct {
+    uint16_t type;          /* RTM_NEWROUTE or RTM_DELROUTE */
+    uint8_t masquerade;
+    struct rtmsg rtm;
+    uint8_t dst[16];
+    uint32_t metric;
+    int has_metric;
+    int ifindex;            /* RTA_OIF, 0 to omit (resolved from device for adds) */
+    char device[IFNAMSIZ];  /* Empty: the manager's WireGuard device */
+    uint32_t nhid;          /* RTA_NH_ID instead of RTA_OIF, 0 for none */
+    uint32_t table;         /* 0: the manager's table */
+    int ret;                /* NB_SUCCESS / NB_ERROR_* after commit */
+    int err;                /* Kernel errno after commit */
+} route_op_t;
+
+struct route_batch {
+    route_op_t *ops;
+    int count;
+    int cap;
+};
+
+/*
+ * Routes this manager installed, keyed by destination (one owned route
+ * per prefix). Same layout as the peer table: an open addressing index
+ * (linear probing, at most half full, backward shift deletion) over a
+ * dense array of entries, so walking the set is an array walk.
+ */
+#define SET_EMPTY       UINT32_MAX
+#define SET_MIN_SLOTS   16
+
+typedef struct {
+    nb_prefix_t dst;            /* Normalized */
+    uint32_t metric;
+    int ifindex;                /* Output interface when installed (0 with the shell backend) */
+    char device[IFNAMSIZ];      /* Empty: the manager's WireGuard device */
+    uint32_t nhid;              /* Nexthop object, 0 for none */
+    uint8_t masquerade;
+} route_entry_t;
+
+/* A nexthop object or group created through the manager */
+struct route_nh {
+    uint32_t id;
+    uint8_t family;
+    char device[IFNAMSIZ];      /* Single nexthop: output device */
+    struct nexthop_grp *group;  /* Group members, NULL for a single nexthop */
+    int group_count;
+};
+
+typedef struct {
+    uint32_t hash;
+    uint32_t idx;               /* Entry index, SET_EMPTY if free */
+} set_slot_t;
+
+struct route_set {
+    set_slot_t *slots;
+    uint32_t mask;              /* Slot count - 1 (power of two) */
+    route_entry_t *entries;
+    uint32_t count;
+    uint32_t cap;
+};
+
+/* Helper: append op to the batch, returns its index */
+static int route_batch_push(route_batch_t *batch, const route_op_t *op) {
+    if (batch->count == batch->cap) {
+        int cap = batch->cap ? batch->cap * 2 : 64;
+        route_op_t *ops = realloc(batch->ops, sizeof(route_op_t) * cap);
+        if (!ops) {
+            NB_LOG_ERROR("realloc failed");
+            return NB_ERROR_SYSTEM;
+        }
+        batch->ops = ops;
+        batch->cap = cap;
+    }
+    batch->ops[batch->count] = *op;
+    return batch->count++;
+}
+
+static uint32_t prefix_hash(const nb_prefix_t *p) {
+    uint64_t a, b;
+    memcpy(&a, p->addr, sizeof(a));
+    memcpy(&b, p->addr + 8, sizeof(b));
+
+    uint64_t h = (a ^ ((uint64_t)p->family << 56 | (uint64_t)p->len << 48)) *
+                 UINT64_C(0x9E3779B97F4A7C15);
+    h ^= b + (h >> 29);
+    h *= UINT64_C(0xBF58476D1CE4E5B9);
+    return (uint32_t)(h >> 32);
+}
+
+static int prefix_equal(const nb_prefix_t *a, const nb_prefix_t *b) {
+    return a->family == b->family && a->len == b->len &&
+           memcmp(a->addr, b->addr, sizeof(a->addr)) == 0;
+}
+
+static void set_free(struct route_set *set) {
+    if (!set) return;
+
+    free(set->slots);
+    free(set->entries);
+    free(set);
+}
+
+static int set_rehash(struct route_set *set, uint32_t nslots) {
+    set_slot_t *slots = malloc(nslots * sizeof(set_slot_t));
+    if (!slots) {
+        NB_LOG_ERROR("malloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    for (uint32_t i = 0; i < nslots; i++) {
+        slots[i].idx = SET_EMPTY;
+    }
+
+    free(set->slots);
+    set->slots = slots;
+    set->mask = nslots - 1;
+
+    for (uint32_t e = 0; e < set->count; e++) {
+        uint32_t h = prefix_hash(&set->entries[e].dst);
+        uint32_t i = h & set->mask;
+        while (set->slots[i].idx != SET_EMPTY) {
+            i = (i + 1) & set->mask;
+        }
+        set->slots[i].hash = h;
+        set->slots[i].idx = e;
+    }
+    return NB_SUCCESS;
+}
+
+static struct route_set* set_new(void) {
+    struct route_set *set = calloc(1, sizeof(struct route_set));
+    if (!set || set_rehash(set, SET_MIN_SLOTS) != NB_SUCCESS) {
+        NB_LOG_ERROR("Failed to allocate route set");
+        set_free(set);
+        return NULL;
+    }
+    return set;
+}
+
+/* Slot holding dst, or SET_EMPTY */
+static uint32_t set_slot(const struct route_set *set, const nb_prefix_t *dst, uint32_t h) {
+    uint32_t i = h & set->mask;
+
+    while (set->slots[i].idx != SET_EMPTY) {
+        if (set->slots[i].hash == h && prefix_equal(&set->entries[set->slots[i].idx].dst, dst)) {
+            return i;
+        }
+        i = (i + 1) & set->mask;
+    }
+    return SET_EMPTY;
+}
+
+/* Entry index for dst, or -1 */
+static int set_find(const struct route_set *set, const nb_prefix_t *dst) {
+    uint32_t s = set_slot(set, dst, prefix_hash(dst));
+    return s == SET_EMPTY ? -1 : (int)set->slots[s].idx;
+}
+
+/* Insert or replace the entry for e->dst */
+static int set_put(struct route_set *set, const route_entry_t *e) {
+    uint32_t h = prefix_hash(&e->dst);
+    uint32_t s = set_slot(set, &e->dst, h);
+    if (s != SET_EMPTY) {
+        set->entries[set->slots[s].idx] = *e;
+        return NB_SUCCESS;
+    }
+
+    if (set->count == set->cap) {
+        uint32_t cap = set->cap ? set->cap * 2 : 64;
+        route_entry_t *entries = realloc(set->entries, cap * sizeof(route_entry_t));
+        if (!entries) {
+            NB_LOG_ERROR("realloc failed");
+            return NB_ERROR_SYSTEM;
+        }
+        set->entries = entries;
+        set->cap = cap;
+    }
+    if ((set->count + 1) * 2 > set->mask + 1 &&
+        set_rehash(set, (set->mask + 1) * 2) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    uint32_t i = h & set->mask;
+    while (set->slots[i].idx != SET_EMPTY) {
+        i = (i + 1) & set->mask;
+    }
+    set->slots[i].hash = h;
+    set->slots[i].idx = set->count;
+    set->entries[set->count++] = *e;
+    return NB_SUCCESS;
+}
+
+static void set_del(struct route_set *set, const nb_prefix_t *dst) {
+    uint32_t s = set_slot(set, dst, prefix_hash(dst));
+    if (s == SET_EMPTY) {
+        return;
+    }
+    uint32_t idx = set->slots[s].idx;
+
+    /* Backward shift deletion keeps probe sequences intact */
+    uint32_t i = s;
+    uint32_t j = s;
+    for (;;) {
+        j = (j + 1) & set->mask;
+        if (set->slots[j].idx == SET_EMPTY) {
+            break;
+        }
+        uint32_t home = set->slots[j].hash & set->mask;
+        int in_range = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+        if (!in_range) {
+            set->slots[i] = set->slots[j];
+            i = j;
+        }
+    }
+    set->slots[i].idx = SET_EMPTY;
+
+    /* Keep entries dense: move the last entry into the hole */
+    uint32_t last = set->count - 1;
+    if (idx != last) {
+        set->entries[idx] = set->entries[last];
+        uint32_t ls = set_slot(set, &set->entries[idx].dst, prefix_hash(&set->entries[idx].dst));
+        set->slots[ls].idx = idx;
+    }
+    set->count--;
+}
+
+static void set_clear(struct route_set *set) {
+    for (uint32_t i = 0; i <= set->mask; i++) {
+        set->slots[i].idx = SET_EMPTY;
+    }
+    set->count = 0;
+}
+
+/* Index of nexthop id in mgr->nexthops, or -1 */
+static int nh_find(const route_manager_t *mgr, uint32_t id) {
+    for (int i = 0; i < mgr->nexthop_count; i++) {
+        if (mgr->nexthops[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Helper: Execute shell command and check result */
+static int exec_cmd(const char *cmd) {
+    NB_LOG_DEBUG("Executing: %s", cmd);
+    int ret = system(cmd);
+    if (ret != 0) {
+        NB_LOG_ERROR("Command failed (exit %d): %s", ret, cmd);
+        return NB_ERROR_SYSTEM;
+    }
+    return NB_SUCCESS;
+}
+
+static void route_nl_close(struct route_nl *nl) {
+    if (!nl) return;
+
+    nb_nl_close(&nl->rtnl);
+    nb_nl_close(&nl->monitor);
+    nb_nl_buf_free(&nl->buf);
+    nb_nl_buf_free(&nl->batch);
+    free(nl);
+}
+
+static int route_nl_open(struct route_nl **nl_out) {
+    struct route_nl *nl = calloc(1, sizeof(struct route_nl));
+    if (!nl) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    nl->rtnl.fd = -1;
+    nl->monitor.fd = -1;
+
+    int ret = nb_nl_open(&nl->rtnl, NETLINK_ROUTE);
+    if (ret == NB_SUCCESS) {
+        ret = nb_nl_buf_init(&nl->buf, NB_NL_BUFSIZE);
+    }
+    if (ret == NB_SUCCESS) {
+        ret = nb_nl_buf_init(&nl->batch, ROUTE_BATCH_BUFSIZE);
+    }
+    if (ret != NB_SUCCESS) {
+        route_nl_close(nl);
+        return ret;
+    }
+
+    /* Let the kernel apply dump filters (table, protocol); older kernels ignore them */
+    int one = 1;
+    setsockopt(nl->rtnl.fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &one, sizeof(one));
+
+    nl->window = nb_nl_rcvbuf(&nl->rtnl) / ROUTE_ACK_TRUESIZE;
+    if (nl->window < ROUTE_WINDOW_MIN) nl->window = ROUTE_WINDOW_MIN;
+    if (nl->window > ROUTE_WINDOW_MAX) nl->window = ROUTE_WINDOW_MAX;
+
+    *nl_out = nl;
+    return NB_SUCCESS;
+}
+
+/* Helper: fill op with a request for dst in the manager's table */
+static void op_init(route_op_t *op, uint16_t type, const nb_prefix_t *dst) {
+    memset(op, 0, sizeof(*op));
+    op->type = type;
+    op->rtm.rtm_family = dst->family;
+    op->rtm.rtm_dst_len = dst->len;
+    if (type == RTM_NEWROUTE) {
+        op->rtm.rtm_protocol = ROUTE_PROTO;
+        op->rtm.rtm_scope = RT_SCOPE_LINK;
+        op->rtm.rtm_type = RTN_UNICAST;
+    } else {
+        /* Like 'ip route del': first route for the destination in the table */
+        op->rtm.rtm_scope = RT_SCOPE_NOWHERE;
+    }
+    memcpy(op->dst, dst->addr, sizeof(op->dst));
+}
+
+/* Helper: parse an add request into op */
+static int op_init_add(route_op_t *op, const route_config_t *route) {
+    nb_prefix_t dst;
+    if (!route->network || nb_prefix_parse(route->network, &dst) != NB_SUCCESS) {
+        return NB_ERROR_INVALID;
+    }
+    nb_prefix_normalize(&dst);
+
+    op_init(op, RTM_NEWROUTE, &dst);
+    op->metric = route->metric > 0 ? (uint32_t)route->metric : ROUTE_DEFAULT_METRIC;
+    op->has_metric = 1;
+    op->masquerade = route->masquerade ? 1 : 0;
+    op->nhid = route->nhid;
+    if (route->device) {
+        if (strlen(route->device) >= sizeof(op->device)) {
+            return NB_ERROR_INVALID;
+        }
+        strcpy(op->device, route->device);
+    }
+    return NB_SUCCESS;
+}
+
+/* Helper: parse a delete request into op */
+static int op_init_del(route_op_t *op, const char *network) {
+    nb_prefix_t dst;
+    if (!network || nb_prefix_parse(network, &dst) != NB_SUCCESS) {
+        return NB_ERROR_INVALID;
+    }
+    nb_prefix_normalize(&dst);
+
+    op_init(op, RTM_DELROUTE, &dst);
+    return NB_SUCCESS;
+}
+
+/* Helper: destination of op as a prefix */
+static void op_prefix(const route_op_t *op, nb_prefix_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->family = op->rtm.rtm_family;
+    out->len = op->rtm.rtm_dst_len;
+    memcpy(out->addr, op->dst, sizeof(out->addr));
+}
+
+/* Helper: exact delete of an owned route */
+static void op_init_owned_del(route_op_t *op, const route_entry_t *e) {
+    op_init(op, RTM_DELROUTE, &e->dst);
+    op->metric = e->metric;
+    op->has_metric = 1;
+    op->ifindex = e->ifindex;
+    op->nhid = e->nhid;
+    memcpy(op->device, e->device, sizeof(op->device));
+}
+
+/* Helper: (re)install an owned route */
+static void op_init_owned_add(route_op_t *op, const route_entry_t *e) {
+    op_init(op, RTM_NEWROUTE, &e->dst);
+    op->metric = e->metric;
+    op->has_metric = 1;
+    op->masquerade = e->masquerade;
+    op->nhid = e->nhid;
+    memcpy(op->device, e->device, sizeof(op->device));
+}
+
+/* Helper: a plain delete of an owned destination targets exactly our route */
+static void op_claim(route_manager_t *mgr, route_op_t *op) {
+    nb_prefix_t dst;
+
+    if (op->type != RTM_DELROUTE || op->has_metric || op->table) {
+        return;
+    }
+    op_prefix(op, &dst);
+    int idx = set_find(mgr->owned, &dst);
+    if (idx >= 0) {
+        op_init_owned_del(op, &mgr->owned->entries[idx]);
+    }
+}
+
+/* Helper: owned set entry for an installed add */
+static void op_entry(const route_op_t *op, route_entry_t *e) {
+    memset(e, 0, sizeof(*e));
+    op_prefix(op, &e->dst);
+    e->metric = op->metric;
+    e->ifindex = op->ifindex;
+    e->masquerade = op->masquerade;
+    e->nhid = op->nhid;
+    memcpy(e->device, op->device, sizeof(e->device));
+}
+
+/* Helper: record the outcome of op in the owned set (ops on other tables are not ours) */
+static void op_track(route_manager_t *mgr, const route_op_t *op) {
+    nb_prefix_t dst;
+
+    if (op->table && op->table != (mgr->table ? mgr->table : RT_TABLE_MAIN)) {
+        return;
+    }
+    op_prefix(op, &dst);
+    if (op->type == RTM_NEWROUTE) {
+        if (op->ret != NB_SUCCESS) {
+            return;
+        }
+        route_entry_t e;
+        op_entry(op, &e);
+        int idx = set_find(mgr->owned, &dst);
+        if (e.masquerade || (idx >= 0 && mgr->owned->entries[idx].masquerade)) {
+            mgr->masq_dirty = 1;
+        }
+        if (set_put(mgr->owned, &e) != NB_SUCCESS) {
+            NB_LOG_WARN("Route installed but not tracked (out of memory)");
+        }
+        return;
+    }
+
+    /* Gone either way; a delete for another metric leaves a replacement alone */
+    if (op->ret == NB_SUCCESS || op->ret == NB_ERROR_NOTFOUND) {
+        int idx = set_find(mgr->owned, &dst);
+        if (idx >= 0 && (!op->has_metric || mgr->owned->entries[idx].metric == op->metric)) {
+            mgr->masq_dirty |= mgr->owned->entries[idx].masquerade;
+            set_del(mgr->owned, &dst);
+        }
+    }
+}
+
+/* Helper: table op goes to */
+static uint32_t op_table(const route_manager_t *mgr, const route_op_t *op) {
+    if (op->table) {
+        return op->table;
+    }
+    return mgr->table ? mgr->table : RT_TABLE_MAIN;
+}
+
+/* Last device resolved by op_resolve (saves an ioctl per route in batches) */
+typedef struct {
+    char name[IFNAMSIZ];
+    int ifindex;
+} ifindex_cache_t;
+
+/* Helper: resolve the output interface of an add */
+static int op_resolve(route_manager_t *mgr, route_op_t *op, ifindex_cache_t *cache) {
+    if (op->type != RTM_NEWROUTE || op->ifindex != 0 || op->nhid) {
+        return NB_SUCCESS;
+    }
+
+    const char *device = op->device[0] ? op->device : mgr->wg_device;
+    if (cache->ifindex == 0 || strcmp(cache->name, device) != 0) {
+        unsigned int ifindex = if_nametoindex(device);
+        if (ifindex == 0) {
+            op->err = errno;
+            op->ret = NB_ERROR_NOTFOUND;
+            return op->ret;
+        }
+        snprintf(cache->name, sizeof(cache->name), "%s", device);
+        cache->ifindex = (int)ifindex;
+    }
+    op->ifindex = cache->ifindex;
+    return NB_SUCCESS;
+}
+
+/* Helper: append the request for op (in table) to b */
+static void op_put(nb_nl_buf_t *b, uint32_t seq, const route_op_t *op, uint32_t table) {
+    uint16_t flags = NLM_F_REQUEST | NLM_F_ACK;
+    if (op->type == RTM_NEWROUTE) {
+        flags |= NLM_F_CREATE | NLM_F_REPLACE;
+    }
+
+    nb_nl_msg_begin(b, op->type, flags, seq);
+    struct rtmsg *rtm = nb_nl_msg_put_header(b, sizeof(*rtm));
+    *rtm = op->rtm;
+    rtm->rtm_table = table < 256 ? (uint8_t)table : RT_TABLE_UNSPEC;
+    nb_nl_attr_put_u32(b, RTA_TABLE, table);
+    if (op->rtm.rtm_dst_len > 0) {
+        nb_nl_attr_put(b, RTA_DST, op->dst, op->rtm.rtm_family == AF_INET ? 4 : 16);
+    }
+    if (op->nhid) {
+        nb_nl_attr_put_u32(b, RTA_NH_ID, op->nhid);
+    } else if (op->ifindex) {
+        nb_nl_attr_put_u32(b, RTA_OIF, (uint32_t)op->ifindex);
+    }
+    if (op->has_metric) {
+        nb_nl_attr_put_u32(b, RTA_PRIORITY, op->metric);
+    }
+}
+
+/* Helper: send a single op and wait for its ACK */
+static int nl_op_transact(route_manager_t *mgr, route_op_t *op) {
+    struct route_nl *nl = mgr->nl;
+    ifindex_cache_t cache = { .ifindex = 0 };
+
+    if (op_resolve(mgr, op, &cache) != NB_SUCCESS) {
+        return op->ret;
+    }
+
+    nb_nl_buf_reset(&nl->buf);
+    op_put(&nl->buf, nb_nl_next_seq(&nl->rtnl), op, op_table(mgr, op));
+    op->ret = nb_nl_transact(&nl->rtnl, &nl->buf, NULL, NULL);
+    op->err = op->ret == NB_SUCCESS ? 0 : nb_nl_last_errno(&nl->rtnl);
+    return op->ret;
+}
+
+/**
+ * Pipeline every op of the batch
+ *
+ * Up to nl->window requests go out in one sendmsg(); the kernel handles
+ * them in order and queues one ACK each, which we match back by sequence
+ * number before sending the next chunk.
+ */
+static int nl_batch_commit(route_manager_t *mgr, route_batch_t *batch) {
+    struct route_nl *nl = mgr->nl;
+    int *errs = malloc(sizeof(int) * nl->window);
+    int *slots = malloc(sizeof(int) * nl->window);
+    if (!errs || !slots) {
+        NB_LOG_ERROR("malloc failed");
+        free(errs);
+        free(slots);
+        return NB_ERROR_SYSTEM;
+    }
+
+    ifindex_cache_t cache = { .ifindex = 0 };
+    int ret = NB_SUCCESS;
+    int next = 0;
+    while (next < batch->count && ret == NB_SUCCESS) {
+        nb_nl_buf_t *b = &nl->batch;
+        uint32_t first_seq = nl->rtnl.seq + 1;
+        int n = 0;
+
+        nb_nl_buf_reset(b);
+        while (next < batch->count && n < nl->window && b->cap - b->len >= ROUTE_MSG_MAX) {
+            route_op_t *op = &batch->ops[next];
+            if (op_resolve(mgr, op, &cache) == NB_SUCCESS) {
+                op_put(b, nb_nl_next_seq(&nl->rtnl), op, op_table(mgr, op));
+                slots[n] = next;
+                errs[n] = -1;
+                n++;
+            }
+            next++;
+        }
+        if (n == 0) {
+            continue;
+        }
+
+        ret = nb_nl_send(&nl->rtnl, b);
+        int acked = 0;
+        while (ret == NB_SUCCESS && acked < n) {
+            int got = nb_nl_recv_acks(&nl->rtnl, first_seq, n, errs, 1);
+            if (got < 0) {
+                if (nb_nl_last_errno(&nl->rtnl) != ENOBUFS) {
+                    ret = got;
+                }
+                break;      /* ENOBUFS: the missing ACKs are gone */
+            }
+            acked += got;
+        }
+
+        for (int i = 0; i < n; i++) {
+            route_op_t *op = &batch->ops[slots[i]];
+            op->err = errs[i] >= 0 ? errs[i] : nb_nl_last_errno(&nl->rtnl);
+            op->ret = errs[i] >= 0 ? nb_nl_error(errs[i]) : NB_ERROR_SYSTEM;
+        }
+    }
+
+    /* Socket failure: nothing after the failed chunk was sent */
+    for (int i = next; i < batch->count; i++) {
+        batch->ops[i].ret = ret;
+        batch->ops[i].err = nb_nl_last_errno(&nl->rtnl);
+    }
+
+    free(errs);
+    free(slots);
+    return ret;
+}
+
+/* Helper: dump the routes of table (protocol 0: any), filtered by the kernel when it can */
+static int nl_dump_table(route_manager_t *mgr, uint32_t table, uint8_t protocol,
+                         nb_nl_cb_t cb, void *ctx) {
+    struct route_nl *nl = mgr->nl;
+
+    nb_nl_buf_reset(&nl->buf);
+    nb_nl_msg_begin(&nl->buf, RTM_GETROUTE, NLM_F_REQUEST | NLM_F_DUMP, nb_nl_next_seq(&nl->rtnl));
+    struct rtmsg *rtm = nb_nl_msg_put_header(&nl->buf, sizeof(*rtm));
+    rtm->rtm_family = AF_UNSPEC;
+    rtm->rtm_table = table < 256 ? (uint8_t)table : RT_TABLE_UNSPEC;
+    rtm->rtm_protocol = protocol;
+    nb_nl_attr_put_u32(&nl->buf, RTA_TABLE, table);
+
+    int ret = nb_nl_send(&nl->rtnl, &nl->buf);
+    if (ret == NB_SUCCESS) {
+        ret = nb_nl_recv(&nl->rtnl, nl->buf.nlh->nlmsg_seq, cb, ctx);
+    }
+    if (ret != NB_SUCCESS) {
+        mgr->last_errno = nb_nl_last_errno(&nl->rtnl);
+        NB_LOG_ERROR("Route dump of table %u failed: %s", table, strerror(mgr->last_errno));
+    }
+    return ret;
+}
+
+/* Helper: table of a dumped route */
+static uint32_t dumped_table(const struct rtmsg *rtm, const struct nlattr **tb) {
+    return tb[RTA_TABLE] ? nb_nl_attr_get_u32(tb[RTA_TABLE]) : rtm->rtm_table;
+}
+
+/* Helper: destination of a dumped route */
+static void dumped_dst(const struct rtmsg *rtm, const struct nlattr **tb, nb_prefix_t *dst) {
+    memset(dst, 0, sizeof(*dst));
+    dst->family = rtm->rtm_family;
+    dst->len = rtm->rtm_dst_len;
+    if (tb[RTA_DST] && nb_nl_attr_len(tb[RTA_DST]) <= sizeof(dst->addr)) {
+        memcpy(dst->addr, nb_nl_attr_data(tb[RTA_DST]), nb_nl_attr_len(tb[RTA_DST]));
+    }
+}
+
+/* Drift check state */
+typedef struct {
+    route_manager_t *mgr;
+    uint32_t table;             /* Table holding the owned routes */
+    int ifindex;                /* The WireGuard device */
+    uint8_t *seen;              /* Per owned entry: present in the kernel as installed */
+    route_batch_t *batch;       /* Deletes of stray routes */
+} drift_ctx_t;
+
+/* Callback: match one dumped route against the owned set */
+static int drift_route_cb(const struct nlmsghdr *nlh, void *arg) {
+    drift_ctx_t *ctx = arg;
+    const struct rtmsg *rtm = NLMSG_DATA(nlh);
+    const struct nlattr *tb[RTA_MAX + 1];
+
+    if (nlh->nlmsg_type != RTM_NEWROUTE || nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*rtm))) {
+        return NB_SUCCESS;
+    }
+    nb_nl_msg_parse(nlh, sizeof(*rtm), tb, RTA_MAX);
+
+    /* The kernel filters too when it supports strict dumps */
+    if (dumped_table(rtm, tb) != ctx->table || rtm->rtm_protocol != ROUTE_PROTO ||
+        (!tb[RTA_OIF] && !tb[RTA_NH_ID])) {
+        return NB_SUCCESS;
+    }
+
+    nb_prefix_t dst;
+    dumped_dst(rtm, tb, &dst);
+    int oif = tb[RTA_OIF] ? (int)nb_nl_attr_get_u32(tb[RTA_OIF]) : 0;
+    uint32_t nhid = tb[RTA_NH_ID] ? nb_nl_attr_get_u32(tb[RTA_NH_ID]) : 0;
+    uint32_t metric = tb[RTA_PRIORITY] ? nb_nl_attr_get_u32(tb[RTA_PRIORITY]) : 0;
+
+    int idx = set_find(ctx->mgr->owned, &dst);
+    if (idx >= 0) {
+        const route_entry_t *e = &ctx->mgr->owned->entries[idx];
+        /* The output interface of a nexthop route follows the nexthop */
+        if (e->metric == metric && e->nhid == nhid && (nhid || e->ifindex == oif)) {
+            ctx->seen[idx] = 1;
+            return NB_SUCCESS;
+        }
+    }
+
+    /* Ours by protocol and device or nexthop, but not (or no longer) in the set */
+    int ours = nhid ? nh_find(ctx->mgr, nhid) >= 0 : oif == ctx->ifindex;
+    if (ours && !(idx >= 0 && ctx->mgr->owned->entries[idx].metric == metric)) {
+        route_entry_t stray = { .dst = dst, .metric = metric, .ifindex = oif, .nhid = nhid };
+        route_op_t op;
+        op_init_owned_del(&op, &stray);
+        if (route_batch_push(ctx->batch, &op) < 0) {
+            return NB_ERROR_SYSTEM;
+        }
+    }
+    return NB_SUCCESS;
+}
+
+/* Table flush state */
+typedef struct {
+    uint32_t table;
+    route_batch_t *batch;       /* Deletes */
+} flush_ctx_t;
+
+/* Callback: queue the exact delete of one dumped route */
+static int flush_route_cb(const struct nlmsghdr *nlh, void *arg) {
+    flush_ctx_t *ctx = arg;
+    const struct rtmsg *rtm = NLMSG_DATA(nlh);
+    const struct nlattr *tb[RTA_MAX + 1];
+
+    if (nlh->nlmsg_type != RTM_NEWROUTE || nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*rtm))) {
+        return NB_SUCCESS;
+    }
+    nb_nl_msg_parse(nlh, sizeof(*rtm), tb, RTA_MAX);
+    if (dumped_table(rtm, tb) != ctx->table) {
+        return NB_SUCCESS;
+    }
+
+    nb_prefix_t dst;
+    route_op_t op;
+    dumped_dst(rtm, tb, &dst);
+    op_init(&op, RTM_DELROUTE, &dst);
+    op.table = ctx->table;
+    op.rtm.rtm_tos = rtm->rtm_tos;
+    if (tb[RTA_PRIORITY]) {
+        op.metric = nb_nl_attr_get_u32(tb[RTA_PRIORITY]);
+        op.has_metric = 1;
+    }
+    if (tb[RTA_OIF]) {
+        op.ifindex = (int)nb_nl_attr_get_u32(tb[RTA_OIF]);
+    }
+    return route_batch_push(ctx->batch, &op) < 0 ? NB_ERROR_SYSTEM : NB_SUCCESS;
+}
+
+/* Shell backend: 'ip route' commands */
+
+static int shell_op(route_manager_t *mgr, route_op_t *op) {
+    const char *device = op->device[0] ? op->device : mgr->wg_device;
+    uint32_t table = op_table(mgr, op);
+    nb_prefix_t dst;
+    char network[NB_PREFIX_STRLEN];
+    char cmd[512];
+
+    op_prefix(op, &dst);
+    nb_prefix_format(&dst, network, sizeof(network));
+    if (op->type == RTM_NEWROUTE && op->nhid) {
+        snprintf(cmd, sizeof(cmd), "ip route replace %s nhid %u metric %u table %u 2>/dev/null",
+                 network, op->nhid, op->metric, table);
+    } else if (op->type == RTM_DELROUTE && op->nhid) {
+        snprintf(cmd, sizeof(cmd), "ip route del %s nhid %u metric %u table %u 2>/dev/null",
+                 network, op->nhid, op->metric, table);
+    } else if (op->type == RTM_NEWROUTE) {
+        snprintf(cmd, sizeof(cmd), "ip route replace %s dev %s metric %u table %u 2>/dev/null",
+                 network, device, op->metric, table);
+    } else if (op->has_metric) {
+        snprintf(cmd, sizeof(cmd), "ip route del %s dev %s metric %u table %u 2>/dev/null",
+                 network, device, op->metric, table);
+    } else {
+        snprintf(cmd, sizeof(cmd), "ip route del %s table %u 2>/dev/null", network, table);
+    }
+
+    op->ret = exec_cmd(cmd);
+    op->err = 0;
+    if (op->ret != NB_SUCCESS && op->type == RTM_DELROUTE) {
+        NB_LOG_WARN("Route removal failed (may not exist): %s", network);
+    }
+    return op->ret;
+}
+
+/* Policy routing rules */
+
+static int table_reserved(uint32_t table) {
+    return table == RT_TABLE_UNSPEC || (table >= RT_TABLE_COMPAT && table <= RT_TABLE_LOCAL);
+}
+
+/* Helper: RTM_NEWRULE / RTM_DELRULE of our rule for table */
+static int nl_rule(route_manager_t *mgr, uint16_t type, int family, uint32_t table) {
+    struct route_nl *nl = mgr->nl;
+    uint16_t flags = NLM_F_REQUEST | NLM_F_ACK;
+    if (type == RTM_NEWRULE) {
+        flags |= NLM_F_CREATE | NLM_F_EXCL;
+    }
+
+    nb_nl_buf_reset(&nl->buf);
+    nb_nl_msg_begin(&nl->buf, type, flags, nb_nl_next_seq(&nl->rtnl));
+    struct fib_rule_hdr *frh = nb_nl_msg_put_header(&nl->buf, sizeof(*frh));
+    frh->family = (uint8_t)family;
+    frh->action = FR_ACT_TO_TBL;
+    frh->table = table < 256 ? (uint8_t)table : RT_TABLE_UNSPEC;
+    nb_nl_attr_put_u32(&nl->buf, FRA_TABLE, table);
+    nb_nl_attr_put_u32(&nl->buf, FRA_PRIORITY, mgr->rule_priority);
+    if (mgr->fwmark) {
+        frh->flags = FIB_RULE_INVERT;
+        nb_nl_attr_put_u32(&nl->buf, FRA_FWMARK, mgr->fwmark);
+        nb_nl_attr_put_u32(&nl->buf, FRA_FWMASK, UINT32_MAX);
+    }
+
+    int ret = nb_nl_transact(&nl->rtnl, &nl->buf, NULL, NULL);
+    mgr->last_errno = ret == NB_SUCCESS ? 0 : nb_nl_last_errno(&nl->rtnl);
+    return ret;
+}
+
+/* Helper: the same with 'ip rule' (no error log: deleting a missing rule is normal) */
+static int shell_rule(route_manager_t *mgr, const char *action, int family, uint32_t table) {
+    char mark[32] = "";
+    char cmd[256];
+
+    if (mgr->fwmark) {
+        snprintf(mark, sizeof(mark), "not fwmark 0x%x ", mgr->fwmark);
+    }
+    snprintf(cmd, sizeof(cmd), "ip %s rule %s %stable %u priority %u 2>/dev/null",
+             family == AF_INET6 ? "-6" : "-4", action, mark, table, mgr->rule_priority);
+    NB_LOG_DEBUG("Executing: %s", cmd);
+    mgr->last_errno = 0;
+    return system(cmd) == 0 ? NB_SUCCESS : NB_ERROR_SYSTEM;
+}
+
+/**
+ * Add our rule for table, IPv4 and IPv6
+ *
+ * @return Number of rules added (an existing rule is not added again),
+ *         or NB_ERROR_* if the IPv4 rule failed
+ */
+static int rule_add(route_manager_t *mgr, uint32_t table) {
+    int added = 0;
+
+    for (int i = 0; i < 2; i++) {
+        int family = i == 0 ? AF_INET : AF_INET6;
+        int ret = mgr->backend == ROUTE_BACKEND_NETLINK ?
+                  nl_rule(mgr, RTM_NEWRULE, family, table) : shell_rule(mgr, "add", family, table);
+        if (ret == NB_SUCCESS) {
+            added++;
+        } else if (ret != NB_ERROR_EXISTS) {
+            if (family == AF_INET) {
+                NB_LOG_ERROR("Failed to add rule for table %u: %s", table,
+                             mgr->last_errno ? strerror(mgr->last_errno) : "command failed");
+                return ret;
+            }
+            /* IPv6 may be disabled */
+            NB_LOG_DEBUG("IPv6 rule for table %u not added", table);
+        }
+    }
+    return added;
+}
+
+/* Helper: delete our rule for table, IPv4 and IPv6 (missing rules are fine) */
+static void rule_del(route_manager_t *mgr, uint32_t table) {
+    for (int i = 0; i < 2; i++) {
+        int family = i == 0 ? AF_INET : AF_INET6;
+        if (mgr->backend == ROUTE_BACKEND_NETLINK) {
+            nl_rule(mgr, RTM_DELRULE, family, table);
+        } else {
+            shell_rule(mgr, "del", family, table);
+        }
+    }
+}
+
+/* Nexthop objects */
+
+/* Helper: send the RTM_NEWNEXTHOP (create or replace) for nh */
+static int nl_nexthop_set(route_manager_t *mgr, const struct route_nh *nh, int ifindex) {
+    struct route_nl *nl = mgr->nl;
+
+    nb_nl_buf_reset(&nl->buf);
+    nb_nl_msg_begin(&nl->buf, RTM_NEWNEXTHOP, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_REPLACE,
+                    nb_nl_next_seq(&nl->rtnl));
+    struct nhmsg *nhm = nb_nl_msg_put_header(&nl->buf, sizeof(*nhm));
+    nhm->nh_family = nh->group ? AF_UNSPEC : nh->family;
+    nhm->nh_protocol = ROUTE_PROTO;
+    nb_nl_attr_put_u32(&nl->buf, NHA_ID, nh->id);
+    if (nh->group) {
+        nb_nl_attr_put(&nl->buf, NHA_GROUP, nh->group, sizeof(*nh->group) * nh->group_count);
+    } else {
+        nb_nl_attr_put_u32(&nl->buf, NHA_OIF, (uint32_t)ifindex);
+    }
+
+    int ret = nb_nl_transact(&nl->rtnl, &nl->buf, NULL, NULL);
+    mgr->last_errno = ret == NB_SUCCESS ? 0 : nb_nl_last_errno(&nl->rtnl);
+    return ret;
+}
+
+/* Helper: 'ip nexthop replace' for nh */
+static int shell_nexthop_set(route_manager_t *mgr, const struct route_nh *nh, const char *device) {
+    char cmd[1024];
+    int len;
+
+    mgr->last_errno = 0;
+    if (!nh->group) {
+        snprintf(cmd, sizeof(cmd), "ip %s nexthop replace id %u dev %s",
+                 nh->family == AF_INET6 ? "-6" : "-4", nh->id, device);
+        return exec_cmd(cmd);
+    }
+
+    len = snprintf(cmd, sizeof(cmd), "ip nexthop replace id %u group ", nh->id);
+    for (int i = 0; i < nh->group_count && len < (int)sizeof(cmd); i++) {
+        len += snprintf(cmd + len, sizeof(cmd) - len, "%s%u,%u", i ? "/" : "",
+                        nh->group[i].id, nh->group[i].weight + 1u);
+    }
+    if (len >= (int)sizeof(cmd)) {
+        return NB_ERROR_INVALID;
+    }
+    return exec_cmd(cmd);
+}
+
+/* Helper: (re)create nh in the kernel */
+static int nh_apply(route_manager_t *mgr, const struct route_nh *nh) {
+    const char *device = nh->device[0] ? nh->device : mgr->wg_device;
+    int ifindex = 0;
+
+    if (!nh->group) {
+        ifindex = (int)if_nametoindex(device);
+        if (ifindex == 0) {
+            mgr->last_errno = errno;
+            NB_LOG_ERROR("Nexthop %u: device %s not found", nh->id, device);
+            return NB_ERROR_NOTFOUND;
+        }
+    }
+
+    int ret = mgr->backend == ROUTE_BACKEND_NETLINK ? nl_nexthop_set(mgr, nh, ifindex)
+                                                    : shell_nexthop_set(mgr, nh, device);
+    if (ret != NB_SUCCESS) {
+        NB_LOG_ERROR("Nexthop %u update failed: %s", nh->id,
+                     mgr->last_errno ? strerror(mgr->last_errno) : "command failed");
+    }
+    return ret;
+}
+
+/* Helper: apply nh and record it (replacing an earlier version) */
+static int nh_set(route_manager_t *mgr, struct route_nh *nh) {
+    int ret = nh_apply(mgr, nh);
+    if (ret != NB_SUCCESS) {
+        free(nh->group);
+        return ret;
+    }
+
+    int idx = nh_find(mgr, nh->id);
+    if (idx >= 0) {
+        free(mgr->nexthops[idx].group);
+        mgr->nexthops[idx] = *nh;
+        return NB_SUCCESS;
+    }
+    if (mgr->nexthop_count == mgr->nexthop_cap) {
+        int cap = mgr->nexthop_cap ? mgr->nexthop_cap * 2 : 8;
+        struct route_nh *nexthops = realloc(mgr->nexthops, sizeof(struct route_nh) * cap);
+        if (!nexthops) {
+            NB_LOG_ERROR("realloc failed");
+            free(nh->group);
+            return NB_ERROR_SYSTEM;
+        }
+        mgr->nexthops = nexthops;
+        mgr->nexthop_cap = cap;
+    }
+    mgr->nexthops[mgr->nexthop_count++] = *nh;
+    return NB_SUCCESS;
+}
+
+/* Helper: delete nexthop id in the kernel */
+static int nh_delete(route_manager_t *mgr, uint32_t id) {
+    if (mgr->backend != ROUTE_BACKEND_NETLINK) {
+        char cmd[64];
+        snprintf(cmd, sizeof(cmd), "ip nexthop del id %u 2>/dev/null", id);
+        mgr->last_errno = 0;
+        NB_LOG_DEBUG("Executing: %s", cmd);
+        return system(cmd) == 0 ? NB_SUCCESS : NB_ERROR_NOTFOUND;
+    }
+
+    struct route_nl *nl = mgr->nl;
+    nb_nl_buf_reset(&nl->buf);
+    nb_nl_msg_begin(&nl->buf, RTM_DELNEXTHOP, NLM_F_REQUEST | NLM_F_ACK, nb_nl_next_seq(&nl->rtnl));
+    nb_nl_msg_put_header(&nl->buf, sizeof(struct nhmsg));
+    nb_nl_attr_put_u32(&nl->buf, NHA_ID, id);
+
+    int ret = nb_nl_transact(&nl->rtnl, &nl->buf, NULL, NULL);
+    mgr->last_errno = ret == NB_SUCCESS ? 0 : nb_nl_last_errno(&nl->rtnl);
+    return ret;
+}
+
+/* Helper: does nexthop id exist in the kernel? */
+static int nh_exists(route_manager_t *mgr, uint32_t id) {
+    struct route_nl *nl = mgr->nl;
+
+    nb_nl_buf_reset(&nl->buf);
+    nb_nl_msg_begin(&nl->buf, RTM_GETNEXTHOP, NLM_F_REQUEST, nb_nl_next_seq(&nl->rtnl));
+    nb_nl_msg_put_header(&nl->buf, sizeof(struct nhmsg));
+    nb_nl_attr_put_u32(&nl->buf, NHA_ID, id);
+    return nb_nl_transact(&nl->rtnl, &nl->buf, NULL, NULL) != NB_ERROR_NOTFOUND;
+}
+
+/* Helper: forget the owned routes that used nexthop id */
+static void nh_drop_routes(route_manager_t *mgr, uint32_t id) {
+    for (uint32_t i = mgr->owned->count; i-- > 0; ) {
+        if (mgr->owned->entries[i].nhid == id) {
+            mgr->masq_dirty |= mgr->owned->entries[i].masquerade;
+            set_del(mgr->owned, &mgr->owned->entries[i].dst);
+        }
+    }
+}
+
+const char* route_backend_name(route_backend_t backend) {
+    switch (backend) {
+    case ROUTE_BACKEND_NETLINK: return "netlink";
+    case ROUTE_BACKEND_SHELL:   return "shell";
+    default:                    return "auto";
+    }
+}
+
+/* Helper: iptables MASQUERADE rule for everything leaving a device */
+static int masq_iptables(const char *action, const char *device) {
+    char cmd[512];
+
+    if (strcmp(action, "-A") == 0) {
+        snprintf(cmd, sizeof(cmd),
+                "iptables -t nat -C POSTROUTING -o %s -j MASQUERADE 2>/dev/null || "
+                "iptables -t nat -A POSTROUTING -o %s -j MASQUERADE",
+                device, device);
+    } else {
+        snprintf(cmd, sizeof(cmd),
+                "iptables -t nat %s POSTROUTING -o %s -j MASQUERADE 2>/dev/null",
+                action, device);
+    }
+    return exec_cmd(cmd);
+}
+
+/* Helper: IP forwarding for the families of the entries, once per family */
+static void masq_forwarding(route_manager_t *mgr, const nb_nft_masq_t *entries, int count) {
+    for (int i = 0; i < count; i++) {
+        int family = entries[i].prefix.family;
+        int bit = family == AF_INET ? 1 : 2;
+        if (mgr->forwarding & bit) {
+            continue;
+        }
+        if (nb_ip_forward_enable(family) == NB_SUCCESS) {
+            mgr->forwarding |= bit;
+        } else {
+            NB_LOG_WARN("Failed to enable IP%s forwarding", family == AF_INET ? "v4" : "v6");
+        }
+    }
+}
+
+/* Helper: masqueraded destinations: owned routes, plus everything leaving masq_devices */
+static int masq_collect(const route_manager_t *mgr, nb_nft_masq_t **out) {
+    int n = 0;
+    nb_nft_masq_t *entries = malloc(((size_t)mgr->owned->count + 2 * (size_t)mgr->masq_device_count + 1) *
+                                    sizeof(*entries));
+    if (!entries) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    for (uint32_t i = 0; i < mgr->owned->count; i++) {
+        const route_entry_t *e = &mgr->owned->entries[i];
+        if (!e->masquerade) {
+            continue;
+        }
+        nb_nft_masq_t *m = &entries[n++];
+        snprintf(m->device, sizeof(m->device), "%s", e->device[0] ? e->device : mgr->wg_device);
+        m->prefix = e->dst;
+    }
+    for (int i = 0; i < mgr->masq_device_count; i++) {
+        for (int f = 0; f < 2; f++) {
+            nb_nft_masq_t *m = &entries[n++];
+            memset(m, 0, sizeof(*m));
+            snprintf(m->device, sizeof(m->device), "%s", mgr->masq_devices[i]);
+            m->prefix.family = f ? AF_INET6 : AF_INET;
+        }
+    }
+    *out = entries;
+    return n;
+}
+
+/* Helper: one iptables rule per device (shell backend, no nf_tables); rules are only added */
+static int masq_legacy(route_manager_t *mgr, const nb_nft_masq_t *entries, int count) {
+    int ret = NB_SUCCESS;
+
+    for (int i = 0; i < count; i++) {
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++) {
+            seen = strcmp(entries[j].device, entries[i].device) == 0;
+        }
+        if (!seen && masq_iptables("-A", entries[i].device) != NB_SUCCESS) {
+            NB_LOG_ERROR("Failed to enable masquerade for %s", entries[i].device);
+            ret = NB_ERROR_SYSTEM;
+        }
+    }
+    masq_forwarding(mgr, entries, count);
+    return ret;
+}
+
+/* Helper: the nfnetlink handle, opened on first use */
+static nb_nft_t* nft_handle(route_manager_t *mgr) {
+    if (!mgr->nft) {
+        mgr->nft = calloc(1, sizeof(*mgr->nft));
+        if (mgr->nft && nb_nft_open(mgr->nft) != NB_SUCCESS) {
+            free(mgr->nft);
+            mgr->nft = NULL;
+        }
+    }
+    return mgr->nft;
+}
+
+/* Helper: close the handle unless the flowtable still depends on it */
+static void nft_release(route_manager_t *mgr) {
+    if (mgr->nft && !mgr->nft->offload_ready) {
+        nb_nft_close(mgr->nft);
+        free(mgr->nft);
+        mgr->nft = NULL;
+    }
+}
+
+/* Helper: replace the nftables set contents; nf_tables unusable: iptables from now on */
+static int masq_nft(route_manager_t *mgr, const nb_nft_masq_t *entries, int count) {
+    if (!nft_handle(mgr)) {
+        goto legacy;
+    }
+
+    int ret = nb_nft_masq_set(mgr->nft, entries, count);
+    if (ret == NB_SUCCESS) {
+        masq_forwarding(mgr, entries, count);
+        return NB_SUCCESS;
+    }
+    if (mgr->nft->masq_ready) {
+        NB_LOG_ERROR("Updating the masquerade sets failed, keeping the previous ones");
+        mgr->masq_dirty = 1;
+        return ret;
+    }
+    nft_release(mgr);
+
+legacy:
+    NB_LOG_WARN("nftables not available, masquerading with iptables");
+    mgr->nft_failed = 1;
+    return masq_legacy(mgr, entries, count);
+}
+
+/* Helper: bring masquerading in line with the owned routes after a change */
+static int masq_apply(route_manager_t *mgr) {
+    if (!mgr->masq_dirty) {
+        return NB_SUCCESS;
+    }
+    mgr->masq_dirty = 0;
+
+    nb_nft_masq_t *entries = NULL;
+    int n = masq_collect(mgr, &entries);
+    if (n < 0) {
+        mgr->masq_dirty = 1;
+        return n;
+    }
+
+    int ret = NB_SUCCESS;
+    if (n == 0 && !(mgr->nft && mgr->nft->masq_ready)) {
+        /* Nothing masqueraded yet: no table */
+    } else if (mgr->backend == ROUTE_BACKEND_SHELL || mgr->nft_failed) {
+        ret = masq_legacy(mgr, entries, n);
+    } else {
+        ret = masq_nft(mgr, entries, n);
+    }
+    free(entries);
+    return ret;
+}
+
+/* Helper: index of a device in masq_devices, -1 if absent */
+static int masq_device_find(const route_manager_t *mgr, const char *device) {
+    for (int i = 0; i < mgr->masq_device_count; i++) {
+        if (strcmp(mgr->masq_devices[i], device) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Helper: drop the nftables table (masquerade sets and flowtable) and the masquerade state */
+static int nft_remove_all(route_manager_t *mgr) {
+    int ret = NB_SUCCESS;
+
+    if (mgr->nft) {
+        ret = nb_nft_table_delete(mgr->nft);
+        nb_nft_close(mgr->nft);
+        free(mgr->nft);
+        mgr->nft = NULL;
+    }
+    for (int i = 0; i < mgr->masq_device_count; i++) {
+        free(mgr->masq_devices[i]);
+    }
+    free(mgr->masq_devices);
+    mgr->masq_devices = NULL;
+    mgr->masq_device_count = 0;
+    mgr->masq_dirty = 0;
+    return ret;
+}
+
+route_manager_t* route_manager_new(const char *wg_device) {
+    return route_manager_new_backend(wg_device, ROUTE_BACKEND_AUTO);
+}
+
+route_manager_t* route_manager_new_backend(const char *wg_device, route_backend_t backend) {
+    if (!wg_device) {
+        NB_LOG_ERROR("Invalid wg_device");
+        return NULL;
+    }
+
+    route_manager_t *mgr = calloc(1, sizeof(route_manager_t));
+    if (!mgr) {
+        NB_LOG_ERROR("calloc failed");
+        return NULL;
+    }
+
+    mgr->wg_device = nb_strdup(wg_device);
+    mgr->owned = set_new();
+    if (!mgr->wg_device || !mgr->owned) {
+        route_manager_free(mgr);
+        return NULL;
+    }
+
+    mgr->backend = backend;
+    if (backend != ROUTE_BACKEND_SHELL) {
+        if (route_nl_open(&mgr->nl) == NB_SUCCESS) {
+            mgr->backend = ROUTE_BACKEND_NETLINK;
+        } else if (backend == ROUTE_BACKEND_NETLINK) {
+            NB_LOG_ERROR("rtnetlink route backend requested but not available");
+            route_manager_free(mgr);
+            return NULL;
+        } else {
+            NB_LOG_WARN("rtnetlink not available, falling back to ip route commands");
+            mgr->backend = ROUTE_BACKEND_SHELL;
+        }
+    }
+
+    NB_LOG_INFO("Route manager created for device: %s (%s)", wg_device,
+                route_backend_name(mgr->backend));
+    return mgr;
+}
+
+int route_add(route_manager_t *mgr, const route_config_t *route) {
+    if (!mgr || !route || !route->network) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    const char *device = route->device ? route->device : mgr->wg_device;
+    int metric = route->metric > 0 ? route->metric : ROUTE_DEFAULT_METRIC;
+
+    NB_LOG_INFO("Adding route: %s via %s (metric: %d)", route->network, device, metric);
+
+    route_op_t op;
+    if (op_init_add(&op, route) != NB_SUCCESS) {
+        mgr->last_errno = EINVAL;
+        NB_LOG_ERROR("Invalid route: %s", route->network);
+        return NB_ERROR_INVALID;
+    }
+
+    int ret = mgr->backend == ROUTE_BACKEND_NETLINK ? nl_op_transact(mgr, &op) : shell_op(mgr, &op);
+    mgr->last_errno = op.err;
+    if (ret != NB_SUCCESS) {
+        NB_LOG_ERROR("Route add %s failed: %s", route->network,
+                     op.err ? strerror(op.err) : "command failed");
+        return ret;
+    }
+    op_track(mgr, &op);
+
+    return masq_apply(mgr);
+}
+
+int route_remove(route_manager_t *mgr, const char *network) {
+    if (!mgr || !network) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    NB_LOG_INFO("Removing route: %s", network);
+
+    route_op_t op;
+    if (op_init_del(&op, network) != NB_SUCCESS) {
+        mgr->last_errno = EINVAL;
+        NB_LOG_ERROR("Invalid route network: %s", network);
+        return NB_ERROR_INVALID;
+    }
+    op_claim(mgr, &op);
+
+    int ret = mgr->backend == ROUTE_BACKEND_NETLINK ? nl_op_transact(mgr, &op) : shell_op(mgr, &op);
+    mgr->last_errno = op.err;
+    op_track(mgr, &op);
+    masq_apply(mgr);
+    if (ret == NB_ERROR_NOTFOUND) {
+        NB_LOG_WARN("Route %s does not exist", network);
+    } else if (ret != NB_SUCCESS && mgr->backend == ROUTE_BACKEND_NETLINK) {
+        NB_LOG_ERROR("Route removal %s failed: %s", network, strerror(op.err));
+    }
+    return ret;
+}
+
+/* Helper: failures of a committed batch, not counting deletes of routes already gone */
+static int batch_failures(const route_batch_t *batch) {
+    int failed = 0;
+    for (int i = 0; i < batch->count; i++) {
+        const route_op_t *op = &batch->ops[i];
+        if (op->ret != NB_SUCCESS && !(op->type == RTM_DELROUTE && op->ret == NB_ERROR_NOTFOUND)) {
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/* Helper: nexthops last, groups before their members */
+static int remove_nexthops(route_manager_t *mgr) {
+    int ret = NB_SUCCESS;
+
+    while (mgr->nexthop_count > 0) {
+        uint32_t id = mgr->nexthops[mgr->nexthop_count - 1].id;
+        if (route_nexthop_del(mgr, id) != NB_SUCCESS && nh_find(mgr, id) >= 0) {
+            ret = NB_ERROR_SYSTEM;
+            free(mgr->nexthops[--mgr->nexthop_count].group);
+        }
+    }
+    return ret;
+}
+
+/* Helper: remove the owned routes */
+static int remove_routes(route_manager_t *mgr) {
+    /* Policy table: drop the rule, then flush instead of deleting route by route */
+    if (mgr->table) {
+        uint32_t table = mgr->table;
+        NB_LOG_INFO("Removing routing table %u (%u owned route(s)) for device: %s",
+                    table, mgr->owned->count, mgr->wg_device);
+        rule_del(mgr, table);
+        int ret = route_flush_table(mgr, table);
+        if (route_flush_table(mgr, mgr->shadow_table) != NB_SUCCESS) {
+            ret = NB_ERROR_SYSTEM;
+        }
+        set_clear(mgr->owned);
+        mgr->table = 0;
+        mgr->shadow_table = 0;
+        return ret;
+    }
+
+    NB_LOG_INFO("Removing all %u owned route(s) for device: %s", mgr->owned->count, mgr->wg_device);
+    if (mgr->owned->count == 0) {
+        return NB_SUCCESS;
+    }
+
+    route_batch_t *batch = route_batch_new();
+    if (!batch) {
+        return NB_ERROR_SYSTEM;
+    }
+    for (uint32_t i = 0; i < mgr->owned->count; i++) {
+        route_op_t op;
+        op_init_owned_del(&op, &mgr->owned->entries[i]);
+        if (route_batch_push(batch, &op) < 0) {
+            route_batch_free(batch);
+            return NB_ERROR_SYSTEM;
+        }
+    }
+
+    int ret = route_batch_commit(mgr, batch);
+    if (ret >= 0) {
+        ret = batch_failures(batch) ? NB_ERROR_SYSTEM : NB_SUCCESS;
+    }
+    route_batch_free(batch);
+    return ret;
+}
+
+int route_remove_all(route_manager_t *mgr) {
+    if (!mgr || !mgr->wg_device) {
+        NB_LOG_ERROR("Invalid route manager");
+        return NB_ERROR_INVALID;
+    }
+
+    int ret = remove_routes(mgr);
+    if (remove_nexthops(mgr) != NB_SUCCESS && ret == NB_SUCCESS) {
+        ret = NB_ERROR_SYSTEM;
+    }
+    if (nft_remove_all(mgr) != NB_SUCCESS && ret == NB_SUCCESS) {
+        ret = NB_ERROR_SYSTEM;
+    }
+    return ret;
+}
+
+/**
+ * Build the desired routes in the shadow table and switch to it
+ *
+ * The rule for the shadow table is added behind the active one (same
+ * priority, later position) and has no effect until the active rule is
+ * deleted; that deletion is the switch. The old table is flushed
+ * afterwards and becomes the next shadow.
+ */
+static int table_rebuild(route_manager_t *mgr, const route_config_t *routes, int count) {
+    uint32_t shadow = mgr->shadow_table;
+    route_batch_t *batch = route_batch_new();
+    struct route_set *built = set_new();
+    int invalid = 0;
+    int ret = NB_SUCCESS;
+
+    if (!batch || !built) {
+        ret = NB_ERROR_SYSTEM;
+        goto out;
+    }
+    for (int i = 0; i < count; i++) {
+        route_op_t op;
+        if (op_init_add(&op, &routes[i]) != NB_SUCCESS) {
+            NB_LOG_ERROR("Invalid route: %s", routes[i].network ? routes[i].network : "(null)");
+            invalid++;
+            continue;
+        }
+        op.table = shadow;
+        if (route_batch_push(batch, &op) < 0) {
+            ret = NB_ERROR_SYSTEM;
+            goto out;
+        }
+    }
+
+    ret = route_batch_commit(mgr, batch);
+    if (ret < 0) {
+        goto out;
+    }
+    for (int i = 0; i < batch->count; i++) {
+        route_entry_t e;
+        if (batch->ops[i].ret != NB_SUCCESS) {
+            continue;
+        }
+        op_entry(&batch->ops[i], &e);
+        if (set_put(built, &e) != NB_SUCCESS) {
+            ret = NB_ERROR_SYSTEM;
+            goto out;
+        }
+    }
 
-/* Helper: Execute shell command and check result */
-static int exec_cmd(const char *cmd) {
-    NB_LOG_DEBUG("Executing: %s", cmd);
-    int ret = system(cmd);
-    if (ret != 0) {
-        NB_LOG_ERROR("Command failed (exit %d): %s", ret, cmd);
+    ret = rule_add(mgr, shadow);
+    if (ret < 0) {
+        goto out;
+    }
+    uint32_t old = mgr->table;
+    rule_del(mgr, old);
+    mgr->table = shadow;
+    mgr->shadow_table = old;
+    set_free(mgr->owned);
+    mgr->owned = built;
+    built = NULL;
+    route_flush_table(mgr, old);
+    mgr->masq_dirty = 1;
+    masq_apply(mgr);
+
+    ret = batch_failures(batch) + invalid;
+    NB_LOG_INFO("Route sync: table %u rebuilt with %u route(s) and switched in, %d failed",
+                shadow, mgr->owned->count, ret);
+
+out:
+    if (ret < 0) {
+        NB_LOG_ERROR("Route sync: rebuilding table %u failed, keeping table %u", shadow, mgr->table);
+        route_flush_table(mgr, shadow);
+    }
+    set_free(built);
+    route_batch_free(batch);
+    return ret;
+}
+
+int route_sync(route_manager_t *mgr, const route_config_t *routes, int count) {
+    if (!mgr || count < 0 || (!routes && count > 0)) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    route_batch_t *batch = route_batch_new();
+    uint8_t *keep = calloc(mgr->owned->count + 1, 1);
+    if (!batch || !keep) {
+        route_batch_free(batch);
+        free(keep);
         return NB_ERROR_SYSTEM;
     }
-    return NB_SUCCESS;
+
+    /* Adds first (make before break), then deletes of what is no longer wanted */
+    int invalid = 0;
+    int unchanged = 0;
+    int ret = NB_SUCCESS;
+    for (int i = 0; i < count && ret == NB_SUCCESS; i++) {
+        route_op_t op;
+        nb_prefix_t dst;
+
+        if (op_init_add(&op, &routes[i]) != NB_SUCCESS) {
+            NB_LOG_ERROR("Invalid route: %s", routes[i].network ? routes[i].network : "(null)");
+            invalid++;
+            continue;
+        }
+        op_prefix(&op, &dst);
+        int idx = set_find(mgr->owned, &dst);
+        if (idx >= 0) {
+            const route_entry_t *e = &mgr->owned->entries[idx];
+            if (e->metric == op.metric) {
+                /* Same kernel key: NLM_F_REPLACE covers any other change */
+                keep[idx] = 1;
+                if (strcmp(e->device, op.device) == 0 && e->masquerade == op.masquerade &&
+                    e->nhid == op.nhid) {
+                    unchanged++;
+                    continue;
+                }
+            }
+        }
+        if (route_batch_push(batch, &op) < 0) {
+            ret = NB_ERROR_SYSTEM;
+        }
+    }
+    int adds = batch->count;
+    for (uint32_t i = 0; i < mgr->owned->count && ret == NB_SUCCESS; i++) {
+        if (!keep[i]) {
+            route_op_t op;
+            op_init_owned_del(&op, &mgr->owned->entries[i]);
+            if (route_batch_push(batch, &op) < 0) {
+                ret = NB_ERROR_SYSTEM;
+            }
+        }
+    }
+    free(keep);
+
+    /* Policy table: any change means a rebuild in the shadow table */
+    if (ret == NB_SUCCESS && batch->count > 0 && mgr->table) {
+        route_batch_free(batch);
+        return table_rebuild(mgr, routes, count);
+    }
+
+    if (ret == NB_SUCCESS && batch->count > 0) {
+        ret = route_batch_commit(mgr, batch);
+    }
+    if (ret >= 0) {
+        ret = batch_failures(batch) + invalid;
+        NB_LOG_INFO("Route sync: %d desired, %d unchanged, %d added/updated, %d removed, %d failed",
+                    count, unchanged, adds, batch->count - adds, ret);
+    }
+    route_batch_free(batch);
+    return ret;
 }
 
-route_manager_t* route_manager_new(const char *wg_device) {
-    if (!wg_device) {
-        NB_LOG_ERROR("Invalid wg_device");
-        return NULL;
+int route_check_drift(route_manager_t *mgr, int *repaired_out) {
+    if (repaired_out) {
+        *repaired_out = 0;
+    }
+    if (!mgr) {
+        return NB_ERROR_INVALID;
+    }
+    if (mgr->backend != ROUTE_BACKEND_NETLINK) {
+        return NB_ERROR;
     }
 
-    route_manager_t *mgr = calloc(1, sizeof(route_manager_t));
+    /* A policy table is useless without its rule */
+    int rules = 0;
+    if (mgr->table) {
+        rules = rule_add(mgr, mgr->table);
+        if (rules > 0) {
+            NB_LOG_WARN("Rule for routing table %u was missing, restored", mgr->table);
+        }
+    }
+
+    /*
+     * Routes cannot come back without their nexthops (members before
+     * groups). A deleted member also silently leaves its groups, so
+     * those are re-applied as well.
+     */
+    int nexthops = 0;
+    uint8_t *restored = calloc(mgr->nexthop_count + 1, 1);
+    for (int i = 0; restored && i < mgr->nexthop_count; i++) {
+        const struct route_nh *nh = &mgr->nexthops[i];
+        int stale = !nh_exists(mgr, nh->id);
+        for (int m = 0; !stale && m < nh->group_count; m++) {
+            int j = nh_find(mgr, nh->group[m].id);
+            stale = j >= 0 && restored[j];
+        }
+        if (stale) {
+            NB_LOG_WARN("Nexthop %u was deleted or changed, restoring", nh->id);
+            if (nh_apply(mgr, nh) == NB_SUCCESS) {
+                restored[i] = 1;
+                nexthops++;
+            }
+        }
+    }
+    free(restored);
+    if (repaired_out) {
+        *repaired_out = (rules > 0 ? rules : 0) + nexthops;
+    }
+
+    drift_ctx_t ctx = {
+        .mgr = mgr,
+        .table = route_table(mgr),
+        .ifindex = (int)if_nametoindex(mgr->wg_device),
+        .seen = calloc(mgr->owned->count + 1, 1),
+        .batch = route_batch_new(),
+    };
+    if (!ctx.seen || !ctx.batch) {
+        free(ctx.seen);
+        route_batch_free(ctx.batch);
+        return NB_ERROR_SYSTEM;
+    }
+
+    /* Only our table's routes with our protocol */
+    int ret = nl_dump_table(mgr, ctx.table, ROUTE_PROTO, drift_route_cb, &ctx);
+    if (ret != NB_SUCCESS) {
+        free(ctx.seen);
+        route_batch_free(ctx.batch);
+        return ret;
+    }
+
+    int strays = ctx.batch->count;
+    for (uint32_t i = 0; i < mgr->owned->count; i++) {
+        if (!ctx.seen[i]) {
+            route_op_t op;
+            op_init_owned_add(&op, &mgr->owned->entries[i]);
+            if (route_batch_push(ctx.batch, &op) < 0) {
+                ret = NB_ERROR_SYSTEM;
+                break;
+            }
+        }
+    }
+    free(ctx.seen);
+
+    if (ret == NB_SUCCESS && ctx.batch->count > 0) {
+        NB_LOG_WARN("Route drift on %s: %d missing, %d stray", mgr->wg_device,
+                    ctx.batch->count - strays, strays);
+        ret = route_batch_commit(mgr, ctx.batch);
+        if (ret >= 0) {
+            int failed = batch_failures(ctx.batch);
+            if (repaired_out) {
+                *repaired_out = ctx.batch->count - failed + (rules > 0 ? rules : 0) + nexthops;
+            }
+            ret = failed ? NB_ERROR_SYSTEM : NB_SUCCESS;
+        }
+    }
+    route_batch_free(ctx.batch);
+    if (ret == NB_SUCCESS && rules < 0) {
+        ret = rules;
+    }
+    return ret;
+}
+
+int route_owned_count(const route_manager_t *mgr) {
+    return mgr ? (int)mgr->owned->count : 0;
+}
+
+int route_monitor_open(route_manager_t *mgr) {
+    static const unsigned int groups[] = {
+        RTNLGRP_IPV4_ROUTE, RTNLGRP_IPV6_ROUTE, RTNLGRP_NEXTHOP,
+        RTNLGRP_IPV4_RULE, RTNLGRP_IPV6_RULE,
+    };
+
     if (!mgr) {
-        NB_LOG_ERROR("calloc failed");
-        return NULL;
+        return NB_ERROR_INVALID;
+    }
+    if (mgr->backend != ROUTE_BACKEND_NETLINK) {
+        return NB_ERROR;
     }
 
-    mgr->wg_device = nb_strdup(wg_device);
-    if (!mgr->wg_device) {
-        free(mgr);
-        return NULL;
+    nb_nl_t *mon = &mgr->nl->monitor;
+    if (mon->fd >= 0) {
+        return mon->fd;
+    }
+    int ret = nb_nl_open(mon, NETLINK_ROUTE);
+    if (ret != NB_SUCCESS) {
+        return ret;
     }
 
-    NB_LOG_INFO("Route manager created for device: %s", wg_device);
-    return mgr;
+    /* The nexthop group needs Linux 5.3; routes alone are still worth watching */
+    for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++) {
+        if (setsockopt(mon->fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &groups[i], sizeof(groups[i])) < 0 &&
+            i < 2) {
+            NB_LOG_ERROR("Failed to join rtnetlink group %u: %s", groups[i], strerror(errno));
+            nb_nl_close(mon);
+            return NB_ERROR_SYSTEM;
+        }
+    }
+    int flags = fcntl(mon->fd, F_GETFL);
+    fcntl(mon->fd, F_SETFL, flags | O_NONBLOCK);
+    return mon->fd;
 }
 
-int route_add(route_manager_t *mgr, const route_config_t *route) {
-    if (!mgr || !route || !route->network) {
+/* Helper: 1 if a route notification does not match what we installed */
+static int monitor_route_event(const route_manager_t *mgr, const struct nlmsghdr *nlh) {
+    const struct rtmsg *rtm = NLMSG_DATA(nlh);
+    const struct nlattr *tb[RTA_MAX + 1];
+
+    if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*rtm))) {
+        return 0;
+    }
+    nb_nl_msg_parse(nlh, sizeof(*rtm), tb, RTA_MAX);
+    if (dumped_table(rtm, tb) != route_table(mgr)) {
+        return 0;
+    }
+
+    nb_prefix_t dst;
+    dumped_dst(rtm, tb, &dst);
+    int idx = set_find(mgr->owned, &dst);
+    uint32_t metric = tb[RTA_PRIORITY] ? nb_nl_attr_get_u32(tb[RTA_PRIORITY]) : 0;
+    if (idx < 0 || mgr->owned->entries[idx].metric != metric) {
+        return 0;
+    }
+
+    /* Deleted, or replaced by something other than the owned route */
+    const route_entry_t *e = &mgr->owned->entries[idx];
+    if (nlh->nlmsg_type == RTM_DELROUTE) {
+        return rtm->rtm_protocol == ROUTE_PROTO;
+    }
+    int oif = tb[RTA_OIF] ? (int)nb_nl_attr_get_u32(tb[RTA_OIF]) : 0;
+    uint32_t nhid = tb[RTA_NH_ID] ? nb_nl_attr_get_u32(tb[RTA_NH_ID]) : 0;
+    return rtm->rtm_protocol != ROUTE_PROTO || e->nhid != nhid || (!nhid && e->ifindex != oif);
+}
+
+/* Helper: 1 if a notification may concern the owned state */
+static int monitor_event(const route_manager_t *mgr, const struct nlmsghdr *nlh) {
+    switch (nlh->nlmsg_type) {
+    case RTM_NEWROUTE:
+    case RTM_DELROUTE:
+        return monitor_route_event(mgr, nlh);
+    case RTM_DELNEXTHOP: {
+        const struct nlattr *tb[NHA_MAX + 1];
+        nb_nl_msg_parse(nlh, sizeof(struct nhmsg), tb, NHA_MAX);
+        return tb[NHA_ID] && nh_find(mgr, nb_nl_attr_get_u32(tb[NHA_ID])) >= 0;
+    }
+    case RTM_DELRULE: {
+        const struct fib_rule_hdr *frh = NLMSG_DATA(nlh);
+        const struct nlattr *tb[FRA_MAX + 1];
+        if (!mgr->table || nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*frh))) {
+            return 0;
+        }
+        nb_nl_msg_parse(nlh, sizeof(*frh), tb, FRA_MAX);
+        return (tb[FRA_TABLE] ? nb_nl_attr_get_u32(tb[FRA_TABLE]) : frh->table) == mgr->table;
+    }
+    }
+    return 0;
+}
+
+int route_monitor_read(route_manager_t *mgr) {
+    if (!mgr || mgr->backend != ROUTE_BACKEND_NETLINK || mgr->nl->monitor.fd < 0) {
+        return NB_ERROR_INVALID;
+    }
+
+    nb_nl_t *mon = &mgr->nl->monitor;
+    uint8_t buf[8192];
+    int changed = 0;
+
+    for (;;) {
+        ssize_t n = recv(mon->fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == ENOBUFS) {
+                /* Notifications were dropped; only a full check can tell */
+                changed = 1;
+                continue;
+            }
+            mon->last_errno = errno;
+            mgr->last_errno = errno;
+            return NB_ERROR_SYSTEM;
+        }
+
+        size_t len = (size_t)n;
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; !changed && NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            changed = monitor_event(mgr, nlh);
+        }
+    }
+    return changed;
+}
+
+void route_monitor_close(route_manager_t *mgr) {
+    if (mgr && mgr->nl) {
+        nb_nl_close(&mgr->nl->monitor);
+    }
+}
+
+uint32_t route_table(const route_manager_t *mgr) {
+    return mgr && mgr->table ? mgr->table : RT_TABLE_MAIN;
+}
+
+int route_flush_table(route_manager_t *mgr, uint32_t table) {
+    if (!mgr || table == RT_TABLE_UNSPEC || table == RT_TABLE_MAIN || table == RT_TABLE_LOCAL) {
         NB_LOG_ERROR("Invalid arguments");
         return NB_ERROR_INVALID;
     }
 
-    const char *device = route->device ? route->device : mgr->wg_device;
-    int metric = route->metric > 0 ? route->metric : 100;
+    if (mgr->backend != ROUTE_BACKEND_NETLINK) {
+        /* 'ip route flush' fails on a table that was never used; check what is left */
+        char cmd[256];
+        snprintf(cmd, sizeof(cmd),
+                 "ip -4 route flush table %u 2>/dev/null; ip -6 route flush table %u 2>/dev/null; "
+                 "test -z \"$(ip -4 route show table %u 2>/dev/null)\"", table, table, table);
+        return exec_cmd(cmd);
+    }
 
-    NB_LOG_INFO("Adding route: %s via %s (metric: %d)", route->network, device, metric);
+    flush_ctx_t ctx = { .table = table, .batch = route_batch_new() };
+    if (!ctx.batch) {
+        return NB_ERROR_SYSTEM;
+    }
+    int ret = nl_dump_table(mgr, table, 0, flush_route_cb, &ctx);
+    if (ret == NB_SUCCESS && ctx.batch->count > 0) {
+        NB_LOG_INFO("Flushing %d route(s) from table %u", ctx.batch->count, table);
+        ret = route_batch_commit(mgr, ctx.batch);
+        if (ret >= 0) {
+            ret = batch_failures(ctx.batch) ? NB_ERROR_SYSTEM : NB_SUCCESS;
+        }
+    }
+    route_batch_free(ctx.batch);
+    return ret;
+}
 
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "ip route add %s dev %s metric %d 2>/dev/null",
-             route->network, device, metric);
+int route_nexthop_set(route_manager_t *mgr, uint32_t id, int family, const char *device) {
+    if (!mgr || id == 0 || (family != AF_INET && family != AF_INET6) ||
+        (device && strlen(device) >= IFNAMSIZ)) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+    int idx = nh_find(mgr, id);
+    if (idx >= 0 && mgr->nexthops[idx].group) {
+        NB_LOG_ERROR("Nexthop %u is a group", id);
+        return NB_ERROR_INVALID;
+    }
 
-    int ret = exec_cmd(cmd);
-    if (ret != NB_SUCCESS) {
-        /* Route might already exist */
-        NB_LOG_WARN("Route add failed (may already exist): %s", route->network);
-        /* Check if route exists */
-        char check_cmd[512];
-        snprintf(check_cmd, sizeof(check_cmd),
-                "ip route show %s | grep -q '%s'", route->network, device);
-        if (system(check_cmd) == 0) {
-            NB_LOG_INFO("Route already exists, continuing");
-            ret = NB_SUCCESS;
+    struct route_nh nh = { .id = id, .family = (uint8_t)family };
+    if (device) {
+        strcpy(nh.device, device);
+    }
+    NB_LOG_INFO("Nexthop %u: dev %s", id, device ? device : mgr->wg_device);
+    return nh_set(mgr, &nh);
+}
+
+int route_nexthop_group_set(route_manager_t *mgr, uint32_t id, const uint32_t *members,
+                            const uint16_t *weights, int count) {
+    if (!mgr || id == 0 || !members || count < 1) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+    int idx = nh_find(mgr, id);
+    if (idx >= 0 && !mgr->nexthops[idx].group) {
+        NB_LOG_ERROR("Nexthop %u is not a group", id);
+        return NB_ERROR_INVALID;
+    }
+
+    struct route_nh nh = { .id = id, .group = calloc(count, sizeof(struct nexthop_grp)),
+                           .group_count = count };
+    if (!nh.group) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    for (int i = 0; i < count; i++) {
+        uint16_t weight = weights ? weights[i] : 1;
+        if (members[i] == 0 || members[i] == id || weight < 1 || weight > 256) {
+            NB_LOG_ERROR("Invalid nexthop group member %u (weight %u)", members[i], weight);
+            free(nh.group);
+            return NB_ERROR_INVALID;
         }
+        nh.group[i].id = members[i];
+        nh.group[i].weight = (uint8_t)(weight - 1);     /* The kernel adds one */
+    }
+    NB_LOG_INFO("Nexthop group %u: %d member(s)", id, count);
+    return nh_set(mgr, &nh);
+}
+
+int route_nexthop_del(route_manager_t *mgr, uint32_t id) {
+    if (!mgr || id == 0) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
     }
 
-    /* Handle masquerading if requested */
-    if (ret == NB_SUCCESS && route->masquerade) {
-        ret = route_enable_masquerade(mgr, device);
+    int ret = nh_delete(mgr, id);
+    if (ret != NB_SUCCESS && ret != NB_ERROR_NOTFOUND) {
+        NB_LOG_ERROR("Nexthop %u delete failed: %s", id, strerror(mgr->last_errno));
+        return ret;
     }
+    nh_drop_routes(mgr, id);
 
+    int idx = nh_find(mgr, id);
+    if (idx >= 0) {
+        free(mgr->nexthops[idx].group);
+        memmove(&mgr->nexthops[idx], &mgr->nexthops[idx + 1],
+                sizeof(struct route_nh) * (mgr->nexthop_count - idx - 1));
+        mgr->nexthop_count--;
+    }
     return ret;
 }
 
-int route_remove(route_manager_t *mgr, const char *network) {
-    if (!mgr || !network) {
+int route_use_table(route_manager_t *mgr, uint32_t table, uint32_t fwmark, uint32_t priority) {
+    if (!mgr || table_reserved(table) || table == UINT32_MAX || table_reserved(table + 1)) {
         NB_LOG_ERROR("Invalid arguments");
         return NB_ERROR_INVALID;
     }
+    if (mgr->table || mgr->owned->count > 0) {
+        NB_LOG_ERROR("Routing table must be selected before routes are installed");
+        return NB_ERROR_INVALID;
+    }
 
-    NB_LOG_INFO("Removing route: %s", network);
+    mgr->fwmark = fwmark;
+    mgr->rule_priority = priority;
 
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "ip route del %s 2>/dev/null", network);
+    /* Leftovers of an earlier run */
+    rule_del(mgr, table);
+    rule_del(mgr, table + 1);
+    route_flush_table(mgr, table);
+    route_flush_table(mgr, table + 1);
 
-    int ret = exec_cmd(cmd);
-    if (ret != NB_SUCCESS) {
-        NB_LOG_WARN("Route removal failed (may not exist): %s", network);
+    int ret = rule_add(mgr, table);
+    if (ret < 0) {
+        mgr->fwmark = 0;
+        mgr->rule_priority = 0;
+        return ret;
     }
+    mgr->table = table;
+    mgr->shadow_table = table + 1;
 
-    return ret;
+    NB_LOG_INFO("Routes for %s go to table %u (shadow %u), rule priority %u, fwmark 0x%x",
+                mgr->wg_device, table, table + 1, priority, fwmark);
+    return NB_SUCCESS;
 }
 
-int route_remove_all(route_manager_t *mgr) {
-    if (!mgr || !mgr->wg_device) {
-        NB_LOG_ERROR("Invalid route manager");
+route_batch_t* route_batch_new(void) {
+    route_batch_t *batch = calloc(1, sizeof(route_batch_t));
+    if (!batch) {
+        NB_LOG_ERROR("calloc failed");
+    }
+    return batch;
+}
+
+int route_batch_add(route_batch_t *batch, const route_config_t *route) {
+    if (!batch || !route) {
         return NB_ERROR_INVALID;
     }
 
-    NB_LOG_INFO("Removing all routes for device: %s", mgr->wg_device);
+    route_op_t op;
+    if (op_init_add(&op, route) != NB_SUCCESS) {
+        NB_LOG_ERROR("Invalid route: %s", route->network ? route->network : "(null)");
+        return NB_ERROR_INVALID;
+    }
+    return route_batch_push(batch, &op);
+}
 
-    /* Get all routes for this device and remove them */
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd),
-            "ip route show dev %s | while read route; do "
-            "ip route del $route dev %s 2>/dev/null; done",
-            mgr->wg_device, mgr->wg_device);
+int route_batch_del(route_batch_t *batch, const char *network) {
+    if (!batch) {
+        return NB_ERROR_INVALID;
+    }
 
-    return exec_cmd(cmd);
+    route_op_t op;
+    if (op_init_del(&op, network) != NB_SUCCESS) {
+        NB_LOG_ERROR("Invalid route network: %s", network ? network : "(null)");
+        return NB_ERROR_INVALID;
+    }
+    return route_batch_push(batch, &op);
 }
 
-int route_enable_masquerade(route_manager_t *mgr, const char *device) {
-    if (!mgr || !device) {
+int route_batch_count(const route_batch_t *batch) {
+    return batch ? batch->count : 0;
+}
+
+int route_batch_commit(route_manager_t *mgr, route_batch_t *batch) {
+    if (!mgr || !batch) {
         NB_LOG_ERROR("Invalid arguments");
         return NB_ERROR_INVALID;
     }
 
-    NB_LOG_INFO("Enabling masquerade for device: %s", device);
-
-    char cmd[512];
+    for (int i = 0; i < batch->count; i++) {
+        route_op_t *op = &batch->ops[i];
+        op->ret = NB_SUCCESS;
+        op->err = 0;
+        if (op->type == RTM_NEWROUTE) {
+            op->ifindex = 0;    /* Re-resolved: the device may have been recreated */
+        }
+        op_claim(mgr, op);
+    }
 
-    /* Add iptables NAT rule */
-    snprintf(cmd, sizeof(cmd),
-            "iptables -t nat -C POSTROUTING -o %s -j MASQUERADE 2>/dev/null || "
-            "iptables -t nat -A POSTROUTING -o %s -j MASQUERADE",
-            device, device);
+    int ret = NB_SUCCESS;
+    if (mgr->backend == ROUTE_BACKEND_NETLINK) {
+        ret = nl_batch_commit(mgr, batch);
+    } else {
+        for (int i = 0; i < batch->count; i++) {
+            shell_op(mgr, &batch->ops[i]);
+        }
+    }
 
-    int ret = exec_cmd(cmd);
+    /* Ops that never reached the kernel carry the socket error and are not tracked */
+    for (int i = 0; i < batch->count; i++) {
+        op_track(mgr, &batch->ops[i]);
+    }
     if (ret != NB_SUCCESS) {
-        NB_LOG_ERROR("Failed to enable masquerade for %s", device);
+        mgr->last_errno = nb_nl_last_errno(&mgr->nl->rtnl);
+        NB_LOG_ERROR("Route batch aborted: %s", strerror(mgr->last_errno));
         return ret;
     }
 
-    /* Enable IP forwarding */
-    ret = exec_cmd("sysctl -w net.ipv4.ip_forward=1 >/dev/null");
-    if (ret != NB_SUCCESS) {
-        NB_LOG_WARN("Failed to enable IP forwarding");
+    int failed = 0;
+    for (int i = 0; i < batch->count; i++) {
+        route_op_t *op = &batch->ops[i];
+        if (op->ret != NB_SUCCESS && failed++ == 0) {
+            mgr->last_errno = op->err;
+            NB_LOG_ERROR("Route batch: operation %d failed: %s", i,
+                         op->err ? strerror(op->err) : "command failed");
+        }
     }
 
-    return NB_SUCCESS;
+    /* All masquerade changes of the batch in one update */
+    int masq = masq_apply(mgr);
+    for (int i = 0; masq != NB_SUCCESS && i < batch->count; i++) {
+        route_op_t *op = &batch->ops[i];
+        if (op->type == RTM_NEWROUTE && op->masquerade && op->ret == NB_SUCCESS) {
+            op->ret = masq;
+            failed++;
+        }
+    }
+
+    NB_LOG_INFO("Route batch: %d operation(s), %d failed", batch->count, failed);
+    return failed;
+}
+
+int route_batch_result(const route_batch_t *batch, int index, int *errno_out) {
+    if (!batch || index < 0 || index >= batch->count) {
+        return NB_ERROR_INVALID;
+    }
+    if (errno_out) {
+        *errno_out = batch->ops[index].err;
+    }
+    return batch->ops[index].ret;
+}
+
+void route_batch_clear(route_batch_t *batch) {
+    if (batch) {
+        batch->count = 0;
+    }
+}
+
+void route_batch_free(route_batch_t *batch) {
+    if (!batch) return;
+
+    free(batch->ops);
+    free(batch);
+}
+
+int route_last_errno(const route_manager_t *mgr) {
+    return mgr ? mgr->last_errno : 0;
+}
+
+int route_enable_masquerade(route_manager_t *mgr, const char *device) {
+    if (!mgr || !device || !device[0] || strlen(device) >= IFNAMSIZ) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    NB_LOG_INFO("Enabling masquerade for device: %s", device);
+
+    if (masq_device_find(mgr, device) < 0) {
+        char **devices = realloc(mgr->masq_devices, (mgr->masq_device_count + 1) * sizeof(*devices));
+        if (!devices) {
+            return NB_ERROR_SYSTEM;
+        }
+        mgr->masq_devices = devices;
+        devices[mgr->masq_device_count] = nb_strdup(device);
+        if (!devices[mgr->masq_device_count]) {
+            return NB_ERROR_SYSTEM;
+        }
+        mgr->masq_device_count++;
+    }
+    mgr->masq_dirty = 1;
+    return masq_apply(mgr);
 }
 
 int route_disable_masquerade(route_manager_t *mgr, const char *device) {
@@ -159,17 +2087,89 @@ int route_disable_masquerade(route_manager_t *mgr, const char *device) {
 
     NB_LOG_INFO("Disabling masquerade for device: %s", device);
 
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd),
-            "iptables -t nat -D POSTROUTING -o %s -j MASQUERADE 2>/dev/null",
-            device);
+    int idx = masq_device_find(mgr, device);
+    if (idx >= 0) {
+        free(mgr->masq_devices[idx]);
+        mgr->masq_devices[idx] = mgr->masq_devices[--mgr->masq_device_count];
+    }
+    if (mgr->backend == ROUTE_BACKEND_SHELL || mgr->nft_failed) {
+        return masq_iptables("-D", device);
+    }
+    mgr->masq_dirty = 1;
+    return masq_apply(mgr);
+}
 
-    return exec_cmd(cmd);
+int route_enable_offload(route_manager_t *mgr, const char *const *devices, int count) {
+    if (!mgr || count < 0 || (count > 0 && !devices) || count >= NB_NFT_OFFLOAD_MAX) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+    if (mgr->backend == ROUTE_BACKEND_SHELL) {
+        NB_LOG_ERROR("Flowtable offload needs the netlink backend");
+        return NB_ERROR_SYSTEM;
+    }
+
+    /* The WireGuard device first, egress devices once each */
+    const char *all[NB_NFT_OFFLOAD_MAX];
+    int n = 0;
+    all[n++] = mgr->wg_device;
+    for (int i = 0; i < count; i++) {
+        int seen = !devices[i];
+        for (int j = 0; j < n && !seen; j++) {
+            seen = strcmp(all[j], devices[i]) == 0;
+        }
+        if (!seen) {
+            all[n++] = devices[i];
+        }
+    }
+
+    if (!nft_handle(mgr)) {
+        NB_LOG_ERROR("nftables not available");
+        return NB_ERROR_SYSTEM;
+    }
+    int ret = nb_nft_offload_set(mgr->nft, all, n);
+    if (ret == NB_SUCCESS) {
+        NB_LOG_INFO("Flowtable offload enabled on %s and %d egress device(s)", mgr->wg_device, n - 1);
+    }
+    return ret;
+}
+
+int route_disable_offload(route_manager_t *mgr) {
+    if (!mgr) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+    if (!mgr->nft || !mgr->nft->offload_ready) {
+        return NB_SUCCESS;
+    }
+
+    int ret = nb_nft_offload_set(mgr->nft, NULL, 0);
+    if (ret == NB_SUCCESS) {
+        NB_LOG_INFO("Flowtable offload disabled");
+        if (!mgr->nft->masq_ready) {
+            nft_release(mgr);
+        }
+    }
+    return ret;
 }
 
 void route_manager_free(route_manager_t *mgr) {
     if (!mgr) return;
 
+    route_nl_close(mgr->nl);
+    if (mgr->nft) {
+        nb_nft_close(mgr->nft);
+        free(mgr->nft);
+    }
+    for (int i = 0; i < mgr->masq_device_count; i++) {
+        free(mgr->masq_devices[i]);
+    }
+    free(mgr->masq_devices);
+    set_free(mgr->owned);
+    for (int i = 0; i < mgr->nexthop_count; i++) {
+        free(mgr->nexthops[i].group);
+    }
+    free(mgr->nexthops);
     free(mgr->wg_device);
     free(mgr);
 }
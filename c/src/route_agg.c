@@ -0,0 +1,419 @@
+/**
+ * route_agg.c - CIDR aggregation of route lists
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "route_agg.h"
+#include "common.h"
+#include "ipaddr.h"
+#include "lpm.h"
+
+/* One parsed original route */
+typedef struct {
+    nb_prefix_t prefix;         /* Normalized */
+    const char *device;         /* Group key: device (NULL = manager default) ... */
+    int metric;                 /* ... metric (<= 0 = default) ... */
+    int masquerade;             /* ... masquerade flag ... */
+    uint32_t nhid;              /* ... and nexthop object */
+    int group;
+    int orig;                   /* Index in the original list */
+    int isolated;               /* Inside another group's prefix: passed through */
+} agg_item_t;
+
+struct route_agg {
+    route_config_t *routes;     /* Output routes */
+    nb_prefix_t *prefixes;      /* Their prefixes */
+    char (*networks)[NB_PREFIX_STRLEN];
+    int count;
+
+    char **devices;             /* Device copies, one per group (NULL for none) */
+    int ngroups;
+
+    int *target;                /* Original index -> output index */
+    int input;
+    int *src_off;               /* Output index -> sources (count + 1 offsets) */
+    int *src;
+
+    route_agg_stats_t stats;
+};
+
+static int group_cmp(const agg_item_t *a, const agg_item_t *b) {
+    if (a->device != b->device) {
+        if (!a->device) return -1;
+        if (!b->device) return 1;
+        int c = strcmp(a->device, b->device);
+        if (c != 0) return c;
+    }
+    if (a->metric != b->metric) {
+        return a->metric < b->metric ? -1 : 1;
+    }
+    if (a->nhid != b->nhid) {
+        return a->nhid < b->nhid ? -1 : 1;
+    }
+    return a->masquerade - b->masquerade;
+}
+
+/* Sort by group, then prefix (address, shorter first) */
+static int item_cmp(const void *pa, const void *pb) {
+    const agg_item_t *a = pa;
+    const agg_item_t *b = pb;
+    int c = group_cmp(a, b);
+    return c != 0 ? c : nb_prefix_cmp(&a->prefix, &b->prefix);
+}
+
+/* Sort item pointers by prefix only */
+static int item_prefix_cmp(const void *pa, const void *pb) {
+    const agg_item_t *a = *(const agg_item_t * const *)pa;
+    const agg_item_t *b = *(const agg_item_t * const *)pb;
+    int c = nb_prefix_cmp(&a->prefix, &b->prefix);
+    return c != 0 ? c : a->group - b->group;
+}
+
+/* Is b the upper half of the parent whose lower half is a? */
+static int is_sibling(const nb_prefix_t *a, const nb_prefix_t *b) {
+    if (a->family != b->family || a->len != b->len || a->len == 0) {
+        return 0;
+    }
+
+    int bit = a->len - 1;
+    uint8_t mask = (uint8_t)(0x80 >> (bit % 8));
+    if ((a->addr[bit / 8] & mask) || !(b->addr[bit / 8] & mask)) {
+        return 0;
+    }
+
+    nb_prefix_t parent = *b;
+    parent.addr[bit / 8] &= (uint8_t)~mask;
+    return memcmp(parent.addr, a->addr, sizeof(a->addr)) == 0;
+}
+
+/*
+ * Mark items that lie inside a prefix of another group: exact duplicates
+ * across groups first (the trie keeps one owner per prefix), then
+ * everything nb_lpm_check() reports as covered.
+ *
+ * Dropping or merging any other item is safe: a dropped item has no
+ * other-group prefix between it and the route that now carries it, and a
+ * merged parent cannot equal or sit inside another group's prefix, since
+ * both halves would then have been covered. Other-group prefixes inside
+ * an output are more specific and keep winning the lookup.
+ */
+static int mark_isolated(agg_item_t *items, int n) {
+    agg_item_t **by_prefix = malloc(sizeof(agg_item_t *) * n);
+    nb_prefix_t *prefixes = malloc(sizeof(nb_prefix_t) * n);
+    uint32_t *values = malloc(sizeof(uint32_t) * n);
+    nb_lpm_t *lpm = nb_lpm_new();
+    int ret = NB_ERROR_SYSTEM;
+
+    if (!by_prefix || !prefixes || !values || !lpm) {
+        NB_LOG_ERROR("Failed to allocate aggregation index");
+        goto out;
+    }
+
+    for (int i = 0; i < n; i++) {
+        by_prefix[i] = &items[i];
+    }
+    qsort(by_prefix, n, sizeof(*by_prefix), item_prefix_cmp);
+    for (int i = 0; i < n; ) {
+        int j = i + 1;
+        while (j < n && nb_prefix_cmp(&by_prefix[i]->prefix, &by_prefix[j]->prefix) == 0) {
+            j++;
+        }
+        if (by_prefix[i]->group != by_prefix[j - 1]->group) {
+            for (int k = i; k < j; k++) {
+                by_prefix[k]->isolated = 1;
+            }
+        }
+        i = j;
+    }
+
+    for (int i = 0; i < n; i++) {
+        prefixes[i] = items[i].prefix;
+        /* A prefix shared by several groups belongs to none of them */
+        values[i] = items[i].isolated ? UINT32_MAX : (uint32_t)items[i].group;
+    }
+    if (nb_lpm_build(lpm, prefixes, values, n) != NB_SUCCESS) {
+        goto out;
+    }
+    for (int i = 0; i < n; i++) {
+        nb_lpm_check_t chk;
+        if (items[i].isolated) {
+            continue;
+        }
+        nb_lpm_check(lpm, &items[i].prefix, (uint32_t)items[i].group, &chk);
+        if (chk.kind >= NB_LPM_COVERED) {
+            items[i].isolated = 1;
+        }
+    }
+    ret = NB_SUCCESS;
+
+out:
+    nb_lpm_free(lpm);
+    free(by_prefix);
+    free(prefixes);
+    free(values);
+    return ret;
+}
+
+/* Index of the output in [lo, hi) containing p (outputs sorted and disjoint), or -1 */
+static int find_output(const route_agg_t *agg, int lo, int hi, const nb_prefix_t *p) {
+    int found = -1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (nb_prefix_cmp(&agg->prefixes[mid], p) <= 0) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return found >= 0 && nb_prefix_contains(&agg->prefixes[found], p) ? found : -1;
+}
+
+/* Append an output prefix */
+static int push_output(route_agg_t *agg, const nb_prefix_t *p) {
+    agg->prefixes[agg->count] = *p;
+    return agg->count++;
+}
+
+int route_aggregate(const route_config_t *routes, int count, route_agg_t **agg_out) {
+    if (count < 0 || (!routes && count > 0) || !agg_out) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    route_agg_t *agg = calloc(1, sizeof(route_agg_t));
+    agg_item_t *items = malloc(sizeof(agg_item_t) * (count + 1));
+    if (!agg || !items) {
+        NB_LOG_ERROR("calloc failed");
+        free(agg);
+        free(items);
+        return NB_ERROR_SYSTEM;
+    }
+    agg->input = count;
+    agg->stats.input = count;
+    agg->target = malloc(sizeof(int) * (count + 1));
+    agg->prefixes = malloc(sizeof(nb_prefix_t) * (count + 1));
+    if (!agg->target || !agg->prefixes) {
+        NB_LOG_ERROR("malloc failed");
+        goto fail;
+    }
+
+    /* Parse */
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        agg_item_t *it = &items[n];
+        agg->target[i] = -1;
+        if (!routes[i].network || nb_prefix_parse(routes[i].network, &it->prefix) != NB_SUCCESS) {
+            NB_LOG_WARN("Skipping invalid route network: %s",
+                        routes[i].network ? routes[i].network : "(null)");
+            agg->stats.invalid++;
+            continue;
+        }
+        nb_prefix_normalize(&it->prefix);
+        it->device = routes[i].device;
+        it->metric = routes[i].metric > 0 ? routes[i].metric : 0;
+        it->masquerade = routes[i].masquerade ? 1 : 0;
+        it->nhid = routes[i].nhid;
+        it->orig = i;
+        it->isolated = 0;
+        n++;
+    }
+
+    /* Group */
+    qsort(items, n, sizeof(agg_item_t), item_cmp);
+    int ngroups = 0;
+    for (int i = 0; i < n; i++) {
+        if (i == 0 || group_cmp(&items[i - 1], &items[i]) != 0) {
+            ngroups++;
+        }
+        items[i].group = ngroups - 1;
+    }
+    agg->ngroups = ngroups;
+    agg->devices = calloc(ngroups + 1, sizeof(char *));
+    if (!agg->devices) {
+        NB_LOG_ERROR("calloc failed");
+        goto fail;
+    }
+    if (ngroups > 1 && mark_isolated(items, n) != NB_SUCCESS) {
+        goto fail;
+    }
+
+    /* Aggregate each group: a sorted walk with a stack of disjoint outputs */
+    int *out_group = malloc(sizeof(int) * (n + 1));
+    if (!out_group) {
+        NB_LOG_ERROR("malloc failed");
+        goto fail;
+    }
+    for (int start = 0; start < n; ) {
+        int g = items[start].group;
+        int end = start;
+        while (end < n && items[end].group == g) {
+            end++;
+        }
+        if (items[start].device) {
+            agg->devices[g] = nb_strdup(items[start].device);
+            if (!agg->devices[g]) {
+                free(out_group);
+                goto fail;
+            }
+        }
+
+        int base = agg->count;
+        for (int i = start; i < end; i++) {
+            if (items[i].isolated) {
+                continue;
+            }
+            if (agg->count > base) {
+                const nb_prefix_t *top = &agg->prefixes[agg->count - 1];
+                if (nb_prefix_contains(top, &items[i].prefix)) {
+                    if (top->len == items[i].prefix.len) {
+                        agg->stats.duplicates++;
+                    } else {
+                        agg->stats.covered++;
+                    }
+                    continue;
+                }
+            }
+            push_output(agg, &items[i].prefix);
+            while (agg->count - base >= 2 &&
+                   is_sibling(&agg->prefixes[agg->count - 2], &agg->prefixes[agg->count - 1])) {
+                agg->count--;
+                agg->prefixes[agg->count - 1].len--;
+                agg->stats.merged++;
+            }
+        }
+        int merged_end = agg->count;
+
+        for (int i = start; i < end; i++) {
+            if (items[i].isolated) {
+                agg->stats.isolated++;
+                /* Equal prefixes are adjacent after the sort */
+                if (agg->count > merged_end &&
+                    nb_prefix_cmp(&agg->prefixes[agg->count - 1], &items[i].prefix) == 0) {
+                    agg->stats.duplicates++;
+                    agg->target[items[i].orig] = agg->count - 1;
+                } else {
+                    agg->target[items[i].orig] = push_output(agg, &items[i].prefix);
+                }
+            } else {
+                agg->target[items[i].orig] = find_output(agg, base, merged_end, &items[i].prefix);
+            }
+        }
+        for (int o = base; o < agg->count; o++) {
+            out_group[o] = g;
+        }
+        start = end;
+    }
+
+    /* Output routes */
+    agg->routes = calloc(agg->count + 1, sizeof(route_config_t));
+    agg->networks = calloc(agg->count + 1, NB_PREFIX_STRLEN);
+    agg->src_off = calloc(agg->count + 2, sizeof(int));
+    agg->src = malloc(sizeof(int) * (count + 1));
+    if (!agg->routes || !agg->networks || !agg->src_off || !agg->src) {
+        NB_LOG_ERROR("calloc failed");
+        free(out_group);
+        goto fail;
+    }
+    for (int i = 0; i < n; i++) {
+        const agg_item_t *it = &items[i];
+        route_config_t *r = &agg->routes[agg->target[it->orig]];
+        r->device = agg->devices[it->group];
+        r->metric = it->metric;
+        r->masquerade = it->masquerade;
+        r->nhid = it->nhid;
+    }
+    for (int o = 0; o < agg->count; o++) {
+        nb_prefix_format(&agg->prefixes[o], agg->networks[o], NB_PREFIX_STRLEN);
+        agg->routes[o].network = agg->networks[o];
+    }
+    free(out_group);
+
+    /* Reverse mapping (CSR) */
+    for (int i = 0; i < count; i++) {
+        if (agg->target[i] >= 0) {
+            agg->src_off[agg->target[i] + 1]++;
+        }
+    }
+    for (int o = 0; o < agg->count; o++) {
+        agg->src_off[o + 1] += agg->src_off[o];
+    }
+    int *fill = calloc(agg->count + 1, sizeof(int));
+    if (!fill) {
+        NB_LOG_ERROR("calloc failed");
+        goto fail;
+    }
+    for (int i = 0; i < count; i++) {
+        int o = agg->target[i];
+        if (o >= 0) {
+            agg->src[agg->src_off[o] + fill[o]++] = i;
+        }
+    }
+    free(fill);
+
+    agg->stats.output = agg->count;
+    agg->stats.saved = count - agg->stats.invalid - agg->count;
+    free(items);
+    *agg_out = agg;
+    return NB_SUCCESS;
+
+fail:
+    free(items);
+    route_agg_free(agg);
+    return NB_ERROR_SYSTEM;
+}
+
+const route_config_t* route_agg_routes(const route_agg_t *agg, int *count_out) {
+    if (count_out) {
+        *count_out = agg ? agg->count : 0;
+    }
+    return agg ? agg->routes : NULL;
+}
+
+int route_agg_target(const route_agg_t *agg, int index) {
+    if (!agg || index < 0 || index >= agg->input) {
+        return -1;
+    }
+    return agg->target[index];
+}
+
+int route_agg_sources(const route_agg_t *agg, int index, const int **sources_out) {
+    if (!agg || index < 0 || index >= agg->count) {
+        if (sources_out) *sources_out = NULL;
+        return 0;
+    }
+    if (sources_out) {
+        *sources_out = &agg->src[agg->src_off[index]];
+    }
+    return agg->src_off[index + 1] - agg->src_off[index];
+}
+
+void route_agg_get_stats(const route_agg_t *agg, route_agg_stats_t *out) {
+    if (!out) return;
+
+    if (agg) {
+        *out = agg->stats;
+    } else {
+        memset(out, 0, sizeof(*out));
+    }
+}
+
+void route_agg_free(route_agg_t *agg) {
+    if (!agg) return;
+
+    if (agg->devices) {
+        for (int g = 0; g < agg->ngroups; g++) {
+            free(agg->devices[g]);
+        }
+        free(agg->devices);
+    }
+    free(agg->routes);
+    free(agg->prefixes);
+    free(agg->networks);
+    free(agg->target);
+    free(agg->src_off);
+    free(agg->src);
+    free(agg);
+}
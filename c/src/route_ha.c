@@ -0,0 +1,454 @@
+/**
+ * route_ha.c - HA selection among routing peers that serve the same network
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "route_ha.h"
+#include "common.h"
+
+/* Handshakes renew every REKEY_AFTER_TIME (120 s) plus REKEY_TIMEOUT while traffic flows */
+#define HA_FRESH_S      125
+
+/* Score weights */
+#define HA_W_FRESH      0.2
+#define HA_W_RTT        0.5
+#define HA_W_RATE       0.3
+
+/* Score of a peer whose RTT is not known */
+#define HA_RTT_UNKNOWN  0.5
+
+typedef struct {
+    uint8_t key[WG_KEY_LEN];
+    route_ha_health_t health;
+} ha_peer_t;
+
+typedef struct {
+    char *net_id;
+    int first;                  /* Routes first .. first + count - 1 */
+    int count;
+    int active;                 /* Index into routes, -1 before the first selection */
+    int healthy;
+    double score;
+    int switched;
+    uint64_t switches;
+    int64_t since_ms;           /* Time of the last change */
+} ha_group_t;
+
+struct route_ha {
+    route_ha_params_t params;
+
+    route_ha_route_t *routes;   /* Sorted by network ID, then input order */
+    int route_count;
+
+    ha_group_t *groups;         /* Sorted by network ID */
+    int group_count;
+
+    ha_peer_t *peers;           /* Sorted by key */
+    int peer_count;
+};
+
+/* Per-candidate scratch for route_ha_select() */
+typedef struct {
+    int healthy;
+    double score;
+} ha_eval_t;
+
+static int peer_cmp(const void *pa, const void *pb) {
+    return memcmp(pa, pb, WG_KEY_LEN);
+}
+
+static ha_peer_t* peer_find(const route_ha_t *ha, const uint8_t key[WG_KEY_LEN]) {
+    if (ha->peer_count == 0) {
+        return NULL;
+    }
+    return bsearch(key, ha->peers, ha->peer_count, sizeof(ha_peer_t), peer_cmp);
+}
+
+static ha_group_t* group_find(ha_group_t *groups, int count, const char *net_id) {
+    int lo = 0;
+    int hi = count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int c = strcmp(groups[mid].net_id, net_id);
+        if (c == 0) {
+            return &groups[mid];
+        }
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+static void routes_free(route_ha_route_t *routes, int count) {
+    for (int i = 0; i < count; i++) {
+        free((char *)routes[i].network);
+    }
+    free(routes);
+}
+
+static void groups_free(ha_group_t *groups, int count) {
+    for (int i = 0; i < count; i++) {
+        free(groups[i].net_id);
+    }
+    free(groups);
+}
+
+route_ha_t* route_ha_new(const route_ha_params_t *params) {
+    route_ha_t *ha = calloc(1, sizeof(route_ha_t));
+    if (!ha) {
+        return NULL;
+    }
+    if (params) {
+        ha->params = *params;
+    }
+    if (ha->params.stale_after_s <= 0) {
+        ha->params.stale_after_s = ROUTE_HA_STALE_AFTER_S;
+    }
+    if (ha->params.margin <= 0) {
+        ha->params.margin = ROUTE_HA_MARGIN;
+    }
+    if (ha->params.hold_ms <= 0) {
+        ha->params.hold_ms = ROUTE_HA_HOLD_MS;
+    }
+    return ha;
+}
+
+void route_ha_free(route_ha_t *ha) {
+    if (!ha) {
+        return;
+    }
+    routes_free(ha->routes, ha->route_count);
+    groups_free(ha->groups, ha->group_count);
+    free(ha->peers);
+    free(ha);
+}
+
+/* Input route for sorting by network ID, keeping the input order within an ID */
+typedef struct {
+    const char *net_id;
+    int index;
+} ha_order_t;
+
+static int order_cmp(const void *pa, const void *pb) {
+    const ha_order_t *a = pa;
+    const ha_order_t *b = pb;
+    int c = strcmp(a->net_id, b->net_id);
+    return c != 0 ? c : a->index - b->index;
+}
+
+/* Health table for the peers of a new route set, keeping known values */
+static int peers_rebuild(route_ha_t *ha, const route_ha_route_t *routes, int count) {
+    ha_peer_t *peers = calloc(count > 0 ? count : 1, sizeof(ha_peer_t));
+    if (!peers) {
+        return NB_ERROR_SYSTEM;
+    }
+    for (int i = 0; i < count; i++) {
+        memcpy(peers[i].key, routes[i].peer, WG_KEY_LEN);
+    }
+    qsort(peers, count, sizeof(ha_peer_t), peer_cmp);
+
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (n > 0 && memcmp(peers[n - 1].key, peers[i].key, WG_KEY_LEN) == 0) {
+            continue;
+        }
+        peers[n] = peers[i];
+        const ha_peer_t *old = peer_find(ha, peers[n].key);
+        if (old) {
+            peers[n].health = old->health;
+        }
+        n++;
+    }
+
+    free(ha->peers);
+    ha->peers = peers;
+    ha->peer_count = n;
+    return NB_SUCCESS;
+}
+
+int route_ha_set_routes(route_ha_t *ha, const route_ha_route_t *routes, int count) {
+    if (!ha || count < 0 || (count > 0 && !routes)) {
+        return NB_ERROR_INVALID;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!routes[i].net_id || !routes[i].network) {
+            NB_LOG_ERROR("HA route %d has no network ID or network", i);
+            return NB_ERROR_INVALID;
+        }
+    }
+
+    ha_order_t *order = calloc(count > 0 ? count : 1, sizeof(ha_order_t));
+    route_ha_route_t *copy = calloc(count > 0 ? count : 1, sizeof(route_ha_route_t));
+    ha_group_t *groups = calloc(count > 0 ? count : 1, sizeof(ha_group_t));
+    if (!order || !copy || !groups) {
+        free(order);
+        free(copy);
+        free(groups);
+        return NB_ERROR_SYSTEM;
+    }
+    for (int i = 0; i < count; i++) {
+        order[i] = (ha_order_t){ .net_id = routes[i].net_id, .index = i };
+    }
+    qsort(order, count, sizeof(ha_order_t), order_cmp);
+
+    int ngroups = 0;
+    int ok = 1;
+    for (int i = 0; ok && i < count; i++) {
+        const route_ha_route_t *r = &routes[order[i].index];
+        copy[i] = *r;
+        copy[i].network = nb_strdup(r->network);
+        ok = copy[i].network != NULL;
+        if (ngroups == 0 || strcmp(groups[ngroups - 1].net_id, r->net_id) != 0) {
+            ha_group_t *g = &groups[ngroups++];
+            g->net_id = nb_strdup(r->net_id);
+            g->first = i;
+            g->active = -1;
+            ok = ok && g->net_id != NULL;
+        }
+        copy[i].net_id = groups[ngroups - 1].net_id;
+        groups[ngroups - 1].count++;
+    }
+    free(order);
+    if (!ok || peers_rebuild(ha, copy, count) != NB_SUCCESS) {
+        routes_free(copy, count);
+        groups_free(groups, ngroups);
+        return NB_ERROR_SYSTEM;
+    }
+
+    /* Carry over active routes that are still offered */
+    for (int i = 0; i < ngroups; i++) {
+        ha_group_t *g = &groups[i];
+        const ha_group_t *old = group_find(ha->groups, ha->group_count, g->net_id);
+        if (!old || old->active < 0) {
+            continue;
+        }
+        g->switches = old->switches;
+        const route_ha_route_t *prev = &ha->routes[old->active];
+        for (int j = g->first; j < g->first + g->count; j++) {
+            if (strcmp(copy[j].network, prev->network) == 0 &&
+                memcmp(copy[j].peer, prev->peer, WG_KEY_LEN) == 0) {
+                g->active = j;
+                g->healthy = old->healthy;
+                g->score = old->score;
+                g->since_ms = old->since_ms;
+                break;
+            }
+        }
+    }
+
+    routes_free(ha->routes, ha->route_count);
+    groups_free(ha->groups, ha->group_count);
+    ha->routes = copy;
+    ha->route_count = count;
+    ha->groups = groups;
+    ha->group_count = ngroups;
+    return NB_SUCCESS;
+}
+
+int route_ha_set_health(route_ha_t *ha, const uint8_t peer[WG_KEY_LEN],
+                        const route_ha_health_t *health) {
+    if (!ha || !peer || !health) {
+        return NB_ERROR_INVALID;
+    }
+
+    ha_peer_t *p = peer_find(ha, peer);
+    if (!p) {
+        /* Not routed yet: keep it for the next route set */
+        ha_peer_t *peers = realloc(ha->peers, (ha->peer_count + 1) * sizeof(ha_peer_t));
+        if (!peers) {
+            return NB_ERROR_SYSTEM;
+        }
+        ha->peers = peers;
+        int pos = 0;
+        while (pos < ha->peer_count && memcmp(peers[pos].key, peer, WG_KEY_LEN) < 0) {
+            pos++;
+        }
+        memmove(&peers[pos + 1], &peers[pos], (ha->peer_count - pos) * sizeof(ha_peer_t));
+        memcpy(peers[pos].key, peer, WG_KEY_LEN);
+        ha->peer_count++;
+        p = &peers[pos];
+    }
+    p->health = *health;
+    return NB_SUCCESS;
+}
+
+int route_ha_update_from_stats(route_ha_t *ha, const nb_stats_t *stats) {
+    if (!ha || !stats) {
+        return NB_ERROR_INVALID;
+    }
+
+    const nb_peer_rate_t *rates = NULL;
+    int count = nb_stats_rates(stats, &rates);
+    int updated = 0;
+    for (int i = 0; i < count; i++) {
+        ha_peer_t *p = peer_find(ha, rates[i].public_key);
+        if (!p) {
+            continue;
+        }
+        p->health.last_handshake = rates[i].last_handshake;
+        p->health.rate = (uint64_t)(rates[i].rx_rate + rates[i].tx_rate);
+        updated++;
+    }
+    return updated;
+}
+
+/* Healthy and score of every candidate of a group */
+static void group_eval(const route_ha_t *ha, const ha_group_t *g, int64_t now_ms, ha_eval_t *eval) {
+    int64_t now = now_ms / 1000;
+    uint32_t best_rtt = 0;
+    uint64_t max_rate = 0;
+
+    for (int i = 0; i < g->count; i++) {
+        const ha_peer_t *p = peer_find(ha, ha->routes[g->first + i].peer);
+        const route_ha_health_t *h = p ? &p->health : NULL;
+        eval[i].healthy = h && h->last_handshake > 0 &&
+                          now - h->last_handshake <= ha->params.stale_after_s;
+        if (!eval[i].healthy) {
+            continue;
+        }
+        if (h->rtt_ms > 0 && (best_rtt == 0 || h->rtt_ms < best_rtt)) {
+            best_rtt = h->rtt_ms;
+        }
+        if (h->rate > max_rate) {
+            max_rate = h->rate;
+        }
+    }
+
+    for (int i = 0; i < g->count; i++) {
+        eval[i].score = 0;
+        if (!eval[i].healthy) {
+            continue;
+        }
+        const route_ha_health_t *h = &peer_find(ha, ha->routes[g->first + i].peer)->health;
+
+        int64_t age = now - h->last_handshake;
+        double fresh = 1.0;
+        if (age > HA_FRESH_S) {
+            fresh = (double)(ha->params.stale_after_s - age) /
+                    (ha->params.stale_after_s - HA_FRESH_S);
+            fresh = fresh < 0 ? 0 : fresh;
+        }
+        double rtt = h->rtt_ms > 0 ? (double)best_rtt / h->rtt_ms : HA_RTT_UNKNOWN;
+        double rate = max_rate > 0 ? (double)h->rate / max_rate : 1.0;
+        eval[i].score = HA_W_FRESH * fresh + HA_W_RTT * rtt + HA_W_RATE * rate;
+    }
+}
+
+/* Does candidate a rank above b (healthy, then lower metric, then score)? */
+static int ranks_above(const route_ha_route_t *ra, const ha_eval_t *a,
+                       const route_ha_route_t *rb, const ha_eval_t *b) {
+    if (a->healthy != b->healthy) {
+        return a->healthy;
+    }
+    if (ra->metric != rb->metric) {
+        return ra->metric < rb->metric;
+    }
+    return a->score > b->score;
+}
+
+int route_ha_select(route_ha_t *ha, int64_t now_ms) {
+    if (!ha) {
+        return NB_ERROR_INVALID;
+    }
+
+    int max_count = 0;
+    for (int i = 0; i < ha->group_count; i++) {
+        if (ha->groups[i].count > max_count) {
+            max_count = ha->groups[i].count;
+        }
+    }
+    ha_eval_t *eval = calloc(max_count > 0 ? max_count : 1, sizeof(ha_eval_t));
+    if (!eval) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    int changed = 0;
+    for (int i = 0; i < ha->group_count; i++) {
+        ha_group_t *g = &ha->groups[i];
+        group_eval(ha, g, now_ms, eval);
+
+        int best = 0;
+        for (int j = 1; j < g->count; j++) {
+            if (ranks_above(&ha->routes[g->first + j], &eval[j],
+                            &ha->routes[g->first + best], &eval[best])) {
+                best = j;
+            }
+        }
+
+        int cur = g->active - g->first;
+        int next = cur;
+        if (g->active < 0) {
+            next = best;
+        } else if (best != cur && eval[best].healthy) {
+            const route_ha_route_t *rb = &ha->routes[g->first + best];
+            const route_ha_route_t *rc = &ha->routes[g->active];
+            if (!eval[cur].healthy || rb->metric < rc->metric) {
+                /* Failover and management preference apply at once */
+                next = best;
+            } else if (rb->metric == rc->metric &&
+                       eval[best].score >= eval[cur].score + ha->params.margin &&
+                       now_ms - g->since_ms >= ha->params.hold_ms) {
+                next = best;
+            }
+        }
+
+        g->switched = next != cur;
+        if (g->switched) {
+            if (g->active >= 0) {
+                char b64[WG_KEY_B64_LEN];
+                wg_key_to_base64(b64, ha->routes[g->first + next].peer);
+                g->switches++;
+                NB_LOG_INFO("HA network %s: switching to peer %s (score %.2f -> %.2f%s)",
+                            g->net_id, b64, eval[cur].score, eval[next].score,
+                            eval[cur].healthy ? "" : ", active peer unhealthy");
+            }
+            g->active = g->first + next;
+            g->since_ms = now_ms;
+            changed++;
+        }
+        g->healthy = eval[next].healthy;
+        g->score = eval[next].score;
+    }
+
+    free(eval);
+    return changed;
+}
+
+int route_ha_count(const route_ha_t *ha) {
+    return ha ? ha->group_count : 0;
+}
+
+static void selection_fill(const route_ha_t *ha, const ha_group_t *g, route_ha_selection_t *out) {
+    out->net_id = g->net_id;
+    out->active = g->active >= 0 ? &ha->routes[g->active] : NULL;
+    out->healthy = g->healthy;
+    out->score = g->score;
+    out->candidates = g->count;
+    out->switched = g->switched;
+    out->switches = g->switches;
+}
+
+int route_ha_get(const route_ha_t *ha, int index, route_ha_selection_t *out) {
+    if (!ha || !out || index < 0 || index >= ha->group_count) {
+        return NB_ERROR_NOTFOUND;
+    }
+    selection_fill(ha, &ha->groups[index], out);
+    return NB_SUCCESS;
+}
+
+int route_ha_find(const route_ha_t *ha, const char *net_id, route_ha_selection_t *out) {
+    if (!ha || !net_id || !out) {
+        return NB_ERROR_NOTFOUND;
+    }
+    const ha_group_t *g = group_find(ha->groups, ha->group_count, net_id);
+    if (!g) {
+        return NB_ERROR_NOTFOUND;
+    }
+    selection_fill(ha, g, out);
+    return NB_SUCCESS;
+}
@@ -0,0 +1,480 @@
+/**
+ * stats.c - Per-peer statistics sampler with a memory-mapped ring
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "stats.h"
+#include "common.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct nb_stats {
+    int fd;
+    void *map;
+    size_t map_size;
+    nb_stats_header_t *hdr;
+    nb_stats_record_t *records;
+    uint32_t slots;
+    double tau_ms;
+
+    nb_peer_rate_t *rates;          /* Sorted by public key */
+    int rate_count;
+};
+
+struct nb_stats_reader {
+    void *map;
+    size_t map_size;
+    const nb_stats_header_t *hdr;
+    const nb_stats_record_t *records;
+    uint32_t slots;
+};
+
+static size_t file_size(uint32_t slots) {
+    return sizeof(nb_stats_header_t) + (size_t)slots * sizeof(nb_stats_record_t);
+}
+
+static int header_valid(const nb_stats_header_t *hdr, size_t size) {
+    return memcmp(hdr->magic, NB_STATS_MAGIC, sizeof(hdr->magic)) == 0 &&
+           hdr->version == NB_STATS_VERSION &&
+           hdr->record_size == sizeof(nb_stats_record_t) &&
+           hdr->slots > 0 &&
+           size == file_size(hdr->slots);
+}
+
+/*
+ * Copy record n if it is still in the ring. The sequence number is checked
+ * before and after the copy, so a record the writer is replacing is never
+ * returned half-written.
+ */
+static int record_copy(const nb_stats_record_t *records, uint32_t slots, uint64_t head,
+                       uint64_t n, nb_stats_record_t *out) {
+    if (n >= head || head - n > slots) {
+        return NB_ERROR_NOTFOUND;
+    }
+
+    const nb_stats_record_t *rec = &records[n % slots];
+    uint64_t seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+    if (seq != n + 1) {
+        return NB_ERROR_NOTFOUND;
+    }
+    memcpy(out, rec, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != seq) {
+        return NB_ERROR_NOTFOUND;
+    }
+    out->seq = seq;
+    return NB_SUCCESS;
+}
+
+static int key_cmp(const void *a, const void *b) {
+    return memcmp(a, b, WG_KEY_LEN);
+}
+
+static int rate_cmp(const void *a, const void *b) {
+    const nb_peer_rate_t *x = a;
+    const nb_peer_rate_t *y = b;
+    int c = memcmp(x->public_key, y->public_key, WG_KEY_LEN);
+    if (c) return c;
+    /* Newest first */
+    return (y->time_ms > x->time_ms) - (y->time_ms < x->time_ms);
+}
+
+static int peer_ptr_cmp(const void *a, const void *b) {
+    const wg_device_peer_t *x = *(const wg_device_peer_t * const *)a;
+    const wg_device_peer_t *y = *(const wg_device_peer_t * const *)b;
+    return memcmp(x->public_key, y->public_key, WG_KEY_LEN);
+}
+
+/* Rebuild the rate state from the newest record of each peer in the ring */
+static int seed_rates(nb_stats_t *stats) {
+    uint64_t head = stats->hdr->head;
+    uint64_t n = head < stats->slots ? head : stats->slots;
+    if (n == 0) {
+        return NB_SUCCESS;
+    }
+
+    nb_peer_rate_t *rates = malloc(n * sizeof(nb_peer_rate_t));
+    if (!rates) {
+        NB_LOG_ERROR("malloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+
+    int count = 0;
+    for (uint64_t i = head - n; i < head; i++) {
+        nb_stats_record_t rec;
+        if (record_copy(stats->records, stats->slots, head, i, &rec) != NB_SUCCESS) {
+            continue;
+        }
+        nb_peer_rate_t *r = &rates[count++];
+        memcpy(r->public_key, rec.public_key, WG_KEY_LEN);
+        r->time_ms = rec.time_ms;
+        r->last_handshake = rec.last_handshake;
+        r->rx_bytes = rec.rx_bytes;
+        r->tx_bytes = rec.tx_bytes;
+        r->rx_rate = (double)rec.rx_rate;
+        r->tx_rate = (double)rec.tx_rate;
+    }
+
+    /* Keep the newest sample per key */
+    qsort(rates, count, sizeof(nb_peer_rate_t), rate_cmp);
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (kept == 0 || key_cmp(rates[kept - 1].public_key, rates[i].public_key) != 0) {
+            rates[kept++] = rates[i];
+        }
+    }
+
+    stats->rates = rates;
+    stats->rate_count = kept;
+    return NB_SUCCESS;
+}
+
+const char* nb_stats_default_path(const char *ifname, char *buf, size_t size) {
+    snprintf(buf, size, "%s/%s.stats", NB_STATS_DIR, ifname ? ifname : "wtnb0");
+    return buf;
+}
+
+int nb_stats_open(const char *path, uint32_t slots, int tau_ms, nb_stats_t **stats_out) {
+    if (!path || !stats_out || tau_ms < 0) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+    if (slots == 0) {
+        slots = NB_STATS_DEFAULT_SLOTS;
+    }
+
+    /* Create directory if needed */
+    char *dir = nb_strdup(path);
+    char *last_slash = dir ? strrchr(dir, '/') : NULL;
+    if (last_slash && last_slash != dir) {
+        *last_slash = '\0';
+        mkdir(dir, 0755);
+        /* Ignore errors - directory might already exist */
+    }
+    free(dir);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        NB_LOG_ERROR("Failed to open %s: %s", path, strerror(errno));
+        return errno == ENOENT ? NB_ERROR_NOTFOUND : NB_ERROR_SYSTEM;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+        NB_LOG_ERROR("Stats file %s is in use by another process", path);
+        close(fd);
+        return NB_ERROR_EXISTS;
+    }
+
+    size_t size = file_size(slots);
+    nb_stats_header_t hdr;
+    struct stat st;
+    int reuse = fstat(fd, &st) == 0 && (size_t)st.st_size == size &&
+                pread(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr) &&
+                header_valid(&hdr, size);
+
+    if (!reuse && (ftruncate(fd, 0) < 0 || ftruncate(fd, (off_t)size) < 0)) {
+        NB_LOG_ERROR("Failed to size %s: %s", path, strerror(errno));
+        close(fd);
+        return NB_ERROR_SYSTEM;
+    }
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        NB_LOG_ERROR("mmap %s failed: %s", path, strerror(errno));
+        close(fd);
+        return NB_ERROR_SYSTEM;
+    }
+
+    nb_stats_t *stats = calloc(1, sizeof(nb_stats_t));
+    if (!stats) {
+        NB_LOG_ERROR("calloc failed");
+        munmap(map, size);
+        close(fd);
+        return NB_ERROR_SYSTEM;
+    }
+    stats->fd = fd;
+    stats->map = map;
+    stats->map_size = size;
+    stats->hdr = map;
+    stats->records = (nb_stats_record_t *)((uint8_t *)map + sizeof(nb_stats_header_t));
+    stats->slots = slots;
+    stats->tau_ms = tau_ms ? tau_ms : NB_STATS_DEFAULT_TAU_MS;
+
+    if (!reuse) {
+        /* The file was truncated, so all records read as unwritten */
+        memcpy(stats->hdr->magic, NB_STATS_MAGIC, sizeof(stats->hdr->magic));
+        stats->hdr->version = NB_STATS_VERSION;
+        stats->hdr->record_size = sizeof(nb_stats_record_t);
+        stats->hdr->slots = slots;
+        __atomic_store_n(&stats->hdr->head, 0, __ATOMIC_RELEASE);
+        NB_LOG_INFO("Created stats ring %s (%u records)", path, slots);
+    } else if (seed_rates(stats) != NB_SUCCESS) {
+        nb_stats_close(stats);
+        return NB_ERROR_SYSTEM;
+    } else {
+        /* A writer that died inside nb_stats_set_gauges() left them half written */
+        if (stats->hdr->gauges_seq & 1) {
+            memset(&stats->hdr->gauges, 0, sizeof(stats->hdr->gauges));
+            __atomic_store_n(&stats->hdr->gauges_seq, stats->hdr->gauges_seq + 1, __ATOMIC_RELEASE);
+        }
+        NB_LOG_INFO("Reopened stats ring %s (%llu records written, %d peers)", path,
+                    (unsigned long long)stats->hdr->head, stats->rate_count);
+    }
+
+    *stats_out = stats;
+    return NB_SUCCESS;
+}
+
+void nb_stats_close(nb_stats_t *stats) {
+    if (!stats) return;
+
+    munmap(stats->map, stats->map_size);
+    close(stats->fd);
+    free(stats->rates);
+    free(stats);
+}
+
+int nb_stats_sample(nb_stats_t *stats, const wg_device_t *dev, int64_t now_ms) {
+    if (!stats || !dev) {
+        return NB_ERROR_INVALID;
+    }
+
+    int count = dev->peer_count;
+    const wg_device_peer_t **order = malloc((count > 0 ? count : 1) * sizeof(*order));
+    nb_peer_rate_t *rates = malloc((count > 0 ? count : 1) * sizeof(nb_peer_rate_t));
+    if (!order || !rates) {
+        NB_LOG_ERROR("malloc failed");
+        free(order);
+        free(rates);
+        return NB_ERROR_SYSTEM;
+    }
+
+    /* Sort by key and merge with the previous round */
+    for (int i = 0; i < count; i++) {
+        order[i] = &dev->peers[i];
+    }
+    qsort(order, count, sizeof(*order), peer_ptr_cmp);
+
+    int j = 0;
+    for (int i = 0; i < count; i++) {
+        const wg_device_peer_t *p = order[i];
+        nb_peer_rate_t *r = &rates[i];
+
+        while (j < stats->rate_count && key_cmp(stats->rates[j].public_key, p->public_key) < 0) {
+            j++;
+        }
+        const nb_peer_rate_t *prev = j < stats->rate_count &&
+            key_cmp(stats->rates[j].public_key, p->public_key) == 0 ? &stats->rates[j] : NULL;
+
+        memcpy(r->public_key, p->public_key, WG_KEY_LEN);
+        r->time_ms = now_ms;
+        r->last_handshake = p->last_handshake;
+        r->rx_bytes = p->rx_bytes;
+        r->tx_bytes = p->tx_bytes;
+        r->rx_rate = prev ? prev->rx_rate : 0;
+        r->tx_rate = prev ? prev->tx_rate : 0;
+
+        /* Counters going backwards mean the peer was re-created: keep the old rates */
+        if (prev && now_ms > prev->time_ms &&
+            p->rx_bytes >= prev->rx_bytes && p->tx_bytes >= prev->tx_bytes) {
+            double dt_ms = (double)(now_ms - prev->time_ms);
+            double alpha = dt_ms / (stats->tau_ms + dt_ms);
+            double rx = (p->rx_bytes - prev->rx_bytes) * 1000.0 / dt_ms;
+            double tx = (p->tx_bytes - prev->tx_bytes) * 1000.0 / dt_ms;
+            r->rx_rate += alpha * (rx - r->rx_rate);
+            r->tx_rate += alpha * (tx - r->tx_rate);
+        }
+    }
+    free(order);
+
+    /* Append the round; readers see it once head moves */
+    uint64_t head = stats->hdr->head;
+    for (int i = 0; i < count; i++) {
+        const nb_peer_rate_t *r = &rates[i];
+        nb_stats_record_t *rec = &stats->records[head % stats->slots];
+
+        __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        rec->time_ms = now_ms;
+        rec->last_handshake = r->last_handshake;
+        rec->rx_bytes = r->rx_bytes;
+        rec->tx_bytes = r->tx_bytes;
+        rec->rx_rate = (uint64_t)(r->rx_rate + 0.5);
+        rec->tx_rate = (uint64_t)(r->tx_rate + 0.5);
+        memcpy(rec->public_key, r->public_key, WG_KEY_LEN);
+        __atomic_store_n(&rec->seq, head + 1, __ATOMIC_RELEASE);
+        head++;
+    }
+    __atomic_store_n(&stats->hdr->head, head, __ATOMIC_RELEASE);
+
+    free(stats->rates);
+    stats->rates = rates;
+    stats->rate_count = count;
+    return NB_SUCCESS;
+}
+
+int nb_stats_rate(const nb_stats_t *stats, const uint8_t key[WG_KEY_LEN], nb_peer_rate_t *out) {
+    if (!stats || !key || !out) {
+        return NB_ERROR_INVALID;
+    }
+
+    const nb_peer_rate_t *r = stats->rate_count == 0 ? NULL :
+        bsearch(key, stats->rates, stats->rate_count, sizeof(nb_peer_rate_t), key_cmp);
+    if (!r) {
+        return NB_ERROR_NOTFOUND;
+    }
+    *out = *r;
+    return NB_SUCCESS;
+}
+
+int nb_stats_rates(const nb_stats_t *stats, const nb_peer_rate_t **rates_out) {
+    if (!stats || !rates_out) {
+        return 0;
+    }
+    *rates_out = stats->rates;
+    return stats->rate_count;
+}
+
+int nb_stats_reader_open(const char *path, nb_stats_reader_t **reader_out) {
+    if (!path || !reader_out) {
+        return NB_ERROR_INVALID;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? NB_ERROR_NOTFOUND : NB_ERROR_SYSTEM;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(nb_stats_header_t)) {
+        close(fd);
+        return NB_ERROR_INVALID;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        NB_LOG_ERROR("mmap %s failed: %s", path, strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+    if (!header_valid(map, size)) {
+        munmap(map, size);
+        return NB_ERROR_INVALID;
+    }
+
+    nb_stats_reader_t *r = calloc(1, sizeof(nb_stats_reader_t));
+    if (!r) {
+        munmap(map, size);
+        return NB_ERROR_SYSTEM;
+    }
+    r->map = map;
+    r->map_size = size;
+    r->hdr = map;
+    r->records = (const nb_stats_record_t *)((const uint8_t *)map + sizeof(nb_stats_header_t));
+    r->slots = r->hdr->slots;
+
+    *reader_out = r;
+    return NB_SUCCESS;
+}
+
+void nb_stats_reader_close(nb_stats_reader_t *reader) {
+    if (!reader) return;
+
+    munmap(reader->map, reader->map_size);
+    free(reader);
+}
+
+void nb_stats_set_gauges(nb_stats_t *stats, const nb_stats_gauges_t *gauges) {
+    if (!stats || !gauges) return;
+
+    nb_stats_header_t *hdr = stats->hdr;
+    uint32_t seq = hdr->gauges_seq | 1;
+
+    __atomic_store_n(&hdr->gauges_seq, seq, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    hdr->gauges = *gauges;
+    __atomic_store_n(&hdr->gauges_seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+#define GAUGES_TRIES    4096
+
+int nb_stats_reader_gauges(const nb_stats_reader_t *reader, nb_stats_gauges_t *out) {
+    if (!reader || !out) {
+        return NB_ERROR_INVALID;
+    }
+
+    /* The writer holds an odd seq for a struct copy; one that stays odd died there */
+    const nb_stats_header_t *hdr = reader->hdr;
+    for (int tries = 0; tries < GAUGES_TRIES; tries++) {
+        uint32_t before = __atomic_load_n(&hdr->gauges_seq, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        *out = hdr->gauges;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&hdr->gauges_seq, __ATOMIC_RELAXED) == before) {
+            return NB_SUCCESS;
+        }
+    }
+    memset(out, 0, sizeof(*out));
+    return NB_ERROR_TIMEOUT;
+}
+
+uint64_t nb_stats_reader_head(const nb_stats_reader_t *reader) {
+    return reader ? __atomic_load_n(&reader->hdr->head, __ATOMIC_ACQUIRE) : 0;
+}
+
+uint32_t nb_stats_reader_slots(const nb_stats_reader_t *reader) {
+    return reader ? reader->slots : 0;
+}
+
+int nb_stats_reader_get(const nb_stats_reader_t *reader, uint64_t n, nb_stats_record_t *out) {
+    if (!reader || !out) {
+        return NB_ERROR_INVALID;
+    }
+    return record_copy(reader->records, reader->slots, nb_stats_reader_head(reader), n, out);
+}
+
+int nb_stats_reader_last_round(const nb_stats_reader_t *reader, nb_stats_record_t **records_out) {
+    if (!reader || !records_out) {
+        return NB_ERROR_INVALID;
+    }
+    *records_out = NULL;
+
+    uint64_t head = nb_stats_reader_head(reader);
+    nb_stats_record_t last;
+    if (head == 0 || record_copy(reader->records, reader->slots, head, head - 1, &last) != NB_SUCCESS) {
+        return 0;
+    }
+
+    /* Walk back while records belong to the same round */
+    uint64_t first = head - 1;
+    nb_stats_record_t rec;
+    while (first > 0 && head - first < reader->slots &&
+           record_copy(reader->records, reader->slots, head, first - 1, &rec) == NB_SUCCESS &&
+           rec.time_ms == last.time_ms) {
+        first--;
+    }
+
+    int count = (int)(head - first);
+    nb_stats_record_t *records = malloc(count * sizeof(nb_stats_record_t));
+    if (!records) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    int got = 0;
+    for (uint64_t n = first; n < head; n++) {
+        if (record_copy(reader->records, reader->slots, head, n, &records[got]) == NB_SUCCESS) {
+            got++;
+        }
+    }
+
+    *records_out = records;
+    return got;
+}
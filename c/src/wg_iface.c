@@ -1,18 +1,28 @@
 /**
- * wg_iface.c - WireGuard interface management (Quick prototype version)
+ * wg_iface.c - WireGuard interface management
  *
  * Reference: go/iface/iface_new_linux.go, go/iface/device/wg_link_linux.go
  *
- * This is the QUICK PROTOTYPE version that uses shell commands.
- * Production version should use netlink API (libmnl).
+ * Dispatches to the netlink backend (wg_netlink.c), the userspace
+ * datapath (wg_user.c) or the original prototype that shells out to
+ * wg/ip. The backend is chosen per interface from the WgBackend config
+ * setting; "auto" prefers netlink and falls back to userspace when the
+ * wireguard module is missing.
  *
  * Author: Claude
  * Date: 2025-11-30
  */
 
 #include "wg_iface.h"
+#include "wg_netlink.h"
+#include "wg_user.h"
+#include "nft.h"
 #include "common.h"
 #include <sys/stat.h>
+#include <arpa/inet.h>
+
+/* Maximum allowed IPs accepted per update_peer() call */
+#define WG_MAX_ALLOWED_IPS 256
 
 /* Helper: Execute shell command and check result */
 static int exec_cmd(const char *cmd) {
@@ -48,6 +58,318 @@ static int write_temp_file(const char *content, char **path_out) {
     return NB_SUCCESS;
 }
 
+int wg_backend_parse(const char *name, wg_backend_t *backend_out) {
+    if (!backend_out) {
+        return NB_ERROR_INVALID;
+    }
+
+    if (!name || name[0] == '\0' || strcmp(name, "auto") == 0) {
+        *backend_out = WG_BACKEND_AUTO;
+    } else if (strcmp(name, "netlink") == 0) {
+        *backend_out = WG_BACKEND_NETLINK;
+    } else if (strcmp(name, "userspace") == 0) {
+        *backend_out = WG_BACKEND_USERSPACE;
+    } else if (strcmp(name, "shell") == 0) {
+        *backend_out = WG_BACKEND_SHELL;
+    } else {
+        return NB_ERROR_INVALID;
+    }
+    return NB_SUCCESS;
+}
+
+const char* wg_backend_name(wg_backend_t backend) {
+    switch (backend) {
+    case WG_BACKEND_SHELL:   return "shell";
+    case WG_BACKEND_NETLINK: return "netlink";
+    case WG_BACKEND_USERSPACE: return "userspace";
+    default:                 return "auto";
+    }
+}
+
+/*
+ * Helper: resolve the backend on first use
+ *
+ * Returns WG_BACKEND_NETLINK, WG_BACKEND_USERSPACE or WG_BACKEND_SHELL,
+ * or NB_ERROR_* if the requested backend is not available. Both kernel
+ * and userspace devices are managed through iface->nl; for userspace it
+ * only carries rtnetlink.
+ */
+static int resolve_backend(wg_iface_t *iface) {
+    if (iface->backend == WG_BACKEND_SHELL) {
+        return WG_BACKEND_SHELL;
+    }
+    if (iface->nl) {
+        return iface->backend;
+    }
+
+    int ret = NB_ERROR_NOTFOUND;
+    if (iface->backend != WG_BACKEND_USERSPACE) {
+        ret = wg_nl_open(&iface->nl);
+        if (ret == NB_SUCCESS) {
+            iface->backend = WG_BACKEND_NETLINK;
+            return WG_BACKEND_NETLINK;
+        }
+        if (iface->backend == WG_BACKEND_NETLINK) {
+            NB_LOG_ERROR("Netlink backend requested but not available");
+            return ret;
+        }
+    }
+
+    /* No wireguard family: run the datapath ourselves */
+    if (ret == NB_ERROR_NOTFOUND) {
+        ret = wg_nl_open_route(&iface->nl);
+        if (ret == NB_SUCCESS) {
+            if (iface->backend == WG_BACKEND_AUTO) {
+                NB_LOG_WARN("WireGuard kernel module not available, using userspace datapath");
+            }
+            iface->backend = WG_BACKEND_USERSPACE;
+            return WG_BACKEND_USERSPACE;
+        }
+        if (iface->backend == WG_BACKEND_USERSPACE) {
+            NB_LOG_ERROR("Userspace backend requested but rtnetlink is not available");
+            return ret;
+        }
+    }
+
+    NB_LOG_WARN("Netlink backend not available, falling back to wg/ip commands");
+    iface->backend = WG_BACKEND_SHELL;
+    return WG_BACKEND_SHELL;
+}
+
+/* Helper: peer specs to the kernel or userspace device */
+static int apply_specs(wg_iface_t *iface, const wg_peer_spec_t *specs, int count, int *errors) {
+    if (iface->backend == WG_BACKEND_USERSPACE) {
+        if (!iface->user) {
+            NB_LOG_ERROR("Interface %s not created", iface->name);
+            for (int i = 0; errors && i < count; i++) {
+                errors[i] = NB_ERROR_NOTFOUND;
+            }
+            return count;
+        }
+        return wg_user_apply_peers(iface->user, specs, count, errors);
+    }
+    return wg_nl_apply_peers(iface->nl, iface->name, specs, count, errors);
+}
+
+/*
+ * An adopted interface may already carry our key and port; in that case
+ * the device-level WG_CMD_SET_DEVICE / wg set can be skipped.
+ */
+static int adopted_device_matches(wg_iface_t *iface) {
+    uint8_t key[WG_KEY_LEN];
+    wg_device_t *dev = NULL;
+    int match = 0;
+
+    if (wg_key_from_base64(key, iface->private_key) != NB_SUCCESS) {
+        return 0;
+    }
+    if (wg_iface_get_device(iface, &dev) == NB_SUCCESS) {
+        match = wg_key_equal(dev->private_key, key) && dev->listen_port == iface->listen_port;
+        wg_device_free(dev);
+    }
+    memset(key, 0, sizeof(key));
+    return match;
+}
+
+/* Netlink backend: create/adopt link, assign address, set key and port */
+static int nl_create(wg_iface_t *iface) {
+    nb_prefix_t addr;
+    uint8_t key[WG_KEY_LEN];
+    int ret;
+
+    if (nb_prefix_parse(iface->address, &addr) != NB_SUCCESS) {
+        NB_LOG_ERROR("Invalid interface address: %s", iface->address);
+        return NB_ERROR_INVALID;
+    }
+    if (wg_key_from_base64(key, iface->private_key) != NB_SUCCESS) {
+        NB_LOG_ERROR("Invalid private key");
+        return NB_ERROR_INVALID;
+    }
+
+    /* Step 1: Create WireGuard interface */
+    NB_LOG_INFO("Creating WireGuard interface: %s", iface->name);
+    ret = wg_nl_link_add(iface->nl, iface->name);
+    int adopted = ret == NB_ERROR_EXISTS;
+    if (adopted) {
+        NB_LOG_WARN("Interface %s already exists, using it", iface->name);
+    } else if (ret != NB_SUCCESS) {
+        NB_LOG_ERROR("Failed to create link %s: %s", iface->name, strerror(errno));
+        memset(key, 0, sizeof(key));
+        return ret;
+    }
+    iface->created = 1;
+
+    /* Step 2: Assign IP address */
+    NB_LOG_INFO("Assigning IP address: %s", iface->address);
+    ret = wg_nl_addr_add(iface->nl, iface->name, &addr);
+    if (ret != NB_SUCCESS) {
+        /* Address might already be assigned */
+        NB_LOG_WARN("Failed to assign address (may already exist): %s", strerror(errno));
+    }
+
+    /* Step 3: Set private key and listen port */
+    if (adopted && adopted_device_matches(iface)) {
+        NB_LOG_INFO("Key and port already configured, skipping device update");
+        memset(key, 0, sizeof(key));
+        return NB_SUCCESS;
+    }
+    NB_LOG_INFO("Configuring WireGuard (port: %d)", iface->listen_port);
+    ret = wg_nl_set_device(iface->nl, iface->name, key, iface->listen_port);
+    memset(key, 0, sizeof(key));
+    if (ret != NB_SUCCESS) {
+        NB_LOG_ERROR("WG_CMD_SET_DEVICE failed: %s", strerror(errno));
+    }
+    return ret;
+}
+
+/* Userspace backend: create the TUN device and assign the address */
+static int user_create(wg_iface_t *iface) {
+    nb_prefix_t addr;
+    uint8_t key[WG_KEY_LEN];
+
+    if (nb_prefix_parse(iface->address, &addr) != NB_SUCCESS) {
+        NB_LOG_ERROR("Invalid interface address: %s", iface->address);
+        return NB_ERROR_INVALID;
+    }
+    if (wg_key_from_base64(key, iface->private_key) != NB_SUCCESS) {
+        NB_LOG_ERROR("Invalid private key");
+        return NB_ERROR_INVALID;
+    }
+
+    NB_LOG_INFO("Creating userspace WireGuard interface: %s (port: %d)",
+                iface->name, iface->listen_port);
+    int ret = wg_user_open(iface->name, key, iface->listen_port, 0, &iface->user);
+    memset(key, 0, sizeof(key));
+    if (ret != NB_SUCCESS) {
+        NB_LOG_ERROR("Failed to create userspace device %s", iface->name);
+        return ret;
+    }
+    iface->created = 1;
+
+    NB_LOG_INFO("Assigning IP address: %s", iface->address);
+    if (wg_nl_addr_add(iface->nl, iface->name, &addr) != NB_SUCCESS) {
+        NB_LOG_WARN("Failed to assign address (may already exist): %s", strerror(errno));
+    }
+    return NB_SUCCESS;
+}
+
+/* Netlink/userspace backend: add or update one peer */
+static int nl_update_peer(wg_iface_t *iface, const char *peer_pubkey,
+                          const char *allowed_ips, int persistent_keepalive,
+                          const char *endpoint, const char *preshared_key) {
+    wg_peer_spec_t peer = { .keepalive = persistent_keepalive > 0 ? persistent_keepalive : -1 };
+    nb_prefix_t ips[WG_MAX_ALLOWED_IPS];
+
+    if (wg_key_from_base64(peer.public_key, peer_pubkey) != NB_SUCCESS) {
+        NB_LOG_ERROR("Invalid peer public key: %s", peer_pubkey);
+        return NB_ERROR_INVALID;
+    }
+
+    if (allowed_ips) {
+        int n = nb_prefix_parse_list(allowed_ips, ips, WG_MAX_ALLOWED_IPS);
+        if (n < 0) {
+            NB_LOG_ERROR("Invalid allowed IPs: %s", allowed_ips);
+            return NB_ERROR_INVALID;
+        }
+        peer.allowed_ips = ips;
+        peer.allowed_ips_count = n;
+    }
+
+    if (endpoint && nb_endpoint_parse(endpoint, &peer.endpoint) != NB_SUCCESS) {
+        NB_LOG_ERROR("Invalid endpoint: %s", endpoint);
+        return NB_ERROR_INVALID;
+    }
+
+    if (preshared_key) {
+        if (wg_key_from_base64(peer.preshared_key, preshared_key) != NB_SUCCESS) {
+            NB_LOG_ERROR("Invalid pre-shared key");
+            return NB_ERROR_INVALID;
+        }
+        peer.has_preshared_key = 1;
+    }
+
+    int ret = NB_SUCCESS;
+    apply_specs(iface, &peer, 1, &ret);
+    memset(peer.preshared_key, 0, sizeof(peer.preshared_key));
+    if (ret != NB_SUCCESS) {
+        NB_LOG_ERROR("Failed to update peer %s: %s", peer_pubkey, strerror(errno));
+    }
+    return ret;
+}
+
+/* Shell backend: apply one spec through wg_iface_update_peer/remove_peer */
+static int shell_apply_peer(wg_iface_t *iface, const wg_peer_spec_t *spec) {
+    char pubkey[WG_KEY_B64_LEN];
+    wg_key_to_base64(pubkey, spec->public_key);
+
+    if (spec->remove) {
+        return wg_iface_remove_peer(iface, pubkey);
+    }
+
+    char *allowed_ips = NULL;
+    if (spec->allowed_ips) {
+        size_t cap = (size_t)spec->allowed_ips_count * NB_PREFIX_STRLEN + 1;
+        allowed_ips = calloc(1, cap);
+        if (!allowed_ips) {
+            NB_LOG_ERROR("calloc failed");
+            return NB_ERROR_SYSTEM;
+        }
+        size_t pos = 0;
+        for (int i = 0; i < spec->allowed_ips_count; i++) {
+            char buf[NB_PREFIX_STRLEN];
+            pos += snprintf(allowed_ips + pos, cap - pos, "%s%s", i > 0 ? "," : "",
+                            nb_prefix_format(&spec->allowed_ips[i], buf, sizeof(buf)));
+        }
+    }
+
+    char endpoint[NB_ENDPOINT_STRLEN];
+    nb_endpoint_format(&spec->endpoint, endpoint, sizeof(endpoint));
+
+    char psk[WG_KEY_B64_LEN];
+    if (spec->has_preshared_key) {
+        wg_key_to_base64(psk, spec->preshared_key);
+    }
+
+    int ret = wg_iface_update_peer(iface, pubkey, allowed_ips,
+                                   spec->keepalive > 0 ? spec->keepalive : 0,
+                                   endpoint[0] ? endpoint : NULL,
+                                   spec->has_preshared_key ? psk : NULL);
+    memset(psk, 0, sizeof(psk));
+    free(allowed_ips);
+    return ret;
+}
+
+/* Helper: raw rules that keep the tunnel's outer UDP packets out of conntrack */
+static void notrack_enable(wg_iface_t *iface) {
+    char table[64];
+    snprintf(table, sizeof(table), WG_NOTRACK_TABLE_PREFIX "%s", iface->name);
+
+    iface->notrack = calloc(1, sizeof(*iface->notrack));
+    if (!iface->notrack || nb_nft_open_table(iface->notrack, table) != NB_SUCCESS ||
+        nb_nft_notrack_set(iface->notrack, (uint16_t)iface->listen_port) != NB_SUCCESS) {
+        NB_LOG_WARN("Conntrack bypass for UDP port %d not available", iface->listen_port);
+        if (iface->notrack) {
+            nb_nft_close(iface->notrack);
+            free(iface->notrack);
+            iface->notrack = NULL;
+        }
+        return;
+    }
+    NB_LOG_INFO("Conntrack bypass for UDP port %d (table %s)", iface->listen_port, table);
+}
+
+/* Helper: drop the conntrack bypass table */
+static int notrack_disable(wg_iface_t *iface) {
+    if (!iface->notrack) {
+        return NB_SUCCESS;
+    }
+    int ret = nb_nft_table_delete(iface->notrack);
+    nb_nft_close(iface->notrack);
+    free(iface->notrack);
+    iface->notrack = NULL;
+    return ret;
+}
+
 int wg_iface_create(const nb_config_t *cfg, wg_iface_t **iface_out) {
     if (!cfg || !iface_out) {
         NB_LOG_ERROR("Invalid arguments");
@@ -72,8 +394,33 @@ int wg_iface_create(const nb_config_t *cfg, wg_iface_t **iface_out) {
     iface->listen_port = cfg->wg_listen_port > 0 ? cfg->wg_listen_port : 51820;
 
     char cmd[1024];
+    int adopted = 0;
     int ret;
 
+    ret = wg_backend_parse(cfg->wg_backend, &iface->backend);
+    if (ret != NB_SUCCESS) {
+        NB_LOG_ERROR("Unknown WireGuard backend: %s", cfg->wg_backend);
+        goto error;
+    }
+
+    ret = resolve_backend(iface);
+    if (ret < 0) {
+        goto error;
+    }
+    if (ret != WG_BACKEND_SHELL) {
+        ret = ret == WG_BACKEND_NETLINK ? nl_create(iface) : user_create(iface);
+        if (ret != NB_SUCCESS) {
+            goto error;
+        }
+        if (cfg->wg_notrack) {
+            notrack_enable(iface);
+        }
+        *iface_out = iface;
+        NB_LOG_INFO("WireGuard interface %s created successfully (%s)",
+                    iface->name, wg_backend_name(iface->backend));
+        return NB_SUCCESS;
+    }
+
     /* Step 1: Create WireGuard interface */
     NB_LOG_INFO("Creating WireGuard interface: %s", iface->name);
     snprintf(cmd, sizeof(cmd), "ip link add dev %s type wireguard 2>/dev/null", iface->name);
@@ -83,6 +430,7 @@ int wg_iface_create(const nb_config_t *cfg, wg_iface_t **iface_out) {
         snprintf(cmd, sizeof(cmd), "ip link show %s >/dev/null 2>&1", iface->name);
         if (system(cmd) == 0) {
             NB_LOG_WARN("Interface %s already exists, using it", iface->name);
+            adopted = 1;
         } else {
             goto error;
         }
@@ -99,6 +447,16 @@ int wg_iface_create(const nb_config_t *cfg, wg_iface_t **iface_out) {
     }
 
     /* Step 3: Set private key and listen port */
+    if (adopted && adopted_device_matches(iface)) {
+        NB_LOG_INFO("Key and port already configured, skipping wg set");
+        if (cfg->wg_notrack) {
+            notrack_enable(iface);
+        }
+        *iface_out = iface;
+        NB_LOG_INFO("WireGuard interface %s adopted", iface->name);
+        return NB_SUCCESS;
+    }
+
     char *key_file = NULL;
     ret = write_temp_file(iface->private_key, &key_file);
     if (ret != NB_SUCCESS) {
@@ -116,15 +474,22 @@ int wg_iface_create(const nb_config_t *cfg, wg_iface_t **iface_out) {
         goto error;
     }
 
+    if (cfg->wg_notrack) {
+        notrack_enable(iface);
+    }
     *iface_out = iface;
     NB_LOG_INFO("WireGuard interface %s created successfully", iface->name);
     return NB_SUCCESS;
 
 error:
-    if (iface->created) {
-        /* Cleanup: remove interface */
-        snprintf(cmd, sizeof(cmd), "ip link del dev %s", iface->name);
-        system(cmd);
+    if (iface->created && !iface->user) {
+        /* Cleanup: remove interface (wg_iface_free closes a userspace device) */
+        if (iface->nl) {
+            wg_nl_link_del(iface->nl, iface->name);
+        } else {
+            snprintf(cmd, sizeof(cmd), "ip link del dev %s", iface->name);
+            system(cmd);
+        }
     }
     wg_iface_free(iface);
     return ret;
@@ -138,9 +503,17 @@ int wg_iface_up(wg_iface_t *iface) {
 
     NB_LOG_INFO("Bringing up interface: %s", iface->name);
 
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "ip link set dev %s up", iface->name);
-    int ret = exec_cmd(cmd);
+    int ret = resolve_backend(iface);
+    if (ret == WG_BACKEND_NETLINK || ret == WG_BACKEND_USERSPACE) {
+        ret = wg_nl_link_set_up(iface->nl, iface->name, 1);
+        if (ret != NB_SUCCESS) {
+            NB_LOG_ERROR("Failed to set %s up: %s", iface->name, strerror(errno));
+        }
+    } else if (ret == WG_BACKEND_SHELL) {
+        char cmd[256];
+        snprintf(cmd, sizeof(cmd), "ip link set dev %s up", iface->name);
+        ret = exec_cmd(cmd);
+    }
     if (ret == NB_SUCCESS) {
         iface->up = 1;
     }
@@ -155,9 +528,17 @@ int wg_iface_down(wg_iface_t *iface) {
 
     NB_LOG_INFO("Bringing down interface: %s", iface->name);
 
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "ip link set dev %s down", iface->name);
-    int ret = exec_cmd(cmd);
+    int ret = resolve_backend(iface);
+    if (ret == WG_BACKEND_NETLINK || ret == WG_BACKEND_USERSPACE) {
+        ret = wg_nl_link_set_up(iface->nl, iface->name, 0);
+        if (ret != NB_SUCCESS) {
+            NB_LOG_ERROR("Failed to set %s down: %s", iface->name, strerror(errno));
+        }
+    } else if (ret == WG_BACKEND_SHELL) {
+        char cmd[256];
+        snprintf(cmd, sizeof(cmd), "ip link set dev %s down", iface->name);
+        ret = exec_cmd(cmd);
+    }
     if (ret == NB_SUCCESS) {
         iface->up = 0;
     }
@@ -179,6 +560,15 @@ int wg_iface_update_peer(
 
     NB_LOG_INFO("Updating peer: %s (endpoint: %s)", peer_pubkey, endpoint ? endpoint : "none");
 
+    int backend = resolve_backend(iface);
+    if (backend < 0) {
+        return backend;
+    }
+    if (backend != WG_BACKEND_SHELL) {
+        return nl_update_peer(iface, peer_pubkey, allowed_ips, persistent_keepalive,
+                              endpoint, preshared_key);
+    }
+
     char cmd[2048];
     int pos = 0;
 
@@ -217,6 +607,47 @@ int wg_iface_update_peer(
     return exec_cmd(cmd);
 }
 
+int wg_iface_apply_peers(
+    wg_iface_t *iface,
+    const wg_peer_spec_t *specs,
+    int count,
+    int *errors)
+{
+    if (!iface || !iface->name || (!specs && count > 0) || count < 0) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    if (count == 0) {
+        return NB_SUCCESS;
+    }
+
+    int backend = resolve_backend(iface);
+    if (backend < 0) {
+        return backend;
+    }
+
+    int failed = 0;
+    if (backend != WG_BACKEND_SHELL) {
+        failed = apply_specs(iface, specs, count, errors);
+    } else {
+        for (int i = 0; i < count; i++) {
+            int ret = shell_apply_peer(iface, &specs[i]);
+            if (errors) {
+                errors[i] = ret;
+            }
+            if (ret != NB_SUCCESS) {
+                failed++;
+            }
+        }
+    }
+
+    NB_LOG_INFO("Applied %d peer change(s) to %s (%d failed, backend: %s)",
+                count, iface->name, failed, wg_backend_name(iface->backend));
+
+    return failed ? NB_ERROR : NB_SUCCESS;
+}
+
 int wg_iface_remove_peer(wg_iface_t *iface, const char *peer_pubkey) {
     if (!iface || !iface->name || !peer_pubkey) {
         NB_LOG_ERROR("Invalid arguments");
@@ -225,6 +656,24 @@ int wg_iface_remove_peer(wg_iface_t *iface, const char *peer_pubkey) {
 
     NB_LOG_INFO("Removing peer: %s", peer_pubkey);
 
+    int backend = resolve_backend(iface);
+    if (backend < 0) {
+        return backend;
+    }
+    if (backend != WG_BACKEND_SHELL) {
+        wg_peer_spec_t peer = { .remove = 1 };
+        if (wg_key_from_base64(peer.public_key, peer_pubkey) != NB_SUCCESS) {
+            NB_LOG_ERROR("Invalid peer public key: %s", peer_pubkey);
+            return NB_ERROR_INVALID;
+        }
+        int ret = NB_SUCCESS;
+        apply_specs(iface, &peer, 1, &ret);
+        if (ret != NB_SUCCESS) {
+            NB_LOG_ERROR("Failed to remove peer %s: %s", peer_pubkey, strerror(errno));
+        }
+        return ret;
+    }
+
     char cmd[512];
     snprintf(cmd, sizeof(cmd), "wg set %s peer %s remove", iface->name, peer_pubkey);
     return exec_cmd(cmd);
@@ -246,12 +695,28 @@ int wg_iface_destroy(wg_iface_t *iface) {
     }
 
     /* Delete interface */
-    snprintf(cmd, sizeof(cmd), "ip link del dev %s", iface->name);
-    int ret = exec_cmd(cmd);
+    int ret = resolve_backend(iface);
+    if (ret == WG_BACKEND_USERSPACE) {
+        /* The TUN device disappears with its last queue */
+        wg_user_close(iface->user);
+        iface->user = NULL;
+        ret = NB_SUCCESS;
+    } else if (ret == WG_BACKEND_NETLINK) {
+        ret = wg_nl_link_del(iface->nl, iface->name);
+        if (ret != NB_SUCCESS) {
+            NB_LOG_ERROR("Failed to delete %s: %s", iface->name, strerror(errno));
+        }
+    } else if (ret == WG_BACKEND_SHELL) {
+        snprintf(cmd, sizeof(cmd), "ip link del dev %s", iface->name);
+        ret = exec_cmd(cmd);
+    }
 
     if (ret == NB_SUCCESS) {
         iface->created = 0;
     }
+    if (notrack_disable(iface) != NB_SUCCESS) {
+        NB_LOG_WARN("Failed to remove the conntrack bypass for %s", iface->name);
+    }
 
     return ret;
 }
@@ -259,73 +724,183 @@ int wg_iface_destroy(wg_iface_t *iface) {
 void wg_iface_free(wg_iface_t *iface) {
     if (!iface) return;
 
+    wg_user_close(iface->user);
+    wg_nl_close(iface->nl);
+    if (iface->notrack) {
+        nb_nft_close(iface->notrack);
+        free(iface->notrack);
+    }
     free(iface->name);
     free(iface->address);
     free(iface->private_key);
     free(iface);
 }
 
-int wg_get_public_key(const char *private_key, char **public_key_out) {
-    if (!private_key || !public_key_out) {
+/* Shell backend: parse "wg show <iface> dump" */
+static int shell_get_device(wg_iface_t *iface, wg_device_t *dev) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "wg show %s dump", iface->name);
+    NB_LOG_DEBUG("Executing: %s", cmd);
+
+    FILE *fp = popen(cmd, "r");
+    if (!fp) {
+        NB_LOG_ERROR("popen failed: %s", strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+
+    char line[8192];
+    int peer_cap = 0;
+    int first = 1;
+    int ret = NB_SUCCESS;
+
+    snprintf(dev->name, sizeof(dev->name), "%s", iface->name);
+    dev->ifindex = if_nametoindex(iface->name);
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *fields[8] = {0};
+        int n = 0;
+        char *save = NULL;
+        for (char *tok = strtok_r(line, "\t\n", &save); tok && n < 8;
+             tok = strtok_r(NULL, "\t\n", &save)) {
+            fields[n++] = tok;
+        }
+
+        if (first) {
+            /* private-key public-key listen-port fwmark */
+            first = 0;
+            if (n >= 4) {
+                wg_key_from_base64(dev->private_key, fields[0]);
+                wg_key_from_base64(dev->public_key, fields[1]);
+                dev->listen_port = atoi(fields[2]);
+                dev->fwmark = strcmp(fields[3], "off") == 0 ? 0 : (uint32_t)strtoul(fields[3], NULL, 0);
+            }
+            continue;
+        }
+
+        /* public-key psk endpoint allowed-ips handshake rx tx keepalive */
+        if (n < 8) continue;
+
+        if (dev->peer_count == peer_cap) {
+            int cap = peer_cap ? peer_cap * 2 : 16;
+            wg_device_peer_t *peers = realloc(dev->peers, cap * sizeof(wg_device_peer_t));
+            if (!peers) {
+                ret = NB_ERROR_SYSTEM;
+                break;
+            }
+            dev->peers = peers;
+            peer_cap = cap;
+        }
+
+        wg_device_peer_t *peer = &dev->peers[dev->peer_count];
+        memset(peer, 0, sizeof(*peer));
+        if (wg_key_from_base64(peer->public_key, fields[0]) != NB_SUCCESS) continue;
+        if (strcmp(fields[1], "(none)") != 0) {
+            wg_key_from_base64(peer->preshared_key, fields[1]);
+        }
+        if (strcmp(fields[2], "(none)") != 0) {
+            nb_endpoint_parse(fields[2], &peer->endpoint);
+        }
+        if (strcmp(fields[3], "(none)") != 0) {
+            nb_prefix_t ips[WG_MAX_ALLOWED_IPS];
+            int count = nb_prefix_parse_list(fields[3], ips, WG_MAX_ALLOWED_IPS);
+            if (count > 0) {
+                peer->allowed_ips = malloc(count * sizeof(nb_prefix_t));
+                if (peer->allowed_ips) {
+                    memcpy(peer->allowed_ips, ips, count * sizeof(nb_prefix_t));
+                    peer->allowed_ips_count = count;
+                }
+            }
+        }
+        peer->last_handshake = strtoll(fields[4], NULL, 10);
+        peer->rx_bytes = strtoull(fields[5], NULL, 10);
+        peer->tx_bytes = strtoull(fields[6], NULL, 10);
+        peer->keepalive = strcmp(fields[7], "off") == 0 ? 0 : atoi(fields[7]);
+        dev->peer_count++;
+    }
+
+    int status = pclose(fp);
+    if (ret == NB_SUCCESS && status != 0) {
+        NB_LOG_ERROR("Command failed (exit %d): %s", status, cmd);
+        ret = NB_ERROR_SYSTEM;
+    }
+    return ret;
+}
+
+int wg_iface_get_device(wg_iface_t *iface, wg_device_t **dev_out) {
+    if (!iface || !iface->name || !dev_out) {
         NB_LOG_ERROR("Invalid arguments");
         return NB_ERROR_INVALID;
     }
 
-    /* Write private key to temp file */
-    char *priv_file = NULL;
-    int ret = write_temp_file(private_key, &priv_file);
-    if (ret != NB_SUCCESS) {
+    int backend = resolve_backend(iface);
+    if (backend < 0) {
+        return backend;
+    }
+    if (backend == WG_BACKEND_USERSPACE) {
+        if (!iface->user) {
+            NB_LOG_ERROR("Interface %s not created", iface->name);
+            return NB_ERROR_NOTFOUND;
+        }
+        return wg_user_get_device(iface->user, dev_out);
+    }
+    if (backend == WG_BACKEND_NETLINK) {
+        int ret = wg_nl_get_device(iface->nl, iface->name, dev_out);
+        if (ret != NB_SUCCESS) {
+            NB_LOG_ERROR("WG_CMD_GET_DEVICE failed for %s: %s", iface->name, strerror(errno));
+        }
         return ret;
     }
 
-    /* Generate public key */
-    char cmd[512];
-    char pub_file[] = "/tmp/nb-wg-pub-XXXXXX";
-    int fd = mkstemp(pub_file);
-    if (fd < 0) {
-        NB_LOG_ERROR("mkstemp failed: %s", strerror(errno));
-        unlink(priv_file);
-        free(priv_file);
+    wg_device_t *dev = calloc(1, sizeof(wg_device_t));
+    if (!dev) {
+        NB_LOG_ERROR("calloc failed");
         return NB_ERROR_SYSTEM;
     }
-    close(fd);
-
-    snprintf(cmd, sizeof(cmd), "wg pubkey < %s > %s", priv_file, pub_file);
-    ret = exec_cmd(cmd);
-    unlink(priv_file);
-    free(priv_file);
 
+    int ret = shell_get_device(iface, dev);
     if (ret != NB_SUCCESS) {
-        unlink(pub_file);
+        wg_device_free(dev);
         return ret;
     }
 
-    /* Read public key */
-    FILE *f = fopen(pub_file, "r");
-    if (!f) {
-        NB_LOG_ERROR("fopen failed: %s", strerror(errno));
-        unlink(pub_file);
-        return NB_ERROR_SYSTEM;
+    *dev_out = dev;
+    return NB_SUCCESS;
+}
+
+void wg_device_free(wg_device_t *dev) {
+    if (!dev) return;
+
+    for (int i = 0; i < dev->peer_count; i++) {
+        free(dev->peers[i].allowed_ips);
     }
+    free(dev->peers);
 
-    char pubkey[256];
-    if (!fgets(pubkey, sizeof(pubkey), f)) {
-        NB_LOG_ERROR("fgets failed");
-        fclose(f);
-        unlink(pub_file);
-        return NB_ERROR_SYSTEM;
+    /* Device state includes the private key */
+    memset(dev->private_key, 0, sizeof(dev->private_key));
+    free(dev);
+}
+
+int wg_get_public_key(const char *private_key, char **public_key_out) {
+    if (!private_key || !public_key_out) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
     }
-    fclose(f);
-    unlink(pub_file);
 
-    /* Remove trailing newline */
-    size_t len = strlen(pubkey);
-    if (len > 0 && pubkey[len-1] == '\n') {
-        pubkey[len-1] = '\0';
+    uint8_t priv[WG_KEY_LEN];
+    uint8_t pub[WG_KEY_LEN];
+    char pubkey[WG_KEY_B64_LEN];
+
+    if (wg_key_from_base64(priv, private_key) != NB_SUCCESS) {
+        NB_LOG_ERROR("Invalid private key");
+        return NB_ERROR_INVALID;
     }
 
+    wg_key_derive_public(pub, priv);
+    memset(priv, 0, sizeof(priv));
+    wg_key_to_base64(pubkey, pub);
+
     *public_key_out = nb_strdup(pubkey);
-    return NB_SUCCESS;
+    return *public_key_out ? NB_SUCCESS : NB_ERROR_SYSTEM;
 }
 
 int wg_generate_private_key(char **private_key_out) {
@@ -334,47 +909,22 @@ int wg_generate_private_key(char **private_key_out) {
         return NB_ERROR_INVALID;
     }
 
-    char priv_file[] = "/tmp/nb-wg-genkey-XXXXXX";
-    int fd = mkstemp(priv_file);
-    if (fd < 0) {
-        NB_LOG_ERROR("mkstemp failed: %s", strerror(errno));
-        return NB_ERROR_SYSTEM;
-    }
-    close(fd);
+    uint8_t priv[WG_KEY_LEN];
+    char privkey[WG_KEY_B64_LEN];
 
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "wg genkey > %s", priv_file);
-    int ret = exec_cmd(cmd);
+    int ret = wg_key_generate_private(priv);
     if (ret != NB_SUCCESS) {
-        unlink(priv_file);
         return ret;
     }
+    wg_key_to_base64(privkey, priv);
+    memset(priv, 0, sizeof(priv));
 
-    /* Read private key */
-    FILE *f = fopen(priv_file, "r");
-    if (!f) {
-        NB_LOG_ERROR("fopen failed: %s", strerror(errno));
-        unlink(priv_file);
-        return NB_ERROR_SYSTEM;
-    }
-
-    char privkey[256];
-    if (!fgets(privkey, sizeof(privkey), f)) {
-        NB_LOG_ERROR("fgets failed");
-        fclose(f);
-        unlink(priv_file);
+    *private_key_out = nb_strdup(privkey);
+    memset(privkey, 0, sizeof(privkey));
+    if (!*private_key_out) {
         return NB_ERROR_SYSTEM;
     }
-    fclose(f);
-    unlink(priv_file);
 
-    /* Remove trailing newline */
-    size_t len = strlen(privkey);
-    if (len > 0 && privkey[len-1] == '\n') {
-        privkey[len-1] = '\0';
-    }
-
-    *private_key_out = nb_strdup(privkey);
     NB_LOG_INFO("Generated new WireGuard private key");
     return NB_SUCCESS;
 }
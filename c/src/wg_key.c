@@ -0,0 +1,136 @@
+/**
+ * wg_key.c - WireGuard key encoding
+ *
+ * The base64 coder works on fixed 32-byte keys only and avoids table
+ * lookups and data dependent branches, since private keys pass through it.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "wg_key.h"
+#include "common.h"
+#include "curve25519.h"
+#include <sys/random.h>
+
+/* Map a 6-bit value to its base64 character without branches */
+static char encode_6bits(int v) {
+    return (char)(v + 'A'
+                  + (((25 - v) >> 8) & 6)
+                  - (((51 - v) >> 8) & 75)
+                  - (((61 - v) >> 8) & 15)
+                  + (((62 - v) >> 8) & 3));
+}
+
+/* Map a base64 character to its 6-bit value, -1 if invalid */
+static int decode_6bits(int c) {
+    int ret = -1;
+
+    ret += (((('A' - 1) - c) & (c - ('Z' + 1))) >> 8) & (c - 64);
+    ret += (((('a' - 1) - c) & (c - ('z' + 1))) >> 8) & (c - 70);
+    ret += (((('0' - 1) - c) & (c - ('9' + 1))) >> 8) & (c + 5);
+    ret += ((('+' - 1 - c) & (c - ('+' + 1))) >> 8) & 63;
+    ret += ((('/' - 1 - c) & (c - ('/' + 1))) >> 8) & 64;
+    return ret;
+}
+
+void wg_key_to_base64(char b64[WG_KEY_B64_LEN], const uint8_t key[WG_KEY_LEN]) {
+    int i;
+
+    for (i = 0; i < WG_KEY_LEN / 3; i++) {
+        const uint8_t *k = &key[i * 3];
+        b64[i * 4 + 0] = encode_6bits((k[0] >> 2) & 63);
+        b64[i * 4 + 1] = encode_6bits(((k[0] << 4) | (k[1] >> 4)) & 63);
+        b64[i * 4 + 2] = encode_6bits(((k[1] << 2) | (k[2] >> 6)) & 63);
+        b64[i * 4 + 3] = encode_6bits(k[2] & 63);
+    }
+
+    /* Last two bytes: 3 characters + '=' */
+    const uint8_t *k = &key[i * 3];
+    b64[i * 4 + 0] = encode_6bits((k[0] >> 2) & 63);
+    b64[i * 4 + 1] = encode_6bits(((k[0] << 4) | (k[1] >> 4)) & 63);
+    b64[i * 4 + 2] = encode_6bits((k[1] << 2) & 63);
+    b64[i * 4 + 3] = '=';
+    b64[WG_KEY_B64_LEN - 1] = '\0';
+}
+
+int wg_key_from_base64(uint8_t key[WG_KEY_LEN], const char *b64) {
+    if (!key || !b64) {
+        return NB_ERROR_INVALID;
+    }
+
+    if (strlen(b64) != WG_KEY_B64_LEN - 1 || b64[WG_KEY_B64_LEN - 2] != '=') {
+        return NB_ERROR_INVALID;
+    }
+
+    volatile uint8_t bad = 0;
+    int i;
+
+    for (i = 0; i < WG_KEY_LEN / 3; i++) {
+        int val = 0;
+        for (int j = 0; j < 4; j++) {
+            int d = decode_6bits((unsigned char)b64[i * 4 + j]);
+            val |= d << (18 - 6 * j);
+            bad |= (uint8_t)((unsigned)d >> 8);
+        }
+        key[i * 3 + 0] = (uint8_t)(val >> 16);
+        key[i * 3 + 1] = (uint8_t)(val >> 8);
+        key[i * 3 + 2] = (uint8_t)val;
+    }
+
+    int val = 0;
+    for (int j = 0; j < 3; j++) {
+        int d = decode_6bits((unsigned char)b64[i * 4 + j]);
+        val |= d << (18 - 6 * j);
+        bad |= (uint8_t)((unsigned)d >> 8);
+    }
+    key[i * 3 + 0] = (uint8_t)(val >> 16);
+    key[i * 3 + 1] = (uint8_t)(val >> 8);
+
+    /* The two unused low bits of the last character must be zero */
+    bad |= (uint8_t)(val & 0xff);
+
+    if (bad) {
+        memset(key, 0, WG_KEY_LEN);
+        return NB_ERROR_INVALID;
+    }
+    return NB_SUCCESS;
+}
+
+int wg_key_is_zero(const uint8_t key[WG_KEY_LEN]) {
+    volatile uint8_t acc = 0;
+    for (int i = 0; i < WG_KEY_LEN; i++) {
+        acc |= key[i];
+    }
+    return acc == 0;
+}
+
+int wg_key_equal(const uint8_t a[WG_KEY_LEN], const uint8_t b[WG_KEY_LEN]) {
+    volatile uint8_t acc = 0;
+    for (int i = 0; i < WG_KEY_LEN; i++) {
+        acc |= a[i] ^ b[i];
+    }
+    return acc == 0;
+}
+
+int wg_key_generate_private(uint8_t key[WG_KEY_LEN]) {
+    size_t got = 0;
+
+    while (got < WG_KEY_LEN) {
+        ssize_t n = getrandom(key + got, WG_KEY_LEN - got, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            NB_LOG_ERROR("getrandom failed: %s", strerror(errno));
+            memset(key, 0, WG_KEY_LEN);
+            return NB_ERROR_SYSTEM;
+        }
+        got += (size_t)n;
+    }
+
+    curve25519_clamp_secret(key);
+    return NB_SUCCESS;
+}
+
+void wg_key_derive_public(uint8_t pub[WG_KEY_LEN], const uint8_t priv[WG_KEY_LEN]) {
+    curve25519_generate_public(pub, priv);
+}
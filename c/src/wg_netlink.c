@@ -0,0 +1,578 @@
+/**
+ * wg_netlink.c - WireGuard netlink backend
+ *
+ * Reference: go/iface/configurer/kernel_unix.go, wireguard-tools ipc-linux.h
+ *
+ * One persistent rtnetlink socket and one generic netlink socket per
+ * interface; no processes are spawned and keys never touch the disk.
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "wg_netlink.h"
+#include "netlink.h"
+#include "common.h"
+#include <linux/genetlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <linux/wireguard.h>
+#include <linux/time_types.h>
+
+struct wg_nl {
+    nb_nl_t genl;           /* Generic netlink (wireguard family) */
+    nb_nl_t rtnl;           /* rtnetlink (links, addresses) */
+    uint16_t family_id;     /* Resolved "wireguard" family id */
+    nb_nl_buf_t buf;        /* Request buffer, reused for every message */
+};
+
+int wg_nl_open(wg_nl_t **nl_out) {
+    if (!nl_out) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    wg_nl_t *nl = calloc(1, sizeof(wg_nl_t));
+    if (!nl) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    nl->genl.fd = -1;
+    nl->rtnl.fd = -1;
+
+    int ret = nb_nl_open(&nl->genl, NETLINK_GENERIC);
+    if (ret == NB_SUCCESS) {
+        ret = nb_nl_open(&nl->rtnl, NETLINK_ROUTE);
+    }
+    if (ret == NB_SUCCESS) {
+        ret = nb_genl_resolve(&nl->genl, WG_GENL_NAME, &nl->family_id);
+        if (ret == NB_ERROR_NOTFOUND) {
+            NB_LOG_WARN("Generic netlink family '%s' not found (wireguard module not loaded?)",
+                        WG_GENL_NAME);
+        }
+    }
+    if (ret == NB_SUCCESS) {
+        ret = nb_nl_buf_init(&nl->buf, NB_NL_BUFSIZE);
+    }
+
+    if (ret != NB_SUCCESS) {
+        wg_nl_close(nl);
+        return ret;
+    }
+
+    *nl_out = nl;
+    return NB_SUCCESS;
+}
+
+int wg_nl_open_route(wg_nl_t **nl_out) {
+    if (!nl_out) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    wg_nl_t *nl = calloc(1, sizeof(wg_nl_t));
+    if (!nl) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    nl->genl.fd = -1;
+    nl->rtnl.fd = -1;
+
+    int ret = nb_nl_open(&nl->rtnl, NETLINK_ROUTE);
+    if (ret == NB_SUCCESS) {
+        ret = nb_nl_buf_init(&nl->buf, NB_NL_BUFSIZE);
+    }
+    if (ret != NB_SUCCESS) {
+        wg_nl_close(nl);
+        return ret;
+    }
+
+    *nl_out = nl;
+    return NB_SUCCESS;
+}
+
+void wg_nl_close(wg_nl_t *nl) {
+    if (!nl) return;
+
+    nb_nl_close(&nl->genl);
+    nb_nl_close(&nl->rtnl);
+    nb_nl_buf_free(&nl->buf);
+    free(nl);
+}
+
+/* Helper: resolve interface index, NB_ERROR_NOTFOUND if missing */
+static int ifindex_of(const char *ifname, int *index_out) {
+    unsigned int index = if_nametoindex(ifname);
+    if (index == 0) {
+        return NB_ERROR_NOTFOUND;
+    }
+    *index_out = (int)index;
+    return NB_SUCCESS;
+}
+
+int wg_nl_link_add(wg_nl_t *nl, const char *ifname) {
+    nb_nl_buf_t *b = &nl->buf;
+
+    nb_nl_buf_reset(b);
+    nb_nl_msg_begin(b, RTM_NEWLINK, NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL,
+                    nb_nl_next_seq(&nl->rtnl));
+    struct ifinfomsg *ifi = nb_nl_msg_put_header(b, sizeof(*ifi));
+    ifi->ifi_family = AF_UNSPEC;
+
+    nb_nl_attr_put_str(b, IFLA_IFNAME, ifname);
+    struct nlattr *linkinfo = nb_nl_nest_begin(b, IFLA_LINKINFO);
+    nb_nl_attr_put_str(b, IFLA_INFO_KIND, "wireguard");
+    nb_nl_nest_end(b, linkinfo);
+
+    return nb_nl_transact(&nl->rtnl, b, NULL, NULL);
+}
+
+int wg_nl_link_del(wg_nl_t *nl, const char *ifname) {
+    int index;
+    int ret = ifindex_of(ifname, &index);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+
+    nb_nl_buf_t *b = &nl->buf;
+    nb_nl_buf_reset(b);
+    nb_nl_msg_begin(b, RTM_DELLINK, NLM_F_REQUEST, nb_nl_next_seq(&nl->rtnl));
+    struct ifinfomsg *ifi = nb_nl_msg_put_header(b, sizeof(*ifi));
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_index = index;
+
+    return nb_nl_transact(&nl->rtnl, b, NULL, NULL);
+}
+
+int wg_nl_link_set_up(wg_nl_t *nl, const char *ifname, int up) {
+    int index;
+    int ret = ifindex_of(ifname, &index);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+
+    nb_nl_buf_t *b = &nl->buf;
+    nb_nl_buf_reset(b);
+    nb_nl_msg_begin(b, RTM_NEWLINK, NLM_F_REQUEST, nb_nl_next_seq(&nl->rtnl));
+    struct ifinfomsg *ifi = nb_nl_msg_put_header(b, sizeof(*ifi));
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_index = index;
+    ifi->ifi_flags = up ? IFF_UP : 0;
+    ifi->ifi_change = IFF_UP;
+
+    return nb_nl_transact(&nl->rtnl, b, NULL, NULL);
+}
+
+int wg_nl_addr_add(wg_nl_t *nl, const char *ifname, const nb_prefix_t *addr) {
+    int index;
+    int ret = ifindex_of(ifname, &index);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+
+    nb_nl_buf_t *b = &nl->buf;
+    nb_nl_buf_reset(b);
+    nb_nl_msg_begin(b, RTM_NEWADDR, NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL,
+                    nb_nl_next_seq(&nl->rtnl));
+    struct ifaddrmsg *ifa = nb_nl_msg_put_header(b, sizeof(*ifa));
+    ifa->ifa_family = addr->family;
+    ifa->ifa_prefixlen = addr->len;
+    ifa->ifa_scope = RT_SCOPE_UNIVERSE;
+    ifa->ifa_index = (uint32_t)index;
+
+    int alen = nb_prefix_addr_len(addr);
+    nb_nl_attr_put(b, IFA_LOCAL, addr->addr, alen);
+    nb_nl_attr_put(b, IFA_ADDRESS, addr->addr, alen);
+
+    return nb_nl_transact(&nl->rtnl, b, NULL, NULL);
+}
+
+/* Helper: start a WireGuard generic netlink message for ifname */
+static void wg_msg_begin(wg_nl_t *nl, uint8_t cmd, uint16_t flags, const char *ifname) {
+    nb_nl_buf_t *b = &nl->buf;
+
+    nb_nl_buf_reset(b);
+    nb_nl_msg_begin(b, nl->family_id, NLM_F_REQUEST | flags, nb_nl_next_seq(&nl->genl));
+    struct genlmsghdr *genl = nb_nl_msg_put_header(b, GENL_HDRLEN);
+    genl->cmd = cmd;
+    genl->version = WG_GENL_VERSION;
+    nb_nl_attr_put_str(b, WGDEVICE_A_IFNAME, ifname);
+}
+
+int wg_nl_set_device(wg_nl_t *nl, const char *ifname,
+                     const uint8_t *private_key, int listen_port) {
+    nb_nl_buf_t *b = &nl->buf;
+
+    wg_msg_begin(nl, WG_CMD_SET_DEVICE, 0, ifname);
+    if (private_key) {
+        nb_nl_attr_put(b, WGDEVICE_A_PRIVATE_KEY, private_key, WG_KEY_LEN);
+    }
+    if (listen_port >= 0) {
+        nb_nl_attr_put_u16(b, WGDEVICE_A_LISTEN_PORT, (uint16_t)listen_port);
+    }
+
+    int ret = nb_nl_transact(&nl->genl, b, NULL, NULL);
+
+    /* Do not leave the private key in the reused buffer */
+    memset(b->data, 0, b->len);
+    return ret;
+}
+
+/* Helper: append one allowed IP, NB_ERROR if the buffer is full */
+static int put_allowed_ip(nb_nl_buf_t *b, const nb_prefix_t *p) {
+    struct nlattr *ip = nb_nl_nest_begin(b, 0);
+    if (!ip ||
+        nb_nl_attr_put_u16(b, WGALLOWEDIP_A_FAMILY, p->family) != NB_SUCCESS ||
+        nb_nl_attr_put(b, WGALLOWEDIP_A_IPADDR, p->addr, nb_prefix_addr_len(p)) != NB_SUCCESS ||
+        nb_nl_attr_put_u8(b, WGALLOWEDIP_A_CIDR_MASK, p->len) != NB_SUCCESS) {
+        return NB_ERROR;
+    }
+    nb_nl_nest_end(b, ip);
+    return NB_SUCCESS;
+}
+
+/*
+ * Helper: append one peer to an open WGDEVICE_A_PEERS nest
+ *
+ * Allowed IPs are written starting at ip_start until the buffer is full;
+ * *ip_next receives the index of the first IP that was not written.
+ * Returns NB_ERROR if not even the peer header fits.
+ */
+static int put_peer(nb_nl_buf_t *b, const wg_peer_spec_t *peer, int ip_start, int *ip_next) {
+    int first_chunk = ip_start == 0;
+
+    *ip_next = ip_start;
+
+    struct nlattr *p = nb_nl_nest_begin(b, 0);
+    if (!p) {
+        return NB_ERROR;
+    }
+
+    uint32_t flags = 0;
+    if (peer->remove) {
+        flags |= WGPEER_F_REMOVE_ME;
+    } else if (peer->allowed_ips && first_chunk) {
+        flags |= WGPEER_F_REPLACE_ALLOWEDIPS;
+    }
+
+    if (nb_nl_attr_put(b, WGPEER_A_PUBLIC_KEY, peer->public_key, WG_KEY_LEN) != NB_SUCCESS ||
+        nb_nl_attr_put_u32(b, WGPEER_A_FLAGS, flags) != NB_SUCCESS) {
+        return NB_ERROR;
+    }
+
+    if (!peer->remove && first_chunk) {
+        if (peer->has_preshared_key &&
+            nb_nl_attr_put(b, WGPEER_A_PRESHARED_KEY, peer->preshared_key, WG_KEY_LEN) != NB_SUCCESS) {
+            return NB_ERROR;
+        }
+        if (nb_endpoint_len(&peer->endpoint) > 0 &&
+            nb_nl_attr_put(b, WGPEER_A_ENDPOINT, &peer->endpoint,
+                           nb_endpoint_len(&peer->endpoint)) != NB_SUCCESS) {
+            return NB_ERROR;
+        }
+        if (peer->keepalive >= 0 &&
+            nb_nl_attr_put_u16(b, WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL,
+                               (uint16_t)peer->keepalive) != NB_SUCCESS) {
+            return NB_ERROR;
+        }
+    }
+
+    if (!peer->remove && peer->allowed_ips && ip_start < peer->allowed_ips_count) {
+        struct nlattr *ips = nb_nl_nest_begin(b, WGPEER_A_ALLOWEDIPS);
+        if (ips) {
+            int i;
+            for (i = ip_start; i < peer->allowed_ips_count; i++) {
+                size_t mark = b->len;
+                if (put_allowed_ip(b, &peer->allowed_ips[i]) != NB_SUCCESS) {
+                    nb_nl_msg_rollback(b, mark);
+                    break;
+                }
+            }
+            nb_nl_nest_end(b, ips);
+            *ip_next = i;
+        }
+    } else if (peer->allowed_ips) {
+        *ip_next = peer->allowed_ips_count;
+    }
+
+    nb_nl_nest_end(b, p);
+    return NB_SUCCESS;
+}
+
+/* Helper: peer has allowed IPs left to write after ip_next */
+static int peer_incomplete(const wg_peer_spec_t *peer, int ip_next) {
+    return !peer->remove && peer->allowed_ips && ip_next < peer->allowed_ips_count;
+}
+
+int wg_nl_set_peer(wg_nl_t *nl, const char *ifname, const wg_peer_spec_t *peer) {
+    int err = NB_SUCCESS;
+    wg_nl_apply_peers(nl, ifname, peer, 1, &err);
+    return err;
+}
+
+int wg_nl_apply_peers(wg_nl_t *nl, const char *ifname,
+                      const wg_peer_spec_t *specs, int count, int *errors) {
+    nb_nl_buf_t *b = &nl->buf;
+    int *errs = errors;
+    int i = 0;
+    int ip_off = 0;
+
+    if (count <= 0) {
+        return 0;
+    }
+    if (!errs) {
+        errs = calloc(count, sizeof(int));
+        if (!errs) {
+            NB_LOG_ERROR("calloc failed");
+            return count;
+        }
+    }
+    for (int k = 0; k < count; k++) {
+        errs[k] = NB_SUCCESS;
+    }
+
+    while (i < count) {
+        int first = i;
+        int has_secret = 0;
+
+        wg_msg_begin(nl, WG_CMD_SET_DEVICE, 0, ifname);
+        struct nlattr *peers = nb_nl_nest_begin(b, WGDEVICE_A_PEERS);
+
+        int written = 0;
+        int too_big = 0;
+        while (i < count) {
+            size_t mark = b->len;
+            int ip_next;
+
+            int ok = put_peer(b, &specs[i], ip_off, &ip_next) == NB_SUCCESS;
+            if (!ok || (peer_incomplete(&specs[i], ip_next) && ip_next == ip_off)) {
+                /* No room for this peer (or any of its IPs): next message */
+                nb_nl_msg_rollback(b, mark);
+                too_big = written == 0;
+                break;
+            }
+            written++;
+            has_secret |= specs[i].has_preshared_key;
+
+            if (peer_incomplete(&specs[i], ip_next)) {
+                ip_off = ip_next;
+                break;      /* Message full, peer continues in the next one */
+            }
+            ip_off = 0;
+            i++;
+        }
+
+        if (too_big) {
+            NB_LOG_ERROR("Peer %d does not fit in a netlink message", i);
+            errs[i] = NB_ERROR_INVALID;
+            i++;
+            ip_off = 0;
+            continue;
+        }
+        nb_nl_nest_end(b, peers);
+
+        /* Last peer touched by this message (may be partially written) */
+        int last = ip_off > 0 ? i : i - 1;
+
+        int ret = nb_nl_transact(&nl->genl, b, NULL, NULL);
+        if (has_secret) {
+            memset(b->data, 0, b->len);
+        }
+        if (ret == NB_SUCCESS) {
+            continue;
+        }
+
+        if (first == last) {
+            errs[first] = ret;
+        } else {
+            /*
+             * The kernel stops at the first bad peer, earlier peers are
+             * already applied. Replay one by one (idempotent) to find it.
+             */
+            NB_LOG_WARN("Batch of %d peers rejected (%s), retrying individually",
+                        last - first + 1, strerror(errno));
+            for (int k = first; k <= last; k++) {
+                wg_nl_apply_peers(nl, ifname, &specs[k], 1, &errs[k]);
+            }
+        }
+
+        /* A partially sent peer has been handled as a whole */
+        if (ip_off > 0) {
+            i = last + 1;
+            ip_off = 0;
+        }
+    }
+
+    int failed = 0;
+    for (int k = 0; k < count; k++) {
+        if (errs[k] != NB_SUCCESS) failed++;
+    }
+    if (errs != errors) {
+        free(errs);
+    }
+    return failed;
+}
+
+/* Dump state: device being filled in */
+typedef struct {
+    wg_device_t *dev;
+    int peer_cap;
+} dump_ctx_t;
+
+/* Helper: append allowed IPs from a WGPEER_A_ALLOWEDIPS nest */
+static int parse_allowed_ips(const struct nlattr *nest, wg_device_peer_t *peer) {
+    const struct nlattr *a;
+    int n = 0;
+
+    nb_nl_attr_for_each(a, nb_nl_attr_data(nest), nb_nl_attr_len(nest)) {
+        n++;
+    }
+    if (n == 0) {
+        return NB_SUCCESS;
+    }
+
+    nb_prefix_t *ips = realloc(peer->allowed_ips,
+                               (peer->allowed_ips_count + n) * sizeof(nb_prefix_t));
+    if (!ips) {
+        return NB_ERROR_SYSTEM;
+    }
+    peer->allowed_ips = ips;
+
+    nb_nl_attr_for_each(a, nb_nl_attr_data(nest), nb_nl_attr_len(nest)) {
+        const struct nlattr *tb[WGALLOWEDIP_A_MAX + 1];
+        nb_nl_attr_parse(nb_nl_attr_data(a), nb_nl_attr_len(a), tb, WGALLOWEDIP_A_MAX);
+        if (!tb[WGALLOWEDIP_A_FAMILY] || !tb[WGALLOWEDIP_A_IPADDR] || !tb[WGALLOWEDIP_A_CIDR_MASK]) {
+            continue;
+        }
+
+        nb_prefix_t *p = &peer->allowed_ips[peer->allowed_ips_count];
+        memset(p, 0, sizeof(*p));
+        p->family = (uint8_t)nb_nl_attr_get_u16(tb[WGALLOWEDIP_A_FAMILY]);
+        p->len = nb_nl_attr_get_u8(tb[WGALLOWEDIP_A_CIDR_MASK]);
+        size_t alen = nb_nl_attr_len(tb[WGALLOWEDIP_A_IPADDR]);
+        if (alen > sizeof(p->addr)) alen = sizeof(p->addr);
+        memcpy(p->addr, nb_nl_attr_data(tb[WGALLOWEDIP_A_IPADDR]), alen);
+        peer->allowed_ips_count++;
+    }
+    return NB_SUCCESS;
+}
+
+/* Helper: parse one peer nest into the device (coalescing split peers) */
+static int parse_peer(const struct nlattr *nest, dump_ctx_t *ctx) {
+    const struct nlattr *tb[WGPEER_A_MAX + 1];
+    nb_nl_attr_parse(nb_nl_attr_data(nest), nb_nl_attr_len(nest), tb, WGPEER_A_MAX);
+
+    if (!tb[WGPEER_A_PUBLIC_KEY] || nb_nl_attr_len(tb[WGPEER_A_PUBLIC_KEY]) != WG_KEY_LEN) {
+        return NB_SUCCESS;
+    }
+    const uint8_t *key = nb_nl_attr_data(tb[WGPEER_A_PUBLIC_KEY]);
+
+    wg_device_t *dev = ctx->dev;
+    wg_device_peer_t *peer = NULL;
+
+    /* A peer with many allowed IPs continues in the next message */
+    if (dev->peer_count > 0 &&
+        memcmp(dev->peers[dev->peer_count - 1].public_key, key, WG_KEY_LEN) == 0) {
+        peer = &dev->peers[dev->peer_count - 1];
+    } else {
+        if (dev->peer_count == ctx->peer_cap) {
+            int cap = ctx->peer_cap ? ctx->peer_cap * 2 : 16;
+            wg_device_peer_t *peers = realloc(dev->peers, cap * sizeof(wg_device_peer_t));
+            if (!peers) {
+                return NB_ERROR_SYSTEM;
+            }
+            dev->peers = peers;
+            ctx->peer_cap = cap;
+        }
+        peer = &dev->peers[dev->peer_count++];
+        memset(peer, 0, sizeof(*peer));
+        memcpy(peer->public_key, key, WG_KEY_LEN);
+    }
+
+    if (tb[WGPEER_A_PRESHARED_KEY] && nb_nl_attr_len(tb[WGPEER_A_PRESHARED_KEY]) == WG_KEY_LEN) {
+        memcpy(peer->preshared_key, nb_nl_attr_data(tb[WGPEER_A_PRESHARED_KEY]), WG_KEY_LEN);
+    }
+    if (tb[WGPEER_A_ENDPOINT]) {
+        size_t len = nb_nl_attr_len(tb[WGPEER_A_ENDPOINT]);
+        if (len > sizeof(peer->endpoint)) len = sizeof(peer->endpoint);
+        memcpy(&peer->endpoint, nb_nl_attr_data(tb[WGPEER_A_ENDPOINT]), len);
+    }
+    if (tb[WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL]) {
+        peer->keepalive = nb_nl_attr_get_u16(tb[WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL]);
+    }
+    if (tb[WGPEER_A_LAST_HANDSHAKE_TIME] &&
+        nb_nl_attr_len(tb[WGPEER_A_LAST_HANDSHAKE_TIME]) == sizeof(struct __kernel_timespec)) {
+        struct __kernel_timespec ts;
+        memcpy(&ts, nb_nl_attr_data(tb[WGPEER_A_LAST_HANDSHAKE_TIME]), sizeof(ts));
+        peer->last_handshake = ts.tv_sec;
+    }
+    if (tb[WGPEER_A_RX_BYTES]) {
+        peer->rx_bytes = nb_nl_attr_get_u64(tb[WGPEER_A_RX_BYTES]);
+    }
+    if (tb[WGPEER_A_TX_BYTES]) {
+        peer->tx_bytes = nb_nl_attr_get_u64(tb[WGPEER_A_TX_BYTES]);
+    }
+    if (tb[WGPEER_A_ALLOWEDIPS]) {
+        return parse_allowed_ips(tb[WGPEER_A_ALLOWEDIPS], peer);
+    }
+    return NB_SUCCESS;
+}
+
+/* Callback: one WG_CMD_GET_DEVICE dump message */
+static int get_device_cb(const struct nlmsghdr *nlh, void *arg) {
+    dump_ctx_t *ctx = arg;
+    wg_device_t *dev = ctx->dev;
+    const struct nlattr *tb[WGDEVICE_A_MAX + 1];
+
+    nb_nl_msg_parse(nlh, GENL_HDRLEN, tb, WGDEVICE_A_MAX);
+
+    if (tb[WGDEVICE_A_IFINDEX]) {
+        dev->ifindex = nb_nl_attr_get_u32(tb[WGDEVICE_A_IFINDEX]);
+    }
+    if (tb[WGDEVICE_A_IFNAME]) {
+        snprintf(dev->name, sizeof(dev->name), "%s", (const char *)nb_nl_attr_data(tb[WGDEVICE_A_IFNAME]));
+    }
+    if (tb[WGDEVICE_A_PRIVATE_KEY] && nb_nl_attr_len(tb[WGDEVICE_A_PRIVATE_KEY]) == WG_KEY_LEN) {
+        memcpy(dev->private_key, nb_nl_attr_data(tb[WGDEVICE_A_PRIVATE_KEY]), WG_KEY_LEN);
+    }
+    if (tb[WGDEVICE_A_PUBLIC_KEY] && nb_nl_attr_len(tb[WGDEVICE_A_PUBLIC_KEY]) == WG_KEY_LEN) {
+        memcpy(dev->public_key, nb_nl_attr_data(tb[WGDEVICE_A_PUBLIC_KEY]), WG_KEY_LEN);
+    }
+    if (tb[WGDEVICE_A_LISTEN_PORT]) {
+        dev->listen_port = nb_nl_attr_get_u16(tb[WGDEVICE_A_LISTEN_PORT]);
+    }
+    if (tb[WGDEVICE_A_FWMARK]) {
+        dev->fwmark = nb_nl_attr_get_u32(tb[WGDEVICE_A_FWMARK]);
+    }
+
+    if (tb[WGDEVICE_A_PEERS]) {
+        const struct nlattr *a;
+        nb_nl_attr_for_each(a, nb_nl_attr_data(tb[WGDEVICE_A_PEERS]),
+                            nb_nl_attr_len(tb[WGDEVICE_A_PEERS])) {
+            if (parse_peer(a, ctx) != NB_SUCCESS) {
+                return NB_ERROR_SYSTEM;
+            }
+        }
+    }
+    return NB_SUCCESS;
+}
+
+int wg_nl_get_device(wg_nl_t *nl, const char *ifname, wg_device_t **dev_out) {
+    wg_device_t *dev = calloc(1, sizeof(wg_device_t));
+    if (!dev) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+
+    dump_ctx_t ctx = { .dev = dev };
+
+    wg_msg_begin(nl, WG_CMD_GET_DEVICE, NLM_F_DUMP, ifname);
+    int ret = nb_nl_transact(&nl->genl, &nl->buf, get_device_cb, &ctx);
+    if (ret != NB_SUCCESS) {
+        wg_device_free(dev);
+        return ret;
+    }
+
+    *dev_out = dev;
+    return NB_SUCCESS;
+}
@@ -0,0 +1,613 @@
+/**
+ * wg_noise.c - WireGuard handshake (Noise_IKpsk2), cookies and transport framing
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "wg_noise.h"
+#include "blake2s.h"
+#include "chacha20poly1305.h"
+#include "curve25519.h"
+#include "common.h"
+#include <time.h>
+#include <sys/random.h>
+
+static const char noise_construction[] = "Noise_IKpsk2_25519_ChaChaPoly_BLAKE2s";
+static const char noise_identifier[] = "WireGuard v1 zx2c4 Jason@zx2c4.com";
+static const char label_mac1[] = "mac1----";
+static const char label_cookie[] = "cookie--";
+
+/* Offsets inside the handshake messages */
+#define INIT_SENDER         4
+#define INIT_EPHEMERAL      8
+#define INIT_STATIC         40
+#define INIT_TIMESTAMP      88
+#define RESP_SENDER         4
+#define RESP_RECEIVER       8
+#define RESP_EPHEMERAL      12
+#define RESP_EMPTY          44
+#define COOKIE_RECEIVER     4
+#define COOKIE_NONCE        8
+#define COOKIE_DATA         32
+
+static void put32_le(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get32_le(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_header(uint8_t *msg, uint8_t type) {
+    msg[0] = type;
+    msg[1] = msg[2] = msg[3] = 0;
+}
+
+static int fill_random(void *buf, size_t len) {
+    uint8_t *p = buf;
+    size_t got = 0;
+
+    while (got < len) {
+        ssize_t n = getrandom(p + got, len - got, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            NB_LOG_ERROR("getrandom failed: %s", strerror(errno));
+            return NB_ERROR_SYSTEM;
+        }
+        got += (size_t)n;
+    }
+    return NB_SUCCESS;
+}
+
+/* HASH(a || b) */
+static void hash2(uint8_t out[32], const uint8_t *a, size_t alen, const uint8_t *b, size_t blen) {
+    blake2s_state_t s;
+    blake2s_init(&s, 32);
+    blake2s_update(&s, a, alen);
+    blake2s_update(&s, b, blen);
+    blake2s_final(&s, out);
+}
+
+/* h = HASH(h || data) */
+static void mix_hash(uint8_t h[32], const uint8_t *data, size_t len) {
+    hash2(h, h, 32, data, len);
+}
+
+/*
+ * HKDF over HMAC-BLAKE2s (whitepaper 5.4): writes up to three outputs;
+ * out1 may alias ck.
+ */
+static void kdf(uint8_t *out1, uint8_t *out2, uint8_t *out3,
+                const uint8_t ck[32], const uint8_t *in, size_t len) {
+    uint8_t prk[32], t[33];
+
+    blake2s_hmac(prk, in, len, ck, 32);
+
+    t[0] = 1;
+    blake2s_hmac(t, t, 1, prk, 32);
+    if (out2 || out3) {
+        uint8_t t1[32];
+        memcpy(t1, t, 32);
+        t[32] = 2;
+        blake2s_hmac(t, t, 33, prk, 32);
+        if (out2) memcpy(out2, t, 32);
+        if (out3) {
+            t[32] = 3;
+            blake2s_hmac(t, t, 33, prk, 32);
+            memcpy(out3, t, 32);
+        }
+        memcpy(out1, t1, 32);
+        memset(t1, 0, sizeof(t1));
+    } else {
+        memcpy(out1, t, 32);
+    }
+    memset(prk, 0, sizeof(prk));
+    memset(t, 0, sizeof(t));
+}
+
+/* ck = KDF1(ck, DH(priv, pub)); fails on an all-zero shared secret */
+static int mix_dh(uint8_t ck[32], uint8_t *key, const uint8_t priv[32], const uint8_t pub[32]) {
+    uint8_t ss[32];
+
+    curve25519(ss, priv, pub);
+    if (wg_key_is_zero(ss)) {
+        return NB_ERROR_INVALID;
+    }
+    kdf(ck, key, NULL, ck, ss, sizeof(ss));
+    memset(ss, 0, sizeof(ss));
+    return NB_SUCCESS;
+}
+
+/* Initial chaining key and hash, already mixed with the responder's static key */
+static void handshake_start(uint8_t ck[32], uint8_t h[32], const uint8_t responder[32]) {
+    blake2s(ck, 32, (const uint8_t *)noise_construction, sizeof(noise_construction) - 1, NULL, 0);
+    hash2(h, ck, 32, (const uint8_t *)noise_identifier, sizeof(noise_identifier) - 1);
+    mix_hash(h, responder, 32);
+}
+
+static void label_key(uint8_t out[32], const char *label, const uint8_t pub[32]) {
+    hash2(out, (const uint8_t *)label, 8, pub, 32);
+}
+
+void wg_noise_static_init(wg_noise_static_t *local, const uint8_t private_key[WG_KEY_LEN]) {
+    memcpy(local->private_key, private_key, WG_KEY_LEN);
+    wg_key_derive_public(local->public_key, private_key);
+    label_key(local->mac1_key, label_mac1, local->public_key);
+    label_key(local->cookie_key, label_cookie, local->public_key);
+}
+
+int wg_noise_handshake_init(wg_noise_handshake_t *hs, const wg_noise_static_t *local,
+                            const uint8_t remote_static[WG_KEY_LEN], const uint8_t *psk) {
+    memset(hs, 0, sizeof(*hs));
+    memcpy(hs->remote_static, remote_static, WG_KEY_LEN);
+    if (psk) {
+        memcpy(hs->preshared_key, psk, WG_KEY_LEN);
+    }
+    label_key(hs->remote_mac1_key, label_mac1, remote_static);
+    label_key(hs->remote_cookie_key, label_cookie, remote_static);
+    curve25519(hs->precomputed_ss, local->private_key, remote_static);
+    return wg_key_is_zero(hs->precomputed_ss) ? NB_ERROR_INVALID : NB_SUCCESS;
+}
+
+void wg_noise_handshake_clear(wg_noise_handshake_t *hs) {
+    memset(hs->hash, 0, sizeof(hs->hash));
+    memset(hs->chaining_key, 0, sizeof(hs->chaining_key));
+    memset(hs->ephemeral_private, 0, sizeof(hs->ephemeral_private));
+    memset(hs->remote_ephemeral, 0, sizeof(hs->remote_ephemeral));
+    hs->local_index = 0;
+    hs->remote_index = 0;
+    hs->state = WG_HS_NONE;
+}
+
+void wg_noise_tai64n(uint8_t out[WG_TIMESTAMP_LEN]) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    /* Round to 2^24 ns like the kernel so timestamps do not leak fine timing */
+    uint64_t sec = 0x400000000000000aULL + (uint64_t)ts.tv_sec;
+    uint32_t nsec = (uint32_t)ts.tv_nsec & ~((1u << 24) - 1);
+    for (int i = 0; i < 8; i++) {
+        out[i] = (uint8_t)(sec >> (56 - 8 * i));
+    }
+    for (int i = 0; i < 4; i++) {
+        out[8 + i] = (uint8_t)(nsec >> (24 - 8 * i));
+    }
+}
+
+int wg_noise_create_initiation(wg_noise_handshake_t *hs, const wg_noise_static_t *local,
+                               uint32_t local_index, uint8_t msg[WG_MSG_INITIATION_LEN]) {
+    uint8_t ck[32], h[32], key[32], ts[WG_TIMESTAMP_LEN];
+    uint8_t *e = msg + INIT_EPHEMERAL;
+
+    if (wg_key_is_zero(hs->precomputed_ss)) {
+        return NB_ERROR_INVALID;    /* Low-order remote key */
+    }
+    if (wg_key_generate_private(hs->ephemeral_private) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    memset(msg, 0, WG_MSG_INITIATION_LEN);
+    put_header(msg, WG_MSG_INITIATION);
+    put32_le(msg + INIT_SENDER, local_index);
+
+    handshake_start(ck, h, hs->remote_static);
+
+    /* e */
+    wg_key_derive_public(e, hs->ephemeral_private);
+    mix_hash(h, e, 32);
+    kdf(ck, NULL, NULL, ck, e, 32);
+
+    /* es */
+    int ret = mix_dh(ck, key, hs->ephemeral_private, hs->remote_static);
+    if (ret == NB_SUCCESS) {
+        /* s */
+        chacha20poly1305_encrypt(msg + INIT_STATIC, local->public_key, WG_KEY_LEN, h, 32, 0, key);
+        mix_hash(h, msg + INIT_STATIC, WG_KEY_LEN + CHACHA20POLY1305_TAG_LEN);
+
+        /* ss */
+        kdf(ck, key, NULL, ck, hs->precomputed_ss, 32);
+
+        /* {t} */
+        wg_noise_tai64n(ts);
+        chacha20poly1305_encrypt(msg + INIT_TIMESTAMP, ts, sizeof(ts), h, 32, 0, key);
+        mix_hash(h, msg + INIT_TIMESTAMP, WG_TIMESTAMP_LEN + CHACHA20POLY1305_TAG_LEN);
+
+        memcpy(hs->chaining_key, ck, 32);
+        memcpy(hs->hash, h, 32);
+        hs->local_index = local_index;
+        hs->state = WG_HS_CREATED_INITIATION;
+    }
+
+    memset(ck, 0, sizeof(ck));
+    memset(key, 0, sizeof(key));
+    return ret;
+}
+
+int wg_noise_consume_initiation(const wg_noise_static_t *local,
+                                const uint8_t msg[WG_MSG_INITIATION_LEN],
+                                wg_noise_initiation_t *out) {
+    uint8_t ck[32], h[32], key[32];
+    const uint8_t *e = msg + INIT_EPHEMERAL;
+
+    if (msg[0] != WG_MSG_INITIATION) {
+        return NB_ERROR_INVALID;
+    }
+
+    handshake_start(ck, h, local->public_key);
+
+    mix_hash(h, e, 32);
+    kdf(ck, NULL, NULL, ck, e, 32);
+
+    int ret = mix_dh(ck, key, local->private_key, e);
+    if (ret == NB_SUCCESS) {
+        ret = chacha20poly1305_decrypt(out->remote_static, msg + INIT_STATIC,
+                                       WG_KEY_LEN + CHACHA20POLY1305_TAG_LEN, h, 32, 0, key);
+    }
+    if (ret == NB_SUCCESS) {
+        mix_hash(h, msg + INIT_STATIC, WG_KEY_LEN + CHACHA20POLY1305_TAG_LEN);
+        memcpy(out->remote_ephemeral, e, 32);
+        memcpy(out->hash, h, 32);
+        memcpy(out->chaining_key, ck, 32);
+        out->sender_index = get32_le(msg + INIT_SENDER);
+    }
+
+    memset(ck, 0, sizeof(ck));
+    memset(key, 0, sizeof(key));
+    return ret == NB_SUCCESS ? NB_SUCCESS : NB_ERROR_INVALID;
+}
+
+int wg_noise_accept_initiation(wg_noise_handshake_t *hs, const wg_noise_initiation_t *in,
+                               const uint8_t msg[WG_MSG_INITIATION_LEN], int64_t now_ms) {
+    uint8_t ck[32], h[32], key[32], ts[WG_TIMESTAMP_LEN];
+    int ret = NB_ERROR_INVALID;
+
+    if (wg_key_is_zero(hs->precomputed_ss)) {
+        return NB_ERROR_INVALID;
+    }
+    memcpy(ck, in->chaining_key, 32);
+    memcpy(h, in->hash, 32);
+
+    /* ss */
+    kdf(ck, key, NULL, ck, hs->precomputed_ss, 32);
+
+    /* {t} */
+    if (chacha20poly1305_decrypt(ts, msg + INIT_TIMESTAMP, WG_TIMESTAMP_LEN + CHACHA20POLY1305_TAG_LEN,
+                                 h, 32, 0, key) != NB_SUCCESS) {
+        goto out;
+    }
+    mix_hash(h, msg + INIT_TIMESTAMP, WG_TIMESTAMP_LEN + CHACHA20POLY1305_TAG_LEN);
+
+    /* Replayed initiation or initiation flood */
+    if (memcmp(ts, hs->latest_timestamp, sizeof(ts)) <= 0) {
+        goto out;
+    }
+    if (hs->last_initiation_ms && now_ms - hs->last_initiation_ms < WG_INITIATION_MIN_GAP_MS) {
+        goto out;
+    }
+
+    memcpy(hs->remote_ephemeral, in->remote_ephemeral, 32);
+    memcpy(hs->chaining_key, ck, 32);
+    memcpy(hs->hash, h, 32);
+    memcpy(hs->latest_timestamp, ts, sizeof(ts));
+    memset(hs->ephemeral_private, 0, sizeof(hs->ephemeral_private));
+    hs->remote_index = in->sender_index;
+    hs->last_initiation_ms = now_ms;
+    hs->state = WG_HS_CONSUMED_INITIATION;
+    ret = NB_SUCCESS;
+
+out:
+    memset(ck, 0, sizeof(ck));
+    memset(key, 0, sizeof(key));
+    return ret;
+}
+
+int wg_noise_create_response(wg_noise_handshake_t *hs, uint32_t local_index,
+                             uint8_t msg[WG_MSG_RESPONSE_LEN]) {
+    uint8_t ck[32], h[32], key[32], tau[32];
+    uint8_t *e = msg + RESP_EPHEMERAL;
+
+    if (hs->state != WG_HS_CONSUMED_INITIATION) {
+        return NB_ERROR_INVALID;
+    }
+    if (wg_key_generate_private(hs->ephemeral_private) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    memset(msg, 0, WG_MSG_RESPONSE_LEN);
+    put_header(msg, WG_MSG_RESPONSE);
+    put32_le(msg + RESP_SENDER, local_index);
+    put32_le(msg + RESP_RECEIVER, hs->remote_index);
+
+    memcpy(ck, hs->chaining_key, 32);
+    memcpy(h, hs->hash, 32);
+
+    /* e */
+    wg_key_derive_public(e, hs->ephemeral_private);
+    mix_hash(h, e, 32);
+    kdf(ck, NULL, NULL, ck, e, 32);
+
+    /* ee, se */
+    int ret = mix_dh(ck, NULL, hs->ephemeral_private, hs->remote_ephemeral);
+    if (ret == NB_SUCCESS) {
+        ret = mix_dh(ck, NULL, hs->ephemeral_private, hs->remote_static);
+    }
+    if (ret == NB_SUCCESS) {
+        /* psk */
+        kdf(ck, tau, key, ck, hs->preshared_key, 32);
+        mix_hash(h, tau, 32);
+
+        /* {} */
+        chacha20poly1305_encrypt(msg + RESP_EMPTY, NULL, 0, h, 32, 0, key);
+        mix_hash(h, msg + RESP_EMPTY, CHACHA20POLY1305_TAG_LEN);
+
+        memcpy(hs->chaining_key, ck, 32);
+        memcpy(hs->hash, h, 32);
+        hs->local_index = local_index;
+        hs->state = WG_HS_CREATED_RESPONSE;
+    }
+
+    memset(ck, 0, sizeof(ck));
+    memset(key, 0, sizeof(key));
+    memset(tau, 0, sizeof(tau));
+    return ret;
+}
+
+int wg_noise_consume_response(wg_noise_handshake_t *hs, const wg_noise_static_t *local,
+                              const uint8_t msg[WG_MSG_RESPONSE_LEN]) {
+    uint8_t ck[32], h[32], key[32], tau[32];
+    const uint8_t *e = msg + RESP_EPHEMERAL;
+    int ret = NB_ERROR_INVALID;
+
+    if (msg[0] != WG_MSG_RESPONSE || hs->state != WG_HS_CREATED_INITIATION ||
+        get32_le(msg + RESP_RECEIVER) != hs->local_index) {
+        return NB_ERROR_INVALID;
+    }
+
+    memcpy(ck, hs->chaining_key, 32);
+    memcpy(h, hs->hash, 32);
+
+    /* e */
+    mix_hash(h, e, 32);
+    kdf(ck, NULL, NULL, ck, e, 32);
+
+    /* ee, se */
+    if (mix_dh(ck, NULL, hs->ephemeral_private, e) != NB_SUCCESS ||
+        mix_dh(ck, NULL, local->private_key, e) != NB_SUCCESS) {
+        goto out;
+    }
+
+    /* psk */
+    kdf(ck, tau, key, ck, hs->preshared_key, 32);
+    mix_hash(h, tau, 32);
+
+    /* {} */
+    if (chacha20poly1305_decrypt(NULL, msg + RESP_EMPTY, CHACHA20POLY1305_TAG_LEN,
+                                 h, 32, 0, key) != NB_SUCCESS) {
+        goto out;
+    }
+    mix_hash(h, msg + RESP_EMPTY, CHACHA20POLY1305_TAG_LEN);
+
+    memcpy(hs->chaining_key, ck, 32);
+    memcpy(hs->hash, h, 32);
+    memset(hs->ephemeral_private, 0, sizeof(hs->ephemeral_private));
+    hs->remote_index = get32_le(msg + RESP_SENDER);
+    hs->state = WG_HS_CONSUMED_RESPONSE;
+    ret = NB_SUCCESS;
+
+out:
+    memset(ck, 0, sizeof(ck));
+    memset(key, 0, sizeof(key));
+    memset(tau, 0, sizeof(tau));
+    return ret;
+}
+
+int wg_noise_derive_keypair(wg_noise_handshake_t *hs, wg_noise_keypair_t *kp, int64_t now_ms) {
+    int initiator;
+
+    if (hs->state == WG_HS_CONSUMED_RESPONSE) {
+        initiator = 1;
+    } else if (hs->state == WG_HS_CREATED_RESPONSE) {
+        initiator = 0;
+    } else {
+        return NB_ERROR_INVALID;
+    }
+
+    memset(kp, 0, sizeof(*kp));
+    if (initiator) {
+        kdf(kp->send_key, kp->recv_key, NULL, hs->chaining_key, NULL, 0);
+    } else {
+        kdf(kp->recv_key, kp->send_key, NULL, hs->chaining_key, NULL, 0);
+    }
+    kp->local_index = hs->local_index;
+    kp->remote_index = hs->remote_index;
+    kp->birth_ms = now_ms;
+    kp->initiator = initiator;
+    kp->valid = 1;
+
+    wg_noise_handshake_clear(hs);
+    return NB_SUCCESS;
+}
+
+void wg_noise_data_seal(uint8_t *out, const uint8_t *plain, size_t len,
+                        uint32_t remote_index, uint64_t counter, const uint8_t key[32]) {
+    size_t padded = (len + 15) & ~(size_t)15;
+    uint8_t *body = out + WG_DATA_HEADER_LEN;
+
+    put_header(out, WG_MSG_DATA);
+    put32_le(out + 4, remote_index);
+    for (int i = 0; i < 8; i++) {
+        out[8 + i] = (uint8_t)(counter >> (8 * i));
+    }
+
+    if (len > 0) {
+        memcpy(body, plain, len);
+    }
+    memset(body + len, 0, padded - len);
+    chacha20poly1305_encrypt(body, body, padded, NULL, 0, counter, key);
+}
+
+uint32_t wg_noise_data_index(const uint8_t *msg) {
+    return get32_le(msg + 4);
+}
+
+uint64_t wg_noise_data_counter(const uint8_t *msg) {
+    return (uint64_t)get32_le(msg + 8) | (uint64_t)get32_le(msg + 12) << 32;
+}
+
+int wg_noise_data_open(uint8_t *out, const uint8_t *msg, size_t len,
+                       const uint8_t key[32], size_t *plain_len) {
+    if (len < WG_DATA_MIN_LEN || msg[0] != WG_MSG_DATA) {
+        return NB_ERROR_INVALID;
+    }
+
+    size_t body = len - WG_DATA_HEADER_LEN;
+    int ret = chacha20poly1305_decrypt(out, msg + WG_DATA_HEADER_LEN, body, NULL, 0,
+                                       wg_noise_data_counter(msg), key);
+    if (ret == NB_SUCCESS && plain_len) {
+        *plain_len = body - WG_DATA_TAG_LEN;
+    }
+    return ret;
+}
+
+int wg_replay_check(wg_replay_t *r, uint64_t counter) {
+    if (counter >= WG_REJECT_AFTER_MESSAGES) {
+        return 0;
+    }
+
+    /* Shift by one so that counter 0 is distinguishable from "nothing seen" */
+    uint64_t c = counter + 1;
+    if (c + WG_REPLAY_WINDOW < r->greatest) {
+        return 0;
+    }
+
+    uint64_t index = c >> 6;
+    if (c > r->greatest) {
+        uint64_t current = r->greatest >> 6;
+        uint64_t top = index - current;
+        if (top > WG_REPLAY_WORDS) {
+            top = WG_REPLAY_WORDS;
+        }
+        for (uint64_t i = 1; i <= top; i++) {
+            r->bitmap[(current + i) & (WG_REPLAY_WORDS - 1)] = 0;
+        }
+        r->greatest = c;
+    }
+
+    uint64_t *word = &r->bitmap[index & (WG_REPLAY_WORDS - 1)];
+    uint64_t bit = 1ULL << (c & 63);
+    if (*word & bit) {
+        return 0;
+    }
+    *word |= bit;
+    return 1;
+}
+
+/* Constant-time comparison of two MACs */
+static int mac_equal(const uint8_t *a, const uint8_t *b) {
+    uint8_t d = 0;
+    for (int i = 0; i < 16; i++) {
+        d |= a[i] ^ b[i];
+    }
+    return d == 0;
+}
+
+void wg_cookie_add_macs(wg_cookie_t *c, const uint8_t remote_mac1_key[32],
+                        uint8_t *msg, size_t len, int64_t now_ms) {
+    uint8_t *mac1 = msg + len - 32;
+    uint8_t *mac2 = msg + len - 16;
+
+    blake2s(mac1, 16, msg, len - 32, remote_mac1_key, 32);
+    memcpy(c->last_mac1, mac1, 16);
+    c->have_last_mac1 = 1;
+
+    /* Leave a little margin so the cookie is still valid when it arrives */
+    if (c->cookie_birth_ms && now_ms - c->cookie_birth_ms < WG_COOKIE_LIFETIME_MS - WG_REKEY_TIMEOUT_MS) {
+        blake2s(mac2, 16, msg, len - 16, c->cookie, WG_COOKIE_LEN);
+    } else {
+        memset(mac2, 0, 16);
+    }
+}
+
+int wg_cookie_check_mac1(const wg_noise_static_t *local, const uint8_t *msg, size_t len) {
+    uint8_t mac[16];
+    blake2s(mac, 16, msg, len - 32, local->mac1_key, 32);
+    return mac_equal(mac, msg + len - 32);
+}
+
+/* The cookie we give to src: MAC(secret, address || port) */
+static int make_cookie(wg_cookie_checker_t *ck, const nb_endpoint_t *src, int64_t now_ms,
+                       uint8_t out[WG_COOKIE_LEN]) {
+    uint8_t buf[18];
+    size_t len;
+
+    if (!ck->secret_birth_ms || now_ms - ck->secret_birth_ms >= WG_COOKIE_LIFETIME_MS) {
+        if (fill_random(ck->secret, sizeof(ck->secret)) != NB_SUCCESS) {
+            return NB_ERROR_SYSTEM;
+        }
+        ck->secret_birth_ms = now_ms ? now_ms : 1;
+    }
+
+    if (src->sa.sa_family == AF_INET6) {
+        memcpy(buf, &src->in6.sin6_addr, 16);
+        memcpy(buf + 16, &src->in6.sin6_port, 2);
+        len = 18;
+    } else {
+        memcpy(buf, &src->in4.sin_addr, 4);
+        memcpy(buf + 4, &src->in4.sin_port, 2);
+        len = 6;
+    }
+    blake2s(out, WG_COOKIE_LEN, buf, len, ck->secret, sizeof(ck->secret));
+    return NB_SUCCESS;
+}
+
+int wg_cookie_check_mac2(wg_cookie_checker_t *ck, const uint8_t *msg, size_t len,
+                         const nb_endpoint_t *src, int64_t now_ms) {
+    uint8_t cookie[WG_COOKIE_LEN], mac[16];
+
+    if (make_cookie(ck, src, now_ms, cookie) != NB_SUCCESS) {
+        return 0;
+    }
+    blake2s(mac, 16, msg, len - 16, cookie, sizeof(cookie));
+    return mac_equal(mac, msg + len - 16);
+}
+
+int wg_cookie_create_reply(wg_cookie_checker_t *ck, const wg_noise_static_t *local,
+                           const uint8_t *msg, size_t len, uint32_t receiver_index,
+                           const nb_endpoint_t *src, int64_t now_ms,
+                           uint8_t out[WG_MSG_COOKIE_LEN]) {
+    uint8_t cookie[WG_COOKIE_LEN];
+
+    if (make_cookie(ck, src, now_ms, cookie) != NB_SUCCESS ||
+        fill_random(out + COOKIE_NONCE, XCHACHA20POLY1305_NONCE_LEN) != NB_SUCCESS) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    put_header(out, WG_MSG_COOKIE);
+    put32_le(out + COOKIE_RECEIVER, receiver_index);
+    xchacha20poly1305_encrypt(out + COOKIE_DATA, cookie, sizeof(cookie), msg + len - 32, 16,
+                              out + COOKIE_NONCE, local->cookie_key);
+    return NB_SUCCESS;
+}
+
+int wg_cookie_consume_reply(wg_cookie_t *c, const uint8_t remote_cookie_key[32],
+                            const uint8_t reply[WG_MSG_COOKIE_LEN], int64_t now_ms) {
+    uint8_t cookie[WG_COOKIE_LEN];
+
+    if (reply[0] != WG_MSG_COOKIE || !c->have_last_mac1) {
+        return NB_ERROR_INVALID;
+    }
+    if (xchacha20poly1305_decrypt(cookie, reply + COOKIE_DATA, WG_COOKIE_LEN + CHACHA20POLY1305_TAG_LEN,
+                                  c->last_mac1, 16, reply + COOKIE_NONCE,
+                                  remote_cookie_key) != NB_SUCCESS) {
+        return NB_ERROR_INVALID;
+    }
+
+    memcpy(c->cookie, cookie, sizeof(cookie));
+    c->cookie_birth_ms = now_ms ? now_ms : 1;
+    c->have_last_mac1 = 0;
+    return NB_SUCCESS;
+}
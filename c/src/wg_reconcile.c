@@ -0,0 +1,268 @@
+/**
+ * wg_reconcile.c - Peer reconciliation against live device state
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "wg_reconcile.h"
+#include "common.h"
+#include "wg_key.h"
+
+/* Open addressing index over device peers, keyed by public key */
+typedef struct {
+    const wg_device_t *dev;
+    int *slots;              /* Peer index + 1, 0 = empty */
+    uint32_t mask;
+} peer_index_t;
+
+static uint32_t key_hash(const uint8_t key[WG_KEY_LEN]) {
+    uint64_t v;
+    memcpy(&v, key, sizeof(v));
+    return (uint32_t)((v * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+}
+
+static int index_build(peer_index_t *idx, const wg_device_t *dev) {
+    uint32_t size = 16;
+    while (size < (uint32_t)dev->peer_count * 2) {
+        size <<= 1;
+    }
+
+    idx->dev = dev;
+    idx->mask = size - 1;
+    idx->slots = calloc(size, sizeof(int));
+    if (!idx->slots) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+
+    for (int i = 0; i < dev->peer_count; i++) {
+        uint32_t h = key_hash(dev->peers[i].public_key) & idx->mask;
+        while (idx->slots[h]) {
+            h = (h + 1) & idx->mask;
+        }
+        idx->slots[h] = i + 1;
+    }
+    return NB_SUCCESS;
+}
+
+static int index_find(const peer_index_t *idx, const uint8_t key[WG_KEY_LEN]) {
+    uint32_t h = key_hash(key) & idx->mask;
+    while (idx->slots[h]) {
+        int i = idx->slots[h] - 1;
+        if (memcmp(idx->dev->peers[i].public_key, key, WG_KEY_LEN) == 0) {
+            return i;
+        }
+        h = (h + 1) & idx->mask;
+    }
+    return -1;
+}
+
+static int prefix_qsort_cmp(const void *a, const void *b) {
+    return nb_prefix_cmp(a, b);
+}
+
+/* Normalize, sort and deduplicate; returns the new count */
+static int prefix_set(nb_prefix_t *p, int n) {
+    int out = 0;
+
+    for (int i = 0; i < n; i++) {
+        nb_prefix_normalize(&p[i]);
+    }
+    qsort(p, n, sizeof(nb_prefix_t), prefix_qsort_cmp);
+    for (int i = 0; i < n; i++) {
+        if (out == 0 || nb_prefix_cmp(&p[out - 1], &p[i]) != 0) {
+            p[out++] = p[i];
+        }
+    }
+    return out;
+}
+
+/* Compare allowed IPs as sets; scratch must hold a + b entries */
+static int allowed_ips_equal(const nb_prefix_t *a, int a_count,
+                             const nb_prefix_t *b, int b_count,
+                             nb_prefix_t *scratch) {
+    nb_prefix_t *sa = scratch;
+    nb_prefix_t *sb = scratch + a_count;
+
+    memcpy(sa, a, a_count * sizeof(nb_prefix_t));
+    memcpy(sb, b, b_count * sizeof(nb_prefix_t));
+    a_count = prefix_set(sa, a_count);
+    b_count = prefix_set(sb, b_count);
+
+    return a_count == b_count && memcmp(sa, sb, a_count * sizeof(nb_prefix_t)) == 0;
+}
+
+static int peer_differs(const wg_peer_spec_t *want, const wg_device_peer_t *have,
+                        nb_prefix_t *scratch) {
+    if (want->endpoint.sa.sa_family != 0 && nb_endpoint_cmp(&want->endpoint, &have->endpoint) != 0) {
+        return 1;
+    }
+    if (want->keepalive >= 0 && want->keepalive != have->keepalive) {
+        return 1;
+    }
+    if (want->has_preshared_key && !wg_key_equal(want->preshared_key, have->preshared_key)) {
+        return 1;
+    }
+    if (want->allowed_ips &&
+        !allowed_ips_equal(want->allowed_ips, want->allowed_ips_count,
+                           have->allowed_ips, have->allowed_ips_count, scratch)) {
+        return 1;
+    }
+    return 0;
+}
+
+int wg_reconcile_plan(const wg_device_t *dev,
+                      const wg_peer_spec_t *desired, int count,
+                      wg_peer_spec_t **plan_out, int *plan_count_out,
+                      wg_reconcile_stats_t *stats) {
+    if (!dev || (!desired && count > 0) || count < 0 || !plan_out || !plan_count_out) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    wg_reconcile_stats_t st = {0};
+    peer_index_t idx;
+    int ret = index_build(&idx, dev);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+
+    /* Scratch for set comparison: largest desired + largest live list */
+    int max_want = 0, max_have = 0;
+    for (int i = 0; i < count; i++) {
+        if (desired[i].allowed_ips_count > max_want) max_want = desired[i].allowed_ips_count;
+    }
+    for (int i = 0; i < dev->peer_count; i++) {
+        if (dev->peers[i].allowed_ips_count > max_have) max_have = dev->peers[i].allowed_ips_count;
+    }
+
+    wg_peer_spec_t *plan = calloc(count + dev->peer_count + 1, sizeof(wg_peer_spec_t));
+    uint8_t *seen = calloc(dev->peer_count + 1, 1);
+    nb_prefix_t *scratch = calloc(max_want + max_have + 1, sizeof(nb_prefix_t));
+    if (!plan || !seen || !scratch) {
+        NB_LOG_ERROR("calloc failed");
+        free(plan);
+        free(seen);
+        free(scratch);
+        free(idx.slots);
+        return NB_ERROR_SYSTEM;
+    }
+
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        const wg_peer_spec_t *want = &desired[i];
+        int j = index_find(&idx, want->public_key);
+
+        if (want->remove) {
+            /* Removal of a peer that is not there is a no-op */
+            continue;
+        }
+
+        if (j < 0) {
+            plan[n++] = *want;
+            st.added++;
+            continue;
+        }
+
+        seen[j] = 1;
+        if (peer_differs(want, &dev->peers[j], scratch)) {
+            plan[n++] = *want;
+            st.updated++;
+        } else {
+            st.unchanged++;
+        }
+    }
+
+    /* Everything not desired goes away (explicit removals included) */
+    for (int j = 0; j < dev->peer_count; j++) {
+        if (seen[j]) continue;
+        memset(&plan[n], 0, sizeof(plan[n]));
+        memcpy(plan[n].public_key, dev->peers[j].public_key, WG_KEY_LEN);
+        plan[n].remove = 1;
+        n++;
+        st.removed++;
+    }
+
+    free(seen);
+    free(scratch);
+    free(idx.slots);
+
+    if (n == 0) {
+        free(plan);
+        plan = NULL;
+    }
+
+    *plan_out = plan;
+    *plan_count_out = n;
+    if (stats) {
+        *stats = st;
+    }
+    return NB_SUCCESS;
+}
+
+int wg_iface_reconcile(wg_iface_t *iface,
+                       const wg_peer_spec_t *desired, int count,
+                       wg_reconcile_stats_t *stats_out) {
+    if (!iface || (!desired && count > 0) || count < 0) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    wg_device_t *dev = NULL;
+    int ret = wg_iface_get_device(iface, &dev);
+    if (ret != NB_SUCCESS) {
+        NB_LOG_ERROR("Failed to read device state for %s", iface->name);
+        return ret;
+    }
+
+    wg_peer_spec_t *plan = NULL;
+    int plan_count = 0;
+    wg_reconcile_stats_t st = {0};
+    ret = wg_reconcile_plan(dev, desired, count, &plan, &plan_count, &st);
+    wg_device_free(dev);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+
+    if (plan_count > 0) {
+        int *errors = calloc(plan_count, sizeof(int));
+        if (!errors) {
+            NB_LOG_ERROR("calloc failed");
+            memset(plan, 0, plan_count * sizeof(wg_peer_spec_t));
+            free(plan);
+            return NB_ERROR_SYSTEM;
+        }
+
+        ret = wg_iface_apply_peers(iface, plan, plan_count, errors);
+        if (ret == NB_SUCCESS || ret == NB_ERROR) {
+            for (int i = 0; i < plan_count; i++) {
+                if (errors[i] != NB_SUCCESS) {
+                    char key[WG_KEY_B64_LEN];
+                    wg_key_to_base64(key, plan[i].public_key);
+                    NB_LOG_WARN("Failed to %s peer %s (error %d)",
+                                plan[i].remove ? "remove" : "apply", key, errors[i]);
+                    st.failed++;
+                }
+            }
+        } else {
+            st.failed = plan_count;
+        }
+
+        free(errors);
+        /* Plan entries may carry pre-shared keys */
+        memset(plan, 0, plan_count * sizeof(wg_peer_spec_t));
+        free(plan);
+    }
+
+    NB_LOG_INFO("Reconciled %s: %d added, %d updated, %d removed, %d unchanged, %d failed",
+                iface->name, st.added, st.updated, st.removed, st.unchanged, st.failed);
+
+    if (stats_out) {
+        *stats_out = st;
+    }
+    if (ret != NB_SUCCESS && ret != NB_ERROR) {
+        return ret;
+    }
+    return st.failed ? NB_ERROR : NB_SUCCESS;
+}
@@ -0,0 +1,1523 @@
+/**
+ * wg_user.c - Userspace WireGuard datapath over TUN
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#define _GNU_SOURCE
+#include "wg_user.h"
+#include "wg_noise.h"
+#include "peer_table.h"
+#include "lpm.h"
+#include "common.h"
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <time.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <linux/if_tun.h>
+
+#define PACKET_MAX          4096    /* TUN read size; covers WG_USER_MTU with room to spare */
+#define OUT_SLOT            (PACKET_MAX + 64)
+#define DATAGRAM_MAX        65536   /* GRO receive buffer */
+#define GSO_MAX_SEGS        64
+#define GSO_MAX_BYTES       65000
+#define SLOT_BITS           22      /* Peer slot in the low bits of our session indices */
+#define SLOT_MASK           ((1u << SLOT_BITS) - 1)
+#define NO_PEER             UINT32_MAX
+#define TIMER_INTERVAL_MS   100
+#define LOAD_HANDSHAKES     1024    /* Handshake messages per second before demanding cookies */
+#define KEY_ZERO_AFTER_MS   (3 * WG_REJECT_AFTER_TIME_MS)
+#define SOCKET_BUFFER       (7 << 20)
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t slot;
+    uint8_t public_key[WG_KEY_LEN];
+    wg_noise_handshake_t hs;
+    wg_cookie_t cookie;
+    wg_noise_keypair_t current;
+    wg_noise_keypair_t previous;
+    wg_noise_keypair_t next;         /* Responder side, until the initiator confirms it */
+    nb_endpoint_t endpoint;
+    int keepalive;
+
+    /* Timers, monotonic ms (0 = not set) */
+    int64_t last_sent_ms;            /* Any packet sent */
+    int64_t data_unanswered_ms;      /* First data sent since the last authenticated receive */
+    int64_t recv_unanswered_ms;      /* First data received since the last send */
+    int64_t handshake_sent_ms;       /* Last initiation */
+    int64_t attempt_start_ms;        /* First initiation of the current attempt */
+    int64_t handshake_unix;          /* Last completed handshake (wall clock) */
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+
+    /* Packets waiting for a session */
+    uint8_t *staged[WG_USER_STAGED_MAX];
+    uint16_t staged_len[WG_USER_STAGED_MAX];
+    int staged_count;
+} peer_t;
+
+/* Keys and destination copied out of a peer for encryption without the lock */
+typedef struct {
+    uint8_t key[32];
+    uint32_t remote_index;
+    uint64_t counter;
+    nb_endpoint_t endpoint;
+    int rekey;
+} send_ctx_t;
+
+/* Outgoing datagrams for one sendmmsg(), with GSO runs */
+typedef struct {
+    struct mmsghdr msgs[WG_USER_BATCH];
+    struct iovec iov[WG_USER_BATCH];
+    struct sockaddr_storage addrs[WG_USER_BATCH];
+    char cmsg[WG_USER_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+    size_t seg_size[WG_USER_BATCH];
+    size_t total[WG_USER_BATCH];
+    int closed[WG_USER_BATCH];      /* Last segment was short; nothing may follow */
+    int nmsgs;
+    int niov;
+} tx_batch_t;
+
+typedef struct {
+    struct wg_user *dev;
+    int index;
+    int tun_fd;
+    int udp_fd;
+    int gso;
+    int started;
+    pthread_t thread;
+
+    uint8_t *tun_buf;               /* WG_USER_BATCH packets read from the TUN queue */
+    uint8_t *out_buf;               /* WG_USER_BATCH encrypted messages */
+    uint8_t *rx_buf;                /* WG_USER_RX_BATCH datagrams */
+    uint8_t *plain;                 /* One decrypted packet */
+    tx_batch_t tx;
+    struct mmsghdr rx_msgs[WG_USER_RX_BATCH];
+    struct iovec rx_iov[WG_USER_RX_BATCH];
+    struct sockaddr_storage rx_addrs[WG_USER_RX_BATCH];
+    char rx_cmsg[WG_USER_RX_BATCH][CMSG_SPACE(sizeof(int))];
+
+    wg_user_stats_t stats;          /* Updated with relaxed atomics */
+} worker_t;
+
+struct wg_user {
+    char name[IFNAMSIZ];
+    wg_noise_static_t local;
+    int listen_port;
+    int family;                     /* AF_INET6 (dual stack) or AF_INET */
+    int nworkers;
+    worker_t *workers;
+    int stop_fd;
+    pthread_t timer;
+    int timer_started;
+
+    /* Read-held by the datapath for a whole batch, write-held by configuration */
+    pthread_rwlock_t lock;
+    nb_peer_table_t *table;         /* Key -> slot (record id) and configured allowed IPs */
+    nb_lpm_t *allowed;              /* Allowed IPs -> slot */
+    peer_t **slots;
+    uint32_t nslots;
+
+    pthread_mutex_t cookie_lock;
+    wg_cookie_checker_t checker;
+    int64_t load_window_ms;
+    uint32_t load_count;
+};
+
+#define STAT_ADD(w, field, n)   __atomic_fetch_add(&(w)->stats.field, (n), __ATOMIC_RELAXED)
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t get32_le(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* sockaddr for an endpoint; IPv4 becomes v4-mapped on a dual-stack socket */
+static socklen_t to_sockaddr(const struct wg_user *dev, const nb_endpoint_t *ep,
+                             struct sockaddr_storage *ss) {
+    memset(ss, 0, sizeof(*ss));
+    if (ep->sa.sa_family == AF_INET && dev->family == AF_INET6) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)ss;
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = ep->in4.sin_port;
+        sin6->sin6_addr.s6_addr[10] = 0xff;
+        sin6->sin6_addr.s6_addr[11] = 0xff;
+        memcpy(&sin6->sin6_addr.s6_addr[12], &ep->in4.sin_addr, 4);
+        return sizeof(*sin6);
+    }
+    if (ep->sa.sa_family == AF_INET) {
+        memcpy(ss, &ep->in4, sizeof(ep->in4));
+        return sizeof(ep->in4);
+    }
+    if (ep->sa.sa_family == AF_INET6 && dev->family == AF_INET6) {
+        memcpy(ss, &ep->in6, sizeof(ep->in6));
+        return sizeof(ep->in6);
+    }
+    return 0;
+}
+
+static void from_sockaddr(const struct sockaddr_storage *ss, nb_endpoint_t *ep) {
+    memset(ep, 0, sizeof(*ep));
+    if (ss->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)ss;
+        if (IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)) {
+            ep->in4.sin_family = AF_INET;
+            ep->in4.sin_port = sin6->sin6_port;
+            memcpy(&ep->in4.sin_addr, &sin6->sin6_addr.s6_addr[12], 4);
+        } else {
+            ep->in6 = *sin6;
+        }
+    } else if (ss->ss_family == AF_INET) {
+        ep->in4 = *(const struct sockaddr_in *)ss;
+    }
+}
+
+static int send_raw(struct wg_user *dev, int fd, const nb_endpoint_t *ep, const void *buf, size_t len) {
+    struct sockaddr_storage ss;
+    socklen_t sl = to_sockaddr(dev, ep, &ss);
+    if (sl == 0) {
+        return NB_ERROR_INVALID;
+    }
+    return sendto(fd, buf, len, 0, (struct sockaddr *)&ss, sl) < 0 ? NB_ERROR_SYSTEM : NB_SUCCESS;
+}
+
+/*
+ * Source or destination of an IP packet and its length without padding
+ *
+ * Returns 0 if the packet is not a well-formed IPv4/IPv6 packet.
+ */
+static size_t packet_addr(const uint8_t *pkt, size_t len, int dst, nb_prefix_t *out) {
+    size_t total;
+
+    if (len < 1) return 0;
+    memset(out, 0, sizeof(*out));
+    switch (pkt[0] >> 4) {
+    case 4:
+        if (len < 20) return 0;
+        total = (size_t)pkt[2] << 8 | pkt[3];
+        if (total < 20 || total > len) return 0;
+        out->family = AF_INET;
+        out->len = 32;
+        memcpy(out->addr, pkt + (dst ? 16 : 12), 4);
+        return total;
+    case 6:
+        if (len < 40) return 0;
+        total = 40 + ((size_t)pkt[4] << 8 | pkt[5]);
+        if (total > len) return 0;
+        out->family = AF_INET6;
+        out->len = 128;
+        memcpy(out->addr, pkt + (dst ? 24 : 8), 16);
+        return total;
+    }
+    return 0;
+}
+
+/* Peer owning the destination of an outgoing packet */
+static uint32_t route_packet(struct wg_user *dev, const uint8_t *pkt, size_t len) {
+    nb_prefix_t dst;
+    uint32_t slot;
+
+    if (!packet_addr(pkt, len, 1, &dst) ||
+        nb_lpm_lookup(dev->allowed, &dst, &slot, NULL) != NB_SUCCESS ||
+        slot >= dev->nslots || !dev->slots[slot]) {
+        return NO_PEER;
+    }
+    return slot;
+}
+
+static peer_t* peer_by_index(struct wg_user *dev, uint32_t index) {
+    uint32_t slot = index & SLOT_MASK;
+    return slot < dev->nslots ? dev->slots[slot] : NULL;
+}
+
+/* A fresh session index for p that none of its sessions uses */
+static uint32_t new_index(peer_t *p) {
+    uint32_t r;
+    for (;;) {
+        if (getrandom(&r, sizeof(r), GRND_NONBLOCK) != sizeof(r)) {
+            r = (uint32_t)rand();
+        }
+        uint32_t index = (r & ~SLOT_MASK) | p->slot;
+        if (index != p->current.local_index && index != p->previous.local_index &&
+            index != p->next.local_index && index != p->hs.local_index) {
+            return index;
+        }
+    }
+}
+
+/* Usable session with this local index (p->lock held) */
+static wg_noise_keypair_t* keypair_by_index(peer_t *p, uint32_t index, int64_t now) {
+    wg_noise_keypair_t *kps[3] = { &p->current, &p->next, &p->previous };
+    for (int i = 0; i < 3; i++) {
+        wg_noise_keypair_t *kp = kps[i];
+        if (kp->valid && kp->local_index == index && now - kp->birth_ms < WG_REJECT_AFTER_TIME_MS) {
+            return kp;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Build an initiation if none went out in the last REKEY_TIMEOUT
+ * (p->lock held). Returns 1 if msg should be sent to p->endpoint.
+ */
+static int prepare_initiation(struct wg_user *dev, peer_t *p, int64_t now,
+                              uint8_t msg[WG_MSG_INITIATION_LEN]) {
+    if (!p->endpoint.sa.sa_family) {
+        return 0;
+    }
+    if (p->handshake_sent_ms && now - p->handshake_sent_ms < WG_REKEY_TIMEOUT_MS) {
+        return 0;
+    }
+    if (wg_noise_create_initiation(&p->hs, &dev->local, new_index(p), msg) != NB_SUCCESS) {
+        return 0;
+    }
+    wg_cookie_add_macs(&p->cookie, p->hs.remote_mac1_key, msg, WG_MSG_INITIATION_LEN, now);
+    if (!p->attempt_start_ms) {
+        p->attempt_start_ms = now;
+    }
+    p->handshake_sent_ms = now;
+    p->last_sent_ms = now;
+    p->recv_unanswered_ms = 0;
+    return 1;
+}
+
+/*
+ * Reserve n counters of the current session for sending (p->lock held)
+ *
+ * Returns 0 if there is no usable session.
+ */
+static int reserve(peer_t *p, int64_t now, int n, size_t bytes, int data, send_ctx_t *ctx) {
+    wg_noise_keypair_t *kp = &p->current;
+
+    if (!kp->valid || now - kp->birth_ms >= WG_REJECT_AFTER_TIME_MS ||
+        kp->send_counter + (uint64_t)n >= WG_REJECT_AFTER_MESSAGES || !p->endpoint.sa.sa_family) {
+        return 0;
+    }
+
+    memcpy(ctx->key, kp->send_key, sizeof(ctx->key));
+    ctx->remote_index = kp->remote_index;
+    ctx->counter = kp->send_counter;
+    ctx->endpoint = p->endpoint;
+    kp->send_counter += (uint64_t)n;
+    ctx->rekey = kp->send_counter >= WG_REKEY_AFTER_MESSAGES ||
+                 (kp->initiator && now - kp->birth_ms >= WG_REKEY_AFTER_TIME_MS);
+
+    p->tx_bytes += bytes;
+    p->last_sent_ms = now;
+    p->recv_unanswered_ms = 0;
+    if (data && !p->data_unanswered_ms) {
+        p->data_unanswered_ms = now;
+    }
+    return 1;
+}
+
+static void stage(peer_t *p, const uint8_t *pkt, size_t len) {
+    uint8_t *copy = malloc(len);
+    if (!copy) return;
+    memcpy(copy, pkt, len);
+
+    if (p->staged_count == WG_USER_STAGED_MAX) {
+        free(p->staged[0]);
+        memmove(&p->staged[0], &p->staged[1], (WG_USER_STAGED_MAX - 1) * sizeof(p->staged[0]));
+        memmove(&p->staged_len[0], &p->staged_len[1], (WG_USER_STAGED_MAX - 1) * sizeof(p->staged_len[0]));
+        p->staged_count--;
+    }
+    p->staged[p->staged_count] = copy;
+    p->staged_len[p->staged_count] = (uint16_t)len;
+    p->staged_count++;
+}
+
+static void staged_clear(peer_t *p) {
+    for (int i = 0; i < p->staged_count; i++) {
+        free(p->staged[i]);
+    }
+    p->staged_count = 0;
+}
+
+/* Send batch */
+
+static void batch_reset(tx_batch_t *b) {
+    b->nmsgs = 0;
+    b->niov = 0;
+}
+
+static void batch_add(worker_t *w, const nb_endpoint_t *ep, uint8_t *buf, size_t len) {
+    tx_batch_t *b = &w->tx;
+    struct sockaddr_storage ss;
+    socklen_t sl = to_sockaddr(w->dev, ep, &ss);
+
+    if (sl == 0) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+
+    /* Append to the previous datagram as another GSO segment if possible */
+    int m = b->nmsgs - 1;
+    if (w->gso && m >= 0 && !b->closed[m] && len <= b->seg_size[m] &&
+        b->msgs[m].msg_hdr.msg_iovlen < GSO_MAX_SEGS && b->total[m] + len <= GSO_MAX_BYTES &&
+        b->msgs[m].msg_hdr.msg_namelen == sl && memcmp(&b->addrs[m], &ss, sl) == 0) {
+        b->iov[b->niov].iov_base = buf;
+        b->iov[b->niov].iov_len = len;
+        b->niov++;
+        b->msgs[m].msg_hdr.msg_iovlen++;
+        b->total[m] += len;
+        b->closed[m] = len < b->seg_size[m];
+        return;
+    }
+
+    m = b->nmsgs++;
+    b->addrs[m] = ss;
+    b->iov[b->niov].iov_base = buf;
+    b->iov[b->niov].iov_len = len;
+    memset(&b->msgs[m], 0, sizeof(b->msgs[m]));
+    b->msgs[m].msg_hdr.msg_name = &b->addrs[m];
+    b->msgs[m].msg_hdr.msg_namelen = sl;
+    b->msgs[m].msg_hdr.msg_iov = &b->iov[b->niov];
+    b->msgs[m].msg_hdr.msg_iovlen = 1;
+    b->niov++;
+    b->seg_size[m] = len;
+    b->total[m] = len;
+    b->closed[m] = 0;
+}
+
+/* Send a GSO datagram segment by segment (after the kernel refused GSO) */
+static void send_split(worker_t *w, struct msghdr *h) {
+    for (size_t i = 0; i < h->msg_iovlen; i++) {
+        if (sendto(w->udp_fd, h->msg_iov[i].iov_base, h->msg_iov[i].iov_len, 0,
+                   h->msg_name, h->msg_namelen) < 0) {
+            STAT_ADD(w, dropped, 1);
+        }
+    }
+}
+
+static void batch_flush(worker_t *w) {
+    tx_batch_t *b = &w->tx;
+    int off = 0;
+
+    for (int m = 0; m < b->nmsgs; m++) {
+        struct msghdr *h = &b->msgs[m].msg_hdr;
+        STAT_ADD(w, tx_datagrams, h->msg_iovlen);
+        if (h->msg_iovlen > 1) {
+            struct cmsghdr *c = (struct cmsghdr *)b->cmsg[m];
+            c->cmsg_level = SOL_UDP;
+            c->cmsg_type = UDP_SEGMENT;
+            c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t seg = (uint16_t)b->seg_size[m];
+            memcpy(CMSG_DATA(c), &seg, sizeof(seg));
+            h->msg_control = b->cmsg[m];
+            h->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            STAT_ADD(w, tx_gso, 1);
+        }
+    }
+
+    while (off < b->nmsgs) {
+        int sent = sendmmsg(w->udp_fd, &b->msgs[off], b->nmsgs - off, 0);
+        STAT_ADD(w, tx_syscalls, 1);
+        if (sent > 0) {
+            off += sent;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            struct pollfd pfd = { .fd = w->udp_fd, .events = POLLOUT };
+            if (poll(&pfd, 1, 100) > 0) {
+                continue;
+            }
+        }
+
+        /* The first message failed; retry it without GSO or drop it */
+        struct msghdr *h = &b->msgs[off].msg_hdr;
+        if (h->msg_iovlen > 1 && (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP)) {
+            if (w->gso) {
+                NB_LOG_WARN("UDP GSO not usable on %s (%s), sending segments separately",
+                            w->dev->name, strerror(errno));
+                w->gso = 0;
+            }
+            send_split(w, h);
+        } else {
+            STAT_ADD(w, dropped, h->msg_iovlen);
+        }
+        off++;
+    }
+    batch_reset(b);
+}
+
+/* Encrypt packets for one peer into the batch; pkts[i] may be reused afterwards */
+static void seal_into_batch(worker_t *w, const send_ctx_t *ctx, uint8_t **pkts, const size_t *lens,
+                            int n, int *out_next) {
+    for (int i = 0; i < n; i++) {
+        if (*out_next == WG_USER_BATCH) {
+            batch_flush(w);
+            *out_next = 0;
+        }
+        uint8_t *out = w->out_buf + (size_t)(*out_next)++ * OUT_SLOT;
+        wg_noise_data_seal(out, pkts[i], lens[i], ctx->remote_index, ctx->counter + (uint64_t)i, ctx->key);
+        batch_add(w, &ctx->endpoint, out, wg_noise_data_len(lens[i]));
+    }
+    STAT_ADD(w, tx_packets, n);
+}
+
+/*
+ * Send the packets staged while handshaking, or a keepalive if there are
+ * none and keepalive_if_empty is set (confirms a new session to the responder)
+ */
+static void flush_staged(worker_t *w, peer_t *p, int64_t now, int keepalive_if_empty) {
+    uint8_t *pkts[WG_USER_STAGED_MAX];
+    size_t lens[WG_USER_STAGED_MAX];
+    size_t bytes = 0;
+    send_ctx_t ctx;
+    int n;
+
+    pthread_mutex_lock(&p->lock);
+    n = p->staged_count;
+    for (int i = 0; i < n; i++) {
+        pkts[i] = p->staged[i];
+        lens[i] = p->staged_len[i];
+        bytes += lens[i];
+    }
+    if ((n == 0 && !keepalive_if_empty) ||
+        !reserve(p, now, n ? n : 1, bytes, n > 0, &ctx)) {
+        pthread_mutex_unlock(&p->lock);
+        return;
+    }
+    p->staged_count = 0;
+    pthread_mutex_unlock(&p->lock);
+
+    int out_next = 0;
+    if (n == 0) {
+        uint8_t *none = NULL;
+        size_t zero = 0;
+        seal_into_batch(w, &ctx, &none, &zero, 1, &out_next);
+    } else {
+        seal_into_batch(w, &ctx, pkts, lens, n, &out_next);
+    }
+    batch_flush(w);
+    STAT_ADD(w, tx_bytes, bytes);
+
+    for (int i = 0; i < n; i++) {
+        free(pkts[i]);
+    }
+    memset(&ctx, 0, sizeof(ctx));
+}
+
+/* TUN -> UDP */
+
+static void tx_round(worker_t *w) {
+    struct wg_user *dev = w->dev;
+    uint8_t *pkts[WG_USER_BATCH];
+    size_t lens[WG_USER_BATCH];
+    uint32_t owner[WG_USER_BATCH];
+    int n = 0;
+
+    while (n < WG_USER_BATCH) {
+        pkts[n] = w->tun_buf + (size_t)n * PACKET_MAX;
+        ssize_t r = read(w->tun_fd, pkts[n], PACKET_MAX);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        lens[n++] = (size_t)r;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    int64_t now = now_ms();
+    int out_next = 0;
+
+    pthread_rwlock_rdlock(&dev->lock);
+    for (int i = 0; i < n; i++) {
+        owner[i] = route_packet(dev, pkts[i], lens[i]);
+    }
+
+    for (int i = 0; i < n;) {
+        int j = i + 1;
+        while (j < n && owner[j] == owner[i]) j++;
+
+        if (owner[i] == NO_PEER) {
+            STAT_ADD(w, dropped, j - i);
+            i = j;
+            continue;
+        }
+
+        peer_t *p = dev->slots[owner[i]];
+        uint8_t init[WG_MSG_INITIATION_LEN];
+        nb_endpoint_t ep;
+        send_ctx_t ctx;
+        size_t bytes = 0;
+
+        for (int k = i; k < j; k++) bytes += lens[k];
+
+        pthread_mutex_lock(&p->lock);
+        int ok = reserve(p, now, j - i, bytes, 1, &ctx);
+        if (!ok) {
+            for (int k = i; k < j; k++) stage(p, pkts[k], lens[k]);
+        }
+        int send_init = (!ok || ctx.rekey) && prepare_initiation(dev, p, now, init);
+        ep = p->endpoint;
+        pthread_mutex_unlock(&p->lock);
+
+        if (ok) {
+            seal_into_batch(w, &ctx, &pkts[i], &lens[i], j - i, &out_next);
+            STAT_ADD(w, tx_bytes, bytes);
+        }
+        if (send_init) {
+            send_raw(dev, w->udp_fd, &ep, init, sizeof(init));
+        }
+        i = j;
+    }
+    batch_flush(w);
+    pthread_rwlock_unlock(&dev->lock);
+}
+
+/* UDP -> TUN */
+
+/* Whether handshakes arrive fast enough to demand cookies */
+static int under_load(struct wg_user *dev, int64_t now) {
+    int64_t window = __atomic_load_n(&dev->load_window_ms, __ATOMIC_RELAXED);
+    if (now - window >= 1000) {
+        __atomic_store_n(&dev->load_window_ms, now, __ATOMIC_RELAXED);
+        __atomic_store_n(&dev->load_count, 0, __ATOMIC_RELAXED);
+    }
+    return __atomic_add_fetch(&dev->load_count, 1, __ATOMIC_RELAXED) > LOAD_HANDSHAKES;
+}
+
+/*
+ * mac1 and, under load, mac2 of a handshake message; answers with a
+ * cookie reply when mac2 is missing. Returns 1 if the message may be processed.
+ */
+static int handshake_allowed(worker_t *w, const uint8_t *msg, size_t len,
+                             const nb_endpoint_t *src, int64_t now) {
+    struct wg_user *dev = w->dev;
+
+    if (!wg_cookie_check_mac1(&dev->local, msg, len)) {
+        return 0;
+    }
+    if (!under_load(dev, now)) {
+        return 1;
+    }
+
+    uint8_t reply[WG_MSG_COOKIE_LEN];
+    pthread_mutex_lock(&dev->cookie_lock);
+    int ok = wg_cookie_check_mac2(&dev->checker, msg, len, src, now);
+    int send = !ok && wg_cookie_create_reply(&dev->checker, &dev->local, msg, len, get32_le(msg + 4),
+                                             src, now, reply) == NB_SUCCESS;
+    pthread_mutex_unlock(&dev->cookie_lock);
+
+    if (send && send_raw(dev, w->udp_fd, src, reply, sizeof(reply)) == NB_SUCCESS) {
+        STAT_ADD(w, cookies_sent, 1);
+    }
+    return ok;
+}
+
+static void rx_initiation(worker_t *w, const uint8_t *msg, const nb_endpoint_t *src, int64_t now) {
+    struct wg_user *dev = w->dev;
+    wg_noise_initiation_t in;
+    uint8_t resp[WG_MSG_RESPONSE_LEN];
+
+    if (!handshake_allowed(w, msg, WG_MSG_INITIATION_LEN, src, now) ||
+        wg_noise_consume_initiation(&dev->local, msg, &in) != NB_SUCCESS) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+
+    nb_peer_record_t *rec = nb_peer_table_find(dev->table, in.remote_static);
+    peer_t *p = rec && rec->id < dev->nslots ? dev->slots[rec->id] : NULL;
+    if (!p) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    int ok = wg_noise_accept_initiation(&p->hs, &in, msg, now) == NB_SUCCESS &&
+             wg_noise_create_response(&p->hs, new_index(p), resp) == NB_SUCCESS;
+    if (ok) {
+        wg_noise_keypair_t kp;
+        wg_noise_derive_keypair(&p->hs, &kp, now);
+        p->next = kp;
+        memset(&p->previous, 0, sizeof(p->previous));
+        memset(&kp, 0, sizeof(kp));
+        wg_cookie_add_macs(&p->cookie, p->hs.remote_mac1_key, resp, sizeof(resp), now);
+        p->endpoint = *src;
+        p->last_sent_ms = now;
+        p->data_unanswered_ms = 0;
+        p->recv_unanswered_ms = 0;
+    } else {
+        wg_noise_handshake_clear(&p->hs);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    memset(&in, 0, sizeof(in));
+    if (!ok) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+    send_raw(dev, w->udp_fd, src, resp, sizeof(resp));
+}
+
+static void rx_response(worker_t *w, const uint8_t *msg, const nb_endpoint_t *src, int64_t now) {
+    struct wg_user *dev = w->dev;
+
+    if (!handshake_allowed(w, msg, WG_MSG_RESPONSE_LEN, src, now)) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+
+    peer_t *p = peer_by_index(dev, get32_le(msg + 8));
+    if (!p) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    int ok = wg_noise_consume_response(&p->hs, &dev->local, msg) == NB_SUCCESS;
+    if (ok) {
+        wg_noise_keypair_t kp;
+        wg_noise_derive_keypair(&p->hs, &kp, now);
+        if (p->next.valid) {
+            p->previous = p->next;
+            memset(&p->next, 0, sizeof(p->next));
+        } else {
+            p->previous = p->current;
+        }
+        p->current = kp;
+        memset(&kp, 0, sizeof(kp));
+        p->endpoint = *src;
+        p->attempt_start_ms = 0;
+        p->data_unanswered_ms = 0;
+        p->handshake_unix = time(NULL);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (!ok) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+    STAT_ADD(w, handshakes, 1);
+    flush_staged(w, p, now, 1);
+}
+
+static void rx_cookie(worker_t *w, const uint8_t *msg, int64_t now) {
+    peer_t *p = peer_by_index(w->dev, get32_le(msg + 4));
+    int ok = 0;
+
+    if (p) {
+        pthread_mutex_lock(&p->lock);
+        ok = wg_cookie_consume_reply(&p->cookie, p->hs.remote_cookie_key, msg, now) == NB_SUCCESS;
+        pthread_mutex_unlock(&p->lock);
+    }
+    if (!ok) {
+        STAT_ADD(w, dropped, 1);
+    }
+}
+
+static void rx_data(worker_t *w, const uint8_t *msg, size_t len, const nb_endpoint_t *src, int64_t now) {
+    struct wg_user *dev = w->dev;
+    uint32_t index = wg_noise_data_index(msg);
+    uint64_t counter = wg_noise_data_counter(msg);
+    peer_t *p = peer_by_index(dev, index);
+    wg_noise_keypair_t *kp;
+    uint8_t key[32];
+    size_t plain_len;
+
+    if (!p) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    kp = keypair_by_index(p, index, now);
+    if (kp) {
+        memcpy(key, kp->recv_key, sizeof(key));
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (!kp) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+
+    int ret = wg_noise_data_open(w->plain, msg, len, key, &plain_len);
+    memset(key, 0, sizeof(key));
+    if (ret != NB_SUCCESS) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+
+    uint8_t init[WG_MSG_INITIATION_LEN];
+    int send_init = 0;
+    int confirmed = 0;
+    nb_endpoint_t ep;
+
+    /* The session may have changed while decrypting; look it up again */
+    pthread_mutex_lock(&p->lock);
+    kp = keypair_by_index(p, index, now);
+    if (!kp || !wg_replay_check(&kp->replay, counter)) {
+        pthread_mutex_unlock(&p->lock);
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+    if (kp == &p->next) {
+        /* First packet on the session we answered: the initiator has confirmed it */
+        p->previous = p->current;
+        p->current = p->next;
+        memset(&p->next, 0, sizeof(p->next));
+        kp = &p->current;
+        p->attempt_start_ms = 0;
+        p->handshake_unix = time(NULL);
+        confirmed = 1;
+    }
+    p->endpoint = *src;
+    p->rx_bytes += len;
+    p->data_unanswered_ms = 0;
+    if (plain_len > 0 && !p->recv_unanswered_ms) {
+        p->recv_unanswered_ms = now;
+    }
+    if (kp == &p->current && kp->initiator &&
+        now - kp->birth_ms >= WG_REJECT_AFTER_TIME_MS - WG_KEEPALIVE_TIMEOUT_MS - WG_REKEY_TIMEOUT_MS) {
+        send_init = prepare_initiation(dev, p, now, init);
+    }
+    ep = p->endpoint;
+    uint32_t slot = p->slot;
+    pthread_mutex_unlock(&p->lock);
+
+    if (confirmed) {
+        STAT_ADD(w, handshakes, 1);
+        flush_staged(w, p, now, 0);
+    }
+    if (send_init) {
+        send_raw(dev, w->udp_fd, &ep, init, sizeof(init));
+    }
+
+    STAT_ADD(w, rx_packets, 1);
+    if (plain_len == 0) {
+        return;             /* Keepalive */
+    }
+
+    /* The inner source must be one of the peer's allowed IPs */
+    nb_prefix_t srcip;
+    uint32_t owner;
+    size_t ip_len = packet_addr(w->plain, plain_len, 0, &srcip);
+    if (!ip_len || nb_lpm_lookup(dev->allowed, &srcip, &owner, NULL) != NB_SUCCESS || owner != slot) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+    if (write(w->tun_fd, w->plain, ip_len) < 0) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+    STAT_ADD(w, rx_bytes, ip_len);
+}
+
+static void rx_packet(worker_t *w, const uint8_t *msg, size_t len, const nb_endpoint_t *src, int64_t now) {
+    if (len < 4 || msg[1] || msg[2] || msg[3]) {
+        STAT_ADD(w, dropped, 1);
+        return;
+    }
+
+    switch (msg[0]) {
+    case WG_MSG_DATA:
+        if (len >= WG_DATA_MIN_LEN) {
+            rx_data(w, msg, len, src, now);
+            return;
+        }
+        break;
+    case WG_MSG_INITIATION:
+        if (len == WG_MSG_INITIATION_LEN) {
+            rx_initiation(w, msg, src, now);
+            return;
+        }
+        break;
+    case WG_MSG_RESPONSE:
+        if (len == WG_MSG_RESPONSE_LEN) {
+            rx_response(w, msg, src, now);
+            return;
+        }
+        break;
+    case WG_MSG_COOKIE:
+        if (len == WG_MSG_COOKIE_LEN) {
+            rx_cookie(w, msg, now);
+            return;
+        }
+        break;
+    }
+    STAT_ADD(w, dropped, 1);
+}
+
+static void rx_round(worker_t *w) {
+    struct wg_user *dev = w->dev;
+
+    for (int i = 0; i < WG_USER_RX_BATCH; i++) {
+        struct msghdr *h = &w->rx_msgs[i].msg_hdr;
+        h->msg_name = &w->rx_addrs[i];
+        h->msg_namelen = sizeof(w->rx_addrs[i]);
+        h->msg_iov = &w->rx_iov[i];
+        h->msg_iovlen = 1;
+        h->msg_control = w->rx_cmsg[i];
+        h->msg_controllen = sizeof(w->rx_cmsg[i]);
+        h->msg_flags = 0;
+    }
+
+    int n = recvmmsg(w->udp_fd, w->rx_msgs, WG_USER_RX_BATCH, MSG_DONTWAIT, NULL);
+    if (n <= 0) {
+        return;
+    }
+    STAT_ADD(w, rx_syscalls, 1);
+    STAT_ADD(w, rx_datagrams, n);
+
+    int64_t now = now_ms();
+    pthread_rwlock_rdlock(&dev->lock);
+    for (int i = 0; i < n; i++) {
+        struct msghdr *h = &w->rx_msgs[i].msg_hdr;
+        size_t len = w->rx_msgs[i].msg_len;
+        size_t seg = len;
+        nb_endpoint_t src;
+
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(h); c; c = CMSG_NXTHDR(h, c)) {
+            if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+                int gso;
+                memcpy(&gso, CMSG_DATA(c), sizeof(gso));
+                if (gso > 0) seg = (size_t)gso;
+            }
+        }
+        if (seg < len) {
+            STAT_ADD(w, rx_gro, 1);
+        }
+
+        from_sockaddr(&w->rx_addrs[i], &src);
+        const uint8_t *buf = w->rx_iov[i].iov_base;
+        for (size_t off = 0; off < len; off += seg) {
+            rx_packet(w, buf + off, len - off < seg ? len - off : seg, &src, now);
+        }
+    }
+    pthread_rwlock_unlock(&dev->lock);
+}
+
+static void* worker_main(void *arg) {
+    worker_t *w = arg;
+    struct pollfd pfd[3] = {
+        { .fd = w->tun_fd, .events = POLLIN },
+        { .fd = w->udp_fd, .events = POLLIN },
+        { .fd = w->dev->stop_fd, .events = POLLIN },
+    };
+
+    for (;;) {
+        if (poll(pfd, 3, -1) < 0) {
+            if (errno == EINTR) continue;
+            NB_LOG_ERROR("poll failed: %s", strerror(errno));
+            break;
+        }
+        if (pfd[2].revents) {
+            break;
+        }
+        if (pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            /* Interface deleted under us (e.g. "ip link del") */
+            NB_LOG_WARN("TUN queue of %s closed, stopping worker %d", w->dev->name, w->index);
+            break;
+        }
+        if (pfd[1].revents & POLLIN) {
+            rx_round(w);
+        }
+        if (pfd[0].revents & POLLIN) {
+            tx_round(w);
+        }
+    }
+    return NULL;
+}
+
+/* Timers (whitepaper 6.2 - 6.5) */
+
+static void timers_peer(struct wg_user *dev, peer_t *p, int64_t now, unsigned int *seed) {
+    uint8_t init[WG_MSG_INITIATION_LEN];
+    uint8_t keepalive[WG_DATA_MIN_LEN];
+    int send_init = 0;
+    int send_keepalive = 0;
+    send_ctx_t ctx;
+    nb_endpoint_t ep;
+
+    pthread_mutex_lock(&p->lock);
+
+    /* Retransmit the initiation, or give up after REKEY_ATTEMPT_TIME */
+    if (p->attempt_start_ms) {
+        if (now - p->attempt_start_ms >= WG_REKEY_ATTEMPT_TIME_MS) {
+            p->attempt_start_ms = 0;
+            wg_noise_handshake_clear(&p->hs);
+            staged_clear(p);
+        } else if (now - p->handshake_sent_ms >= WG_REKEY_TIMEOUT_MS + (int64_t)(rand_r(seed) % 334)) {
+            send_init = prepare_initiation(dev, p, now, init);
+        }
+    }
+
+    /* Data went out but nothing came back: start over */
+    if (!send_init && p->data_unanswered_ms &&
+        now - p->data_unanswered_ms >= WG_KEEPALIVE_TIMEOUT_MS + WG_REKEY_TIMEOUT_MS) {
+        p->data_unanswered_ms = 0;
+        send_init = prepare_initiation(dev, p, now, init);
+    }
+
+    /* Passive keepalive after receiving data we did not answer */
+    if (p->recv_unanswered_ms && now - p->recv_unanswered_ms >= WG_KEEPALIVE_TIMEOUT_MS) {
+        send_keepalive = 1;
+    }
+
+    /* Persistent keepalive */
+    if (p->keepalive > 0 && now - p->last_sent_ms >= (int64_t)p->keepalive * 1000) {
+        send_keepalive = 1;
+    }
+
+    if (send_keepalive) {
+        send_keepalive = reserve(p, now, 1, 0, 0, &ctx);
+        if (!send_keepalive && !send_init) {
+            send_init = prepare_initiation(dev, p, now, init);
+        }
+    }
+
+    /* Wipe sessions nobody renewed */
+    if (p->current.valid && now - p->current.birth_ms >= KEY_ZERO_AFTER_MS) {
+        memset(&p->current, 0, sizeof(p->current));
+        memset(&p->previous, 0, sizeof(p->previous));
+        memset(&p->next, 0, sizeof(p->next));
+        wg_noise_handshake_clear(&p->hs);
+    }
+
+    ep = p->endpoint;
+    pthread_mutex_unlock(&p->lock);
+
+    int fd = dev->workers[0].udp_fd;
+    if (send_init) {
+        send_raw(dev, fd, &ep, init, sizeof(init));
+    }
+    if (send_keepalive) {
+        wg_noise_data_seal(keepalive, NULL, 0, ctx.remote_index, ctx.counter, ctx.key);
+        send_raw(dev, fd, &ctx.endpoint, keepalive, sizeof(keepalive));
+        memset(&ctx, 0, sizeof(ctx));
+    }
+}
+
+static void* timer_main(void *arg) {
+    struct wg_user *dev = arg;
+    struct pollfd pfd = { .fd = dev->stop_fd, .events = POLLIN };
+    unsigned int seed = (unsigned int)now_ms();
+
+    for (;;) {
+        int r = poll(&pfd, 1, TIMER_INTERVAL_MS);
+        if (r > 0) break;
+        if (r < 0 && errno != EINTR) break;
+
+        int64_t now = now_ms();
+        pthread_rwlock_rdlock(&dev->lock);
+        for (uint32_t i = 0; i < dev->nslots; i++) {
+            if (dev->slots[i]) {
+                timers_peer(dev, dev->slots[i], now, &seed);
+            }
+        }
+        pthread_rwlock_unlock(&dev->lock);
+    }
+    return NULL;
+}
+
+/* Setup */
+
+static int tun_open_queue(const char *ifname, int *fd_out) {
+    struct ifreq ifr;
+    int fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) {
+        NB_LOG_ERROR("Failed to open /dev/net/tun: %s", strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TUN | IFF_NO_PI | IFF_MULTI_QUEUE;
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+        int err = errno;
+        NB_LOG_ERROR("TUNSETIFF %s failed: %s", ifname, strerror(err));
+        close(fd);
+        return err == EBUSY || err == EEXIST ? NB_ERROR_EXISTS : NB_ERROR_SYSTEM;
+    }
+
+    *fd_out = fd;
+    return NB_SUCCESS;
+}
+
+static int tun_set_mtu(const char *ifname, int mtu) {
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    ifr.ifr_mtu = mtu;
+    int ret = ioctl(fd, SIOCSIFMTU, &ifr) < 0 ? NB_ERROR_SYSTEM : NB_SUCCESS;
+    close(fd);
+    return ret;
+}
+
+static void socket_buffers(int fd) {
+    int size = SOCKET_BUFFER;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+}
+
+/* One SO_REUSEPORT socket on the listen port (picked by the first socket if 0) */
+static int udp_open(struct wg_user *dev, worker_t *w) {
+    int one = 1, zero = 0;
+    int fd = -1;
+
+    if (dev->family != AF_INET) {
+        fd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd >= 0) {
+            dev->family = AF_INET6;
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        }
+    }
+    if (fd < 0) {
+        fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        dev->family = AF_INET;
+    }
+    if (fd < 0) {
+        NB_LOG_ERROR("socket failed: %s", strerror(errno));
+        return NB_ERROR_SYSTEM;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    socket_buffers(fd);
+
+    struct sockaddr_storage ss;
+    socklen_t sl;
+    memset(&ss, 0, sizeof(ss));
+    if (dev->family == AF_INET6) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons((uint16_t)dev->listen_port);
+        sl = sizeof(*sin6);
+    } else {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons((uint16_t)dev->listen_port);
+        sl = sizeof(*sin);
+    }
+    if (bind(fd, (struct sockaddr *)&ss, sl) < 0) {
+        int err = errno;
+        NB_LOG_ERROR("Failed to bind UDP port %d: %s", dev->listen_port, strerror(err));
+        close(fd);
+        return err == EADDRINUSE ? NB_ERROR_EXISTS : NB_ERROR_SYSTEM;
+    }
+    if (dev->listen_port == 0) {
+        sl = sizeof(ss);
+        getsockname(fd, (struct sockaddr *)&ss, &sl);
+        dev->listen_port = ntohs(ss.ss_family == AF_INET6 ? ((struct sockaddr_in6 *)&ss)->sin6_port
+                                                          : ((struct sockaddr_in *)&ss)->sin_port);
+    }
+
+    /* Offloads are optional; fall back to one datagram per packet */
+    setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one));
+    w->gso = setsockopt(fd, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)) == 0;
+    w->udp_fd = fd;
+    return NB_SUCCESS;
+}
+
+static int worker_init(struct wg_user *dev, worker_t *w) {
+    w->tun_buf = malloc((size_t)WG_USER_BATCH * PACKET_MAX);
+    w->out_buf = malloc((size_t)WG_USER_BATCH * OUT_SLOT);
+    w->rx_buf = malloc((size_t)WG_USER_RX_BATCH * DATAGRAM_MAX);
+    w->plain = malloc(DATAGRAM_MAX);
+    if (!w->tun_buf || !w->out_buf || !w->rx_buf || !w->plain) {
+        NB_LOG_ERROR("malloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    for (int i = 0; i < WG_USER_RX_BATCH; i++) {
+        w->rx_iov[i].iov_base = w->rx_buf + (size_t)i * DATAGRAM_MAX;
+        w->rx_iov[i].iov_len = DATAGRAM_MAX;
+    }
+
+    int ret = tun_open_queue(dev->name, &w->tun_fd);
+    if (ret == NB_SUCCESS) {
+        ret = udp_open(dev, w);
+    }
+    return ret;
+}
+
+int wg_user_open(const char *ifname, const uint8_t private_key[WG_KEY_LEN],
+                 int listen_port, int workers, wg_user_t **dev_out) {
+    if (!ifname || !private_key || !dev_out || strlen(ifname) >= IFNAMSIZ ||
+        listen_port < 0 || listen_port > 65535) {
+        NB_LOG_ERROR("Invalid arguments");
+        return NB_ERROR_INVALID;
+    }
+
+    /* TUNSETIFF would attach to an existing multiqueue TUN instead of failing */
+    if (if_nametoindex(ifname) != 0) {
+        NB_LOG_ERROR("Interface %s already exists", ifname);
+        return NB_ERROR_EXISTS;
+    }
+
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    if (workers > WG_USER_MAX_WORKERS) {
+        workers = WG_USER_MAX_WORKERS;
+    }
+
+    struct wg_user *dev = calloc(1, sizeof(*dev));
+    if (!dev) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    snprintf(dev->name, sizeof(dev->name), "%s", ifname);
+    dev->listen_port = listen_port;
+    dev->stop_fd = -1;
+
+    /* Prefer writers so configuration is not starved by busy workers */
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&dev->lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    pthread_mutex_init(&dev->cookie_lock, NULL);
+
+    wg_noise_static_init(&dev->local, private_key);
+    dev->table = nb_peer_table_new(0);
+    dev->allowed = nb_lpm_new();
+    dev->workers = calloc((size_t)workers, sizeof(worker_t));
+    dev->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    int ret = NB_SUCCESS;
+    if (!dev->table || !dev->allowed || !dev->workers || dev->stop_fd < 0) {
+        NB_LOG_ERROR("Failed to allocate userspace device");
+        ret = NB_ERROR_SYSTEM;
+    }
+
+    for (int i = 0; ret == NB_SUCCESS && i < workers; i++) {
+        worker_t *w = &dev->workers[i];
+        w->dev = dev;
+        w->index = i;
+        w->tun_fd = -1;
+        w->udp_fd = -1;
+        dev->nworkers++;
+        ret = worker_init(dev, w);
+    }
+
+    if (ret == NB_SUCCESS && tun_set_mtu(ifname, WG_USER_MTU) != NB_SUCCESS) {
+        NB_LOG_WARN("Failed to set MTU of %s to %d: %s", ifname, WG_USER_MTU, strerror(errno));
+    }
+
+    for (int i = 0; ret == NB_SUCCESS && i < dev->nworkers; i++) {
+        worker_t *w = &dev->workers[i];
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            NB_LOG_ERROR("pthread_create failed");
+            ret = NB_ERROR_SYSTEM;
+        } else {
+            w->started = 1;
+        }
+    }
+    if (ret == NB_SUCCESS) {
+        if (pthread_create(&dev->timer, NULL, timer_main, dev) != 0) {
+            NB_LOG_ERROR("pthread_create failed");
+            ret = NB_ERROR_SYSTEM;
+        } else {
+            dev->timer_started = 1;
+        }
+    }
+
+    if (ret != NB_SUCCESS) {
+        wg_user_close(dev);
+        return ret;
+    }
+
+    NB_LOG_INFO("Userspace WireGuard on %s: port %d, %d worker(s), GSO %s",
+                ifname, dev->listen_port, dev->nworkers, dev->workers[0].gso ? "on" : "off");
+    *dev_out = dev;
+    return NB_SUCCESS;
+}
+
+static void peer_free(peer_t *p) {
+    staged_clear(p);
+    pthread_mutex_destroy(&p->lock);
+    memset(p, 0, sizeof(*p));
+    free(p);
+}
+
+void wg_user_close(wg_user_t *dev) {
+    if (!dev) return;
+
+    if (dev->stop_fd >= 0) {
+        uint64_t one = 1;
+        if (write(dev->stop_fd, &one, sizeof(one)) < 0) {
+            NB_LOG_WARN("Failed to signal workers: %s", strerror(errno));
+        }
+    }
+    if (dev->timer_started) {
+        pthread_join(dev->timer, NULL);
+    }
+    for (int i = 0; i < dev->nworkers; i++) {
+        worker_t *w = &dev->workers[i];
+        if (w->started) {
+            pthread_join(w->thread, NULL);
+        }
+        if (w->tun_fd >= 0) close(w->tun_fd);
+        if (w->udp_fd >= 0) close(w->udp_fd);
+        free(w->tun_buf);
+        free(w->out_buf);
+        free(w->rx_buf);
+        free(w->plain);
+    }
+    if (dev->stop_fd >= 0) {
+        close(dev->stop_fd);
+    }
+
+    for (uint32_t i = 0; i < dev->nslots; i++) {
+        if (dev->slots[i]) {
+            peer_free(dev->slots[i]);
+        }
+    }
+    free(dev->slots);
+    free(dev->workers);
+    nb_peer_table_free(dev->table);
+    nb_lpm_free(dev->allowed);
+    pthread_rwlock_destroy(&dev->lock);
+    pthread_mutex_destroy(&dev->cookie_lock);
+    memset(&dev->local, 0, sizeof(dev->local));
+    memset(&dev->checker, 0, sizeof(dev->checker));
+    free(dev);
+}
+
+int wg_user_listen_port(const wg_user_t *dev) {
+    return dev ? dev->listen_port : -1;
+}
+
+/* Configuration (dev->lock held for writing) */
+
+/* Drop the trie entries a record owns; prefixes reassigned to another peer stay */
+static void unroute(struct wg_user *dev, const nb_peer_record_t *rec) {
+    const nb_prefix_t *ips = nb_peer_table_allowed_ips(dev->table, rec);
+
+    for (int i = 0; i < rec->ips_count; i++) {
+        nb_prefix_t match;
+        uint32_t owner;
+        if (nb_lpm_lookup(dev->allowed, &ips[i], &owner, &match) == NB_SUCCESS &&
+            owner == rec->id && match.len == ips[i].len) {
+            nb_lpm_remove(dev->allowed, &ips[i]);
+        }
+    }
+}
+
+static int slots_reserve(struct wg_user *dev, uint32_t id) {
+    if (id < dev->nslots) {
+        return NB_SUCCESS;
+    }
+    if (id > SLOT_MASK) {
+        return NB_ERROR_SYSTEM;
+    }
+
+    uint32_t cap = dev->nslots ? dev->nslots : 16;
+    while (cap <= id) cap *= 2;
+    peer_t **slots = realloc(dev->slots, cap * sizeof(*slots));
+    if (!slots) {
+        return NB_ERROR_SYSTEM;
+    }
+    memset(slots + dev->nslots, 0, (cap - dev->nslots) * sizeof(*slots));
+    dev->slots = slots;
+    dev->nslots = cap;
+    return NB_SUCCESS;
+}
+
+static int apply_one(struct wg_user *dev, const wg_peer_spec_t *spec) {
+    nb_peer_record_t *rec = nb_peer_table_find(dev->table, spec->public_key);
+
+    if (spec->remove) {
+        if (rec) {
+            uint32_t id = rec->id;
+            unroute(dev, rec);
+            nb_peer_table_remove(dev->table, spec->public_key);
+            if (id < dev->nslots && dev->slots[id]) {
+                peer_free(dev->slots[id]);
+                dev->slots[id] = NULL;
+            }
+        }
+        return NB_SUCCESS;
+    }
+
+    /* Like the kernel, silently ignore our own key */
+    if (wg_key_equal(spec->public_key, dev->local.public_key)) {
+        return NB_SUCCESS;
+    }
+
+    nb_endpoint_t ep;
+    memset(&ep, 0, sizeof(ep));
+    if (spec->endpoint.sa.sa_family) {
+        ep = spec->endpoint;
+    } else if (rec) {
+        ep = rec->endpoint;
+    }
+    int keepalive = spec->keepalive >= 0 ? spec->keepalive : rec ? rec->keepalive : 0;
+
+    if (rec && spec->allowed_ips) {
+        unroute(dev, rec);
+    }
+    int ret = nb_peer_table_upsert(dev->table, spec->public_key, ep.sa.sa_family ? &ep : NULL,
+                                   keepalive, spec->allowed_ips,
+                                   spec->allowed_ips ? spec->allowed_ips_count : -1);
+    if (ret != NB_SUCCESS) {
+        return ret;
+    }
+    rec = nb_peer_table_find(dev->table, spec->public_key);
+    uint32_t id = rec->id;
+
+    if (slots_reserve(dev, id) != NB_SUCCESS) {
+        nb_peer_table_remove(dev->table, spec->public_key);
+        return NB_ERROR_SYSTEM;
+    }
+
+    peer_t *p = dev->slots[id];
+    if (!p) {
+        p = calloc(1, sizeof(*p));
+        if (!p) {
+            nb_peer_table_remove(dev->table, spec->public_key);
+            return NB_ERROR_SYSTEM;
+        }
+        pthread_mutex_init(&p->lock, NULL);
+        p->slot = id;
+        memcpy(p->public_key, spec->public_key, WG_KEY_LEN);
+        /* Like the kernel, accept a low-order key; its handshakes just never succeed */
+        if (wg_noise_handshake_init(&p->hs, &dev->local, spec->public_key, NULL) != NB_SUCCESS) {
+            NB_LOG_WARN("Peer key is a low-order point, handshakes with it will fail");
+        }
+        dev->slots[id] = p;
+    }
+
+    if (spec->has_preshared_key) {
+        memcpy(p->hs.preshared_key, spec->preshared_key, WG_KEY_LEN);
+    }
+    if (spec->endpoint.sa.sa_family) {
+        p->endpoint = spec->endpoint;
+    }
+    if (spec->keepalive >= 0) {
+        p->keepalive = spec->keepalive;
+    }
+    for (int i = 0; spec->allowed_ips && i < spec->allowed_ips_count; i++) {
+        ret = nb_lpm_insert(dev->allowed, &spec->allowed_ips[i], id);
+        if (ret != NB_SUCCESS) {
+            return ret;
+        }
+    }
+    return NB_SUCCESS;
+}
+
+int wg_user_apply_peers(wg_user_t *dev, const wg_peer_spec_t *specs, int count, int *errors) {
+    if (!dev || (!specs && count > 0) || count < 0) {
+        return count > 0 ? count : 0;
+    }
+
+    int failed = 0;
+    pthread_rwlock_wrlock(&dev->lock);
+    for (int i = 0; i < count; i++) {
+        int ret = apply_one(dev, &specs[i]);
+        if (errors) {
+            errors[i] = ret;
+        }
+        if (ret != NB_SUCCESS) {
+            failed++;
+        }
+    }
+    pthread_rwlock_unlock(&dev->lock);
+    return failed;
+}
+
+int wg_user_get_device(wg_user_t *dev, wg_device_t **dev_out) {
+    if (!dev || !dev_out) {
+        return NB_ERROR_INVALID;
+    }
+
+    wg_device_t *out = calloc(1, sizeof(*out));
+    if (!out) {
+        NB_LOG_ERROR("calloc failed");
+        return NB_ERROR_SYSTEM;
+    }
+    snprintf(out->name, sizeof(out->name), "%s", dev->name);
+    out->ifindex = if_nametoindex(dev->name);
+    memcpy(out->private_key, dev->local.private_key, WG_KEY_LEN);
+    memcpy(out->public_key, dev->local.public_key, WG_KEY_LEN);
+    out->listen_port = dev->listen_port;
+
+    int ret = NB_SUCCESS;
+    pthread_rwlock_rdlock(&dev->lock);
+    int count = nb_peer_table_count(dev->table);
+    if (count > 0) {
+        out->peers = calloc((size_t)count, sizeof(wg_device_peer_t));
+        if (!out->peers) {
+            ret = NB_ERROR_SYSTEM;
+        }
+    }
+    for (int i = 0; ret == NB_SUCCESS && i < count; i++) {
+        const nb_peer_record_t *rec = nb_peer_table_at(dev->table, i);
+        peer_t *p = rec->id < dev->nslots ? dev->slots[rec->id] : NULL;
+        wg_device_peer_t *dp = &out->peers[out->peer_count];
+        if (!p) continue;
+
+        memcpy(dp->public_key, rec->public_key, WG_KEY_LEN);
+        if (rec->ips_count > 0) {
+            dp->allowed_ips = malloc(rec->ips_count * sizeof(nb_prefix_t));
+            if (!dp->allowed_ips) {
+                ret = NB_ERROR_SYSTEM;
+                break;
+            }
+            memcpy(dp->allowed_ips, nb_peer_table_allowed_ips(dev->table, rec),
+                   rec->ips_count * sizeof(nb_prefix_t));
+            dp->allowed_ips_count = rec->ips_count;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        memcpy(dp->preshared_key, p->hs.preshared_key, WG_KEY_LEN);
+        dp->endpoint = p->endpoint;
+        dp->keepalive = p->keepalive;
+        dp->last_handshake = p->handshake_unix;
+        dp->rx_bytes = p->rx_bytes;
+        dp->tx_bytes = p->tx_bytes;
+        pthread_mutex_unlock(&p->lock);
+        out->peer_count++;
+    }
+    pthread_rwlock_unlock(&dev->lock);
+
+    if (ret != NB_SUCCESS) {
+        NB_LOG_ERROR("Failed to allocate device dump");
+        wg_device_free(out);
+        return ret;
+    }
+    *dev_out = out;
+    return NB_SUCCESS;
+}
+
+void wg_user_get_stats(wg_user_t *dev, wg_user_stats_t *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!dev) return;
+
+    for (int i = 0; i < dev->nworkers; i++) {
+        const uint64_t *src = (const uint64_t *)&dev->workers[i].stats;
+        uint64_t *dst = (uint64_t *)out;
+        for (size_t k = 0; k < sizeof(*out) / sizeof(uint64_t); k++) {
+            dst[k] += __atomic_load_n(&src[k], __ATOMIC_RELAXED);
+        }
+    }
+}
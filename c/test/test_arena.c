@@ -0,0 +1,151 @@
+/**
+ * test_arena.c - Test program for the snapshot arena
+ *
+ * Checks alignment, block growth, oversized requests, overflow handling,
+ * reuse after nb_arena_free() and that peers_file_load() builds its whole
+ * snapshot in the arena.
+ *
+ * Usage: ./test_arena
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "arena.h"
+#include "peers_file.h"
+#include <stdalign.h>
+#include <stdint.h>
+
+static int result(int ok, int *failed) {
+    if (!ok) {
+        printf("  FAILED\n");
+        (*failed)++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+    return ok;
+}
+
+int main(void) {
+    int failed = 0;
+    nb_arena_t arena;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Arena Test\n");
+    printf("================================================================================\n\n");
+
+    /* Test 1: Allocations are aligned for any type, strings are packed */
+    printf("[Test 1] Alignment...\n");
+    nb_arena_init(&arena, 0);
+    int ok = arena.blocks == 0 && arena.head == NULL;
+    char *s1 = nb_arena_strdup(&arena, "abc");
+    char *s2 = nb_arena_strdup(&arena, "de");
+    double *d = nb_arena_alloc(&arena, sizeof(double));
+    uint64_t *z = nb_arena_calloc(&arena, 4, sizeof(uint64_t));
+    ok = ok && s1 && s2 && d && z && s2 == s1 + 4 && strcmp(s1, "abc") == 0 && strcmp(s2, "de") == 0 &&
+         (uintptr_t)d % alignof(max_align_t) == 0 && (uintptr_t)z % alignof(max_align_t) == 0 &&
+         z[0] == 0 && z[3] == 0 && arena.blocks == 1 && nb_arena_strdup(&arena, NULL) == NULL;
+    printf("  %zu bytes used in %d block(s)\n", arena.used, arena.blocks);
+    nb_arena_free(&arena);
+    ok = ok && arena.head == NULL && arena.blocks == 0 && arena.used == 0;
+    result(ok, &failed);
+
+    /* Test 2: Blocks grow geometrically, earlier pointers stay valid */
+    printf("[Test 2] Block growth...\n");
+    nb_arena_init(&arena, 0);
+    char *first = nb_arena_strdup(&arena, "first");
+    ok = 1;
+    for (int i = 0; i < 100000; i++) {
+        int *p = nb_arena_alloc(&arena, sizeof(int));
+        if (!p) {
+            ok = 0;
+            break;
+        }
+        *p = i;
+    }
+    ok = ok && first && strcmp(first, "first") == 0 && arena.blocks > 1 && arena.blocks <= 12 &&
+         arena.used <= arena.reserved;
+    printf("  100000 allocations in %d block(s), %zu of %zu bytes used\n",
+           arena.blocks, arena.used, arena.reserved);
+    nb_arena_free(&arena);
+    result(ok, &failed);
+
+    /* Test 3: An oversized request gets its own block */
+    printf("[Test 3] Oversized request...\n");
+    nb_arena_init(&arena, 0);
+    char *cur = nb_arena_alloc(&arena, 16);
+    int blocks = arena.blocks;
+    size_t big_size = 2 * NB_ARENA_BLOCK_MAX;
+    char *big = nb_arena_alloc(&arena, big_size);
+    char *after = nb_arena_alloc(&arena, 16);
+    ok = cur && big && after && arena.blocks == blocks + 1 &&
+         after == cur + 16;
+    if (big) memset(big, 0xab, big_size);
+    printf("  %zu MB block, later requests continue in the current block: %s\n",
+           big_size >> 20, ok ? "yes" : "no");
+    result(ok, &failed);
+
+    /* Test 4: Overflowing counts are rejected, the arena is reusable */
+    printf("[Test 4] Overflow and reuse...\n");
+    ok = nb_arena_calloc(&arena, SIZE_MAX / 2, 4) == NULL && nb_arena_alloc(&arena, SIZE_MAX) == NULL &&
+         nb_arena_alloc(NULL, 8) == NULL;
+    nb_arena_free(&arena);
+    ok = ok && arena.blocks == 0 && nb_arena_strdup(&arena, "again") != NULL && arena.blocks == 1;
+    nb_arena_free(&arena);
+    nb_arena_free(NULL);
+    result(ok, &failed);
+
+    /* Test 5: peers.json loads into a single arena */
+    printf("[Test 5] peers_file_load() snapshot...\n");
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/nb-test-arena-%d.json", getpid());
+    FILE *f = fopen(path, "w");
+    ok = f != NULL;
+    if (f) {
+        fprintf(f, "{\"updatedAt\": \"2026-10-16T00:00:00Z\", \"peers\": [\n");
+        for (int i = 0; i < 1000; i++) {
+            fprintf(f, "  {\"id\": \"peer-%d\", \"publicKey\": \"key-%d=\", \"endpoint\": \"192.0.2.%d:51820\", "
+                    "\"keepalive\": 25, \"allowedIPs\": [\"100.64.%d.%d/32\", \"10.%d.0.0/16\"]}%s\n",
+                    i, i, i % 250, i / 250, i % 250, i % 250, i < 999 ? "," : "");
+        }
+        fprintf(f, "]}\n");
+        fclose(f);
+    }
+    peers_file_t *pf = NULL;
+    ok = ok && peers_file_load(path, &pf) == NB_SUCCESS && pf->peer_count == 1000 &&
+         strcmp(pf->updated_at, "2026-10-16T00:00:00Z") == 0 &&
+         strcmp(pf->peers[0].id, "peer-0") == 0 && strcmp(pf->peers[999].public_key, "key-999=") == 0 &&
+         strcmp(pf->peers[999].endpoint, "192.0.2.249:51820") == 0 && pf->peers[999].keepalive == 25 &&
+         pf->peers[999].allowed_ips_count == 2 &&
+         strcmp(pf->peers[999].allowed_ips[0], "100.64.3.249/32") == 0 &&
+         strcmp(pf->peers[999].allowed_ips[1], "10.249.0.0/16") == 0 && pf->arena.blocks == 1;
+    if (pf) {
+        printf("  %d peers in %d block(s), %zu bytes\n", pf->peer_count, pf->arena.blocks, pf->arena.used);
+    }
+    peers_file_free(pf);
+
+    /* An empty list still loads */
+    f = fopen(path, "w");
+    if (f) {
+        fprintf(f, "{\"peers\": []}\n");
+        fclose(f);
+    }
+    pf = NULL;
+    ok = ok && peers_file_load(path, &pf) == NB_SUCCESS && pf->peer_count == 0 && pf->peers == NULL;
+    peers_file_free(pf);
+    unlink(path);
+    result(ok, &failed);
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,286 @@
+/**
+ * test_delta_ring.c - Test program for the shared-memory delta channel
+ *
+ * Hands a ring over a socketpair, checks that records only appear once
+ * published and arrive in order across the wrap, that a full ring refuses
+ * records instead of overwriting, that a corrupt or gapped producer is
+ * detected and cannot change a header once it was checked, the eventfd
+ * wakeup protocol, and streams 1M records between two threads.
+ *
+ * Usage: ./test_delta_ring
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "delta_ring.h"
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <time.h>
+
+static int result(int ok, int *failed) {
+    if (!ok) {
+        printf("  FAILED\n");
+        (*failed)++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+    return ok;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Create a ring and hand it to a producer through a socketpair */
+static int make_pair(size_t capacity, nb_delta_ring_t **cons, nb_delta_ring_t **prod) {
+    int sv[2];
+    *cons = *prod = NULL;
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+        return NB_ERROR_SYSTEM;
+    }
+    int ret = nb_delta_ring_create(capacity, cons);
+    if (ret == NB_SUCCESS) ret = nb_delta_ring_send(*cons, sv[0]);
+    if (ret == NB_SUCCESS) ret = nb_delta_ring_recv(sv[1], prod);
+    close(sv[0]);
+    close(sv[1]);
+    if (ret != NB_SUCCESS) {
+        nb_delta_ring_close(*cons);
+        nb_delta_ring_close(*prod);
+        *cons = *prod = NULL;
+    }
+    return ret;
+}
+
+static int readable(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    return poll(&pfd, 1, 0) == 1;
+}
+
+/* Producer thread of Test 6 */
+typedef struct {
+    nb_delta_ring_t *ring;
+    uint64_t count;
+    uint64_t full;
+} stream_ctx_t;
+
+static void* stream_producer(void *arg) {
+    stream_ctx_t *c = arg;
+    for (uint64_t i = 1; i <= c->count; i++) {
+        /* Sizes from 8 to 120 bytes so records wrap at every offset */
+        size_t len = 8 + (i % 15) * 8;
+        uint64_t *p;
+        while (!(p = nb_delta_ring_reserve(c->ring, NB_DELTA_ROUTE_ADD, len))) {
+            c->full++;
+            nb_delta_ring_publish(c->ring);
+            sched_yield();
+        }
+        p[0] = i;
+        if (i % 64 == 0 || i == c->count) {
+            nb_delta_ring_publish(c->ring);
+        }
+    }
+    return NULL;
+}
+
+int main(void) {
+    int failed = 0;
+    nb_delta_ring_t *cons = NULL, *prod = NULL;
+    nb_delta_record_t rec;
+    const void *payload;
+    int ok;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Delta Ring Test\n");
+    printf("================================================================================\n\n");
+
+    /* Test 1: Hand-over over a unix socket */
+    printf("[Test 1] Create a ring and hand it over a socketpair...\n");
+    ok = make_pair(5000, &cons, &prod) == NB_SUCCESS;
+    if (ok) {
+        const nb_delta_header_t *hc = nb_delta_ring_header(cons);
+        const nb_delta_header_t *hp = nb_delta_ring_header(prod);
+        ok = hc->capacity == 8192 && hp->capacity == 8192 && hp->version == NB_DELTA_VERSION &&
+             memcmp(hp->magic, NB_DELTA_MAGIC, 8) == 0 && nb_delta_ring_eventfd(prod) >= 0 &&
+             nb_delta_ring_next(cons, &rec, &payload) == 0;
+        printf("  Capacity %llu bytes\n", (unsigned long long)hp->capacity);
+    }
+    int sv[2];
+    nb_delta_ring_t *bogus = NULL;
+    ok = ok && socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0;
+    if (ok) {
+        /* A message without descriptors is not a ring */
+        ok = send(sv[0], "NBDRING1\0\0\0\0\0\0\0\0", 16, 0) == 16 &&
+             nb_delta_ring_recv(sv[1], &bogus) == NB_ERROR_INVALID && !bogus;
+        close(sv[0]);
+        close(sv[1]);
+    }
+    result(ok, &failed);
+
+    /* Test 2: Records are visible once published, in order */
+    printf("[Test 2] Publish peer and route records...\n");
+    ok = prod != NULL;
+    if (ok) {
+        peers_snap_peer_t *peer = nb_delta_ring_reserve(prod, NB_DELTA_PEER_SET,
+                                                        sizeof(peers_snap_peer_t) + sizeof(nb_prefix_t));
+        nb_delta_route_t *route = nb_delta_ring_reserve(prod, NB_DELTA_ROUTE_ADD, sizeof(nb_delta_route_t));
+        ok = peer && route;
+        if (ok) {
+            memset(peer->public_key, 0xab, sizeof(peer->public_key));
+            peer->prefix_count = 1;
+            nb_prefix_parse("100.64.0.7/32", (nb_prefix_t *)(peer + 1));
+            nb_prefix_parse("10.30.0.0/16", &route->network);
+            route->metric = 100;
+        }
+        ok = ok && nb_delta_ring_next(cons, &rec, &payload) == 0 && nb_delta_ring_publish(prod) == NB_SUCCESS;
+
+        const peers_snap_peer_t *p = NULL;
+        const nb_delta_route_t *r = NULL;
+        if (ok && nb_delta_ring_next(cons, &rec, &payload) == 1 && rec.type == NB_DELTA_PEER_SET && rec.seq == 1) {
+            p = (const peers_snap_peer_t *)payload;
+        }
+        if (ok && nb_delta_ring_next(cons, &rec, &payload) == 1 && rec.type == NB_DELTA_ROUTE_ADD && rec.seq == 2) {
+            r = (const nb_delta_route_t *)payload;
+        }
+        char buf[NB_PREFIX_STRLEN];
+        ok = p && r && p->public_key[31] == 0xab && p->prefix_count == 1 &&
+             strcmp(nb_prefix_format((const nb_prefix_t *)(p + 1), buf, sizeof(buf)), "100.64.0.7/32") == 0 &&
+             r->metric == 100 && strcmp(nb_prefix_format(&r->network, buf, sizeof(buf)), "10.30.0.0/16") == 0 &&
+             nb_delta_ring_next(cons, &rec, &payload) == 0;
+        nb_delta_ring_release(cons);
+        ok = ok && nb_delta_ring_header(prod)->tail == nb_delta_ring_header(prod)->head;
+    }
+    result(ok, &failed);
+
+    /* Test 3: A full ring refuses records; space comes back on release, records wrap */
+    printf("[Test 3] Fill, drain and wrap the ring...\n");
+    ok = prod != NULL;
+    int filled = 0;
+    uint64_t expect = 3;
+    for (int round = 0; ok && round < 50; round++) {
+        uint64_t *v;
+        int n = 0;
+        while ((v = nb_delta_ring_reserve(prod, NB_DELTA_PEER_REMOVE, 40 + (round % 7) * 16))) {
+            v[0] = expect + n++;
+        }
+        filled += n;
+        ok = n > 0 && nb_delta_ring_publish(prod) == NB_SUCCESS;
+
+        /* Read everything back; the space only returns to the producer on release */
+        for (int i = 0; ok && i < n; i++) {
+            ok = nb_delta_ring_next(cons, &rec, &payload) == 1 && rec.seq == expect && ((const uint64_t *)payload)[0] == expect;
+            expect++;
+        }
+        ok = ok && nb_delta_ring_reserve(prod, NB_DELTA_PEER_REMOVE, 4096) == NULL;
+        nb_delta_ring_release(cons);
+    }
+    uint64_t head = nb_delta_ring_header(prod)->head;
+    printf("  %d records, %llu bytes through an 8 KB ring\n", filled, (unsigned long long)head);
+    ok = ok && head > 40 * 8192 && nb_delta_ring_reserve(prod, NB_DELTA_PEER_REMOVE, 8192) == NULL;
+    result(ok, &failed);
+
+    /* Test 4: Wakeup protocol */
+    printf("[Test 4] Wake the consumer only when it sleeps...\n");
+    ok = prod != NULL;
+    if (ok) {
+        int efd = nb_delta_ring_eventfd(cons);
+        ok = nb_delta_ring_sleep(cons) == 0 && nb_delta_ring_header(cons)->waiting == 1 && !readable(efd);
+        ok = ok && nb_delta_ring_reserve(prod, NB_DELTA_RESYNC, 0) && nb_delta_ring_publish(prod) == NB_SUCCESS &&
+             readable(efd) && nb_delta_ring_header(cons)->waiting == 0;
+
+        /* Awake consumer: no wakeup is needed, sleep finds the record instead of blocking */
+        uint64_t count = 0;
+        ok = ok && read(efd, &count, sizeof(count)) == sizeof(count) && count == 1 &&
+             nb_delta_ring_next(cons, &rec, &payload) == 1 && rec.type == NB_DELTA_RESYNC &&
+             nb_delta_ring_reserve(prod, NB_DELTA_RESYNC, 0) && nb_delta_ring_publish(prod) == NB_SUCCESS &&
+             !readable(efd) && nb_delta_ring_sleep(cons) == 1 &&
+             nb_delta_ring_next(cons, &rec, &payload) == 1 && nb_delta_ring_next(cons, &rec, &payload) == 0;
+        nb_delta_ring_release(cons);
+    }
+    result(ok, &failed);
+
+    /* Test 5: A corrupt or gapped producer is detected */
+    printf("[Test 5] Reject corrupt records and sequence gaps...\n");
+    ok = prod != NULL;
+    nb_delta_ring_t *c2 = NULL, *p2 = NULL;
+    if (ok) {
+        nb_delta_record_t *r = (nb_delta_record_t *)nb_delta_ring_reserve(prod, NB_DELTA_PEER_REMOVE, 32) - 1;
+        r->seq += 1;
+        ok = nb_delta_ring_publish(prod) == NB_SUCCESS && nb_delta_ring_next(cons, &rec, &payload) == NB_ERROR_INVALID;
+    }
+    ok = ok && make_pair(0, &c2, &p2) == NB_SUCCESS;
+    if (ok) {
+        nb_delta_record_t *r = (nb_delta_record_t *)nb_delta_ring_reserve(p2, NB_DELTA_PEER_REMOVE, 32) - 1;
+        r->size = 1 << 24;
+        ok = nb_delta_ring_publish(p2) == NB_SUCCESS && nb_delta_ring_next(c2, &rec, &payload) == NB_ERROR_INVALID;
+    }
+    nb_delta_ring_close(c2);
+    nb_delta_ring_close(p2);
+    c2 = p2 = NULL;
+
+    /* A size rewritten after the check does not reach the consumer's copy */
+    ok = ok && make_pair(0, &c2, &p2) == NB_SUCCESS;
+    if (ok) {
+        nb_delta_record_t *r = (nb_delta_record_t *)nb_delta_ring_reserve(p2, NB_DELTA_PEER_REMOVE, 32) - 1;
+        ok = nb_delta_ring_publish(p2) == NB_SUCCESS && nb_delta_ring_next(c2, &rec, &payload) == 1;
+        r->size = 1 << 24;
+        r->type = NB_DELTA_ROUTE_SYNC;
+        ok = ok && rec.size == sizeof(rec) + 32 && rec.type == NB_DELTA_PEER_REMOVE;
+    }
+    nb_delta_ring_close(c2);
+    nb_delta_ring_close(p2);
+    result(ok, &failed);
+
+    nb_delta_ring_close(cons);
+    nb_delta_ring_close(prod);
+
+    /* Test 6: 1M records between two threads */
+    printf("[Test 6] Stream 1000000 records between threads...\n");
+    ok = make_pair(64 * 1024, &cons, &prod) == NB_SUCCESS;
+    stream_ctx_t ctx = { .ring = prod, .count = 1000000 };
+    pthread_t tid;
+    uint64_t got = 0, wakeups = 0;
+    double t0 = now_sec();
+    ok = ok && pthread_create(&tid, NULL, stream_producer, &ctx) == 0;
+    if (ok) {
+        struct pollfd pfd = { .fd = nb_delta_ring_eventfd(cons), .events = POLLIN };
+        while (ok && got < ctx.count) {
+            int n;
+            while ((n = nb_delta_ring_next(cons, &rec, &payload)) == 1) {
+                got++;
+                ok = ok && rec.seq == got && ((const uint64_t *)payload)[0] == got;
+            }
+            nb_delta_ring_release(cons);
+            ok = ok && n == 0;
+            if (ok && got < ctx.count && !nb_delta_ring_sleep(cons)) {
+                ok = poll(&pfd, 1, 5000) == 1;
+                wakeups++;
+            }
+        }
+        pthread_join(tid, NULL);
+    }
+    double t = now_sec() - t0;
+    printf("  %llu records in %.1f ms (%.0f ns/record), %llu wakeups, producer found it full %llu times\n",
+           (unsigned long long)got, t * 1e3, t * 1e9 / (got ? got : 1),
+           (unsigned long long)wakeups, (unsigned long long)ctx.full);
+    ok = ok && got == ctx.count;
+    nb_delta_ring_close(cons);
+    nb_delta_ring_close(prod);
+    result(ok, &failed);
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
@@ -6,6 +6,7 @@
  * - Start engine (creates WireGuard interface + route manager)
  * - Add test peer
  * - Add routes
+ * - Drive the engine from an event loop (peer file, route events)
  * - Stop engine (cleanup)
  *
  * Usage: sudo ./test_engine
@@ -19,6 +20,63 @@
 #include "wg_iface.h"
 #include "route.h"
 #include "engine.h"
+#include "event_loop.h"
+#include "wg_key.h"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Dispatch loop events until done() holds or timeout_ms passes; returns the wait in ms or -1 */
+static int64_t run_until(nb_loop_t *loop, int (*done)(void *), void *arg, int timeout_ms) {
+    int64_t start = now_ms();
+    while (!done(arg)) {
+        if (now_ms() - start > timeout_ms || nb_loop_run_once(loop, 50) < 0) {
+            return -1;
+        }
+    }
+    return now_ms() - start;
+}
+
+static int peers_reloaded(void *arg) {
+    return ((nb_engine_t *)arg)->peer_reloads > 0;
+}
+
+static int peers_reloaded_twice(void *arg) {
+    return ((nb_engine_t *)arg)->peer_reloads > 1;
+}
+
+static int journal_applied(void *arg) {
+    return ((nb_engine_t *)arg)->journal_records > 0;
+}
+
+static int delta_attached(void *arg) {
+    return ((nb_engine_t *)arg)->delta != NULL;
+}
+
+static int delta_detached(void *arg) {
+    return ((nb_engine_t *)arg)->delta == NULL;
+}
+
+static int delta_resynced(void *arg) {
+    return ((nb_engine_t *)arg)->delta_records >= 2;
+}
+
+static int delta_applied(void *arg) {
+    return ((nb_engine_t *)arg)->delta_records >= 4;
+}
+
+static int route_restored(void *arg) {
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "ip route show dev %s | grep -q '^10.0.0.0/24'", (const char *)arg);
+    return system(cmd) == 0;
+}
 
 int main(void) {
     int ret;
@@ -177,8 +235,232 @@ int main(void) {
     }
     printf("\n");
 
-    /* Test 10: Stop engine */
-    printf("[Test 10] Stopping engine...\n");
+    /* Test 10: Peer file updates and route events through the event loop */
+    printf("[Test 10] Event loop: peer file and route events...\n");
+    char peers_path[64], tmp_path[80], journal_path[64], delta_path[64];
+    snprintf(peers_path, sizeof(peers_path), "/tmp/nb-test-peers-%d.json", getpid());
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", peers_path);
+    snprintf(journal_path, sizeof(journal_path), "/tmp/nb-test-peers-%d.journal", getpid());
+    cfg->peers_file = strdup(peers_path);
+    cfg->journal_file = strdup(journal_path);
+    snprintf(delta_path, sizeof(delta_path), "/tmp/nb-test-delta-%d.sock", getpid());
+    cfg->delta_socket = strdup(delta_path);
+    nb_loop_t *loop = nb_loop_new();
+    ret = loop ? nb_engine_attach(engine, loop) : NB_ERROR_SYSTEM;
+    if (ret != NB_SUCCESS) {
+        printf("  FAILED: Could not attach engine (error %d)\n", ret);
+    } else {
+        /* Written like the helper does: a new file renamed over the old one */
+        FILE *f = fopen(tmp_path, "w");
+        if (f) {
+            fprintf(f, "{\"peers\": [{\"publicKey\": \"%s\", \"endpoint\": \"203.0.113.10:51820\", "
+                       "\"allowedIPs\": [\"100.64.0.201/32\"], \"keepalive\": 25}]}\n", peer_pubkey);
+            fclose(f);
+        }
+        int64_t peers_ms = f && rename(tmp_path, peers_path) == 0 ?
+                           run_until(loop, peers_reloaded, engine, 2000) : -1;
+        int ok = peers_ms >= 0 && nb_engine_find_peer(engine, peer_pubkey) != NULL;
+
+        /* The same file replaced by a binary snapshot with a new endpoint */
+        char *snap_ips[] = { "100.64.0.201/32" };
+        peers_file_peer_t snap_peer = { .public_key = peer_pubkey, .endpoint = "203.0.113.11:51821",
+                                        .allowed_ips = snap_ips, .allowed_ips_count = 1, .keepalive = 15 };
+        peers_file_t snap_file = { .peers = &snap_peer, .peer_count = 1 };
+        int64_t snap_ms = peers_snap_write(peers_path, &snap_file) == 1 ?
+                          run_until(loop, peers_reloaded_twice, engine, 2000) : -1;
+        const nb_peer_record_t *rec = nb_engine_find_peer(engine, peer_pubkey);
+        ok = ok && snap_ms >= 0 && rec && rec->keepalive == 15 &&
+             rec->endpoint.sa.sa_family == AF_INET && ntohs(rec->endpoint.in4.sin_port) == 51821;
+
+        /* The snapshot holds journal records up to 0: the journal's first record comes next */
+        struct {
+            peers_snap_peer_t peer;
+            nb_prefix_t prefix;
+        } set;
+        memset(&set, 0, sizeof(set));
+        wg_key_from_base64(set.peer.public_key, peer_pubkey);
+        set.peer.endpoint_family = AF_INET;
+        inet_pton(AF_INET, "203.0.113.12", set.peer.endpoint_addr);
+        set.peer.endpoint_port = htons(51822);
+        set.peer.keepalive = 15;
+        set.peer.prefix_count = 1;
+        nb_prefix_parse("100.64.0.201/32", &set.prefix);
+        nb_journal_t *journal = NULL;
+        int64_t journal_ms = nb_journal_create(journal_path, 0, &journal) == NB_SUCCESS &&
+                             nb_journal_append(journal, NB_DELTA_PEER_SET, &set, sizeof(set)) == NB_SUCCESS ?
+                             run_until(loop, journal_applied, engine, 2000) : -1;
+        rec = nb_engine_find_peer(engine, peer_pubkey);
+        ok = ok && journal_ms >= 0 && engine->journal_seq == 1 && engine->peer_reloads == 2 &&
+             rec && ntohs(rec->endpoint.in4.sin_port) == 51822;
+
+        /*
+         * A helper attaches to the delta channel: resync and a type from a newer
+         * helper, then a peer change it journaled as record 2
+         */
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", delta_path);
+        int sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        nb_delta_ring_t *ring = NULL;
+        int64_t delta_ms = -1;
+        if (sock >= 0 && connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+            run_until(loop, delta_attached, engine, 2000) >= 0 &&
+            nb_delta_ring_recv(sock, &ring) == NB_SUCCESS &&
+            nb_delta_ring_reserve(ring, NB_DELTA_RESYNC, 0) && nb_delta_ring_reserve(ring, 99, 8) &&
+            nb_delta_ring_publish(ring) == NB_SUCCESS && run_until(loop, delta_resynced, engine, 2000) >= 0) {
+            set.peer.endpoint_port = htons(51823);
+            uint64_t journal_seq = 2;
+            void *p = NULL, *q = NULL;
+            if (nb_journal_append(journal, NB_DELTA_PEER_SET, &set, sizeof(set)) == NB_SUCCESS &&
+                (p = nb_delta_ring_reserve(ring, NB_DELTA_PEER_SET, sizeof(set))) &&
+                (q = nb_delta_ring_reserve(ring, NB_DELTA_JOURNAL_SEQ, sizeof(journal_seq)))) {
+                memcpy(p, &set, sizeof(set));
+                memcpy(q, &journal_seq, sizeof(journal_seq));
+                nb_delta_ring_publish(ring);
+                delta_ms = run_until(loop, delta_applied, engine, 2000);
+            }
+        }
+        rec = nb_engine_find_peer(engine, peer_pubkey);
+        ok = ok && delta_ms >= 0 && engine->delta != NULL && engine->journal_seq == 2 &&
+             rec && ntohs(rec->endpoint.in4.sin_port) == 51823;
+
+        /* Once it leaves, only the journal records it did not publish are read */
+        uint64_t journal_records = engine->journal_records;
+        set.peer.endpoint_port = htons(51824);
+        ok = ok && nb_journal_append(journal, NB_DELTA_PEER_SET, &set, sizeof(set)) == NB_SUCCESS;
+        nb_journal_close(journal);
+        nb_delta_ring_close(ring);
+        if (sock >= 0) {
+            close(sock);
+        }
+        rec = run_until(loop, delta_detached, engine, 2000) >= 0 ? nb_engine_find_peer(engine, peer_pubkey) : NULL;
+        ok = ok && engine->journal_seq == 3 && engine->journal_records == journal_records + 1 &&
+             rec && ntohs(rec->endpoint.in4.sin_port) == 51824;
+
+        /* A route deleted behind the engine's back comes back without waiting for the 30 s check */
+        snprintf(cmd, sizeof(cmd), "ip route del 10.0.0.0/24 dev %s", engine->wg_iface->name);
+        int64_t route_ms = -1;
+        if (engine->routes_fd >= 0) {
+            route_ms = system(cmd) == 0 ? run_until(loop, route_restored, engine->wg_iface->name, 2000) : -1;
+            ok = ok && route_ms >= 0;
+        }
+        nb_engine_detach(engine);
+        ok = ok && engine->loop == NULL && nb_loop_run_once(loop, 0) == 0;
+        printf("  Peer file synced after %lld ms, snapshot after %lld ms, journal record after %lld ms, "
+               "delta records after %lld ms, route restored after %lld ms\n",
+               (long long)peers_ms, (long long)snap_ms, (long long)journal_ms, (long long)delta_ms,
+               (long long)route_ms);
+        printf("  %s\n", ok ? "SUCCESS: Events handled by the loop" : "FAILED");
+    }
+    nb_loop_free(loop);
+    unlink(peers_path);
+    unlink(journal_path);
+    printf("\n");
+
+    /* Test 11: A new peer listed twice in one batch keeps the prefixes of its last entry */
+    printf("[Test 11] Same new peer twice in one batch...\n");
+    {
+        char *dup_privkey = NULL, *dup_pubkey = NULL;
+        wg_generate_private_key(&dup_privkey);
+        wg_get_public_key(dup_privkey, &dup_pubkey);
+        char *first_ips[] = { "100.64.0.210/32" };
+        char *last_ips[] = { "100.64.0.210/32", "100.64.0.211/32" };
+        nb_peer_info_t dup[2] = {
+            { .public_key = dup_pubkey, .allowed_ips = first_ips, .allowed_ips_count = 1, .keepalive = 25 },
+            { .public_key = dup_pubkey, .allowed_ips = last_ips, .allowed_ips_count = 2, .keepalive = 25 },
+        };
+        ret = nb_engine_add_peers(engine, dup, 2);
+        const nb_peer_record_t *rec = nb_engine_find_peer(engine, dup_pubkey);
+        if (ret != NB_SUCCESS || !rec || rec->ips_count != 2) {
+            printf("  FAILED: Peer has %d allowed IP(s) (error %d)\n", rec ? rec->ips_count : -1, ret);
+        } else {
+            printf("  SUCCESS: Peer installed with both allowed IPs\n");
+        }
+        nb_engine_remove_peer(engine, dup_pubkey);
+        free(dup_privkey);
+        free(dup_pubkey);
+    }
+    printf("\n");
+
+    /* Test 12: A prefix moves from one peer to another within one batch, in either order */
+    printf("[Test 12] Prefix moves between peers in one batch...\n");
+    {
+        char *a_privkey = NULL, *a_pubkey = NULL, *b_privkey = NULL, *b_pubkey = NULL;
+        wg_generate_private_key(&a_privkey);
+        wg_get_public_key(a_privkey, &a_pubkey);
+        wg_generate_private_key(&b_privkey);
+        wg_get_public_key(b_privkey, &b_pubkey);
+        char *a_with[] = { "100.64.0.220/32", "10.220.0.0/24" }, *a_without[] = { "100.64.0.220/32" };
+        char *b_with[] = { "100.64.0.221/32", "10.220.0.0/24" }, *b_without[] = { "100.64.0.221/32" };
+        nb_peer_info_t setup[2] = {
+            { .public_key = a_pubkey, .allowed_ips = a_with, .allowed_ips_count = 2, .keepalive = 25 },
+            { .public_key = b_pubkey, .allowed_ips = b_without, .allowed_ips_count = 1, .keepalive = 25 },
+        };
+        /* The gaining peer comes first */
+        nb_peer_info_t to_b[2] = {
+            { .public_key = b_pubkey, .allowed_ips = b_with, .allowed_ips_count = 2, .keepalive = 25 },
+            { .public_key = a_pubkey, .allowed_ips = a_without, .allowed_ips_count = 1, .keepalive = 25 },
+        };
+        /* The losing peer comes first */
+        nb_peer_info_t to_a[2] = {
+            { .public_key = b_pubkey, .allowed_ips = b_without, .allowed_ips_count = 1, .keepalive = 25 },
+            { .public_key = a_pubkey, .allowed_ips = a_with, .allowed_ips_count = 2, .keepalive = 25 },
+        };
+        const nb_peer_record_t *a, *b, *owner_b = NULL, *owner_a = NULL;
+        int ok = nb_engine_add_peers(engine, setup, 2) == NB_SUCCESS &&
+                 nb_engine_add_peers(engine, to_b, 2) == NB_SUCCESS;
+        a = nb_engine_find_peer(engine, a_pubkey);
+        b = nb_engine_find_peer(engine, b_pubkey);
+        owner_b = nb_engine_peer_for_ip(engine, "10.220.0.1");
+        ok = ok && a && b && owner_b == b && b->ips_count == 2 && a->ips_count == 1;
+        ok = ok && nb_engine_add_peers(engine, to_a, 2) == NB_SUCCESS;
+        a = nb_engine_find_peer(engine, a_pubkey);
+        b = nb_engine_find_peer(engine, b_pubkey);
+        owner_a = nb_engine_peer_for_ip(engine, "10.220.0.1");
+        ok = ok && a && b && owner_a == a && a->ips_count == 2 && b->ips_count == 1;
+        if (!ok) {
+            printf("  FAILED: 10.220.0.0/24 owned by %s, then by %s\n",
+                   owner_b ? (owner_b == b ? "B" : "A") : "nobody",
+                   owner_a ? (owner_a == a ? "A" : "B") : "nobody");
+        } else {
+            printf("  SUCCESS: 10.220.0.0/24 moved to B and back to A\n");
+        }
+        nb_engine_remove_peer(engine, a_pubkey);
+        nb_engine_remove_peer(engine, b_pubkey);
+        free(a_privkey);
+        free(a_pubkey);
+        free(b_privkey);
+        free(b_pubkey);
+    }
+    printf("\n");
+
+    /* Test 13: More allowed IPs than fit the old 1024-byte list string */
+    printf("[Test 13] Peer with 48 IPv6 allowed IPs...\n");
+    {
+        char *v6_privkey = NULL, *v6_pubkey = NULL;
+        wg_generate_private_key(&v6_privkey);
+        wg_get_public_key(v6_privkey, &v6_pubkey);
+        char v6_ips[48][48], *v6_list[48];
+        for (int i = 0; i < 48; i++) {
+            snprintf(v6_ips[i], sizeof(v6_ips[i]), "fd00:1234:5678:%x::/64", 0x1000 + i);
+            v6_list[i] = v6_ips[i];
+        }
+        nb_peer_info_t v6 = { .public_key = v6_pubkey, .allowed_ips = v6_list, .allowed_ips_count = 48,
+                              .endpoint = "203.0.113.20:51820", .keepalive = 25 };
+        ret = nb_engine_add_peer(engine, &v6);
+        const nb_peer_record_t *rec = nb_engine_find_peer(engine, v6_pubkey);
+        if (ret != NB_SUCCESS || !rec || rec->ips_count != 48) {
+            printf("  FAILED: Peer has %d allowed IP(s) (error %d)\n", rec ? rec->ips_count : -1, ret);
+        } else {
+            printf("  SUCCESS: Peer added with all 48 allowed IPs\n");
+        }
+        nb_engine_remove_peer(engine, v6_pubkey);
+        free(v6_privkey);
+        free(v6_pubkey);
+    }
+    printf("\n");
+
+    /* Test 14: Stop engine */
+    printf("[Test 14] Stopping engine...\n");
     ret = nb_engine_stop(engine);
     if (ret != NB_SUCCESS) {
         printf("  FAILED: Could not stop engine\n");
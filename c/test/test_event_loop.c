@@ -0,0 +1,212 @@
+/**
+ * test_event_loop.c - Test program for the epoll event loop
+ *
+ * Checks timer ordering and periods, descriptor readiness, signal
+ * delivery through the signalfd, removal of watches from callbacks and
+ * that an idle loop does not wake up.
+ *
+ * Usage: ./test_event_loop
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "event_loop.h"
+#include <signal.h>
+#include <time.h>
+
+static int result(int ok, int *failed) {
+    if (!ok) {
+        printf("  FAILED\n");
+        (*failed)++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+    return ok;
+}
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Shared callback state */
+typedef struct {
+    int order[8];
+    int fired;
+    int stop_after;
+    int64_t at_us;
+    int sig;
+    nb_loop_timer_t *pair[2];
+} state_t;
+
+static state_t st;
+
+static void on_order(nb_loop_t *loop, nb_loop_timer_t *timer, void *ctx) {
+    (void)timer;
+    st.order[st.fired++] = (int)(intptr_t)ctx;
+    if (st.fired == st.stop_after) {
+        nb_loop_stop(loop);
+    }
+}
+
+static void on_periodic(nb_loop_t *loop, nb_loop_timer_t *timer, void *ctx) {
+    (void)ctx;
+    if (++st.fired == st.stop_after) {
+        nb_loop_timer_disarm(timer);
+        nb_loop_stop(loop);
+    }
+}
+
+static void on_write(nb_loop_t *loop, nb_loop_timer_t *timer, void *ctx) {
+    (void)loop;
+    (void)timer;
+    st.at_us = now_us();
+    if (write((int)(intptr_t)ctx, "x", 1) != 1) {
+        st.at_us = 0;
+    }
+}
+
+static void on_readable(nb_loop_t *loop, int fd, uint32_t events, void *ctx) {
+    char c;
+    (void)ctx;
+    if ((events & EPOLLIN) && read(fd, &c, 1) == 1 && c == 'x') {
+        st.at_us = now_us() - st.at_us;
+        st.fired++;
+    }
+    nb_loop_del_fd(loop, fd);
+    nb_loop_stop(loop);
+}
+
+static void on_signal(nb_loop_t *loop, int sig, void *ctx) {
+    (void)ctx;
+    st.sig = sig;
+    nb_loop_stop(loop);
+}
+
+/* Frees itself and its partner, which expired in the same batch */
+static void on_free_pair(nb_loop_t *loop, nb_loop_timer_t *timer, void *ctx) {
+    (void)loop;
+    (void)timer;
+    (void)ctx;
+    st.fired++;
+    nb_loop_timer_free(st.pair[0]);
+    nb_loop_timer_free(st.pair[1]);
+}
+
+int main(void) {
+    int failed = 0;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Event Loop Test\n");
+    printf("================================================================================\n\n");
+
+    /* Test 1: One-shot timers fire in deadline order */
+    printf("[Test 1] One-shot timers in deadline order...\n");
+    nb_loop_t *loop = nb_loop_new();
+    memset(&st, 0, sizeof(st));
+    st.stop_after = 3;
+    nb_loop_timer_t *t30 = nb_loop_timer_new(loop, on_order, (void *)30);
+    nb_loop_timer_t *t10 = nb_loop_timer_new(loop, on_order, (void *)10);
+    nb_loop_timer_t *t20 = nb_loop_timer_new(loop, on_order, (void *)20);
+    int64_t t0 = now_us();
+    int ok = loop && t30 && t10 && t20 &&
+             nb_loop_timer_arm(t30, 30, 0) == NB_SUCCESS &&
+             nb_loop_timer_arm(t10, 10, 0) == NB_SUCCESS &&
+             nb_loop_timer_arm(t20, 20, 0) == NB_SUCCESS &&
+             nb_loop_timer_arm(t20, -1, 0) == NB_ERROR_INVALID &&
+             nb_loop_run(loop) == NB_SUCCESS;
+    int64_t elapsed = now_us() - t0;
+    ok = ok && st.fired == 3 && st.order[0] == 10 && st.order[1] == 20 && st.order[2] == 30 &&
+         elapsed >= 30000 && !nb_loop_timer_armed(t10) && !nb_loop_timer_armed(t30);
+    printf("  Fired %d, %d, %d after %.1f ms\n", st.order[0], st.order[1], st.order[2], elapsed / 1000.0);
+    result(ok, &failed);
+
+    /* Test 2: Periodic timer, disarmed from its callback */
+    printf("[Test 2] Periodic timer...\n");
+    memset(&st, 0, sizeof(st));
+    st.stop_after = 5;
+    nb_loop_timer_t *tp = nb_loop_timer_new(loop, on_periodic, NULL);
+    t0 = now_us();
+    ok = tp && nb_loop_timer_arm(tp, 0, 5) == NB_SUCCESS && nb_loop_timer_armed(tp) &&
+         nb_loop_run(loop) == NB_SUCCESS;
+    elapsed = now_us() - t0;
+    ok = ok && st.fired == 5 && !nb_loop_timer_armed(tp) && elapsed >= 20000 &&
+         nb_loop_run_once(loop, 20) == 0;
+    printf("  5 expiries in %.1f ms\n", elapsed / 1000.0);
+    nb_loop_timer_free(tp);
+    result(ok, &failed);
+
+    /* Test 3: Descriptor readiness reaches the callback without delay */
+    printf("[Test 3] Descriptor readiness...\n");
+    int fds[2];
+    memset(&st, 0, sizeof(st));
+    ok = pipe(fds) == 0;
+    nb_loop_timer_t *tw = nb_loop_timer_new(loop, on_write, (void *)(intptr_t)fds[1]);
+    ok = ok && tw && nb_loop_add_fd(loop, fds[0], EPOLLIN, on_readable, NULL) == NB_SUCCESS &&
+         nb_loop_add_fd(loop, fds[0], EPOLLIN, on_readable, NULL) == NB_ERROR_EXISTS &&
+         nb_loop_timer_arm(tw, 5, 0) == NB_SUCCESS && nb_loop_run(loop) == NB_SUCCESS;
+    ok = ok && st.fired == 1 && st.at_us >= 0 && st.at_us < 50000 &&
+         nb_loop_del_fd(loop, fds[0]) == NB_ERROR_NOTFOUND;
+    printf("  Write to callback: %lld us\n", (long long)st.at_us);
+    nb_loop_timer_free(tw);
+    result(ok, &failed);
+
+    close(fds[0]);
+    close(fds[1]);
+
+    /* Test 4: Removing watches from a callback while their events are pending */
+    printf("[Test 4] Removing watches during dispatch...\n");
+    memset(&st, 0, sizeof(st));
+    st.pair[0] = nb_loop_timer_new(loop, on_free_pair, NULL);
+    st.pair[1] = nb_loop_timer_new(loop, on_free_pair, NULL);
+    /* Both expire before the next epoll_wait(); only the first may run */
+    ok = st.pair[0] && st.pair[1] &&
+         nb_loop_timer_arm(st.pair[0], 1, 0) == NB_SUCCESS &&
+         nb_loop_timer_arm(st.pair[1], 1, 0) == NB_SUCCESS && usleep(5000) == 0 &&
+         nb_loop_run_once(loop, 100) == 2 && st.fired == 1 && nb_loop_run_once(loop, 20) == 0;
+    result(ok, &failed);
+    nb_loop_free(loop);
+
+    /* Test 5: Signals through the signalfd */
+    printf("[Test 5] Signal delivery...\n");
+    loop = nb_loop_new();
+    memset(&st, 0, sizeof(st));
+    ok = loop && nb_loop_add_signal(loop, SIGUSR1, on_signal, NULL) == NB_SUCCESS &&
+         nb_loop_add_signal(loop, SIGUSR2, on_signal, NULL) == NB_SUCCESS &&
+         nb_loop_add_signal(loop, SIGUSR1, on_signal, NULL) == NB_ERROR_EXISTS &&
+         raise(SIGUSR2) == 0 && nb_loop_run(loop) == NB_SUCCESS && st.sig == SIGUSR2;
+    nb_loop_free(loop);
+    sigset_t mask;
+    sigprocmask(SIG_BLOCK, NULL, &mask);
+    ok = ok && !sigismember(&mask, SIGUSR1) && !sigismember(&mask, SIGUSR2);
+    printf("  Received signal %d, mask restored\n", st.sig);
+    result(ok, &failed);
+
+    /* Test 6: No wakeups while idle */
+    printf("[Test 6] Idle loop...\n");
+    loop = nb_loop_new();
+    memset(&st, 0, sizeof(st));
+    st.stop_after = 1;
+    nb_loop_timer_t *ti = nb_loop_timer_new(loop, on_order, (void *)1);
+    ok = ti && nb_loop_run_once(loop, 200) == 0 && nb_loop_wakeups(loop) == 0 &&
+         nb_loop_timer_arm(ti, 300, 0) == NB_SUCCESS && nb_loop_run(loop) == NB_SUCCESS &&
+         st.fired == 1 && nb_loop_wakeups(loop) == 1;
+    printf("  %llu wakeup(s) over 500 ms with one timer\n", (unsigned long long)nb_loop_wakeups(loop));
+    nb_loop_free(loop);
+    result(ok, &failed);
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * test_journal.c - Test program for the peer and route change journal
+ *
+ * Writes a journal and reads it back, tails it while records are
+ * appended (a record written in two parts, or torn at the end of the file,
+ * only shows up once complete), detects damaged records, sequence gaps
+ * and files that are no journal,
+ * and notices a journal renamed over the one being read (compaction).
+ *
+ * Usage: ./test_journal
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "journal.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static int result(int ok, int *failed) {
+    if (!ok) {
+        printf("  FAILED\n");
+        (*failed)++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+    return ok;
+}
+
+/*
+ * Encode one record with seq base_seq + 1 the way nb_journal_append does,
+ * through a scratch journal. Returns its size, 0 on failure.
+ */
+static size_t record_bytes(const char *scratch, uint64_t base_seq, uint16_t type,
+                           const void *payload, size_t len, uint8_t *buf, size_t cap) {
+    nb_journal_t *j = NULL;
+    size_t size = 0;
+    if (nb_journal_create(scratch, base_seq, &j) != NB_SUCCESS) {
+        return 0;
+    }
+    if (nb_journal_append(j, type, payload, len) == NB_SUCCESS) {
+        int fd = open(scratch, O_RDONLY);
+        ssize_t n = fd >= 0 ? pread(fd, buf, cap, sizeof(nb_journal_header_t)) : -1;
+        size = n > 0 ? (size_t)n : 0;
+        if (fd >= 0) close(fd);
+    }
+    nb_journal_close(j);
+    unlink(scratch);
+    return size;
+}
+
+static int append_raw(const char *path, const void *data, size_t len) {
+    int fd = open(path, O_WRONLY | O_APPEND);
+    int ok = fd >= 0 && write(fd, data, len) == (ssize_t)len;
+    if (fd >= 0) close(fd);
+    return ok;
+}
+
+int main(void) {
+    int failed = 0;
+    char path[64], scratch[64], other[64];
+    nb_journal_t *w = NULL, *r = NULL;
+    const nb_journal_record_t *rec;
+    uint8_t buf[256];
+    int fd, ok;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Journal Test\n");
+    printf("================================================================================\n\n");
+
+    snprintf(path, sizeof(path), "/tmp/nb-test-journal-%d", getpid());
+    snprintf(scratch, sizeof(scratch), "/tmp/nb-test-journal-%d.scratch", getpid());
+    snprintf(other, sizeof(other), "/tmp/nb-test-journal-%d.new", getpid());
+
+    /* Test 1: Write records and read them back */
+    printf("[Test 1] Append records and read them back...\n");
+    uint8_t key[32];
+    memset(key, 0x11, sizeof(key));
+    nb_delta_route_t route = { .metric = 100 };
+    nb_prefix_parse("10.1.0.0/16", &route.network);
+    ok = nb_journal_create(path, 41, &w) == NB_SUCCESS &&
+         nb_journal_append(w, NB_DELTA_PEER_REMOVE, key, sizeof(key)) == NB_SUCCESS &&
+         nb_journal_append(w, NB_DELTA_ROUTE_ADD, &route, sizeof(route)) == NB_SUCCESS &&
+         nb_journal_append(w, NB_DELTA_RESYNC, NULL, 0) == NB_SUCCESS &&
+         nb_journal_seq(w) == 44;
+    ok = ok && nb_journal_open(path, &r) == NB_SUCCESS &&
+         nb_journal_base_seq(r) == 41 && nb_journal_seq(r) == 41;
+    ok = ok && nb_journal_next(r, &rec) == 1 && rec->seq == 42 && rec->type == NB_DELTA_PEER_REMOVE &&
+         rec->size == sizeof(*rec) + sizeof(key) && memcmp(rec + 1, key, sizeof(key)) == 0;
+    ok = ok && nb_journal_next(r, &rec) == 1 && rec->seq == 43 && rec->type == NB_DELTA_ROUTE_ADD &&
+         memcmp(rec + 1, &route, sizeof(route)) == 0 && rec->size % NB_JOURNAL_ALIGN == 0;
+    ok = ok && nb_journal_next(r, &rec) == 1 && rec->seq == 44 && rec->type == NB_DELTA_RESYNC &&
+         rec->size == sizeof(*rec);
+    ok = ok && nb_journal_next(r, &rec) == 0 && nb_journal_seq(r) == 44;
+    printf("  Read records 42..44 after base 41\n");
+    result(ok, &failed);
+
+    /* Test 2: Tail the journal while it grows; a half-written record waits */
+    printf("[Test 2] Tail the journal while records are appended...\n");
+    ok = nb_journal_append(w, NB_DELTA_PEER_REMOVE, key, sizeof(key)) == NB_SUCCESS &&
+         nb_journal_next(r, &rec) == 1 && rec->seq == 45 && nb_journal_next(r, &rec) == 0;
+    size_t size = record_bytes(scratch, 45, NB_DELTA_ROUTE_REMOVE, &route, sizeof(route), buf, sizeof(buf));
+    ok = ok && size > 0 && append_raw(path, buf, 10) && nb_journal_next(r, &rec) == 0;
+    ok = ok && append_raw(path, buf + 10, sizeof(*rec) - 10) && nb_journal_next(r, &rec) == 0;
+    ok = ok && append_raw(path, buf + sizeof(*rec), size - sizeof(*rec)) &&
+         nb_journal_next(r, &rec) == 1 && rec->seq == 46 && rec->type == NB_DELTA_ROUTE_REMOVE &&
+         memcmp(rec + 1, &route, sizeof(route)) == 0;
+    printf("  Record 46 appeared only once all %zu bytes were written\n", size);
+
+    /* A torn last record (bad checksum, nothing after it) waits too */
+    size = record_bytes(scratch, 46, NB_DELTA_PEER_REMOVE, key, sizeof(key), buf, sizeof(buf));
+    buf[size - 1] ^= 0x80;
+    ok = ok && size > 0 && append_raw(path, buf, size) && nb_journal_next(r, &rec) == 0;
+    buf[size - 1] ^= 0x80;
+    fd = open(path, O_WRONLY);
+    ok = ok && fd >= 0 && pwrite(fd, buf + size - 1, 1, lseek(fd, 0, SEEK_END) - 1) == 1;
+    if (fd >= 0) close(fd);
+    ok = ok && nb_journal_next(r, &rec) == 1 && rec->seq == 47 && nb_journal_next(r, &rec) == 0;
+    printf("  Torn record 47 waited until its last byte was right\n");
+    nb_journal_close(w);
+    w = NULL;
+    result(ok, &failed);
+
+    /* Test 3: Damage and sequence gaps are reported */
+    printf("[Test 3] Detect a damaged record and a sequence gap...\n");
+    size = record_bytes(scratch, 50, NB_DELTA_PEER_REMOVE, key, sizeof(key), buf, sizeof(buf));
+    ok = size > 0 && append_raw(path, buf, size) && nb_journal_next(r, &rec) == NB_ERROR_INVALID;
+    printf("  Record 51 after 47 rejected\n");
+    nb_journal_close(r);
+    r = NULL;
+
+    fd = open(path, O_RDWR);
+    uint8_t byte = 0;
+    off_t at = sizeof(nb_journal_header_t) + sizeof(nb_journal_record_t) + 3;
+    ok = ok && fd >= 0 && pread(fd, &byte, 1, at) == 1;
+    byte ^= 0x80;
+    ok = ok && pwrite(fd, &byte, 1, at) == 1;
+    if (fd >= 0) close(fd);
+    ok = ok && nb_journal_open(path, &r) == NB_SUCCESS && nb_journal_next(r, &rec) == NB_ERROR_INVALID;
+    printf("  Flipped payload bit of record 42 detected\n");
+    nb_journal_close(r);
+    r = NULL;
+    result(ok, &failed);
+
+    /* Test 4: Missing files and files that are no journal */
+    printf("[Test 4] Open a missing file and one that is no journal...\n");
+    ok = nb_journal_open(scratch, &r) == NB_ERROR_NOTFOUND && !r;
+    FILE *f = fopen(scratch, "w");
+    ok = ok && f && fprintf(f, "{\"peers\": []}\n") > 0;
+    if (f) fclose(f);
+    ok = ok && nb_journal_open(scratch, &r) == NB_ERROR_INVALID && !r;
+    unlink(scratch);
+    result(ok, &failed);
+
+    /* Test 5: Compaction renames a new journal over the one being read */
+    printf("[Test 5] Notice a compacted journal...\n");
+    ok = nb_journal_create(path, 100, &w) == NB_SUCCESS &&
+         nb_journal_append(w, NB_DELTA_PEER_REMOVE, key, sizeof(key)) == NB_SUCCESS;
+    nb_journal_close(w);
+    w = NULL;
+    ok = ok && nb_journal_open(path, &r) == NB_SUCCESS && !nb_journal_replaced(r);
+    ok = ok && nb_journal_create(other, 101, &w) == NB_SUCCESS && rename(other, path) == 0 &&
+         nb_journal_replaced(r);
+    /* The old file stays readable until it is closed */
+    ok = ok && nb_journal_next(r, &rec) == 1 && rec->seq == 101 && nb_journal_next(r, &rec) == 0;
+    nb_journal_close(r);
+    r = NULL;
+    ok = ok && nb_journal_append(w, NB_DELTA_PEER_REMOVE, key, sizeof(key)) == NB_SUCCESS &&
+         nb_journal_open(path, &r) == NB_SUCCESS && nb_journal_base_seq(r) == 101 &&
+         nb_journal_next(r, &rec) == 1 && rec->seq == 102;
+    nb_journal_close(r);
+    nb_journal_close(w);
+    unlink(path);
+    result(ok, &failed);
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,249 @@
+/**
+ * test_lpm.c - Test program for the allowed IP trie
+ *
+ * Checks longest prefix matching and overlap classification, and compares
+ * the trie against a linear scan over random prefixes while inserting and
+ * removing.
+ *
+ * Usage: ./test_lpm
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "lpm.h"
+
+#define RANDOM_PREFIXES 4000
+#define RANDOM_LOOKUPS  20000
+
+static uint64_t rng_state = 0x243F6A8885A308D3ULL;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)rng_state;
+}
+
+static nb_prefix_t P(const char *s) {
+    nb_prefix_t p;
+    if (nb_prefix_parse(s, &p) != NB_SUCCESS) {
+        printf("  bad prefix %s\n", s);
+        memset(&p, 0, sizeof(p));
+    }
+    return p;
+}
+
+static int lookup_is(nb_lpm_t *lpm, const char *key, int want) {
+    nb_prefix_t k = P(key);
+    uint32_t v;
+    int ret = nb_lpm_lookup(lpm, &k, &v, NULL);
+    if (want < 0) return ret == NB_ERROR_NOTFOUND;
+    return ret == NB_SUCCESS && v == (uint32_t)want;
+}
+
+static nb_lpm_overlap_t check_kind(nb_lpm_t *lpm, const char *prefix, uint32_t value) {
+    nb_prefix_t p = P(prefix);
+    nb_lpm_check_t c;
+    nb_lpm_check(lpm, &p, value, &c);
+    return c.kind;
+}
+
+/* Random IPv4 prefix clustered in 10.0.0.0/12 so that many of them nest */
+static void random_prefix(nb_prefix_t *p, uint32_t *addr) {
+    uint32_t a = 0x0A000000u | (rng() & 0x000FFFFFu);
+    int len = 8 + rng() % 25;
+    p->family = AF_INET;
+    p->len = (uint8_t)len;
+    memset(p->addr, 0, sizeof(p->addr));
+    p->addr[0] = a >> 24;
+    p->addr[1] = a >> 16;
+    p->addr[2] = a >> 8;
+    p->addr[3] = a;
+    nb_prefix_normalize(p);
+    *addr = a;
+}
+
+/* Value of the longest live prefix containing key, -1 if none */
+static int scan_lookup(const nb_prefix_t *prefixes, const int *live, int n, const nb_prefix_t *key) {
+    int best = -1;
+    for (int i = 0; i < n; i++) {
+        if (live[i] && nb_prefix_contains(&prefixes[i], key) &&
+            (best < 0 || prefixes[i].len > prefixes[best].len)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static int compare_random(nb_lpm_t *lpm, const nb_prefix_t *prefixes, const int *live, int n) {
+    for (int i = 0; i < RANDOM_LOOKUPS; i++) {
+        nb_prefix_t key;
+        uint32_t a;
+        random_prefix(&key, &a);
+        key.len = 32;
+        key.addr[2] = a >> 8;
+        key.addr[3] = a;
+
+        int want = scan_lookup(prefixes, live, n, &key);
+        uint32_t v;
+        int ret = nb_lpm_lookup(lpm, &key, &v, NULL);
+        if (want < 0 ? ret != NB_ERROR_NOTFOUND : (ret != NB_SUCCESS ||
+            nb_prefix_cmp(&prefixes[v], &prefixes[want]) != 0)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(void) {
+    int failed = 0;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Allowed IP Trie Test\n");
+    printf("================================================================================\n\n");
+
+    nb_lpm_t *lpm = nb_lpm_new();
+    if (!lpm) {
+        printf("  FAILED: Could not create trie\n");
+        return 1;
+    }
+
+    /* Test 1: Longest prefix match */
+    printf("[Test 1] Longest prefix match...\n");
+    int ok = nb_lpm_insert(lpm, &(nb_prefix_t){0}, 1) == NB_ERROR_INVALID;
+    nb_prefix_t p;
+    p = P("10.0.0.0/8");        ok &= nb_lpm_insert(lpm, &p, 1) == NB_SUCCESS;
+    p = P("10.1.0.0/16");       ok &= nb_lpm_insert(lpm, &p, 2) == NB_SUCCESS;
+    p = P("10.1.2.3/24");       ok &= nb_lpm_insert(lpm, &p, 3) == NB_SUCCESS;   /* host bits */
+    p = P("100.64.0.7/32");     ok &= nb_lpm_insert(lpm, &p, 4) == NB_SUCCESS;
+    p = P("0.0.0.0/0");         ok &= nb_lpm_insert(lpm, &p, 5) == NB_SUCCESS;
+    p = P("fd00::/8");          ok &= nb_lpm_insert(lpm, &p, 6) == NB_SUCCESS;
+    p = P("fd00:1::/32");       ok &= nb_lpm_insert(lpm, &p, 7) == NB_SUCCESS;
+    ok &= lookup_is(lpm, "10.9.9.9", 1);
+    ok &= lookup_is(lpm, "10.1.9.9", 2);
+    ok &= lookup_is(lpm, "10.1.2.200", 3);
+    ok &= lookup_is(lpm, "10.1.2.0/25", 3);
+    ok &= lookup_is(lpm, "10.0.0.0/7", 5);
+    ok &= lookup_is(lpm, "100.64.0.7", 4);
+    ok &= lookup_is(lpm, "100.64.0.8", 5);
+    ok &= lookup_is(lpm, "fd00:1::5", 7);
+    ok &= lookup_is(lpm, "fd01::1", 6);
+    ok &= lookup_is(lpm, "2001:db8::1", -1);
+    /* Replace keeps the count */
+    p = P("10.1.0.0/16");       ok &= nb_lpm_insert(lpm, &p, 9) == NB_SUCCESS;
+    ok &= lookup_is(lpm, "10.1.9.9", 9) && nb_lpm_count(lpm) == 7;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 2: Removal */
+    printf("[Test 2] Removing prefixes...\n");
+    p = P("10.1.0.0/16");       ok = nb_lpm_remove(lpm, &p) == NB_SUCCESS;
+    ok &= nb_lpm_remove(lpm, &p) == NB_ERROR_NOTFOUND;
+    ok &= lookup_is(lpm, "10.1.9.9", 1) && lookup_is(lpm, "10.1.2.1", 3);
+    p = P("0.0.0.0/0");         ok &= nb_lpm_remove(lpm, &p) == NB_SUCCESS;
+    ok &= lookup_is(lpm, "100.64.0.8", -1) && lookup_is(lpm, "100.64.0.7", 4);
+    p = P("10.0.0.0/8");        ok &= nb_lpm_remove(lpm, &p) == NB_SUCCESS;
+    ok &= lookup_is(lpm, "10.9.9.9", -1) && lookup_is(lpm, "10.1.2.1", 3);
+    p = P("10.0.0.0/9");        ok &= nb_lpm_remove(lpm, &p) == NB_ERROR_NOTFOUND;
+    ok &= nb_lpm_count(lpm) == 4;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 3: Overlap classification */
+    printf("[Test 3] Overlap detection...\n");
+    nb_lpm_clear(lpm);
+    p = P("10.0.0.0/8");        nb_lpm_insert(lpm, &p, 1);
+    p = P("10.1.2.0/24");       nb_lpm_insert(lpm, &p, 2);
+    p = P("100.64.0.7/32");     nb_lpm_insert(lpm, &p, 3);
+    ok = check_kind(lpm, "100.64.0.7/32", 4) == NB_LPM_CONFLICT;
+    ok &= check_kind(lpm, "100.64.0.7/32", 3) == NB_LPM_DUPLICATE;
+    ok &= check_kind(lpm, "100.64.0.8/32", 3) == NB_LPM_OK;
+    ok &= check_kind(lpm, "10.1.0.0/16", 1) == NB_LPM_COVERS;     /* Own /8 does not count */
+    ok &= check_kind(lpm, "10.1.0.0/16", 5) == NB_LPM_COVERED;
+    ok &= check_kind(lpm, "10.1.2.128/25", 2) == NB_LPM_COVERED;  /* By the /8 of owner 1 */
+    ok &= check_kind(lpm, "10.0.0.0/8", 1) == NB_LPM_COVERS;
+    ok &= check_kind(lpm, "10.0.0.0/8", 2) == NB_LPM_CONFLICT;
+    ok &= check_kind(lpm, "100.0.0.0/8", 9) == NB_LPM_COVERS;
+    ok &= check_kind(lpm, "fd00::/8", 9) == NB_LPM_OK;
+    nb_lpm_check_t c;
+    p = P("0.0.0.0/0");
+    nb_lpm_check(lpm, &p, 3, &c);
+    char buf[NB_PREFIX_STRLEN];
+    ok &= c.kind == NB_LPM_COVERS && c.other_value != 3;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS: 0.0.0.0/0 %s %s\n", nb_lpm_overlap_name(c.kind),
+               nb_prefix_format(&c.other, buf, sizeof(buf)));
+    }
+    printf("\n");
+
+    /* Test 4: Random prefixes against a linear scan */
+    printf("[Test 4] Comparing %d random prefixes with a linear scan...\n", RANDOM_PREFIXES);
+    nb_lpm_clear(lpm);
+    nb_prefix_t *prefixes = calloc(RANDOM_PREFIXES, sizeof(nb_prefix_t));
+    int *live = calloc(RANDOM_PREFIXES, sizeof(int));
+    uint32_t *values = calloc(RANDOM_PREFIXES, sizeof(uint32_t));
+    ok = prefixes && live && values;
+    int n = 0;
+    while (ok && n < RANDOM_PREFIXES) {
+        uint32_t a;
+        random_prefix(&prefixes[n], &a);
+        int dup = 0;
+        for (int i = 0; i < n && !dup; i++) {
+            dup = nb_prefix_cmp(&prefixes[i], &prefixes[n]) == 0;
+        }
+        if (dup) continue;
+        live[n] = 1;
+        values[n] = (uint32_t)n;
+        n++;
+    }
+    ok = ok && nb_lpm_build(lpm, prefixes, values, n) == NB_SUCCESS && nb_lpm_count(lpm) == n;
+    ok = ok && compare_random(lpm, prefixes, live, n);
+    for (int i = 0; ok && i < n; i += 2) {
+        ok = nb_lpm_remove(lpm, &prefixes[i]) == NB_SUCCESS;
+        live[i] = 0;
+    }
+    ok = ok && nb_lpm_count(lpm) == n / 2 && compare_random(lpm, prefixes, live, n);
+    for (int i = 0; ok && i < n; i += 4) {
+        ok = nb_lpm_insert(lpm, &prefixes[i], (uint32_t)i) == NB_SUCCESS;
+        live[i] = 1;
+    }
+    ok = ok && compare_random(lpm, prefixes, live, n);
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS: %d prefixes, %d live\n", n, nb_lpm_count(lpm));
+    }
+    printf("\n");
+
+    free(prefixes);
+    free(live);
+    free(values);
+    nb_lpm_free(lpm);
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
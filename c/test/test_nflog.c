@@ -0,0 +1,131 @@
+/**
+ * test_nflog.c - Test program for the lazy peer traffic trap
+ *
+ * Checks destination parsing of trapped IPv4/IPv6 packets and, when the
+ * kernel allows it, binding and draining an NFLOG group.
+ *
+ * Usage: sudo ./test_nflog
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "nflog.h"
+#include "lpm.h"
+#include <arpa/inet.h>
+
+int main(void) {
+    int failed = 0;
+    uint8_t pkt[64];
+    nb_prefix_t dst, want;
+    char buf[NB_PREFIX_STRLEN];
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - NFLOG Trap Test\n");
+    printf("================================================================================\n\n");
+
+    /* Test 1: IPv4 destination */
+    printf("[Test 1] Parsing an IPv4 packet...\n");
+    memset(pkt, 0, sizeof(pkt));
+    pkt[0] = 0x45;
+    inet_pton(AF_INET, "100.64.0.1", pkt + 12);
+    inet_pton(AF_INET, "100.64.3.7", pkt + 16);
+    nb_prefix_parse("100.64.3.7/32", &want);
+    int ok = nb_nflog_packet_dst(pkt, 20, &dst) == NB_SUCCESS &&
+             memcmp(&dst, &want, sizeof(dst)) == 0;
+    nb_prefix_t tmp = dst;
+    ok &= nb_nflog_packet_dst(pkt, 19, &tmp) == NB_ERROR_INVALID &&
+          memcmp(&dst, &tmp, sizeof(dst)) == 0;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS: %s\n", nb_prefix_format(&dst, buf, sizeof(buf)));
+    }
+    printf("\n");
+
+    /* Test 2: IPv6 destination */
+    printf("[Test 2] Parsing an IPv6 packet...\n");
+    memset(pkt, 0, sizeof(pkt));
+    pkt[0] = 0x60;
+    inet_pton(AF_INET6, "fd00::1", pkt + 8);
+    inet_pton(AF_INET6, "fd00:1234::42", pkt + 24);
+    nb_prefix_parse("fd00:1234::42/128", &want);
+    ok = nb_nflog_packet_dst(pkt, 40, &dst) == NB_SUCCESS &&
+         memcmp(&dst, &want, sizeof(dst)) == 0;
+    tmp = dst;
+    ok &= nb_nflog_packet_dst(pkt, 39, &tmp) == NB_ERROR_INVALID &&
+          memcmp(&dst, &tmp, sizeof(dst)) == 0;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS: %s\n", nb_prefix_format(&dst, buf, sizeof(buf)));
+    }
+    printf("\n");
+
+    /* Test 3: Anything else is rejected */
+    printf("[Test 3] Rejecting non-IP data...\n");
+    pkt[0] = 0x20;
+    ok = nb_nflog_packet_dst(pkt, sizeof(pkt), &tmp) == NB_ERROR_INVALID;
+    ok &= nb_nflog_packet_dst(pkt, 0, &tmp) == NB_ERROR_INVALID;
+    ok &= nb_nflog_packet_dst(NULL, 20, &tmp) == NB_ERROR_INVALID;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 4: A trapped destination maps to the peer owning it */
+    printf("[Test 4] Mapping destinations to peers...\n");
+    nb_lpm_t *trie = nb_lpm_new();
+    nb_prefix_t p;
+    uint32_t owner = 0;
+    ok = trie != NULL;
+    ok = ok && nb_prefix_parse("100.64.3.7/32", &p) == NB_SUCCESS && nb_lpm_insert(trie, &p, 1) == NB_SUCCESS;
+    ok = ok && nb_prefix_parse("fd00:1234::/32", &p) == NB_SUCCESS && nb_lpm_insert(trie, &p, 2) == NB_SUCCESS;
+    ok = ok && nb_prefix_parse("fd00:1234::42", &p) == NB_SUCCESS &&
+         nb_lpm_lookup(trie, &p, &owner, NULL) == NB_SUCCESS && owner == 2;
+    ok = ok && nb_prefix_parse("100.64.3.8/32", &p) == NB_SUCCESS &&
+         nb_lpm_lookup(trie, &p, &owner, NULL) == NB_ERROR_NOTFOUND;
+    nb_lpm_free(trie);
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 5: Binding a group (needs CAP_NET_ADMIN and nfnetlink_log) */
+    printf("[Test 5] Binding NFLOG group %u...\n", NB_NFLOG_DEFAULT_GROUP);
+    nb_nflog_t nf;
+    int ret = nb_nflog_open(NB_NFLOG_DEFAULT_GROUP, &nf);
+    if (ret != NB_SUCCESS) {
+        printf("  SKIPPED: NFLOG not available (error %d)\n", ret);
+    } else {
+        ok = nb_nflog_fd(&nf) >= 0 && nb_nflog_read(&nf, &dst, 1) >= 0;
+        nb_nflog_close(&nf);
+        if (!ok) {
+            printf("  FAILED\n");
+            failed++;
+        } else {
+            printf("  SUCCESS\n");
+        }
+    }
+    printf("\n");
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
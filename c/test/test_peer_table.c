@@ -0,0 +1,202 @@
+/**
+ * test_peer_table.c - Test program for the engine peer table
+ *
+ * Inserts, updates, looks up and removes 100k peers and checks that the
+ * allowed IP lists survive slab growth and compaction.
+ *
+ * Usage: ./test_peer_table
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "peer_table.h"
+
+#define PEERS 100000
+
+static void make_key(uint8_t key[WG_KEY_LEN], int i) {
+    /* Deterministic but well spread */
+    uint64_t x = (uint64_t)(i + 1) * UINT64_C(0x9E3779B97F4A7C15);
+    for (int j = 0; j < WG_KEY_LEN; j++) {
+        x ^= x >> 31;
+        x *= UINT64_C(0xBF58476D1CE4E5B9);
+        key[j] = (uint8_t)(x >> 56);
+    }
+}
+
+static void make_ips(nb_prefix_t *ips, int i, int n) {
+    for (int j = 0; j < n; j++) {
+        char cidr[32];
+        snprintf(cidr, sizeof(cidr), "10.%d.%d.%d/32", j, (i >> 8) & 0xff, i & 0xff);
+        nb_prefix_parse(cidr, &ips[j]);
+    }
+}
+
+static int check_peer(nb_peer_table_t *t, int i, int n) {
+    uint8_t key[WG_KEY_LEN];
+    nb_prefix_t ips[4];
+
+    make_key(key, i);
+    nb_peer_record_t *rec = nb_peer_table_find(t, key);
+    if (!rec || rec->ips_count != n) return 0;
+    make_ips(ips, i, n);
+    const nb_prefix_t *got = nb_peer_table_allowed_ips(t, rec);
+    return n == 0 || memcmp(got, ips, n * sizeof(nb_prefix_t)) == 0;
+}
+
+int main(void) {
+    int failed = 0;
+    uint8_t key[WG_KEY_LEN];
+    nb_prefix_t ips[4];
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Peer Table Test\n");
+    printf("================================================================================\n\n");
+
+    nb_peer_table_t *t = nb_peer_table_new(0);
+    if (!t) {
+        printf("  FAILED: Could not create table\n");
+        return 1;
+    }
+
+    /* Test 1: Insert */
+    printf("[Test 1] Inserting %d peers...\n", PEERS);
+    int ok = 1;
+    for (int i = 0; i < PEERS && ok; i++) {
+        make_key(key, i);
+        make_ips(ips, i, 1 + i % 3);
+        ok = nb_peer_table_upsert(t, key, NULL, 25, ips, 1 + i % 3) == NB_SUCCESS;
+    }
+    for (int i = 0; i < PEERS && ok; i++) {
+        ok = check_peer(t, i, 1 + i % 3);
+    }
+    if (!ok || nb_peer_table_count(t) != PEERS) {
+        printf("  FAILED: count=%d\n", nb_peer_table_count(t));
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 2: Update grows and shrinks lists, keeps others intact */
+    printf("[Test 2] Updating allowed IPs...\n");
+    ok = 1;
+    for (int i = 0; i < PEERS && ok; i += 2) {
+        int n = (i % 4 == 0) ? 4 : 0;
+        make_key(key, i);
+        make_ips(ips, i, n);
+        ok = nb_peer_table_upsert(t, key, NULL, 25, ips, n) == NB_SUCCESS;
+    }
+    for (int i = 0; i < PEERS && ok; i++) {
+        int n = (i % 2) ? 1 + i % 3 : (i % 4 == 0) ? 4 : 0;
+        ok = check_peer(t, i, n);
+    }
+    /* -1 keeps the list */
+    make_key(key, 4);
+    ok &= nb_peer_table_upsert(t, key, NULL, 10, NULL, -1) == NB_SUCCESS && check_peer(t, 4, 4);
+    if (!ok || nb_peer_table_count(t) != PEERS) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 3: Remove every third peer, then re-add with new lists (compaction) */
+    printf("[Test 3] Removing and re-adding peers...\n");
+    ok = 1;
+    int removed = 0;
+    for (int i = 0; i < PEERS && ok; i += 3) {
+        make_key(key, i);
+        ok = nb_peer_table_remove(t, key) == NB_SUCCESS;
+        removed++;
+    }
+    make_key(key, 0);
+    ok &= nb_peer_table_remove(t, key) == NB_ERROR_NOTFOUND;
+    ok &= nb_peer_table_count(t) == PEERS - removed;
+    for (int i = 0; i < PEERS && ok; i++) {
+        if (i % 3 == 0) {
+            make_key(key, i);
+            ok = nb_peer_table_find(t, key) == NULL;
+        } else {
+            int n = (i % 2) ? 1 + i % 3 : (i % 4 == 0) ? 4 : 0;
+            ok = check_peer(t, i, n);
+        }
+    }
+    for (int r = 0; r < 3 && ok; r++) {
+        for (int i = 0; i < PEERS && ok; i += 3) {
+            make_key(key, i);
+            make_ips(ips, i, 4);
+            ok = nb_peer_table_upsert(t, key, NULL, 25, ips, 4) == NB_SUCCESS;
+        }
+    }
+    for (int i = 0; i < PEERS && ok; i += 3) {
+        ok = check_peer(t, i, 4);
+    }
+    if (!ok || nb_peer_table_count(t) != PEERS) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 4: Ids and install state stay attached to their peer across moves */
+    printf("[Test 4] Looking up peers by id...\n");
+    ok = 1;
+    for (int i = 0; i < nb_peer_table_count(t) && ok; i++) {
+        nb_peer_record_t *rec = nb_peer_table_at(t, i);
+        ok = nb_peer_table_by_id(t, rec->id) == rec;
+    }
+    make_key(key, 1);
+    uint32_t id = nb_peer_table_find(t, key)->id;
+    make_key(key, 2);
+    ok &= nb_peer_table_remove(t, key) == NB_SUCCESS;
+    make_key(key, 1);
+    ok &= nb_peer_table_by_id(t, id) == nb_peer_table_find(t, key);
+    ok &= nb_peer_table_by_id(t, PEERS * 2) == NULL;
+    nb_peer_table_find(t, key)->flags = NB_PEER_INSTALLED;
+    nb_peer_table_find(t, key)->last_active = 1700000000;
+    ok &= nb_peer_table_upsert(t, key, NULL, 5, NULL, -1) == NB_SUCCESS;
+    ok &= nb_peer_table_find(t, key)->flags == NB_PEER_INSTALLED &&
+          nb_peer_table_find(t, key)->last_active == 1700000000;
+    make_key(key, 2);
+    ok &= nb_peer_table_upsert(t, key, NULL, 25, NULL, 0) == NB_SUCCESS &&
+          nb_peer_table_find(t, key)->flags == 0 && nb_peer_table_find(t, key)->last_active == 0;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 5: Iteration sees every peer once */
+    printf("[Test 5] Iterating...\n");
+    int total_ips = 0;
+    for (int i = 0; i < nb_peer_table_count(t); i++) {
+        total_ips += nb_peer_table_at(t, i)->ips_count;
+    }
+    nb_peer_table_clear(t);
+    if (total_ips == 0 || nb_peer_table_count(t) != 0 || nb_peer_table_at(t, 0)) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS: %d allowed IPs\n", total_ips);
+    }
+    printf("\n");
+
+    nb_peer_table_free(t);
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
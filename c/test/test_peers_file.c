@@ -0,0 +1,203 @@
+/**
+ * test_peers_file.c - Test program for the streaming peers.json reader
+ *
+ * Loads files with escapes (an unpaired surrogate becomes U+FFFD, as in
+ * Go's encoding/json), unknown members and odd ordering, checks that
+ * malformed JSON is rejected, that a callback can stop the stream and
+ * times streaming 100k peers.
+ *
+ * Usage: ./test_peers_file
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "peers_file.h"
+#include <time.h>
+
+static int result(int ok, int *failed) {
+    if (!ok) {
+        printf("  FAILED\n");
+        (*failed)++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+    return ok;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_file(const char *path, const char *data) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    size_t len = strlen(data);
+    size_t n = fwrite(data, 1, len, f);
+    fclose(f);
+    return n == len ? 0 : -1;
+}
+
+static int str_is(const char *s, const char *want) {
+    return s && strcmp(s, want) == 0;
+}
+
+/* Stream callback: count peers, stop with an error after ctx->stop_after */
+typedef struct {
+    int seen;
+    int stop_after;
+    int ips;
+} count_ctx_t;
+
+static int count_peer(const peers_file_peer_t *peer, void *arg) {
+    count_ctx_t *c = arg;
+    c->seen++;
+    c->ips += peer->allowed_ips_count;
+    return c->stop_after && c->seen >= c->stop_after ? NB_ERROR_EXISTS : NB_SUCCESS;
+}
+
+int main(void) {
+    int failed = 0;
+    char path[64];
+    peers_file_t *pf = NULL;
+    int ok;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Peers File Test\n");
+    printf("================================================================================\n\n");
+
+    snprintf(path, sizeof(path), "/tmp/nb-test-peers-file-%d.json", getpid());
+
+    /* Test 1: Escapes, unknown members, non-object elements, updatedAt last */
+    printf("[Test 1] Load peers with escapes and unknown members...\n");
+    ok = write_file(path,
+        "{\"version\": 3, \"meta\": {\"nested\": [1, [2, {\"peers\": []}], \"]}\"], \"x\": null},\n"
+        " \"peers\": [\n"
+        "  {\"id\": \"caf\\u00e9 \\\"A\\\"\\n\", \"publicKey\": \"key\\/A=\", \"endpoint\": \"198.51.100.7:51820\",\n"
+        "   \"allowedIPs\": [\"100.64.0.1/32\", 7, \"10.1.0.0/16,10.2.0.0/16\"], \"keepalive\": 25.0,\n"
+        "   \"extra\": {\"allowedIPs\": [\"1.2.3.4/32\"]}},\n"
+        "  null, 42, \"peer\", [],\n"
+        "  {\"PUBLICKEY\": \"\\ud83d\\ude00\", \"allowedIPs\": [], \"keepalive\": -5, \"endpoint\": null},\n"
+        "  {\"id\": \"\\ud83d!\"}\n"
+        " ],\n"
+        " \"updatedAt\": \"2026-10-16T12:00:00Z\"}\n") == 0 &&
+        peers_file_load(path, &pf) == NB_SUCCESS;
+    if (ok) {
+        const peers_file_peer_t *p = pf->peers;
+        ok = pf->peer_count == 3 && str_is(pf->updated_at, "2026-10-16T12:00:00Z") &&
+             str_is(p[0].id, "caf\xc3\xa9 \"A\"\n") && str_is(p[0].public_key, "key/A=") &&
+             str_is(p[0].endpoint, "198.51.100.7:51820") && p[0].keepalive == 25 &&
+             p[0].allowed_ips_count == 2 && str_is(p[0].allowed_ips[0], "100.64.0.1/32") &&
+             str_is(p[0].allowed_ips[1], "10.1.0.0/16,10.2.0.0/16") &&
+             str_is(p[1].public_key, "\xf0\x9f\x98\x80") && !p[1].id && !p[1].endpoint &&
+             p[1].allowed_ips_count == 0 && p[1].keepalive == -5 &&
+             str_is(p[2].id, "\xef\xbf\xbd!") && !p[2].public_key && !p[2].allowed_ips &&
+             p[2].allowed_ips_count == 0;
+        printf("  %d peers, updatedAt %s\n", pf->peer_count, pf->updated_at);
+    }
+    peers_file_free(pf);
+    pf = NULL;
+    result(ok, &failed);
+
+    /* Test 2: Malformed files are rejected */
+    printf("[Test 2] Reject malformed JSON...\n");
+    static const char *bad[] = {
+        "",
+        "[]",
+        "{\"peers\": [{\"publicKey\": \"abc\"}",
+        "{\"peers\": [{\"publicKey\": \"abc\"}]} x",
+        "{\"peers\": [{\"publicKey\": \"a\\qc\"}]}",
+        "{\"peers\": [{\"publicKey\": \"a\tc\"}]}",
+        "{\"peers\": [{\"publicKey\" \"abc\"}]}",
+        "{\"peers\": [{\"publicKey\": \"abc\",}]}",
+        "{\"peers\": [{\"keepalive\": 2x}]}",
+        "{\"peers\": [], \"x\": [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]}",
+    };
+    int rejected = 0, tried = 0;
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        if (write_file(path, bad[i]) != 0) continue;
+        tried++;
+        pf = NULL;
+        if (peers_file_load(path, &pf) == NB_ERROR_INVALID && !pf) {
+            rejected++;
+        } else {
+            printf("  Accepted: %s\n", bad[i]);
+            peers_file_free(pf);
+        }
+    }
+    ok = tried > 0 && rejected == tried &&
+         peers_file_load("/nonexistent/peers.json", &pf) == NB_ERROR_NOTFOUND;
+    printf("  %d/%d malformed files rejected\n", rejected, tried);
+    result(ok, &failed);
+
+    /* Test 3: Missing and empty peer lists */
+    printf("[Test 3] Missing and empty peers arrays...\n");
+    ok = write_file(path, "{\"updatedAt\": \"t\"}") == 0 && peers_file_load(path, &pf) == NB_SUCCESS &&
+         pf->peer_count == 0 && str_is(pf->updated_at, "t");
+    peers_file_free(pf);
+    pf = NULL;
+    ok = ok && write_file(path, " {\"peers\": [ ]} ") == 0 && peers_file_load(path, &pf) == NB_SUCCESS &&
+         pf->peer_count == 0 && !pf->updated_at;
+    peers_file_free(pf);
+    pf = NULL;
+    result(ok, &failed);
+
+    /* Test 4: The callback sees every peer and can stop the stream */
+    printf("[Test 4] Stream peers to a callback...\n");
+    ok = write_file(path,
+        "{\"peers\": [{\"publicKey\": \"a\", \"allowedIPs\": [\"10.0.0.1/32\"]},"
+        " {\"publicKey\": \"b\", \"allowedIPs\": [\"10.0.0.2/32\", \"10.0.0.3/32\"]},"
+        " {\"publicKey\": \"c\"}]}") == 0;
+    count_ctx_t all = {0}, stop = { .stop_after = 2 };
+    ok = ok && peers_file_stream(path, count_peer, &all) == 3 && all.seen == 3 && all.ips == 3 &&
+         peers_file_stream(path, count_peer, &stop) == NB_ERROR_EXISTS && stop.seen == 2 &&
+         peers_file_stream(path, NULL, NULL) == NB_ERROR_INVALID;
+    result(ok, &failed);
+
+    /* Test 5: Streaming 100k peers */
+    printf("[Test 5] Stream 100000 peers...\n");
+    const int count = 100000;
+    FILE *f = fopen(path, "w");
+    ok = f != NULL;
+    if (f) {
+        fprintf(f, "{\"updatedAt\": \"2026-10-16T00:00:00Z\", \"peers\": [\n");
+        for (int i = 0; i < count; i++) {
+            fprintf(f, "  {\"id\": \"peer-%08d\", \"publicKey\": \"%043dA=\", \"endpoint\": \"198.51.%d.%d:51820\", "
+                    "\"keepalive\": 25, \"allowedIPs\": [\"100.64.%d.%d/32\", \"10.%d.%d.0/24\"]}%s\n",
+                    i, i, (i >> 8) & 255, i & 255, (i >> 8) & 255, i & 255, (i >> 8) & 255, i & 255,
+                    i + 1 < count ? "," : "");
+        }
+        fprintf(f, "]}\n");
+        fclose(f);
+    }
+    count_ctx_t big = {0};
+    double t0 = now_sec();
+    ok = ok && peers_file_stream(path, count_peer, &big) == count && big.seen == count &&
+         big.ips == 2 * count;
+    double t_stream = now_sec() - t0;
+    t0 = now_sec();
+    ok = ok && peers_file_load(path, &pf) == NB_SUCCESS && pf->peer_count == count &&
+         str_is(pf->peers[count - 1].id, "peer-00099999") &&
+         str_is(pf->peers[count - 1].allowed_ips[1], "10.134.159.0/24");
+    double t_load = now_sec() - t0;
+    printf("  Streamed in %.1f ms, loaded in %.1f ms\n", t_stream * 1e3, t_load * 1e3);
+    peers_file_free(pf);
+    result(ok, &failed);
+
+    unlink(path);
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
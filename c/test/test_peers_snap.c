@@ -0,0 +1,222 @@
+/**
+ * test_peers_snap.c - Test program for the binary peer snapshot
+ *
+ * Converts a peers.json to a snapshot and reads it back in place, checks
+ * that corrupt or foreign files are rejected and times mapping 100k peers.
+ *
+ * Usage: ./test_peers_snap
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "peers_file.h"
+#include "peers_snap.h"
+#include "wg_key.h"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <time.h>
+
+static int result(int ok, int *failed) {
+    if (!ok) {
+        printf("  FAILED\n");
+        (*failed)++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+    return ok;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Deterministic key for peer i */
+static void peer_key(int i, char b64[WG_KEY_B64_LEN]) {
+    uint8_t key[WG_KEY_LEN] = {0};
+    memcpy(key, &i, sizeof(i));
+    key[31] = 0x5a;
+    wg_key_to_base64(b64, key);
+}
+
+static int write_file(const char *path, const void *data, size_t len) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    size_t n = fwrite(data, 1, len, f);
+    fclose(f);
+    return n == len ? 0 : -1;
+}
+
+static int prefix_is(const nb_prefix_t *p, const char *str) {
+    char buf[NB_PREFIX_STRLEN];
+    return strcmp(nb_prefix_format(p, buf, sizeof(buf)), str) == 0;
+}
+
+int main(void) {
+    int failed = 0;
+    char json_path[64], snap_path[64];
+    char k0[WG_KEY_B64_LEN], k1[WG_KEY_B64_LEN], k2[WG_KEY_B64_LEN];
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Peer Snapshot Test\n");
+    printf("================================================================================\n\n");
+
+    snprintf(json_path, sizeof(json_path), "/tmp/nb-test-snap-%d.json", getpid());
+    snprintf(snap_path, sizeof(snap_path), "/tmp/nb-test-snap-%d.snap", getpid());
+    peer_key(0, k0);
+    peer_key(1, k1);
+    peer_key(2, k2);
+
+    /* Test 1: JSON to snapshot and back */
+    printf("[Test 1] Convert peers.json and map the snapshot...\n");
+    FILE *f = fopen(json_path, "w");
+    if (f) {
+        fprintf(f, "{\"updatedAt\": \"2026-10-16T12:00:00Z\", \"peers\": [\n"
+                   "  {\"id\": \"alpha\", \"publicKey\": \"%s\", \"endpoint\": \"198.51.100.7:51820\", "
+                   "\"allowedIPs\": [\"100.64.0.1/32\", \"10.1.0.0/16,10.2.0.0/16\"], \"keepalive\": 25},\n"
+                   "  {\"id\": \"broken\", \"publicKey\": \"not-a-key\", \"allowedIPs\": []},\n"
+                   "  {\"id\": \"beta\", \"publicKey\": \"%s\", \"endpoint\": \"[2001:db8::1]:51821\", "
+                   "\"allowedIPs\": [\"fd00::/64\"]},\n"
+                   "  {\"publicKey\": \"%s\", \"endpoint\": \"\", \"allowedIPs\": [\"100.64.0.3\"]}\n"
+                   "]}\n", k0, k1, k2);
+        fclose(f);
+    }
+    peers_file_t *pf = NULL;
+    peers_snap_t *snap = NULL;
+    nb_endpoint_t ep;
+    int ok = f && peers_file_load(json_path, &pf) == NB_SUCCESS &&
+             peers_snap_write(snap_path, pf) == 3 && peers_snap_open(snap_path, &snap) == NB_SUCCESS;
+    if (ok) {
+        const peers_snap_peer_t *p = snap->peers;
+        const nb_prefix_t *ips = peers_snap_prefixes(snap, &p[0]);
+        char b64[WG_KEY_B64_LEN];
+        wg_key_to_base64(b64, p[1].public_key);
+
+        ok = snap->peer_count == 3 && snap->prefix_count == 5 &&
+             strcmp(peers_snap_string(snap, snap->hdr->updated_at), "2026-10-16T12:00:00Z") == 0 &&
+             strcmp(peers_snap_string(snap, p[0].id), "alpha") == 0 &&
+             strcmp(peers_snap_string(snap, p[2].id), "") == 0 &&
+             p[0].keepalive == 25 && p[1].keepalive == 0 && p[0].prefix_count == 3 &&
+             prefix_is(&ips[0], "100.64.0.1/32") && prefix_is(&ips[1], "10.1.0.0/16") &&
+             prefix_is(&ips[2], "10.2.0.0/16") &&
+             prefix_is(peers_snap_prefixes(snap, &p[1]), "fd00::/64") &&
+             prefix_is(peers_snap_prefixes(snap, &p[2]), "100.64.0.3/32") &&
+             strcmp(b64, k1) == 0 &&
+             peers_snap_endpoint(&p[0], &ep) == NB_SUCCESS && ep.sa.sa_family == AF_INET &&
+             ntohs(ep.in4.sin_port) == 51820 && ep.in4.sin_addr.s_addr == inet_addr("198.51.100.7") &&
+             peers_snap_endpoint(&p[1], &ep) == NB_SUCCESS && ep.sa.sa_family == AF_INET6 &&
+             ntohs(ep.in6.sin6_port) == 51821 &&
+             peers_snap_endpoint(&p[2], &ep) == NB_ERROR_NOTFOUND;
+        printf("  %d peers, %d prefixes, %zu bytes (invalid peer left out)\n",
+               snap->peer_count, snap->prefix_count, snap->map_size);
+    }
+    peers_snap_close(snap);
+    peers_file_free(pf);
+    result(ok, &failed);
+
+    /* Test 2: Foreign and corrupt files are rejected */
+    printf("[Test 2] Reject JSON, truncated and corrupted files...\n");
+    ok = peers_snap_is_snapshot(snap_path) && !peers_snap_is_snapshot(json_path) &&
+         peers_snap_open(json_path, &snap) == NB_ERROR_INVALID &&
+         peers_snap_open("/nonexistent/peers.snap", &snap) == NB_ERROR_NOTFOUND;
+
+    FILE *sf = fopen(snap_path, "r");
+    uint8_t image[4096];
+    size_t size = sf ? fread(image, 1, sizeof(image), sf) : 0;
+    if (sf) fclose(sf);
+    char bad_path[80];
+    snprintf(bad_path, sizeof(bad_path), "%s.bad", snap_path);
+
+    /* One flipped bit anywhere fails the checksum */
+    int rejected = 0, tried = 0;
+    for (size_t off = 0; ok && off < size; off += 7) {
+        image[off] ^= 0x10;
+        if (write_file(bad_path, image, size) == 0) {
+            tried++;
+            rejected += peers_snap_open(bad_path, &snap) == NB_ERROR_INVALID;
+        }
+        image[off] ^= 0x10;
+    }
+    ok = ok && tried > 0 && rejected == tried &&
+         write_file(bad_path, image, size - 1) == 0 && peers_snap_open(bad_path, &snap) == NB_ERROR_INVALID &&
+         write_file(bad_path, image, size) == 0 && peers_snap_open(bad_path, &snap) == NB_SUCCESS;
+    peers_snap_close(snap);
+    printf("  %d/%d corrupted copies rejected\n", rejected, tried);
+    unlink(bad_path);
+    result(ok, &failed);
+
+    /* Test 3: An empty peer list */
+    printf("[Test 3] Empty snapshot...\n");
+    peers_file_t empty = {0};
+    snap = NULL;
+    ok = peers_snap_write(snap_path, &empty) == 0 && peers_snap_open(snap_path, &snap) == NB_SUCCESS &&
+         snap->peer_count == 0 && snap->prefix_count == 0 &&
+         strcmp(peers_snap_string(snap, snap->hdr->updated_at), "") == 0;
+    peers_snap_close(snap);
+    result(ok, &failed);
+
+    /* Test 4: Mapping 100k peers */
+    printf("[Test 4] Map 100000 peers...\n");
+    const int count = 100000;
+    peers_file_t big = {0};
+    big.peers = calloc(count, sizeof(peers_file_peer_t));
+    char (*keys)[WG_KEY_B64_LEN] = calloc(count, WG_KEY_B64_LEN);
+    char (*ipbuf)[2][24] = calloc(count, sizeof(*ipbuf));
+    char **iplist = calloc((size_t)count * 2, sizeof(char *));
+    ok = big.peers && keys && ipbuf && iplist;
+    for (int i = 0; ok && i < count; i++) {
+        peers_file_peer_t *p = &big.peers[i];
+        peer_key(i, keys[i]);
+        snprintf(ipbuf[i][0], sizeof(ipbuf[i][0]), "100.%d.%d.%d/32", 64 + (i >> 16), (i >> 8) & 255, i & 255);
+        snprintf(ipbuf[i][1], sizeof(ipbuf[i][1]), "10.%d.%d.0/24", i >> 8 & 255, i & 255);
+        iplist[2 * i] = ipbuf[i][0];
+        iplist[2 * i + 1] = ipbuf[i][1];
+        p->public_key = keys[i];
+        p->endpoint = "192.0.2.1:51820";
+        p->allowed_ips = &iplist[2 * i];
+        p->allowed_ips_count = 2;
+        p->keepalive = 25;
+    }
+    big.peer_count = count;
+    double t0 = now_sec();
+    ok = ok && peers_snap_write(snap_path, &big) == count;
+    double t_write = now_sec() - t0;
+    snap = NULL;
+    t0 = now_sec();
+    ok = ok && peers_snap_open(snap_path, &snap) == NB_SUCCESS;
+    double t_open = now_sec() - t0;
+    if (ok) {
+        const peers_snap_peer_t *last = &snap->peers[count - 1];
+        char b64[WG_KEY_B64_LEN];
+        wg_key_to_base64(b64, last->public_key);
+        ok = snap->peer_count == count && snap->prefix_count == 2 * count &&
+             strcmp(b64, keys[count - 1]) == 0 &&
+             prefix_is(&peers_snap_prefixes(snap, last)[1], ipbuf[count - 1][1]);
+        printf("  Written in %.1f ms, mapped and verified in %.1f ms (%.1f MB)\n",
+               t_write * 1e3, t_open * 1e3, snap->map_size / 1e6);
+    }
+    peers_snap_close(snap);
+    free(big.peers);
+    free(keys);
+    free(ipbuf);
+    free(iplist);
+    result(ok, &failed);
+
+    unlink(json_path);
+    unlink(snap_path);
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
@@ -1,7 +1,7 @@
 /**
  * test_route.c - Test program for route management
  *
- * This tests route addition and removal.
+ * This tests route addition and removal, and masquerading.
  *
  * Usage: sudo ./test_route
  *
@@ -13,6 +13,8 @@
 #include "config.h"
 #include "wg_iface.h"
 #include "route.h"
+#include "nft.h"
+#include <linux/rtnetlink.h>
 
 int main(void) {
     int ret;
@@ -109,6 +111,7 @@ int main(void) {
     printf("  Running: ip route show dev %s\n", iface->name);
     char cmd[256];
     snprintf(cmd, sizeof(cmd), "ip route show dev %s", iface->name);
+    fflush(stdout);
     system(cmd);
     printf("\n");
 
@@ -125,6 +128,7 @@ int main(void) {
     /* Test 6: Show routing table again */
     printf("[Test 6] Checking routing table after removal...\n");
     printf("  Running: ip route show dev %s\n", iface->name);
+    fflush(stdout);
     system(cmd);
     printf("\n");
 
@@ -138,6 +142,357 @@ int main(void) {
     }
     printf("\n");
 
+    /* Test 8: Adding an existing route replaces it */
+    printf("[Test 8] Adding 10.2.0.0/16 twice (%s backend)...\n",
+           route_backend_name(route_mgr->backend));
+    route_config_t route3 = {
+        .network = "10.2.0.0/16",
+        .device = iface->name,
+        .metric = 120,
+        .masquerade = 0
+    };
+    ret = route_add(route_mgr, &route3);
+    if (ret == NB_SUCCESS) {
+        ret = route_add(route_mgr, &route3);
+    }
+    if (ret != NB_SUCCESS) {
+        printf("  FAILED: Second add returned %d (errno %d)\n", ret, route_last_errno(route_mgr));
+    } else {
+        printf("  SUCCESS: Existing route replaced\n");
+    }
+    printf("\n");
+
+    /* Test 9: Removing a missing route reports the kernel errno */
+    printf("[Test 9] Removing 10.2.0.0/16 twice...\n");
+    ret = route_remove(route_mgr, "10.2.0.0/16");
+    if (ret == NB_SUCCESS) {
+        ret = route_remove(route_mgr, "10.2.0.0/16");
+    }
+    if (ret != NB_ERROR_NOTFOUND && route_mgr->backend == ROUTE_BACKEND_NETLINK) {
+        printf("  FAILED: Expected NB_ERROR_NOTFOUND, got %d\n", ret);
+    } else if (route_mgr->backend == ROUTE_BACKEND_NETLINK) {
+        printf("  SUCCESS: NB_ERROR_NOTFOUND (errno %d: %s)\n",
+               route_last_errno(route_mgr), strerror(route_last_errno(route_mgr)));
+    } else {
+        printf("  SKIPPED: Shell backend reports no errno\n");
+    }
+    printf("\n");
+
+    /* Test 10: Pipelined batch with per-route error mapping */
+    printf("[Test 10] Batch of 1000 adds, one missing device, then 1001 deletes...\n");
+    route_batch_t *batch = route_batch_new();
+    char network[32];
+    int bad_add = -1, bad_del = -1;
+    for (int i = 0; i < 1000; i++) {
+        snprintf(network, sizeof(network), "10.3.%d.%d/32", i / 250, i % 250);
+        route_config_t route = { .network = network, .device = iface->name, .metric = 100 };
+        if (i == 500) {
+            route.device = "nb-missing0";
+        }
+        int idx = route_batch_add(batch, &route);
+        if (i == 500) bad_add = idx;
+    }
+    ret = route_batch_commit(route_mgr, batch);
+    int add_err = 0;
+    int add_ret = route_batch_result(batch, bad_add, &add_err);
+    int failed_adds = ret;
+
+    route_batch_clear(batch);
+    for (int i = 0; i < 1000; i++) {
+        snprintf(network, sizeof(network), "10.3.%d.%d/32", i / 250, i % 250);
+        route_batch_del(batch, network);
+    }
+    bad_del = route_batch_del(batch, "10.3.0.0/32");    /* Already deleted above */
+    int failed_dels = route_batch_commit(route_mgr, batch);
+    int del_err = 0;
+    int del_ret = route_batch_result(batch, bad_del, &del_err);
+
+    if (failed_adds != 1 || add_ret != NB_ERROR_NOTFOUND ||
+        failed_dels != 2 || del_ret != NB_ERROR_NOTFOUND) {
+        printf("  FAILED: adds failed %d (op %d: %d), deletes failed %d (op %d: %d)\n",
+               failed_adds, bad_add, add_ret, failed_dels, bad_del, del_ret);
+    } else {
+        printf("  SUCCESS: op %d failed with errno %d, op %d with errno %d (%s)\n",
+               bad_add, add_err, bad_del, del_err, strerror(del_err));
+    }
+    route_batch_free(batch);
+    printf("\n");
+
+    /* Test 11: Sync applies only the difference */
+    printf("[Test 11] Syncing desired routes...\n");
+    route_config_t desired[3] = {
+        { .network = "10.4.0.0/16", .device = iface->name, .metric = 100 },
+        { .network = "10.5.0.0/16", .device = iface->name, .metric = 100 },
+        { .network = "10.6.0.0/16", .device = iface->name, .metric = 100 },
+    };
+    ret = route_sync(route_mgr, desired, 3);
+    int owned_first = route_owned_count(route_mgr);
+    /* Drop 10.4/16, change the metric of 10.5/16, add 10.7/16 */
+    desired[0].network = "10.7.0.0/16";
+    desired[1].metric = 200;
+    int ret2 = route_sync(route_mgr, desired, 3);
+    char check[512];
+    snprintf(check, sizeof(check),
+             "test \"$(ip route show dev %s | grep -c -e '^10.4.0.0/16' -e '^10.5.0.0/16 .*metric 100')\" = 0 && "
+             "ip route show dev %s | grep -q '^10.5.0.0/16 .*metric 200' && "
+             "ip route show dev %s | grep -q '^10.7.0.0/16'",
+             iface->name, iface->name, iface->name);
+    if (ret != 0 || ret2 != 0 || owned_first != 3 || route_owned_count(route_mgr) != 3 ||
+        system(check) != 0) {
+        printf("  FAILED: sync returned %d/%d, owned %d/%d\n", ret, ret2, owned_first,
+               route_owned_count(route_mgr));
+    } else {
+        printf("  SUCCESS: 3 routes owned, stale route removed, metric change applied\n");
+    }
+    printf("\n");
+
+    /* Test 12: Drift check repairs routes changed behind our back */
+    printf("[Test 12] Deleting an owned route externally, adding a stray one...\n");
+    snprintf(cmd, sizeof(cmd), "ip route del 10.6.0.0/16 dev %s && "
+             "ip route add 10.8.0.0/16 dev %s proto static metric 100", iface->name, iface->name);
+    int repaired = 0;
+    if (system(cmd) != 0) {
+        printf("  SKIPPED: could not modify routes\n");
+    } else if (route_check_drift(route_mgr, &repaired) != NB_SUCCESS || repaired != 2) {
+        printf("  FAILED: drift check repaired %d route(s)\n", repaired);
+    } else {
+        snprintf(check, sizeof(check),
+                 "ip route show dev %s | grep -q '^10.6.0.0/16' && "
+                 "! ip route show dev %s | grep -q '^10.8.0.0/16'", iface->name, iface->name);
+        int second = -1;
+        route_check_drift(route_mgr, &second);
+        if (system(check) != 0 || second != 0) {
+            printf("  FAILED: routes not repaired (second pass fixed %d)\n", second);
+        } else {
+            printf("  SUCCESS: missing route restored, stray route removed\n");
+        }
+    }
+    printf("\n");
+
+    /* Test 13: Remove all deletes exactly the owned routes */
+    printf("[Test 13] Removing all owned routes...\n");
+    ret = route_remove_all(route_mgr);
+    snprintf(check, sizeof(check), "test -z \"$(ip route show dev %s | grep -v 'proto kernel')\"",
+             iface->name);
+    if (ret != NB_SUCCESS || route_owned_count(route_mgr) != 0 || system(check) != 0) {
+        printf("  FAILED: remove all returned %d, %d still owned\n", ret, route_owned_count(route_mgr));
+    } else {
+        printf("  SUCCESS: No routes left on %s\n", iface->name);
+    }
+    printf("\n");
+
+    /* Test 14: Dedicated table, rebuilt in the shadow table and switched by rule */
+    printf("[Test 14] Policy routing table %d...\n", ROUTE_TABLE_DEFAULT);
+    ret = route_use_table(route_mgr, ROUTE_TABLE_DEFAULT, ROUTE_FWMARK_DEFAULT, ROUTE_RULE_PRIORITY);
+    if (ret != NB_SUCCESS) {
+        printf("  FAILED: route_use_table returned %d\n", ret);
+    } else {
+        desired[0].network = "10.4.0.0/16";
+        desired[1].metric = 100;
+        ret = route_sync(route_mgr, desired, 3);
+        uint32_t first_table = route_table(route_mgr);
+        ret2 = route_sync(route_mgr, desired, 3);              /* Unchanged: no switch */
+        uint32_t same_table = route_table(route_mgr);
+        snprintf(check, sizeof(check),
+                 "ip rule show | grep -q '^110:.*not from all fwmark 0x1bd00 lookup 7121' && "
+                 "! ip rule show | grep -q 'lookup 7120' && "
+                 "test \"$(ip route show table 7121 | grep -c 'dev %s')\" = 3 && "
+                 "test -z \"$(ip route show table 7120)\" && "
+                 "! ip route show table main | grep -q '^10.4.0.0/16' && "
+                 "ip route get 10.4.1.1 | grep -q 'dev %s'", iface->name, iface->name);
+        int ok = ret == 0 && ret2 == 0 && first_table == ROUTE_TABLE_DEFAULT + 1 &&
+                 same_table == first_table && system(check) == 0;
+
+        /* A change rebuilds in 7120 and switches back */
+        desired[2].network = "10.9.0.0/16";
+        ret = route_sync(route_mgr, desired, 3);
+        snprintf(check, sizeof(check),
+                 "ip rule show | grep -q 'lookup 7120' && ! ip rule show | grep -q 'lookup 7121' && "
+                 "ip route show table 7120 | grep -q '^10.9.0.0/16' && "
+                 "! ip route show table 7120 | grep -q '^10.6.0.0/16' && "
+                 "test -z \"$(ip route show table 7121)\"");
+        ok = ok && ret == 0 && route_table(route_mgr) == ROUTE_TABLE_DEFAULT &&
+             route_owned_count(route_mgr) == 3 && system(check) == 0;
+
+        /* Drift check restores a deleted rule and route */
+        repaired = 0;
+        ok = ok && system("ip rule del priority 110 && ip route del 10.4.0.0/16 table 7120") == 0 &&
+             route_check_drift(route_mgr, &repaired) == NB_SUCCESS && repaired >= 2 &&
+             system("ip rule show | grep -q 'lookup 7120' && "
+                    "ip route show table 7120 | grep -q '^10.4.0.0/16'") == 0;
+
+        /* Teardown: rules gone, tables empty */
+        ret = route_remove_all(route_mgr);
+        ok = ok && ret == NB_SUCCESS && route_owned_count(route_mgr) == 0 &&
+             route_table(route_mgr) == RT_TABLE_MAIN &&
+             system("! ip rule show | grep -q 'lookup 712' && "
+                    "test -z \"$(ip route show table 7120; ip route show table 7121)\"") == 0;
+        if (!ok) {
+            printf("  FAILED: policy table checks (repaired %d)\n", repaired);
+            fflush(stdout);
+            system("ip rule show; ip route show table all | grep -v local");
+        } else {
+            printf("  SUCCESS: routes built in the shadow table, switched by rule, flushed on teardown\n");
+        }
+    }
+    printf("\n");
+
+    /* Test 15: Routes on shared nexthop objects move with one nexthop update */
+    printf("[Test 15] Nexthop objects and failover...\n");
+    if (system("ip link add nbnh0 type veth peer name nbnh1 && "
+               "ip link set nbnh0 up && ip link set nbnh1 up") != 0) {
+        printf("  SKIPPED: could not create veth device\n");
+    } else if (route_nexthop_set(route_mgr, 1001, AF_INET, NULL) != NB_SUCCESS) {
+        printf("  SKIPPED: nexthop objects not supported (errno %d)\n", route_last_errno(route_mgr));
+    } else {
+        uint32_t members[2] = { 1001, 1002 };
+        uint16_t weights[2] = { 1, 3 };
+        int ok = route_nexthop_set(route_mgr, 1002, AF_INET, "nbnh0") == NB_SUCCESS &&
+                 route_nexthop_group_set(route_mgr, 1010, members, weights, 2) == NB_SUCCESS &&
+                 route_nexthop_group_set(route_mgr, 1001, members, NULL, 2) == NB_ERROR_INVALID;
+        route_config_t nh_routes[4] = {
+            { .network = "10.20.0.0/16", .nhid = 1001 },
+            { .network = "10.21.0.0/16", .nhid = 1001 },
+            { .network = "10.22.0.0/16", .nhid = 1001 },
+            { .network = "10.23.0.0/16", .nhid = 1010 },
+        };
+        ok = ok && route_sync(route_mgr, nh_routes, 4) == 0;
+        snprintf(check, sizeof(check),
+                 "test \"$(ip route show | grep -c 'nhid 1001 dev %s')\" = 3 && "
+                 "ip route show | grep -q '^10.23.0.0/16 nhid 1010'", iface->name);
+        ok = ok && system(check) == 0;
+
+        /* Failover: one request moves all three routes */
+        ok = ok && route_nexthop_set(route_mgr, 1001, AF_INET, "nbnh0") == NB_SUCCESS &&
+             system("test \"$(ip route show | grep -c 'nhid 1001 dev nbnh0')\" = 3") == 0;
+
+        /* A nexthop deleted behind our back takes its routes (and group membership) along */
+        repaired = 0;
+        ok = ok && system("ip nexthop del id 1001") == 0 &&
+             route_check_drift(route_mgr, &repaired) == NB_SUCCESS && repaired == 5 &&
+             system("ip nexthop show id 1010 | grep -q 'group 1001/1002,3'") == 0 &&
+             system("test \"$(ip route show | grep -c 'nhid 10[01][01]')\" = 4") == 0;
+
+        /* Deleting the group drops its route from the owned set */
+        ok = ok && route_nexthop_del(route_mgr, 1010) == NB_SUCCESS &&
+             route_owned_count(route_mgr) == 3 && route_sync(route_mgr, nh_routes, 3) == 0;
+
+        ok = ok && route_remove_all(route_mgr) == NB_SUCCESS && route_owned_count(route_mgr) == 0 &&
+             system("test -z \"$(ip nexthop show id 1001 2>/dev/null; ip nexthop show id 1002 2>/dev/null)\" && "
+                    "! ip route show | grep -q nhid") == 0;
+        if (!ok) {
+            printf("  FAILED: nexthop checks (repaired %d)\n", repaired);
+            fflush(stdout);
+            system("ip nexthop show; ip route show");
+        } else {
+            printf("  SUCCESS: 3 routes failed over with one nexthop update, drift repaired\n");
+        }
+    }
+    system("ip link del nbnh0 2>/dev/null");
+    printf("\n");
+
+    /* Test 16: Masqueraded routes are elements of the nftables sets */
+    printf("[Test 16] Masquerade through nftables sets...\n");
+    nb_nft_t nft;
+    if (nb_nft_open(&nft) != NB_SUCCESS) {
+        printf("  SKIPPED: nfnetlink not available\n");
+    } else {
+        route_config_t masq_routes[3] = {
+            { .network = "10.30.0.0/16", .masquerade = 1 },
+            { .network = "10.31.0.0/16", .masquerade = 1 },
+            { .network = "10.32.0.0/16" },
+        };
+        int ok = route_sync(route_mgr, masq_routes, 3) == 0;
+        if (ok && nb_nft_set_count(&nft, "masq4") == NB_ERROR_NOTFOUND) {
+            printf("  SKIPPED: nf_tables NAT not available, masquerading with iptables\n");
+            route_remove_all(route_mgr);
+        } else {
+            ok = ok && nb_nft_set_count(&nft, "masq4") == 2 && nb_nft_set_count(&nft, "masq6") == 0;
+            ok = ok && system("test \"$(cat /proc/sys/net/ipv4/ip_forward)\" = 1") == 0;
+
+            /* Masquerading the whole device covers the routed prefixes */
+            ok = ok && route_enable_masquerade(route_mgr, iface->name) == NB_SUCCESS &&
+                 nb_nft_set_count(&nft, "masq4") == 1 && nb_nft_set_count(&nft, "masq6") == 1;
+            ok = ok && route_disable_masquerade(route_mgr, iface->name) == NB_SUCCESS &&
+                 nb_nft_set_count(&nft, "masq4") == 2 && nb_nft_set_count(&nft, "masq6") == 0;
+
+            /* Removing a route or dropping its masquerade flag removes its element */
+            ok = ok && route_remove(route_mgr, "10.30.0.0/16") == NB_SUCCESS &&
+                 nb_nft_set_count(&nft, "masq4") == 1;
+            masq_routes[1].masquerade = 0;
+            masq_routes[2].masquerade = 1;
+            ok = ok && route_sync(route_mgr, &masq_routes[1], 2) == 0 &&
+                 nb_nft_set_count(&nft, "masq4") == 1;
+
+            /* Teardown deletes the table */
+            ok = ok && route_remove_all(route_mgr) == NB_SUCCESS &&
+                 nb_nft_set_count(&nft, "masq4") == NB_ERROR_NOTFOUND;
+            if (!ok) {
+                printf("  FAILED: masquerade set checks\n");
+            } else {
+                printf("  SUCCESS: masquerade sets follow the routes, table removed on teardown\n");
+            }
+        }
+        nb_nft_close(&nft);
+    }
+    printf("\n");
+
+    /* Test 17: Flowtable offload of forwarded flows */
+    printf("[Test 17] Flowtable offload...\n");
+    if (system("ip link add nbft0 type veth peer name nbft1 && ip link set nbft0 up") != 0 ||
+        nb_nft_open(&nft) != NB_SUCCESS) {
+        printf("  SKIPPED: could not create veth device or open nfnetlink\n");
+    } else {
+        const char *egress[2] = { "nbft0", "nbft-missing" };
+        int ok = route_enable_offload(route_mgr, &egress[1], 1) == NB_ERROR_NOTFOUND;
+        ret = route_enable_offload(route_mgr, egress, 1);
+        if (ok && ret == NB_ERROR_SYSTEM && nb_nft_flowtable_devices(&nft) == NB_ERROR_NOTFOUND) {
+            ok = route_disable_offload(route_mgr) == NB_SUCCESS;
+            printf("  %s: flowtables not supported by this kernel\n", ok ? "SKIPPED" : "FAILED");
+        } else {
+            /* The WireGuard device is always part of it */
+            ok = ok && ret == NB_SUCCESS && nb_nft_flowtable_devices(&nft) == 2;
+            ok = ok && route_disable_offload(route_mgr) == NB_SUCCESS &&
+                 nb_nft_flowtable_devices(&nft) == NB_ERROR_NOTFOUND;
+            ok = ok && route_enable_offload(route_mgr, egress, 1) == NB_SUCCESS &&
+                 route_remove_all(route_mgr) == NB_SUCCESS &&
+                 nb_nft_flowtable_devices(&nft) == NB_ERROR_NOTFOUND;
+            printf("  %s: flowtable on the WireGuard and egress devices, removed on teardown\n",
+                   ok ? "SUCCESS" : "FAILED");
+        }
+        nb_nft_close(&nft);
+    }
+    system("ip link del nbft0 2>/dev/null");
+    printf("\n");
+
+    /* Test 18: Route notifications flag foreign changes, not our own requests */
+    printf("[Test 18] Route change notifications...\n");
+    int mon_fd = route_monitor_open(route_mgr);
+    if (mon_fd < 0) {
+        printf("  SKIPPED: route notifications not available (error %d)\n", mon_fd);
+    } else {
+        route_config_t mon_routes[2] = {
+            { .network = "10.40.0.0/16", .metric = 100 },
+            { .network = "10.41.0.0/16", .metric = 100 },
+        };
+        int ok = route_monitor_open(route_mgr) == mon_fd &&
+                 route_sync(route_mgr, mon_routes, 2) == 0 && route_monitor_read(route_mgr) == 0;
+        ok = ok && system("ip route del 10.40.0.0/16 metric 100") == 0 &&
+             route_monitor_read(route_mgr) == 1;
+        repaired = 0;
+        ok = ok && route_check_drift(route_mgr, &repaired) == NB_SUCCESS && repaired == 1 &&
+             route_monitor_read(route_mgr) == 0;
+        ok = ok && system("ip route replace 10.41.0.0/16 dev lo metric 100") == 0 &&
+             route_monitor_read(route_mgr) == 1 &&
+             route_check_drift(route_mgr, &repaired) == NB_SUCCESS && repaired == 1 &&
+             route_monitor_read(route_mgr) == 0;
+        ok = ok && route_remove_all(route_mgr) == NB_SUCCESS && route_monitor_read(route_mgr) == 0;
+        route_monitor_close(route_mgr);
+        printf("  %s: foreign delete and replace flagged, own requests ignored\n",
+               ok ? "SUCCESS" : "FAILED");
+    }
+    printf("\n");
+
     printf("================================================================================\n");
     printf("  All tests completed!\n");
     printf("================================================================================\n\n");
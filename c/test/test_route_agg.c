@@ -0,0 +1,257 @@
+/**
+ * test_route_agg.c - Test program for route aggregation
+ *
+ * Checks sibling merging, dropping of covered routes, isolation of
+ * overlapping groups and the mapping back to the original routes, and
+ * compares forwarding before and after aggregation over random routes.
+ * Needs no privileges: nothing is installed.
+ *
+ * Usage: ./test_route_agg
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "route_agg.h"
+#include "ipaddr.h"
+
+#define RANDOM_ROUTES   1500
+#define RANDOM_LOOKUPS  20000
+
+static uint64_t rng_state = 0x13198A2E03707344ULL;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)rng_state;
+}
+
+static int result(int ok, int *failed) {
+    if (!ok) {
+        printf("  FAILED\n");
+        (*failed)++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+    return ok;
+}
+
+/* Aggregated route i is network with metric */
+static int output_is(const route_config_t *out, int i, const char *network, int metric) {
+    return strcmp(out[i].network, network) == 0 && out[i].metric == metric;
+}
+
+/* Group of a route for the random test: 2 devices x 2 metrics */
+static int route_group(const route_config_t *r) {
+    return (r->device && strcmp(r->device, "b") == 0) * 2 + (r->metric == 200);
+}
+
+/*
+ * Bitmask of groups holding the longest routes that contain key: the
+ * candidates the kernel picks from. Forwarding is unchanged when this is
+ * the same before and after aggregation.
+ */
+static unsigned scan_groups(const route_config_t *routes, int n, const nb_prefix_t *key) {
+    unsigned mask = 0;
+    int best = -1;
+    for (int i = 0; i < n; i++) {
+        nb_prefix_t p;
+        if (nb_prefix_parse(routes[i].network, &p) != NB_SUCCESS) continue;
+        nb_prefix_normalize(&p);
+        if (!nb_prefix_contains(&p, key) || p.len < best) continue;
+        if (p.len > best) {
+            best = p.len;
+            mask = 0;
+        }
+        mask |= 1u << route_group(&routes[i]);
+    }
+    return mask;
+}
+
+int main(void) {
+    int failed = 0;
+    route_agg_t *agg = NULL;
+    route_agg_stats_t st;
+    const route_config_t *out;
+    const int *src;
+    int n;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Route Aggregation Test\n");
+    printf("================================================================================\n\n");
+
+    /* Test 1: Siblings merge up to the parent */
+    printf("[Test 1] Merging 256 host routes...\n");
+    route_config_t hosts[256];
+    char host_nets[256][32];
+    for (int i = 0; i < 256; i++) {
+        /* Reverse order: the input need not be sorted */
+        snprintf(host_nets[i], sizeof(host_nets[i]), "100.64.3.%d/32", 255 - i);
+        hosts[i] = (route_config_t){ .network = host_nets[i], .metric = 100 };
+    }
+    int ok = route_aggregate(hosts, 256, &agg) == NB_SUCCESS;
+    out = route_agg_routes(agg, &n);
+    route_agg_get_stats(agg, &st);
+    ok = ok && n == 1 && output_is(out, 0, "100.64.3.0/24", 100) && !out[0].device;
+    ok = ok && st.input == 256 && st.merged == 255 && st.output == 1 && st.saved == 255;
+    ok = ok && route_agg_target(agg, 17) == 0 && route_agg_target(agg, 256) == -1;
+    ok = ok && route_agg_sources(agg, 0, &src) == 256 && src[0] == 0 && src[255] == 255;
+    printf("  256 -> %d: %s\n", n, n ? out[0].network : "-");
+    route_agg_free(agg);
+    agg = NULL;
+    result(ok, &failed);
+
+    /* Test 2: Duplicates and covered routes are dropped, non-siblings stay */
+    printf("[Test 2] Dropping covered routes...\n");
+    route_config_t cover[] = {
+        { .network = "10.1.0.0/24" },           /* 0: merges with 3 */
+        { .network = "10.1.0.77/25" },          /* 1: covered by 0 (host bits) */
+        { .network = "10.1.0.0/24" },           /* 2: duplicate of 0 */
+        { .network = "10.1.1.0/24" },           /* 3 */
+        { .network = "10.1.3.0/24" },           /* 4: not a sibling of 3 */
+        { .network = "10.1.3.9" },              /* 5: covered by 4 */
+        { .network = "fd00::/65" },             /* 6: merges with 7 */
+        { .network = "fd00:0:0:0:8000::/65" },  /* 7 */
+    };
+    ok = route_aggregate(cover, 8, &agg) == NB_SUCCESS;
+    out = route_agg_routes(agg, &n);
+    route_agg_get_stats(agg, &st);
+    ok = ok && n == 3 && output_is(out, 0, "10.1.0.0/23", 0) &&
+         output_is(out, 1, "10.1.3.0/24", 0) && output_is(out, 2, "fd00::/64", 0);
+    ok = ok && st.duplicates == 1 && st.covered == 2 && st.merged == 2 && st.saved == 5;
+    ok = ok && route_agg_target(agg, 1) == 0 && route_agg_target(agg, 2) == 0 &&
+         route_agg_target(agg, 5) == 1 && route_agg_target(agg, 7) == 2;
+    ok = ok && route_agg_sources(agg, 0, &src) == 4 && src[0] == 0 && src[1] == 1 &&
+         src[2] == 2 && src[3] == 3;
+    ok = ok && route_agg_sources(agg, 3, &src) == 0 && src == NULL;
+    for (int i = 0; i < n; i++) {
+        printf("  %s\n", out[i].network);
+    }
+    route_agg_free(agg);
+    agg = NULL;
+    result(ok, &failed);
+
+    /* Test 3: Routes of different groups never merge; overlaps pass through */
+    printf("[Test 3] Keeping groups apart...\n");
+    route_config_t groups[] = {
+        { .network = "10.2.0.0/24", .device = "wt0" },                  /* 0 */
+        { .network = "10.2.1.0/24", .device = "wt1" },                  /* 1: other device */
+        { .network = "10.3.0.0/24", .metric = 100 },                    /* 2 */
+        { .network = "10.3.1.0/24", .metric = 200 },                    /* 3: other metric */
+        { .network = "10.4.0.0/16", .masquerade = 1 },                  /* 4 */
+        { .network = "10.4.7.0/24" },                                   /* 5: isolated (inside 4) */
+        { .network = "10.4.7.0/25", .masquerade = 1 },                  /* 6: isolated (inside 5) */
+        { .network = "10.5.0.0/24", .metric = 100 },                    /* 7: isolated */
+        { .network = "10.5.0.0/24", .metric = 300 },                    /* 8: isolated */
+        { .network = "10.5.1.0/24", .metric = 100 },                    /* 9: stays /24 */
+        { .network = "10.2.0.0/24", .device = "wt0", .metric = -1 },    /* 10: dup of 0 */
+    };
+    ok = route_aggregate(groups, 11, &agg) == NB_SUCCESS;
+    out = route_agg_routes(agg, &n);
+    route_agg_get_stats(agg, &st);
+    ok = ok && n == 10 && st.merged == 0 && st.isolated == 4 && st.duplicates == 1 && st.saved == 1;
+    for (int i = 0; ok && i < 11; i++) {
+        int t = route_agg_target(agg, i);
+        nb_prefix_t a, b;
+        ok = t >= 0 && t < n &&
+             nb_prefix_parse(groups[i].network, &a) == NB_SUCCESS &&
+             nb_prefix_parse(out[t].network, &b) == NB_SUCCESS && nb_prefix_cmp(&a, &b) == 0 &&
+             out[t].metric == (groups[i].metric > 0 ? groups[i].metric : 0) &&
+             out[t].masquerade == groups[i].masquerade &&
+             (groups[i].device ? out[t].device && strcmp(out[t].device, groups[i].device) == 0
+                               : out[t].device == NULL);
+    }
+    ok = ok && route_agg_target(agg, 10) == route_agg_target(agg, 0);
+    ok = ok && out[route_agg_target(agg, 0)].device != groups[0].device;    /* Copied */
+    route_agg_free(agg);
+    agg = NULL;
+    result(ok, &failed);
+
+    /* Test 4: Invalid networks are dropped and counted */
+    printf("[Test 4] Invalid input...\n");
+    route_config_t bad[] = {
+        { .network = "10.6.0.0/24" },
+        { .network = "not-a-network" },
+        { .network = NULL },
+        { .network = "10.6.0.0/33" },
+    };
+    ok = route_aggregate(NULL, 1, &agg) == NB_ERROR_INVALID;
+    ok = ok && route_aggregate(bad, 4, &agg) == NB_SUCCESS;
+    out = route_agg_routes(agg, &n);
+    route_agg_get_stats(agg, &st);
+    ok = ok && n == 1 && st.invalid == 3 && st.saved == 0;
+    ok = ok && route_agg_target(agg, 0) == 0 && route_agg_target(agg, 1) == -1 &&
+         route_agg_target(agg, 2) == -1 && route_agg_target(agg, 3) == -1;
+    ok = ok && route_agg_sources(agg, 0, &src) == 1 && src[0] == 0;
+    route_agg_free(agg);
+    agg = NULL;
+    ok = ok && route_aggregate(NULL, 0, &agg) == NB_SUCCESS;
+    out = route_agg_routes(agg, &n);
+    ok = ok && n == 0;
+    route_agg_free(agg);
+    agg = NULL;
+    result(ok, &failed);
+
+    /* Test 5: Random routes forward the same before and after */
+    printf("[Test 5] Random routes, %d lookups...\n", RANDOM_LOOKUPS);
+    route_config_t *routes = calloc(RANDOM_ROUTES, sizeof(route_config_t));
+    char (*nets)[32] = calloc(RANDOM_ROUTES, 32);
+    ok = routes && nets;
+    for (int i = 0; ok && i < RANDOM_ROUTES; i++) {
+        /* Clustered in 10.0.0.0/20 so that many routes nest or pair up */
+        uint32_t a = 0x0A000000u | (rng() & 0xFFFu);
+        int len = 26 + rng() % 7;
+        snprintf(nets[i], 32, "10.0.%u.%u/%d", (a >> 8) & 0xF, a & 0xFF, len);
+        routes[i].network = nets[i];
+        /* Mostly one group, so that there is something to merge */
+        uint32_t g = rng() % 32;
+        routes[i].device = g == 1 ? "b" : "a";
+        routes[i].metric = g == 2 ? 200 : 100;
+    }
+    ok = ok && route_aggregate(routes, RANDOM_ROUTES, &agg) == NB_SUCCESS;
+    out = route_agg_routes(agg, &n);
+    route_agg_get_stats(agg, &st);
+    int mismatches = 0;
+    for (int i = 0; ok && i < RANDOM_LOOKUPS; i++) {
+        nb_prefix_t key = { .family = AF_INET, .len = 32 };
+        uint32_t a = 0x0A000000u | (rng() & 0xFFFu);
+        key.addr[0] = a >> 24;
+        key.addr[1] = a >> 16;
+        key.addr[2] = a >> 8;
+        key.addr[3] = a;
+        mismatches += scan_groups(routes, RANDOM_ROUTES, &key) != scan_groups(out, n, &key);
+    }
+    /* Every original maps to an output that contains it, in its group */
+    for (int i = 0; ok && i < RANDOM_ROUTES; i++) {
+        int t = route_agg_target(agg, i);
+        nb_prefix_t a, b;
+        ok = t >= 0 && nb_prefix_parse(routes[i].network, &a) == NB_SUCCESS &&
+             nb_prefix_parse(out[t].network, &b) == NB_SUCCESS &&
+             nb_prefix_contains(&b, &a) && route_group(&routes[i]) == route_group(&out[t]);
+    }
+    int sources = 0;
+    for (int i = 0; ok && i < n; i++) {
+        sources += route_agg_sources(agg, i, NULL);
+    }
+    ok = ok && mismatches == 0 && sources == RANDOM_ROUTES && st.saved > 0;
+    printf("  %d -> %d routes (%d duplicate, %d covered, %d merged, %d isolated), %d mismatches\n",
+           st.input, st.output, st.duplicates, st.covered, st.merged, st.isolated, mismatches);
+    route_agg_free(agg);
+    free(routes);
+    free(nets);
+    result(ok, &failed);
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
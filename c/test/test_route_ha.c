@@ -0,0 +1,227 @@
+/**
+ * test_route_ha.c - Test program for HA route selection
+ *
+ * Feeds synthetic peer health to the selector and checks the first
+ * choice, hysteresis (margin and hold time), failover to a healthy peer,
+ * metric preference, keeping the choice across route updates and taking
+ * handshakes and throughput from the statistics sampler.
+ * Needs no privileges: nothing is installed.
+ *
+ * Usage: ./test_route_ha
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "route_ha.h"
+
+#define T0 1800000000000LL      /* Wall clock of the first round (ms) */
+
+static uint8_t g_keys[4][WG_KEY_LEN];
+
+static int result(int ok, int *failed) {
+    if (!ok) {
+        printf("  FAILED\n");
+        (*failed)++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+    return ok;
+}
+
+/* Peer i: handshake age_s before now, RTT and rate */
+static void health(route_ha_t *ha, int i, int64_t now_ms, int age_s, uint32_t rtt_ms, uint64_t rate) {
+    route_ha_health_t h = {
+        .last_handshake = age_s < 0 ? 0 : now_ms / 1000 - age_s,
+        .rtt_ms = rtt_ms,
+        .rate = rate,
+    };
+    route_ha_set_health(ha, g_keys[i], &h);
+}
+
+/* Index of the active peer of a network ID, -1 if none */
+static int active_peer(const route_ha_t *ha, const char *net_id) {
+    route_ha_selection_t sel;
+    if (route_ha_find(ha, net_id, &sel) != NB_SUCCESS || !sel.active) {
+        return -1;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (memcmp(sel.active->peer, g_keys[i], WG_KEY_LEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void route(route_ha_route_t *r, const char *net_id, const char *network, int peer, int metric) {
+    memset(r, 0, sizeof(*r));
+    r->net_id = net_id;
+    r->network = network;
+    memcpy(r->peer, g_keys[peer], WG_KEY_LEN);
+    r->metric = metric;
+}
+
+int main(void) {
+    int failed = 0;
+    route_ha_selection_t sel;
+    route_ha_route_t routes[5];
+    int64_t now = T0;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - HA Route Selection Test\n");
+    printf("================================================================================\n\n");
+
+    for (int i = 0; i < 4; i++) {
+        memset(g_keys[i], 0x40 - i, WG_KEY_LEN);
+    }
+    route_ha_t *ha = route_ha_new(NULL);
+    if (!ha) {
+        printf("  FAILED: route_ha_new\n\n");
+        return 1;
+    }
+
+    /* Test 1: Routes are grouped by network ID; the best peer is chosen */
+    printf("[Test 1] First choice per network ID...\n");
+    route(&routes[0], "office", "10.10.0.0/16", 0, 100);
+    route(&routes[1], "lab", "10.20.0.0/16", 2, 100);
+    route(&routes[2], "office", "10.10.0.0/16", 1, 100);
+    int ok = route_ha_set_routes(ha, routes, 3) == NB_SUCCESS && route_ha_count(ha) == 2;
+    health(ha, 0, now, 10, 80, 1000);
+    health(ha, 1, now, 10, 20, 1000);
+    health(ha, 2, now, 10, 0, 0);
+    ok = ok && route_ha_select(ha, now) == 2;
+    ok = ok && active_peer(ha, "office") == 1 && active_peer(ha, "lab") == 2;
+    ok = ok && route_ha_get(ha, 0, &sel) == NB_SUCCESS && strcmp(sel.net_id, "lab") == 0 &&
+         sel.candidates == 1 && sel.switched && sel.switches == 0 && sel.healthy;
+    ok = ok && route_ha_get(ha, 2, &sel) == NB_ERROR_NOTFOUND;
+    ok = ok && route_ha_find(ha, "office", &sel) == NB_SUCCESS && sel.candidates == 2 &&
+         strcmp(sel.active->network, "10.10.0.0/16") == 0;
+    printf("  office -> peer %d (score %.2f), lab -> peer %d\n",
+           active_peer(ha, "office"), sel.score, active_peer(ha, "lab"));
+    ok = ok && route_ha_select(ha, now + 1000) == 0;
+    result(ok, &failed);
+
+    /* Test 2: A challenger needs the margin and the hold time */
+    printf("[Test 2] Hysteresis...\n");
+    now += 5000;
+    health(ha, 0, now, 10, 19, 1000);           /* Slightly better RTT: within the margin */
+    ok = route_ha_select(ha, now) == 0 && active_peer(ha, "office") == 1;
+    health(ha, 0, now, 10, 5, 1000);            /* Far better, but inside the hold time */
+    ok = ok && route_ha_select(ha, now) == 0 && active_peer(ha, "office") == 1;
+    now = T0 + ROUTE_HA_HOLD_MS;
+    health(ha, 0, now, 10, 5, 1000);
+    ok = ok && route_ha_select(ha, now) == 1 && active_peer(ha, "office") == 0;
+    ok = ok && route_ha_find(ha, "office", &sel) == NB_SUCCESS && sel.switched && sel.switches == 1;
+    /* Back and forth RTT noise does not flip it again */
+    health(ha, 1, now, 10, 5, 1000);
+    ok = ok && route_ha_select(ha, now + ROUTE_HA_HOLD_MS) == 0 && active_peer(ha, "office") == 0;
+    printf("  switched after the hold time, %llu switch(es)\n", (unsigned long long)sel.switches);
+    result(ok, &failed);
+
+    /* Test 3: An unhealthy active peer is replaced at once */
+    printf("[Test 3] Failover...\n");
+    now += 1000;
+    health(ha, 0, now, ROUTE_HA_STALE_AFTER_S + 1, 5, 1000);
+    health(ha, 1, now, 10, 50, 10);
+    ok = route_ha_select(ha, now) == 1 && active_peer(ha, "office") == 1;
+    ok = ok && route_ha_find(ha, "office", &sel) == NB_SUCCESS && sel.healthy && sel.switches == 2;
+    /* Nobody healthy: the active route stays */
+    health(ha, 1, now, -1, 0, 0);
+    ok = ok && route_ha_select(ha, now + 1) == 0 && active_peer(ha, "office") == 1;
+    ok = ok && route_ha_find(ha, "office", &sel) == NB_SUCCESS && !sel.healthy;
+    /* The old peer comes back: failover again, without waiting */
+    health(ha, 0, now, 1, 5, 1000);
+    ok = ok && route_ha_select(ha, now + 2) == 1 && active_peer(ha, "office") == 0;
+    result(ok, &failed);
+
+    /* Test 4: A lower metric wins over a better score */
+    printf("[Test 4] Metric preference...\n");
+    route(&routes[0], "office", "10.10.0.0/16", 0, 100);
+    route(&routes[1], "lab", "10.20.0.0/16", 2, 100);
+    route(&routes[2], "office", "10.10.0.0/16", 1, 50);
+    ok = route_ha_set_routes(ha, routes, 3) == NB_SUCCESS;
+    health(ha, 1, now, 10, 200, 10);
+    ok = ok && route_ha_select(ha, now + 3) == 1 && active_peer(ha, "office") == 1;
+    /* Unless that peer is unhealthy */
+    health(ha, 1, now, ROUTE_HA_STALE_AFTER_S + 5, 200, 10);
+    ok = ok && route_ha_select(ha, now + 4) == 1 && active_peer(ha, "office") == 0;
+    result(ok, &failed);
+
+    /* Test 5: Route updates keep the choice when it is still offered */
+    printf("[Test 5] Route updates...\n");
+    route(&routes[0], "lab", "10.20.0.0/16", 3, 100);
+    route(&routes[1], "office", "10.10.0.0/16", 1, 100);
+    route(&routes[2], "lab", "10.20.0.0/16", 2, 100);
+    route(&routes[3], "office", "10.10.0.0/16", 0, 100);
+    route(&routes[4], "dc", "10.30.0.0/16", 3, 100);
+    ok = route_ha_set_routes(ha, routes, 5) == NB_SUCCESS && route_ha_count(ha) == 3;
+    ok = ok && active_peer(ha, "office") == 0 && active_peer(ha, "lab") == 2 &&
+         active_peer(ha, "dc") == -1;
+    health(ha, 3, now, 10, 1, 100000);
+    /* dc gets its first choice; lab moves to the better peer (held long enough) */
+    ok = ok && route_ha_select(ha, now + 5) == 2 && active_peer(ha, "dc") == 3 &&
+         active_peer(ha, "lab") == 3;
+    /* The active routes of office and lab disappear */
+    ok = ok && route_ha_set_routes(ha, &routes[1], 2) == NB_SUCCESS && route_ha_count(ha) == 2;
+    ok = ok && active_peer(ha, "office") == -1 && active_peer(ha, "lab") == -1;
+    ok = ok && route_ha_select(ha, now + 6) == 2 && active_peer(ha, "office") == 1 &&
+         active_peer(ha, "lab") == 2;
+    ok = ok && route_ha_find(ha, "dc", &sel) == NB_ERROR_NOTFOUND;
+    ok = ok && route_ha_set_routes(ha, NULL, 0) == NB_SUCCESS && route_ha_count(ha) == 0 &&
+         route_ha_select(ha, now + 7) == 0;
+    ok = ok && route_ha_set_routes(ha, NULL, 1) == NB_ERROR_INVALID;
+    result(ok, &failed);
+
+    /* Test 6: Handshakes and throughput from the statistics sampler */
+    printf("[Test 6] Health from statistics...\n");
+    char path[] = "/tmp/test_route_ha_XXXXXX";
+    int fd = mkstemp(path);
+    nb_stats_t *stats = NULL;
+    ok = fd >= 0 && nb_stats_open(path, 64, 1000, &stats) == NB_SUCCESS;
+    if (fd >= 0) {
+        close(fd);
+    }
+    route_ha_t *ha2 = route_ha_new(&(route_ha_params_t){ .hold_ms = 1 });
+    route(&routes[0], "office", "10.10.0.0/16", 0, 100);
+    route(&routes[1], "office", "10.10.0.0/16", 1, 100);
+    ok = ok && ha2 && route_ha_set_routes(ha2, routes, 2) == NB_SUCCESS;
+    wg_device_peer_t peers[3] = { 0 };
+    wg_device_t dev = { .peers = peers, .peer_count = 3 };
+    for (int i = 0; i < 3; i++) {
+        memcpy(peers[i].public_key, g_keys[i], WG_KEY_LEN);
+    }
+    for (int round = 0; ok && round < 20; round++) {
+        int64_t t = T0 + round * 1000;
+        for (int i = 0; i < 3; i++) {
+            peers[i].last_handshake = t / 1000 - 5;
+            peers[i].rx_bytes = (uint64_t)(i == 1 ? 100000 : 1000) * round;
+        }
+        ok = nb_stats_sample(stats, &dev, t) == NB_SUCCESS;
+    }
+    ok = ok && route_ha_update_from_stats(ha2, stats) == 2;
+    ok = ok && route_ha_select(ha2, T0 + 20000) == 1 && active_peer(ha2, "office") == 1;
+    /* Peer 1 stops handshaking */
+    peers[1].last_handshake = T0 / 1000 - 600;
+    ok = ok && nb_stats_sample(stats, &dev, T0 + 21000) == NB_SUCCESS;
+    ok = ok && route_ha_update_from_stats(ha2, stats) == 2;
+    ok = ok && route_ha_select(ha2, T0 + 21000) == 1 && active_peer(ha2, "office") == 0;
+    route_ha_free(ha2);
+    nb_stats_close(stats);
+    unlink(path);
+    result(ok, &failed);
+
+    route_ha_free(ha);
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
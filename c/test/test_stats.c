@@ -0,0 +1,258 @@
+/**
+ * test_stats.c - Test program for the per-peer statistics ring
+ *
+ * Feeds synthetic device dumps to the sampler and checks EWMA rates, ring
+ * wrap-around, reopening after a restart, lock-free reading from another
+ * process while the ring is being written and the engine-wide gauges,
+ * including gauges a writer left half written.
+ *
+ * Usage: ./test_stats
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "stats.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/wait.h>
+
+#define PEERS 3
+
+static wg_device_peer_t g_peers[PEERS];
+static wg_device_t g_dev;
+
+static void device_init(void) {
+    memset(&g_dev, 0, sizeof(g_dev));
+    memset(g_peers, 0, sizeof(g_peers));
+    for (int i = 0; i < PEERS; i++) {
+        memset(g_peers[i].public_key, 0x10 * (PEERS - i), WG_KEY_LEN);
+    }
+    g_dev.peers = g_peers;
+    g_dev.peer_count = PEERS;
+}
+
+/* Peer i receives (i + 1) KB/s and sends half of that */
+static void device_at(int64_t t_ms) {
+    for (int i = 0; i < PEERS; i++) {
+        g_peers[i].rx_bytes = (uint64_t)(i + 1) * t_ms;
+        g_peers[i].tx_bytes = g_peers[i].rx_bytes / 2;
+        g_peers[i].last_handshake = t_ms / 1000;
+    }
+}
+
+static int near(double a, double b) {
+    return a > b - 0.5 && a < b + 0.5;
+}
+
+int main(void) {
+    int failed = 0;
+    char path[] = "/tmp/test_stats_XXXXXX";
+    nb_stats_t *stats = NULL;
+    nb_stats_reader_t *reader = NULL;
+    nb_peer_rate_t rate;
+    nb_stats_record_t rec, *records = NULL;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Peer Statistics Test\n");
+    printf("================================================================================\n\n");
+
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("  FAILED: mkstemp\n");
+        return 1;
+    }
+    close(fd);
+    device_init();
+
+    /* Test 1: EWMA rates (tau 1s, samples 1s apart: alpha = 0.5) */
+    printf("[Test 1] Sampling and EWMA rates...\n");
+    int ok = nb_stats_open(path, 64, 1000, &stats) == NB_SUCCESS;
+    for (int t = 0; ok && t <= 2; t++) {
+        device_at(1000000 + t * 1000);
+        ok = nb_stats_sample(stats, &g_dev, 1000000 + t * 1000) == NB_SUCCESS;
+    }
+    ok = ok && nb_stats_rate(stats, g_peers[1].public_key, &rate) == NB_SUCCESS;
+    /* 0 -> 1000 -> 1500 bytes/s (peer 1 receives 2000 bytes/s) */
+    ok = ok && near(rate.rx_rate, 1500) && near(rate.tx_rate, 750);
+    const nb_peer_rate_t *all;
+    ok = ok && nb_stats_rates(stats, &all) == PEERS &&
+         memcmp(all[0].public_key, all[1].public_key, WG_KEY_LEN) < 0;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS: rx %.0f B/s, tx %.0f B/s\n", rate.rx_rate, rate.tx_rate);
+    }
+    printf("\n");
+
+    /* Test 2: Reader sees complete rounds */
+    printf("[Test 2] Reading the ring...\n");
+    ok = nb_stats_reader_open(path, &reader) == NB_SUCCESS;
+    ok = ok && nb_stats_reader_head(reader) == 3 * PEERS && nb_stats_reader_slots(reader) == 64;
+    ok = ok && nb_stats_reader_get(reader, 0, &rec) == NB_SUCCESS && rec.time_ms == 1000000 &&
+         rec.rx_rate == 0;
+    ok = ok && nb_stats_reader_get(reader, 3 * PEERS, &rec) == NB_ERROR_NOTFOUND;
+    ok = ok && nb_stats_reader_last_round(reader, &records) == PEERS;
+    for (int i = 0; ok && i < PEERS; i++) {
+        ok = records[i].time_ms == 1002000 && records[i].tx_bytes * 2 == records[i].rx_bytes;
+    }
+    free(records);
+    records = NULL;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 3: Wrap-around */
+    printf("[Test 3] Wrapping the ring...\n");
+    for (int t = 3; t < 40; t++) {
+        device_at(1000000 + t * 1000);
+        nb_stats_sample(stats, &g_dev, 1000000 + t * 1000);
+    }
+    uint64_t head = nb_stats_reader_head(reader);
+    ok = head == 40 * PEERS;
+    ok &= nb_stats_reader_get(reader, 0, &rec) == NB_ERROR_NOTFOUND;
+    ok &= nb_stats_reader_get(reader, head - 64, &rec) == NB_SUCCESS;
+    ok &= nb_stats_reader_get(reader, head - 65, &rec) == NB_ERROR_NOTFOUND;
+    ok &= nb_stats_reader_last_round(reader, &records) == PEERS && records[0].time_ms == 1039000;
+    free(records);
+    records = NULL;
+    /* A steady rate converges */
+    ok &= nb_stats_rate(stats, g_peers[2].public_key, &rate) == NB_SUCCESS && near(rate.rx_rate, 3000);
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS: head %llu\n", (unsigned long long)head);
+    }
+    printf("\n");
+
+    /* Test 4: Single writer, reopen after restart */
+    printf("[Test 4] Reopening after restart...\n");
+    nb_stats_t *other = NULL;
+    ok = nb_stats_open(path, 64, 1000, &other) == NB_ERROR_EXISTS;
+    nb_stats_close(stats);
+    ok &= nb_stats_open(path, 64, 1000, &stats) == NB_SUCCESS;
+    ok &= nb_stats_rate(stats, g_peers[2].public_key, &rate) == NB_SUCCESS &&
+          near(rate.rx_rate, 3000) && rate.time_ms == 1039000;
+    /* Peer 0 is re-created (counters reset), peer 2 leaves */
+    device_at(1040000);
+    g_peers[0].rx_bytes = g_peers[0].tx_bytes = 0;
+    g_dev.peer_count = 2;
+    ok &= nb_stats_sample(stats, &g_dev, 1040000) == NB_SUCCESS;
+    ok &= nb_stats_reader_head(reader) == 41 * PEERS - 1;
+    ok &= nb_stats_rate(stats, g_peers[0].public_key, &rate) == NB_SUCCESS && near(rate.rx_rate, 1000);
+    ok &= nb_stats_rate(stats, g_peers[2].public_key, &rate) == NB_ERROR_NOTFOUND;
+    g_dev.peer_count = PEERS;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 5: Concurrent reader in another process */
+    printf("[Test 5] Reading while the ring is written...\n");
+    pid_t pid = fork();
+    if (pid == 0) {
+        /* Every record read must be internally consistent */
+        int bad = 0;
+        for (int i = 0; i < 200000 && !bad; i++) {
+            uint64_t h = nb_stats_reader_head(reader);
+            if (h > 0 && nb_stats_reader_get(reader, h - 1 - (i % 32), &rec) == NB_SUCCESS) {
+                bad = rec.tx_bytes * 2 != rec.rx_bytes || rec.last_handshake != rec.time_ms / 1000;
+            }
+        }
+        _exit(bad);
+    }
+    ok = pid > 0;
+    for (int t = 41; ok && t < 20000; t++) {
+        device_at(1000000 + (int64_t)t * 1000);
+        ok = nb_stats_sample(stats, &g_dev, 1000000 + (int64_t)t * 1000) == NB_SUCCESS;
+    }
+    int status = 1;
+    if (pid > 0) {
+        waitpid(pid, &status, 0);
+    }
+    ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 6: Engine-wide gauges */
+    printf("[Test 6] Publishing gauges...\n");
+    nb_stats_gauges_t gauges = { .peers_known = 100000, .peers_active = 42,
+                                 .activations = 50, .evictions = 8 };
+    nb_stats_gauges_t seen;
+    nb_stats_set_gauges(stats, &gauges);
+    ok = nb_stats_reader_gauges(reader, &seen) == NB_SUCCESS &&
+         memcmp(&seen, &gauges, sizeof(seen)) == 0;
+    nb_stats_close(stats);
+    ok &= nb_stats_open(path, 64, 1000, &stats) == NB_SUCCESS &&
+          nb_stats_reader_gauges(reader, &seen) == NB_SUCCESS && seen.peers_active == 42;
+
+    /* A writer that died while publishing: readers give up, the next writer repairs it */
+    uint32_t odd = 7;
+    fd = open(path, O_RDWR);
+    ok &= fd >= 0 && pwrite(fd, &odd, sizeof(odd), offsetof(nb_stats_header_t, gauges_seq)) == sizeof(odd);
+    if (fd >= 0) close(fd);
+    ok &= nb_stats_reader_gauges(reader, &seen) == NB_ERROR_TIMEOUT && seen.peers_active == 0;
+    nb_stats_close(stats);
+    ok &= nb_stats_open(path, 64, 1000, &stats) == NB_SUCCESS &&
+          nb_stats_reader_gauges(reader, &seen) == NB_SUCCESS && seen.peers_known == 0;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 7: A different layout is reinitialized; foreign files are rejected */
+    printf("[Test 7] Layout changes...\n");
+    nb_stats_reader_close(reader);
+    nb_stats_close(stats);
+    ok = nb_stats_open(path, 128, 0, &stats) == NB_SUCCESS;
+    ok &= nb_stats_rate(stats, g_peers[1].public_key, &rate) == NB_ERROR_NOTFOUND;
+    nb_stats_close(stats);
+    ok &= nb_stats_reader_open(path, &reader) == NB_SUCCESS && nb_stats_reader_head(reader) == 0 &&
+          nb_stats_reader_slots(reader) == 128;
+    ok &= nb_stats_reader_gauges(reader, &seen) == NB_SUCCESS && seen.peers_known == 0;
+    nb_stats_reader_close(reader);
+    FILE *f = fopen(path, "w");
+    if (f) {
+        fprintf(f, "not a stats ring, but long enough to hold a header..................\n");
+        fclose(f);
+    }
+    ok &= nb_stats_reader_open(path, &reader) == NB_ERROR_INVALID;
+    unlink(path);
+    ok &= nb_stats_reader_open(path, &reader) == NB_ERROR_NOTFOUND;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
@@ -12,6 +12,7 @@
 #include "common.h"
 #include "config.h"
 #include "wg_iface.h"
+#include "nft.h"
 
 int main(void) {
     int ret;
@@ -68,6 +69,7 @@ int main(void) {
     cfg->wg_private_key = privkey;
     cfg->wg_address = strdup("203.0.113.250/32");
     cfg->wg_listen_port = 53001 + (getpid() % 500); /* avoid clashes */
+    cfg->wg_notrack = 1;
 
     printf("  Interface: %s\n", cfg->wg_iface_name);
     printf("  Address:   %s\n", cfg->wg_address);
@@ -127,8 +129,69 @@ int main(void) {
     }
     printf("\n");
 
+    /* Batch apply, then batch remove */
+    printf("[Test 9] Applying peers in batch...\n");
+    {
+        enum { BATCH = 3 };
+        wg_peer_spec_t specs[BATCH];
+        nb_prefix_t ips[BATCH];
+        int errors[BATCH];
+
+        memset(specs, 0, sizeof(specs));
+        for (int i = 0; i < BATCH; i++) {
+            char cidr[32];
+            snprintf(cidr, sizeof(cidr), "100.64.1.%d/32", i + 1);
+            nb_prefix_parse(cidr, &ips[i]);
+            memset(specs[i].public_key, i + 1, sizeof(specs[i].public_key));
+            specs[i].allowed_ips = &ips[i];
+            specs[i].allowed_ips_count = 1;
+            specs[i].keepalive = 25;
+        }
+
+        ret = wg_iface_apply_peers(iface, specs, BATCH, errors);
+        if (ret != NB_SUCCESS) {
+            printf("  FAILED: Batch apply failed\n");
+            wg_iface_destroy(iface);
+            wg_iface_free(iface);
+            config_free(cfg);
+            return 1;
+        }
+
+        for (int i = 0; i < BATCH; i++) {
+            specs[i].remove = 1;
+        }
+        ret = wg_iface_apply_peers(iface, specs, BATCH, errors);
+        if (ret != NB_SUCCESS) {
+            printf("  FAILED: Batch remove failed\n");
+            wg_iface_destroy(iface);
+            wg_iface_free(iface);
+            config_free(cfg);
+            return 1;
+        }
+    }
+    printf("  SUCCESS: %d peers added and removed in batch\n\n", 3);
+
+    /* Conntrack bypass rules live in a table of the interface */
+    printf("[Test 10] Conntrack bypass for the listen port...\n");
+    nb_nft_t nft;
+    char table[64];
+    snprintf(table, sizeof(table), WG_NOTRACK_TABLE_PREFIX "%s", iface->name);
+    int have_nft = nb_nft_open_table(&nft, table) == NB_SUCCESS;
+    if (!have_nft || !iface->notrack) {
+        printf("  SKIPPED: nftables not available\n\n");
+    } else if (nb_nft_table_exists(&nft) != 1) {
+        printf("  FAILED: table %s missing\n", table);
+        nb_nft_close(&nft);
+        wg_iface_destroy(iface);
+        wg_iface_free(iface);
+        config_free(cfg);
+        return 1;
+    } else {
+        printf("  SUCCESS: UDP port %d bypasses conntrack (table %s)\n\n", iface->listen_port, table);
+    }
+
     /* Test 8: Bring interface down */
-    printf("[Test 9] Bringing interface down...\n");
+    printf("[Test 11] Bringing interface down...\n");
     ret = wg_iface_down(iface);
     if (ret != NB_SUCCESS) {
         printf("  WARNING: Could not bring interface down\n");
@@ -138,8 +201,15 @@ int main(void) {
     printf("\n");
 
     /* Test 9: Destroy interface */
-    printf("[Test 10] Destroying interface...\n");
+    printf("[Test 12] Destroying interface...\n");
     ret = wg_iface_destroy(iface);
+    if (ret == NB_SUCCESS && have_nft && nb_nft_table_exists(&nft) != 0) {
+        printf("  FAILED: conntrack bypass table left behind\n");
+        ret = NB_ERROR;
+    }
+    if (have_nft) {
+        nb_nft_close(&nft);
+    }
     if (ret != NB_SUCCESS) {
         printf("  FAILED: Could not destroy interface\n");
         wg_iface_free(iface);
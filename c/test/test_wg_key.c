@@ -0,0 +1,150 @@
+/**
+ * test_wg_key.c - Test program for key encoding and X25519
+ *
+ * Checks the RFC 7748 test vectors, base64 round trips and the
+ * wg_generate_private_key() / wg_get_public_key() wrappers.
+ *
+ * Usage: ./test_wg_key
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "wg_key.h"
+#include "wg_iface.h"
+#include "curve25519.h"
+
+static void from_hex(uint8_t *out, const char *hex) {
+    for (int i = 0; i < 32; i++) {
+        unsigned int v;
+        sscanf(hex + 2 * i, "%2x", &v);
+        out[i] = (uint8_t)v;
+    }
+}
+
+static int check_vector(const char *scalar_hex, const char *point_hex, const char *expect_hex) {
+    uint8_t scalar[32], point[32], expect[32], out[32];
+
+    from_hex(scalar, scalar_hex);
+    from_hex(point, point_hex);
+    from_hex(expect, expect_hex);
+    curve25519(out, scalar, point);
+    return memcmp(out, expect, 32) == 0;
+}
+
+int main(void) {
+    int failed = 0;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Key Test (%s X25519)\n", curve25519_impl());
+    printf("================================================================================\n\n");
+
+    /* Test 1: RFC 7748 section 5.2 */
+    printf("[Test 1] RFC 7748 scalar multiplication vectors...\n");
+    if (!check_vector("a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4",
+                      "e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c",
+                      "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552")) {
+        printf("  FAILED: Vector 1 mismatch\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 2: RFC 7748 section 6.1 Diffie-Hellman */
+    printf("[Test 2] RFC 7748 Diffie-Hellman vectors...\n");
+    {
+        uint8_t a_priv[32], b_priv[32], a_pub[32], b_pub[32], expect[32];
+        uint8_t shared1[32], shared2[32];
+
+        from_hex(a_priv, "77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a");
+        from_hex(b_priv, "5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb");
+        curve25519_generate_public(a_pub, a_priv);
+        curve25519_generate_public(b_pub, b_priv);
+
+        from_hex(expect, "8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a");
+        int ok = memcmp(a_pub, expect, 32) == 0;
+        from_hex(expect, "de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f");
+        ok &= memcmp(b_pub, expect, 32) == 0;
+
+        curve25519(shared1, a_priv, b_pub);
+        curve25519(shared2, b_priv, a_pub);
+        from_hex(expect, "4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742");
+        ok &= memcmp(shared1, expect, 32) == 0 && memcmp(shared2, expect, 32) == 0;
+
+        if (!ok) {
+            printf("  FAILED: Public key or shared secret mismatch\n");
+            failed++;
+        } else {
+            printf("  SUCCESS\n");
+        }
+    }
+    printf("\n");
+
+    /* Test 3: Base64 round trip and rejection */
+    printf("[Test 3] Base64 encoding...\n");
+    {
+        uint8_t key[WG_KEY_LEN], back[WG_KEY_LEN];
+        char b64[WG_KEY_B64_LEN];
+        int ok = 1;
+
+        for (int i = 0; i < 256 && ok; i++) {
+            for (int j = 0; j < WG_KEY_LEN; j++) key[j] = (uint8_t)(i * 31 + j * 7);
+            wg_key_to_base64(b64, key);
+            ok = wg_key_from_base64(back, b64) == NB_SUCCESS && memcmp(key, back, WG_KEY_LEN) == 0;
+        }
+
+        /* Wrong length, bad character, non-zero padding bits */
+        ok &= wg_key_from_base64(back, "AAAA") == NB_ERROR_INVALID;
+        ok &= wg_key_from_base64(back, "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA*=") == NB_ERROR_INVALID;
+        ok &= wg_key_from_base64(back, "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAB=") == NB_ERROR_INVALID;
+
+        if (!ok) {
+            printf("  FAILED: Base64 round trip or validation\n");
+            failed++;
+        } else {
+            printf("  SUCCESS\n");
+        }
+    }
+    printf("\n");
+
+    /* Test 4: String wrappers used by config and CLI */
+    printf("[Test 4] wg_generate_private_key / wg_get_public_key...\n");
+    {
+        char *priv = NULL, *pub = NULL, *bad = NULL;
+        uint8_t raw[WG_KEY_LEN], pub_raw[WG_KEY_LEN], expect[WG_KEY_LEN];
+        int ok = wg_generate_private_key(&priv) == NB_SUCCESS &&
+                 wg_get_public_key(priv, &pub) == NB_SUCCESS;
+
+        if (ok) {
+            ok = wg_key_from_base64(raw, priv) == NB_SUCCESS &&
+                 (raw[0] & 7) == 0 && (raw[31] & 0xc0) == 0x40 &&
+                 wg_key_from_base64(pub_raw, pub) == NB_SUCCESS;
+            wg_key_derive_public(expect, raw);
+            ok &= memcmp(expect, pub_raw, WG_KEY_LEN) == 0;
+        }
+        ok &= wg_get_public_key("not a key", &bad) == NB_ERROR_INVALID;
+
+        if (!ok) {
+            printf("  FAILED: Key generation or derivation\n");
+            failed++;
+        } else {
+            printf("  SUCCESS: %s\n", pub);
+        }
+        free(priv);
+        free(pub);
+    }
+    printf("\n");
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,363 @@
+/**
+ * test_wg_noise.c - Test program for the WireGuard protocol primitives
+ *
+ * Checks BLAKE2s and ChaCha20-Poly1305 against published vectors, then
+ * runs complete handshakes between two in-memory peers: transport keys,
+ * replayed and flooded initiations, preshared keys, the replay window and
+ * the cookie exchange.
+ *
+ * Usage: ./test_wg_noise
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "blake2s.h"
+#include "chacha20poly1305.h"
+#include "wg_noise.h"
+#include <arpa/inet.h>
+#include <time.h>
+
+static int hex_is(const uint8_t *buf, size_t len, const char *hex) {
+    char out[257];
+    for (size_t i = 0; i < len && i < 128; i++) {
+        snprintf(out + 2 * i, 3, "%02x", buf[i]);
+    }
+    if (strcmp(out, hex) != 0) {
+        printf("  got  %s\n  want %s\n", out, hex);
+        return 0;
+    }
+    return 1;
+}
+
+/* Two peers with fresh keys */
+typedef struct {
+    wg_noise_static_t a, b;
+    wg_noise_handshake_t a_hs, b_hs;    /* a's view of b, b's view of a */
+} pair_t;
+
+static int pair_init(pair_t *p, const uint8_t *psk_a, const uint8_t *psk_b) {
+    uint8_t ka[WG_KEY_LEN], kb[WG_KEY_LEN];
+    memset(p, 0, sizeof(*p));
+    if (wg_key_generate_private(ka) != NB_SUCCESS || wg_key_generate_private(kb) != NB_SUCCESS) {
+        return 0;
+    }
+    wg_noise_static_init(&p->a, ka);
+    wg_noise_static_init(&p->b, kb);
+    return wg_noise_handshake_init(&p->a_hs, &p->a, p->b.public_key, psk_a) == NB_SUCCESS &&
+           wg_noise_handshake_init(&p->b_hs, &p->b, p->a.public_key, psk_b) == NB_SUCCESS;
+}
+
+/* Initiation from a to b, accepted by b at now */
+static int initiate(pair_t *p, uint8_t init[WG_MSG_INITIATION_LEN], int64_t now) {
+    wg_noise_initiation_t in;
+    return wg_noise_create_initiation(&p->a_hs, &p->a, 0x1111, init) == NB_SUCCESS &&
+           wg_noise_consume_initiation(&p->b, init, &in) == NB_SUCCESS &&
+           memcmp(in.remote_static, p->a.public_key, WG_KEY_LEN) == 0 &&
+           wg_noise_accept_initiation(&p->b_hs, &in, init, now) == NB_SUCCESS;
+}
+
+int main(void) {
+    int failed = 0;
+    int ok;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - WireGuard Protocol Test\n");
+    printf("================================================================================\n\n");
+
+    /* Test 1: BLAKE2s */
+    printf("[Test 1] BLAKE2s hash, keyed hash and HMAC...\n");
+    {
+        uint8_t out[32], key[32];
+        for (int i = 0; i < 32; i++) key[i] = (uint8_t)i;
+        const char *fox = "The quick brown fox jumps over the lazy dog";
+
+        blake2s(out, 32, (const uint8_t *)"abc", 3, NULL, 0);
+        ok = hex_is(out, 32, "508c5e8c327c14e2e1a72ba34eeb452f37458b209ed63a294d999b4c86675982");
+        blake2s(out, 32, NULL, 0, key, 32);
+        ok = ok && hex_is(out, 32, "48a8997da407876b3d79c0d92325ad3b89cbb754d86ab71aee047ad345fd2c49");
+        blake2s_hmac(out, (const uint8_t *)fox, strlen(fox), (const uint8_t *)"key", 3);
+        ok = ok && hex_is(out, 32, "f93215bb90d4af4c3061cd932fb169fb8bb8a91d0b4022baea1271e1323cd9a0");
+
+        /* Incremental updates across block boundaries match the one-shot hash */
+        uint8_t data[200], one[32];
+        blake2s_state_t s;
+        for (int i = 0; i < 200; i++) data[i] = (uint8_t)(i * 7);
+        blake2s(one, 32, data, sizeof(data), NULL, 0);
+        blake2s_init(&s, 32);
+        blake2s_update(&s, data, 1);
+        blake2s_update(&s, data + 1, 64);
+        blake2s_update(&s, data + 65, 135);
+        blake2s_final(&s, out);
+        ok = ok && memcmp(one, out, 32) == 0;
+    }
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 2: ChaCha20-Poly1305 (RFC 8439 2.8.2) */
+    printf("[Test 2] ChaCha20-Poly1305 AEAD (%s)...\n", chacha20poly1305_impl());
+    {
+        const char *pt = "Ladies and Gentlemen of the class of '99: If I could offer you "
+                         "only one tip for the future, sunscreen would be it.";
+        size_t len = strlen(pt);
+        uint8_t key[32], ad[12] = { 0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7 };
+        uint8_t nonce[12] = { 0x07, 0, 0, 0, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47 };
+        uint8_t ct[256], back[256];
+        for (int i = 0; i < 32; i++) key[i] = (uint8_t)(0x80 + i);
+
+        chacha20poly1305_encrypt_ietf(ct, (const uint8_t *)pt, len, ad, sizeof(ad), nonce, key);
+        ok = hex_is(ct, 16, "d31a8d34648e60db7b86afbc53ef7ec2") &&
+             hex_is(ct + len, 16, "1ae10b594f09e26a7e902ecbd0600691");
+        ok = ok && chacha20poly1305_decrypt_ietf(back, ct, len + 16, ad, sizeof(ad), nonce, key) == NB_SUCCESS &&
+             memcmp(back, pt, len) == 0;
+        ct[5] ^= 1;
+        ok = ok && chacha20poly1305_decrypt_ietf(back, ct, len + 16, ad, sizeof(ad), nonce, key) == NB_ERROR_INVALID;
+
+        /* Long messages take the four-block path; round trip in place */
+        static uint8_t big[4096 + 16];
+        for (size_t i = 0; i < 4096; i++) big[i] = (uint8_t)i;
+        chacha20poly1305_encrypt(big, big, 4096, NULL, 0, 42, key);
+        ok = ok && chacha20poly1305_decrypt(big, big, 4096 + 16, NULL, 0, 42, key) == NB_SUCCESS;
+        for (size_t i = 0; ok && i < 4096; i++) ok = big[i] == (uint8_t)i;
+
+        uint8_t xn[24] = { 1, 2, 3 };
+        xchacha20poly1305_encrypt(ct, (const uint8_t *)pt, len, NULL, 0, xn, key);
+        ok = ok && xchacha20poly1305_decrypt(back, ct, len + 16, NULL, 0, xn, key) == NB_SUCCESS &&
+             memcmp(back, pt, len) == 0;
+        xn[0] ^= 1;
+        ok = ok && xchacha20poly1305_decrypt(back, ct, len + 16, NULL, 0, xn, key) == NB_ERROR_INVALID;
+    }
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 3: Full handshake */
+    printf("[Test 3] Handshake and transport keys...\n");
+    {
+        pair_t p;
+        uint8_t init[WG_MSG_INITIATION_LEN], resp[WG_MSG_RESPONSE_LEN];
+        wg_noise_keypair_t ka, kb;
+
+        ok = pair_init(&p, NULL, NULL) && initiate(&p, init, 1000);
+        ok = ok && init[0] == WG_MSG_INITIATION &&
+             wg_noise_create_response(&p.b_hs, 0x2222, resp) == NB_SUCCESS &&
+             wg_noise_derive_keypair(&p.b_hs, &kb, 1000) == NB_SUCCESS;
+        ok = ok && wg_noise_consume_response(&p.a_hs, &p.a, resp) == NB_SUCCESS &&
+             wg_noise_derive_keypair(&p.a_hs, &ka, 1000) == NB_SUCCESS;
+        ok = ok && memcmp(ka.send_key, kb.recv_key, 32) == 0 && memcmp(ka.recv_key, kb.send_key, 32) == 0 &&
+             memcmp(ka.send_key, ka.recv_key, 32) != 0;
+        ok = ok && ka.local_index == 0x1111 && ka.remote_index == 0x2222 &&
+             kb.local_index == 0x2222 && kb.remote_index == 0x1111 && ka.initiator && !kb.initiator;
+
+        /* Data both ways */
+        uint8_t msg[256], plain[256];
+        size_t plain_len;
+        const char *hello = "hello, world";
+        wg_noise_data_seal(msg, (const uint8_t *)hello, strlen(hello), ka.remote_index, 0, ka.send_key);
+        ok = ok && wg_noise_data_index(msg) == 0x2222 && wg_noise_data_counter(msg) == 0 &&
+             wg_noise_data_open(plain, msg, wg_noise_data_len(strlen(hello)), kb.recv_key, &plain_len) == NB_SUCCESS &&
+             plain_len == 16 && memcmp(plain, hello, strlen(hello)) == 0;
+        wg_noise_data_seal(msg, NULL, 0, kb.remote_index, 7, kb.send_key);
+        ok = ok && wg_noise_data_counter(msg) == 7 &&
+             wg_noise_data_open(plain, msg, WG_DATA_MIN_LEN, ka.recv_key, &plain_len) == NB_SUCCESS &&
+             plain_len == 0;
+        msg[20] ^= 1;
+        ok = ok && wg_noise_data_open(plain, msg, WG_DATA_MIN_LEN, ka.recv_key, &plain_len) == NB_ERROR_INVALID;
+
+        /* A second response cannot be consumed */
+        ok = ok && wg_noise_consume_response(&p.a_hs, &p.a, resp) == NB_ERROR_INVALID;
+    }
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 4: Replayed and flooded initiations */
+    printf("[Test 4] Initiation replay and flood protection...\n");
+    {
+        pair_t p;
+        uint8_t init[WG_MSG_INITIATION_LEN], init2[WG_MSG_INITIATION_LEN];
+        wg_noise_initiation_t in;
+
+        ok = pair_init(&p, NULL, NULL) && initiate(&p, init, 1000);
+        /* The same message again: timestamp not newer */
+        ok = ok && wg_noise_consume_initiation(&p.b, init, &in) == NB_SUCCESS &&
+             wg_noise_accept_initiation(&p.b_hs, &in, init, 5000) == NB_ERROR_INVALID;
+
+        /* A fresh one right away is rate limited, later accepted (TAI64N has 2^24 ns granularity) */
+        struct timespec ts = { 0, 50 * 1000 * 1000 };
+        nanosleep(&ts, NULL);
+        ok = ok && wg_noise_create_initiation(&p.a_hs, &p.a, 0x3333, init2) == NB_SUCCESS &&
+             wg_noise_consume_initiation(&p.b, init2, &in) == NB_SUCCESS &&
+             wg_noise_accept_initiation(&p.b_hs, &in, init2, 1005) == NB_ERROR_INVALID &&
+             wg_noise_accept_initiation(&p.b_hs, &in, init2, 1100) == NB_SUCCESS;
+
+        /* Tampered message or wrong responder */
+        init2[50] ^= 1;
+        ok = ok && wg_noise_consume_initiation(&p.b, init2, &in) == NB_ERROR_INVALID;
+        init2[50] ^= 1;
+        ok = ok && wg_noise_consume_initiation(&p.a, init2, &in) == NB_ERROR_INVALID;
+
+        /* Low-order remote keys can never complete a handshake */
+        uint8_t zero[WG_KEY_LEN] = { 0 };
+        wg_noise_handshake_t hs;
+        ok = ok && wg_noise_handshake_init(&hs, &p.a, zero, NULL) == NB_ERROR_INVALID &&
+             wg_noise_create_initiation(&hs, &p.a, 0x4444, init2) == NB_ERROR_INVALID;
+    }
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 5: Preshared key */
+    printf("[Test 5] Preshared key mismatch...\n");
+    {
+        pair_t p;
+        uint8_t psk1[32], psk2[32];
+        uint8_t init[WG_MSG_INITIATION_LEN], resp[WG_MSG_RESPONSE_LEN];
+        memset(psk1, 0x11, sizeof(psk1));
+        memset(psk2, 0x22, sizeof(psk2));
+
+        /* The PSK is only mixed in at the response */
+        ok = pair_init(&p, psk1, psk2) && initiate(&p, init, 1000) &&
+             wg_noise_create_response(&p.b_hs, 0x2222, resp) == NB_SUCCESS &&
+             wg_noise_consume_response(&p.a_hs, &p.a, resp) == NB_ERROR_INVALID;
+
+        wg_noise_keypair_t ka, kb;
+        ok = ok && pair_init(&p, psk1, psk1) && initiate(&p, init, 1000) &&
+             wg_noise_create_response(&p.b_hs, 0x2222, resp) == NB_SUCCESS &&
+             wg_noise_consume_response(&p.a_hs, &p.a, resp) == NB_SUCCESS &&
+             wg_noise_derive_keypair(&p.a_hs, &ka, 0) == NB_SUCCESS &&
+             wg_noise_derive_keypair(&p.b_hs, &kb, 0) == NB_SUCCESS &&
+             memcmp(ka.send_key, kb.recv_key, 32) == 0;
+    }
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 6: Replay window */
+    printf("[Test 6] Replay window...\n");
+    {
+        wg_replay_t r;
+        memset(&r, 0, sizeof(r));
+        ok = wg_replay_check(&r, 0) && !wg_replay_check(&r, 0);
+        ok = ok && wg_replay_check(&r, 5) && wg_replay_check(&r, 3) && !wg_replay_check(&r, 3) &&
+             wg_replay_check(&r, 4) && !wg_replay_check(&r, 5);
+        ok = ok && wg_replay_check(&r, 5000) && !wg_replay_check(&r, 5000 - WG_REPLAY_WINDOW - 1) &&
+             wg_replay_check(&r, 5000 - WG_REPLAY_WINDOW + 1) && wg_replay_check(&r, 4999);
+        ok = ok && !wg_replay_check(&r, WG_REJECT_AFTER_MESSAGES);
+
+        /* Every counter accepted exactly once when delivered out of order */
+        memset(&r, 0, sizeof(r));
+        int accepted = 0;
+        for (uint64_t base = 0; base < 10000; base += 100) {
+            for (uint64_t i = 0; i < 100; i++) {
+                uint64_t c = base + (i * 37) % 100;
+                accepted += wg_replay_check(&r, c);
+                accepted += wg_replay_check(&r, c);
+            }
+        }
+        ok = ok && accepted == 10000;
+    }
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 7: Cookies */
+    printf("[Test 7] mac1, cookie reply and mac2...\n");
+    {
+        pair_t p;
+        wg_cookie_t cookie;
+        wg_cookie_checker_t checker;
+        uint8_t init[WG_MSG_INITIATION_LEN], reply[WG_MSG_COOKIE_LEN];
+        nb_endpoint_t src, other;
+        memset(&cookie, 0, sizeof(cookie));
+        memset(&checker, 0, sizeof(checker));
+        memset(&src, 0, sizeof(src));
+        src.in4.sin_family = AF_INET;
+        src.in4.sin_port = htons(51820);
+        src.in4.sin_addr.s_addr = htonl(0xC0000201);
+        other = src;
+        other.in4.sin_port = htons(51821);
+
+        ok = pair_init(&p, NULL, NULL) &&
+             wg_noise_create_initiation(&p.a_hs, &p.a, 0x1111, init) == NB_SUCCESS;
+        wg_cookie_add_macs(&cookie, p.a_hs.remote_mac1_key, init, sizeof(init), 1000);
+        ok = ok && wg_cookie_check_mac1(&p.b, init, sizeof(init)) &&
+             !wg_cookie_check_mac1(&p.a, init, sizeof(init)) &&
+             !wg_cookie_check_mac2(&checker, init, sizeof(init), &src, 1000);
+
+        /* b is under load: a gets a cookie and retries with mac2 */
+        ok = ok && wg_cookie_create_reply(&checker, &p.b, init, sizeof(init), 0x1111, &src, 1000, reply) == NB_SUCCESS &&
+             reply[0] == WG_MSG_COOKIE &&
+             wg_cookie_consume_reply(&cookie, p.a_hs.remote_cookie_key, reply, 1000) == NB_SUCCESS;
+        wg_cookie_add_macs(&cookie, p.a_hs.remote_mac1_key, init, sizeof(init), 2000);
+        ok = ok && wg_cookie_check_mac1(&p.b, init, sizeof(init)) &&
+             wg_cookie_check_mac2(&checker, init, sizeof(init), &src, 2000) &&
+             !wg_cookie_check_mac2(&checker, init, sizeof(init), &other, 2000);
+
+        /* The reply only matches the message it answered */
+        ok = ok && wg_noise_create_initiation(&p.a_hs, &p.a, 0x1112, init) == NB_SUCCESS;
+        wg_cookie_add_macs(&cookie, p.a_hs.remote_mac1_key, init, sizeof(init), 2000);
+        ok = ok && wg_cookie_consume_reply(&cookie, p.a_hs.remote_cookie_key, reply, 2000) == NB_ERROR_INVALID;
+
+        /* An expired cookie is no longer sent */
+        wg_cookie_add_macs(&cookie, p.a_hs.remote_mac1_key, init, sizeof(init), 1000 + WG_COOKIE_LIFETIME_MS);
+        uint8_t zero[16] = { 0 };
+        ok = ok && memcmp(init + sizeof(init) - 16, zero, 16) == 0;
+    }
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Test 8: Data message framing */
+    printf("[Test 8] Data padding...\n");
+    ok = wg_noise_data_len(0) == 32 && wg_noise_data_len(1) == 48 && wg_noise_data_len(16) == 48 &&
+         wg_noise_data_len(1420) == 16 + 1424 + 16;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
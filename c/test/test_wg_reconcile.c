@@ -0,0 +1,146 @@
+/**
+ * test_wg_reconcile.c - Test program for peer reconciliation planning
+ *
+ * Builds a synthetic device state and checks that wg_reconcile_plan()
+ * produces the minimal add/update/remove plan. Does not touch the kernel.
+ *
+ * Usage: ./test_wg_reconcile
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#include "common.h"
+#include "wg_reconcile.h"
+
+#define LIVE_PEERS 1000
+
+static void make_key(uint8_t key[WG_KEY_LEN], int i) {
+    memset(key, 0, WG_KEY_LEN);
+    key[0] = (uint8_t)i;
+    key[1] = (uint8_t)(i >> 8);
+    key[31] = 0x5a;
+}
+
+static void make_prefix(nb_prefix_t *p, int i, int j) {
+    char cidr[32];
+    snprintf(cidr, sizeof(cidr), "10.%d.%d.%d/32", j, (i >> 8) & 0xff, i & 0xff);
+    nb_prefix_parse(cidr, p);
+}
+
+int main(void) {
+    int failed = 0;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Peer Reconcile Test\n");
+    printf("================================================================================\n\n");
+
+    /* Live device: LIVE_PEERS peers with two allowed IPs each */
+    wg_device_t dev = {0};
+    dev.peers = calloc(LIVE_PEERS, sizeof(wg_device_peer_t));
+    dev.peer_count = LIVE_PEERS;
+    nb_prefix_t *live_ips = calloc(LIVE_PEERS * 2, sizeof(nb_prefix_t));
+    nb_prefix_t *want_ips = calloc(LIVE_PEERS * 2, sizeof(nb_prefix_t));
+    wg_peer_spec_t *want = calloc(LIVE_PEERS + 1, sizeof(wg_peer_spec_t));
+    if (!dev.peers || !live_ips || !want_ips || !want) {
+        printf("  FAILED: Out of memory\n");
+        return 1;
+    }
+
+    for (int i = 0; i < LIVE_PEERS; i++) {
+        wg_device_peer_t *p = &dev.peers[i];
+        make_key(p->public_key, i);
+        nb_endpoint_parse("203.0.113.10:51820", &p->endpoint);
+        p->keepalive = 25;
+        make_prefix(&live_ips[i * 2], i, 1);
+        make_prefix(&live_ips[i * 2 + 1], i, 2);
+        p->allowed_ips = &live_ips[i * 2];
+        p->allowed_ips_count = 2;
+
+        /* Desired: same peers, allowed IPs listed in the other order */
+        make_key(want[i].public_key, i);
+        want[i].endpoint = p->endpoint;
+        want[i].keepalive = 25;
+        want_ips[i * 2] = live_ips[i * 2 + 1];
+        want_ips[i * 2 + 1] = live_ips[i * 2];
+        want[i].allowed_ips = &want_ips[i * 2];
+        want[i].allowed_ips_count = 2;
+    }
+
+    wg_peer_spec_t *plan = NULL;
+    int plan_count = -1;
+    wg_reconcile_stats_t st;
+
+    /* Test 1: Nothing changed */
+    printf("[Test 1] Identical peer set produces an empty plan...\n");
+    if (wg_reconcile_plan(&dev, want, LIVE_PEERS, &plan, &plan_count, &st) != NB_SUCCESS ||
+        plan_count != 0 || st.unchanged != LIVE_PEERS) {
+        printf("  FAILED: plan_count=%d unchanged=%d\n", plan_count, st.unchanged);
+        failed++;
+    } else {
+        printf("  SUCCESS: %d unchanged, 0 writes\n", st.unchanged);
+    }
+    free(plan);
+    printf("\n");
+
+    /* Test 2: One of each change */
+    printf("[Test 2] Add, update and remove are detected...\n");
+    nb_endpoint_parse("198.51.100.7:51820", &want[1].endpoint);  /* update */
+    want[2].keepalive = 0;                                       /* update */
+    want[3].keepalive = -1;                                      /* don't care */
+    want[4].allowed_ips = NULL;                                  /* don't care */
+    want[5] = want[LIVE_PEERS - 1];                              /* remove peer 5 */
+    make_key(want[LIVE_PEERS - 1].public_key, LIVE_PEERS + 7);   /* add */
+    want[LIVE_PEERS - 1].allowed_ips_count = 1;
+
+    if (wg_reconcile_plan(&dev, want, LIVE_PEERS, &plan, &plan_count, &st) != NB_SUCCESS) {
+        printf("  FAILED: wg_reconcile_plan\n");
+        failed++;
+    } else if (plan_count != 4 || st.added != 1 || st.updated != 2 || st.removed != 1 ||
+               st.unchanged != LIVE_PEERS - 3) {
+        printf("  FAILED: plan=%d added=%d updated=%d removed=%d unchanged=%d\n",
+               plan_count, st.added, st.updated, st.removed, st.unchanged);
+        failed++;
+    } else {
+        int removals = 0;
+        for (int i = 0; i < plan_count; i++) {
+            removals += plan[i].remove;
+        }
+        if (removals != 1) {
+            printf("  FAILED: expected 1 removal entry, got %d\n", removals);
+            failed++;
+        } else {
+            printf("  SUCCESS: 1 added, 2 updated, 1 removed\n");
+        }
+    }
+    free(plan);
+    printf("\n");
+
+    /* Test 3: Empty desired set removes everything */
+    printf("[Test 3] Empty desired set removes all peers...\n");
+    if (wg_reconcile_plan(&dev, NULL, 0, &plan, &plan_count, &st) != NB_SUCCESS ||
+        plan_count != LIVE_PEERS || st.removed != LIVE_PEERS) {
+        printf("  FAILED: plan_count=%d\n", plan_count);
+        failed++;
+    } else {
+        printf("  SUCCESS: %d removals\n", st.removed);
+    }
+    free(plan);
+    printf("\n");
+
+    free(dev.peers);
+    free(live_ips);
+    free(want_ips);
+    free(want);
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,302 @@
+/**
+ * test_wg_user.c - Test program for the userspace WireGuard datapath
+ *
+ * Runs in a private network namespace. The test plays the remote peer
+ * itself with the wg_noise primitives over a loopback UDP socket, so no
+ * second device or kernel module is needed:
+ *   local socket -> wgu0 (TUN) -> device encrypts -> test decrypts
+ *   test encrypts -> device decrypts -> wgu0 (TUN) -> local socket
+ *
+ * Usage: sudo ./test_wg_user
+ *
+ * Author: Claude
+ * Date: 2026-10-16
+ */
+
+#define _GNU_SOURCE
+#include "common.h"
+#include "wg_user.h"
+#include "wg_noise.h"
+#include "wg_netlink.h"
+#include <sched.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#define IFNAME      "wgu0"
+#define LOCAL_ADDR  "10.100.0.1"
+#define PEER_ADDR   "10.100.0.2"
+
+static int link_up(const char *ifname) {
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return 0;
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    int ok = ioctl(fd, SIOCGIFFLAGS, &ifr) == 0;
+    ifr.ifr_flags |= IFF_UP;
+    ok = ok && ioctl(fd, SIOCSIFFLAGS, &ifr) == 0;
+    close(fd);
+    return ok;
+}
+
+static int udp_socket(const char *addr, int port, int *port_out) {
+    struct sockaddr_in sin = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    socklen_t sl = sizeof(sin);
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    inet_pton(AF_INET, addr, &sin.sin_addr);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    getsockname(fd, (struct sockaddr *)&sin, &sl);
+    *port_out = ntohs(sin.sin_port);
+    return fd;
+}
+
+static ssize_t recv_timeout(int fd, uint8_t *buf, size_t len, int ms) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    if (poll(&pfd, 1, ms) <= 0) return -1;
+    return recv(fd, buf, len, 0);
+}
+
+static int send_to(int fd, const char *addr, int port, const void *buf, size_t len) {
+    struct sockaddr_in sin = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    inet_pton(AF_INET, addr, &sin.sin_addr);
+    return sendto(fd, buf, len, 0, (struct sockaddr *)&sin, sizeof(sin)) == (ssize_t)len;
+}
+
+/* IPv4/UDP packet (UDP checksum 0) */
+static size_t build_udp(uint8_t *pkt, const char *src, const char *dst, int sport, int dport,
+                        const char *payload) {
+    size_t plen = strlen(payload);
+    size_t total = 28 + plen;
+    uint32_t sum = 0;
+
+    memset(pkt, 0, 28);
+    pkt[0] = 0x45;
+    pkt[2] = (uint8_t)(total >> 8);
+    pkt[3] = (uint8_t)total;
+    pkt[8] = 64;
+    pkt[9] = IPPROTO_UDP;
+    inet_pton(AF_INET, src, pkt + 12);
+    inet_pton(AF_INET, dst, pkt + 16);
+    for (int i = 0; i < 20; i += 2) sum += (uint32_t)pkt[i] << 8 | pkt[i + 1];
+    while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+    pkt[10] = (uint8_t)(~sum >> 8);
+    pkt[11] = (uint8_t)~sum;
+
+    pkt[20] = (uint8_t)(sport >> 8);
+    pkt[21] = (uint8_t)sport;
+    pkt[22] = (uint8_t)(dport >> 8);
+    pkt[23] = (uint8_t)dport;
+    pkt[24] = (uint8_t)((8 + plen) >> 8);
+    pkt[25] = (uint8_t)(8 + plen);
+    memcpy(pkt + 28, payload, plen);
+    return total;
+}
+
+int main(void) {
+    int failed = 0;
+    int ok;
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("  NetBird Minimal C Client - Userspace WireGuard Test\n");
+    printf("================================================================================\n\n");
+
+    if (geteuid() != 0) {
+        printf("ERROR: This test must be run as root (use sudo)\n");
+        return 1;
+    }
+    if (unshare(CLONE_NEWNET) != 0 || !link_up("lo")) {
+        printf("  SKIPPED: cannot create a network namespace (%s)\n\n", strerror(errno));
+        return 0;
+    }
+
+    /* Identities: the device, and the peer played by this test */
+    uint8_t dev_priv[WG_KEY_LEN], peer_priv[WG_KEY_LEN];
+    wg_noise_static_t peer;
+    wg_noise_handshake_t hs;
+    wg_cookie_t cookie;
+    wg_noise_keypair_t kp;
+    wg_key_generate_private(dev_priv);
+    wg_key_generate_private(peer_priv);
+    wg_noise_static_init(&peer, peer_priv);
+    memset(&cookie, 0, sizeof(cookie));
+    memset(&kp, 0, sizeof(kp));
+
+    /* Test 1: Open */
+    printf("[Test 1] Creating %s...\n", IFNAME);
+    wg_user_t *dev = NULL;
+    wg_user_t *dup = NULL;
+    wg_device_t *info = NULL;
+    int ret = wg_user_open(IFNAME, dev_priv, 0, 2, &dev);
+    ok = ret == NB_SUCCESS && wg_user_listen_port(dev) > 0 &&
+         wg_user_open(IFNAME, dev_priv, 0, 1, &dup) == NB_ERROR_EXISTS;
+    ok = ok && wg_user_get_device(dev, &info) == NB_SUCCESS && strcmp(info->name, IFNAME) == 0 &&
+         info->ifindex > 0 && info->peer_count == 0 && info->listen_port == wg_user_listen_port(dev);
+    wg_device_free(info);
+    if (!ok) {
+        printf("  FAILED (error %d)\n\n", ret);
+        wg_user_close(dev);
+        return 1;
+    }
+    int dev_port = wg_user_listen_port(dev);
+    printf("  SUCCESS: listening on port %d\n\n", dev_port);
+
+    /* Test 2: Peers */
+    printf("[Test 2] Applying peers...\n");
+    int peer_port;
+    int peer_fd = udp_socket("127.0.0.1", 0, &peer_port);
+    nb_prefix_t allowed;
+    nb_prefix_parse(PEER_ADDR "/32", &allowed);
+    wg_peer_spec_t specs[3];
+    int errors[3];
+    memset(specs, 0, sizeof(specs));
+    specs[0].keepalive = -1;                                /* All-zero key: accepted, never handshakes */
+    wg_key_derive_public(specs[1].public_key, dev_priv);    /* Our own key: ignored */
+    specs[1].keepalive = -1;
+    memcpy(specs[2].public_key, peer.public_key, WG_KEY_LEN);
+    specs[2].allowed_ips = &allowed;
+    specs[2].allowed_ips_count = 1;
+    specs[2].keepalive = 0;
+    specs[2].endpoint.in4.sin_family = AF_INET;
+    specs[2].endpoint.in4.sin_port = htons((uint16_t)peer_port);
+    specs[2].endpoint.in4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ok = peer_fd >= 0 && wg_user_apply_peers(dev, specs, 3, errors) == 0 &&
+         errors[0] == NB_SUCCESS && errors[1] == NB_SUCCESS && errors[2] == NB_SUCCESS;
+    ok = ok && wg_user_get_device(dev, &info) == NB_SUCCESS && info->peer_count == 2 &&
+         wg_key_equal(info->peers[1].public_key, peer.public_key) &&
+         info->peers[1].allowed_ips_count == 1 && info->peers[1].endpoint.sa.sa_family == AF_INET;
+    wg_device_free(info);
+    ok = ok && wg_noise_handshake_init(&hs, &peer, specs[1].public_key, NULL) == NB_SUCCESS;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    /* Address and link through rtnetlink, as wg_iface does */
+    wg_nl_t *nl = NULL;
+    nb_prefix_t addr;
+    nb_prefix_parse(LOCAL_ADDR "/24", &addr);
+    if (wg_nl_open_route(&nl) != NB_SUCCESS || wg_nl_addr_add(nl, IFNAME, &addr) != NB_SUCCESS ||
+        wg_nl_link_set_up(nl, IFNAME, 1) != NB_SUCCESS) {
+        printf("  FAILED: cannot configure %s\n\n", IFNAME);
+        wg_nl_close(nl);
+        wg_user_close(dev);
+        return 1;
+    }
+
+    /* Test 3: Outgoing packet triggers a handshake and is delivered after it */
+    printf("[Test 3] Handshake initiated by outgoing traffic...\n");
+    uint8_t buf[2048], plain[2048];
+    int local_port;
+    int local_fd = udp_socket(LOCAL_ADDR, 0, &local_port);
+    ok = local_fd >= 0 && send_to(local_fd, PEER_ADDR, 7, "ping", 4);
+
+    ssize_t n = recv_timeout(peer_fd, buf, sizeof(buf), 2000);
+    wg_noise_initiation_t in;
+    uint8_t resp[WG_MSG_RESPONSE_LEN];
+    ok = ok && n == WG_MSG_INITIATION_LEN && wg_cookie_check_mac1(&peer, buf, (size_t)n) &&
+         wg_noise_consume_initiation(&peer, buf, &in) == NB_SUCCESS &&
+         wg_noise_accept_initiation(&hs, &in, buf, 1000) == NB_SUCCESS &&
+         wg_noise_create_response(&hs, 0xabcd, resp) == NB_SUCCESS &&
+         wg_noise_derive_keypair(&hs, &kp, 1000) == NB_SUCCESS;
+    if (ok) {
+        wg_cookie_add_macs(&cookie, hs.remote_mac1_key, resp, sizeof(resp), 1000);
+        ok = send_to(peer_fd, "127.0.0.1", dev_port, resp, sizeof(resp));
+    }
+
+    /* The staged packet follows the response */
+    size_t plain_len = 0;
+    n = recv_timeout(peer_fd, buf, sizeof(buf), 2000);
+    ok = ok && n > WG_DATA_MIN_LEN && buf[0] == WG_MSG_DATA && wg_noise_data_index(buf) == 0xabcd &&
+         wg_noise_data_open(plain, buf, (size_t)n, kp.recv_key, &plain_len) == NB_SUCCESS &&
+         plain_len >= 32 && (plain[0] >> 4) == 4 && plain[9] == IPPROTO_UDP &&
+         memcmp(plain + 28, "ping", 4) == 0;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS: got %zd byte data message\n", n);
+    }
+    printf("\n");
+
+    /* Test 4: Incoming data */
+    printf("[Test 4] Incoming data, replay and spoofed source...\n");
+    uint8_t pkt[256], msg[512];
+    size_t len = build_udp(pkt, PEER_ADDR, LOCAL_ADDR, 7, local_port, "pong");
+    wg_noise_data_seal(msg, pkt, len, kp.remote_index, 0, kp.send_key);
+    ok = send_to(peer_fd, "127.0.0.1", dev_port, msg, wg_noise_data_len(len));
+    n = recv_timeout(local_fd, buf, sizeof(buf), 2000);
+    ok = ok && n == 4 && memcmp(buf, "pong", 4) == 0;
+
+    /* The same counter again, then a source outside the allowed IPs */
+    ok = ok && send_to(peer_fd, "127.0.0.1", dev_port, msg, wg_noise_data_len(len));
+    len = build_udp(pkt, "10.100.0.3", LOCAL_ADDR, 7, local_port, "spoof");
+    wg_noise_data_seal(msg, pkt, len, kp.remote_index, 1, kp.send_key);
+    ok = ok && send_to(peer_fd, "127.0.0.1", dev_port, msg, wg_noise_data_len(len));
+    ok = ok && recv_timeout(local_fd, buf, sizeof(buf), 300) < 0;
+
+    wg_user_stats_t st;
+    wg_user_get_stats(dev, &st);
+    ok = ok && st.handshakes == 1 && st.rx_packets >= 2 && st.dropped >= 2 && st.tx_packets >= 1;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS: tx %llu rx %llu dropped %llu\n", (unsigned long long)st.tx_packets,
+               (unsigned long long)st.rx_packets, (unsigned long long)st.dropped);
+    }
+    printf("\n");
+
+    /* Test 5: Removal */
+    printf("[Test 5] Removing the peer...\n");
+    ok = wg_user_get_device(dev, &info) == NB_SUCCESS && info->peer_count == 2 &&
+         info->peers[1].last_handshake > 0 && info->peers[1].rx_bytes > 0 && info->peers[1].tx_bytes > 0 &&
+         info->peers[0].last_handshake == 0;
+    wg_device_free(info);
+    specs[2].remove = 1;
+    ok = ok && wg_user_apply_peers(dev, &specs[2], 1, NULL) == 0 &&
+         wg_user_apply_peers(dev, &specs[2], 1, NULL) == 0;
+    ok = ok && wg_user_get_device(dev, &info) == NB_SUCCESS && info->peer_count == 1;
+    wg_device_free(info);
+
+    /* Traffic for the removed peer is dropped */
+    wg_noise_data_seal(msg, pkt, len, kp.remote_index, 2, kp.send_key);
+    ok = ok && send_to(peer_fd, "127.0.0.1", dev_port, msg, wg_noise_data_len(len)) &&
+         recv_timeout(local_fd, buf, sizeof(buf), 300) < 0;
+    if (!ok) {
+        printf("  FAILED\n");
+        failed++;
+    } else {
+        printf("  SUCCESS\n");
+    }
+    printf("\n");
+
+    close(local_fd);
+    close(peer_fd);
+    wg_nl_close(nl);
+    wg_user_close(dev);
+    ok = if_nametoindex(IFNAME) == 0;
+    if (!ok) {
+        printf("  FAILED: %s still exists after close\n", IFNAME);
+        failed++;
+    }
+
+    printf("================================================================================\n");
+    if (failed) {
+        printf("  %d test(s) FAILED\n", failed);
+    } else {
+        printf("  All tests PASSED!\n");
+    }
+    printf("================================================================================\n\n");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,338 @@
+package main
+
+import (
+	"bytes"
+	"encoding/base64"
+	"encoding/binary"
+	"fmt"
+	"log"
+	"net"
+	"slices"
+	"sync/atomic"
+	"syscall"
+	"unsafe"
+)
+
+// Delta channel to the C client
+//
+// The client creates a shared-memory ring (a memfd) and an eventfd and
+// passes both over its DeltaSocket (c/include/delta_ring.h). Peer and
+// route changes are then published as typed records, in order and with
+// sequence numbers, instead of rewriting peers.json/peers.snap: the client
+// applies them as soon as the eventfd fires.
+//
+// The helper is the only producer. When the ring is full the update goes
+// to the files as before, followed by a resync record once there is room,
+// so the client applies the file in order with the records around it.
+
+const (
+	deltaMagic      = "NBDRING1"
+	deltaVersion    = 1
+	deltaHeaderSize = 256
+	deltaRecordSize = 16
+	deltaAlign      = 16
+
+	// Record types
+	deltaPad         = 0
+	deltaPeerSet     = 1 // snapPeer + snapPrefix[PrefixCount]
+	deltaPeerRemove  = 2 // 32-byte public key
+	deltaRouteAdd    = 3 // deltaRoute
+	deltaRouteRemove = 4 // deltaRoute
+	deltaRouteSync   = 5 // count uint32, reserved uint32, deltaRoute[count]
+	deltaResync      = 6 // Reload peers.json/peers.snap
+	deltaJournalSeq  = 7 // uint64: the records so far hold peers.journal up to this record
+
+	// Header offsets
+	deltaOffCapacity = 16
+	deltaOffHead     = 64
+	deltaOffSeq      = 72
+	deltaOffResyncs  = 80
+	deltaOffTail     = 128
+	deltaOffWaiting  = 192
+)
+
+type deltaRoute struct {
+	Network  snapPrefix
+	Reserved uint16
+	Metric   uint32
+}
+
+// DeltaRing is the producer side of a ring received from the client
+type DeltaRing struct {
+	conn     *net.UnixConn
+	mem      []byte
+	data     []byte
+	efd      int
+	capacity uint64
+	wpos     uint64 // End of the reserved records
+	wseq     uint64 // Sequence number of the last reserved record
+}
+
+// dialDeltaRing connects to the client's DeltaSocket and maps the ring it sends
+func dialDeltaRing(path string) (*DeltaRing, error) {
+	conn, err := net.DialUnix("unixpacket", nil, &net.UnixAddr{Name: path, Net: "unixpacket"})
+	if err != nil {
+		return nil, err
+	}
+
+	hello := make([]byte, 16)
+	oob := make([]byte, syscall.CmsgSpace(2*4))
+	n, oobn, _, _, err := conn.ReadMsgUnix(hello, oob)
+	if err != nil {
+		conn.Close()
+		return nil, fmt.Errorf("receive ring: %w", err)
+	}
+	var fds []int
+	if msgs, err := syscall.ParseSocketControlMessage(oob[:oobn]); err == nil && len(msgs) == 1 {
+		fds, _ = syscall.ParseUnixRights(&msgs[0])
+	}
+	if n != len(hello) || string(hello[:8]) != deltaMagic || len(fds) != 2 {
+		for _, fd := range fds {
+			syscall.Close(fd)
+		}
+		conn.Close()
+		return nil, fmt.Errorf("not a delta ring")
+	}
+
+	size := binary.LittleEndian.Uint64(hello[8:])
+	mem, err := syscall.Mmap(fds[0], 0, int(size), syscall.PROT_READ|syscall.PROT_WRITE, syscall.MAP_SHARED)
+	syscall.Close(fds[0])
+	if err != nil {
+		syscall.Close(fds[1])
+		conn.Close()
+		return nil, fmt.Errorf("map ring: %w", err)
+	}
+
+	r := &DeltaRing{conn: conn, mem: mem, efd: fds[1]}
+	r.capacity = binary.LittleEndian.Uint64(mem[deltaOffCapacity:])
+	if string(mem[:8]) != deltaMagic || binary.LittleEndian.Uint32(mem[8:]) != deltaVersion ||
+		binary.LittleEndian.Uint32(mem[12:]) != deltaHeaderSize || r.capacity == 0 ||
+		r.capacity&(r.capacity-1) != 0 || r.capacity != size-deltaHeaderSize {
+		r.Close()
+		return nil, fmt.Errorf("unsupported delta ring")
+	}
+	r.data = mem[deltaHeaderSize:]
+	r.wpos = atomic.LoadUint64(r.u64(deltaOffHead))
+	r.wseq = atomic.LoadUint64(r.u64(deltaOffSeq))
+	return r, nil
+}
+
+func (r *DeltaRing) u64(off int) *uint64 {
+	return (*uint64)(unsafe.Pointer(&r.mem[off]))
+}
+
+// Close unmaps the ring and detaches from the client
+func (r *DeltaRing) Close() {
+	syscall.Munmap(r.mem)
+	syscall.Close(r.efd)
+	r.conn.Close()
+}
+
+// Wait blocks until the client closes the connection
+func (r *DeltaRing) Wait() {
+	buf := make([]byte, 16)
+	for {
+		if _, err := r.conn.Read(buf); err != nil {
+			return
+		}
+	}
+}
+
+// reserve returns the zeroed payload of a new record, nil if the ring is full.
+// Nothing is visible to the client before publish.
+func (r *DeltaRing) reserve(typ uint16, n int) []byte {
+	size := (deltaRecordSize + uint64(n) + deltaAlign - 1) &^ (deltaAlign - 1)
+	off := r.wpos & (r.capacity - 1)
+	var pad uint64
+	if off+size > r.capacity {
+		pad = r.capacity - off
+	}
+	tail := atomic.LoadUint64(r.u64(deltaOffTail))
+	if pad+size > r.capacity-(r.wpos-tail) {
+		return nil
+	}
+
+	if pad > 0 {
+		putRecordHeader(r.data[off:], uint32(pad), deltaPad, 0)
+		r.wpos += pad
+		off = 0
+	}
+	r.wseq++
+	rec := r.data[off : off+size]
+	putRecordHeader(rec, uint32(size), typ, r.wseq)
+	clear(rec[deltaRecordSize:])
+	r.wpos += size
+	return rec[deltaRecordSize : deltaRecordSize+n]
+}
+
+func putRecordHeader(b []byte, size uint32, typ uint16, seq uint64) {
+	binary.LittleEndian.PutUint32(b[0:], size)
+	binary.LittleEndian.PutUint16(b[4:], typ)
+	binary.LittleEndian.PutUint16(b[6:], 0)
+	binary.LittleEndian.PutUint64(b[8:], seq)
+}
+
+// put reserves a record and copies payload into it
+func (r *DeltaRing) put(typ uint16, payload []byte) bool {
+	b := r.reserve(typ, len(payload))
+	if b == nil {
+		return false
+	}
+	copy(b, payload)
+	return true
+}
+
+// rollback drops the records reserved since mark (they were never published)
+func (r *DeltaRing) mark() (uint64, uint64) {
+	return r.wpos, r.wseq
+}
+
+func (r *DeltaRing) rollback(pos, seq uint64) {
+	r.wpos, r.wseq = pos, seq
+}
+
+// publish makes the reserved records visible and wakes the client if it sleeps
+func (r *DeltaRing) publish() error {
+	atomic.StoreUint64(r.u64(deltaOffSeq), r.wseq)
+	atomic.StoreUint64(r.u64(deltaOffHead), r.wpos)
+	if atomic.SwapUint32((*uint32)(unsafe.Pointer(&r.mem[deltaOffWaiting])), 0) != 0 {
+		var one [8]byte
+		binary.LittleEndian.PutUint64(one[:], 1)
+		if _, err := syscall.Write(r.efd, one[:]); err != nil {
+			return fmt.Errorf("wake client: %w", err)
+		}
+	}
+	return nil
+}
+
+// countResync records a fallback to the files in the shared header
+func (r *DeltaRing) countResync() {
+	atomic.AddUint64(r.u64(deltaOffResyncs), 1)
+}
+
+func encodeBinary(v interface{}) []byte {
+	var buf bytes.Buffer
+	binary.Write(&buf, binary.LittleEndian, v)
+	return buf.Bytes()
+}
+
+// peerIndex keys the peers that can be encoded by public key
+func peerIndex(pf *PeersFile) map[string]PeerInfo {
+	idx := make(map[string]PeerInfo, len(pf.Peers))
+	for _, p := range pf.Peers {
+		if _, _, err := encodeSnapPeer(&p); err != nil {
+			log.Printf("[WARN] Skipping peer %s in delta: %v", p.PublicKey, err)
+			continue
+		}
+		idx[p.PublicKey] = p
+	}
+	return idx
+}
+
+func samePeer(a, b *PeerInfo) bool {
+	return a.Endpoint == b.Endpoint && a.Keepalive == b.Keepalive && slices.Equal(a.AllowedIPs, b.AllowedIPs)
+}
+
+// putPeers reserves the records turning prev into next
+func (r *DeltaRing) putPeers(prev, next map[string]PeerInfo) bool {
+	return diffPeers(prev, next, r.put)
+}
+
+// diffPeers emits the records turning prev into next: removals first, so a
+// prefix handed from a removed peer to another one is free when it arrives.
+// It stops when put fails.
+func diffPeers(prev, next map[string]PeerInfo, put func(typ uint16, payload []byte) bool) bool {
+	for key := range prev {
+		if _, ok := next[key]; ok {
+			continue
+		}
+		// peerIndex only keeps peers whose key decodes to 32 bytes
+		raw, _ := base64.StdEncoding.DecodeString(key)
+		if !put(deltaPeerRemove, raw) {
+			return false
+		}
+	}
+	for key, p := range next {
+		if old, ok := prev[key]; ok && samePeer(&old, &p) {
+			continue
+		}
+		rec, prefixes, _ := encodeSnapPeer(&p)
+		rec.PrefixCount = uint16(len(prefixes))
+		payload := append(encodeBinary(&rec), encodeBinary(prefixes)...)
+		if !put(deltaPeerSet, payload) {
+			return false
+		}
+	}
+	return true
+}
+
+// routeIndex keys the routes that can be encoded by network
+func routeIndex(rf *RoutesFile) map[string]deltaRoute {
+	idx := make(map[string]deltaRoute, len(rf.Routes))
+	for _, rt := range rf.Routes {
+		pfx, err := parsePrefix(rt.Network)
+		if err != nil {
+			log.Printf("[WARN] Skipping route %s in delta: %v", rt.Network, err)
+			continue
+		}
+		idx[rt.Network] = deltaRoute{Network: pfx, Metric: uint32(rt.Metric)}
+	}
+	return idx
+}
+
+// putRoutes reserves the records turning prev into next
+func (r *DeltaRing) putRoutes(prev, next map[string]deltaRoute) bool {
+	return diffRoutes(prev, next, r.put)
+}
+
+// diffRoutes emits the records turning prev into next; a changed metric is
+// a removal and an addition
+func diffRoutes(prev, next map[string]deltaRoute, put func(typ uint16, payload []byte) bool) bool {
+	for network, old := range prev {
+		if rt, ok := next[network]; ok && rt == old {
+			continue
+		}
+		if !put(deltaRouteRemove, encodeBinary(&old)) {
+			return false
+		}
+	}
+	for network, rt := range next {
+		if old, ok := prev[network]; ok && rt == old {
+			continue
+		}
+		if !put(deltaRouteAdd, encodeBinary(&rt)) {
+			return false
+		}
+	}
+	return true
+}
+
+// putResync reserves a record telling the client to reload the peer files
+func (r *DeltaRing) putResync() bool {
+	return r.reserve(deltaResync, 0) != nil
+}
+
+// putJournalSeq reserves the journal record the client is brought to, so it
+// does not read the records again after a detach
+func (r *DeltaRing) putJournalSeq(seq uint64) bool {
+	b := r.reserve(deltaJournalSeq, 8)
+	if b == nil {
+		return false
+	}
+	binary.LittleEndian.PutUint64(b, seq)
+	return true
+}
+
+// putRouteSync reserves the complete route set
+func (r *DeltaRing) putRouteSync(routes map[string]deltaRoute) bool {
+	return r.put(deltaRouteSync, routeSyncPayload(routes))
+}
+
+func routeSyncPayload(routes map[string]deltaRoute) []byte {
+	list := make([]deltaRoute, 0, len(routes))
+	for _, rt := range routes {
+		list = append(list, rt)
+	}
+	head := encodeBinary([2]uint32{uint32(len(list)), 0})
+	return append(head, encodeBinary(list)...)
+}
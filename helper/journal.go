@@ -0,0 +1,195 @@
+package main
+
+import (
+	"encoding/binary"
+	"fmt"
+	"hash/crc32"
+	"log"
+	"os"
+)
+
+// Change journal for the C client
+//
+// With -journal, peer and route changes are appended to peers.journal as
+// sequenced records in the delta ring's formats (c/include/journal.h)
+// instead of rewriting peers.json and peers.snap for every update. The C
+// client tails the journal from the last record it applied, so an update
+// it missed costs the records after it, not a reload of the whole map.
+//
+// Every -journal-compact records the journal is compacted: peers.snap is
+// written with the current state and the sequence number it holds, then a
+// new journal starting after that number is renamed over the old one.
+// Records are not fsynced; after a crash the client still has the last
+// snapshot and a journal that ends at a record boundary or a damaged one.
+
+const (
+	journalMagic      = "NBJRNL01"
+	journalVersion    = 1
+	journalHeaderSize = 64
+	journalRecordSize = 24
+	journalAlign      = 8
+	journalChecksumAt = 60 // Offset of the checksum in the header
+)
+
+// Journal is the writer side of peers.journal
+type Journal struct {
+	path    string
+	f       *os.File
+	compact int    // Records between compactions
+	seq     uint64 // Last record written
+	records int    // Records since the last compaction
+	failed  bool   // A write failed: compact before appending again
+
+	// State after seq; peers is nil until the first compaction
+	peers  map[string]PeerInfo
+	routes map[string]deltaRoute // nil if unknown
+}
+
+// openJournal continues the sequence numbers of a previous run. The state
+// they describe is unknown, so the first update compacts the journal.
+func openJournal(path, snapFile string, compact int) *Journal {
+	j := &Journal{path: path, compact: compact, seq: snapshotJournalSeq(snapFile)}
+	if seq := lastJournalSeq(path); seq > j.seq {
+		j.seq = seq
+	}
+	return j
+}
+
+// lastJournalSeq returns the sequence number of the last intact record, 0
+// if path is no journal
+func lastJournalSeq(path string) uint64 {
+	data, err := os.ReadFile(path)
+	if err != nil || len(data) < journalHeaderSize || string(data[:8]) != journalMagic {
+		return 0
+	}
+	seq := binary.LittleEndian.Uint64(data[16:])
+	for off := journalHeaderSize; off+journalRecordSize <= len(data); {
+		size := int(binary.LittleEndian.Uint32(data[off:]))
+		if size < journalRecordSize || size%journalAlign != 0 || off+size > len(data) ||
+			binary.LittleEndian.Uint64(data[off+8:]) != seq+1 ||
+			binary.LittleEndian.Uint32(data[off+16:]) != journalRecordChecksum(data[off:off+size]) {
+			break
+		}
+		seq++
+		off += size
+	}
+	return seq
+}
+
+func journalRecordChecksum(rec []byte) uint32 {
+	crc := crc32.Update(0, castagnoli, rec[:16])
+	return crc32.Update(crc, castagnoli, rec[journalRecordSize:])
+}
+
+func appendJournalRecord(buf []byte, seq uint64, typ uint16, payload []byte) []byte {
+	size := (journalRecordSize + len(payload) + journalAlign - 1) &^ (journalAlign - 1)
+	rec := make([]byte, size)
+	binary.LittleEndian.PutUint32(rec[0:], uint32(size))
+	binary.LittleEndian.PutUint16(rec[4:], typ)
+	binary.LittleEndian.PutUint64(rec[8:], seq)
+	copy(rec[journalRecordSize:], payload)
+	binary.LittleEndian.PutUint32(rec[16:], journalRecordChecksum(rec))
+	return append(buf, rec...)
+}
+
+// needsCompaction tells whether the next update must go through compaction
+func (j *Journal) needsCompaction() bool {
+	return j.peers == nil || j.failed || j.records >= j.compact
+}
+
+// append writes the records turning the journaled state into peers and
+// routes (nil: unchanged) with a single write
+func (j *Journal) append(peers *PeersFile, routes *RoutesFile) error {
+	var buf []byte
+	seq := j.seq
+	put := func(typ uint16, payload []byte) bool {
+		seq++
+		buf = appendJournalRecord(buf, seq, typ, payload)
+		return true
+	}
+
+	nextPeers, nextRoutes := j.peers, j.routes
+	if peers != nil {
+		nextPeers = peerIndex(peers)
+		diffPeers(j.peers, nextPeers, put)
+	}
+	if routes != nil {
+		nextRoutes = routeIndex(routes)
+		if j.routes == nil {
+			put(deltaRouteSync, routeSyncPayload(nextRoutes))
+		} else {
+			diffRoutes(j.routes, nextRoutes, put)
+		}
+	}
+	if len(buf) == 0 {
+		return nil
+	}
+
+	if _, err := j.f.Write(buf); err != nil {
+		j.failed = true
+		return fmt.Errorf("append to journal: %w", err)
+	}
+	j.records += int(seq - j.seq)
+	j.seq = seq
+	j.peers, j.routes = nextPeers, nextRoutes
+	return nil
+}
+
+// snapshotSeq returns the sequence number a snapshot of peers and routes
+// holds. The journal is brought up to that state first if it can be;
+// otherwise the snapshot takes a number of its own, so a client that went
+// further in the old journal still loads it.
+func (j *Journal) snapshotSeq(peers *PeersFile, routes *RoutesFile) uint64 {
+	if j.peers != nil && !j.failed {
+		if err := j.append(peers, routes); err == nil {
+			return j.seq
+		}
+	}
+	j.seq++
+	return j.seq
+}
+
+// restart replaces the journal with an empty one starting after base, the
+// sequence number of the snapshot just written. It opens with the route set
+// when it is known, for clients starting from the snapshot.
+func (j *Journal) restart(base uint64, peers *PeersFile, routes *RoutesFile) error {
+	hdr := make([]byte, journalHeaderSize)
+	copy(hdr, journalMagic)
+	binary.LittleEndian.PutUint32(hdr[8:], journalVersion)
+	binary.LittleEndian.PutUint32(hdr[12:], journalHeaderSize)
+	binary.LittleEndian.PutUint64(hdr[16:], base)
+	binary.LittleEndian.PutUint32(hdr[journalChecksumAt:], crc32.Checksum(hdr[:journalChecksumAt], castagnoli))
+
+	seq := base
+	var nextRoutes map[string]deltaRoute
+	if routes != nil {
+		nextRoutes = routeIndex(routes)
+		seq++
+		hdr = appendJournalRecord(hdr, seq, deltaRouteSync, routeSyncPayload(nextRoutes))
+	}
+
+	tmpFile := j.path + ".tmp"
+	f, err := os.OpenFile(tmpFile, os.O_WRONLY|os.O_CREATE|os.O_TRUNC|os.O_APPEND, 0600)
+	if err != nil {
+		return fmt.Errorf("create journal: %w", err)
+	}
+	if _, err := f.Write(hdr); err != nil {
+		f.Close()
+		return fmt.Errorf("write journal: %w", err)
+	}
+	if err := os.Rename(tmpFile, j.path); err != nil {
+		f.Close()
+		return fmt.Errorf("atomic rename: %w", err)
+	}
+
+	if j.f != nil {
+		j.f.Close()
+	}
+	j.f = f
+	j.seq = seq
+	j.records = 0
+	j.failed = false
+	j.peers, j.routes = peerIndex(peers), nextRoutes
+	log.Printf("Compacted %s at record %d", j.path, base)
+	return nil
+}
@@ -9,6 +9,8 @@ import (
 	"os"
 	"os/signal"
 	"path/filepath"
+	"strings"
+	"sync"
 	"syscall"
 	"time"
 
@@ -22,9 +24,15 @@ import (
 //
 // Communication: Shared JSON configuration files
 //   - Reads: config.json (setup key, URLs, etc.)
-//   - Writes: peers.json, routes.json
+//   - Writes: peers.json, routes.json, peers.snap (binary peers, see snapshot.go)
 //
 // The C client watches these files and updates WireGuard configuration.
+// With -delta-socket, changes are published to the client through a
+// shared-memory ring instead (see delta.go) and the files are only
+// written when the ring is full or the client goes away. With -journal,
+// changes are appended to peers.journal (see journal.go) and the files
+// are only written when it is compacted; with both, the ring tells the
+// client which journal record its changes bring it to.
 
 const (
 	DefaultConfigDir = "/etc/netbird"
@@ -71,29 +79,63 @@ type Helper struct {
 	configDir  string
 	config     *Config
 	peersFile  string
+	snapFile   string // Binary snapshot of peersFile, "" if disabled
 	routesFile string
 	running    bool
 	mgmtClient *ManagementClient
+
+	// Delta channel to the C client, "" if disabled
+	deltaSocket string
+
+	mu            sync.Mutex
+	delta         *DeltaRing
+	resyncPending bool       // The client must reload the files before further deltas
+	curPeers      *PeersFile // Latest state
+	curRoutes     *RoutesFile
+	pubPeers      map[string]PeerInfo   // State the client has been given
+	pubRoutes     map[string]deltaRoute // nil if unknown
+
+	journal *Journal // nil if disabled
 }
 
 func main() {
 	configDir := flag.String("config-dir", DefaultConfigDir, "Configuration directory")
 	daemon := flag.Bool("daemon", false, "Run as daemon")
+	snapshot := flag.Bool("snapshot", true, "Also write peers.snap (binary peers for the C client)")
+	convert := flag.String("convert", "", "Convert a peers.json file to <file>.snap and exit")
+	deltaSocket := flag.String("delta-socket", "", "Publish changes through the C client's DeltaSocket")
+	journal := flag.Bool("journal", false, "Append changes to peers.journal (the C client's JournalFile)")
+	journalCompact := flag.Int("journal-compact", 4096, "Compact peers.journal after this many records")
 	flag.Parse()
 
 	log.SetPrefix("[netbird-helper] ")
 	log.SetFlags(log.LstdFlags | log.Lshortfile)
 
+	if *convert != "" {
+		if err := convertPeersFile(*convert); err != nil {
+			log.Fatalf("Convert failed: %v", err)
+		}
+		return
+	}
+
 	if *daemon {
 		// TODO: Daemonize process
 		log.Println("Running as daemon")
 	}
 
 	helper := &Helper{
-		configDir:  *configDir,
-		peersFile:  filepath.Join(*configDir, "peers.json"),
-		routesFile: filepath.Join(*configDir, "routes.json"),
-		running:    true,
+		configDir:   *configDir,
+		peersFile:   filepath.Join(*configDir, "peers.json"),
+		routesFile:  filepath.Join(*configDir, "routes.json"),
+		running:     true,
+		deltaSocket: *deltaSocket,
+	}
+	if *snapshot || *journal {
+		helper.snapFile = filepath.Join(*configDir, "peers.snap")
+	}
+	if *journal {
+		// The journal continues peers.snap; it is written even with -snapshot=false
+		helper.journal = openJournal(filepath.Join(*configDir, "peers.journal"), helper.snapFile, *journalCompact)
 	}
 
 	// Load configuration
@@ -116,6 +158,9 @@ func main() {
 
 	// Start helper goroutine
 	go helper.run()
+	if helper.deltaSocket != "" {
+		go helper.runDelta()
+	}
 
 	// Wait for signal
 	sig := <-sigChan
@@ -339,11 +384,232 @@ func (h *Helper) updateStub() {
 }
 
 func (h *Helper) writePeers(peers *PeersFile) error {
-	return h.writeJSONAtomic(h.peersFile, peers)
+	h.mu.Lock()
+	defer h.mu.Unlock()
+
+	h.curPeers = peers
+	journaled := h.appendJournal(peers, nil)
+	if h.delta != nil && !h.resyncPending {
+		next := peerIndex(peers)
+		if h.publishDelta(func() bool { return h.delta.putPeers(h.pubPeers, next) && h.putJournalSeq(journaled) }) {
+			h.pubPeers = next
+			if h.journal != nil && !journaled {
+				return h.writeFiles() // Compaction
+			}
+			return nil
+		}
+	}
+	if journaled {
+		h.tryResync()
+		return nil
+	}
+	return h.writeFiles()
+}
+
+// convertPeersFile writes the snapshot of an existing peers.json
+func convertPeersFile(path string) error {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return fmt.Errorf("read peers: %w", err)
+	}
+
+	var peers PeersFile
+	if err := json.Unmarshal(data, &peers); err != nil {
+		return fmt.Errorf("parse peers: %w", err)
+	}
+
+	return writeSnapshotAtomic(strings.TrimSuffix(path, ".json")+".snap", &peers, 0)
 }
 
 func (h *Helper) writeRoutes(routes *RoutesFile) error {
-	return h.writeJSONAtomic(h.routesFile, routes)
+	h.mu.Lock()
+	defer h.mu.Unlock()
+
+	h.curRoutes = routes
+	journaled := h.appendJournal(nil, routes)
+	if h.delta != nil && !h.resyncPending {
+		next := routeIndex(routes)
+		if h.publishDelta(func() bool {
+			if h.pubRoutes == nil {
+				return h.delta.putRouteSync(next) && h.putJournalSeq(journaled)
+			}
+			return h.delta.putRoutes(h.pubRoutes, next) && h.putJournalSeq(journaled)
+		}) {
+			h.pubRoutes = next
+			if h.journal != nil && !journaled {
+				return h.writeFiles() // Compaction
+			}
+			return nil
+		}
+	}
+	if journaled {
+		h.tryResync()
+		return nil
+	}
+	return h.writeFiles()
+}
+
+// appendJournal appends the change to the journal. It returns false if
+// there is no journal or the change must go through compaction
+// (writeFiles). Called with h.mu held.
+func (h *Helper) appendJournal(peers *PeersFile, routes *RoutesFile) bool {
+	if h.journal == nil || h.journal.needsCompaction() {
+		return false
+	}
+	if err := h.journal.append(peers, routes); err != nil {
+		log.Printf("[WARN] %v, compacting", err)
+		return false
+	}
+	return true
+}
+
+// writeFiles writes the latest state and compacts the journal; with a
+// delta channel attached, the client is then told to reload it. Called
+// with h.mu held.
+func (h *Helper) writeFiles() error {
+	compact := h.journal != nil && h.curPeers != nil
+	var journalSeq uint64
+	if compact {
+		journalSeq = h.journal.snapshotSeq(h.curPeers, h.curRoutes)
+	}
+	if h.curPeers != nil {
+		if err := h.writeJSONAtomic(h.peersFile, h.curPeers); err != nil {
+			return err
+		}
+		if h.snapFile != "" {
+			if err := writeSnapshotAtomic(h.snapFile, h.curPeers, journalSeq); err != nil {
+				return err
+			}
+		}
+	}
+	if h.curRoutes != nil {
+		if err := h.writeJSONAtomic(h.routesFile, h.curRoutes); err != nil {
+			return err
+		}
+	}
+	// After the snapshot, so the client never finds a journal starting past it
+	if compact {
+		if err := h.journal.restart(journalSeq, h.curPeers, h.curRoutes); err != nil {
+			return err
+		}
+	}
+	h.tryResync()
+	// The client has all the compacted journal holds, through the ring or the resync
+	if compact && h.delta != nil && !h.resyncPending {
+		h.publishDelta(func() bool { return h.putJournalSeq(true) })
+	}
+	return nil
+}
+
+// putJournalSeq follows records the journal holds too with the journal's
+// last record (see deltaJournalSeq). Called with h.mu held.
+func (h *Helper) putJournalSeq(journaled bool) bool {
+	if !journaled || h.journal == nil {
+		return true
+	}
+	return h.delta.putJournalSeq(h.journal.seq)
+}
+
+// publishDelta publishes the records reserved by put. If they do not fit,
+// nothing is published and the files take over until the next resync.
+// Called with h.mu held.
+func (h *Helper) publishDelta(put func() bool) bool {
+	pos, seq := h.delta.mark()
+	if !put() {
+		h.delta.rollback(pos, seq)
+		h.delta.countResync()
+		h.resyncPending = true
+		log.Println("[WARN] Delta ring full, falling back to files")
+		return false
+	}
+	if err := h.delta.publish(); err != nil {
+		log.Printf("[WARN] Delta publish: %v", err)
+	}
+	return true
+}
+
+// tryResync tells the client to reload the files it was given and hands it
+// the complete route set. Called with h.mu held.
+func (h *Helper) tryResync() {
+	if h.delta == nil || !h.resyncPending || h.curPeers == nil {
+		return
+	}
+	var routes map[string]deltaRoute
+	if h.curRoutes != nil {
+		routes = routeIndex(h.curRoutes)
+	}
+	pos, seq := h.delta.mark()
+	if !h.delta.putResync() || (routes != nil && !h.delta.putRouteSync(routes)) {
+		h.delta.rollback(pos, seq)
+		return // Retried by runDelta
+	}
+	if err := h.delta.publish(); err != nil {
+		log.Printf("[WARN] Delta publish: %v", err)
+	}
+	h.pubPeers = peerIndex(h.curPeers)
+	h.pubRoutes = routes
+	h.resyncPending = false
+}
+
+// runDelta keeps the delta channel attached to the C client
+func (h *Helper) runDelta() {
+	ticker := time.NewTicker(time.Second)
+	defer ticker.Stop()
+
+	warned := false
+	for h.running {
+		ring, err := dialDeltaRing(h.deltaSocket)
+		if err != nil {
+			if !warned {
+				log.Printf("[WARN] Delta channel unavailable (%v), retrying", err)
+				warned = true
+			}
+			<-ticker.C
+			continue
+		}
+		warned = false
+
+		// The client starts from the files; bring them up to date
+		h.mu.Lock()
+		h.delta = ring
+		h.resyncPending = true
+		h.pubPeers, h.pubRoutes = nil, nil
+		if err := h.writeFiles(); err != nil {
+			log.Printf("[ERROR] Failed to write files: %v", err)
+		}
+		h.mu.Unlock()
+		log.Printf("Attached to delta channel %s", h.deltaSocket)
+
+		done := make(chan struct{})
+		go func() {
+			ring.Wait()
+			close(done)
+		}()
+	attached:
+		for h.running {
+			select {
+			case <-done:
+				break attached
+			case <-ticker.C:
+				h.mu.Lock()
+				h.tryResync()
+				h.mu.Unlock()
+			}
+		}
+
+		// Until the next attach the client reads the files again; the
+		// journal already has everything
+		h.mu.Lock()
+		h.delta = nil
+		if h.journal == nil {
+			if err := h.writeFiles(); err != nil {
+				log.Printf("[ERROR] Failed to write files: %v", err)
+			}
+		}
+		h.mu.Unlock()
+		ring.Close()
+		log.Printf("Detached from delta channel %s", h.deltaSocket)
+	}
 }
 
 func (h *Helper) writeJSONAtomic(path string, data interface{}) error {
@@ -0,0 +1,227 @@
+package main
+
+import (
+	"bytes"
+	"encoding/base64"
+	"encoding/binary"
+	"fmt"
+	"hash/crc32"
+	"log"
+	"net/netip"
+	"os"
+	"strings"
+)
+
+// Binary peer snapshot
+//
+// Same content as peers.json in a form the C client maps and reads in
+// place (c/include/peers_snap.h): fixed-size peer records with raw keys
+// and packed endpoints, a table of packed prefixes and a string table,
+// protected by a CRC-32C. Integers are little endian, addresses and ports
+// in network byte order.
+
+const (
+	snapMagic      = "NBPSNAP1"
+	snapVersion    = 1
+	snapHeaderSize = 64
+	snapPeerSize   = 64
+	snapPrefixSize = 18
+	snapChecksumAt = 60 // Offset of the checksum in the header
+
+	// Linux address families, as stored in the file
+	afInet  = 2
+	afInet6 = 10
+)
+
+var castagnoli = crc32.MakeTable(crc32.Castagnoli)
+
+type snapHeader struct {
+	Magic       [8]byte
+	Version     uint32
+	HeaderSize  uint32
+	PeerSize    uint32
+	PrefixSize  uint32
+	PeerCount   uint32
+	PrefixCount uint32
+	StringsSize uint32
+	UpdatedAt   uint32 // String offset
+	JournalSeq  uint64 // Last journal record folded in (see journal.go)
+	Reserved    [12]byte
+	Checksum    uint32
+}
+
+type snapPeer struct {
+	PublicKey      [32]byte
+	EndpointAddr   [16]byte
+	EndpointPort   [2]byte // Network byte order
+	EndpointFamily uint8
+	Flags          uint8
+	Keepalive      uint16
+	PrefixCount    uint16
+	PrefixFirst    uint32
+	ID             uint32 // String offset
+}
+
+type snapPrefix struct {
+	Family uint8
+	Len    uint8
+	Addr   [16]byte
+}
+
+// encodePeersSnapshot serializes the peers; invalid peers are skipped
+func encodePeersSnapshot(pf *PeersFile, journalSeq uint64) ([]byte, error) {
+	var peers []snapPeer
+	var prefixes []snapPrefix
+	strs := []byte{0} // Offset 0 is the empty string
+
+	addString := func(s string) uint32 {
+		if s == "" {
+			return 0
+		}
+		off := uint32(len(strs))
+		strs = append(append(strs, s...), 0)
+		return off
+	}
+
+	hdr := snapHeader{
+		Version:    snapVersion,
+		HeaderSize: snapHeaderSize,
+		PeerSize:   snapPeerSize,
+		PrefixSize: snapPrefixSize,
+		JournalSeq: journalSeq,
+	}
+	copy(hdr.Magic[:], snapMagic)
+	hdr.UpdatedAt = addString(pf.UpdatedAt)
+
+	for _, p := range pf.Peers {
+		rec, pfx, err := encodeSnapPeer(&p)
+		if err != nil {
+			log.Printf("[WARN] Skipping peer %s in snapshot: %v", p.PublicKey, err)
+			continue
+		}
+		rec.PrefixFirst = uint32(len(prefixes))
+		rec.ID = addString(p.ID)
+		peers = append(peers, rec)
+		prefixes = append(prefixes, pfx...)
+	}
+	hdr.PeerCount = uint32(len(peers))
+	hdr.PrefixCount = uint32(len(prefixes))
+	hdr.StringsSize = uint32(len(strs))
+
+	var buf bytes.Buffer
+	buf.Grow(snapHeaderSize + len(peers)*snapPeerSize + len(prefixes)*snapPrefixSize + len(strs))
+	for _, v := range []interface{}{&hdr, peers, prefixes} {
+		if err := binary.Write(&buf, binary.LittleEndian, v); err != nil {
+			return nil, fmt.Errorf("encode snapshot: %w", err)
+		}
+	}
+	buf.Write(strs)
+
+	data := buf.Bytes()
+	crc := crc32.Update(0, castagnoli, data[:snapChecksumAt])
+	crc = crc32.Update(crc, castagnoli, data[snapHeaderSize:])
+	binary.LittleEndian.PutUint32(data[snapChecksumAt:], crc)
+	return data, nil
+}
+
+func encodeSnapPeer(p *PeerInfo) (snapPeer, []snapPrefix, error) {
+	var rec snapPeer
+
+	key, err := base64.StdEncoding.DecodeString(p.PublicKey)
+	if err != nil || len(key) != len(rec.PublicKey) {
+		return rec, nil, fmt.Errorf("invalid public key")
+	}
+	copy(rec.PublicKey[:], key)
+
+	if p.Endpoint != "" {
+		ap, err := netip.ParseAddrPort(p.Endpoint)
+		if err != nil || ap.Addr().Zone() != "" || ap.Port() == 0 {
+			return rec, nil, fmt.Errorf("invalid endpoint %q", p.Endpoint)
+		}
+		rec.EndpointFamily, rec.EndpointAddr = packAddr(ap.Addr())
+		binary.BigEndian.PutUint16(rec.EndpointPort[:], ap.Port())
+	}
+
+	if p.Keepalive > 0 && p.Keepalive <= 0xffff {
+		rec.Keepalive = uint16(p.Keepalive)
+	}
+
+	var prefixes []snapPrefix
+	for _, entry := range p.AllowedIPs {
+		for _, s := range strings.Split(entry, ",") {
+			pfx, err := parsePrefix(strings.TrimSpace(s))
+			if err != nil {
+				return rec, nil, err
+			}
+			prefixes = append(prefixes, pfx)
+		}
+	}
+	if len(prefixes) > 0xffff {
+		return rec, nil, fmt.Errorf("too many allowed IPs")
+	}
+	rec.PrefixCount = uint16(len(prefixes))
+	return rec, prefixes, nil
+}
+
+// parsePrefix accepts "addr/len" or a bare address (a host prefix)
+func parsePrefix(s string) (snapPrefix, error) {
+	var pfx snapPrefix
+
+	p, err := netip.ParsePrefix(s)
+	if err != nil {
+		addr, aerr := netip.ParseAddr(s)
+		if aerr != nil || addr.Zone() != "" {
+			return pfx, fmt.Errorf("invalid allowed IP %q", s)
+		}
+		p = netip.PrefixFrom(addr, addr.BitLen())
+	}
+	pfx.Family, pfx.Addr = packAddr(p.Addr())
+	pfx.Len = uint8(p.Bits())
+	return pfx, nil
+}
+
+func packAddr(a netip.Addr) (uint8, [16]byte) {
+	var out [16]byte
+	if a.Is4() {
+		b := a.As4()
+		copy(out[:], b[:])
+		return afInet, out
+	}
+	return afInet6, a.As16()
+}
+
+// writeSnapshotAtomic writes the snapshot to a temp file and renames it,
+// so the C client never maps a half-written file
+func writeSnapshotAtomic(path string, pf *PeersFile, journalSeq uint64) error {
+	data, err := encodePeersSnapshot(pf, journalSeq)
+	if err != nil {
+		return err
+	}
+
+	tmpFile := path + ".tmp"
+	if err := os.WriteFile(tmpFile, data, 0600); err != nil {
+		return fmt.Errorf("write temp file: %w", err)
+	}
+	if err := os.Rename(tmpFile, path); err != nil {
+		return fmt.Errorf("atomic rename: %w", err)
+	}
+
+	log.Printf("Wrote %s", path)
+	return nil
+}
+
+// snapshotJournalSeq reads the journal sequence number of a snapshot, 0 if
+// there is none
+func snapshotJournalSeq(path string) uint64 {
+	f, err := os.Open(path)
+	if err != nil {
+		return 0
+	}
+	defer f.Close()
+
+	var hdr snapHeader
+	if binary.Read(f, binary.LittleEndian, &hdr) != nil || string(hdr.Magic[:]) != snapMagic {
+		return 0
+	}
+	return hdr.JournalSeq
+}